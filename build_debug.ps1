@@ -25,9 +25,73 @@ if($pch_source.LastWriteTime -gt $pch.LastWriteTime)
     -o "$output_path\cnewsetup.h.pch"
 }
 
+# shaders, fxc writes them to generated\ as C arrays the game code includes
+$generated_path = "$output_path\generated"
+if(!(Test-Path $generated_path))
+{
+    new-item $generated_path -ItemType "directory"
+}
+
+$fxc = (Get-Item "$PSScriptRoot\bin\compiler\fxc.exe" -ErrorAction SilentlyContinue)
+if(!$fxc)
+{
+    $fxc = (Get-ChildItem "${env:ProgramFiles(x86)}\Windows Kits\10\bin\*\x64\fxc.exe" -ErrorAction SilentlyContinue | Sort-Object FullName | Select-Object -Last 1)
+}
+
+$shader_sources = @((Get-Item "$PSScriptRoot\source\imgui_shaders.hlsl"), (Get-Item "$PSScriptRoot\source\bindless.hlsli"))
+$newest_shader_source = ($shader_sources | Sort-Object LastWriteTime | Select-Object -Last 1).LastWriteTime
+$shaders = @(
+    @{ source = "imgui_shaders.hlsl"; entry = "vs_main"; profile = "vs_5_1"; name = "imgui_vs" },
+    @{ source = "imgui_shaders.hlsl"; entry = "ps_main"; profile = "ps_5_1"; name = "imgui_ps" },
+    @{ source = "bindless.hlsli"; entry = "BINDLESS_ROOT_SIGNATURE"; profile = "rootsig_1_1"; name = "bindless_rootsig" }
+)
+
+if(!$fxc)
+{
+    Write-Host "fxc.exe not found, ImGui shaders and the root signature will be compiled at runtime" -ForegroundColor Yellow
+}
+else
+{
+    foreach($shader in $shaders)
+    {
+        $header = (Get-Item "$generated_path\$($shader.name).h" -ErrorAction SilentlyContinue)
+        if($header -and $header.LastWriteTime -gt $newest_shader_source)
+        {
+            continue
+        }
+
+        Write-Host $shader.source "was modified, compiling $($shader.name).h" -ForegroundColor Cyan
+        &$fxc /nologo /O3 /T $shader.profile /E $shader.entry /Vn "$($shader.name)_bytecode" `
+        /Fh "$generated_path\$($shader.name).h" `
+        "$PSScriptRoot\source\$($shader.source)"
+    }
+}
+
 # game_code
 $gamecode_source_path = "$PSScriptRoot\source"
-$gamecode_source_files = @((Get-Item "$PSScriptRoot\source\game_code.c"), (Get-Item "$PSScriptRoot\source\imgui_impl_dx12.c"), (Get-Item "$PSScriptRoot\source\imgui_impl_win32.c"))
+$gamecode_source_files = @((Get-Item "$PSScriptRoot\source\game_code.c"), (Get-Item "$PSScriptRoot\source\imgui_impl_dx12.c"), (Get-Item "$PSScriptRoot\source\imgui_impl_win32.c"),
+(Get-Item "$PSScriptRoot\source\threading.c"), (Get-Item "$PSScriptRoot\source\job_system.c"), (Get-Item "$PSScriptRoot\source\arena.c"), (Get-Item "$PSScriptRoot\source\spsc_queue.c"), (Get-Item "$PSScriptRoot\source\frame_pipeline.c"),
+(Get-Item "$PSScriptRoot\source\input.c"),
+(Get-Item "$PSScriptRoot\source\bindless.c"),
+(Get-Item "$PSScriptRoot\source\upload_ring.c"),
+(Get-Item "$PSScriptRoot\source\ui_batch.c"),
+(Get-Item "$PSScriptRoot\source\frame_scheduler.c"),
+(Get-Item "$PSScriptRoot\source\imgui_shaders.hlsl"), (Get-Item "$PSScriptRoot\source\bindless.hlsli"),
+(Get-Item "$PSScriptRoot\source\font_cache.c"),
+(Get-Item "$PSScriptRoot\source\pool_alloc.c"),
+(Get-Item "$PSScriptRoot\source\alloc_track.c"),
+(Get-Item "$PSScriptRoot\source\vecmath.c"),
+(Get-Item "$PSScriptRoot\source\scene.c"),
+(Get-Item "$PSScriptRoot\source\mesh_renderer.c"),
+(Get-Item "$PSScriptRoot\source\cull.c"),
+(Get-Item "$PSScriptRoot\source\bvh.c"),
+(Get-Item "$PSScriptRoot\source\draw_queue.c"),
+(Get-Item "$PSScriptRoot\source\vertex_format.c"), (Get-Item "$PSScriptRoot\source\vertex_format.hlsli"),
+(Get-Item "$PSScriptRoot\source\mesh_blob.c"),
+(Get-Item "$PSScriptRoot\source\lod.c"),
+(Get-Item "$PSScriptRoot\source\meshlet.c"),
+(Get-Item "$PSScriptRoot\source\asset_archive.c"),
+(Get-Item "$PSScriptRoot\source\lz_block.c"))
 $last_gamecode_compilation_output = (Get-Item "$output_path\game_code.dll" -ErrorAction SilentlyContinue)
 
 foreach($file in $gamecode_source_files)
@@ -51,11 +115,12 @@ foreach($file in $gamecode_source_files)
     }
             
     $pre_compilation = (Get-Date)
+    # imgui_impl_dx12.c only builds as part of game_code.c, it uses the modules included before it
     &$compiler -std=c11 -gfull -c -Weverything -include "$PSScriptRoot\source\cnewsetup.h" `
+    -I "$output_path" `
     -D "CIMGUI_DEFINE_ENUMS_AND_STRUCTS" `
     -D "CINTERFACE" `
     "$PSScriptRoot\source\game_code.c" `
-    "$PSScriptRoot\source\imgui_impl_dx12.c" `
     "$PSScriptRoot\source\imgui_impl_win32.c"
 
     $post_compilation = (Get-Date)
@@ -66,8 +131,7 @@ foreach($file in $gamecode_source_files)
     &$linker -dll -debug -subsystem:windows -defaultlib:libcmt `
     -libpath:"$PSScriptRoot\bin\dependencies" `
     "$output_path\game_code.o" `
-    "$output_path\imgui_impl_win32.o" `
-    "$output_path\imgui_impl_dx12.o"
+    "$output_path\imgui_impl_win32.o"
 
     $post_linking = (Get-Date)
     $link_time = New-TimeSpan Start $pre_linking End $post_linking
@@ -0,0 +1,264 @@
+// Heap allocation tracking.
+// The macros at the end of this file send every malloc, calloc, realloc and free of the unity build
+// through here, so it is included before any other module. Calls are counted per thread and per zone,
+// the zone being whatever the calling thread last entered with alloc_zone_enter(), and alloc_track_frame()
+// turns the running totals into per-frame numbers. Builds without NDEBUG also count per call site.
+// Only code compiled into the unity build is seen: the CRT's own allocations, cimgui.lib and the D3D
+// runtime and debug layer use their heaps directly. ImGui is covered by pool_alloc.c's statistics.
+// Blocks carry no header, a tracked block freed by untracked code or the other way around only skews
+// the counts.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#if defined(_WIN32)
+#include <malloc.h>
+#endif
+
+#if !defined(NDEBUG)
+#define ALLOC_TRACK_SITES 1
+#else
+#define ALLOC_TRACK_SITES 0
+#endif
+
+#define ALLOC_TRACK_MAX_THREADS 64
+#define ALLOC_TRACK_MAX_SITES 1024 // power of two
+
+#define ALLOC_ZONES(X)               \
+	X(OTHER, "other")            \
+	X(STARTUP, "startup")        \
+	X(SIMULATION, "simulation")  \
+	X(RENDER, "render")          \
+	X(RESIZE, "resize")
+
+enum alloc_zone
+{
+#define ALLOC_ZONE_ENUM(id, name) ALLOC_ZONE_##id,
+	ALLOC_ZONES(ALLOC_ZONE_ENUM)
+#undef ALLOC_ZONE_ENUM
+	ALLOC_ZONE_COUNT,
+};
+
+static const char* alloc_zone_names[ALLOC_ZONE_COUNT] = {
+#define ALLOC_ZONE_NAME(id, name) name,
+	ALLOC_ZONES(ALLOC_ZONE_NAME)
+#undef ALLOC_ZONE_NAME
+};
+
+// allocs counts malloc, calloc and every realloc, frees counts free and realloc to zero
+struct alloc_counts
+{
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t bytes;
+};
+
+// Written only by its thread, read by the frame thread.
+struct alloc_thread
+{
+	const char* name;
+	_Atomic uint64_t allocs[ALLOC_ZONE_COUNT];
+	_Atomic uint64_t frees[ALLOC_ZONE_COUNT];
+	_Atomic uint64_t bytes[ALLOC_ZONE_COUNT];
+	struct alloc_counts seen[ALLOC_ZONE_COUNT]; // totals at the last alloc_track_frame()
+};
+
+struct alloc_site
+{
+	_Atomic uint64_t key; // published last, 0 while free
+	const char* file;
+	uint32_t line;
+	_Atomic uint64_t allocs;
+	_Atomic uint64_t bytes;
+	uint64_t seen_allocs;
+	uint64_t frame_allocs;
+};
+
+static struct
+{
+	struct alloc_thread threads[ALLOC_TRACK_MAX_THREADS];
+	_Atomic uint32_t thread_count;
+	struct alloc_site sites[ALLOC_TRACK_MAX_SITES];
+	atomic_flag site_lock;
+	_Atomic uint32_t dropped_sites; // table full
+
+	// per frame, filled by alloc_track_frame()
+	struct alloc_counts frame_threads[ALLOC_TRACK_MAX_THREADS];
+	struct alloc_counts frame_zones[ALLOC_ZONE_COUNT];
+	struct alloc_counts frame_total;
+	uint64_t frame_count;
+	uint64_t clean_frames; // consecutive frames without an allocation
+	const struct alloc_site* frame_top_site;
+} g_alloc_track;
+
+static _Thread_local int32_t t_alloc_thread = -1;
+static _Thread_local uint32_t t_alloc_zone = ALLOC_ZONE_OTHER;
+
+static struct alloc_thread* alloc_track_thread(void)
+{
+	if (t_alloc_thread < 0) {
+		uint32_t index = atomic_fetch_add_explicit(&g_alloc_track.thread_count, 1, memory_order_relaxed);
+		if (index >= ALLOC_TRACK_MAX_THREADS) {
+			atomic_store_explicit(&g_alloc_track.thread_count, ALLOC_TRACK_MAX_THREADS, memory_order_relaxed);
+			index = ALLOC_TRACK_MAX_THREADS - 1; // shared overflow slot, counts may be lost
+		}
+		t_alloc_thread = (int32_t)index;
+	}
+	return &g_alloc_track.threads[t_alloc_thread];
+}
+
+// Single writer, a plain load and store is enough and skips the locked add.
+static inline void alloc_track_add(_Atomic uint64_t* counter, uint64_t value)
+{
+	atomic_store_explicit(counter, atomic_load_explicit(counter, memory_order_relaxed) + value, memory_order_relaxed);
+}
+
+static struct alloc_site* alloc_track_site(const char* file, uint32_t line)
+{
+	uint64_t key = ((uint64_t)(uintptr_t)file * 0x9e3779b97f4a7c15ull) ^ line;
+	key |= 1; // never 0
+	uint32_t slot = (uint32_t)(key >> 32) & (ALLOC_TRACK_MAX_SITES - 1);
+	for (uint32_t probe = 0; probe < ALLOC_TRACK_MAX_SITES; ++probe) {
+		struct alloc_site* site = &g_alloc_track.sites[(slot + probe) & (ALLOC_TRACK_MAX_SITES - 1)];
+		uint64_t site_key = atomic_load_explicit(&site->key, memory_order_acquire);
+		if (site_key == key && site->file == file && site->line == line) return site;
+		if (site_key != 0) continue;
+
+		// claim under the lock, another thread may be taking this slot for the same site
+		while (atomic_flag_test_and_set_explicit(&g_alloc_track.site_lock, memory_order_acquire)) {}
+		site_key = atomic_load_explicit(&site->key, memory_order_relaxed);
+		if (site_key == 0) {
+			site->file = file;
+			site->line = line;
+			atomic_store_explicit(&site->key, key, memory_order_release);
+			site_key = key;
+		}
+		atomic_flag_clear_explicit(&g_alloc_track.site_lock, memory_order_release);
+		if (site_key == key && site->file == file && site->line == line) return site;
+	}
+	atomic_fetch_add_explicit(&g_alloc_track.dropped_sites, 1, memory_order_relaxed);
+	return NULL;
+}
+
+static void alloc_track_count(size_t size, bool allocated, bool freed, const char* file, uint32_t line)
+{
+	struct alloc_thread* thread = alloc_track_thread();
+	uint32_t zone = t_alloc_zone;
+	if (allocated) {
+		alloc_track_add(&thread->allocs[zone], 1);
+		alloc_track_add(&thread->bytes[zone], size);
+	}
+	if (freed) alloc_track_add(&thread->frees[zone], 1);
+
+#if ALLOC_TRACK_SITES
+	if (allocated && file) {
+		struct alloc_site* site = alloc_track_site(file, line);
+		if (site) {
+			atomic_fetch_add_explicit(&site->allocs, 1, memory_order_relaxed);
+			atomic_fetch_add_explicit(&site->bytes, size, memory_order_relaxed);
+		}
+	}
+#else
+	(void)file;
+	(void)line;
+#endif
+}
+
+void* alloc_track_malloc(size_t size, const char* file, uint32_t line)
+{
+	alloc_track_count(size, true, false, file, line);
+	return malloc(size);
+}
+
+void* alloc_track_calloc(size_t count, size_t size, const char* file, uint32_t line)
+{
+	alloc_track_count(count * size, true, false, file, line);
+	return calloc(count, size);
+}
+
+void* alloc_track_realloc(void* p, size_t size, const char* file, uint32_t line)
+{
+	alloc_track_count(size, size != 0, p != NULL && size == 0, file, line);
+	return realloc(p, size);
+}
+
+void alloc_track_free(void* p, const char* file, uint32_t line)
+{
+	if (p) alloc_track_count(0, false, true, file, line);
+	free(p);
+}
+
+// Returns the zone the thread was in, pass it back to leave.
+uint32_t alloc_zone_enter(uint32_t zone)
+{
+	uint32_t previous = t_alloc_zone;
+	t_alloc_zone = zone;
+	return previous;
+}
+
+// For the panel, the pointer must stay valid.
+void alloc_track_name_thread(const char* name)
+{
+	alloc_track_thread()->name = name;
+}
+
+// Once per frame on the frame thread, closes the counts since the last call. Other threads keep
+// counting meanwhile, their allocations land in whichever frame reads them first.
+void alloc_track_frame(void)
+{
+	memset(g_alloc_track.frame_threads, 0, sizeof(g_alloc_track.frame_threads));
+	memset(g_alloc_track.frame_zones, 0, sizeof(g_alloc_track.frame_zones));
+	memset(&g_alloc_track.frame_total, 0, sizeof(g_alloc_track.frame_total));
+
+	uint32_t thread_count = atomic_load_explicit(&g_alloc_track.thread_count, memory_order_relaxed);
+	for (uint32_t t = 0; t < thread_count; ++t) {
+		struct alloc_thread* thread = &g_alloc_track.threads[t];
+		for (uint32_t zone = 0; zone < ALLOC_ZONE_COUNT; ++zone) {
+			struct alloc_counts now = {
+				.allocs = atomic_load_explicit(&thread->allocs[zone], memory_order_relaxed),
+				.frees = atomic_load_explicit(&thread->frees[zone], memory_order_relaxed),
+				.bytes = atomic_load_explicit(&thread->bytes[zone], memory_order_relaxed),
+			};
+			struct alloc_counts delta = {
+				.allocs = now.allocs - thread->seen[zone].allocs,
+				.frees = now.frees - thread->seen[zone].frees,
+				.bytes = now.bytes - thread->seen[zone].bytes,
+			};
+			thread->seen[zone] = now;
+
+			struct alloc_counts* sums[3] = {&g_alloc_track.frame_threads[t], &g_alloc_track.frame_zones[zone], &g_alloc_track.frame_total};
+			for (int i = 0; i < 3; ++i) {
+				sums[i]->allocs += delta.allocs;
+				sums[i]->frees += delta.frees;
+				sums[i]->bytes += delta.bytes;
+			}
+		}
+	}
+
+	g_alloc_track.frame_top_site = NULL;
+	for (uint32_t i = 0; i < ALLOC_TRACK_MAX_SITES; ++i) {
+		struct alloc_site* site = &g_alloc_track.sites[i];
+		if (!atomic_load_explicit(&site->key, memory_order_acquire)) continue;
+		uint64_t allocs = atomic_load_explicit(&site->allocs, memory_order_relaxed);
+		site->frame_allocs = allocs - site->seen_allocs;
+		site->seen_allocs = allocs;
+		if (site->frame_allocs && (!g_alloc_track.frame_top_site || site->frame_allocs > g_alloc_track.frame_top_site->frame_allocs))
+			g_alloc_track.frame_top_site = site;
+	}
+
+	g_alloc_track.frame_count++;
+	g_alloc_track.clean_frames = g_alloc_track.frame_total.allocs ? 0 : g_alloc_track.clean_frames + 1;
+}
+
+// Everything from here on allocates through the tracker.
+#if ALLOC_TRACK_SITES
+#define ALLOC_SITE __FILE__, __LINE__
+#else
+#define ALLOC_SITE NULL, 0
+#endif
+#define malloc(size) alloc_track_malloc((size), ALLOC_SITE)
+#define calloc(count, size) alloc_track_calloc((count), (size), ALLOC_SITE)
+#define realloc(p, size) alloc_track_realloc((p), (size), ALLOC_SITE)
+#define free(p) alloc_track_free((p), ALLOC_SITE)
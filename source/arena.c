@@ -0,0 +1,66 @@
+// Linear arena. Allocations are bump-pointer and only released all at once by arena_reset().
+// arena_reserve() grows the block while it is empty, so per-frame users size it up front
+// and never reallocate under live pointers.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+struct arena
+{
+	uint8_t* base;
+	size_t size;
+	size_t used;
+	size_t high_water;
+};
+
+bool arena_init(struct arena* arena, size_t size)
+{
+	arena->base = malloc(size);
+	arena->size = arena->base ? size : 0;
+	arena->used = 0;
+	arena->high_water = 0;
+	return arena->base != NULL;
+}
+
+void arena_free(struct arena* arena)
+{
+	free(arena->base);
+	arena->base = NULL;
+	arena->size = 0;
+	arena->used = 0;
+}
+
+void arena_reset(struct arena* arena)
+{
+	arena->used = 0;
+}
+
+// Makes sure `size` bytes fit, growing geometrically. Only valid on an empty arena.
+bool arena_reserve(struct arena* arena, size_t size)
+{
+	if (size <= arena->size) return true;
+	if (arena->used != 0) return false;
+
+	size_t new_size = arena->size ? arena->size : 4096;
+	while (new_size < size)
+		new_size *= 2;
+
+	uint8_t* base = malloc(new_size);
+	if (!base) return false;
+	free(arena->base);
+	arena->base = base;
+	arena->size = new_size;
+	return true;
+}
+
+// align must be a power of two, returns NULL when the arena is full
+void* arena_push(struct arena* arena, size_t size, size_t align)
+{
+	size_t offset = (arena->used + align - 1) & ~(align - 1);
+	if (offset + size > arena->size) return NULL;
+	arena->used = offset + size;
+	if (arena->used > arena->high_water) arena->high_water = arena->used;
+	return arena->base + offset;
+}
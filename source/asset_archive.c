@@ -0,0 +1,335 @@
+// Packed asset archive, what tools/asset_packer.c writes and the game maps instead of loose files.
+// One file: the header, a table of contents sorted by asset id, the names, the block tables, then
+// the payloads, each starting on a 4 KiB boundary so an asset's pages are its own. Nothing is
+// parsed or copied when it is opened: the file is mapped and the header and entries are used where
+// they lie. A lookup is a binary search of the ids, so startup touches the header's page, the
+// table's and then only the pages of the payloads it reads, asset_archive_prefetch() asking for
+// each in one go. Links inside the archive are struct asset_ref, an offset from the field itself,
+// and hold wherever the file is mapped; cooked formats stored in it (mesh_blob.c's) use offsets
+// from their own start and are read in place the same way.
+// An asset's id is asset_id() of its path relative to the packed root, '/' separated and case
+// folded. Every payload carries asset_hash() of its bytes, checked on demand as that reads them all.
+// A large payload may be stored compressed instead, cut into blocks of block_size bytes that
+// lz_block.c compresses on their own, a block that would not shrink stored as it is. The entry's
+// block table gives where each starts in the stored bytes, so asset_entry_read() decodes them in
+// parallel straight into the destination. Such a payload cannot be read in place.
+// Plain C, mapped with MapViewOfFile on Windows and mmap elsewhere; the packer includes it too.
+// Requires threading.c for time_now_ns(), job_system.c, lz_block.c.
+
+#if defined(_WIN32)
+typedef wchar_t asset_char;
+#else
+#include <fcntl.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#include <unistd.h>
+typedef char asset_char;
+#endif
+
+#define ASSET_ARCHIVE_MAGIC 0x314b4150u // "PAK1"
+#define ASSET_ARCHIVE_VERSION 2
+#define ASSET_ARCHIVE_ALIGNMENT 4096 // of every payload, a page on both platforms
+#define ASSET_ARCHIVE_MAX_NAME 260
+#define ASSET_BLOCK_MIN (64u * 1024u)  // sizes of a compressed payload's blocks: large enough to compress
+#define ASSET_BLOCK_MAX (256u * 1024u) // well, small enough that an asset is spread over the workers
+#define ASSET_COPY_CHUNK (128u * 1024u) // an uncompressed payload is copied in parallel in these
+
+// Offset in bytes from the ref to what it points at, 0 for none.
+struct asset_ref
+{
+	int64_t offset;
+};
+
+// One of a compressed payload's blocks, compressed unless size is the bytes it decodes to.
+struct asset_block
+{
+	uint32_t offset; // in the stored bytes, the blocks are in order and back to back
+	uint32_t size;
+};
+
+struct asset_entry
+{
+	uint64_t id;   // asset_id() of the name
+	uint64_t hash; // asset_hash() of the payload, decompressed
+	struct asset_ref data; // the stored bytes, ASSET_ARCHIVE_ALIGNMENT aligned from the start of the file
+	uint64_t size;         // of the payload
+	uint64_t stored_size;  // of the stored bytes, size unless compressed
+	struct asset_ref blocks; // one struct asset_block per block_size bytes of the payload when compressed
+	struct asset_ref name;   // NUL terminated, for tools and messages
+	uint32_t name_length;
+	uint32_t block_size; // 0 when the payload is stored as it is
+};
+
+struct asset_archive_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t file_size;
+	uint32_t entry_count;
+	uint32_t pad;
+	struct asset_ref entries; // ids ascending and unique
+	uint64_t payload_bytes;   // of all entries, without the alignment
+	uint64_t stored_bytes;    // what they take in the file, as compressed
+};
+
+_Static_assert(sizeof(struct asset_block) == 8 && sizeof(struct asset_entry) == 64 && sizeof(struct asset_archive_header) == 48, "the archive layout is fixed");
+
+struct asset_archive
+{
+	const uint8_t* view;
+	uint64_t size;
+	const struct asset_archive_header* header;
+	const struct asset_entry* entries;
+	uint64_t open_ns; // map and validate
+};
+
+static inline const void* asset_ref_get(const struct asset_ref* ref)
+{
+	return ref->offset ? (const uint8_t*)ref + ref->offset : NULL;
+}
+
+// FNV-1a of the path with '\\' as '/' and ASCII upper case folded, so both spellings find it.
+uint64_t asset_id(const char* path)
+{
+	uint64_t h = 0xcbf29ce484222325ull;
+	for (const char* c = path; *c; ++c) {
+		char folded = *c == '\\' ? '/' : *c >= 'A' && *c <= 'Z' ? (char)(*c - 'A' + 'a') : *c;
+		h = (h ^ (uint8_t)folded) * 0x100000001b3ull;
+	}
+	return h;
+}
+
+static inline uint64_t asset_hash_round(uint64_t h, uint64_t word)
+{
+	h += word * 0xc2b2ae3d27d4eb4full;
+	h = (h << 31) | (h >> 33);
+	return h * 0x9e3779b97f4a7c15ull;
+}
+
+// Content hash stored in the archive, so fixed once written, unlike frame_hash_bytes(). xxHash64's
+// round over four lanes of 8 bytes, which keeps up with a cold read of the file.
+uint64_t asset_hash(const void* data, uint64_t size)
+{
+	const uint8_t* p = data;
+	uint64_t lanes[4] = {0x60ea27eeadc0b5d6ull, 0xc2b2ae3d27d4eb4full, 0, 0x61c8864e7a143579ull};
+	uint64_t remaining = size;
+	for (; remaining >= 32; remaining -= 32, p += 32) {
+		for (int i = 0; i < 4; ++i) {
+			uint64_t word;
+			memcpy(&word, p + i * 8, 8);
+			lanes[i] = asset_hash_round(lanes[i], word);
+		}
+	}
+	uint64_t h = size;
+	for (int i = 0; i < 4; ++i) h = asset_hash_round(h ^ asset_hash_round(0, lanes[i]), (uint64_t)i);
+	for (; remaining >= 8; remaining -= 8, p += 8) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		h = asset_hash_round(h, word);
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, p, (size_t)remaining);
+	h = asset_hash_round(h, tail ^ remaining << 56);
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+// Whether ref, inside the size bytes at base, points at bytes bytes that are inside them too.
+static bool asset_ref_in_range(const uint8_t* base, uint64_t size, const struct asset_ref* ref, uint64_t bytes)
+{
+	int64_t at = (int64_t)((const uint8_t*)ref - base);
+	if (ref->offset < -at || ref->offset > (int64_t)size - at) return false;
+	uint64_t target = (uint64_t)(at + ref->offset);
+	return bytes <= size - target;
+}
+
+static inline uint32_t asset_entry_block_count(const struct asset_entry* entry)
+{
+	return entry->block_size ? (uint32_t)((entry->size + entry->block_size - 1) / entry->block_size) : 0;
+}
+
+// Whether a compressed entry's blocks, in range of the file, cover its stored bytes in order and
+// each is no larger than what it decodes to.
+static bool asset_blocks_valid(const uint8_t* base, uint64_t size, const struct asset_entry* entry)
+{
+	if (entry->block_size < ASSET_BLOCK_MIN || entry->block_size > ASSET_BLOCK_MAX || !entry->size) return false;
+	if ((entry->size - 1) / entry->block_size >= UINT32_MAX) return false; // more blocks than the count holds
+	uint32_t count = asset_entry_block_count(entry);
+	if (!entry->blocks.offset || !asset_ref_in_range(base, size, &entry->blocks, (uint64_t)count * sizeof(struct asset_block))) return false;
+	if ((uint64_t)((const uint8_t*)asset_ref_get(&entry->blocks) - base) % _Alignof(struct asset_block)) return false;
+	const struct asset_block* blocks = asset_ref_get(&entry->blocks);
+	uint64_t offset = 0;
+	for (uint32_t b = 0; b < count; ++b) {
+		uint64_t decoded = b + 1 < count ? entry->block_size : entry->size - (uint64_t)b * entry->block_size;
+		if (blocks[b].offset != offset || blocks[b].size == 0 || blocks[b].size > decoded) return false;
+		offset += blocks[b].size;
+	}
+	return offset == entry->stored_size;
+}
+
+// The header of size bytes of an archive when its table and every link in it are in range, NULL
+// otherwise. Reads the table, the names and the block tables, never the payloads.
+static const struct asset_archive_header* asset_archive_validate(const void* data, uint64_t size)
+{
+	const uint8_t* base = data;
+	if (size < sizeof(struct asset_archive_header)) return NULL;
+	const struct asset_archive_header* header = data;
+	if (header->magic != ASSET_ARCHIVE_MAGIC || header->version != ASSET_ARCHIVE_VERSION || header->file_size != size) return NULL;
+	if (!asset_ref_in_range(base, size, &header->entries, (uint64_t)header->entry_count * sizeof(struct asset_entry))) return NULL;
+	if (header->entry_count && ((uint64_t)((const uint8_t*)asset_ref_get(&header->entries) - base) % _Alignof(struct asset_entry))) return NULL;
+
+	const struct asset_entry* entries = header->entry_count ? asset_ref_get(&header->entries) : NULL;
+	uint64_t payload_bytes = 0, stored_bytes = 0;
+	for (uint32_t i = 0; i < header->entry_count; ++i) {
+		const struct asset_entry* entry = &entries[i];
+		if (i && entry->id <= entries[i - 1].id) return NULL;
+		if (entry->block_size ? !asset_blocks_valid(base, size, entry) : entry->blocks.offset || entry->stored_size != entry->size) return NULL;
+		if (!entry->data.offset || !asset_ref_in_range(base, size, &entry->data, entry->stored_size)) return NULL;
+		if ((uint64_t)((const uint8_t*)asset_ref_get(&entry->data) - base) % ASSET_ARCHIVE_ALIGNMENT) return NULL;
+		if (entry->name_length >= ASSET_ARCHIVE_MAX_NAME || !entry->name.offset || !asset_ref_in_range(base, size, &entry->name, entry->name_length + 1u)) return NULL;
+		if (((const char*)asset_ref_get(&entry->name))[entry->name_length] != '\0') return NULL;
+		payload_bytes += entry->size;
+		stored_bytes += entry->stored_size;
+	}
+	if (payload_bytes != header->payload_bytes || stored_bytes != header->stored_bytes) return NULL;
+	return header;
+}
+
+void asset_archive_close(struct asset_archive* archive)
+{
+	if (archive->view) {
+#if defined(_WIN32)
+		UnmapViewOfFile(archive->view);
+#else
+		munmap((void*)archive->view, (size_t)archive->size);
+#endif
+	}
+	memset(archive, 0, sizeof(*archive));
+}
+
+// Maps the archive at path for reading and validates it. On failure nothing stays open.
+bool asset_archive_open(struct asset_archive* archive, const asset_char* path)
+{
+	uint64_t begin = time_now_ns();
+	memset(archive, 0, sizeof(*archive));
+#if defined(_WIN32)
+	HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return false;
+	LARGE_INTEGER size = {0};
+	HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	archive->view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	archive->size = (uint64_t)size.QuadPart;
+	// the view keeps the file open on its own
+	if (mapping) CloseHandle(mapping);
+	CloseHandle(file);
+#else
+	int file = open(path, O_RDONLY);
+	if (file < 0) return false;
+	struct stat status;
+	if (fstat(file, &status) == 0 && status.st_size > 0) {
+		void* view = mmap(NULL, (size_t)status.st_size, PROT_READ, MAP_SHARED, file, 0);
+		archive->view = view == MAP_FAILED ? NULL : view;
+		archive->size = (uint64_t)status.st_size;
+		// a fault reads its page only, readahead would bring in the neighbouring payloads as well;
+		// asset_archive_prefetch() asks for the ones that are wanted
+		if (archive->view) madvise(view, (size_t)status.st_size, MADV_RANDOM);
+	}
+	close(file);
+#endif
+	if (!archive->view) return false;
+	archive->header = asset_archive_validate(archive->view, archive->size);
+	if (!archive->header) {
+		asset_archive_close(archive);
+		return false;
+	}
+	archive->entries = archive->header->entry_count ? asset_ref_get(&archive->header->entries) : NULL;
+	archive->open_ns = time_now_ns() - begin;
+	return true;
+}
+
+// The entry of the asset with id, NULL when the archive has none or is not open.
+const struct asset_entry* asset_archive_find(const struct asset_archive* archive, uint64_t id)
+{
+	uint32_t low = 0;
+	uint32_t high = archive->header ? archive->header->entry_count : 0;
+	while (low < high) {
+		uint32_t middle = low + (high - low) / 2;
+		if (archive->entries[middle].id < id)
+			low = middle + 1;
+		else
+			high = middle;
+	}
+	return archive->header && low < archive->header->entry_count && archive->entries[low].id == id ? &archive->entries[low] : NULL;
+}
+
+// The stored bytes, the payload itself unless the entry is compressed.
+static inline const void* asset_entry_data(const struct asset_entry* entry) { return asset_ref_get(&entry->data); }
+static inline const char* asset_entry_name(const struct asset_entry* entry) { return asset_ref_get(&entry->name); }
+static inline bool asset_entry_compressed(const struct asset_entry* entry) { return entry->block_size != 0; }
+
+// Starts reading the stored bytes' pages in the background, one request for all of them instead of
+// a fault per page. Worth it before reading an asset through, not for a peek at its header.
+void asset_archive_prefetch(const struct asset_entry* entry)
+{
+	if (!entry->stored_size) return;
+#if defined(_WIN32)
+	WIN32_MEMORY_RANGE_ENTRY range = {.VirtualAddress = (PVOID)asset_entry_data(entry), .NumberOfBytes = (SIZE_T)entry->stored_size};
+	PrefetchVirtualMemory(GetCurrentProcess(), 1, &range, 0);
+#else
+	madvise((void*)asset_entry_data(entry), (size_t)entry->stored_size, MADV_WILLNEED); // page aligned by the format
+#endif
+}
+
+struct asset_read
+{
+	const struct asset_entry* entry;
+	const uint8_t* data;
+	uint8_t* destination;
+	_Atomic bool failed;
+};
+
+// Blocks begin to end of the entry, or chunks of ASSET_COPY_CHUNK when it is not compressed.
+static void asset_read_blocks(void* data, uint32_t begin, uint32_t end)
+{
+	struct asset_read* read = data;
+	const struct asset_entry* entry = read->entry;
+	uint64_t block_size = entry->block_size ? entry->block_size : ASSET_COPY_CHUNK;
+	const struct asset_block* blocks = asset_ref_get(&entry->blocks);
+	for (uint32_t b = begin; b < end; ++b) {
+		uint64_t at = (uint64_t)b * block_size;
+		size_t decoded = (size_t)(entry->size - at < block_size ? entry->size - at : block_size);
+		if (!blocks) {
+			memcpy(read->destination + at, read->data + at, decoded);
+		} else if (blocks[b].size == decoded) {
+			memcpy(read->destination + at, read->data + blocks[b].offset, decoded);
+		} else if (!lz_decompress(read->data + blocks[b].offset, blocks[b].size, read->destination + at, decoded)) {
+			atomic_store_explicit(&read->failed, true, memory_order_relaxed);
+		}
+	}
+}
+
+// Writes the payload, size bytes, to destination, its blocks decompressed or copied a block to a
+// job. Meant for the memory the asset ends up in, an upload buffer when that is cached: a block's
+// matches are read back from it, which write-combined memory makes slow. Returns false when a
+// block is damaged, destination then holds part of the payload.
+bool asset_entry_read(const struct asset_entry* entry, void* destination)
+{
+	struct asset_read read = {.entry = entry, .data = asset_entry_data(entry), .destination = destination};
+	uint32_t count = entry->block_size ? asset_entry_block_count(entry) : (uint32_t)((entry->size + ASSET_COPY_CHUNK - 1) / ASSET_COPY_CHUNK);
+	job_parallel_for(count, 1, asset_read_blocks, &read);
+	return !atomic_load_explicit(&read.failed, memory_order_relaxed);
+}
+
+// Whether the payload still has the hash it was packed with, reading every page of it; a
+// compressed one is decompressed into memory of its own for that.
+bool asset_entry_verify(const struct asset_entry* entry)
+{
+	if (!asset_entry_compressed(entry)) return asset_hash(asset_entry_data(entry), entry->size) == entry->hash;
+	void* payload = malloc((size_t)entry->size);
+	bool intact = payload && asset_entry_read(entry, payload) && asset_hash(payload, entry->size) == entry->hash;
+	free(payload);
+	return intact;
+}
@@ -0,0 +1,279 @@
+// Bindless resources.
+// Every SRV lives in the one shader-visible CBV/SRV/UAV heap, and a single root signature (1.1)
+// covers the whole heap with unbounded descriptor ranges. Shaders pick resources with 32-bit heap
+// indices passed as root constants, so binding is one table set per command list and one
+// constant per draw. Layout, mirrored by bindless.hlsli and the ImGui shaders,
+// BINDLESS_ROOT_SIGNATURE there is the same root signature in HLSL syntax:
+//   b0         root constants, struct bindless_constants
+//   t0 space1  Texture2D textures[]
+//   t0 space2  ByteAddressBuffer buffers[]
+//   u0 space3  RWByteAddressBuffer rw_buffers[]
+//   s0         linear wrap sampler
+// Index 0 is a null texture so a zero ImTextureID or an unset index reads black, not garbage.
+
+// Serialized root signature from fxc (build_debug.ps1), serialized at runtime when it is missing.
+#if __has_include("generated/bindless_rootsig.h")
+#define BINDLESS_PRECOMPILED_ROOT_SIGNATURE 1
+#include "generated/bindless_rootsig.h"
+#else
+#define BINDLESS_PRECOMPILED_ROOT_SIGNATURE 0
+#endif
+
+#define BINDLESS_HEAP_SIZE 16384
+#define BINDLESS_INVALID_INDEX UINT32_MAX
+#define BINDLESS_ROOT_CONSTANTS 0
+#define BINDLESS_ROOT_TABLE 1
+
+struct bindless_constants
+{
+	struct mat4 transform;
+	uint32_t texture_index;
+	uint32_t buffer_index;
+	uint32_t instance_buffer_index; // instanced draws, buffers[] index of the instance data
+	uint32_t instance_base;         // first instance of the draw, SV_InstanceID starts at 0
+};
+
+#define BINDLESS_CONSTANT_COUNT (sizeof(struct bindless_constants) / sizeof(uint32_t))
+#define BINDLESS_TEXTURE_INDEX_OFFSET 16
+#define BINDLESS_BUFFER_INDEX_OFFSET 17
+#define BINDLESS_INSTANCE_BUFFER_OFFSET 18
+#define BINDLESS_INSTANCE_BASE_OFFSET 19
+
+// the C bindings declare the heap start getters with the wrong return convention
+typedef void(__stdcall* bindless_get_cpu_start)(ID3D12DescriptorHeap* This, D3D12_CPU_DESCRIPTOR_HANDLE* pOut);
+typedef void(__stdcall* bindless_get_gpu_start)(ID3D12DescriptorHeap* This, D3D12_GPU_DESCRIPTOR_HANDLE* pOut);
+
+static struct
+{
+	ID3D12Device* device;
+	ID3D12DescriptorHeap* heap; // owned by the caller
+	ID3D12RootSignature* root_signature;
+	D3D12_CPU_DESCRIPTOR_HANDLE cpu_start;
+	D3D12_GPU_DESCRIPTOR_HANDLE gpu_start;
+	UINT increment;
+	uint32_t capacity;
+	uint32_t used; // high water mark
+	uint32_t free_count;
+	uint32_t free_list[BINDLESS_HEAP_SIZE];
+} g_bindless;
+
+static bool bindless_create_root_signature(void)
+{
+#if BINDLESS_PRECOMPILED_ROOT_SIGNATURE
+	HRESULT hr = g_bindless.device->lpVtbl->CreateRootSignature(g_bindless.device,
+								   0,
+								   bindless_rootsig_bytecode,
+								   sizeof(bindless_rootsig_bytecode),
+								   &IID_ID3D12RootSignature,
+								   (void**)&g_bindless.root_signature);
+	if (FAILED(hr)) return false;
+#else
+	D3D12_DESCRIPTOR_RANGE1 ranges[3] = {
+		{
+			.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+			.NumDescriptors = UINT_MAX,
+			.BaseShaderRegister = 0,
+			.RegisterSpace = 1,
+			.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE,
+			.OffsetInDescriptorsFromTableStart = 0,
+		},
+		{
+			.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV,
+			.NumDescriptors = UINT_MAX,
+			.BaseShaderRegister = 0,
+			.RegisterSpace = 2,
+			.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE,
+			.OffsetInDescriptorsFromTableStart = 0,
+		},
+		{
+			.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_UAV,
+			.NumDescriptors = UINT_MAX,
+			.BaseShaderRegister = 0,
+			.RegisterSpace = 3,
+			.Flags = D3D12_DESCRIPTOR_RANGE_FLAG_DESCRIPTORS_VOLATILE | D3D12_DESCRIPTOR_RANGE_FLAG_DATA_VOLATILE,
+			.OffsetInDescriptorsFromTableStart = 0,
+		},
+	};
+
+	D3D12_ROOT_PARAMETER1 params[2] = {
+		[BINDLESS_ROOT_CONSTANTS] = {
+			.ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS,
+			.Constants = {.ShaderRegister = 0, .RegisterSpace = 0, .Num32BitValues = BINDLESS_CONSTANT_COUNT},
+			.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL,
+		},
+		[BINDLESS_ROOT_TABLE] = {
+			.ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE,
+			.DescriptorTable = {.NumDescriptorRanges = _countof(ranges), .pDescriptorRanges = ranges},
+			.ShaderVisibility = D3D12_SHADER_VISIBILITY_ALL,
+		},
+	};
+
+	D3D12_STATIC_SAMPLER_DESC sampler = {
+		.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR,
+		.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP,
+		.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP,
+		.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP,
+		.ComparisonFunc = D3D12_COMPARISON_FUNC_ALWAYS,
+		.BorderColor = D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK,
+		.ShaderRegister = 0,
+		.RegisterSpace = 0,
+		.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL,
+	};
+
+	ID3DBlob* blob = NULL;
+	ID3DBlob* error_blob = NULL;
+	HRESULT hr = D3D12SerializeVersionedRootSignature(&(D3D12_VERSIONED_ROOT_SIGNATURE_DESC) {
+			.Version = D3D_ROOT_SIGNATURE_VERSION_1_1,
+			.Desc_1_1 = {
+				.NumParameters = _countof(params),
+				.pParameters = params,
+				.NumStaticSamplers = 1,
+				.pStaticSamplers = &sampler,
+				.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
+					 D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
+					 D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
+					 D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS,
+			},
+		},
+		&blob, &error_blob);
+	if (error_blob) {
+		OutputDebugStringA((char*)error_blob->lpVtbl->GetBufferPointer(error_blob));
+		error_blob->lpVtbl->Release(error_blob);
+	}
+	if (FAILED(hr)) return false;
+
+	hr = g_bindless.device->lpVtbl->CreateRootSignature(g_bindless.device,
+							   0,
+							   blob->lpVtbl->GetBufferPointer(blob),
+							   blob->lpVtbl->GetBufferSize(blob),
+							   &IID_ID3D12RootSignature,
+							   (void**)&g_bindless.root_signature);
+	blob->lpVtbl->Release(blob);
+	if (FAILED(hr)) return false;
+#endif
+
+	g_bindless.root_signature->lpVtbl->SetName(g_bindless.root_signature, L"bindless_rootsig");
+	return true;
+}
+
+// heap must be shader visible, CBV_SRV_UAV, BINDLESS_HEAP_SIZE descriptors
+bool bindless_init(ID3D12Device* device, ID3D12DescriptorHeap* heap)
+{
+	memset(&g_bindless, 0, sizeof(g_bindless));
+	g_bindless.device = device;
+	g_bindless.heap = heap;
+	g_bindless.capacity = BINDLESS_HEAP_SIZE;
+	g_bindless.increment = device->lpVtbl->GetDescriptorHandleIncrementSize(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
+	((bindless_get_cpu_start)heap->lpVtbl->GetCPUDescriptorHandleForHeapStart)(heap, &g_bindless.cpu_start);
+	((bindless_get_gpu_start)heap->lpVtbl->GetGPUDescriptorHandleForHeapStart)(heap, &g_bindless.gpu_start);
+
+	// unbounded SRV ranges need resource binding tier 2 and root signature 1.1
+	D3D12_FEATURE_DATA_D3D12_OPTIONS options = {0};
+	D3D12_FEATURE_DATA_ROOT_SIGNATURE root_signature = {.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1};
+	if (FAILED(device->lpVtbl->CheckFeatureSupport(device, D3D12_FEATURE_D3D12_OPTIONS, &options, sizeof(options))) ||
+	    options.ResourceBindingTier < D3D12_RESOURCE_BINDING_TIER_2 ||
+	    FAILED(device->lpVtbl->CheckFeatureSupport(device, D3D12_FEATURE_ROOT_SIGNATURE, &root_signature, sizeof(root_signature))) ||
+	    root_signature.HighestVersion < D3D_ROOT_SIGNATURE_VERSION_1_1)
+		return false;
+
+	if (!bindless_create_root_signature()) return false;
+
+	// index 0, null texture
+	g_bindless.used = 1;
+	device->lpVtbl->CreateShaderResourceView(device, NULL,
+		&(D3D12_SHADER_RESOURCE_VIEW_DESC){
+			.Format = DXGI_FORMAT_R8G8B8A8_UNORM,
+			.ViewDimension = D3D12_SRV_DIMENSION_TEXTURE2D,
+			.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+			.Texture2D = {.MipLevels = 1},
+		},
+		g_bindless.cpu_start);
+	return true;
+}
+
+void bindless_shutdown(void)
+{
+	if (g_bindless.root_signature) {
+		g_bindless.root_signature->lpVtbl->Release(g_bindless.root_signature);
+		g_bindless.root_signature = NULL;
+	}
+	g_bindless.heap = NULL;
+	g_bindless.device = NULL;
+}
+
+// Not thread safe, allocate from the thread that creates device objects.
+uint32_t bindless_alloc(void)
+{
+	if (g_bindless.free_count) return g_bindless.free_list[--g_bindless.free_count];
+	if (g_bindless.used == g_bindless.capacity) return BINDLESS_INVALID_INDEX;
+	return g_bindless.used++;
+}
+
+// The GPU must be done with every draw that referenced the index.
+void bindless_free(uint32_t index)
+{
+	if (index == 0 || index == BINDLESS_INVALID_INDEX) return;
+	g_bindless.free_list[g_bindless.free_count++] = index;
+}
+
+D3D12_CPU_DESCRIPTOR_HANDLE bindless_cpu_handle(uint32_t index)
+{
+	return (D3D12_CPU_DESCRIPTOR_HANDLE){.ptr = g_bindless.cpu_start.ptr + (SIZE_T)index * g_bindless.increment};
+}
+
+D3D12_GPU_DESCRIPTOR_HANDLE bindless_gpu_handle(uint32_t index)
+{
+	return (D3D12_GPU_DESCRIPTOR_HANDLE){.ptr = g_bindless.gpu_start.ptr + (UINT64)index * g_bindless.increment};
+}
+
+// Points an allocated index at a range of a buffer, for per-frame views into a ring. Offsets and
+// sizes are multiples of 4. The GPU must be done with every draw that read the previous view.
+void bindless_write_buffer_srv(uint32_t index, ID3D12Resource* buffer, UINT64 offset_bytes, UINT64 size_bytes)
+{
+	g_bindless.device->lpVtbl->CreateShaderResourceView(g_bindless.device, buffer,
+		&(D3D12_SHADER_RESOURCE_VIEW_DESC){
+			.Format = DXGI_FORMAT_R32_TYPELESS,
+			.ViewDimension = D3D12_SRV_DIMENSION_BUFFER,
+			.Shader4ComponentMapping = D3D12_DEFAULT_SHADER_4_COMPONENT_MAPPING,
+			.Buffer = {.FirstElement = offset_bytes / 4, .NumElements = (UINT)(size_bytes / 4), .Flags = D3D12_BUFFER_SRV_FLAG_RAW},
+		},
+		bindless_cpu_handle(index));
+}
+
+// raw view for buffers[], size_bytes must be a multiple of 4
+uint32_t bindless_create_buffer_srv(ID3D12Resource* buffer, UINT64 size_bytes)
+{
+	uint32_t index = bindless_alloc();
+	if (index == BINDLESS_INVALID_INDEX) return index;
+	bindless_write_buffer_srv(index, buffer, 0, size_bytes);
+	return index;
+}
+
+// raw view for rw_buffers[], the buffer needs D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS
+uint32_t bindless_create_buffer_uav(ID3D12Resource* buffer, UINT64 size_bytes)
+{
+	uint32_t index = bindless_alloc();
+	if (index == BINDLESS_INVALID_INDEX) return index;
+	g_bindless.device->lpVtbl->CreateUnorderedAccessView(g_bindless.device, buffer, NULL,
+		&(D3D12_UNORDERED_ACCESS_VIEW_DESC){
+			.Format = DXGI_FORMAT_R32_TYPELESS,
+			.ViewDimension = D3D12_UAV_DIMENSION_BUFFER,
+			.Buffer = {.FirstElement = 0, .NumElements = (UINT)(size_bytes / 4), .Flags = D3D12_BUFFER_UAV_FLAG_RAW},
+		},
+		bindless_cpu_handle(index));
+	return index;
+}
+
+// Root signature and the heap-wide table, once per command list after SetDescriptorHeaps.
+void bindless_bind_graphics(ID3D12GraphicsCommandList* cmd_list)
+{
+	cmd_list->lpVtbl->SetGraphicsRootSignature(cmd_list, g_bindless.root_signature);
+	cmd_list->lpVtbl->SetGraphicsRootDescriptorTable(cmd_list, BINDLESS_ROOT_TABLE, g_bindless.gpu_start);
+}
+
+// The same for dispatches, compute shaders see the whole layout too.
+void bindless_bind_compute(ID3D12GraphicsCommandList* cmd_list)
+{
+	cmd_list->lpVtbl->SetComputeRootSignature(cmd_list, g_bindless.root_signature);
+	cmd_list->lpVtbl->SetComputeRootDescriptorTable(cmd_list, BINDLESS_ROOT_TABLE, g_bindless.gpu_start);
+}
@@ -0,0 +1,31 @@
+// Bindless register layout, must match bindless.c
+struct bindless_constants
+{
+	float4x4 transform;
+	uint texture_index;
+	uint buffer_index;
+	uint instance_buffer_index;
+	uint instance_base;
+};
+// compute shaders reinterpret the root constants, define BINDLESS_CONSTANTS as their own struct first
+#ifndef BINDLESS_CONSTANTS
+#define BINDLESS_CONSTANTS bindless_constants
+#endif
+ConstantBuffer<BINDLESS_CONSTANTS> constants : register(b0);
+
+Texture2D textures[] : register(t0, space1);
+ByteAddressBuffer buffers[] : register(t0, space2);
+RWByteAddressBuffer rw_buffers[] : register(u0, space3);
+SamplerState linear_wrap : register(s0);
+
+// The same root signature for fxc /T rootsig_1_1 /E BINDLESS_ROOT_SIGNATURE, built into bin\debug\generated\bindless_rootsig.h
+#define BINDLESS_ROOT_SIGNATURE \
+	"RootFlags(ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT | DENY_HULL_SHADER_ROOT_ACCESS | DENY_DOMAIN_SHADER_ROOT_ACCESS | DENY_GEOMETRY_SHADER_ROOT_ACCESS), " \
+	"RootConstants(num32BitConstants = 20, b0), " \
+	"DescriptorTable(SRV(t0, space = 1, numDescriptors = unbounded, offset = 0, flags = DESCRIPTORS_VOLATILE), " \
+	"                SRV(t0, space = 2, numDescriptors = unbounded, offset = 0, flags = DESCRIPTORS_VOLATILE), " \
+	"                UAV(u0, space = 3, numDescriptors = unbounded, offset = 0, flags = DESCRIPTORS_VOLATILE | DATA_VOLATILE)), " \
+	"StaticSampler(s0, filter = FILTER_MIN_MAG_MIP_LINEAR, " \
+	"              addressU = TEXTURE_ADDRESS_WRAP, addressV = TEXTURE_ADDRESS_WRAP, addressW = TEXTURE_ADDRESS_WRAP, " \
+	"              comparisonFunc = COMPARISON_ALWAYS, borderColor = STATIC_BORDER_COLOR_TRANSPARENT_BLACK, " \
+	"              visibility = SHADER_VISIBILITY_PIXEL)"
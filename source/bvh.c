@@ -0,0 +1,831 @@
+// Bounding volume hierarchy over the boxes of a cull_bounds, for culling, picking and other spatial
+// queries on large scenes.
+// bvh_build() splits the objects into a binary tree with the surface area heuristic evaluated on
+// BVH_BINS bins of centroids per axis. It works on a copy of the boxes, which the partitions move
+// along, so every pass reads memory in order however the objects are scattered in the bounds.
+// Ranges near the top are binned in parallel, and below a split both halves build as jobs of their
+// own, so every thread soon has a subtree to itself.
+// A node is 32 bytes. Siblings are allocated as a pair at an even index of a 64 byte aligned array,
+// one cache line, which is what the traversals test together. The objects of a leaf are a range of
+// bvh.indices.
+// bvh_refit() recomputes the boxes bottom up after objects moved and keeps the topology: a fraction
+// of a build, but the tree loosens as objects travel, rebuild now and then.
+// Queries test a node box against four frustum planes or the three slabs of a ray per SSE
+// instruction. bvh_query_frustum() finds exactly the objects cull_run() does.
+// Requires vecmath.c, job_system.c, cull.c.
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define BVH_BINS 16
+#define BVH_LEAF_SIZE 4             // objects in a leaf at most, unless they cannot be told apart
+#define BVH_PARALLEL_OBJECTS 65536  // ranges at least this large are binned on all threads
+#define BVH_PARALLEL_PARTS 32
+#define BVH_TASK_OBJECTS 4096       // ranges at least this large build one half as a job
+#define BVH_MAX_DEPTH 64
+#define BVH_REFIT_TASKS 256
+
+struct bvh_node
+{
+	float min[3];
+	uint32_t first; // inner nodes: the left child, the right one follows; leaves: into bvh.indices
+	float max[3];
+	uint32_t count; // objects of a leaf, 0 for inner nodes
+};
+_Static_assert(sizeof(struct bvh_node) == 32, "two nodes per cache line");
+
+struct bvh
+{
+	struct bvh_node* nodes; // nodes[0] is the root, nodes[1] pads the pairs to even indices
+	void* node_memory;
+	uint32_t node_count;
+	uint32_t node_capacity;
+	uint32_t* indices; // objects in leaf order
+	uint32_t object_count;
+	uint32_t object_capacity;
+	struct bvh_ref* refs; // build scratch, kept for the next one
+	_Atomic uint32_t allocated; // nodes handed out during a build
+};
+
+// corners of 4 floats, so SSE loads and stores them whole; the fourth lane means nothing
+struct bvh_box
+{
+	float min[4];
+	float max[4];
+};
+
+struct bvh_hit
+{
+	uint32_t index; // into the bounds
+	float t;        // distance along the ray in units of its direction
+};
+
+// plain compares, fminf and fmaxf are library calls with some compilers
+static inline float bvh_min(float a, float b) { return a < b ? a : b; }
+static inline float bvh_max(float a, float b) { return a > b ? a : b; }
+
+static const struct bvh_box bvh_box_empty = {{INFINITY, INFINITY, INFINITY, 0.0f}, {-INFINITY, -INFINITY, -INFINITY, 0.0f}};
+
+// min and max point at 4 floats
+static inline void bvh_box_grow_corners(struct bvh_box* box, const float* min, const float* max)
+{
+#if VECMATH_SSE
+	_mm_storeu_ps(box->min, _mm_min_ps(_mm_loadu_ps(box->min), _mm_loadu_ps(min)));
+	_mm_storeu_ps(box->max, _mm_max_ps(_mm_loadu_ps(box->max), _mm_loadu_ps(max)));
+#else
+	for (int axis = 0; axis < 3; ++axis) {
+		box->min[axis] = bvh_min(box->min[axis], min[axis]);
+		box->max[axis] = bvh_max(box->max[axis], max[axis]);
+	}
+#endif
+}
+
+static inline void bvh_box_grow(struct bvh_box* box, const struct bvh_box* other)
+{
+	bvh_box_grow_corners(box, other->min, other->max);
+}
+
+static inline float bvh_box_area(const struct bvh_box* box)
+{
+	float x = box->max[0] - box->min[0];
+	float y = box->max[1] - box->min[1];
+	float z = box->max[2] - box->min[2];
+	return x < 0.0f ? 0.0f : x * y + y * z + z * x;
+}
+
+static inline struct bvh_box bvh_object_box(const struct cull_bounds* bounds, uint32_t object)
+{
+	struct bvh_box box = {{0.0f}, {0.0f}};
+	for (int axis = 0; axis < 3; ++axis) {
+		box.min[axis] = bounds->center[axis][object] - bounds->extent[axis][object];
+		box.max[axis] = bounds->center[axis][object] + bounds->extent[axis][object];
+	}
+	return box;
+}
+
+// build
+
+// an object's box during the build, min and max are followed by a lane SSE may load
+struct bvh_ref
+{
+	float min[3];
+	uint32_t index;
+	float max[3];
+	uint32_t padding;
+};
+
+#if VECMATH_SSE
+// xyz of a ref or node corner; lane 3 is an integer there, as a float mostly a denormal, which
+// makes every add and multiply on it a slow microcode assist
+static inline __m128 bvh_load_corner(const float* corner)
+{
+	return _mm_and_ps(_mm_loadu_ps(corner), _mm_castsi128_ps(_mm_setr_epi32(-1, -1, -1, 0)));
+}
+#endif
+
+static inline float bvh_ref_center(const struct bvh_ref* ref, int axis)
+{
+	return (ref->min[axis] + ref->max[axis]) * 0.5f;
+}
+
+struct bvh_bin
+{
+	struct bvh_box box;
+	uint32_t count;
+};
+
+// bounds of a range of refs, of the boxes and of their centers
+struct bvh_range
+{
+	struct bvh_box box;
+	struct bvh_box centers;
+};
+
+static const struct bvh_range bvh_range_empty = {
+	{{INFINITY, INFINITY, INFINITY, 0.0f}, {-INFINITY, -INFINITY, -INFINITY, 0.0f}},
+	{{INFINITY, INFINITY, INFINITY, 0.0f}, {-INFINITY, -INFINITY, -INFINITY, 0.0f}},
+};
+
+// bins of all three axes over a range, as many as objects up to BVH_BINS
+struct bvh_bins
+{
+	uint32_t bin_count;
+	float low[3];   // centers' minimum
+	float scale[3]; // bins per unit, 0 when all centers are equal on the axis
+	struct bvh_bin bins[3][BVH_BINS];
+};
+
+struct bvh_build
+{
+	struct bvh* bvh;
+	const struct cull_bounds* bounds;
+	bool parallel;
+};
+
+// The loops over refs keep their values in registers, SSE ones when there are: a center stored
+// and read back lane by lane stalls store forwarding.
+static void bvh_range_bounds(const struct bvh_build* build, uint32_t begin, uint32_t end, struct bvh_range* range)
+{
+	*range = bvh_range_empty;
+	const struct bvh_ref* refs = build->bvh->refs;
+#if VECMATH_SSE
+	__m128 box_min = _mm_loadu_ps(range->box.min), box_max = _mm_loadu_ps(range->box.max);
+	__m128 centers_min = box_min, centers_max = box_max;
+	for (uint32_t i = begin; i < end; ++i) {
+		__m128 min = bvh_load_corner(refs[i].min);
+		__m128 max = bvh_load_corner(refs[i].max);
+		__m128 center = _mm_mul_ps(_mm_add_ps(min, max), _mm_set1_ps(0.5f));
+		box_min = _mm_min_ps(box_min, min);
+		box_max = _mm_max_ps(box_max, max);
+		centers_min = _mm_min_ps(centers_min, center);
+		centers_max = _mm_max_ps(centers_max, center);
+	}
+	_mm_storeu_ps(range->box.min, box_min);
+	_mm_storeu_ps(range->box.max, box_max);
+	_mm_storeu_ps(range->centers.min, centers_min);
+	_mm_storeu_ps(range->centers.max, centers_max);
+#else
+	for (uint32_t i = begin; i < end; ++i) {
+		for (int axis = 0; axis < 3; ++axis) {
+			float center = bvh_ref_center(&refs[i], axis);
+			range->box.min[axis] = bvh_min(range->box.min[axis], refs[i].min[axis]);
+			range->box.max[axis] = bvh_max(range->box.max[axis], refs[i].max[axis]);
+			range->centers.min[axis] = bvh_min(range->centers.min[axis], center);
+			range->centers.max[axis] = bvh_max(range->centers.max[axis], center);
+		}
+	}
+#endif
+}
+
+static inline uint32_t bvh_bin_index(const struct bvh_bins* bins, int axis, float center)
+{
+	int bin = (int)((center - bins->low[axis]) * bins->scale[axis]);
+	return bin < 0 ? 0 : (uint32_t)bin >= bins->bin_count ? bins->bin_count - 1 : (uint32_t)bin;
+}
+
+static void bvh_bins_init(struct bvh_bins* bins, uint32_t bin_count, const struct bvh_box* centers)
+{
+	bins->bin_count = bin_count;
+	for (int axis = 0; axis < 3; ++axis) {
+		float size = centers->max[axis] - centers->min[axis];
+		bins->low[axis] = centers->min[axis];
+		bins->scale[axis] = size > 0.0f ? (float)bin_count / size : 0.0f;
+		for (uint32_t b = 0; b < bin_count; ++b) bins->bins[axis][b] = (struct bvh_bin){bvh_box_empty, 0};
+	}
+}
+
+static void bvh_bin_range(const struct bvh_build* build, uint32_t begin, uint32_t end, struct bvh_bins* bins)
+{
+	const struct bvh_ref* refs = build->bvh->refs;
+#if VECMATH_SSE
+	__m128 low = _mm_setr_ps(bins->low[0], bins->low[1], bins->low[2], 0.0f);
+	__m128 scale = _mm_setr_ps(bins->scale[0], bins->scale[1], bins->scale[2], 0.0f);
+	__m128 last = _mm_set1_ps((float)(bins->bin_count - 1));
+	for (uint32_t i = begin; i < end; ++i) {
+		__m128 min = bvh_load_corner(refs[i].min);
+		__m128 max = bvh_load_corner(refs[i].max);
+		__m128 center = _mm_mul_ps(_mm_add_ps(min, max), _mm_set1_ps(0.5f));
+		__m128i bin = _mm_cvttps_epi32(_mm_min_ps(_mm_max_ps(_mm_mul_ps(_mm_sub_ps(center, low), scale), _mm_setzero_ps()), last));
+		for (int axis = 0; axis < 3; ++axis) {
+			struct bvh_bin* target = &bins->bins[axis][_mm_cvtsi128_si32(bin)];
+			_mm_storeu_ps(target->box.min, _mm_min_ps(_mm_loadu_ps(target->box.min), min));
+			_mm_storeu_ps(target->box.max, _mm_max_ps(_mm_loadu_ps(target->box.max), max));
+			target->count++;
+			bin = _mm_shuffle_epi32(bin, _MM_SHUFFLE(0, 3, 2, 1));
+		}
+	}
+#else
+	for (uint32_t i = begin; i < end; ++i) {
+		for (int axis = 0; axis < 3; ++axis) {
+			struct bvh_bin* bin = &bins->bins[axis][bvh_bin_index(bins, axis, bvh_ref_center(&refs[i], axis))];
+			bvh_box_grow_corners(&bin->box, refs[i].min, refs[i].max);
+			bin->count++;
+		}
+	}
+#endif
+}
+
+// the parallel versions split a range into BVH_PARALLEL_PARTS and merge the parts' results
+struct bvh_parallel_job
+{
+	const struct bvh_build* build;
+	uint32_t begin;
+	uint32_t grain;
+	uint32_t end;
+	struct bvh_range ranges[BVH_PARALLEL_PARTS];
+	struct bvh_bins bins[BVH_PARALLEL_PARTS];
+};
+
+static struct bvh_parallel_job* bvh_parallel_job_make(const struct bvh_build* build, uint32_t begin, uint32_t end, uint32_t* parts)
+{
+	struct bvh_parallel_job* job = malloc(sizeof(*job));
+	if (!job) return NULL;
+	job->build = build;
+	job->begin = begin;
+	job->end = end;
+	job->grain = (end - begin + BVH_PARALLEL_PARTS - 1) / BVH_PARALLEL_PARTS;
+	*parts = (end - begin + job->grain - 1) / job->grain;
+	return job;
+}
+
+static void bvh_range_bounds_part(void* data, uint32_t begin, uint32_t end)
+{
+	struct bvh_parallel_job* job = data;
+	for (uint32_t part = begin; part < end; ++part) {
+		uint32_t first = job->begin + part * job->grain;
+		uint32_t last = first + job->grain < job->end ? first + job->grain : job->end;
+		bvh_range_bounds(job->build, first, last, &job->ranges[part]);
+	}
+}
+
+static void bvh_bin_part(void* data, uint32_t begin, uint32_t end)
+{
+	struct bvh_parallel_job* job = data;
+	for (uint32_t part = begin; part < end; ++part) {
+		uint32_t first = job->begin + part * job->grain;
+		uint32_t last = first + job->grain < job->end ? first + job->grain : job->end;
+		bvh_bin_range(job->build, first, last, &job->bins[part]);
+	}
+}
+
+// Bounds of the whole input on all threads, the children's come from their parent's partition.
+static void bvh_range_bounds_parallel(const struct bvh_build* build, uint32_t begin, uint32_t end, struct bvh_range* range)
+{
+	uint32_t parts;
+	struct bvh_parallel_job* job = build->parallel ? bvh_parallel_job_make(build, begin, end, &parts) : NULL;
+	if (!job) {
+		bvh_range_bounds(build, begin, end, range);
+		return;
+	}
+	job_parallel_for(parts, 1, bvh_range_bounds_part, job);
+	*range = job->ranges[0];
+	for (uint32_t part = 1; part < parts; ++part) {
+		bvh_box_grow(&range->box, &job->ranges[part].box);
+		bvh_box_grow(&range->centers, &job->ranges[part].centers);
+	}
+	free(job);
+}
+
+// Bins of a large range on all threads; the job is too big for the recursion's stack.
+static bool bvh_bin_parallel(const struct bvh_build* build, uint32_t begin, uint32_t end, struct bvh_bins* bins)
+{
+	uint32_t parts;
+	struct bvh_parallel_job* job = bvh_parallel_job_make(build, begin, end, &parts);
+	if (!job) return false;
+	for (uint32_t part = 0; part < parts; ++part) {
+		job->bins[part].bin_count = bins->bin_count;
+		for (int axis = 0; axis < 3; ++axis) {
+			job->bins[part].low[axis] = bins->low[axis];
+			job->bins[part].scale[axis] = bins->scale[axis];
+			memcpy(job->bins[part].bins[axis], bins->bins[axis], bins->bin_count * sizeof(struct bvh_bin));
+		}
+	}
+	job_parallel_for(parts, 1, bvh_bin_part, job);
+	for (uint32_t part = 0; part < parts; ++part) {
+		for (int axis = 0; axis < 3; ++axis) {
+			for (uint32_t b = 0; b < bins->bin_count; ++b) {
+				bvh_box_grow(&bins->bins[axis][b].box, &job->bins[part].bins[axis][b].box);
+				bins->bins[axis][b].count += job->bins[part].bins[axis][b].count;
+			}
+		}
+	}
+	free(job);
+	return true;
+}
+
+// Moves the refs left of the split to the front and returns where the others start, sides gets
+// the bounds of both parts.
+static uint32_t bvh_partition(const struct bvh_build* build, uint32_t begin, uint32_t end, const struct bvh_bins* bins, int axis, uint32_t split,
+			      struct bvh_range* sides)
+{
+	struct bvh_ref* refs = build->bvh->refs;
+	uint32_t middle = begin;
+	uint32_t right = end;
+#if VECMATH_SSE
+	__m128 half = _mm_set1_ps(0.5f);
+	__m128 empty_min = _mm_loadu_ps(bvh_box_empty.min), empty_max = _mm_loadu_ps(bvh_box_empty.max);
+	__m128 left_min = empty_min, left_max = empty_max, left_centers_min = empty_min, left_centers_max = empty_max;
+	__m128 right_min = empty_min, right_max = empty_max, right_centers_min = empty_min, right_centers_max = empty_max;
+	while (middle < right) {
+		struct bvh_ref* ref = &refs[middle];
+		__m128 min = bvh_load_corner(ref->min);
+		__m128 max = bvh_load_corner(ref->max);
+		__m128 center = _mm_mul_ps(_mm_add_ps(min, max), half);
+		if (bvh_bin_index(bins, axis, bvh_ref_center(ref, axis)) < split) {
+			left_min = _mm_min_ps(left_min, min);
+			left_max = _mm_max_ps(left_max, max);
+			left_centers_min = _mm_min_ps(left_centers_min, center);
+			left_centers_max = _mm_max_ps(left_centers_max, center);
+			middle++;
+		} else {
+			right_min = _mm_min_ps(right_min, min);
+			right_max = _mm_max_ps(right_max, max);
+			right_centers_min = _mm_min_ps(right_centers_min, center);
+			right_centers_max = _mm_max_ps(right_centers_max, center);
+			struct bvh_ref swap = *ref;
+			*ref = refs[--right];
+			refs[right] = swap;
+		}
+	}
+	_mm_storeu_ps(sides[0].box.min, left_min);
+	_mm_storeu_ps(sides[0].box.max, left_max);
+	_mm_storeu_ps(sides[0].centers.min, left_centers_min);
+	_mm_storeu_ps(sides[0].centers.max, left_centers_max);
+	_mm_storeu_ps(sides[1].box.min, right_min);
+	_mm_storeu_ps(sides[1].box.max, right_max);
+	_mm_storeu_ps(sides[1].centers.min, right_centers_min);
+	_mm_storeu_ps(sides[1].centers.max, right_centers_max);
+#else
+	sides[0] = sides[1] = bvh_range_empty;
+	while (middle < right) {
+		struct bvh_ref* ref = &refs[middle];
+		bool left = bvh_bin_index(bins, axis, bvh_ref_center(ref, axis)) < split;
+		struct bvh_range* side = &sides[left ? 0 : 1];
+		for (int k = 0; k < 3; ++k) {
+			float center = bvh_ref_center(ref, k);
+			side->box.min[k] = bvh_min(side->box.min[k], ref->min[k]);
+			side->box.max[k] = bvh_max(side->box.max[k], ref->max[k]);
+			side->centers.min[k] = bvh_min(side->centers.min[k], center);
+			side->centers.max[k] = bvh_max(side->centers.max[k], center);
+		}
+		if (left) {
+			middle++;
+		} else {
+			struct bvh_ref swap = *ref;
+			*ref = refs[--right];
+			refs[right] = swap;
+		}
+	}
+#endif
+	return middle;
+}
+
+struct bvh_task
+{
+	struct bvh_build* build;
+	uint32_t node;
+	uint32_t depth;
+	struct bvh_range range;
+};
+
+static void bvh_build_node(struct bvh_build* build, uint32_t node_index, uint32_t begin, uint32_t end, uint32_t depth, const struct bvh_range* range);
+
+static void bvh_build_task(void* data, uint32_t begin, uint32_t end)
+{
+	struct bvh_task* task = data;
+	bvh_build_node(task->build, task->node, begin, end, task->depth, &task->range);
+}
+
+// range holds the bounds of refs [begin, end)
+static void bvh_build_node(struct bvh_build* build, uint32_t node_index, uint32_t begin, uint32_t end, uint32_t depth, const struct bvh_range* range)
+{
+	struct bvh* bvh = build->bvh;
+	uint32_t count = end - begin;
+	struct bvh_node* node = &bvh->nodes[node_index];
+	memcpy(node->min, range->box.min, sizeof(node->min));
+	memcpy(node->max, range->box.max, sizeof(node->max));
+	node->first = begin;
+	node->count = count;
+	if (count <= 1 || depth + 1 >= BVH_MAX_DEPTH) return;
+
+	struct bvh_bins bins;
+	bvh_bins_init(&bins, count < BVH_BINS ? count : BVH_BINS, &range->centers);
+	if (!build->parallel || count < BVH_PARALLEL_OBJECTS || !bvh_bin_parallel(build, begin, end, &bins))
+		bvh_bin_range(build, begin, end, &bins);
+
+	// cost of a split relative to testing every object here: one traversal step, then the objects
+	// of each side weighted by the chance a query reaching this node reaches that side
+	int best_axis = -1;
+	uint32_t best_split = 0;
+	float best_cost = INFINITY;
+	for (int axis = 0; axis < 3; ++axis) {
+		if (bins.scale[axis] == 0.0f) continue;
+		float right_cost[BVH_BINS];
+		struct bvh_box box = bvh_box_empty;
+		uint32_t right_count = 0;
+		for (uint32_t b = bins.bin_count - 1; b > 0; --b) {
+			bvh_box_grow(&box, &bins.bins[axis][b].box);
+			right_count += bins.bins[axis][b].count;
+			right_cost[b] = bvh_box_area(&box) * (float)right_count;
+		}
+		box = bvh_box_empty;
+		uint32_t left_count = 0;
+		for (uint32_t b = 1; b < bins.bin_count; ++b) {
+			bvh_box_grow(&box, &bins.bins[axis][b - 1].box);
+			left_count += bins.bins[axis][b - 1].count;
+			float cost = bvh_box_area(&box) * (float)left_count + right_cost[b];
+			if (left_count && left_count < count && cost < best_cost) {
+				best_cost = cost;
+				best_axis = axis;
+				best_split = b;
+			}
+		}
+	}
+	float area = bvh_box_area(&range->box);
+	float split_cost = 1.0f + (area > 0.0f ? best_cost / area : (float)count);
+	if (count <= BVH_LEAF_SIZE && (best_axis < 0 || split_cost >= (float)count)) return;
+
+	struct bvh_range sides[2];
+	uint32_t middle = best_axis >= 0 ? bvh_partition(build, begin, end, &bins, best_axis, best_split, sides) : begin;
+	if (middle == begin || middle == end) {
+		// objects sharing one center are split by count
+		middle = begin + count / 2;
+		bvh_range_bounds(build, begin, middle, &sides[0]);
+		bvh_range_bounds(build, middle, end, &sides[1]);
+	}
+
+	uint32_t children = atomic_fetch_add_explicit(&bvh->allocated, 2, memory_order_relaxed);
+	assert(children + 2 <= bvh->node_capacity);
+	node->first = children;
+	node->count = 0;
+	if (build->parallel && count >= BVH_TASK_OBJECTS) {
+		struct bvh_task task = {build, children, depth + 1, sides[0]};
+		struct job_counter counter = {0};
+		job_run(&(struct job_decl){bvh_build_task, &task, begin, middle}, 1, &counter);
+		bvh_build_node(build, children + 1, middle, end, depth + 1, &sides[1]);
+		job_wait(&counter);
+	} else {
+		bvh_build_node(build, children, begin, middle, depth + 1, &sides[0]);
+		bvh_build_node(build, children + 1, middle, end, depth + 1, &sides[1]);
+	}
+}
+
+static void bvh_init_refs(void* data, uint32_t begin, uint32_t end)
+{
+	struct bvh_build* build = data;
+	for (uint32_t i = begin; i < end; ++i) {
+		struct bvh_box box = bvh_object_box(build->bounds, i);
+		build->bvh->refs[i] = (struct bvh_ref){{box.min[0], box.min[1], box.min[2]}, i, {box.max[0], box.max[1], box.max[2]}, 0};
+	}
+}
+
+static void bvh_copy_indices(void* data, uint32_t begin, uint32_t end)
+{
+	struct bvh* bvh = data;
+	for (uint32_t i = begin; i < end; ++i) bvh->indices[i] = bvh->refs[i].index;
+}
+
+// Builds the tree over the boxes of bounds, reusing the bvh's memory. Call from a thread known to
+// the job system to build in parallel, from any other it builds on the calling thread alone.
+bool bvh_build(struct bvh* bvh, const struct cull_bounds* bounds)
+{
+	uint32_t count = bounds->count;
+	// a leaf per object at worst: count - 1 pairs, the root and the padding
+	uint32_t node_capacity = count > 1 ? 2 * count : 2;
+	if (node_capacity > bvh->node_capacity) {
+		void* memory = malloc((size_t)node_capacity * sizeof(struct bvh_node) + 63);
+		if (!memory) return false;
+		free(bvh->node_memory);
+		bvh->node_memory = memory;
+		bvh->nodes = (struct bvh_node*)(((uintptr_t)memory + 63) & ~(uintptr_t)63);
+		bvh->node_capacity = node_capacity;
+	}
+	if (count > bvh->object_capacity) {
+		uint32_t* indices = realloc(bvh->indices, (size_t)count * sizeof(uint32_t));
+		if (indices) bvh->indices = indices;
+		struct bvh_ref* refs = realloc(bvh->refs, (size_t)count * sizeof(struct bvh_ref));
+		if (refs) bvh->refs = refs;
+		if (!indices || !refs) return false;
+		bvh->object_capacity = count;
+	}
+	bvh->object_count = count;
+	bvh->node_count = 0;
+	if (count == 0) return true;
+
+	struct bvh_build build = {
+		.bvh = bvh,
+		.bounds = bounds,
+		.parallel = job_thread_count() > 1 && t_job_thread_index >= 0,
+	};
+	job_parallel_for(count, 16384, bvh_init_refs, &build);
+	struct bvh_range range;
+	bvh_range_bounds_parallel(&build, 0, count, &range);
+	atomic_store_explicit(&bvh->allocated, 2, memory_order_relaxed);
+	memset(&bvh->nodes[1], 0, sizeof(struct bvh_node));
+	bvh_build_node(&build, 0, 0, count, 0, &range);
+	job_parallel_for(count, 65536, bvh_copy_indices, bvh);
+	bvh->node_count = atomic_load_explicit(&bvh->allocated, memory_order_relaxed);
+	return true;
+}
+
+void bvh_free(struct bvh* bvh)
+{
+	free(bvh->node_memory);
+	free(bvh->indices);
+	free(bvh->refs);
+	memset(bvh, 0, sizeof(*bvh));
+}
+
+// refit
+
+struct bvh_refit_job
+{
+	struct bvh* bvh;
+	const struct cull_bounds* bounds;
+	const uint32_t* subtrees;
+};
+
+static void bvh_refit_node(struct bvh* bvh, const struct cull_bounds* bounds, uint32_t node_index)
+{
+	struct bvh_node* node = &bvh->nodes[node_index];
+	struct bvh_box box = bvh_box_empty;
+	if (node->count) {
+		for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+			struct bvh_box object = bvh_object_box(bounds, bvh->indices[i]);
+			bvh_box_grow(&box, &object);
+		}
+	} else {
+		bvh_refit_node(bvh, bounds, node->first);
+		bvh_refit_node(bvh, bounds, node->first + 1);
+		const struct bvh_node* children = &bvh->nodes[node->first];
+		for (int axis = 0; axis < 3; ++axis) {
+			box.min[axis] = bvh_min(children[0].min[axis], children[1].min[axis]);
+			box.max[axis] = bvh_max(children[0].max[axis], children[1].max[axis]);
+		}
+	}
+	memcpy(node->min, box.min, sizeof(node->min));
+	memcpy(node->max, box.max, sizeof(node->max));
+}
+
+static void bvh_refit_subtrees(void* data, uint32_t begin, uint32_t end)
+{
+	struct bvh_refit_job* job = data;
+	for (uint32_t i = begin; i < end; ++i) bvh_refit_node(job->bvh, job->bounds, job->subtrees[i]);
+}
+
+// Recomputes every box from bounds after objects moved; the bounds must hold the same objects the
+// tree was built over. The top levels are cut breadth first into subtrees refit as jobs.
+void bvh_refit(struct bvh* bvh, const struct cull_bounds* bounds)
+{
+	assert(bounds->count == bvh->object_count);
+	if (bvh->node_count == 0) return;
+	uint32_t top[BVH_REFIT_TASKS];      // inner nodes above the cut, parents first
+	uint32_t queue[BVH_REFIT_TASKS * 2]; // the cut: subtrees, leaves stay in it
+	uint32_t top_count = 0;
+	uint32_t head = 0;
+	uint32_t tail = 0;
+	queue[tail++] = 0;
+	uint32_t target = job_thread_count() * 8;
+	if (target > BVH_REFIT_TASKS) target = BVH_REFIT_TASKS;
+	while (head < tail && tail - head < target && top_count < BVH_REFIT_TASKS) {
+		uint32_t node = queue[head];
+		if (bvh->nodes[node].count) break; // the shallowest subtree left is a leaf, so are few others
+		head++;
+		top[top_count++] = node;
+		queue[tail++] = bvh->nodes[node].first;
+		queue[tail++] = bvh->nodes[node].first + 1;
+	}
+
+	struct bvh_refit_job job = {bvh, bounds, queue + head};
+	job_parallel_for(tail - head, 1, bvh_refit_subtrees, &job);
+	while (top_count) {
+		struct bvh_node* node = &bvh->nodes[top[--top_count]];
+		const struct bvh_node* children = &bvh->nodes[node->first];
+		for (int axis = 0; axis < 3; ++axis) {
+			node->min[axis] = bvh_min(children[0].min[axis], children[1].min[axis]);
+			node->max[axis] = bvh_max(children[0].max[axis], children[1].max[axis]);
+		}
+	}
+}
+
+// queries
+
+// the six planes four at a time, the last two lanes never cull
+struct bvh_planes
+{
+#if VECMATH_SSE
+	__m128 normal[2][3];
+	__m128 abs_normal[2][3];
+	__m128 distance[2];
+#else
+	const struct frustum* frustum;
+#endif
+};
+
+static struct bvh_planes bvh_planes_make(const struct frustum* frustum)
+{
+	struct bvh_planes planes;
+#if VECMATH_SSE
+	float lanes[4][8];
+	for (int i = 0; i < 8; ++i) {
+		struct vec4 p = i < 6 ? frustum->planes[i] : vec4_make(0.0f, 0.0f, 0.0f, 1.0f);
+		lanes[0][i] = p.x;
+		lanes[1][i] = p.y;
+		lanes[2][i] = p.z;
+		lanes[3][i] = p.w;
+	}
+	for (int set = 0; set < 2; ++set) {
+		for (int k = 0; k < 3; ++k) {
+			planes.normal[set][k] = _mm_loadu_ps(&lanes[k][set * 4]);
+			planes.abs_normal[set][k] = _mm_andnot_ps(_mm_set1_ps(-0.0f), planes.normal[set][k]);
+		}
+		planes.distance[set] = _mm_loadu_ps(&lanes[3][set * 4]);
+	}
+#else
+	planes.frustum = frustum;
+#endif
+	return planes;
+}
+
+static inline enum cull_classification bvh_classify_node(const struct bvh_planes* planes, const struct bvh_node* node)
+{
+	struct vec3 center = {(node->min[0] + node->max[0]) * 0.5f, (node->min[1] + node->max[1]) * 0.5f, (node->min[2] + node->max[2]) * 0.5f};
+	struct vec3 extent = {(node->max[0] - node->min[0]) * 0.5f, (node->max[1] - node->min[1]) * 0.5f, (node->max[2] - node->min[2]) * 0.5f};
+#if VECMATH_SSE
+	__m128 cx = _mm_set1_ps(center.x), cy = _mm_set1_ps(center.y), cz = _mm_set1_ps(center.z);
+	__m128 ex = _mm_set1_ps(extent.x), ey = _mm_set1_ps(extent.y), ez = _mm_set1_ps(extent.z);
+	int outside = 0;
+	int crossing = 0;
+	for (int set = 0; set < 2; ++set) {
+		__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes->normal[set][0], cx), _mm_mul_ps(planes->normal[set][1], cy)),
+					     _mm_add_ps(_mm_mul_ps(planes->normal[set][2], cz), planes->distance[set]));
+		__m128 reach = _mm_add_ps(_mm_add_ps(_mm_mul_ps(planes->abs_normal[set][0], ex), _mm_mul_ps(planes->abs_normal[set][1], ey)),
+					  _mm_mul_ps(planes->abs_normal[set][2], ez));
+		outside |= _mm_movemask_ps(_mm_cmplt_ps(_mm_add_ps(distance, reach), _mm_setzero_ps()));
+		crossing |= _mm_movemask_ps(_mm_cmplt_ps(_mm_sub_ps(distance, reach), _mm_setzero_ps()));
+	}
+	return outside ? CULL_OUTSIDE : crossing ? CULL_INTERSECTS : CULL_INSIDE;
+#else
+	return cull_classify_box(planes->frustum, center, extent);
+#endif
+}
+
+static uint32_t bvh_emit_subtree(const struct bvh* bvh, uint32_t node_index, uint32_t* out, uint32_t count)
+{
+	const struct bvh_node* node = &bvh->nodes[node_index];
+	if (node->count) {
+		memcpy(out + count, bvh->indices + node->first, node->count * sizeof(uint32_t));
+		return count + node->count;
+	}
+	count = bvh_emit_subtree(bvh, node->first, out, count);
+	return bvh_emit_subtree(bvh, node->first + 1, out, count);
+}
+
+// Writes the objects in the frustum to visible, in tree order, and returns how many. visible must
+// hold bvh.object_count indices. Nodes fully inside are emitted without testing what is below.
+uint32_t bvh_query_frustum(const struct bvh* bvh, const struct cull_bounds* bounds, const struct frustum* frustum, uint32_t* visible)
+{
+	if (bvh->node_count == 0) return 0;
+	struct bvh_planes planes = bvh_planes_make(frustum);
+	uint32_t stack[BVH_MAX_DEPTH * 2];
+	uint32_t stack_size = 0;
+	uint32_t count = 0;
+	stack[stack_size++] = 0;
+	while (stack_size) {
+		uint32_t node_index = stack[--stack_size];
+		const struct bvh_node* node = &bvh->nodes[node_index];
+		enum cull_classification classification = bvh_classify_node(&planes, node);
+		if (classification == CULL_OUTSIDE) continue;
+		if (classification == CULL_INSIDE) {
+			count = bvh_emit_subtree(bvh, node_index, visible, count);
+		} else if (node->count) {
+			for (uint32_t i = node->first; i < node->first + node->count; ++i)
+				if (cull_test_scalar(bounds, frustum, bvh->indices[i])) visible[count++] = bvh->indices[i];
+		} else {
+			stack[stack_size++] = node->first + 1;
+			stack[stack_size++] = node->first;
+		}
+	}
+	return count;
+}
+
+// Entry distance of the ray into the box, INFINITY when it misses or enters beyond max_t.
+#if VECMATH_SSE
+static inline float bvh_ray_box(__m128 origin, __m128 inverse, __m128 far_limit, __m128 box_min, __m128 box_max)
+{
+	// lane 3 of every input is 0
+	__m128 t0 = _mm_mul_ps(_mm_sub_ps(box_min, origin), inverse);
+	__m128 t1 = _mm_mul_ps(_mm_sub_ps(box_max, origin), inverse);
+	__m128 entry = _mm_min_ps(t0, t1);                     // lane 3: 0, where the ray starts
+	__m128 exit = _mm_or_ps(_mm_max_ps(t0, t1), far_limit); // lane 3: max_t
+	entry = _mm_max_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(2, 3, 0, 1)));
+	entry = _mm_max_ps(entry, _mm_shuffle_ps(entry, entry, _MM_SHUFFLE(1, 0, 3, 2)));
+	exit = _mm_min_ps(exit, _mm_shuffle_ps(exit, exit, _MM_SHUFFLE(2, 3, 0, 1)));
+	exit = _mm_min_ps(exit, _mm_shuffle_ps(exit, exit, _MM_SHUFFLE(1, 0, 3, 2)));
+	float t = _mm_cvtss_f32(entry);
+	return t <= _mm_cvtss_f32(exit) ? t : INFINITY;
+}
+#else
+static inline float bvh_ray_box(const float* origin, const float* inverse, float max_t, const float* box_min, const float* box_max)
+{
+	float entry = 0.0f;
+	float exit = max_t;
+	for (int axis = 0; axis < 3; ++axis) {
+		float t0 = (box_min[axis] - origin[axis]) * inverse[axis];
+		float t1 = (box_max[axis] - origin[axis]) * inverse[axis];
+		entry = bvh_max(entry, bvh_min(t0, t1));
+		exit = bvh_min(exit, bvh_max(t0, t1));
+	}
+	return entry <= exit ? entry : INFINITY;
+}
+#endif
+
+// The object box the ray enters first within max_t, nearer children are visited first so most of
+// the tree is skipped once something was hit. False when nothing is hit.
+bool bvh_query_ray(const struct bvh* bvh, const struct cull_bounds* bounds, struct vec3 origin, struct vec3 direction, float max_t, struct bvh_hit* hit)
+{
+	hit->index = UINT32_MAX;
+	hit->t = max_t;
+	if (bvh->node_count == 0) return false;
+	float inverse[3] = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+#if VECMATH_SSE
+	__m128 origin4 = _mm_setr_ps(origin.x, origin.y, origin.z, 0.0f);
+	__m128 inverse4 = _mm_setr_ps(inverse[0], inverse[1], inverse[2], 0.0f);
+#define BVH_RAY_BOX(box_min, box_max) \
+	bvh_ray_box(origin4, inverse4, _mm_setr_ps(0.0f, 0.0f, 0.0f, hit->t), bvh_load_corner(box_min), bvh_load_corner(box_max))
+#else
+	float origin3[3] = {origin.x, origin.y, origin.z};
+#define BVH_RAY_BOX(box_min, box_max) bvh_ray_box(origin3, inverse, hit->t, box_min, box_max)
+#endif
+
+	// nodes to visit and where the ray enters them, a node entered beyond the best hit is skipped
+	uint32_t stack[BVH_MAX_DEPTH * 2];
+	float stack_t[BVH_MAX_DEPTH * 2];
+	uint32_t stack_size = 0;
+	float root_t = BVH_RAY_BOX(bvh->nodes[0].min, bvh->nodes[0].max);
+	if (root_t < INFINITY) {
+		stack[stack_size] = 0;
+		stack_t[stack_size++] = root_t;
+	}
+	while (stack_size) {
+		--stack_size;
+		if (stack_t[stack_size] >= hit->t) continue;
+		const struct bvh_node* node = &bvh->nodes[stack[stack_size]];
+		if (node->count) {
+			for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+				uint32_t object = bvh->indices[i];
+				struct bvh_box box = bvh_object_box(bounds, object);
+				float t = BVH_RAY_BOX(box.min, box.max);
+				if (t < hit->t) {
+					hit->t = t;
+					hit->index = object;
+				}
+			}
+			continue;
+		}
+		const struct bvh_node* children = &bvh->nodes[node->first];
+		float t0 = BVH_RAY_BOX(children[0].min, children[0].max);
+		float t1 = BVH_RAY_BOX(children[1].min, children[1].max);
+		uint32_t first = node->first;
+		uint32_t second = node->first + 1;
+		if (t1 < t0) {
+			float swap = t0;
+			t0 = t1;
+			t1 = swap;
+			first = node->first + 1;
+			second = node->first;
+		}
+		// the nearer one is popped first
+		if (t1 < hit->t) {
+			stack[stack_size] = second;
+			stack_t[stack_size++] = t1;
+		}
+		if (t0 < hit->t) {
+			stack[stack_size] = first;
+			stack_t[stack_size++] = t0;
+		}
+	}
+#undef BVH_RAY_BOX
+	return hit->index != UINT32_MAX;
+}
@@ -0,0 +1,394 @@
+// Frustum culling.
+// Bounds are structure of arrays: a center shared by a bounding sphere and an axis aligned box,
+// the sphere's radius and the box's half extents. An object is culled when, for one of the six
+// planes, its center is further outside than the smaller of the two reaches, the radius or the
+// box's projection on the plane normal, so whichever volume is tighter decides.
+// cull_run() splits the objects into chunks on the job system, every chunk tests its objects with
+// the widest kernel the CPU has (AVX2 8, SSE 4 objects per iteration) and writes the visible indices
+// into its part of the output, which is compacted afterwards. The hierarchical mode first tests
+// the boxes of groups of CULL_GROUP consecutive objects, cull_build_groups() computes them: groups
+// fully outside are skipped and groups fully inside emitted without a test, worth it when
+// consecutive objects are close to each other, as a grid or a spatially sorted scene is.
+// Requires vecmath.c, job_system.c.
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define CULL_CHUNK 16384     // objects per job at least, a multiple of CULL_GROUP
+#define CULL_MAX_CHUNKS 256  // larger inputs get larger chunks
+#define CULL_GROUP 64        // objects per group box of the hierarchical pass
+
+struct cull_bounds
+{
+	uint32_t count;
+	uint32_t capacity;
+	float* center[3]; // sphere and box
+	float* radius;
+	float* extent[3]; // box half size
+
+	// boxes of groups of CULL_GROUP objects, from cull_build_groups()
+	uint32_t group_count;
+	float* group_center[3];
+	float* group_extent[3];
+};
+
+// xyz the inward normal, w the distance, normalized: inside when dot(normal, p) + w >= 0.
+struct frustum
+{
+	struct vec4 planes[6];
+};
+
+enum cull_classification
+{
+	CULL_OUTSIDE,
+	CULL_INTERSECTS,
+	CULL_INSIDE,
+};
+
+bool cull_bounds_resize(struct cull_bounds* bounds, uint32_t count)
+{
+	if (count > bounds->capacity) {
+		uint32_t capacity = bounds->capacity ? bounds->capacity : 64;
+		while (capacity < count) capacity *= 2;
+		uint32_t group_capacity = (capacity + CULL_GROUP - 1) / CULL_GROUP;
+		float** arrays[] = {
+			&bounds->center[0], &bounds->center[1], &bounds->center[2], &bounds->radius,
+			&bounds->extent[0], &bounds->extent[1], &bounds->extent[2],
+		};
+		float** group_arrays[] = {
+			&bounds->group_center[0], &bounds->group_center[1], &bounds->group_center[2],
+			&bounds->group_extent[0], &bounds->group_extent[1], &bounds->group_extent[2],
+		};
+		for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+			float* p = realloc(*arrays[i], (size_t)capacity * sizeof(float));
+			if (!p) return false;
+			*arrays[i] = p;
+		}
+		for (size_t i = 0; i < sizeof(group_arrays) / sizeof(group_arrays[0]); ++i) {
+			float* p = realloc(*group_arrays[i], (size_t)group_capacity * sizeof(float));
+			if (!p) return false;
+			*group_arrays[i] = p;
+		}
+		bounds->capacity = capacity;
+	}
+	bounds->count = count;
+	bounds->group_count = 0;
+	return true;
+}
+
+void cull_bounds_free(struct cull_bounds* bounds)
+{
+	for (int i = 0; i < 3; ++i) {
+		free(bounds->center[i]);
+		free(bounds->extent[i]);
+		free(bounds->group_center[i]);
+		free(bounds->group_extent[i]);
+	}
+	free(bounds->radius);
+	memset(bounds, 0, sizeof(*bounds));
+}
+
+void cull_bounds_set(struct cull_bounds* bounds, uint32_t index, struct vec3 center, float radius, struct vec3 extent)
+{
+	bounds->center[0][index] = center.x;
+	bounds->center[1][index] = center.y;
+	bounds->center[2][index] = center.z;
+	bounds->radius[index] = radius;
+	bounds->extent[0][index] = extent.x;
+	bounds->extent[1][index] = extent.y;
+	bounds->extent[2][index] = extent.z;
+}
+
+// World bounds of a local box under an affine transform: the box around the transformed box, and
+// the local box's sphere scaled by the largest axis scale.
+void cull_bounds_transform(struct cull_bounds* bounds, uint32_t index, const struct mat4* world, struct vec3 local_center, struct vec3 local_extent)
+{
+	const struct vec4* c = world->columns;
+	struct vec3 center = vec3_make(c[0].x * local_center.x + c[1].x * local_center.y + c[2].x * local_center.z + c[3].x,
+				       c[0].y * local_center.x + c[1].y * local_center.y + c[2].y * local_center.z + c[3].y,
+				       c[0].z * local_center.x + c[1].z * local_center.y + c[2].z * local_center.z + c[3].z);
+	struct vec3 extent = vec3_make(fabsf(c[0].x) * local_extent.x + fabsf(c[1].x) * local_extent.y + fabsf(c[2].x) * local_extent.z,
+				       fabsf(c[0].y) * local_extent.x + fabsf(c[1].y) * local_extent.y + fabsf(c[2].y) * local_extent.z,
+				       fabsf(c[0].z) * local_extent.x + fabsf(c[1].z) * local_extent.y + fabsf(c[2].z) * local_extent.z);
+	float scale_squared = fmaxf(fmaxf(c[0].x * c[0].x + c[0].y * c[0].y + c[0].z * c[0].z,
+					  c[1].x * c[1].x + c[1].y * c[1].y + c[1].z * c[1].z),
+				    c[2].x * c[2].x + c[2].y * c[2].y + c[2].z * c[2].z);
+	cull_bounds_set(bounds, index, center, vec3_length(local_extent) * sqrtf(scale_squared), extent);
+}
+
+static void cull_build_group_range(void* data, uint32_t begin, uint32_t end)
+{
+	struct cull_bounds* bounds = data;
+	for (uint32_t group = begin; group < end; ++group) {
+		uint32_t first = group * CULL_GROUP;
+		uint32_t last = first + CULL_GROUP < bounds->count ? first + CULL_GROUP : bounds->count;
+		for (int axis = 0; axis < 3; ++axis) {
+			float low = INFINITY;
+			float high = -INFINITY;
+			for (uint32_t i = first; i < last; ++i) {
+				low = fminf(low, bounds->center[axis][i] - bounds->extent[axis][i]);
+				high = fmaxf(high, bounds->center[axis][i] + bounds->extent[axis][i]);
+			}
+			bounds->group_center[axis][group] = (low + high) * 0.5f;
+			bounds->group_extent[axis][group] = (high - low) * 0.5f;
+		}
+	}
+}
+
+// Group boxes for the hierarchical mode, after the bounds changed. Call from a thread known to the
+// job system.
+void cull_build_groups(struct cull_bounds* bounds)
+{
+	uint32_t group_count = (bounds->count + CULL_GROUP - 1) / CULL_GROUP;
+	job_parallel_for(group_count, 256, cull_build_group_range, bounds);
+	bounds->group_count = group_count;
+}
+
+// Planes of a world to clip transform, depth in [0, 1].
+struct frustum frustum_from_matrix(const struct mat4* view_projection)
+{
+	const struct vec4* c = view_projection->columns;
+	struct vec4 rows[4] = {
+		{c[0].x, c[1].x, c[2].x, c[3].x},
+		{c[0].y, c[1].y, c[2].y, c[3].y},
+		{c[0].z, c[1].z, c[2].z, c[3].z},
+		{c[0].w, c[1].w, c[2].w, c[3].w},
+	};
+	struct frustum frustum = {
+		.planes = {
+			vec4_add(rows[3], rows[0]), // left, -w <= x
+			vec4_sub(rows[3], rows[0]), // right, x <= w
+			vec4_add(rows[3], rows[1]), // bottom
+			vec4_sub(rows[3], rows[1]), // top
+			rows[2],                    // near, 0 <= z
+			vec4_sub(rows[3], rows[2]), // far, z <= w
+		},
+	};
+	for (int i = 0; i < 6; ++i) {
+		struct vec4 p = frustum.planes[i];
+		float length = sqrtf(p.x * p.x + p.y * p.y + p.z * p.z);
+		frustum.planes[i] = length > 0.0f ? vec4_scale(p, 1.0f / length) : p;
+	}
+	return frustum;
+}
+
+static enum cull_classification cull_classify_box(const struct frustum* frustum, struct vec3 center, struct vec3 extent)
+{
+	enum cull_classification result = CULL_INSIDE;
+	for (int i = 0; i < 6; ++i) {
+		struct vec4 p = frustum->planes[i];
+		float distance = p.x * center.x + p.y * center.y + p.z * center.z + p.w;
+		float reach = fabsf(p.x) * extent.x + fabsf(p.y) * extent.y + fabsf(p.z) * extent.z;
+		if (distance + reach < 0.0f) return CULL_OUTSIDE;
+		if (distance - reach < 0.0f) result = CULL_INTERSECTS;
+	}
+	return result;
+}
+
+// The reference every kernel has to match.
+static bool cull_test_scalar(const struct cull_bounds* bounds, const struct frustum* frustum, uint32_t i)
+{
+	for (int p = 0; p < 6; ++p) {
+		struct vec4 plane = frustum->planes[p];
+		float distance = plane.x * bounds->center[0][i] + plane.y * bounds->center[1][i] + plane.z * bounds->center[2][i] + plane.w;
+		float box = fabsf(plane.x) * bounds->extent[0][i] + fabsf(plane.y) * bounds->extent[1][i] + fabsf(plane.z) * bounds->extent[2][i];
+		if (distance + fminf(bounds->radius[i], box) < 0.0f) return false;
+	}
+	return true;
+}
+
+static uint32_t cull_range_scalar(const struct cull_bounds* bounds, const struct frustum* frustum, uint32_t begin, uint32_t end, uint32_t* out)
+{
+	uint32_t count = 0;
+	for (uint32_t i = begin; i < end; ++i)
+		if (cull_test_scalar(bounds, frustum, i)) out[count++] = i;
+	return count;
+}
+
+// Appends base + the set bits of mask.
+static inline uint32_t cull_emit(uint32_t* out, uint32_t count, uint32_t base, uint32_t mask)
+{
+	while (mask) {
+		out[count++] = base + (uint32_t)__builtin_ctz(mask);
+		mask &= mask - 1;
+	}
+	return count;
+}
+
+#if VECMATH_SSE
+static uint32_t cull_range_sse(const struct cull_bounds* bounds, const struct frustum* frustum, uint32_t begin, uint32_t end, uint32_t* out)
+{
+	__m128 n[6][4], a[6][3];
+	__m128 sign = _mm_set1_ps(-0.0f);
+	for (int p = 0; p < 6; ++p) {
+		const float* plane = &frustum->planes[p].x;
+		for (int k = 0; k < 4; ++k) n[p][k] = _mm_set1_ps(plane[k]);
+		for (int k = 0; k < 3; ++k) a[p][k] = _mm_andnot_ps(sign, n[p][k]);
+	}
+	uint32_t count = 0;
+	uint32_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 cx = _mm_loadu_ps(bounds->center[0] + i);
+		__m128 cy = _mm_loadu_ps(bounds->center[1] + i);
+		__m128 cz = _mm_loadu_ps(bounds->center[2] + i);
+		__m128 r = _mm_loadu_ps(bounds->radius + i);
+		__m128 ex = _mm_loadu_ps(bounds->extent[0] + i);
+		__m128 ey = _mm_loadu_ps(bounds->extent[1] + i);
+		__m128 ez = _mm_loadu_ps(bounds->extent[2] + i);
+		__m128 outside = _mm_setzero_ps();
+		for (int p = 0; p < 6; ++p) {
+			__m128 distance = _mm_add_ps(_mm_add_ps(_mm_mul_ps(n[p][0], cx), _mm_mul_ps(n[p][1], cy)), _mm_add_ps(_mm_mul_ps(n[p][2], cz), n[p][3]));
+			__m128 box = _mm_add_ps(_mm_add_ps(_mm_mul_ps(a[p][0], ex), _mm_mul_ps(a[p][1], ey)), _mm_mul_ps(a[p][2], ez));
+			outside = _mm_or_ps(outside, _mm_cmplt_ps(_mm_add_ps(distance, _mm_min_ps(r, box)), _mm_setzero_ps()));
+		}
+		count = cull_emit(out, count, i, (uint32_t)~_mm_movemask_ps(outside) & 0xf);
+	}
+	return count + cull_range_scalar(bounds, frustum, i, end, out + count);
+}
+#endif
+
+#if VECMATH_AVX2
+// Lane numbers of the set bits of every 8 bit mask, packed in nibbles, for a branchless compaction.
+static uint32_t g_cull_lanes[256];
+
+VECMATH_TARGET_AVX2 static uint32_t cull_range_avx2(const struct cull_bounds* bounds, const struct frustum* frustum, uint32_t begin, uint32_t end, uint32_t* out)
+{
+	__m256 n[6][4], a[6][3];
+	__m256 sign = _mm256_set1_ps(-0.0f);
+	for (int p = 0; p < 6; ++p) {
+		const float* plane = &frustum->planes[p].x;
+		for (int k = 0; k < 4; ++k) n[p][k] = _mm256_set1_ps(plane[k]);
+		for (int k = 0; k < 3; ++k) a[p][k] = _mm256_andnot_ps(sign, n[p][k]);
+	}
+	__m256i shifts = _mm256_setr_epi32(0, 4, 8, 12, 16, 20, 24, 28);
+	__m256i nibble = _mm256_set1_epi32(7);
+	uint32_t count = 0;
+	uint32_t i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 cx = _mm256_loadu_ps(bounds->center[0] + i);
+		__m256 cy = _mm256_loadu_ps(bounds->center[1] + i);
+		__m256 cz = _mm256_loadu_ps(bounds->center[2] + i);
+		__m256 r = _mm256_loadu_ps(bounds->radius + i);
+		__m256 ex = _mm256_loadu_ps(bounds->extent[0] + i);
+		__m256 ey = _mm256_loadu_ps(bounds->extent[1] + i);
+		__m256 ez = _mm256_loadu_ps(bounds->extent[2] + i);
+		__m256 outside = _mm256_setzero_ps();
+		for (int p = 0; p < 6; ++p) {
+			__m256 distance = _mm256_fmadd_ps(n[p][0], cx, _mm256_fmadd_ps(n[p][1], cy, _mm256_fmadd_ps(n[p][2], cz, n[p][3])));
+			__m256 box = _mm256_fmadd_ps(a[p][0], ex, _mm256_fmadd_ps(a[p][1], ey, _mm256_mul_ps(a[p][2], ez)));
+			outside = _mm256_or_ps(outside, _mm256_cmp_ps(_mm256_add_ps(distance, _mm256_min_ps(r, box)), _mm256_setzero_ps(), _CMP_LT_OQ));
+		}
+		// all 8 slots are written, count only advances by the visible ones; never past out[i + 8 - begin]
+		uint32_t visible = (uint32_t)~_mm256_movemask_ps(outside) & 0xff;
+		__m256i lanes = _mm256_and_si256(_mm256_srlv_epi32(_mm256_set1_epi32((int)g_cull_lanes[visible]), shifts), nibble);
+		_mm256_storeu_si256((__m256i*)(out + count), _mm256_add_epi32(lanes, _mm256_set1_epi32((int)i)));
+		count += (uint32_t)__builtin_popcount(visible);
+	}
+	return count + cull_range_scalar(bounds, frustum, i, end, out + count);
+}
+#endif
+
+typedef uint32_t (*cull_range_function)(const struct cull_bounds* bounds, const struct frustum* frustum, uint32_t begin, uint32_t end, uint32_t* out);
+
+static struct
+{
+	bool initialized;
+	enum vecmath_path path;
+	cull_range_function range;
+} g_cull;
+
+// Picks the kernel like vecmath_init() does, call up front from one thread.
+void cull_init(enum vecmath_path max_path)
+{
+	g_cull.path = VECMATH_PATH_SCALAR;
+	g_cull.range = cull_range_scalar;
+#if VECMATH_SSE
+	if (max_path >= VECMATH_PATH_SSE) {
+		g_cull.path = VECMATH_PATH_SSE;
+		g_cull.range = cull_range_sse;
+	}
+#endif
+#if VECMATH_AVX2
+	if (max_path >= VECMATH_PATH_AVX2 && vecmath_cpu_has_avx2()) {
+		for (uint32_t mask = 0; mask < 256; ++mask) {
+			uint32_t packed = 0;
+			uint32_t n = 0;
+			for (uint32_t lane = 0; lane < 8; ++lane)
+				if (mask & (1u << lane)) packed |= lane << (4 * n++);
+			g_cull_lanes[mask] = packed;
+		}
+		g_cull.path = VECMATH_PATH_AVX2;
+		g_cull.range = cull_range_avx2;
+	}
+#endif
+	(void)max_path;
+	g_cull.initialized = true;
+}
+
+struct cull_job
+{
+	const struct cull_bounds* bounds;
+	const struct frustum* frustum;
+	uint32_t* visible;
+	uint32_t chunk_size;
+	bool hierarchical;
+	uint32_t counts[CULL_MAX_CHUNKS];
+};
+
+static void cull_chunks(void* data, uint32_t begin, uint32_t end)
+{
+	struct cull_job* job = data;
+	for (uint32_t chunk = begin; chunk < end; ++chunk) {
+		uint32_t first = chunk * job->chunk_size;
+		uint32_t last = first + job->chunk_size < job->bounds->count ? first + job->chunk_size : job->bounds->count;
+		uint32_t* out = job->visible + first;
+		uint32_t count = 0;
+		if (!job->hierarchical) {
+			count = g_cull.range(job->bounds, job->frustum, first, last, out);
+		} else {
+			const struct cull_bounds* bounds = job->bounds;
+			for (uint32_t group = first / CULL_GROUP; group * CULL_GROUP < last; ++group) {
+				uint32_t group_first = group * CULL_GROUP;
+				uint32_t group_last = group_first + CULL_GROUP < last ? group_first + CULL_GROUP : last;
+				struct vec3 center = {bounds->group_center[0][group], bounds->group_center[1][group], bounds->group_center[2][group]};
+				struct vec3 extent = {bounds->group_extent[0][group], bounds->group_extent[1][group], bounds->group_extent[2][group]};
+				enum cull_classification classification = cull_classify_box(job->frustum, center, extent);
+				if (classification == CULL_INSIDE) {
+					for (uint32_t i = group_first; i < group_last; ++i) out[count++] = i;
+				} else if (classification == CULL_INTERSECTS) {
+					count += g_cull.range(bounds, job->frustum, group_first, group_last, out + count);
+				}
+			}
+		}
+		job->counts[chunk] = count;
+	}
+}
+
+// Writes the indices of the objects in the frustum to visible, ascending, and returns how many.
+// visible must hold bounds->count indices. hierarchical needs cull_build_groups() after the last
+// change to the bounds. Call from a thread known to the job system.
+uint32_t cull_run(const struct cull_bounds* bounds, const struct frustum* frustum, uint32_t* visible, bool hierarchical)
+{
+	if (!g_cull.initialized) cull_init(VECMATH_PATH_AVX2);
+	assert(!hierarchical || bounds->group_count == (bounds->count + CULL_GROUP - 1) / CULL_GROUP);
+	struct cull_job job = {
+		.bounds = bounds,
+		.frustum = frustum,
+		.visible = visible,
+		.chunk_size = CULL_CHUNK,
+		.hierarchical = hierarchical,
+	};
+	while ((uint64_t)job.chunk_size * CULL_MAX_CHUNKS < bounds->count) job.chunk_size *= 2;
+	uint32_t chunk_count = (bounds->count + job.chunk_size - 1) / job.chunk_size;
+	job_parallel_for(chunk_count, 1, cull_chunks, &job);
+
+	// every chunk wrote at its own start, moving them down in order never overwrites a later one
+	uint32_t count = 0;
+	for (uint32_t chunk = 0; chunk < chunk_count; ++chunk) {
+		uint32_t first = chunk * job.chunk_size;
+		if (count != first) memmove(visible + count, visible + first, job.counts[chunk] * sizeof(uint32_t));
+		count += job.counts[chunk];
+	}
+	return count;
+}
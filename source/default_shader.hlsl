@@ -1,9 +1,8 @@
-//IA
-struct VertexPosColor
-{
-    float4 Position : POSITION;
-    float4 Color : COLOR;
-};
+#include "bindless.hlsli"
+#include "vertex_format.hlsli"
+
+// vertices come from buffers[constants.buffer_index] in any format of vertex_format.hlsli, no input
+// assembler; instances from buffers[constants.instance_buffer_index], see mesh_renderer.c
 
 struct VertexShaderOutput
 {
@@ -11,22 +10,25 @@ struct VertexShaderOutput
     float4 Position : SV_Position;
 };
 
-//Bindings
-struct vs_constants
-{
-	matrix model_to_projection;
-};
-ConstantBuffer<vs_constants> vs_cb : register(b0);
-
-VertexShaderOutput VS(VertexPosColor IN)
+VertexShaderOutput VS(uint vertex_id : SV_VertexID, uint instance_id : SV_InstanceID)
 {
     VertexShaderOutput OUT;
 
-    /*OUT.Position = float4(IN.Position, 1.0f);*/
-    /*OUT.Color = float4(IN.Color, 1.0f);*/
+    mesh_vertex v = vertex_load(buffers[constants.buffer_index], vertex_id);
+    float4 position = v.position;
+
+    // float4x4 transform, column-major as vecmath.c stores it, then float4 color
+    ByteAddressBuffer instances = buffers[constants.instance_buffer_index];
+    uint instance = (constants.instance_base + instance_id) * 80;
+    float4 c0 = asfloat(instances.Load4(instance));
+    float4 c1 = asfloat(instances.Load4(instance + 16));
+    float4 c2 = asfloat(instances.Load4(instance + 32));
+    float4 c3 = asfloat(instances.Load4(instance + 48));
 
-    OUT.Position = IN.Position;
-    OUT.Color = IN.Color;
+    OUT.Position = c0 * position.x + c1 * position.y + c2 * position.z + c3 * position.w;
+    // model space normals facing the view lit fully, rims darker; flat meshes face it
+    float light = 0.6f + 0.4f * abs(v.normal.z);
+    OUT.Color = v.color * asfloat(instances.Load4(instance + 64)) * float4(light, light, light, 1.0f);
     return OUT;
 }
 
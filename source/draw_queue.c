@@ -0,0 +1,387 @@
+// Draw submission ordered by 64-bit sort keys.
+// Submitters add commands, then push a key naming a command, from any thread once the queue has
+// the room reserved. draw_queue_sort() orders the items by key with a parallel LSD radix sort, 8
+// bits per pass; a pass whose digit is the same for every key is skipped, so unused fields cost
+// nothing. draw_queue_record() walks the sorted items and records their commands, setting the root
+// signature, PSO, vertex and index buffers only when they differ from what is bound.
+// Key, most significant first: layer (4 bits), pass (4), PSO (8), material (16), depth (32). Layers
+// order what is drawn over what (scene, then UI), passes order within a layer.
+// Requires job_system.c.
+
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define DRAW_INVALID UINT32_MAX
+#define DRAW_MAX_CONSTANTS 4
+#define DRAW_ROOT_CONSTANTS 0 // both root signatures in the tree start with constants, then a table
+#define DRAW_ROOT_TABLE 1
+#define DRAW_SORT_PASSES 8
+#define DRAW_SORT_BUCKETS 256
+#define DRAW_SORT_CHUNK 16384    // items per job at least
+#define DRAW_SORT_MAX_CHUNKS 64  // larger queues get larger chunks
+#define DRAW_SORT_INSERTION 64   // queues up to this size skip the radix sort
+
+#define DRAW_KEY(layer, pass, pso, material, depth) \
+	((uint64_t)(layer) << 60 | (uint64_t)(pass) << 56 | (uint64_t)(pso) << 48 | (uint64_t)(material) << 32 | (uint64_t)(depth))
+
+#define DRAW_LAYER_SCENE 0
+#define DRAW_LAYER_UI 8
+#define DRAW_PASS_OPAQUE 0
+#define DRAW_PASS_TRANSPARENT 8
+#define DRAW_PASS_END 15 // after everything else of the layer, timestamps and the like
+
+enum draw_state_kind
+{
+	DRAW_STATE_ROOT_SIGNATURE,
+	DRAW_STATE_PSO,
+	DRAW_STATE_VERTEX_BUFFER,
+	DRAW_STATE_INDEX_BUFFER,
+	DRAW_STATE_COUNT,
+};
+
+static const char* draw_state_names[DRAW_STATE_COUNT] = {"root signature", "pso", "vertex buffer", "index buffer"};
+
+typedef void (*draw_record_function)(ID3D12GraphicsCommandList* cmd_list, void* data);
+
+// A draw, or with record set anything recorded by a function; after one of those nothing is
+// assumed bound anymore.
+struct draw_command
+{
+	draw_record_function record;
+	void* data;
+
+	ID3D12RootSignature* root_signature;
+	D3D12_GPU_DESCRIPTOR_HANDLE table;      // DRAW_ROOT_TABLE, ptr 0 for none
+	ID3D12PipelineState* pso;
+	D3D12_VERTEX_BUFFER_VIEW vertex_buffer; // BufferLocation 0 when the shader pulls vertices itself
+	D3D12_INDEX_BUFFER_VIEW index_buffer;
+	uint32_t constants[DRAW_MAX_CONSTANTS];  // DRAW_ROOT_CONSTANTS from constant_offset
+	uint32_t constant_offset;
+	uint32_t constant_count;
+	uint32_t index_count;
+	uint32_t instance_count;
+	uint32_t first_index;
+	int32_t base_vertex;
+};
+
+struct draw_item
+{
+	uint64_t key;
+	uint32_t command;
+	uint32_t padding;
+};
+
+struct draw_stats
+{
+	uint32_t items;
+	uint32_t sort_passes; // radix passes run, at most DRAW_SORT_PASSES
+	uint64_t sort_ns;
+	uint32_t sets[DRAW_STATE_COUNT];  // recorded
+	uint32_t skips[DRAW_STATE_COUNT]; // matched what was bound
+};
+
+struct draw_queue
+{
+	struct draw_item* items;
+	struct draw_item* scratch; // the other half of every radix pass
+	_Atomic uint32_t count;
+	uint32_t capacity;
+	struct draw_command* commands;
+	_Atomic uint32_t command_count;
+	uint32_t command_capacity;
+	uint32_t* histograms; // DRAW_SORT_MAX_CHUNKS * DRAW_SORT_PASSES * DRAW_SORT_BUCKETS
+	struct draw_stats stats;
+};
+
+// Front to back for depths >= 0, a float's bits order as the value does.
+static inline uint32_t draw_key_depth(float depth)
+{
+	uint32_t bits;
+	memcpy(&bits, &depth, sizeof(bits));
+	return bits >> 31 ? 0 : bits;
+}
+
+static inline uint32_t draw_key_depth_back_to_front(float depth)
+{
+	return ~draw_key_depth(depth);
+}
+
+// Room for items and commands, not concurrent with anything else on the queue.
+bool draw_queue_reserve(struct draw_queue* queue, uint32_t items, uint32_t commands)
+{
+	if (!queue->histograms) {
+		queue->histograms = malloc(DRAW_SORT_MAX_CHUNKS * DRAW_SORT_PASSES * DRAW_SORT_BUCKETS * sizeof(uint32_t));
+		if (!queue->histograms) return false;
+	}
+	if (items > queue->capacity) {
+		uint32_t capacity = queue->capacity ? queue->capacity : 64;
+		while (capacity < items) capacity *= 2;
+		struct draw_item* grown = realloc(queue->items, capacity * sizeof(struct draw_item));
+		if (!grown) return false;
+		queue->items = grown;
+		grown = realloc(queue->scratch, capacity * sizeof(struct draw_item));
+		if (!grown) return false;
+		queue->scratch = grown;
+		queue->capacity = capacity;
+	}
+	if (commands > queue->command_capacity) {
+		uint32_t capacity = queue->command_capacity ? queue->command_capacity : 64;
+		while (capacity < commands) capacity *= 2;
+		struct draw_command* grown = realloc(queue->commands, capacity * sizeof(struct draw_command));
+		if (!grown) return false;
+		queue->commands = grown;
+		queue->command_capacity = capacity;
+	}
+	return true;
+}
+
+void draw_queue_free(struct draw_queue* queue)
+{
+	free(queue->items);
+	free(queue->scratch);
+	free(queue->commands);
+	free(queue->histograms);
+	memset(queue, 0, sizeof(*queue));
+}
+
+// Empties the queue, keeps the memory.
+void draw_queue_reset(struct draw_queue* queue)
+{
+	atomic_store_explicit(&queue->count, 0, memory_order_relaxed);
+	atomic_store_explicit(&queue->command_count, 0, memory_order_relaxed);
+}
+
+// Index of the copied command for draw_queue_push(), DRAW_INVALID when the reserved room is used up.
+uint32_t draw_queue_command(struct draw_queue* queue, const struct draw_command* command)
+{
+	uint32_t index = atomic_fetch_add_explicit(&queue->command_count, 1, memory_order_relaxed);
+	if (index >= queue->command_capacity) return DRAW_INVALID;
+	queue->commands[index] = *command;
+	return index;
+}
+
+// Commands may be pushed any number of times under different keys. False when the queue is full.
+bool draw_queue_push(struct draw_queue* queue, uint64_t key, uint32_t command)
+{
+	if (command == DRAW_INVALID) return false;
+	uint32_t index = atomic_fetch_add_explicit(&queue->count, 1, memory_order_relaxed);
+	if (index >= queue->capacity) return false;
+	queue->items[index] = (struct draw_item){.key = key, .command = command};
+	return true;
+}
+
+struct draw_sort_job
+{
+	struct draw_queue* queue;
+	const struct draw_item* source;
+	struct draw_item* destination;
+	uint32_t count;
+	uint32_t chunk_size;
+	uint32_t pass;     // digit of the histogram and scatter jobs
+	bool all_passes;   // the first histogram counts every digit at once
+};
+
+static uint32_t* draw_sort_histogram(struct draw_queue* queue, uint32_t chunk, uint32_t pass)
+{
+	return queue->histograms + ((size_t)chunk * DRAW_SORT_PASSES + pass) * DRAW_SORT_BUCKETS;
+}
+
+static void draw_sort_count(void* data, uint32_t begin, uint32_t end)
+{
+	struct draw_sort_job* job = data;
+	for (uint32_t chunk = begin; chunk < end; ++chunk) {
+		uint32_t first = chunk * job->chunk_size;
+		uint32_t last = first + job->chunk_size < job->count ? first + job->chunk_size : job->count;
+		if (job->all_passes) {
+			uint32_t* histograms = draw_sort_histogram(job->queue, chunk, 0);
+			memset(histograms, 0, DRAW_SORT_PASSES * DRAW_SORT_BUCKETS * sizeof(uint32_t));
+			for (uint32_t i = first; i < last; ++i) {
+				uint64_t key = job->source[i].key;
+				for (uint32_t pass = 0; pass < DRAW_SORT_PASSES; ++pass)
+					histograms[pass * DRAW_SORT_BUCKETS + (key >> (pass * 8) & 0xff)]++;
+			}
+		} else {
+			uint32_t* histogram = draw_sort_histogram(job->queue, chunk, job->pass);
+			memset(histogram, 0, DRAW_SORT_BUCKETS * sizeof(uint32_t));
+			uint32_t shift = job->pass * 8;
+			for (uint32_t i = first; i < last; ++i) histogram[job->source[i].key >> shift & 0xff]++;
+		}
+	}
+}
+
+// Every chunk scatters its items in order to the offsets its histogram holds by then, stable.
+static void draw_sort_scatter(void* data, uint32_t begin, uint32_t end)
+{
+	struct draw_sort_job* job = data;
+	uint32_t shift = job->pass * 8;
+	for (uint32_t chunk = begin; chunk < end; ++chunk) {
+		uint32_t first = chunk * job->chunk_size;
+		uint32_t last = first + job->chunk_size < job->count ? first + job->chunk_size : job->count;
+		uint32_t* offsets = draw_sort_histogram(job->queue, chunk, job->pass);
+		for (uint32_t i = first; i < last; ++i) {
+			struct draw_item item = job->source[i];
+			job->destination[offsets[item.key >> shift & 0xff]++] = item;
+		}
+	}
+}
+
+// Orders the items by key, stable, after all pushes are done.
+void draw_queue_sort(struct draw_queue* queue)
+{
+	uint64_t begin = time_now_ns();
+	uint32_t count = atomic_load_explicit(&queue->count, memory_order_relaxed);
+	if (count > queue->capacity) count = queue->capacity;
+	queue->stats.items = count;
+	queue->stats.sort_passes = 0;
+
+	if (count <= DRAW_SORT_INSERTION) {
+		struct draw_item* items = queue->items;
+		for (uint32_t i = 1; i < count; ++i) {
+			struct draw_item item = items[i];
+			uint32_t j = i;
+			for (; j > 0 && items[j - 1].key > item.key; --j) items[j] = items[j - 1];
+			items[j] = item;
+		}
+		queue->stats.sort_ns = time_now_ns() - begin;
+		return;
+	}
+
+	uint32_t chunk_count = (count + DRAW_SORT_CHUNK - 1) / DRAW_SORT_CHUNK;
+	if (chunk_count > DRAW_SORT_MAX_CHUNKS) chunk_count = DRAW_SORT_MAX_CHUNKS;
+	struct draw_sort_job job = {
+		.queue = queue,
+		.source = queue->items,
+		.destination = queue->scratch,
+		.count = count,
+		.chunk_size = (count + chunk_count - 1) / chunk_count,
+		.all_passes = true,
+	};
+	chunk_count = (count + job.chunk_size - 1) / job.chunk_size;
+	job_parallel_for(chunk_count, 1, draw_sort_count, &job);
+
+	bool counted = true; // the chunk histograms match the current order
+	for (uint32_t pass = 0; pass < DRAW_SORT_PASSES; ++pass) {
+		// a digit all keys share would leave the order as it is
+		uint32_t total[DRAW_SORT_BUCKETS] = {0};
+		for (uint32_t chunk = 0; chunk < chunk_count; ++chunk) {
+			const uint32_t* histogram = draw_sort_histogram(queue, chunk, pass);
+			for (uint32_t bucket = 0; bucket < DRAW_SORT_BUCKETS; ++bucket) total[bucket] += histogram[bucket];
+		}
+		bool skip = false;
+		for (uint32_t bucket = 0; bucket < DRAW_SORT_BUCKETS; ++bucket)
+			if (total[bucket]) {
+				skip = total[bucket] == count;
+				break;
+			}
+		if (skip) continue;
+
+		job.pass = pass;
+		if (!counted) {
+			job.all_passes = false;
+			job_parallel_for(chunk_count, 1, draw_sort_count, &job);
+		}
+		// the counts become where each chunk writes its first item of every bucket
+		uint32_t offset = 0;
+		for (uint32_t bucket = 0; bucket < DRAW_SORT_BUCKETS; ++bucket) {
+			for (uint32_t chunk = 0; chunk < chunk_count; ++chunk) {
+				uint32_t* histogram = draw_sort_histogram(queue, chunk, pass);
+				uint32_t items = histogram[bucket];
+				histogram[bucket] = offset;
+				offset += items;
+			}
+		}
+		job_parallel_for(chunk_count, 1, draw_sort_scatter, &job);
+
+		const struct draw_item* sorted = job.destination;
+		job.destination = (struct draw_item*)job.source;
+		job.source = sorted;
+		counted = false;
+		queue->stats.sort_passes++;
+	}
+
+	if (job.source != queue->items) {
+		queue->scratch = queue->items;
+		queue->items = (struct draw_item*)job.source;
+	}
+	queue->stats.sort_ns = time_now_ns() - begin;
+}
+
+// Records the sorted items' commands into cmd_list, which has the descriptor heaps set. Without a
+// cmd_list the walk only counts the state changes it would make.
+void draw_queue_record(struct draw_queue* queue, ID3D12GraphicsCommandList* cmd_list)
+{
+	struct draw_stats* stats = &queue->stats;
+	memset(stats->sets, 0, sizeof(stats->sets));
+	memset(stats->skips, 0, sizeof(stats->skips));
+	uint32_t count = atomic_load_explicit(&queue->count, memory_order_relaxed);
+	if (count > queue->capacity) count = queue->capacity;
+
+	ID3D12RootSignature* root_signature = NULL;
+	D3D12_GPU_DESCRIPTOR_HANDLE table = {0};
+	ID3D12PipelineState* pso = NULL;
+	D3D12_VERTEX_BUFFER_VIEW vertex_buffer = {0};
+	D3D12_INDEX_BUFFER_VIEW index_buffer = {0};
+	bool topology = false;
+	for (uint32_t i = 0; i < count; ++i) {
+		const struct draw_command* command = &queue->commands[queue->items[i].command];
+		if (command->record) {
+			if (cmd_list) command->record(cmd_list, command->data);
+			root_signature = NULL;
+			table.ptr = 0;
+			pso = NULL;
+			memset(&vertex_buffer, 0, sizeof(vertex_buffer));
+			memset(&index_buffer, 0, sizeof(index_buffer));
+			topology = false;
+			continue;
+		}
+
+		if (command->root_signature != root_signature) {
+			// the root arguments are gone with the old signature
+			if (cmd_list) cmd_list->lpVtbl->SetGraphicsRootSignature(cmd_list, command->root_signature);
+			root_signature = command->root_signature;
+			table.ptr = 0;
+			stats->sets[DRAW_STATE_ROOT_SIGNATURE]++;
+		} else {
+			stats->skips[DRAW_STATE_ROOT_SIGNATURE]++;
+		}
+		if (command->table.ptr && command->table.ptr != table.ptr) {
+			if (cmd_list) cmd_list->lpVtbl->SetGraphicsRootDescriptorTable(cmd_list, DRAW_ROOT_TABLE, command->table);
+			table = command->table;
+		}
+		if (command->pso != pso) {
+			if (cmd_list) cmd_list->lpVtbl->SetPipelineState(cmd_list, command->pso);
+			pso = command->pso;
+			stats->sets[DRAW_STATE_PSO]++;
+		} else {
+			stats->skips[DRAW_STATE_PSO]++;
+		}
+		if (command->vertex_buffer.BufferLocation) {
+			if (memcmp(&command->vertex_buffer, &vertex_buffer, sizeof(vertex_buffer)) != 0) {
+				if (cmd_list) cmd_list->lpVtbl->IASetVertexBuffers(cmd_list, 0, 1, &command->vertex_buffer);
+				vertex_buffer = command->vertex_buffer;
+				stats->sets[DRAW_STATE_VERTEX_BUFFER]++;
+			} else {
+				stats->skips[DRAW_STATE_VERTEX_BUFFER]++;
+			}
+		}
+		if (memcmp(&command->index_buffer, &index_buffer, sizeof(index_buffer)) != 0) {
+			if (cmd_list) cmd_list->lpVtbl->IASetIndexBuffer(cmd_list, &command->index_buffer);
+			index_buffer = command->index_buffer;
+			stats->sets[DRAW_STATE_INDEX_BUFFER]++;
+		} else {
+			stats->skips[DRAW_STATE_INDEX_BUFFER]++;
+		}
+		if (!cmd_list) continue;
+
+		if (!topology) {
+			cmd_list->lpVtbl->IASetPrimitiveTopology(cmd_list, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+			topology = true;
+		}
+		if (command->constant_count)
+			cmd_list->lpVtbl->SetGraphicsRoot32BitConstants(cmd_list, DRAW_ROOT_CONSTANTS, command->constant_count, command->constants,
+									 command->constant_offset);
+		cmd_list->lpVtbl->DrawIndexedInstanced(cmd_list, command->index_count, command->instance_count, command->first_index,
+						       command->base_vertex, 0);
+	}
+}
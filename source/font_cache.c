@@ -0,0 +1,361 @@
+// On-disk font atlas cache.
+// Rasterizing the atlas with stb_truetype is most of the UI startup cost. The RGBA atlas, the glyph
+// metrics and the custom rectangles are written to a file keyed by a hash of everything the build
+// reads: font data, sizes, oversampling, glyph ranges and atlas settings. On the next startup the
+// file is memory-mapped and the fonts are filled in from it, so the atlas is never built and the
+// pixels upload straight from the mapping. Any mismatch or damage just rebuilds and rewrites it.
+// Requires frame_scheduler.c for frame_hash_bytes().
+
+#define FONT_CACHE_MAGIC 0x31415446u // "FTA1"
+#define FONT_CACHE_VERSION 1
+#define FONT_CACHE_MAX_GLYPHS (1u << 20)
+
+struct font_cache
+{
+	HANDLE file;
+	HANDLE mapping;
+	const uint8_t* view;
+
+	// RGBA32, in the mapping on a hit and owned by the atlas on a miss, valid until font_cache_close()
+	const unsigned char* pixels;
+	int width;
+	int height;
+
+	uint64_t key;
+	bool hit;
+	uint64_t build_ns; // map and restore on a hit, rasterize and write on a miss
+};
+
+struct font_cache_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t key;
+	uint64_t file_size;
+	uint64_t pixels_offset;
+	int32_t width;
+	int32_t height;
+	float uv_scale[2];
+	float uv_white_pixel[2];
+	uint32_t font_count;
+	uint32_t rect_count;
+	int32_t cursor_rect; // ImFontAtlas::CustomRectIds[0]
+	uint32_t pad;
+};
+
+// Per font, followed by glyph_count ImFontGlyph.
+struct font_cache_font
+{
+	float font_size;
+	float ascent;
+	float descent;
+	int32_t metrics_total_surface;
+	uint32_t glyph_count;
+	uint16_t fallback_char;
+	uint16_t ellipsis_char;
+};
+
+struct font_cache_rect
+{
+	uint32_t id;
+	uint16_t width;
+	uint16_t height;
+	uint16_t x;
+	uint16_t y;
+	float advance_x;
+	float offset[2];
+	int32_t font; // index into ImFontAtlas::Fonts, -1 for a plain rectangle
+};
+
+static int font_cache_font_index(const ImFontAtlas* atlas, const ImFont* font)
+{
+	for (int i = 0; i < atlas->Fonts.Size; ++i)
+		if (atlas->Fonts.Data[i] == font) return i;
+	return -1;
+}
+
+// Every input of ImFontAtlas_Build(), pointers replaced by what they point to.
+static uint64_t font_cache_key(ImFontAtlas* atlas)
+{
+	const char* version = igGetVersion();
+	uint64_t h = frame_hash_bytes(FONT_CACHE_VERSION, version, strlen(version));
+	int32_t settings[3] = {atlas->Flags, atlas->TexDesiredWidth, atlas->TexGlyphPadding};
+	h = frame_hash_bytes(h, settings, sizeof(settings));
+
+	for (int i = 0; i < atlas->ConfigData.Size; ++i) {
+		const ImFontConfig* cfg = &atlas->ConfigData.Data[i];
+		h = frame_hash_bytes(h, cfg->FontData, (size_t)cfg->FontDataSize);
+		float sizes[8] = {
+			cfg->SizePixels,
+			cfg->GlyphExtraSpacing.x,
+			cfg->GlyphExtraSpacing.y,
+			cfg->GlyphOffset.x,
+			cfg->GlyphOffset.y,
+			cfg->GlyphMinAdvanceX,
+			cfg->GlyphMaxAdvanceX,
+			cfg->RasterizerMultiply,
+		};
+		int32_t options[8] = {
+			cfg->FontNo,
+			cfg->OversampleH,
+			cfg->OversampleV,
+			cfg->PixelSnapH,
+			cfg->MergeMode,
+			(int32_t)cfg->RasterizerFlags,
+			cfg->EllipsisChar,
+			font_cache_font_index(atlas, cfg->DstFont),
+		};
+		h = frame_hash_bytes(h, sizes, sizeof(sizes));
+		h = frame_hash_bytes(h, options, sizeof(options));
+		const ImWchar* ranges = cfg->GlyphRanges ? cfg->GlyphRanges : ImFontAtlas_GetGlyphRangesDefault(atlas);
+		size_t range_count = 0;
+		while (ranges[range_count]) range_count += 2;
+		h = frame_hash_bytes(h, ranges, range_count * sizeof(ImWchar));
+	}
+
+	for (int i = 0; i < atlas->CustomRects.Size; ++i) {
+		const ImFontAtlasCustomRect* rect = &atlas->CustomRects.Data[i];
+		uint32_t size[3] = {rect->ID, rect->Width, rect->Height};
+		float glyph[3] = {rect->GlyphAdvanceX, rect->GlyphOffset.x, rect->GlyphOffset.y};
+		h = frame_hash_bytes(h, size, sizeof(size));
+		h = frame_hash_bytes(h, glyph, sizeof(glyph));
+	}
+	return h;
+}
+
+// Bounds-checked cursor over the mapped file.
+static const void* font_cache_read(const uint8_t* view, uint64_t size, uint64_t* offset, uint64_t bytes)
+{
+	if (bytes > size || *offset > size - bytes) return NULL;
+	const void* p = view + *offset;
+	*offset += bytes;
+	return p;
+}
+
+static void font_cache_unmap(struct font_cache* cache)
+{
+	if (cache->view) UnmapViewOfFile(cache->view);
+	if (cache->mapping) CloseHandle(cache->mapping);
+	if (cache->file != NULL && cache->file != INVALID_HANDLE_VALUE) CloseHandle(cache->file);
+	cache->view = NULL;
+	cache->mapping = NULL;
+	cache->file = NULL;
+}
+
+// Checks the whole file before touching the atlas, so a bad file leaves it untouched.
+static bool font_cache_validate(const struct font_cache* cache, const ImFontAtlas* atlas, uint64_t size)
+{
+	uint64_t offset = 0;
+	const struct font_cache_header* header = font_cache_read(cache->view, size, &offset, sizeof(*header));
+	if (!header || header->magic != FONT_CACHE_MAGIC || header->version != FONT_CACHE_VERSION ||
+	    header->key != cache->key || header->file_size != size)
+		return false;
+	if ((int)header->font_count != atlas->Fonts.Size || header->rect_count < (uint32_t)atlas->CustomRects.Size ||
+	    header->width <= 0 || header->height <= 0)
+		return false;
+
+	for (uint32_t i = 0; i < header->font_count; ++i) {
+		const struct font_cache_font* font = font_cache_read(cache->view, size, &offset, sizeof(*font));
+		if (!font || font->glyph_count > FONT_CACHE_MAX_GLYPHS ||
+		    !font_cache_read(cache->view, size, &offset, font->glyph_count * sizeof(ImFontGlyph)))
+			return false;
+	}
+	const struct font_cache_rect* rects = font_cache_read(cache->view, size, &offset, header->rect_count * sizeof(struct font_cache_rect));
+	if (!rects) return false;
+	for (uint32_t i = 0; i < header->rect_count; ++i) {
+		if (rects[i].font < -1 || rects[i].font >= (int32_t)header->font_count) return false;
+		if (i < (uint32_t)atlas->CustomRects.Size && rects[i].id != atlas->CustomRects.Data[i].ID) return false;
+	}
+
+	uint64_t pixel_bytes = (uint64_t)header->width * (uint64_t)header->height * 4;
+	offset = header->pixels_offset;
+	return font_cache_read(cache->view, size, &offset, pixel_bytes) != NULL;
+}
+
+// Does what ImFontAtlasBuildWithStbTruetype() and ImFontAtlasBuildFinish() leave behind, minus the pixels.
+static void font_cache_restore(struct font_cache* cache, ImFontAtlas* atlas)
+{
+	uint64_t size = ((const struct font_cache_header*)cache->view)->file_size;
+	uint64_t offset = 0;
+	const struct font_cache_header* header = font_cache_read(cache->view, size, &offset, sizeof(*header));
+
+	for (uint32_t i = 0; i < header->font_count; ++i) {
+		const struct font_cache_font* cached = font_cache_read(cache->view, size, &offset, sizeof(*cached));
+		const ImFontGlyph* glyphs = font_cache_read(cache->view, size, &offset, cached->glyph_count * sizeof(ImFontGlyph));
+
+		ImFont* font = atlas->Fonts.Data[i];
+		ImFont_ClearOutputData(font);
+		font->FontSize = cached->font_size;
+		font->Ascent = cached->ascent;
+		font->Descent = cached->descent;
+		font->MetricsTotalSurface = cached->metrics_total_surface;
+		font->FallbackChar = cached->fallback_char;
+		font->EllipsisChar = cached->ellipsis_char;
+		font->ContainerAtlas = atlas;
+		font->ConfigData = NULL;
+		font->ConfigDataCount = 0;
+		// the font frees its vectors with ImGui's allocator, so they have to come from it
+		size_t glyph_bytes = cached->glyph_count * sizeof(ImFontGlyph);
+		font->Glyphs.Data = glyph_bytes ? igMemAlloc(glyph_bytes) : NULL;
+		if (glyph_bytes) memcpy(font->Glyphs.Data, glyphs, glyph_bytes);
+		font->Glyphs.Size = font->Glyphs.Capacity = (int)cached->glyph_count;
+	}
+
+	for (int i = 0; i < atlas->ConfigData.Size; ++i) {
+		ImFontConfig* cfg = &atlas->ConfigData.Data[i];
+		if (!cfg->DstFont->ConfigData) cfg->DstFont->ConfigData = cfg;
+		cfg->DstFont->ConfigDataCount++;
+	}
+	for (int i = 0; i < atlas->Fonts.Size; ++i)
+		ImFont_BuildLookupTable(atlas->Fonts.Data[i]);
+
+	// rectangles the build registered itself (mouse cursors) are added, the caller's get their place
+	const struct font_cache_rect* rects = font_cache_read(cache->view, size, &offset, header->rect_count * sizeof(*rects));
+	for (uint32_t i = 0; i < header->rect_count; ++i) {
+		const struct font_cache_rect* cached = &rects[i];
+		if (i >= (uint32_t)atlas->CustomRects.Size) {
+			if (cached->font >= 0)
+				ImFontAtlas_AddCustomRectFontGlyph(atlas, atlas->Fonts.Data[cached->font], (ImWchar)cached->id, cached->width,
+								   cached->height, cached->advance_x,
+								   (ImVec2){cached->offset[0], cached->offset[1]});
+			else
+				ImFontAtlas_AddCustomRectRegular(atlas, cached->id, cached->width, cached->height);
+		}
+		atlas->CustomRects.Data[i].X = cached->x;
+		atlas->CustomRects.Data[i].Y = cached->y;
+	}
+	atlas->CustomRectIds[0] = header->cursor_rect;
+
+	atlas->TexWidth = header->width;
+	atlas->TexHeight = header->height;
+	atlas->TexUvScale = (ImVec2){header->uv_scale[0], header->uv_scale[1]};
+	atlas->TexUvWhitePixel = (ImVec2){header->uv_white_pixel[0], header->uv_white_pixel[1]};
+
+	cache->pixels = cache->view + header->pixels_offset;
+	cache->width = header->width;
+	cache->height = header->height;
+}
+
+static bool font_cache_load(struct font_cache* cache, ImFontAtlas* atlas, const wchar_t* path)
+{
+	cache->file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (cache->file == INVALID_HANDLE_VALUE) return false;
+
+	LARGE_INTEGER size;
+	if (GetFileSizeEx(cache->file, &size) && size.QuadPart >= (LONGLONG)sizeof(struct font_cache_header)) {
+		cache->mapping = CreateFileMappingW(cache->file, NULL, PAGE_READONLY, 0, 0, NULL);
+		if (cache->mapping) cache->view = MapViewOfFile(cache->mapping, FILE_MAP_READ, 0, 0, 0);
+	}
+	if (cache->view && font_cache_validate(cache, atlas, (uint64_t)size.QuadPart)) {
+		font_cache_restore(cache, atlas);
+		return true;
+	}
+	font_cache_unmap(cache);
+	return false;
+}
+
+// Written to a temporary file first, a reader never maps a half written cache.
+static bool font_cache_store(const struct font_cache* cache, const ImFontAtlas* atlas, const wchar_t* path)
+{
+	uint64_t size = sizeof(struct font_cache_header);
+	for (int i = 0; i < atlas->Fonts.Size; ++i)
+		size += sizeof(struct font_cache_font) + (uint64_t)atlas->Fonts.Data[i]->Glyphs.Size * sizeof(ImFontGlyph);
+	size += (uint64_t)atlas->CustomRects.Size * sizeof(struct font_cache_rect);
+	uint64_t pixels_offset = (size + 15) & ~15ull;
+	uint64_t pixel_bytes = (uint64_t)cache->width * (uint64_t)cache->height * 4;
+	size = pixels_offset + pixel_bytes;
+
+	uint8_t* data = calloc(1, size);
+	if (!data) return false;
+	uint8_t* p = data;
+	struct font_cache_header* header = (struct font_cache_header*)p;
+	*header = (struct font_cache_header){
+		.magic = FONT_CACHE_MAGIC,
+		.version = FONT_CACHE_VERSION,
+		.key = cache->key,
+		.file_size = size,
+		.pixels_offset = pixels_offset,
+		.width = cache->width,
+		.height = cache->height,
+		.uv_scale = {atlas->TexUvScale.x, atlas->TexUvScale.y},
+		.uv_white_pixel = {atlas->TexUvWhitePixel.x, atlas->TexUvWhitePixel.y},
+		.font_count = (uint32_t)atlas->Fonts.Size,
+		.rect_count = (uint32_t)atlas->CustomRects.Size,
+		.cursor_rect = atlas->CustomRectIds[0],
+	};
+	p += sizeof(*header);
+
+	for (int i = 0; i < atlas->Fonts.Size; ++i) {
+		const ImFont* font = atlas->Fonts.Data[i];
+		*(struct font_cache_font*)p = (struct font_cache_font){
+			.font_size = font->FontSize,
+			.ascent = font->Ascent,
+			.descent = font->Descent,
+			.metrics_total_surface = font->MetricsTotalSurface,
+			.glyph_count = (uint32_t)font->Glyphs.Size,
+			.fallback_char = font->FallbackChar,
+			.ellipsis_char = font->EllipsisChar,
+		};
+		p += sizeof(struct font_cache_font);
+		memcpy(p, font->Glyphs.Data, (size_t)font->Glyphs.Size * sizeof(ImFontGlyph));
+		p += (size_t)font->Glyphs.Size * sizeof(ImFontGlyph);
+	}
+	for (int i = 0; i < atlas->CustomRects.Size; ++i) {
+		const ImFontAtlasCustomRect* rect = &atlas->CustomRects.Data[i];
+		*(struct font_cache_rect*)p = (struct font_cache_rect){
+			.id = rect->ID,
+			.width = rect->Width,
+			.height = rect->Height,
+			.x = rect->X,
+			.y = rect->Y,
+			.advance_x = rect->GlyphAdvanceX,
+			.offset = {rect->GlyphOffset.x, rect->GlyphOffset.y},
+			.font = rect->Font ? font_cache_font_index(atlas, rect->Font) : -1,
+		};
+		p += sizeof(struct font_cache_rect);
+	}
+	memcpy(data + pixels_offset, cache->pixels, pixel_bytes);
+
+	wchar_t temp_path[MAX_PATH];
+	bool written = false;
+	if (swprintf(temp_path, MAX_PATH, L"%ls.tmp", path) > 0) {
+		HANDLE file = CreateFileW(temp_path, GENERIC_WRITE, 0, NULL, CREATE_ALWAYS, FILE_ATTRIBUTE_NORMAL, NULL);
+		if (file != INVALID_HANDLE_VALUE) {
+			DWORD done = 0;
+			written = size <= MAXDWORD && WriteFile(file, data, (DWORD)size, &done, NULL) && done == size;
+			CloseHandle(file);
+			written = written && MoveFileExW(temp_path, path, MOVEFILE_REPLACE_EXISTING);
+			if (!written) DeleteFileW(temp_path);
+		}
+	}
+	free(data);
+	return written;
+}
+
+// Fills the atlas from the cache at path, or builds it and writes the cache. Fonts must be added
+// before, the default font is added if there are none. False only if the atlas could not be built.
+bool font_cache_build(struct font_cache* cache, ImFontAtlas* atlas, const wchar_t* path)
+{
+	uint64_t begin = time_now_ns();
+	memset(cache, 0, sizeof(*cache));
+	if (atlas->ConfigData.Size == 0) ImFontAtlas_AddFontDefault(atlas, NULL);
+	cache->key = font_cache_key(atlas);
+
+	cache->hit = font_cache_load(cache, atlas, path);
+	if (!cache->hit) {
+		unsigned char* pixels = NULL;
+		ImFontAtlas_GetTexDataAsRGBA32(atlas, &pixels, &cache->width, &cache->height, NULL);
+		if (!pixels) return false;
+		cache->pixels = pixels;
+		font_cache_store(cache, atlas, path);
+	}
+	cache->build_ns = time_now_ns() - begin;
+	return true;
+}
+
+// After the renderer stopped reading the pixels.
+void font_cache_close(struct font_cache* cache)
+{
+	font_cache_unmap(cache);
+	cache->pixels = NULL;
+}
@@ -0,0 +1,258 @@
+// Simulation/render thread handoff.
+// The simulation thread fills an immutable frame packet (draw list, view, copied ImGui draw data)
+// in the packet's own arena and submits it; the render thread records and presents packet N while
+// the simulation builds N+1. Packets cycle through two bounded SPSC queues, when no packet is free
+// the simulation helps the job system until the render thread hands one back (backpressure).
+// With threading off every packet is rendered inline, for latency sensitive use.
+// Requires threading.c, job_system.c, arena.c, spsc_queue.c, mesh_renderer.c.
+
+#define FRAME_PACKET_COUNT 3
+#define FRAME_PACKET_ARENA_SIZE (1 << 20)
+
+struct frame_packet
+{
+	struct arena arena;
+	uint64_t frame_number;
+	uint64_t sim_begin_ns;
+	uint64_t sim_end_ns;
+
+	// view
+	uint32_t width;
+	uint32_t height;
+	float clear_color[4];
+	bool vsync;
+
+	// draw list
+	bool draw_triangle;
+	struct mesh_draw_list meshes; // instances grouped by PSO and mesh, in the packet arena
+	bool gpu_culling;
+	bool verify_culling;
+	bool per_draw_descriptor_tables;
+	bool parallel_ui_upload;
+
+	// timestamps of the input samples this frame consumed, for input-to-present latency
+	uint64_t* input_timestamps;
+	uint32_t input_count;
+
+	// deep copy of igGetDrawData(), every pointer refers to the packet arena
+	ImDrawData ui;
+};
+
+typedef void (*frame_render_function)(struct frame_packet* packet);
+
+static struct
+{
+	struct frame_packet packets[FRAME_PACKET_COUNT];
+	struct spsc_queue free_packets;      // render -> simulation
+	struct spsc_queue submitted_packets; // simulation -> render
+	semaphore_handle submitted;
+	thread_handle render_thread;
+	frame_render_function render;
+	_Atomic bool running;
+	bool threaded;
+	uint64_t frame_number;
+	_Atomic uint64_t submitted_count;
+	_Atomic uint64_t completed_count;
+	struct frame_packet* spare; // acquired and discarded, handed out again before the free queue
+
+	// statistics, nanoseconds of the last frame
+	uint64_t sim_ns;
+	uint64_t backpressure_ns;
+	_Atomic uint64_t render_ns;
+} g_pipeline;
+
+bool frame_pipeline_init(frame_render_function render, bool threaded);
+void frame_pipeline_shutdown(void);
+void frame_pipeline_set_threaded(bool threaded);
+void frame_pipeline_flush(void);
+struct frame_packet* frame_pipeline_acquire(void);
+void frame_pipeline_submit(struct frame_packet* packet);
+void frame_pipeline_discard(struct frame_packet* packet);
+bool frame_packet_copy_ui(struct frame_packet* packet, const ImDrawData* draw_data, size_t extra_bytes);
+
+static void frame_pipeline_render_main(void* param)
+{
+	(void)param;
+	job_register_thread();
+	while (atomic_load_explicit(&g_pipeline.running, memory_order_acquire)) {
+		semaphore_wait(&g_pipeline.submitted, 100);
+
+		struct frame_packet* packet;
+		while (spsc_queue_pop(&g_pipeline.submitted_packets, &packet)) {
+			uint64_t begin = time_now_ns();
+			g_pipeline.render(packet);
+			atomic_store_explicit(&g_pipeline.render_ns, time_now_ns() - begin, memory_order_relaxed);
+
+			spsc_queue_push(&g_pipeline.free_packets, &packet);
+			atomic_fetch_add_explicit(&g_pipeline.completed_count, 1, memory_order_release);
+		}
+	}
+}
+
+static bool frame_pipeline_start_thread(void)
+{
+	atomic_store(&g_pipeline.running, true);
+	if (!thread_create(&g_pipeline.render_thread, frame_pipeline_render_main, NULL)) {
+		atomic_store(&g_pipeline.running, false);
+		return false;
+	}
+	return true;
+}
+
+static void frame_pipeline_stop_thread(void)
+{
+	atomic_store(&g_pipeline.running, false);
+	semaphore_post(&g_pipeline.submitted, 1);
+	thread_join(g_pipeline.render_thread);
+}
+
+bool frame_pipeline_init(frame_render_function render, bool threaded)
+{
+	g_pipeline.render = render;
+	g_pipeline.frame_number = 0;
+	atomic_store(&g_pipeline.submitted_count, 0);
+	atomic_store(&g_pipeline.completed_count, 0);
+
+	if (!spsc_queue_init(&g_pipeline.free_packets, FRAME_PACKET_COUNT, sizeof(struct frame_packet*)) ||
+	    !spsc_queue_init(&g_pipeline.submitted_packets, FRAME_PACKET_COUNT, sizeof(struct frame_packet*)) ||
+	    !semaphore_create(&g_pipeline.submitted, 0))
+		return false;
+
+	for (int i = 0; i < FRAME_PACKET_COUNT; ++i) {
+		struct frame_packet* packet = &g_pipeline.packets[i];
+		if (!arena_init(&packet->arena, FRAME_PACKET_ARENA_SIZE)) return false;
+		spsc_queue_push(&g_pipeline.free_packets, &packet);
+	}
+
+	g_pipeline.threaded = threaded && frame_pipeline_start_thread();
+	return true;
+}
+
+void frame_pipeline_shutdown(void)
+{
+	frame_pipeline_flush();
+	if (g_pipeline.threaded) frame_pipeline_stop_thread();
+	g_pipeline.threaded = false;
+
+	for (int i = 0; i < FRAME_PACKET_COUNT; ++i)
+		arena_free(&g_pipeline.packets[i].arena);
+	spsc_queue_destroy(&g_pipeline.free_packets);
+	spsc_queue_destroy(&g_pipeline.submitted_packets);
+	semaphore_destroy(&g_pipeline.submitted);
+}
+
+// Waits until the render thread retired every submitted packet. Call before touching anything the
+// render thread uses: swap chain, device objects, command list.
+void frame_pipeline_flush(void)
+{
+	while (atomic_load_explicit(&g_pipeline.completed_count, memory_order_acquire) !=
+	       atomic_load_explicit(&g_pipeline.submitted_count, memory_order_relaxed)) {
+		if (!job_help()) thread_yield();
+	}
+}
+
+void frame_pipeline_set_threaded(bool threaded)
+{
+	if (threaded == g_pipeline.threaded) return;
+	frame_pipeline_flush();
+	if (threaded)
+		g_pipeline.threaded = frame_pipeline_start_thread();
+	else {
+		frame_pipeline_stop_thread();
+		g_pipeline.threaded = false;
+	}
+}
+
+struct frame_packet* frame_pipeline_acquire(void)
+{
+	uint64_t begin = time_now_ns();
+	struct frame_packet* packet = g_pipeline.spare;
+	g_pipeline.spare = NULL;
+	while (!packet && !spsc_queue_pop(&g_pipeline.free_packets, &packet)) {
+		if (!job_help()) thread_yield();
+	}
+	g_pipeline.backpressure_ns = time_now_ns() - begin;
+
+	arena_reset(&packet->arena);
+	packet->frame_number = g_pipeline.frame_number++;
+	memset(&packet->ui, 0, sizeof(packet->ui));
+	packet->input_timestamps = NULL;
+	packet->input_count = 0;
+	return packet;
+}
+
+void frame_pipeline_submit(struct frame_packet* packet)
+{
+	g_pipeline.sim_ns = packet->sim_end_ns - packet->sim_begin_ns;
+	atomic_fetch_add_explicit(&g_pipeline.submitted_count, 1, memory_order_relaxed);
+
+	if (!g_pipeline.threaded) {
+		uint64_t begin = time_now_ns();
+		g_pipeline.render(packet);
+		atomic_store_explicit(&g_pipeline.render_ns, time_now_ns() - begin, memory_order_relaxed);
+		spsc_queue_push(&g_pipeline.free_packets, &packet);
+		atomic_fetch_add_explicit(&g_pipeline.completed_count, 1, memory_order_release);
+		return;
+	}
+
+	// cannot fail, there are never more packets than queue slots
+	spsc_queue_push(&g_pipeline.submitted_packets, &packet);
+	semaphore_post(&g_pipeline.submitted, 1);
+}
+
+// Gives back a packet that will not be rendered. The free queue only takes packets from the render
+// side, so the packet is kept aside for the next acquire instead.
+void frame_pipeline_discard(struct frame_packet* packet)
+{
+	g_pipeline.sim_ns = packet->sim_end_ns - packet->sim_begin_ns;
+	g_pipeline.spare = packet;
+}
+
+// Copies the vertex, index and command buffers the renderer reads. The ImGui side buffers are
+// reused by the next igNewFrame(), so the packet cannot keep pointers to them. The arena only grows
+// while empty, extra_bytes is room for what the caller pushes after the copy.
+bool frame_packet_copy_ui(struct frame_packet* packet, const ImDrawData* draw_data, size_t extra_bytes)
+{
+	memset(&packet->ui, 0, sizeof(packet->ui));
+	struct arena* arena = &packet->arena;
+	if (!draw_data || !draw_data->Valid) {
+		if (arena->used + extra_bytes > arena->size) arena_reserve(arena, arena->used + extra_bytes);
+		return false;
+	}
+
+	size_t bytes = extra_bytes + (size_t)draw_data->CmdListsCount * (sizeof(ImDrawList*) + sizeof(ImDrawList) + 4 * 16) + 16;
+	for (int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* list = draw_data->CmdLists[n];
+		bytes += (size_t)list->CmdBuffer.Size * sizeof(ImDrawCmd) +
+			 (size_t)list->IdxBuffer.Size * sizeof(ImDrawIdx) +
+			 (size_t)list->VtxBuffer.Size * sizeof(ImDrawVert);
+	}
+	if (arena->used + bytes > arena->size && !arena_reserve(arena, arena->used + bytes))
+		return false;
+
+	ImDrawList** lists = arena_push(arena, (size_t)draw_data->CmdListsCount * sizeof(ImDrawList*), 16);
+	for (int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* src = draw_data->CmdLists[n];
+		ImDrawList* dst = arena_push(arena, sizeof(ImDrawList), 16);
+		memset(dst, 0, sizeof(ImDrawList));
+		dst->Flags = src->Flags;
+
+		dst->CmdBuffer.Size = dst->CmdBuffer.Capacity = src->CmdBuffer.Size;
+		dst->CmdBuffer.Data = arena_push(arena, (size_t)src->CmdBuffer.Size * sizeof(ImDrawCmd), 16);
+		memcpy(dst->CmdBuffer.Data, src->CmdBuffer.Data, (size_t)src->CmdBuffer.Size * sizeof(ImDrawCmd));
+
+		dst->IdxBuffer.Size = dst->IdxBuffer.Capacity = src->IdxBuffer.Size;
+		dst->IdxBuffer.Data = arena_push(arena, (size_t)src->IdxBuffer.Size * sizeof(ImDrawIdx), 16);
+		memcpy(dst->IdxBuffer.Data, src->IdxBuffer.Data, (size_t)src->IdxBuffer.Size * sizeof(ImDrawIdx));
+
+		dst->VtxBuffer.Size = dst->VtxBuffer.Capacity = src->VtxBuffer.Size;
+		dst->VtxBuffer.Data = arena_push(arena, (size_t)src->VtxBuffer.Size * sizeof(ImDrawVert), 16);
+		memcpy(dst->VtxBuffer.Data, src->VtxBuffer.Data, (size_t)src->VtxBuffer.Size * sizeof(ImDrawVert));
+
+		lists[n] = dst;
+	}
+
+	packet->ui = *draw_data;
+	packet->ui.CmdLists = lists;
+	return true;
+}
@@ -0,0 +1,215 @@
+// Idle-aware frame scheduling.
+// Every tick still runs the simulation and builds the UI, but a frame is only rendered and
+// presented when something visible changed: the hash of the draw data and view differs from the
+// last presented frame, or input arrived. Otherwise the previous image stays on screen and the host
+// sleeps on its event ring until input or the next idle tick. Occluded or minimized windows drop to
+// a slower tick that only probes whether presenting would be visible again.
+// Idle skipping can be switched off for comparison, occlusion handling cannot.
+// CPU use is accounted per mode from process CPU time, so the saving is measurable.
+// Requires threading.c.
+
+#define FRAME_IDLE_TICK_MS 100
+#define FRAME_OCCLUDED_TICK_MS 250
+#define FRAME_USAGE_WINDOW_NS 1000000000ull
+
+enum frame_mode
+{
+	FRAME_MODE_ACTIVE,
+	FRAME_MODE_IDLE,
+	FRAME_MODE_OCCLUDED,
+	FRAME_MODE_COUNT,
+};
+
+static const char* frame_mode_names[FRAME_MODE_COUNT] = {"active", "idle", "occluded"};
+
+struct frame_mode_usage
+{
+	double cpu_percent; // of one core
+	double ticks_per_second;
+	double presents_per_second;
+};
+
+static struct
+{
+	bool enabled;
+	uint32_t mode;
+	bool has_last_hash;
+	uint64_t last_hash;
+	_Atomic bool occluded; // set by whichever thread presents
+	uint64_t last_probe_ns;
+
+	// accounting, the time between two ticks belongs to the mode chosen by the earlier one
+	uint64_t tick_wall_ns;
+	uint64_t tick_cpu_ns;
+	uint64_t window_begin_ns;
+	uint64_t wall_ns[FRAME_MODE_COUNT];
+	uint64_t cpu_ns[FRAME_MODE_COUNT];
+	uint32_t ticks[FRAME_MODE_COUNT];
+	uint32_t presents[FRAME_MODE_COUNT];
+	struct frame_mode_usage usage[FRAME_MODE_COUNT];
+	uint64_t hash_ns;
+} g_scheduler;
+
+static inline uint64_t frame_hash_rotl(uint64_t x, int r)
+{
+	return (x << r) | (x >> (64 - r));
+}
+
+static inline uint64_t frame_hash_word(uint64_t h, uint64_t word)
+{
+	return frame_hash_rotl(h + word * 0xc2b2ae3d27d4eb4full, 31) * 0x9e3779b97f4a7c15ull;
+}
+
+// Not cryptographic, only has to notice that a frame differs from the previous one. Four
+// independent lanes so the multiplies overlap, draw data runs to megabytes with big UIs.
+uint64_t frame_hash_bytes(uint64_t seed, const void* data, size_t size)
+{
+	const uint8_t* p = data;
+	uint64_t lanes[4] = {seed, seed ^ 0x9e3779b97f4a7c15ull, seed ^ 0xc2b2ae3d27d4eb4full, seed ^ 0x165667b19e3779f9ull};
+	for (; size >= 32; size -= 32, p += 32) {
+		for (int i = 0; i < 4; ++i) {
+			uint64_t word;
+			memcpy(&word, p + i * 8, 8);
+			lanes[i] = frame_hash_word(lanes[i], word);
+		}
+	}
+	uint64_t h = lanes[0] ^ frame_hash_rotl(lanes[1], 7) ^ frame_hash_rotl(lanes[2], 12) ^ frame_hash_rotl(lanes[3], 18);
+	for (; size >= 8; size -= 8, p += 8) {
+		uint64_t word;
+		memcpy(&word, p, 8);
+		h = frame_hash_word(h, word);
+	}
+	uint64_t tail = 0;
+	memcpy(&tail, p, size);
+	h = frame_hash_word(h, tail ^ (uint64_t)size << 56);
+
+	h ^= h >> 33;
+	h *= 0xff51afd7ed558ccdull;
+	h ^= h >> 33;
+	return h;
+}
+
+// Vertices, indices and every command field that changes what ends up on screen.
+uint64_t frame_hash_draw_data(uint64_t seed, const ImDrawData* draw_data)
+{
+	uint64_t begin = time_now_ns();
+	uint64_t h = frame_hash_bytes(seed, &draw_data->DisplayPos, sizeof(ImVec2) * 2);
+	for (int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* list = draw_data->CmdLists[n];
+		h = frame_hash_bytes(h, list->VtxBuffer.Data, (size_t)list->VtxBuffer.Size * sizeof(ImDrawVert));
+		h = frame_hash_bytes(h, list->IdxBuffer.Data, (size_t)list->IdxBuffer.Size * sizeof(ImDrawIdx));
+		for (int i = 0; i < list->CmdBuffer.Size; i++) {
+			const ImDrawCmd* cmd = &list->CmdBuffer.Data[i];
+			uint64_t fields[5] = {
+				cmd->ElemCount,
+				(uint64_t)(uintptr_t)cmd->TextureId,
+				(uint64_t)cmd->VtxOffset << 32 | cmd->IdxOffset,
+				(uint64_t)(uintptr_t)cmd->UserCallback,
+				(uint64_t)(uintptr_t)cmd->UserCallbackData,
+			};
+			h = frame_hash_bytes(h, fields, sizeof(fields));
+			h = frame_hash_bytes(h, &cmd->ClipRect, sizeof(cmd->ClipRect));
+		}
+	}
+	g_scheduler.hash_ns = time_now_ns() - begin;
+	return h;
+}
+
+void frame_scheduler_init(bool enabled)
+{
+	memset(&g_scheduler, 0, sizeof(g_scheduler));
+	g_scheduler.enabled = enabled;
+	g_scheduler.tick_wall_ns = g_scheduler.window_begin_ns = time_now_ns();
+	g_scheduler.tick_cpu_ns = process_cpu_time_ns();
+}
+
+// The next tick renders no matter what, for when the screen content is gone (resize, unocclusion).
+void frame_scheduler_invalidate(void)
+{
+	g_scheduler.has_last_hash = false;
+}
+
+void frame_scheduler_set_enabled(bool enabled)
+{
+	if (enabled != g_scheduler.enabled) frame_scheduler_invalidate();
+	g_scheduler.enabled = enabled;
+}
+
+// From the presenting thread with the Present result.
+void frame_scheduler_presented(bool occluded)
+{
+	atomic_store_explicit(&g_scheduler.occluded, occluded, memory_order_relaxed);
+}
+
+static void frame_scheduler_account(void)
+{
+	uint64_t now = time_now_ns();
+	uint64_t cpu = process_cpu_time_ns();
+	uint32_t mode = g_scheduler.mode;
+	g_scheduler.wall_ns[mode] += now - g_scheduler.tick_wall_ns;
+	g_scheduler.cpu_ns[mode] += cpu - g_scheduler.tick_cpu_ns;
+	g_scheduler.tick_wall_ns = now;
+	g_scheduler.tick_cpu_ns = cpu;
+
+	if (now - g_scheduler.window_begin_ns < FRAME_USAGE_WINDOW_NS) return;
+	g_scheduler.window_begin_ns = now;
+	for (uint32_t i = 0; i < FRAME_MODE_COUNT; ++i) {
+		// modes not seen in this window keep their last numbers
+		if (g_scheduler.wall_ns[i]) {
+			double seconds = (double)g_scheduler.wall_ns[i] / 1e9;
+			g_scheduler.usage[i] = (struct frame_mode_usage){
+				.cpu_percent = 100.0 * (double)g_scheduler.cpu_ns[i] / (double)g_scheduler.wall_ns[i],
+				.ticks_per_second = g_scheduler.ticks[i] / seconds,
+				.presents_per_second = g_scheduler.presents[i] / seconds,
+			};
+		}
+		g_scheduler.wall_ns[i] = g_scheduler.cpu_ns[i] = 0;
+		g_scheduler.ticks[i] = g_scheduler.presents[i] = 0;
+	}
+}
+
+// Once per tick after the UI was built. Returns true if the frame should be rendered and presented.
+// probe_occlusion is set when the caller should test-present to find out if the window is visible again.
+bool frame_scheduler_tick(uint64_t content_hash, bool input_activity, bool minimized, bool* probe_occlusion)
+{
+	frame_scheduler_account();
+	*probe_occlusion = false;
+
+	bool render;
+	uint64_t now = time_now_ns();
+	if (minimized || atomic_load_explicit(&g_scheduler.occluded, memory_order_relaxed)) {
+		g_scheduler.mode = FRAME_MODE_OCCLUDED;
+		render = false;
+		if (!minimized && now - g_scheduler.last_probe_ns >= FRAME_OCCLUDED_TICK_MS * 1000000ull) {
+			g_scheduler.last_probe_ns = now;
+			*probe_occlusion = true;
+		}
+		// a restored window renders right away, its first Present says whether it is still hidden
+		if (minimized) atomic_store_explicit(&g_scheduler.occluded, false, memory_order_relaxed);
+		g_scheduler.has_last_hash = false;
+	} else if (!g_scheduler.enabled || input_activity || !g_scheduler.has_last_hash || content_hash != g_scheduler.last_hash) {
+		g_scheduler.mode = FRAME_MODE_ACTIVE;
+		render = true;
+	} else {
+		g_scheduler.mode = FRAME_MODE_IDLE;
+		render = false;
+	}
+
+	if (render) {
+		g_scheduler.last_hash = content_hash;
+		g_scheduler.has_last_hash = true;
+		g_scheduler.presents[g_scheduler.mode]++;
+	}
+	g_scheduler.ticks[g_scheduler.mode]++;
+	return render;
+}
+
+// How long the host may sleep on its event ring before the next tick, input ends the wait early.
+uint32_t frame_scheduler_wait_ms(void)
+{
+	switch (g_scheduler.mode) {
+		case FRAME_MODE_IDLE: return FRAME_IDLE_TICK_MS;
+		case FRAME_MODE_OCCLUDED: return FRAME_OCCLUDED_TICK_MS;
+		default: return 0;
+	}
+}
@@ -1,6 +1,31 @@
 #include "cnewsetup.h" 
+#include "alloc_track.c"
+#include "vecmath.c"
+#include "threading.c"
+#include "job_system.c"
+#include "upload_ring.c"
+#include "ui_batch.c"
 #include "imgui_impl_dx12.c"
 #include "imgui_impl_win32.c"
+#include "arena.c"
+#include "pool_alloc.c"
+#include "spsc_queue.c"
+#include "bindless.c"
+#include "draw_queue.c"
+#include "vertex_format.c"
+#include "mesh_blob.c"
+#include "lz_block.c"
+#include "asset_archive.c"
+#include "mesh_renderer.c"
+#include "frame_pipeline.c"
+#include "input.c"
+#include "frame_scheduler.c"
+#include "font_cache.c"
+#include "scene.c"
+#include "cull.c"
+#include "bvh.c"
+#include "lod.c"
+#include "meshlet.c"
 
 #define DX12_ENABLE_DEBUG_LAYER
 #ifdef DX12_ENABLE_DEBUG_LAYER
@@ -71,9 +96,15 @@ struct FrameContext {
 	UINT64 FenceValue;
 };
 
-#define IDT_TIMER1 1
+#define FRAME_STATS_INTERVAL_NS 5000000000ull
 #define NUM_FRAMES_IN_FLIGHT 3
 #define NUM_BACK_BUFFERS 3
+#define UPLOAD_RING_INITIAL_SIZE (1 << 20)
+#define FONT_CACHE_PATH L"imgui_font_atlas.cache"
+#define ALLOC_GATE_WARMUP_FRAMES 120
+#define SCENE_STRESS_NODES 1000000
+#define DEMO_SCENE_NODES 13
+#define INSTANCE_STRESS_COUNT 100000
 static HWND* g_hwnd;
 static UINT64 hwnd_width;
 static UINT hwnd_height;
@@ -86,8 +117,47 @@ static ID3D12DescriptorHeap* dsv_heap = NULL;
 static ID3D12CommandQueue* g_pd3dCommandQueue = NULL;
 static ID3D12GraphicsCommandList* g_pd3dCommandList = NULL;
 static ID3D12Fence* g_fence = NULL;
+static struct upload_ring g_upload_ring;
+static struct font_cache g_font_cache;
+// What survives a hot reload, the host keeps the pointer between game codes. It is allocated from
+// the ImGui allocator, destroying that takes the block along.
+#define GAME_PERSISTENT_VERSION 1
+struct game_persistent
+{
+	// these three first and never moved, a game code finding another version or size reads only them
+	uint32_t size;
+	uint32_t version;
+	struct pool_allocator* imgui_allocator;
+	char imgui_version[16]; // the context is only taken over by the same ImGui
+	ImGuiContext* imgui_context;
+};
+static struct game_persistent* g_persistent = NULL;
+static struct pool_allocator* g_imgui_allocator = NULL; // g_persistent->imgui_allocator
+static struct scene g_scene;          // one mesh per node
+static struct scene g_stress_scene;   // update benchmark, never drawn
+static struct scene g_instance_scene; // instancing stress test, a flat grid
+// MESH_KEY and color per node
+static uint32_t g_scene_keys[DEMO_SCENE_NODES];
+static struct vec4 g_scene_colors[DEMO_SCENE_NODES];
+static uint32_t* g_instance_keys;
+static struct vec4* g_instance_colors;
+static struct cull_bounds g_scene_bounds;      // world bounds of g_scene, then g_instance_scene
+static struct cull_bounds g_cull_stress_bounds; // culling benchmark, never drawn
+static uint32_t* g_cull_stress_visible;
+static struct bvh g_scene_bvh; // over g_scene_bounds, for picking
+static struct bvh g_cull_stress_bvh;
+static struct draw_queue g_draw_queue; // the render thread's
+static struct draw_queue g_draw_stress; // sort benchmark, never recorded
+static _Atomic uint32_t g_cooked_mesh = MESH_INVALID; // set by the render thread once it tried to load one
+static struct mesh_blob_header g_cooked_header;
+static struct asset_archive g_assets; // the render thread's, mapped while the game runs, assets are read in place unless compressed
+static _Atomic uint32_t g_asset_count = 0; // in g_assets, 0 when the loose files were read
+static _Atomic uint64_t g_asset_open_ns = 0;
+static _Atomic uint64_t g_cooked_load_ns = 0; // find or open, then upload
+static _Atomic uint32_t g_cooked_blocks = 0;  // the cooked mesh was decompressed from, 0 when it was stored as it is
 static ID3D12PipelineState* g_pso = NULL; 
-static ID3D12RootSignature* g_rootsig = NULL;
+static ID3D12PipelineState* g_pso_wireframe = NULL;
+static ID3D12PipelineState* g_pso_depth = NULL; // depth tested and back faces culled, for closed meshes
 ID3DBlob* vs_blob = NULL;
 ID3DBlob* ps_blob = NULL;
 
@@ -104,12 +174,36 @@ static UINT64* timestamp_buffer = NULL;
 static ID3D12Resource* rb_buffer;
 static ID3D12QueryHeap* query_heap;
 static double frame_time = 0.0;
+static _Atomic UINT64 gpu_frame_ticks = 0; // written by the render thread
+static _Atomic uint64_t ui_record_ns = 0;     // written by the render thread
+static _Atomic uint32_t ui_draw_count = 0;
+static _Atomic uint32_t ui_command_count = 0;
+static _Atomic uint32_t ui_culled_count = 0;
+static _Atomic uint32_t ui_skipped_state_sets = 0;
+static _Atomic uint64_t ui_upload_bytes = 0;
+static _Atomic uint64_t ui_upload_copy_ns = 0;
+static _Atomic uint32_t draw_queue_items = 0;   // written by the render thread
+static _Atomic uint32_t draw_queue_passes = 0;
+static _Atomic uint64_t draw_queue_sort_ns = 0;
+static _Atomic uint32_t draw_queue_sets[DRAW_STATE_COUNT];
+static _Atomic uint32_t draw_queue_skips[DRAW_STATE_COUNT];
+static _Atomic uint64_t upload_ring_size = 0;
+static _Atomic uint32_t upload_ring_grows = 0;
 static UINT total_timer_count = 6;
 static UINT ui_timer_count = 6;
 UINT stats_counter = 0;
+static uint64_t last_frame_stats_ns = 0;
+static uint64_t initialize_ns = 0;
+static uint64_t resize_ns = 0;
+static uint64_t initialize_begin_ns = 0;
+static _Atomic uint64_t ui_first_frame_ns = 0;  // since initialize, written by the render thread
+static _Atomic uint64_t ui_visible_ns = 0;      // first frame drawn with the font atlas resident
+static _Atomic uint64_t ui_font_upload_ns = 0;
 void frame_time_statistics(void);
 
 static bool is_vsync = true;
+static bool is_pipelined = true; // UI toggle, initialize() starts the pipeline with it
+static bool idle_skipping = true; // UI toggle, initialize() hands it to the frame scheduler
 
 // benchmarking
 #define microsecond 1000000
@@ -148,8 +242,9 @@ __declspec(dllexport) void CreateRenderTarget(void);
 __declspec(dllexport) void create_dsv(UINT64 width, UINT height);
 __declspec(dllexport) D3D12_CPU_DESCRIPTOR_HANDLE get_dsv_cpuhandle(void);
 __declspec(dllexport) void cleanup(void);
-__declspec(dllexport) void wndproc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
-__declspec(dllexport) bool initialize(HWND* hwnd);
+__declspec(dllexport) void wndproc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam, uint64_t timestamp_ns);
+__declspec(dllexport) bool initialize(HWND* hwnd, void** persistent);
+__declspec(dllexport) uint32_t idle_wait_ms(void);
 
 void WaitForLastSubmittedFrame(void);
 struct FrameContext* WaitForNextFrameResources(void);
@@ -164,8 +259,27 @@ ID3D12Resource* create_committed_resource(const D3D12_HEAP_PROPERTIES* heap_prop
 
 ID3D12PipelineState* create_pso(D3D12_GRAPHICS_PIPELINE_STATE_DESC* pso_desc);
 
-// triangle
-void create_triangle(ID3D12GraphicsCommandList* cmd_list);
+void job_stats_window(void);
+void alloc_stats_window(void);
+void ui_stress_windows(void);
+bool simulate_frame(struct frame_packet* packet);
+void render_frame(struct frame_packet* packet);
+
+// meshes
+void create_demo_meshes(ID3D12GraphicsCommandList* cmd_list);
+
+// scene
+void create_demo_scene(void);
+void animate_demo_scene(uint64_t now_ns);
+void update_stress_scene(uint64_t now_ns);
+void create_instance_scene(void);
+void free_instance_scene(void);
+bool update_scene_bounds(void);
+uint32_t cull_scene(const struct mat4* view_projection, uint32_t* visible, uint32_t* demo_visible);
+uint32_t pick_scene_node(struct vec3 origin, struct vec3 direction);
+void update_cull_stress(uint64_t now_ns);
+void free_cull_stress(void);
+void update_draw_stress(uint64_t now_ns);
 
 // defaults
 #define set_default(val, def) (((val) == 0) ? (def) : (val))
@@ -176,8 +290,69 @@ D3D12_BLEND_DESC default_blenddesc(D3D12_BLEND_DESC* blend_desc);
 D3D12_RASTERIZER_DESC default_rasterizer_desc(D3D12_RASTERIZER_DESC* rasterizer_desc);
 D3D12_DEPTH_STENCIL_DESC default_depthstencil_desc(D3D12_DEPTH_STENCIL_DESC* depthstencil_desc);
 
-__declspec(dllexport) bool initialize(HWND* hwnd)
+// ImGui allocates from the pools, user_data is the allocator
+static void* imgui_alloc(size_t size, void* user_data)
+{
+	return pool_alloc(user_data, size);
+}
+
+static void imgui_free(void* p, void* user_data)
+{
+	pool_free(user_data, p);
+}
+
+// Takes over what the previous game code left in the host's slot, or starts over when it was built
+// with another layout or another ImGui: the old allocator is destroyed with the context still in it.
+static struct game_persistent* game_persistent_take(void** persistent)
+{
+	struct game_persistent* kept = *persistent;
+	if (kept && kept->size == sizeof(*kept) && kept->version == GAME_PERSISTENT_VERSION &&
+	    strncmp(kept->imgui_version, igGetVersion(), sizeof(kept->imgui_version)) == 0)
+		return kept;
+	if (kept) pool_allocator_destroy(kept->imgui_allocator);
+
+	*persistent = NULL;
+	struct pool_allocator* allocator = pool_allocator_create();
+	if (!allocator) return NULL;
+	struct game_persistent* fresh = pool_alloc(allocator, sizeof(*fresh));
+	if (!fresh) {
+		pool_allocator_destroy(allocator);
+		return NULL;
+	}
+	*fresh = (struct game_persistent){.size = sizeof(*fresh), .version = GAME_PERSISTENT_VERSION, .imgui_allocator = allocator};
+	strncpy(fresh->imgui_version, igGetVersion(), sizeof(fresh->imgui_version) - 1);
+	return *persistent = fresh;
+}
+
+// A context created by an earlier game code still points into its unloaded image: the clipboard
+// and IME callbacks and the ini and log file names. They are taken from a context this game code
+// creates and drops. The settings handlers cannot be reached from C, so the ini is saved once by
+// the game code that created the context and not again for the rest of the run.
+static void imgui_take_over_context(ImGuiContext* context)
+{
+	ImGuiContext* scratch = igCreateContext(0);
+	ImGuiIO defaults = *igGetIO();
+	igDestroyContext(scratch);
+
+	igSetCurrentContext(context);
+	ImGuiIO* io = igGetIO();
+	io->GetClipboardTextFn = defaults.GetClipboardTextFn;
+	io->SetClipboardTextFn = defaults.SetClipboardTextFn;
+	io->ImeSetInputScreenPosFn = defaults.ImeSetInputScreenPosFn;
+	io->IniFilename = NULL;
+	io->LogFilename = defaults.LogFilename;
+	io->BackendPlatformName = io->BackendRendererName = NULL;
+	// the fonts are built again, their configs hold glyph ranges of the old image
+	ImFontAtlas_Clear(io->Fonts);
+}
+
+// persistent: the host keeps it across hot reloads, the ImGui allocator and context live there so
+// a reloaded game code starts with its pools warm and its windows where they were
+__declspec(dllexport) bool initialize(HWND* hwnd, void** persistent)
 {
+	initialize_begin_ns = time_now_ns();
+	alloc_track_name_thread("main");
+	uint32_t zone = alloc_zone_enter(ALLOC_ZONE_STARTUP);
 	g_hwnd = hwnd;
 	RECT rect;
 	if (GetClientRect(*g_hwnd, &rect)) {
@@ -188,32 +363,43 @@ __declspec(dllexport) bool initialize(HWND* hwnd)
 
 	if (!CreateDeviceD3D()) {
 		CleanupDeviceD3D();
+		alloc_zone_enter(zone);
 		return true;
 	}
-	igCreateContext(0);
+	job_system_init(0);
+	create_demo_scene();
+	g_persistent = game_persistent_take(persistent);
+	ASSERT(g_persistent);
+	g_imgui_allocator = g_persistent->imgui_allocator;
+	// before the context, ImGui allocates the context itself through them
+	igSetAllocatorFunctions(imgui_alloc, imgui_free, g_imgui_allocator);
+	if (g_persistent->imgui_context) {
+		imgui_take_over_context(g_persistent->imgui_context);
+	} else {
+		g_persistent->imgui_context = igCreateContext(0);
+		igStyleColorsDark(0);
+	}
 	ImGuiIO* io = igGetIO();
-	(void)io;
-	igStyleColorsDark(0);
 	ImGui_ImplWin32_Init(*hwnd);
 
-	fixed_GetCPUDescriptorHandleForHeapStart fixed_gchfhs =
-	    (fixed_GetCPUDescriptorHandleForHeapStart)
-		g_pd3dSrvDescHeap->lpVtbl->GetCPUDescriptorHandleForHeapStart;
-	fixed_GetGPUDescriptorHandleForHeapStart fixed_gghfhs =
-	    (fixed_GetGPUDescriptorHandleForHeapStart)
-		g_pd3dSrvDescHeap->lpVtbl->GetGPUDescriptorHandleForHeapStart;
-
-	D3D12_CPU_DESCRIPTOR_HANDLE srv_cpu_handle;
-	D3D12_GPU_DESCRIPTOR_HANDLE srv_gpu_handle;
-	fixed_gchfhs(g_pd3dSrvDescHeap, &srv_cpu_handle);
-	fixed_gghfhs(g_pd3dSrvDescHeap, &srv_gpu_handle);
+	// the atlas comes from the mapped cache when the fonts did not change, the backend uploads it without waiting
+	bool atlas_built = font_cache_build(&g_font_cache, io->Fonts, FONT_CACHE_PATH);
+	ASSERT(atlas_built);
 
+	bool ring_created = upload_ring_init(&g_upload_ring, g_device, UPLOAD_RING_INITIAL_SIZE);
+	ASSERT(ring_created);
+	bool meshes_initialized = mesh_renderer_init(g_device, NUM_FRAMES_IN_FLIGHT);
+	ASSERT(meshes_initialized);
+	uint32_t font_srv_index = bindless_alloc();
 	ImGui_ImplDX12_Init(g_device,
-			    NUM_FRAMES_IN_FLIGHT,
+			    &g_upload_ring,
 			    DXGI_FORMAT_R8G8B8A8_UNORM,
 			    g_pd3dSrvDescHeap,
-			    srv_cpu_handle,
-			    srv_gpu_handle);
+			    g_bindless.root_signature,
+			    bindless_gpu_handle(0),
+			    bindless_cpu_handle(font_srv_index),
+			    font_srv_index);
+	ImGui_ImplDX12_SetFontPixels(g_font_cache.pixels, g_font_cache.width, g_font_cache.height);
 
 	LARGE_INTEGER tmp_gpu_frequency;
 	g_pd3dCommandQueue->lpVtbl->GetTimestampFrequency(g_pd3dCommandQueue, &tmp_gpu_frequency);
@@ -223,18 +409,39 @@ __declspec(dllexport) bool initialize(HWND* hwnd)
 	QueryPerformanceFrequency(&tmp_cpu_frequency);
 	g_cpu_frequency = (double)tmp_cpu_frequency.QuadPart;
 	delta_time = measurement_default;
-	SetTimer(*hwnd, IDT_TIMER1, 5000 ,NULL);
+	last_frame_stats_ns = time_now_ns();
+	input_init();
+	frame_scheduler_init(idle_skipping);
+	frame_pipeline_init(render_frame, is_pipelined);
+	// ImGui device objects are created on the first frame and counted separately
+	initialize_ns = time_now_ns() - initialize_begin_ns;
+	alloc_zone_enter(zone);
 	return true;
 }
 
 __declspec(dllexport) void cleanup(void)
 {
-	KillTimer(*g_hwnd, IDT_TIMER1);
+	frame_pipeline_shutdown();
+	input_shutdown();
 	cpu_wait(g_fenceLastSignaledValue);
 	ImGui_ImplDX12_Shutdown();
+	font_cache_close(&g_font_cache);
+	upload_ring_destroy(&g_upload_ring);
 	ImGui_ImplWin32_Shutdown();
-	igDestroyContext(0);
+	// the context stays for the next game code, its settings are saved while their handlers are loaded
+	ImGuiIO* io = igGetIO();
+	if (io->IniFilename) igSaveIniSettingsToDisk(io->IniFilename);
+	io->IniFilename = NULL;
 	CleanupDeviceD3D();
+	scene_free(&g_scene);
+	scene_free(&g_stress_scene);
+	free_instance_scene();
+	cull_bounds_free(&g_scene_bounds);
+	bvh_free(&g_scene_bvh);
+	free_cull_stress();
+	draw_queue_free(&g_draw_queue);
+	draw_queue_free(&g_draw_stress);
+	job_system_shutdown();
 }
 
 void frame_time_statistics(void){
@@ -246,20 +453,11 @@ void frame_time_statistics(void){
 	memset(&delta_times, 0, stats_counter);
 }
 
-__declspec(dllexport) void wndproc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
+// timestamp_ns is when the window thread received the message, on the time_now_ns() clock
+__declspec(dllexport) void wndproc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam, uint64_t timestamp_ns)
 {
+	input_record_message(msg, wParam, timestamp_ns);
 	ImGui_ImplWin32_WndProcHandler(hWnd, msg, wParam, lParam);
-
-	switch (msg) {
-		case WM_TIMER:
-			switch(wParam)
-			{
-				case IDT_TIMER1:
-					frame_time_statistics();
-					return 0;
-			}
-			break;
-	}
 }
 
 __declspec(dllexport) bool CreateDeviceD3D()
@@ -325,7 +523,7 @@ __declspec(dllexport) bool CreateDeviceD3D()
 	{
 		D3D12_DESCRIPTOR_HEAP_DESC desc;
 		desc.Type = D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV;
-		desc.NumDescriptors = 1;
+		desc.NumDescriptors = BINDLESS_HEAP_SIZE;
 		desc.NodeMask = 1;
 		desc.Flags = D3D12_DESCRIPTOR_HEAP_FLAG_SHADER_VISIBLE;
 
@@ -334,6 +532,10 @@ __declspec(dllexport) bool CreateDeviceD3D()
 							   &IID_ID3D12DescriptorHeap,
 							   (void**)&g_pd3dSrvDescHeap);
 		g_pd3dSrvDescHeap->lpVtbl->SetName(g_pd3dSrvDescHeap, L"main_srv_desc_heap");
+
+		// every shader resource lives in this heap, referenced by index
+		if (!bindless_init(g_device, g_pd3dSrvDescHeap))
+			return false;
 	}
 
 	{
@@ -529,198 +731,203 @@ ID3D12PipelineState* create_pso(D3D12_GRAPHICS_PIPELINE_STATE_DESC* pso_desc)
 	return pso;
 }
 
-#define triangle_vertices_count 3
-#define no_offset 0
-#define first_subresource 0
-struct position_color
+// mesh and PSO ids, in creation order: every shape once per vertex format, the copy in format f at
+// shape + f * DEMO_MESH_COUNT
+#define DEMO_MESH_TRIANGLE 0
+#define DEMO_MESH_QUAD 1
+#define DEMO_MESH_SPHERE 2
+#define DEMO_MESH_COUNT 3
+#define DEMO_PSO_SOLID 0
+#define DEMO_PSO_WIREFRAME 1
+#define DEMO_PSO_DEPTH 2
+#define DEMO_COOKED_MESH L"..\\..\\data\\cooked.mesh" // written by tools/mesh_cooker.c
+#define DEMO_ARCHIVE L"..\\..\\data\\assets.pak" // written by tools/asset_packer.c, the loose files are the fallback
+#define DEMO_SPHERE_SEGMENTS 16
+#define DEMO_SPHERE_RINGS 8
+
+// local bounds of the demo meshes, from their vertices in create_demo_meshes()
+static const struct
 {
-	float position[4];
-	float color[4];
+	struct vec3 center;
+	struct vec3 extent;
+} demo_mesh_bounds[] = {
+	[DEMO_MESH_TRIANGLE] = {{0.0f, 0.0f, 0.0f}, {0.25f, 0.25f, 0.0f}},
+	[DEMO_MESH_QUAD] = {{0.0f, 0.0f, 0.0f}, {0.2f, 0.2f, 0.0f}},
+	[DEMO_MESH_SPHERE] = {{0.0f, 0.0f, 0.0f}, {0.25f, 0.25f, 0.25f}},
 };
 
-struct mesh
+// The payload of an archived asset: in place, or decompressed on the workers into memory that
+// asset_payload_release() frees. NULL when a compressed one is damaged.
+static const void* asset_payload(const struct asset_entry* entry)
 {
-	ID3D12Resource* vertex_default_resource;
-	ID3D12Resource* vertex_upload_resource;
-	D3D12_VERTEX_BUFFER_VIEW vbv;
-};
+	if (!asset_entry_compressed(entry)) return asset_entry_data(entry);
+	void* payload = malloc((size_t)entry->size);
+	if (payload && !asset_entry_read(entry, payload)) {
+		free(payload);
+		payload = NULL;
+	}
+	return payload;
+}
 
-struct mesh triangle;
+static void asset_payload_release(const void* payload)
+{
+	const uint8_t* bytes = payload;
+	if (bytes < g_assets.view || bytes >= g_assets.view + g_assets.size) free((void*)payload);
+}
 
-void create_triangle(ID3D12GraphicsCommandList* cmd_list)
+// HLSL includes looked up in the archive, beside the file being compiled.
+struct archive_include
 {
-	struct position_color vertices[triangle_vertices_count] = 
-	{
-		 { .position ={ 0.0f , 0.25f, 0.0f, 1.0f} ,.color = {1.0f , 0.0f, 0.0f, 1.0f}} ,
-		 { .position ={ 0.25f , -0.25f , 0.0f, 1.0f} ,.color = {0.0f , 1.0f, 0.0f, 1.0f}} ,
-		 { .position ={  -0.25f , -0.25f , 0.0f, 1.0f} ,.color = {0.0f , 0.0f, 1.0f, 1.f}} ,
-	};
+	ID3DInclude base;
+	char directory[ASSET_ARCHIVE_MAX_NAME]; // with the trailing '/'
+};
 
-	size_t stride = sizeof(struct position_color);
-	size_t vertex_buffer_byte_size = stride * _countof(vertices);
-
-	triangle.vertex_default_resource = create_committed_resource(&(D3D12_HEAP_PROPERTIES)
-			                                           {
-									.Type = D3D12_HEAP_TYPE_DEFAULT
-							           },
-							           &(D3D12_RESOURCE_DESC)
-								   {
-									.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
-								        .Width = vertex_buffer_byte_size,
-									.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR
-								   },
-                                                                   D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
-							           D3D12_RESOURCE_STATE_COPY_DEST,
-								   NULL);
-	triangle.vertex_default_resource->lpVtbl->SetName(triangle.vertex_default_resource, L"vertex_default_resource");
-
-	triangle.vertex_upload_resource = create_committed_resource(&(D3D12_HEAP_PROPERTIES)
-			                                           {
-								        .Type = D3D12_HEAP_TYPE_UPLOAD
-							           },
-							           &(D3D12_RESOURCE_DESC)
-								   {
-									.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
-								        .Width = vertex_buffer_byte_size,
-									.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR
-								   },
-                                                                   D3D12_DESCRIPTOR_HEAP_FLAG_NONE,
-							           D3D12_RESOURCE_STATE_GENERIC_READ,
-								   NULL);
-	triangle.vertex_upload_resource->lpVtbl->SetName(triangle.vertex_upload_resource, L"vertex_upload_resource");
-
-	BYTE* mapped_vertex_data = NULL;
-	triangle.vertex_upload_resource->lpVtbl->Map(triangle.vertex_upload_resource,
-						 first_subresource,
-						 &(D3D12_RANGE){.Begin = 0, .End = 0},
-						 (void**)&mapped_vertex_data);
-
-	memcpy((void*)mapped_vertex_data, 
-	       (void*)vertices, 
-	       vertex_buffer_byte_size);
-
-	triangle.vertex_upload_resource->lpVtbl->Unmap(triangle.vertex_upload_resource,
-						   first_subresource,
-						   &(D3D12_RANGE){.Begin = 0, .End = 0});
-
-	cmd_list->lpVtbl->CopyBufferRegion(cmd_list,
-					   triangle.vertex_default_resource, no_offset,
-					   triangle.vertex_upload_resource , no_offset,
-					   vertex_buffer_byte_size);
-
-	triangle.vbv.BufferLocation = triangle.vertex_default_resource->lpVtbl->GetGPUVirtualAddress(triangle.vertex_default_resource);
-	triangle.vbv.SizeInBytes = vertex_buffer_byte_size;
-	triangle.vbv.StrideInBytes = stride;
-
-	// resource transitions
-	cmd_list->lpVtbl->ResourceBarrier(cmd_list, 1, &(D3D12_RESOURCE_BARRIER)
-						   {
-							.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION, 
-							.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE, 
-							.Transition = 
-							{
-								.pResource = triangle.vertex_default_resource, 
-								.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES, 
-								.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST, 
-								.StateAfter = D3D12_RESOURCE_STATE_GENERIC_READ
-							} 
-						   });
+static HRESULT STDMETHODCALLTYPE archive_include_open(ID3DInclude* include, D3D_INCLUDE_TYPE type, LPCSTR name, LPCVOID parent, LPCVOID* data, UINT* bytes)
+{
+	(void)type;
+	(void)parent;
+	char path[ASSET_ARCHIVE_MAX_NAME];
+	if (snprintf(path, sizeof(path), "%s%s", ((struct archive_include*)include)->directory, name) >= (int)sizeof(path)) return E_FAIL;
+	const struct asset_entry* entry = asset_archive_find(&g_assets, asset_id(path));
+	if (!entry || entry->size > UINT_MAX) return E_FAIL;
+	*data = asset_payload(entry);
+	*bytes = (UINT)entry->size;
+	return *data ? S_OK : E_FAIL;
+}
 
-	// shaders compilation
+static HRESULT STDMETHODCALLTYPE archive_include_close(ID3DInclude* include, LPCVOID data)
+{
+	(void)include;
+	asset_payload_release(data); // only frees a decompressed include, the archive stays mapped
+	return S_OK;
+}
 
-	wchar_t* default_shader = L"..\\..\\source\\default_shader.hlsl";
+static ID3DIncludeVtbl archive_include_vtbl = {archive_include_open, archive_include_close};
 
-	WIN32_FIND_DATAW found_file;
-	if (FindFirstFileW(default_shader, &found_file) == INVALID_HANDLE_VALUE) {
-		if (MessageBoxW(NULL, L"Required shader file not found.\n\nMake sure default_shaders.hlsl is in the cnewsetup\\source folder.", L"Could not find required shader.",
-				MB_OK | MB_ICONERROR | MB_DEFBUTTON2) != IDYES) {
-		}
+// Entry of the shader at path in the archive, or of the loose file at loose_path without one. The
+// compiler's messages go to the debugger, NULL when it failed.
+static ID3DBlob* compile_shader(const char* path, const wchar_t* loose_path, const char* entry, const char* target)
+{
+	ID3DBlob* blob = NULL;
+	ID3DBlob* error_blob = NULL;
+	const struct asset_entry* source = asset_archive_find(&g_assets, asset_id(path));
+	const void* text = source ? asset_payload(source) : NULL;
+	if (text) {
+		struct archive_include include = {.base = {.lpVtbl = &archive_include_vtbl}};
+		const char* slash = strrchr(path, '/');
+		size_t length = slash ? (size_t)(slash - path) + 1 : 0;
+		memcpy(include.directory, path, length);
+		D3DCompile(text, (SIZE_T)source->size, path, NULL, &include.base, entry, target,
+			   D3DCOMPILE_SKIP_OPTIMIZATION | D3DCOMPILE_DEBUG, 0, &blob, &error_blob);
+		asset_payload_release(text);
+	} else {
+		D3DCompileFromFile(loose_path, NULL, D3D_COMPILE_STANDARD_FILE_INCLUDE, entry, target,
+				   D3DCOMPILE_SKIP_OPTIMIZATION | D3DCOMPILE_DEBUG, 0, &blob, &error_blob);
+	}
+	if (error_blob) {
+		OutputDebugString((char*)error_blob->lpVtbl->GetBufferPointer(error_blob));
+		csafe_release(error_blob);
 	}
+	return blob;
+}
 
-	HRESULT hr = NULL; 
-	ID3DBlob* error_blob = NULL;
+void create_demo_meshes(ID3D12GraphicsCommandList* cmd_list)
+{
+	struct vertex_input triangle_vertices[] = 
+	{
+		 { .position = { 0.0f , 0.25f, 0.0f} , .normal = {0.0f, 0.0f, 1.0f}, .color = {1.0f , 0.0f, 0.0f, 1.0f}} ,
+		 { .position = { 0.25f , -0.25f , 0.0f} , .normal = {0.0f, 0.0f, 1.0f}, .color = {0.0f , 1.0f, 0.0f, 1.0f}} ,
+		 { .position = {  -0.25f , -0.25f , 0.0f} , .normal = {0.0f, 0.0f, 1.0f}, .color = {0.0f , 0.0f, 1.0f, 1.f}} ,
+	};
+	uint16_t triangle_indices[] = {0, 1, 2};
 
-	hr = D3DCompileFromFile(default_shader,
-				NULL,
-				D3D_COMPILE_STANDARD_FILE_INCLUDE,
-				"VS",
-				"vs_5_1",
-				D3DCOMPILE_SKIP_OPTIMIZATION | D3DCOMPILE_DEBUG,
-				0,
-				(void**)&vs_blob,
-				(void**)&error_blob);
-	ASSERT(SUCCEEDED(hr));
-	if(error_blob)
+	struct vertex_input quad_vertices[] =
 	{
-		char* error_msg = (char*) error_blob->lpVtbl->GetBufferPointer(error_blob);
-		OutputDebugString(error_msg);
+		 { .position = { -0.2f , 0.2f, 0.0f} , .normal = {0.0f, 0.0f, 1.0f}, .color = {1.0f , 1.0f, 1.0f, 1.0f}} ,
+		 { .position = { 0.2f , 0.2f , 0.0f} , .normal = {0.0f, 0.0f, 1.0f}, .color = {1.0f , 1.0f, 0.0f, 1.0f}} ,
+		 { .position = { 0.2f , -0.2f , 0.0f} , .normal = {0.0f, 0.0f, 1.0f}, .color = {0.0f , 1.0f, 1.0f, 1.0f}} ,
+		 { .position = { -0.2f , -0.2f , 0.0f} , .normal = {0.0f, 0.0f, 1.0f}, .color = {1.0f , 0.0f, 1.0f, 1.0f}} ,
+	};
+	uint16_t quad_indices[] = {0, 1, 2, 0, 2, 3};
+
+	// a UV sphere, the seam column duplicated; colored by its normal so the quantization shows
+	struct vertex_input sphere_vertices[(DEMO_SPHERE_SEGMENTS + 1) * (DEMO_SPHERE_RINGS + 1)];
+	uint16_t sphere_indices[DEMO_SPHERE_SEGMENTS * DEMO_SPHERE_RINGS * 6];
+	uint32_t sphere_index_count = 0;
+	for (uint32_t ring = 0; ring <= DEMO_SPHERE_RINGS; ++ring) {
+		float theta = (float)ring / (float)DEMO_SPHERE_RINGS * 3.14159265f;
+		for (uint32_t segment = 0; segment <= DEMO_SPHERE_SEGMENTS; ++segment) {
+			float phi = (float)segment / (float)DEMO_SPHERE_SEGMENTS * 6.28318531f;
+			struct vec3 normal = vec3_make(sinf(theta) * cosf(phi), sinf(theta) * sinf(phi), cosf(theta));
+			sphere_vertices[ring * (DEMO_SPHERE_SEGMENTS + 1) + segment] = (struct vertex_input){
+				.position = vec3_scale(normal, 0.25f),
+				.normal = normal,
+				.color = vec4_make(normal.x * 0.5f + 0.5f, normal.y * 0.5f + 0.5f, normal.z * 0.5f + 0.5f, 1.0f),
+			};
+			if (ring < DEMO_SPHERE_RINGS && segment < DEMO_SPHERE_SEGMENTS) {
+				uint16_t a = (uint16_t)(ring * (DEMO_SPHERE_SEGMENTS + 1) + segment);
+				uint16_t b = (uint16_t)(a + DEMO_SPHERE_SEGMENTS + 1);
+				uint16_t quad[6] = {a, b, (uint16_t)(a + 1), (uint16_t)(a + 1), b, (uint16_t)(b + 1)};
+				memcpy(sphere_indices + sphere_index_count, quad, sizeof(quad));
+				sphere_index_count += 6;
+			}
+		}
 	}
 
-	hr = D3DCompileFromFile(default_shader,
-				NULL,
-				D3D_COMPILE_STANDARD_FILE_INCLUDE,
-				"PS",
-				"ps_5_1",
-				D3DCOMPILE_SKIP_OPTIMIZATION | D3DCOMPILE_DEBUG,
-				0,
-				(void**)&ps_blob,
-				(void**)&error_blob);
-
-	ASSERT(SUCCEEDED(hr));
-	if(error_blob)
-	{
-		char* error_msg = (char*) error_blob->lpVtbl->GetBufferPointer(error_blob);
-		OutputDebugString(error_msg);
+	for (uint32_t format = 0; format < VERTEX_FORMAT_COUNT; ++format) {
+		uint32_t triangle_mesh = mesh_create(cmd_list, (enum vertex_format)format, triangle_vertices, _countof(triangle_vertices), triangle_indices, _countof(triangle_indices), L"triangle");
+		uint32_t quad_mesh = mesh_create(cmd_list, (enum vertex_format)format, quad_vertices, _countof(quad_vertices), quad_indices, _countof(quad_indices), L"quad");
+		uint32_t sphere_mesh = mesh_create(cmd_list, (enum vertex_format)format, sphere_vertices, _countof(sphere_vertices), sphere_indices, sphere_index_count, L"sphere");
+		uint32_t first = format * DEMO_MESH_COUNT;
+		ASSERT(triangle_mesh == first + DEMO_MESH_TRIANGLE && quad_mesh == first + DEMO_MESH_QUAD && sphere_mesh == first + DEMO_MESH_SPHERE);
 	}
 
+	if (asset_archive_open(&g_assets, DEMO_ARCHIVE)) {
+		atomic_store_explicit(&g_asset_count, g_assets.header->entry_count, memory_order_relaxed);
+		atomic_store_explicit(&g_asset_open_ns, g_assets.open_ns, memory_order_relaxed);
+	}
 
-	ID3DBlob* rs_blob = NULL;
+	// published to the simulation with its header, the bounds place it; straight from the archive's
+	// pages when it is there. A compressed one is decompressed on the workers into memory of its own
+	// rather than the upload buffer, it is validated and split up from there and the upload heap is
+	// write-combined.
+	uint64_t cooked_begin = time_now_ns();
+	const struct asset_entry* cooked = asset_archive_find(&g_assets, asset_id("data/cooked.mesh"));
+	uint32_t cooked_mesh = MESH_INVALID;
+	if (cooked) {
+		asset_archive_prefetch(cooked);
+		const void* blob = asset_payload(cooked);
+		if (blob) {
+			cooked_mesh = mesh_create_cooked(cmd_list, blob, cooked->size, L"cooked.mesh");
+			if (cooked_mesh != MESH_INVALID) memcpy(&g_cooked_header, blob, sizeof(g_cooked_header));
+			asset_payload_release(blob);
+		}
+		atomic_store_explicit(&g_cooked_blocks, asset_entry_block_count(cooked), memory_order_relaxed);
+	} else {
+		cooked_mesh = mesh_load_cooked(cmd_list, DEMO_COOKED_MESH, &g_cooked_header);
+	}
+	atomic_store_explicit(&g_cooked_load_ns, time_now_ns() - cooked_begin, memory_order_relaxed);
+	atomic_store_explicit(&g_cooked_mesh, cooked_mesh, memory_order_release);
 
-	D3D12_FEATURE_DATA_ROOT_SIGNATURE feature_data = {};
-	feature_data.HighestVersion = D3D_ROOT_SIGNATURE_VERSION_1_1;
-	hr = g_device->lpVtbl->CheckFeatureSupport(g_device, D3D12_FEATURE_ROOT_SIGNATURE, (void*)&feature_data, sizeof(feature_data) );
-	ASSERT(SUCCEEDED(hr));
+	// shaders compilation
 
-	hr = D3D12SerializeVersionedRootSignature(&(D3D12_VERSIONED_ROOT_SIGNATURE_DESC) {
-				.Version = D3D_ROOT_SIGNATURE_VERSION_1_1, 
-				.Desc_1_1 = (D3D12_ROOT_SIGNATURE_DESC1) {
-					.NumParameters = 1,
-					.pParameters = (D3D12_ROOT_PARAMETER1[1]){
-						{
-							.ParameterType = D3D12_ROOT_PARAMETER_TYPE_CBV,
-							.ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX,
-							.Descriptor = {
-								.ShaderRegister = 0,
-								.RegisterSpace = 0,
-								.Flags = D3D12_ROOT_DESCRIPTOR_FLAG_NONE
-							}
-						}
-					},
-					.NumStaticSamplers = 0,
-					.pStaticSamplers = NULL,
-					.Flags = D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT
-				}
-			}, 
-			&rs_blob, &error_blob);
+	wchar_t* default_shader = L"..\\..\\source\\default_shader.hlsl";
 
-	ASSERT(SUCCEEDED(hr));
-	if(error_blob)
-	{
-		char* error_msg = (char*) error_blob->lpVtbl->GetBufferPointer(error_blob);
-		OutputDebugString(error_msg);
+	WIN32_FIND_DATAW found_file;
+	if (!asset_archive_find(&g_assets, asset_id("source/default_shader.hlsl")) && FindFirstFileW(default_shader, &found_file) == INVALID_HANDLE_VALUE) {
+		if (MessageBoxW(NULL, L"Required shader file not found.\n\nMake sure default_shaders.hlsl is in the cnewsetup\\source folder.", L"Could not find required shader.",
+				MB_OK | MB_ICONERROR | MB_DEFBUTTON2) != IDYES) {
+		}
 	}
 
-	hr = g_device->lpVtbl->CreateRootSignature(g_device,
-						  1,
-						  rs_blob->lpVtbl->GetBufferPointer(rs_blob),
-						  rs_blob->lpVtbl->GetBufferSize(rs_blob),
-						  &IID_ID3D12RootSignature,
-						  (void**)&g_rootsig);
+	vs_blob = compile_shader("source/default_shader.hlsl", default_shader, "VS", "vs_5_1");
+	ASSERT(vs_blob);
+	ps_blob = compile_shader("source/default_shader.hlsl", default_shader, "PS", "ps_5_1");
+	ASSERT(ps_blob);
 
-	ASSERT(SUCCEEDED(hr));
 
 	g_pso = create_pso(&(D3D12_GRAPHICS_PIPELINE_STATE_DESC) {
-				.pRootSignature = g_rootsig,
+				.pRootSignature = g_bindless.root_signature,
 				.VS = {.pShaderBytecode = vs_blob->lpVtbl->GetBufferPointer(vs_blob), .BytecodeLength = vs_blob->lpVtbl->GetBufferSize(vs_blob)},
 				.PS = {.pShaderBytecode = ps_blob->lpVtbl->GetBufferPointer(ps_blob), .BytecodeLength = ps_blob->lpVtbl->GetBufferSize(ps_blob)},
 				.RasterizerState = {
@@ -728,30 +935,60 @@ void create_triangle(ID3D12GraphicsCommandList* cmd_list)
 					.CullMode = D3D12_CULL_MODE_NONE
 				},
 				.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM,
-				.InputLayout = {
-					.NumElements = 2,
-					.pInputElementDescs = (D3D12_INPUT_ELEMENT_DESC[2]) {
-						{
-							.SemanticName = "POSITION",
-							.Format = DXGI_FORMAT_R32G32B32A32_FLOAT,
-							.InputSlot = 0,
-							.AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT,
-							.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA
-						},
-						{
-							.SemanticName = "COLOR",
-							.Format = DXGI_FORMAT_R32G32B32A32_FLOAT,
-							.InputSlot = 0,
-							.AlignedByteOffset = D3D12_APPEND_ALIGNED_ELEMENT,
-							.InputSlotClass = D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA
-						}
-					}
+				// vertices are fetched from the bindless buffer by SV_VertexID
+				.InputLayout = {.NumElements = 0, .pInputElementDescs = NULL},
+				.DSVFormat = dsv_format,
+				.NumRenderTargets = NUM_BACK_BUFFERS,
+				.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE
+			});
+
+	g_pso_wireframe = create_pso(&(D3D12_GRAPHICS_PIPELINE_STATE_DESC) {
+				.pRootSignature = g_bindless.root_signature,
+				.VS = {.pShaderBytecode = vs_blob->lpVtbl->GetBufferPointer(vs_blob), .BytecodeLength = vs_blob->lpVtbl->GetBufferSize(vs_blob)},
+				.PS = {.pShaderBytecode = ps_blob->lpVtbl->GetBufferPointer(ps_blob), .BytecodeLength = ps_blob->lpVtbl->GetBufferSize(ps_blob)},
+				.RasterizerState = {
+					.FillMode = D3D12_FILL_MODE_WIREFRAME, 
+					.CullMode = D3D12_CULL_MODE_NONE
+				},
+				.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM,
+				.InputLayout = {.NumElements = 0, .pInputElementDescs = NULL},
+				.DSVFormat = dsv_format,
+				.NumRenderTargets = NUM_BACK_BUFFERS,
+				.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE
+			});
+
+	g_pso_depth = create_pso(&(D3D12_GRAPHICS_PIPELINE_STATE_DESC) {
+				.pRootSignature = g_bindless.root_signature,
+				.VS = {.pShaderBytecode = vs_blob->lpVtbl->GetBufferPointer(vs_blob), .BytecodeLength = vs_blob->lpVtbl->GetBufferSize(vs_blob)},
+				.PS = {.pShaderBytecode = ps_blob->lpVtbl->GetBufferPointer(ps_blob), .BytecodeLength = ps_blob->lpVtbl->GetBufferSize(ps_blob)},
+				.RasterizerState = {
+					.FillMode = D3D12_FILL_MODE_SOLID, 
+					.CullMode = D3D12_CULL_MODE_BACK
 				},
+				.DepthStencilState = {.DepthEnable = TRUE},
+				.RTVFormats[0] = DXGI_FORMAT_R8G8B8A8_UNORM,
+				.InputLayout = {.NumElements = 0, .pInputElementDescs = NULL},
 				.DSVFormat = dsv_format,
 				.NumRenderTargets = NUM_BACK_BUFFERS,
 				.PrimitiveTopologyType = D3D12_PRIMITIVE_TOPOLOGY_TYPE_TRIANGLE
 			});
 
+	uint32_t solid = mesh_renderer_add_pso(g_pso);
+	uint32_t wireframe = mesh_renderer_add_pso(g_pso_wireframe);
+	uint32_t depth = mesh_renderer_add_pso(g_pso_depth);
+	ASSERT(solid == DEMO_PSO_SOLID && wireframe == DEMO_PSO_WIREFRAME && depth == DEMO_PSO_DEPTH);
+
+	// GPU culling kernels, without them the scene is drawn by the CPU path
+	wchar_t* cull_shader = L"..\\..\\source\\mesh_cull.hlsl";
+	const char* cull_entries[2] = {"cull", "compact"};
+	ID3DBlob* cull_blobs[2] = {NULL, NULL};
+	for (int i = 0; i < 2; ++i) cull_blobs[i] = compile_shader("source/mesh_cull.hlsl", cull_shader, cull_entries[i], "cs_5_1");
+	if (cull_blobs[0] && cull_blobs[1] &&
+	    !mesh_renderer_init_culling(cull_blobs[0]->lpVtbl->GetBufferPointer(cull_blobs[0]), cull_blobs[0]->lpVtbl->GetBufferSize(cull_blobs[0]),
+					cull_blobs[1]->lpVtbl->GetBufferPointer(cull_blobs[1]), cull_blobs[1]->lpVtbl->GetBufferSize(cull_blobs[1])))
+		OutputDebugString("GPU culling unavailable, drawing without it\n");
+	csafe_release(cull_blobs[0]);
+	csafe_release(cull_blobs[1]);
 }
 
 D3D12_BLEND_DESC default_blenddesc(D3D12_BLEND_DESC* blend_desc)
@@ -996,6 +1233,9 @@ __declspec(dllexport) void CleanupDeviceD3D()
 	csafe_release(g_pd3dCommandQueue);
 	csafe_release(g_pd3dCommandList);
 	csafe_release(g_pd3dRtvDescHeap);
+	mesh_renderer_shutdown();
+	asset_archive_close(&g_assets);
+	bindless_shutdown();
 	csafe_release(g_pd3dSrvDescHeap);
 	csafe_release(dsv_heap);
 	csafe_release(g_fence);
@@ -1007,12 +1247,11 @@ __declspec(dllexport) void CleanupDeviceD3D()
 	csafe_release(query_heap);
 
 	csafe_release(g_pso);
-	csafe_release(g_rootsig);
+	csafe_release(g_pso_wireframe);
+	csafe_release(g_pso_depth);
 	csafe_release(dsv_resource);
 	csafe_release(vs_blob);
 	csafe_release(ps_blob);
-	csafe_release(triangle.vertex_default_resource);
-	csafe_release(triangle.vertex_upload_resource);
 
 	for(int i = 0; i < _countof(g_mainRenderTargetResource); ++i)
 	{
@@ -1029,14 +1268,528 @@ __declspec(dllexport) void CleanupDeviceD3D()
 #endif
 }
 
+void job_stats_window(void)
+{
+	if (!igCollapsingHeader("Jobs", 0)) return;
+
+	uint32_t thread_count = job_thread_count();
+	igText("%u threads, %u workers", thread_count, g_jobs.worker_count);
+	igColumns(6, "job_stats", true);
+	igText("thread"); igNextColumn();
+	igText("busy ms"); igNextColumn();
+	igText("idle ms"); igNextColumn();
+	igText("jobs"); igNextColumn();
+	igText("steals"); igNextColumn();
+	igText("steal attempts"); igNextColumn();
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		struct job_worker_stats* stats = &g_jobs.stats[i];
+		igText("%u", i); igNextColumn();
+		igText("%.1f", (double)atomic_load_explicit(&stats->busy_ns, memory_order_relaxed) / 1e6); igNextColumn();
+		igText("%.1f", (double)atomic_load_explicit(&stats->idle_ns, memory_order_relaxed) / 1e6); igNextColumn();
+		igText("%llu", atomic_load_explicit(&stats->executed, memory_order_relaxed)); igNextColumn();
+		igText("%llu", atomic_load_explicit(&stats->steals, memory_order_relaxed)); igNextColumn();
+		igText("%llu", atomic_load_explicit(&stats->steal_attempts, memory_order_relaxed)); igNextColumn();
+	}
+	igColumns(1, NULL, false);
+}
+
+void alloc_stats_window(void)
+{
+	if (!igCollapsingHeader("Allocations", 0)) return;
+
+	const struct alloc_counts* total = &g_alloc_track.frame_total;
+	igText("heap this frame: %llu allocs, %llu frees, %llu bytes, %llu clean frames in a row",
+	       total->allocs, total->frees, total->bytes, g_alloc_track.clean_frames);
+	igText("imgui pools this frame: %llu allocs, %llu from the os",
+	       g_imgui_allocator->last_frame.allocs, g_imgui_allocator->last_frame.os_allocs);
+
+	igColumns(4, "alloc_zones", true);
+	igText("zone"); igNextColumn();
+	igText("allocs"); igNextColumn();
+	igText("frees"); igNextColumn();
+	igText("bytes"); igNextColumn();
+	for (uint32_t zone = 0; zone < ALLOC_ZONE_COUNT; ++zone) {
+		const struct alloc_counts* counts = &g_alloc_track.frame_zones[zone];
+		igText("%s", alloc_zone_names[zone]); igNextColumn();
+		igText("%llu", counts->allocs); igNextColumn();
+		igText("%llu", counts->frees); igNextColumn();
+		igText("%llu", counts->bytes); igNextColumn();
+	}
+	igColumns(1, NULL, false);
+
+	igColumns(4, "alloc_threads", true);
+	igText("thread"); igNextColumn();
+	igText("allocs"); igNextColumn();
+	igText("frees"); igNextColumn();
+	igText("bytes"); igNextColumn();
+	uint32_t thread_count = atomic_load_explicit(&g_alloc_track.thread_count, memory_order_relaxed);
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		const struct alloc_counts* counts = &g_alloc_track.frame_threads[i];
+		const char* name = g_alloc_track.threads[i].name;
+		if (name) igText("%s", name); else igText("thread %u", i);
+		igNextColumn();
+		igText("%llu", counts->allocs); igNextColumn();
+		igText("%llu", counts->frees); igNextColumn();
+		igText("%llu", counts->bytes); igNextColumn();
+	}
+	igColumns(1, NULL, false);
+
+	if (!ALLOC_TRACK_SITES) return;
+	igText("call sites allocating this frame, %u not tracked (table full)",
+	       atomic_load_explicit(&g_alloc_track.dropped_sites, memory_order_relaxed));
+	for (uint32_t i = 0; i < ALLOC_TRACK_MAX_SITES; ++i) {
+		const struct alloc_site* site = &g_alloc_track.sites[i];
+		if (!site->frame_allocs) continue;
+		igText("  %s:%u  %llu this frame, %llu total", site->file, site->line, site->frame_allocs,
+		       atomic_load_explicit(&site->allocs, memory_order_relaxed));
+	}
+}
+
+// Synthetic UI for upload benchmarks: 8 windows of 3125 quads, 100k vertices a frame.
+#define UI_STRESS_WINDOWS 8
+#define UI_STRESS_QUADS 3125
+void ui_stress_windows(void)
+{
+	ImVec2 display = igGetIO()->DisplaySize;
+	float cell = 6.0f;
+	int columns = 64;
+	ImU32 tint = (ImU32)(igGetFrameCount() & 0xff);
+	for (int w = 0; w < UI_STRESS_WINDOWS; ++w) {
+		char name[32];
+		snprintf(name, sizeof(name), "ui stress %d", w);
+		igSetNextWindowPos((ImVec2){display.x - (float)(UI_STRESS_WINDOWS - w) * 48.0f - 400.0f, 20.0f + (float)w * 24.0f}, ImGuiCond_Always, (ImVec2){0, 0});
+		igSetNextWindowSize((ImVec2){(float)columns * cell, (float)(UI_STRESS_QUADS / columns + 1) * cell}, ImGuiCond_Always);
+		igBegin(name, NULL, ImGuiWindowFlags_NoDecoration | ImGuiWindowFlags_NoInputs | ImGuiWindowFlags_NoSavedSettings | ImGuiWindowFlags_NoBackground);
+		ImDrawList* draw_list = igGetWindowDrawList();
+		ImVec2 origin;
+		igGetWindowPos_nonUDT(&origin);
+		for (int i = 0; i < UI_STRESS_QUADS; ++i) {
+			ImVec2 min = {origin.x + (float)(i % columns) * cell, origin.y + (float)(i / columns) * cell};
+			ImVec2 max = {min.x + cell - 1.0f, min.y + cell - 1.0f};
+			ImU32 color = 0xff000000u | (ImU32)(i * 37 + w * 91) << 8 | tint;
+			ImDrawList_AddRectFilled(draw_list, min, max, color, 0.0f, 0);
+		}
+		igEnd();
+	}
+}
+
+// A root with six children around it, each holding one more: 13 triangles.
+void create_demo_scene(void)
+{
+	bool created = scene_init(&g_scene, 16);
+	ASSERT(created);
+	uint32_t root = scene_add(&g_scene, SCENE_NO_PARENT, vec3_make(0.0f, 0.0f, 0.0f), quat_identity(), vec3_make(1.0f, 1.0f, 1.0f));
+	uint32_t children[6];
+	for (uint32_t i = 0; i < 6; ++i) {
+		float angle = (float)i * (2.0f * VECMATH_PI / 6.0f);
+		children[i] = scene_add(&g_scene, root, vec3_make(0.65f * cosf(angle), 0.65f * sinf(angle), 0.0f),
+					quat_axis_angle(vec3_make(0.0f, 0.0f, 1.0f), angle), vec3_make(0.5f, 0.5f, 0.5f));
+	}
+	for (uint32_t i = 0; i < 6; ++i)
+		scene_add(&g_scene, children[i], vec3_make(0.6f, 0.0f, 0.0f), quat_identity(), vec3_make(0.5f, 0.5f, 0.5f));
+	ASSERT(g_scene.sorted && g_scene.count == DEMO_SCENE_NODES);
+
+	// a solid quad in the middle, solid triangles around it and wireframe quads outside
+	g_scene_keys[0] = MESH_KEY(DEMO_PSO_SOLID, DEMO_MESH_QUAD);
+	for (uint32_t i = 1; i <= 6; ++i) g_scene_keys[i] = MESH_KEY(DEMO_PSO_SOLID, DEMO_MESH_TRIANGLE);
+	for (uint32_t i = 7; i < DEMO_SCENE_NODES; ++i) g_scene_keys[i] = MESH_KEY(DEMO_PSO_WIREFRAME, DEMO_MESH_QUAD);
+	for (uint32_t i = 0; i < DEMO_SCENE_NODES; ++i) g_scene_colors[i] = vec4_make(1.0f, 1.0f, 1.0f, 1.0f);
+}
+
+// Spins the root one way and the children the other, the grandchildren follow.
+void animate_demo_scene(uint64_t now_ns)
+{
+	float t = (float)(now_ns % 60000000000ull) / 1e9f;
+	struct vec3 z = {0.0f, 0.0f, 1.0f};
+	scene_set_rotation(&g_scene, 0, quat_axis_angle(z, t * 0.5f));
+	for (uint32_t i = 1; i <= 6; ++i) {
+		float angle = (float)(i - 1) * (2.0f * VECMATH_PI / 6.0f);
+		scene_set_rotation(&g_scene, i, quat_axis_angle(z, angle - t * 2.0f));
+	}
+}
+
+// SCENE_STRESS_NODES nodes, 64 roots and eight children per node level by level. Every root turns
+// each frame, so the update recomputes the whole hierarchy, the worst case.
+void update_stress_scene(uint64_t now_ns)
+{
+	if (g_stress_scene.count == 0) {
+		if (!scene_init(&g_stress_scene, SCENE_STRESS_NODES)) return;
+		uint32_t random = 0x9e3779b9u;
+		for (uint32_t i = 0; i < 64; ++i)
+			scene_add(&g_stress_scene, SCENE_NO_PARENT, vec3_make((float)i, 0.0f, 0.0f), quat_identity(), vec3_make(1.0f, 1.0f, 1.0f));
+		uint32_t level_begin = 0;
+		uint32_t level_end = g_stress_scene.count;
+		while (g_stress_scene.count < SCENE_STRESS_NODES) {
+			uint32_t next_begin = g_stress_scene.count;
+			for (uint32_t i = 0; i < (level_end - level_begin) * 8 && g_stress_scene.count < SCENE_STRESS_NODES; ++i) {
+				random ^= random << 13;
+				random ^= random >> 17;
+				random ^= random << 5;
+				uint32_t parent = level_begin + random % (level_end - level_begin);
+				scene_add(&g_stress_scene, parent, vec3_make(1.0f, 0.5f, 0.0f), quat_axis_angle(vec3_make(0.0f, 1.0f, 0.0f), 0.3f),
+					  vec3_make(0.9f, 0.9f, 0.9f));
+			}
+			level_begin = next_begin;
+			level_end = g_stress_scene.count;
+		}
+	}
+
+	float t = (float)(now_ns % 60000000000ull) / 1e9f;
+	for (uint32_t i = 0; i < g_stress_scene.level_begin[1]; ++i)
+		scene_set_rotation(&g_stress_scene, i, quat_axis_angle(vec3_make(0.0f, 1.0f, 0.0f), t));
+	scene_update(&g_stress_scene, NULL, NULL);
+}
+
+static bool instance_spheres = false; // instead of the quads, a vertex heavy mesh
+static bool instance_lods = false;    // instead of both, the cooked mesh with its levels of detail
+static int demo_vertex_format = VERTEX_FORMAT_FLOAT4;
+static struct lod_chain g_instance_lod; // of the instance scene, count 0 when it has none
+
+// The cooked mesh's levels as lod_select() reads them, its errors over the radius culling's bounds use.
+static struct lod_chain cooked_lod_chain(uint32_t cooked_mesh)
+{
+	const float* min = g_cooked_header.bounds_min;
+	const float* max = g_cooked_header.bounds_max;
+	float radius = vec3_length(vec3_make((max[0] - min[0]) * 0.5f, (max[1] - min[1]) * 0.5f, (max[2] - min[2]) * 0.5f));
+	struct lod_chain chain = {.key = MESH_KEY(DEMO_PSO_DEPTH, cooked_mesh), .count = g_cooked_header.lod_count};
+	for (uint32_t l = 0; l < chain.count; ++l) {
+		chain.errors[l] = radius > 0.0f ? g_cooked_header.lods[l].error / radius : 0.0f;
+		chain.triangles[l] = g_cooked_header.lods[l].index_count / 3;
+	}
+	return chain;
+}
+
+// INSTANCE_STRESS_COUNT small static nodes in a grid, the four PSO and mesh combinations interleaved
+// so grouping has work to do. With instance_lods and a cooked mesh loaded, every node is the cooked
+// mesh instead, growing from a cell to 32 across the columns so the levels differ.
+void create_instance_scene(void)
+{
+	g_instance_keys = malloc(INSTANCE_STRESS_COUNT * sizeof(uint32_t));
+	g_instance_colors = malloc(INSTANCE_STRESS_COUNT * sizeof(struct vec4));
+	if (!g_instance_keys || !g_instance_colors || !scene_init(&g_instance_scene, INSTANCE_STRESS_COUNT)) {
+		free_instance_scene();
+		return;
+	}
+	// three times the view's height and more than its width, culling has something to remove
+	uint32_t columns = 400;
+	uint32_t rows = INSTANCE_STRESS_COUNT / columns;
+	float step_x = 6.0f / (float)columns;
+	float step_y = 3.0f / (float)rows;
+	uint32_t cooked_mesh = atomic_load_explicit(&g_cooked_mesh, memory_order_acquire);
+	g_instance_lod = instance_lods && cooked_mesh != MESH_INVALID ? cooked_lod_chain(cooked_mesh) : (struct lod_chain){0};
+	const float* min = g_cooked_header.bounds_min;
+	const float* max = g_cooked_header.bounds_max;
+	float cooked_size = fmaxf(max[0] - min[0], fmaxf(max[1] - min[1], max[2] - min[2]));
+	struct vec3 cooked_center = vec3_make((min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f);
+	for (uint32_t i = 0; i < INSTANCE_STRESS_COUNT; ++i) {
+		uint32_t column = i % columns;
+		uint32_t row = i / columns;
+		struct vec3 position = vec3_make(-3.0f + ((float)column + 0.5f) * step_x, -1.5f + ((float)row + 0.5f) * step_y, 0.0f);
+		g_instance_colors[i] = vec4_make((float)column / (float)columns, (float)row / (float)rows, 0.5f, 1.0f);
+		if (g_instance_lod.count) {
+			// centered on the cell, in front like the single cooked mesh
+			float size = step_y * exp2f(5.0f * (float)column / (float)columns);
+			float scale = cooked_size > 0.0f ? size / cooked_size : 1.0f;
+			position = vec3_add(vec3_add(position, vec3_make(0.0f, 0.0f, 0.5f)), vec3_scale(cooked_center, -scale));
+			scene_add(&g_instance_scene, SCENE_NO_PARENT, position, quat_identity(), vec3_make(scale, scale, scale));
+			g_instance_keys[i] = g_instance_lod.key;
+			continue;
+		}
+		scene_add(&g_instance_scene, SCENE_NO_PARENT, position, quat_identity(), vec3_make(step_x * 2.0f, step_y * 2.0f, 1.0f));
+		uint32_t shape = i & 2 ? (instance_spheres ? DEMO_MESH_SPHERE : DEMO_MESH_QUAD) : DEMO_MESH_TRIANGLE;
+		g_instance_keys[i] = MESH_KEY(i & 1 ? DEMO_PSO_WIREFRAME : DEMO_PSO_SOLID, shape);
+	}
+}
+
+void free_instance_scene(void)
+{
+	scene_free(&g_instance_scene);
+	free(g_instance_keys);
+	free(g_instance_colors);
+	g_instance_keys = NULL;
+	g_instance_colors = NULL;
+	g_instance_lod = (struct lod_chain){0};
+}
+
+static bool hierarchical_culling = true;
+static uint64_t cull_bounds_ns = 0;
+static uint64_t cull_ns = 0;
+static uint64_t cull_stress_ns = 0;
+static uint32_t cull_visible = 0;
+static uint32_t cull_stress_visible = 0;
+static bool bvh_picking = false;
+static bool bvh_cull_stress = false;
+static uint64_t bvh_update_ns = 0; // the scene's, a build or a refit
+static uint64_t bvh_pick_ns = 0;
+static bool bvh_rebuilt = false;
+static uint32_t picked_node = UINT32_MAX;
+static uint64_t bvh_stress_build_ns = 0;
+static uint64_t bvh_stress_refit_ns = 0;
+static float lod_pixel_error = 1.0f; // the most a level may be off on screen
+static int cooked_lod = 0;           // the single cooked mesh's level
+static struct lod_stats lod_stats;
+static uint64_t lod_ns = 0;
+static bool cluster_culling = false; // the cooked mesh's meshlets, for batches of a few instances
+static struct meshlet_stats meshlet_stats;
+
+static void scene_bounds_range(void* data, uint32_t begin, uint32_t end)
+{
+	(void)data;
+	for (uint32_t i = begin; i < end; ++i) {
+		bool demo = i < g_scene.count;
+		uint32_t node = demo ? i : i - g_scene.count;
+		uint32_t mesh = MESH_KEY_MESH(demo ? g_scene_keys[node] : g_instance_keys[node]);
+		const struct mat4* world = demo ? &g_scene.world[node] : &g_instance_scene.world[node];
+		if (mesh < DEMO_MESH_COUNT) {
+			cull_bounds_transform(&g_scene_bounds, i, world, demo_mesh_bounds[mesh].center, demo_mesh_bounds[mesh].extent);
+			continue;
+		}
+		// the cooked mesh, of the instance scene with levels of detail
+		const float* min = g_cooked_header.bounds_min;
+		const float* max = g_cooked_header.bounds_max;
+		struct vec3 center = vec3_make((min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f);
+		struct vec3 extent = vec3_make((max[0] - min[0]) * 0.5f, (max[1] - min[1]) * 0.5f, (max[2] - min[2]) * 0.5f);
+		cull_bounds_transform(&g_scene_bounds, i, world, center, extent);
+	}
+}
+
+// Bounds of both scenes' nodes from their world matrices, after scene_update(): the demo scene's
+// first, then the instance scene's.
+bool update_scene_bounds(void)
+{
+	uint64_t begin = time_now_ns();
+	uint32_t count = g_scene.count + g_instance_scene.count;
+	if (!cull_bounds_resize(&g_scene_bounds, count)) return false;
+	job_parallel_for(count, 1024, scene_bounds_range, NULL);
+	if (hierarchical_culling) cull_build_groups(&g_scene_bounds);
+	cull_bounds_ns = time_now_ns() - begin;
+	return true;
+}
+
+// The indices of the nodes in view into visible, after update_scene_bounds(): demo_visible of the
+// demo scene, then the instance scene's from 0 again.
+uint32_t cull_scene(const struct mat4* view_projection, uint32_t* visible, uint32_t* demo_visible)
+{
+	uint64_t culled = time_now_ns();
+
+	struct frustum frustum = frustum_from_matrix(view_projection);
+	uint32_t visible_count = cull_run(&g_scene_bounds, &frustum, visible, hierarchical_culling);
+	uint32_t demo = 0;
+	while (demo < visible_count && visible[demo] < g_scene.count) demo++;
+	for (uint32_t i = demo; i < visible_count; ++i) visible[i] -= g_scene.count;
+	*demo_visible = demo;
+	cull_ns = time_now_ns() - culled;
+	cull_visible = visible_count;
+	return visible_count;
+}
+
+// The first node along the ray, into g_scene_bounds, UINT32_MAX for none. The BVH over the bounds
+// is rebuilt when the nodes changed in number and refit otherwise: only the demo scene moves.
+uint32_t pick_scene_node(struct vec3 origin, struct vec3 direction)
+{
+	uint64_t begin = time_now_ns();
+	bvh_rebuilt = g_scene_bvh.object_count != g_scene_bounds.count;
+	if (bvh_rebuilt) {
+		if (!bvh_build(&g_scene_bvh, &g_scene_bounds)) return UINT32_MAX;
+	} else {
+		bvh_refit(&g_scene_bvh, &g_scene_bounds);
+	}
+	uint64_t updated = time_now_ns();
+	bvh_update_ns = updated - begin;
+
+	struct bvh_hit hit;
+	bvh_query_ray(&g_scene_bvh, &g_scene_bounds, origin, direction, INFINITY, &hit);
+	bvh_pick_ns = time_now_ns() - updated;
+	return hit.index;
+}
+
+// CULL_STRESS_OBJECTS boxes in a 100 x 100 x 100 grid, culled every frame against a turning
+// perspective frustum: the throughput of cull_run() alone.
+#define CULL_STRESS_OBJECTS 1000000
+void update_cull_stress(uint64_t now_ns)
+{
+	if (g_cull_stress_bounds.count == 0) {
+		g_cull_stress_visible = malloc(CULL_STRESS_OBJECTS * sizeof(uint32_t));
+		if (!g_cull_stress_visible || !cull_bounds_resize(&g_cull_stress_bounds, CULL_STRESS_OBJECTS)) {
+			free_cull_stress();
+			return;
+		}
+		for (uint32_t i = 0; i < CULL_STRESS_OBJECTS; ++i) {
+			struct vec3 center = vec3_make((float)(i % 100) - 49.5f, (float)(i / 100 % 100) - 49.5f, (float)(i / 10000) - 49.5f);
+			struct vec3 extent = vec3_make(0.3f, 0.2f + (float)(i % 7) * 0.03f, 0.3f);
+			cull_bounds_set(&g_cull_stress_bounds, i, center, vec3_length(extent), extent);
+		}
+		cull_build_groups(&g_cull_stress_bounds);
+	}
+	if (bvh_cull_stress && g_cull_stress_bvh.object_count == 0) {
+		uint64_t begin = time_now_ns();
+		bvh_build(&g_cull_stress_bvh, &g_cull_stress_bounds);
+		bvh_stress_build_ns = time_now_ns() - begin;
+	}
+
+	float t = (float)(now_ns % 60000000000ull) / 1e9f;
+	struct vec3 eye = vec3_make(0.0f, 0.0f, 0.0f);
+	struct vec3 target = vec3_make(cosf(t * 0.3f), 0.2f * sinf(t * 0.2f), sinf(t * 0.3f));
+	struct mat4 view = mat4_look_at(eye, target, vec3_make(0.0f, 1.0f, 0.0f));
+	struct mat4 projection = mat4_perspective(1.0f, 16.0f / 9.0f, 0.1f, 100.0f);
+	struct mat4 view_projection = mat4_mul(&projection, &view);
+	struct frustum frustum = frustum_from_matrix(&view_projection);
+
+	uint64_t begin = time_now_ns();
+	if (bvh_cull_stress && g_cull_stress_bvh.object_count) {
+		// the objects stay put, the refit is there to be measured
+		bvh_refit(&g_cull_stress_bvh, &g_cull_stress_bounds);
+		uint64_t refit = time_now_ns();
+		bvh_stress_refit_ns = refit - begin;
+		begin = refit;
+		cull_stress_visible = bvh_query_frustum(&g_cull_stress_bvh, &g_cull_stress_bounds, &frustum, g_cull_stress_visible);
+	} else {
+		cull_stress_visible = cull_run(&g_cull_stress_bounds, &frustum, g_cull_stress_visible, hierarchical_culling);
+	}
+	cull_stress_ns = time_now_ns() - begin;
+}
+
+void free_cull_stress(void)
+{
+	bvh_free(&g_cull_stress_bvh);
+	cull_bounds_free(&g_cull_stress_bounds);
+	free(g_cull_stress_visible);
+	g_cull_stress_visible = NULL;
+}
+
+// DRAW_STRESS_ITEMS draws over DRAW_STRESS_PSOS x DRAW_STRESS_MATERIALS commands in random order and
+// at random depths every frame, the last PSOs transparent: the throughput of draw_queue_sort() and
+// the state changes it saves, counted by a draw_queue_record() walk without a command list.
+#define DRAW_STRESS_ITEMS (1u << 20)
+#define DRAW_STRESS_PSOS 16
+#define DRAW_STRESS_MATERIALS 256
+#define DRAW_STRESS_TRANSPARENT_PSOS 4
+static uint64_t draw_stress_push_ns = 0;
+static uint32_t draw_stress_unsorted[DRAW_STATE_COUNT];
+
+static void draw_stress_range(void* data, uint32_t begin, uint32_t end)
+{
+	uint32_t frame = *(uint32_t*)data;
+	for (uint32_t i = begin; i < end; ++i) {
+		uint32_t hash = (i ^ frame * 0x85ebca6bu) * 0x9e3779b1u;
+		hash ^= hash >> 15;
+		hash *= 0xc2b2ae35u;
+		hash ^= hash >> 13;
+		uint32_t command = hash % (DRAW_STRESS_PSOS * DRAW_STRESS_MATERIALS);
+		uint32_t pso = command / DRAW_STRESS_MATERIALS;
+		uint32_t material = command % DRAW_STRESS_MATERIALS;
+		float depth = (float)(hash >> 8) / (float)(1u << 24) * 100.0f;
+		bool transparent = pso >= DRAW_STRESS_PSOS - DRAW_STRESS_TRANSPARENT_PSOS;
+		uint64_t key = transparent ? DRAW_KEY(DRAW_LAYER_SCENE, DRAW_PASS_TRANSPARENT, pso, material, draw_key_depth_back_to_front(depth))
+					   : DRAW_KEY(DRAW_LAYER_SCENE, DRAW_PASS_OPAQUE, pso, material, draw_key_depth(depth));
+		draw_queue_push(&g_draw_stress, key, command);
+	}
+}
+
+void update_draw_stress(uint64_t now_ns)
+{
+	if (!draw_queue_reserve(&g_draw_stress, DRAW_STRESS_ITEMS, DRAW_STRESS_PSOS * DRAW_STRESS_MATERIALS)) return;
+	draw_queue_reset(&g_draw_stress);
+	// made up states, never recorded: two root signatures, vertex buffers per material, index
+	// buffers shared by four materials
+	for (uint32_t pso = 0; pso < DRAW_STRESS_PSOS; ++pso) {
+		for (uint32_t material = 0; material < DRAW_STRESS_MATERIALS; ++material) {
+			struct draw_command command = {
+				.root_signature = (ID3D12RootSignature*)(uintptr_t)(pso < DRAW_STRESS_PSOS / 2 ? 0x1000 : 0x2000),
+				.pso = (ID3D12PipelineState*)(uintptr_t)(0x10000 + pso * 0x100),
+				.vertex_buffer = {.BufferLocation = 0x100000 * (material + 1ull), .SizeInBytes = 0x10000, .StrideInBytes = 32},
+				.index_buffer = {.BufferLocation = 0x100000000 * (material / 4 + 1ull), .SizeInBytes = 0x1000, .Format = DXGI_FORMAT_R16_UINT},
+				.index_count = 36,
+				.instance_count = 1,
+			};
+			draw_queue_command(&g_draw_stress, &command);
+		}
+	}
+
+	uint64_t begin = time_now_ns();
+	uint32_t frame = (uint32_t)(now_ns / 1000000);
+	job_parallel_for(DRAW_STRESS_ITEMS, 16384, draw_stress_range, &frame);
+	draw_stress_push_ns = time_now_ns() - begin;
+	draw_queue_record(&g_draw_stress, NULL);
+	memcpy(draw_stress_unsorted, g_draw_stress.stats.sets, sizeof(draw_stress_unsorted));
+	draw_queue_sort(&g_draw_stress);
+	draw_queue_record(&g_draw_stress, NULL);
+}
+
 bool should_render_triangle = false;
 bool is_triangle_created = false;
+static bool animate_scene = false;
+static bool scene_stress = false;
+static bool instance_stress = false;
+static bool draw_cooked = true;
+static bool gpu_culling = false;
+static bool verify_culling = false;
+static bool cpu_culling = false;
+static bool cull_stress = false;
+static bool draw_stress = false;
+static uint64_t scene_update_ns = 0;
+static uint64_t mesh_build_ns = 0;
+static uint64_t scene_stress_update_ns = 0;
+static bool per_draw_descriptor_tables = false;
+static bool ui_stress = false;
+static bool parallel_ui_upload = true;
+static bool alloc_gate = false;
+static uint64_t alloc_gate_frames = 0;
+
+// Live numbers are formatted at STATS_REFRESH_NS, in between the text and so the draw data stay
+// identical and an untouched UI counts as unchanged.
+#define STATS_REFRESH_NS 500000000ull
+static char stats_buffer[4096];
+static size_t stats_length = 0;
+static bool stats_refresh = false;
+static uint64_t stats_refresh_ns = 0;
+
+static void stats_begin(void)
+{
+	uint64_t now = time_now_ns();
+	stats_refresh = now - stats_refresh_ns >= STATS_REFRESH_NS;
+	if (stats_refresh) {
+		stats_refresh_ns = now;
+		stats_length = 0;
+	}
+}
 
-__declspec(dllexport) bool update_and_render()
+static void stats_text(const char* format, ...)
+{
+	if (!stats_refresh || stats_length >= sizeof(stats_buffer) - 1) return;
+	va_list args;
+	va_start(args, format);
+	int written = vsnprintf(stats_buffer + stats_length, sizeof(stats_buffer) - stats_length, format, args);
+	va_end(args);
+	if (written < 0) return;
+	stats_length += (size_t)written;
+	if (stats_length > sizeof(stats_buffer) - 2) stats_length = sizeof(stats_buffer) - 2;
+	stats_buffer[stats_length++] = '\n';
+	stats_buffer[stats_length] = 0;
+}
+
+static void probe_occlusion(void)
+{
+	// the render thread must not be presenting at the same time
+	frame_pipeline_flush();
+	if (g_pSwapChain->lpVtbl->Present(g_pSwapChain, 0, DXGI_PRESENT_TEST) != DXGI_STATUS_OCCLUDED) {
+		frame_scheduler_presented(false);
+		frame_scheduler_invalidate();
+	}
+}
+static double record_ns_per_draw[2]; // bindless, per-draw tables
+static double mode_fps[2]; // serial, pipelined
+
+// Returns false when the frame looks exactly like the last presented one and need not be rendered.
+bool simulate_frame(struct frame_packet* packet)
 {
+	packet->sim_begin_ns = time_now_ns();
+	pool_allocator_frame(g_imgui_allocator);
 
 	ImGui_ImplDX12_NewFrame();
 	ImGui_ImplWin32_NewFrame();
+	input_begin_frame();
+	input_apply_imgui(igGetIO());
 	igNewFrame();
 
 	bool show_demo_window = true;
@@ -1055,23 +1808,441 @@ __declspec(dllexport) bool update_and_render()
 
 		igCheckbox("Demo Window", &show_demo_window);
 		igCheckbox("VSync", &is_vsync);
+		igCheckbox("Pipelined simulation/render", &is_pipelined);
+		igCheckbox("Per-draw descriptor tables (pre-bindless)", &per_draw_descriptor_tables);
+		igCheckbox("Synthetic 100k-vertex UI", &ui_stress);
+		igCheckbox("Draw scene", &should_render_triangle);
+		igCheckbox("Cooked mesh (data\\cooked.mesh)", &draw_cooked);
+		igCheckbox("Animate scene", &animate_scene);
+		igCheckbox("Synthetic 1M-node hierarchy update", &scene_stress);
+		igCheckbox("Synthetic 100k-instance scene", &instance_stress);
+		if (igCheckbox("Spheres in the instance scene", &instance_spheres) && g_instance_scene.count) free_instance_scene();
+		if (igCheckbox("Cooked mesh LODs in the instance scene", &instance_lods) && g_instance_scene.count) free_instance_scene();
+		igSliderFloat("LOD pixel error", &lod_pixel_error, 0.25f, 16.0f, "%.2f px", 2.0f);
+		igSliderInt("Cooked mesh LOD", &cooked_lod, 0, g_cooked_header.lod_count ? (int)g_cooked_header.lod_count - 1 : 0, "%d");
+		igCheckbox("Cooked mesh cluster culling (meshlets)", &cluster_culling);
+		igCombo("Vertex format", &demo_vertex_format, vertex_format_names, VERTEX_FORMAT_COUNT, -1);
+		igCheckbox("GPU culling (ExecuteIndirect)", &gpu_culling);
+		igCheckbox("Verify GPU culling on the CPU", &verify_culling);
+		igCheckbox("CPU frustum culling", &cpu_culling);
+		igCheckbox("Hierarchical culling (64-object groups)", &hierarchical_culling);
+		igCheckbox("Synthetic 1M-object culling benchmark", &cull_stress);
+		igCheckbox("BVH for the culling benchmark", &bvh_cull_stress);
+		igCheckbox("Synthetic 1M-draw sort benchmark", &draw_stress);
+		igCheckbox("Pick the node under the mouse (BVH)", &bvh_picking);
+		igCheckbox("Parallel UI upload", &parallel_ui_upload);
+		igCheckbox("Skip unchanged frames", &idle_skipping);
+		igCheckbox("Assert zero heap allocations per frame", &alloc_gate);
 		igColorEdit3("clear color", (float*)&clear_color, 0);
 
-		igText("imgui gpu time %.4f ms/frame",
+		stats_begin();
+		frame_time = ((double)atomic_load_explicit(&gpu_frame_ticks, memory_order_relaxed) / g_gpu_frequency) * 1000.0;
+		stats_text("imgui gpu time %.4f ms/frame",
 		       frame_time);
 
-		igText("elapsed time %.4f ms/frame",
+		stats_text("elapsed time %.4f ms/frame",
 		       delta_time.elapsed_ms);
 
-		igText("average delta %.4f ms/frame",
+		stats_text("average delta %.4f ms/frame",
 		       delta_time_avg);
 
-		igText("Application average %.4f ms/frame (%.1f FPS)",
+		stats_text("Application average %.4f ms/frame (%.1f FPS)",
 		       (double)(1000.0f / igGetIO()->Framerate),
 		       (double)igGetIO()->Framerate);
+
+		mode_fps[g_pipeline.threaded] = (double)igGetIO()->Framerate;
+		stats_text("simulation %.3f ms, render cpu %.3f ms, backpressure %.3f ms",
+		       (double)g_pipeline.sim_ns / 1e6,
+		       (double)atomic_load_explicit(&g_pipeline.render_ns, memory_order_relaxed) / 1e6,
+		       (double)g_pipeline.backpressure_ns / 1e6);
+		stats_text("throughput serial %.1f FPS, pipelined %.1f FPS", mode_fps[0], mode_fps[1]);
+
+		uint32_t draws = atomic_load_explicit(&ui_draw_count, memory_order_relaxed);
+		uint64_t record_ns = atomic_load_explicit(&ui_record_ns, memory_order_relaxed);
+		if (draws) {
+			double per_draw = (double)record_ns / draws;
+			double* average = &record_ns_per_draw[per_draw_descriptor_tables];
+			*average = *average == 0.0 ? per_draw : *average * 0.95 + per_draw * 0.05;
+		}
+		stats_text("ui record %.3f ms, %u draws, cpu per draw: bindless %.0f ns, per-draw tables %.0f ns",
+		       (double)record_ns / 1e6,
+		       draws,
+		       record_ns_per_draw[0],
+		       record_ns_per_draw[1]);
+		uint32_t commands = atomic_load_explicit(&ui_command_count, memory_order_relaxed);
+		stats_text("ui draws %u from %u commands (%.0f%% fewer), %u culled, %u redundant state sets skipped",
+		       draws,
+		       commands,
+		       commands ? 100.0 * (double)(commands - draws) / (double)commands : 0.0,
+		       atomic_load_explicit(&ui_culled_count, memory_order_relaxed),
+		       atomic_load_explicit(&ui_skipped_state_sets, memory_order_relaxed));
+
+		uint64_t upload_bytes = atomic_load_explicit(&ui_upload_bytes, memory_order_relaxed);
+		uint64_t copy_ns = atomic_load_explicit(&ui_upload_copy_ns, memory_order_relaxed);
+		stats_text("ui upload %.2f MB/frame, copy %.3f ms (%.2f GB/s), ring %.1f MB, %u grows",
+		       (double)upload_bytes / (1024.0 * 1024.0),
+		       (double)copy_ns / 1e6,
+		       copy_ns ? (double)upload_bytes / (double)copy_ns : 0.0,
+		       (double)atomic_load_explicit(&upload_ring_size, memory_order_relaxed) / (1024.0 * 1024.0),
+		       atomic_load_explicit(&upload_ring_grows, memory_order_relaxed));
+
+		stats_text("scene %u nodes, update %.3f ms, %u recomputed",
+		       g_scene.count,
+		       (double)scene_update_ns / 1e6,
+		       atomic_load_explicit(&g_scene.updated, memory_order_relaxed));
+		if (scene_stress)
+			stats_text("stress hierarchy %u nodes in %u levels, update %.2f ms on %u threads",
+			       g_stress_scene.count,
+			       g_stress_scene.level_count,
+			       (double)scene_stress_update_ns / 1e6,
+			       job_thread_count());
+		stats_text("meshes %u draws for %u instances, build %.3f ms, submit %.3f ms (instance copy %.3f ms)",
+		       atomic_load_explicit(&g_mesh_renderer.draw_count, memory_order_relaxed),
+		       atomic_load_explicit(&g_mesh_renderer.instance_count, memory_order_relaxed),
+		       (double)mesh_build_ns / 1e6,
+		       (double)atomic_load_explicit(&g_mesh_renderer.submit_ns, memory_order_relaxed) / 1e6,
+		       (double)atomic_load_explicit(&g_mesh_renderer.copy_ns, memory_order_relaxed) / 1e6);
+		stats_text("vertices %s, %u bytes each (%u as float4), %.1f MB read by the vertex shader per frame",
+		       vertex_format_names[demo_vertex_format],
+		       vertex_formats[demo_vertex_format].stride,
+		       vertex_formats[VERTEX_FORMAT_FLOAT4].stride,
+		       (double)atomic_load_explicit(&g_mesh_renderer.vertex_bytes, memory_order_relaxed) / (1024.0 * 1024.0));
+		if (atomic_load_explicit(&g_asset_count, memory_order_relaxed))
+			stats_text("assets from data\\assets.pak, %u mapped and checked in %.3f ms, cooked mesh loaded in %.2f ms, %u blocks decompressed on %u threads",
+			       atomic_load_explicit(&g_asset_count, memory_order_relaxed),
+			       (double)atomic_load_explicit(&g_asset_open_ns, memory_order_relaxed) / 1e6,
+			       (double)atomic_load_explicit(&g_cooked_load_ns, memory_order_relaxed) / 1e6,
+			       atomic_load_explicit(&g_cooked_blocks, memory_order_relaxed),
+			       job_thread_count());
+		else if (atomic_load_explicit(&g_cooked_load_ns, memory_order_relaxed))
+			stats_text("assets from loose files, cooked mesh loaded in %.2f ms",
+			       (double)atomic_load_explicit(&g_cooked_load_ns, memory_order_relaxed) / 1e6);
+		if (atomic_load_explicit(&g_cooked_mesh, memory_order_acquire) != MESH_INVALID)
+			stats_text("cooked mesh %u vertices, %u triangles, %s, cooked to ACMR %.3f, ATVR %.3f (%u entry cache), overdraw %.2f, %u meshlets",
+			       g_cooked_header.vertex_count,
+			       g_cooked_header.index_count / 3,
+			       vertex_format_names[g_cooked_header.format],
+			       (double)g_cooked_header.acmr,
+			       (double)g_cooked_header.atvr,
+			       g_cooked_header.cache_size,
+			       (double)g_cooked_header.overdraw,
+			       g_cooked_header.meshlet_count);
+		if (cluster_culling && meshlet_stats.meshlets)
+			stats_text("meshlets %u instances, %u tested, %.1f%% off screen, %.1f%% back-facing, %.2f M of %.2f M triangles in %u draws, cull %.3f ms",
+			       meshlet_stats.instances,
+			       meshlet_stats.meshlets,
+			       meshlet_stats.frustum_culled * 100.0 / meshlet_stats.meshlets,
+			       meshlet_stats.cone_culled * 100.0 / meshlet_stats.meshlets,
+			       (double)meshlet_stats.drawn_triangles / 1e6,
+			       (double)meshlet_stats.triangles / 1e6,
+			       meshlet_stats.ranges,
+			       (double)meshlet_stats.cull_ns / 1e6);
+		stats_text("triangles %.2f M submitted per frame",
+		       (double)atomic_load_explicit(&g_mesh_renderer.triangle_count, memory_order_relaxed) / 1e6);
+		if (g_instance_lod.count) {
+			stats_text("lod %u objects, %.2f M of %.2f M triangles, projected error max %.2f px mean %.3f px (limit %.2f), select %.3f ms (%s)",
+			       lod_stats.objects,
+			       (double)lod_stats.triangles / 1e6,
+			       (double)lod_stats.full_triangles / 1e6,
+			       (double)lod_stats.max_pixels,
+			       lod_stats.objects ? lod_stats.sum_pixels / lod_stats.objects : 0.0,
+			       (double)lod_pixel_error,
+			       (double)lod_ns / 1e6,
+			       vecmath_path_name(g_lod.path));
+			for (uint32_t l = 0; l < g_instance_lod.count; ++l)
+				stats_text("  lod %u: %u triangles, error %.3f%% of radius, %u objects",
+				       l,
+				       g_instance_lod.triangles[l],
+				       (double)g_instance_lod.errors[l] * 100.0,
+				       lod_stats.levels[l]);
+		}
+		if (gpu_culling)
+			stats_text("gpu culling %u of %u instances visible in %u indirect draws, cpu reference %u, %u mismatched frames",
+			       atomic_load_explicit(&g_mesh_renderer.gpu_visible_count, memory_order_relaxed),
+			       atomic_load_explicit(&g_mesh_renderer.instance_count, memory_order_relaxed),
+			       atomic_load_explicit(&g_mesh_renderer.gpu_draw_count, memory_order_relaxed),
+			       atomic_load_explicit(&g_mesh_renderer.reference_visible_count, memory_order_relaxed),
+			       atomic_load_explicit(&g_mesh_renderer.cull_mismatches, memory_order_relaxed));
+		if (cpu_culling)
+			stats_text("cpu culling %u of %u nodes visible, bounds %.3f ms, cull %.3f ms (%s, %s)",
+			       cull_visible,
+			       g_scene_bounds.count,
+			       (double)cull_bounds_ns / 1e6,
+			       (double)cull_ns / 1e6,
+			       vecmath_path_name(g_cull.path),
+			       hierarchical_culling ? "hierarchical" : "flat");
+		if (cull_stress)
+			stats_text("stress culling %u of %u objects visible in %.3f ms on %u threads (%s, %s)",
+			       cull_stress_visible,
+			       g_cull_stress_bounds.count,
+			       (double)cull_stress_ns / 1e6,
+			       job_thread_count(),
+			       vecmath_path_name(g_cull.path),
+			       hierarchical_culling ? "hierarchical" : "flat");
+		stats_text("draw queue %u items sorted in %.3f ms (%u passes), %u pso, %u root signature, %u index buffer sets, %u skipped",
+		       atomic_load_explicit(&draw_queue_items, memory_order_relaxed),
+		       (double)atomic_load_explicit(&draw_queue_sort_ns, memory_order_relaxed) / 1e6,
+		       atomic_load_explicit(&draw_queue_passes, memory_order_relaxed),
+		       atomic_load_explicit(&draw_queue_sets[DRAW_STATE_PSO], memory_order_relaxed),
+		       atomic_load_explicit(&draw_queue_sets[DRAW_STATE_ROOT_SIGNATURE], memory_order_relaxed),
+		       atomic_load_explicit(&draw_queue_sets[DRAW_STATE_INDEX_BUFFER], memory_order_relaxed),
+		       atomic_load_explicit(&draw_queue_skips[DRAW_STATE_PSO], memory_order_relaxed) +
+			   atomic_load_explicit(&draw_queue_skips[DRAW_STATE_ROOT_SIGNATURE], memory_order_relaxed) +
+			   atomic_load_explicit(&draw_queue_skips[DRAW_STATE_VERTEX_BUFFER], memory_order_relaxed) +
+			   atomic_load_explicit(&draw_queue_skips[DRAW_STATE_INDEX_BUFFER], memory_order_relaxed));
+		if (draw_stress) {
+			const struct draw_stats* sorted = &g_draw_stress.stats;
+			stats_text("stress draw sort %u keys in %.2f ms (%.0f M keys/s, %u passes) on %u threads, push %.2f ms",
+			       sorted->items,
+			       (double)sorted->sort_ns / 1e6,
+			       sorted->sort_ns ? (double)sorted->items * 1e3 / (double)sorted->sort_ns : 0.0,
+			       sorted->sort_passes,
+			       job_thread_count(),
+			       (double)draw_stress_push_ns / 1e6);
+			for (uint32_t state = 0; state < DRAW_STATE_COUNT; ++state)
+				stats_text("  %s sets %u unsorted, %u sorted", draw_state_names[state], draw_stress_unsorted[state], sorted->sets[state]);
+		}
+		if (cull_stress && bvh_cull_stress)
+			stats_text("stress bvh %u nodes, build %.1f ms, refit %.3f ms, query above",
+			       g_cull_stress_bvh.node_count,
+			       (double)bvh_stress_build_ns / 1e6,
+			       (double)bvh_stress_refit_ns / 1e6);
+		if (bvh_picking) {
+			if (picked_node == UINT32_MAX)
+				stats_text("bvh %u nodes, %s %.3f ms, pick %.3f ms, nothing under the mouse",
+				       g_scene_bvh.node_count,
+				       bvh_rebuilt ? "build" : "refit",
+				       (double)bvh_update_ns / 1e6,
+				       (double)bvh_pick_ns / 1e6);
+			else
+				stats_text("bvh %u nodes, %s %.3f ms, pick %.3f ms, %s node %u under the mouse",
+				       g_scene_bvh.node_count,
+				       bvh_rebuilt ? "build" : "refit",
+				       (double)bvh_update_ns / 1e6,
+				       (double)bvh_pick_ns / 1e6,
+				       picked_node < g_scene.count ? "demo" : "instance",
+				       picked_node < g_scene.count ? picked_node : picked_node - g_scene.count);
+		}
+
+		struct input_latency latency = input_latency_stats();
+		stats_text("input to present p50 %.2f ms, p90 %.2f ms, p99 %.2f ms, max %.2f ms (%u samples/s, %llu dropped)",
+		       (double)latency.p50_ns / 1e6,
+		       (double)latency.p90_ns / 1e6,
+		       (double)latency.p99_ns / 1e6,
+		       (double)latency.max_ns / 1e6,
+		       latency.samples,
+		       latency.dropped);
+		stats_text("gamepad poll %.0f Hz, %u input samples this frame",
+		       g_input.poll_rate_hz,
+		       g_input.frame_samples);
+
+		stats_text("initialize %.2f ms, last resize %.2f ms, ui device objects %.2f ms (%s shaders)",
+		       (double)initialize_ns / 1e6,
+		       (double)resize_ns / 1e6,
+		       (double)g_CreateDeviceObjectsNs / 1e6,
+		       IMGUI_DX12_PRECOMPILED_SHADERS ? "precompiled" : "runtime compiled");
+		stats_text("ui startup %s, atlas %s in %.2f ms, first frame %.1f ms, ui visible %.1f ms, font upload %.2f ms (async)",
+		       g_font_cache.hit ? "warm" : "cold",
+		       g_font_cache.hit ? "mapped from cache" : "rasterized and cached",
+		       (double)g_font_cache.build_ns / 1e6,
+		       (double)atomic_load_explicit(&ui_first_frame_ns, memory_order_relaxed) / 1e6,
+		       (double)atomic_load_explicit(&ui_visible_ns, memory_order_relaxed) / 1e6,
+		       (double)atomic_load_explicit(&ui_font_upload_ns, memory_order_relaxed) / 1e6);
+
+		const struct pool_stats* heap = &g_imgui_allocator->last_frame;
+		stats_text("imgui heap %llu allocs %llu frees (%.1f KB) per frame, %llu from the os (none for %llu frames), %.1f KB live, %.1f KB reserved",
+		       (unsigned long long)heap->allocs,
+		       (unsigned long long)heap->frees,
+		       (double)heap->alloc_bytes / 1024.0,
+		       (unsigned long long)heap->os_allocs,
+		       (unsigned long long)g_imgui_allocator->quiet_frames,
+		       (double)g_imgui_allocator->live_bytes / 1024.0,
+		       (double)g_imgui_allocator->os_reserved / 1024.0);
+
+		stats_text("scheduler %s, draw data hash %.3f ms",
+		       frame_mode_names[g_scheduler.mode],
+		       (double)g_scheduler.hash_ns / 1e6);
+		for (uint32_t mode = 0; mode < FRAME_MODE_COUNT; ++mode) {
+			struct frame_mode_usage* usage = &g_scheduler.usage[mode];
+			stats_text("  %-8s cpu %5.1f%% of a core, %6.1f ticks/s, %6.1f presents/s",
+				   frame_mode_names[mode],
+				   usage->cpu_percent,
+				   usage->ticks_per_second,
+				   usage->presents_per_second);
+		}
+		igTextUnformatted(stats_buffer, stats_buffer + stats_length);
+
+
+		job_stats_window();
+		alloc_stats_window();
+	}
+
+	if (ui_stress) ui_stress_windows();
+	if (scene_stress) {
+		uint64_t begin = time_now_ns();
+		update_stress_scene(packet->sim_begin_ns);
+		scene_stress_update_ns = time_now_ns() - begin;
+	} else if (g_stress_scene.count) {
+		scene_free(&g_stress_scene);
+	}
+	if (cull_stress) update_cull_stress(packet->sim_begin_ns);
+	else if (g_cull_stress_bounds.count) free_cull_stress();
+	if (draw_stress) update_draw_stress(packet->sim_begin_ns);
+	else if (g_draw_stress.capacity) draw_queue_free(&g_draw_stress);
+	if (animate_scene) animate_demo_scene(packet->sim_begin_ns);
+	if (instance_stress && g_instance_scene.count == 0) create_instance_scene();
+	else if (!instance_stress && g_instance_scene.count) free_instance_scene();
+
+	igRender();
+
+	packet->width = (uint32_t)hwnd_width;
+	packet->height = hwnd_height;
+	memcpy(packet->clear_color, &clear_color, sizeof(packet->clear_color));
+	packet->vsync = is_vsync;
+	packet->draw_triangle = should_render_triangle;
+	memset(&packet->meshes, 0, sizeof(packet->meshes));
+	packet->gpu_culling = gpu_culling;
+	packet->verify_culling = verify_culling;
+	packet->per_draw_descriptor_tables = per_draw_descriptor_tables;
+	packet->parallel_ui_upload = parallel_ui_upload;
+
+	ImDrawData* draw_data = igGetDrawData();
+	uint64_t hash = draw_data ? frame_hash_draw_data(0, draw_data) : 0;
+	// the UI appears once the font atlas is resident, the draw data alone does not change then
+	uint32_t view[6] = {packet->width, packet->height, packet->vsync, packet->draw_triangle, packet->per_draw_descriptor_tables,
+			    ImGui_ImplDX12_FontTextureReady()};
+	hash = frame_hash_bytes(hash, view, sizeof(view));
+	hash = frame_hash_bytes(hash, packet->clear_color, sizeof(packet->clear_color));
+	if (packet->draw_triangle) {
+		float lod_error = g_instance_lod.count ? lod_pixel_error : 0.0f;
+		uint64_t revisions[8] = {g_scene.revision, g_instance_scene.count ? g_instance_scene.revision : 0, (uint64_t)demo_vertex_format, instance_spheres,
+					 draw_cooked ? atomic_load_explicit(&g_cooked_mesh, memory_order_acquire) : MESH_INVALID, (uint64_t)cooked_lod, 0, cluster_culling};
+		memcpy(&revisions[6], &lod_error, sizeof(lod_error));
+		hash = frame_hash_bytes(hash, revisions, sizeof(revisions));
+	}
+	bool probe = false;
+	bool render = frame_scheduler_tick(hash, g_input.pending_count > 0, IsIconic(*g_hwnd) != 0, &probe);
+	if (probe) probe_occlusion();
+	if (!render) {
+		packet->sim_end_ns = time_now_ns();
+		return false;
+	}
+
+	uint32_t instance_count = g_scene.count + g_instance_scene.count;
+	// and one more for the cooked mesh, the instance scene's keys by level of detail
+	size_t scene_bytes = packet->draw_triangle ? (instance_count + 1) * (sizeof(struct mat4) + sizeof(uint32_t)) + mesh_draw_list_bytes(instance_count + 1) + 48 : 0;
+	if (packet->draw_triangle && g_instance_lod.count) scene_bytes += g_instance_scene.count * sizeof(uint32_t) + 16;
+	// the cooked mesh's levels are a batch each, culled up to MESHLET_MAX_INSTANCES instances in half as many ranges as meshlets
+	uint32_t cooked_mesh = atomic_load_explicit(&g_cooked_mesh, memory_order_acquire);
+	bool clusters = packet->draw_triangle && cluster_culling && cooked_mesh != MESH_INVALID;
+	if (clusters) scene_bytes += MESHLET_MAX_INSTANCES * (g_cooked_header.meshlet_count + g_cooked_header.lod_count) / 2 * sizeof(struct mesh_range) + 16;
+	// and the input timestamps pushed after the UI, the arena only grows while it is empty
+	scene_bytes += input_frame_bytes();
+	frame_packet_copy_ui(packet, draw_data, scene_bytes);
+	packet->input_count = input_end_frame(&packet->arena, &packet->input_timestamps);
+
+	if (packet->draw_triangle) {
+		// model to projection for every node, then grouped by PSO and mesh into the packet
+		uint64_t begin = time_now_ns();
+		float aspect = (float)packet->width / (float)(packet->height ? packet->height : 1);
+		struct mat4 projection = mat4_ortho(-aspect, aspect, -1.0f, 1.0f, 0.0f, 1.0f);
+		struct mat4* transforms = arena_push(&packet->arena, instance_count * sizeof(struct mat4), 16);
+		if (transforms) {
+			scene_update(&g_scene, &projection, transforms);
+			scene_update_ns = time_now_ns() - begin;
+			if (g_instance_scene.count) scene_update(&g_instance_scene, &projection, transforms + g_scene.count);
+
+			uint32_t mesh_offset = (uint32_t)demo_vertex_format * DEMO_MESH_COUNT;
+			struct mesh_objects sources[3] = {
+				{.transforms = transforms, .keys = g_scene_keys, .colors = g_scene_colors, .count = g_scene.count, .mesh_offset = mesh_offset},
+				{.transforms = transforms + g_scene.count, .keys = g_instance_keys, .colors = g_instance_colors, .count = g_instance_scene.count,
+				 .mesh_offset = g_instance_lod.count ? 0 : mesh_offset},
+				{0},
+			};
+			// the cooked mesh turns with the root, fitted into the middle quad, in front of it
+			uint32_t cooked_key = MESH_KEY(DEMO_PSO_DEPTH, cooked_mesh + (uint32_t)cooked_lod);
+			struct vec4 cooked_color = vec4_make(1.0f, 1.0f, 1.0f, 1.0f);
+			struct mat4* cooked_transform = draw_cooked && cooked_mesh != MESH_INVALID ? arena_push(&packet->arena, sizeof(struct mat4), 16) : NULL;
+			if (cooked_transform) {
+				const float* min = g_cooked_header.bounds_min;
+				const float* max = g_cooked_header.bounds_max;
+				float size = fmaxf(max[0] - min[0], fmaxf(max[1] - min[1], max[2] - min[2]));
+				float scale = size > 0.0f ? 0.4f / size : 1.0f;
+				struct vec3 center = vec3_make((min[0] + max[0]) * 0.5f, (min[1] + max[1]) * 0.5f, (min[2] + max[2]) * 0.5f);
+				struct mat4 fit = mat4_trs(vec3_add(vec3_scale(center, -scale), vec3_make(0.0f, 0.0f, 0.5f)), quat_identity(), vec3_make(scale, scale, scale));
+				*cooked_transform = mat4_mul(&transforms[0], &fit);
+				sources[2] = (struct mesh_objects){.transforms = cooked_transform, .keys = &cooked_key, .colors = &cooked_color, .count = 1};
+			}
+			// only the visible nodes go into the draw list, the indices are ascending per scene
+			bool bounds = (cpu_culling || bvh_picking || g_instance_lod.count) && update_scene_bounds();
+			uint32_t* visible = cpu_culling && bounds ? arena_push(&packet->arena, instance_count * sizeof(uint32_t), 16) : NULL;
+			uint32_t demo_visible = 0;
+			uint32_t visible_count = visible ? cull_scene(&projection, visible, &demo_visible) : UINT32_MAX;
+			if (bvh_picking && bounds) {
+				// straight into the screen at the mouse, through the ortho projection's inverse
+				ImVec2 mouse = igGetIO()->MousePos;
+				float x = (mouse.x / (float)(packet->width ? packet->width : 1) * 2.0f - 1.0f) * aspect;
+				float y = 1.0f - mouse.y / (float)(packet->height ? packet->height : 1) * 2.0f;
+				picked_node = igIsMousePosValid(NULL) ? pick_scene_node(vec3_make(x, y, -1.0f), vec3_make(0.0f, 0.0f, 1.0f)) : UINT32_MAX;
+			}
+			if (visible_count != UINT32_MAX) {
+				sources[0].indices = visible;
+				sources[0].count = demo_visible;
+				sources[1].indices = visible + demo_visible;
+				sources[1].count = visible_count - demo_visible;
+			}
+			// a level per drawn instance, from its bounds' projected size
+			uint32_t* lod_keys = g_instance_lod.count && bounds ? arena_push(&packet->arena, g_instance_scene.count * sizeof(uint32_t), 16) : NULL;
+			if (lod_keys) {
+				uint64_t selected = time_now_ns();
+				struct lod_view lod_view = lod_view_from_matrix(&projection, (float)packet->height, lod_pixel_error);
+				lod_select(&g_scene_bounds, g_scene.count, sources[1].indices, sources[1].count, &lod_view, &g_instance_lod, lod_keys, &lod_stats);
+				sources[1].keys = lod_keys;
+				lod_ns = time_now_ns() - selected;
+			}
+			mesh_draw_list_build(&packet->meshes, &packet->arena, sources, 3);
+			meshlet_stats = (struct meshlet_stats){0};
+			if (clusters) mesh_draw_list_cull_clusters(&packet->meshes, &packet->arena, cooked_mesh, g_cooked_header.lod_count, &meshlet_stats);
+		}
+		mesh_build_ns = time_now_ns() - begin;
+	}
+
+	packet->sim_end_ns = time_now_ns();
+	return true;
+}
+
+static void record_timestamp(ID3D12GraphicsCommandList* cmd_list, void* data)
+{
+	cmd_list->lpVtbl->EndQuery(cmd_list, query_heap, D3D12_QUERY_TYPE_TIMESTAMP, *(UINT*)data);
+}
+
+static void record_ui(ID3D12GraphicsCommandList* cmd_list, void* data)
+{
+	struct frame_packet* packet = data;
+	g_PerDrawDescriptorTables = packet->per_draw_descriptor_tables;
+	g_ParallelCopy = packet->parallel_ui_upload;
+	uint64_t ui_begin = time_now_ns();
+	ImGui_ImplDX12_RenderDrawData(&packet->ui, cmd_list);
+	atomic_store_explicit(&ui_record_ns, time_now_ns() - ui_begin, memory_order_relaxed);
+	atomic_store_explicit(&ui_draw_count, g_DrawCallCount, memory_order_relaxed);
+	atomic_store_explicit(&ui_command_count, g_CommandCount, memory_order_relaxed);
+	atomic_store_explicit(&ui_culled_count, g_CulledCount, memory_order_relaxed);
+	atomic_store_explicit(&ui_skipped_state_sets, g_SkippedStateSets, memory_order_relaxed);
+	atomic_store_explicit(&ui_upload_bytes, g_upload_ring.frame_bytes, memory_order_relaxed);
+	atomic_store_explicit(&ui_upload_copy_ns, g_UploadCopyNs, memory_order_relaxed);
+	if (g_FontUploadNs && !atomic_load_explicit(&ui_visible_ns, memory_order_relaxed)) {
+		atomic_store_explicit(&ui_visible_ns, time_now_ns() - initialize_begin_ns, memory_order_relaxed);
+		atomic_store_explicit(&ui_font_upload_ns, g_FontUploadNs, memory_order_relaxed);
 	}
+}
 
+// Runs on the render thread when pipelined, only reads the packet and render state.
+void render_frame(struct frame_packet* packet)
+{
+	if (g_pipeline.threaded) alloc_track_name_thread("render");
+	uint32_t zone = alloc_zone_enter(ALLOC_ZONE_RENDER);
 	struct FrameContext* frameCtxt = WaitForNextFrameResources();
+	upload_ring_begin_frame(&g_upload_ring, g_fenceLastSignaledValue + 1, g_fence->lpVtbl->GetCompletedValue(g_fence));
 
 	UINT backBufferIdx = g_pSwapChain->lpVtbl->GetCurrentBackBufferIndex(g_pSwapChain);
 	frameCtxt->CommandAllocator->lpVtbl->Reset(frameCtxt->CommandAllocator);
@@ -1080,14 +2251,14 @@ __declspec(dllexport) bool update_and_render()
 	g_pd3dCommandList->lpVtbl->RSSetScissorRects(
 	    g_pd3dCommandList,
 	    1,
-	    &(D3D12_RECT){.left = 0, .top = 0, .right = hwnd_width, .bottom = hwnd_height});
+	    &(D3D12_RECT){.left = 0, .top = 0, .right = packet->width, .bottom = packet->height});
 
 	g_pd3dCommandList->lpVtbl->RSSetViewports(g_pd3dCommandList,
 						  1,
 						  &(D3D12_VIEWPORT){.TopLeftX = 0,
 								    .TopLeftY = 0,
-								    .Width = hwnd_width,
-								    .Height = hwnd_height,
+								    .Width = packet->width,
+								    .Height = packet->height,
 								    .MaxDepth = 1.0f,
 								    .MinDepth = 0.0f});
 
@@ -1106,7 +2277,7 @@ __declspec(dllexport) bool update_and_render()
 	g_pd3dCommandList->lpVtbl->ClearRenderTargetView(
 	    g_pd3dCommandList,
 	    g_mainRenderTargetDescriptor[backBufferIdx],
-	    (float*)&clear_color,
+	    packet->clear_color,
 	    0,
 	    NULL);
 
@@ -1118,33 +2289,43 @@ __declspec(dllexport) bool update_and_render()
 						      &dsv_handle);
 	g_pd3dCommandList->lpVtbl->SetDescriptorHeaps(g_pd3dCommandList, 1, &g_pd3dSrvDescHeap);
 
-	//render triangle
-	if(should_render_triangle)
+	// the scene, its timestamp, then the UI, in the order of their keys
+	draw_queue_reset(&g_draw_queue);
+	uint32_t queued = packet->draw_triangle ? packet->meshes.batch_count + packet->meshes.range_count + 2 : 2;
+	draw_queue_reserve(&g_draw_queue, queued, queued); // on failure the pushes fail, nothing is drawn
+	if(packet->draw_triangle)
 	{
 		if(!is_triangle_created)
 		{
 			is_triangle_created = true;
-			create_triangle(g_pd3dCommandList);
+			create_demo_meshes(g_pd3dCommandList);
 		}
 
-		g_pd3dCommandList->lpVtbl->IASetPrimitiveTopology(g_pd3dCommandList, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
-		g_pd3dCommandList->lpVtbl->SetGraphicsRootSignature(g_pd3dCommandList, g_rootsig);
-		g_pd3dCommandList->lpVtbl->SetPipelineState(g_pd3dCommandList, g_pso);
-		g_pd3dCommandList->lpVtbl->IASetVertexBuffers(g_pd3dCommandList, 0, 1, &triangle.vbv);
-		g_pd3dCommandList->lpVtbl->DrawInstanced(g_pd3dCommandList, 3, 1, 0, 0);
+		// the GPU-driven path records its dispatches right away, ahead of the queue
+		uint32_t frame_slot = g_frameIndex % NUM_FRAMES_IN_FLIGHT;
+		bindless_bind_graphics(g_pd3dCommandList);
+		if (!packet->gpu_culling || !mesh_renderer_draw_indirect(g_pd3dCommandList, &packet->meshes, &g_upload_ring, frame_slot, packet->verify_culling))
+			mesh_renderer_draw(&g_draw_queue, DRAW_LAYER_SCENE, &packet->meshes, &g_upload_ring, frame_slot);
 	}
 
 	UINT buffer_start = backBufferIdx * 2;
 	UINT buffer_end = (backBufferIdx * 2 + 1);
 
-	g_pd3dCommandList->lpVtbl->EndQuery(g_pd3dCommandList,
-					    query_heap,
-					    D3D12_QUERY_TYPE_TIMESTAMP,
-					    buffer_start);
-
-	igRender();  // render ui
-
-	ImGui_ImplDX12_RenderDrawData(igGetDrawData(), g_pd3dCommandList);
+	struct draw_command scene_end = {.record = record_timestamp, .data = &buffer_start};
+	draw_queue_push(&g_draw_queue, DRAW_KEY(DRAW_LAYER_SCENE, DRAW_PASS_END, 0, 0, 0), draw_queue_command(&g_draw_queue, &scene_end));
+	if (packet->ui.Valid) {
+		struct draw_command ui = {.record = record_ui, .data = packet};
+		draw_queue_push(&g_draw_queue, DRAW_KEY(DRAW_LAYER_UI, DRAW_PASS_TRANSPARENT, 0, 0, 0), draw_queue_command(&g_draw_queue, &ui));
+	}
+	draw_queue_sort(&g_draw_queue);
+	draw_queue_record(&g_draw_queue, g_pd3dCommandList);
+	atomic_store_explicit(&draw_queue_items, g_draw_queue.stats.items, memory_order_relaxed);
+	atomic_store_explicit(&draw_queue_passes, g_draw_queue.stats.sort_passes, memory_order_relaxed);
+	atomic_store_explicit(&draw_queue_sort_ns, g_draw_queue.stats.sort_ns, memory_order_relaxed);
+	for (uint32_t state = 0; state < DRAW_STATE_COUNT; ++state) {
+		atomic_store_explicit(&draw_queue_sets[state], g_draw_queue.stats.sets[state], memory_order_relaxed);
+		atomic_store_explicit(&draw_queue_skips[state], g_draw_queue.stats.skips[state], memory_order_relaxed);
+	}
 
 	barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_RENDER_TARGET;
 	barrier.Transition.StateAfter = D3D12_RESOURCE_STATE_PRESENT;
@@ -1176,23 +2357,59 @@ __declspec(dllexport) bool update_and_render()
 					     (void**)&timestamp_buffer);
 	ASSERT(SUCCEEDED(hr));
 	UINT64 time_delta = timestamp_buffer[buffer_end] - timestamp_buffer[buffer_start];
-	frame_time = ((double)time_delta / g_gpu_frequency) * 1000.0;
+	atomic_store_explicit(&gpu_frame_ticks, time_delta, memory_order_relaxed);
 
 	rb_buffer->lpVtbl->Unmap(rb_buffer, 0, &(D3D12_RANGE){.Begin = 0, .End = 0});
 	timestamp_buffer = NULL;
 
-	UINT sync_interval = is_vsync ? 1 : 0;
-	UINT present_flags = is_vsync ? 0 : DXGI_PRESENT_ALLOW_TEARING;
-	g_pSwapChain->lpVtbl->Present(g_pSwapChain, sync_interval, present_flags);
+	UINT sync_interval = packet->vsync ? 1 : 0;
+	UINT present_flags = packet->vsync ? 0 : DXGI_PRESENT_ALLOW_TEARING;
+	HRESULT present_result = g_pSwapChain->lpVtbl->Present(g_pSwapChain, sync_interval, present_flags);
+	frame_scheduler_presented(present_result == DXGI_STATUS_OCCLUDED);
+	if (!atomic_load_explicit(&ui_first_frame_ns, memory_order_relaxed))
+		atomic_store_explicit(&ui_first_frame_ns, time_now_ns() - initialize_begin_ns, memory_order_relaxed);
+	input_record_present(packet->input_timestamps, packet->input_count, time_now_ns());
 
 	UINT64 fenceValue = g_fenceLastSignaledValue + 1;
 	g_pd3dCommandQueue->lpVtbl->Signal(g_pd3dCommandQueue, g_fence, fenceValue);
 	g_fenceLastSignaledValue = fenceValue;
 	frameCtxt->FenceValue = fenceValue;
+	upload_ring_end_frame(&g_upload_ring);
+	atomic_store_explicit(&upload_ring_size, g_upload_ring.size, memory_order_relaxed);
+	atomic_store_explicit(&upload_ring_grows, g_upload_ring.grow_count, memory_order_relaxed);
 
 	// Gather statistics
 	DXGI_FRAME_STATISTICS frame_stats;
 	g_pSwapChain->lpVtbl->GetFrameStatistics(g_pSwapChain, &frame_stats);
+	alloc_zone_enter(zone);
+}
+
+__declspec(dllexport) bool update_and_render()
+{
+	alloc_track_frame();
+	// benchmark gate: after a warm-up no frame may touch the heap, ImGui's pools included
+	if (alloc_gate) {
+		bool allocated = g_alloc_track.frame_total.allocs || g_imgui_allocator->last_frame.os_allocs;
+		if (++alloc_gate_frames > ALLOC_GATE_WARMUP_FRAMES && allocated) {
+			alloc_gate = false;
+			const struct alloc_site* site = g_alloc_track.frame_top_site;
+			failed_assert(site ? site->file : __FILE__, site ? (int)site->line : __LINE__, "zero heap allocations in a steady-state frame");
+		}
+	} else {
+		alloc_gate_frames = 0;
+	}
+
+	frame_pipeline_set_threaded(is_pipelined);
+	frame_scheduler_set_enabled(idle_skipping);
+
+	struct frame_packet* packet = frame_pipeline_acquire();
+	uint32_t zone = alloc_zone_enter(ALLOC_ZONE_SIMULATION);
+	bool render = simulate_frame(packet);
+	alloc_zone_enter(zone);
+	if (render)
+		frame_pipeline_submit(packet);
+	else
+		frame_pipeline_discard(packet);
 
 	LARGE_INTEGER current_time;
 	QueryPerformanceCounter(&current_time);
@@ -1207,17 +2424,35 @@ __declspec(dllexport) bool update_and_render()
 	delta_times[stats_counter++] = delta_time.elapsed_ms;
 	if(stats_counter == BUFFERED_FRAME_STATS) stats_counter = 0;
 
+	// the window lives on another thread now, SetTimer cannot target it from here
+	uint64_t now = time_now_ns();
+	if (now - last_frame_stats_ns >= FRAME_STATS_INTERVAL_NS) {
+		last_frame_stats_ns = now;
+		frame_time_statistics();
+	}
+
 	return true;
 }
 
+// How long the host may block on window events before calling update_and_render again.
+__declspec(dllexport) uint32_t idle_wait_ms(void)
+{
+	return frame_scheduler_wait_ms();
+}
+
 __declspec(dllexport) void resize(HWND hWnd, int width, int height)
 {
-	ImGui_ImplDX12_InvalidateDeviceObjects();
+	uint64_t resize_begin = time_now_ns();
+	uint32_t zone = alloc_zone_enter(ALLOC_ZONE_RESIZE);
+	frame_pipeline_flush();
+	frame_scheduler_invalidate();
+	// the ImGui device objects do not depend on the swap chain, recreating them would stream the atlas in again
 	CleanupRenderTarget();
 	csafe_release(dsv_resource);
 
 	ResizeSwapChain(hWnd, width, height);
 	create_dsv(width,height);
 	CreateRenderTarget();
-	ImGui_ImplDX12_CreateDeviceObjects();
+	resize_ns = time_now_ns() - resize_begin;
+	alloc_zone_enter(zone);
 }
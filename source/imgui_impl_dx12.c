@@ -2,7 +2,7 @@
 // This needs to be used along with a Platform Binding (e.g. Win32)
 
 // Implemented features:
-//  [X] Renderer: User texture binding. Use 'D3D12_GPU_DESCRIPTOR_HANDLE' as ImTextureID. Read the FAQ about ImTextureID!
+//  [X] Renderer: User texture binding. Use a bindless heap index as ImTextureID. Read the FAQ about ImTextureID!
 //  [X] Renderer: Support for large meshes (64k+ vertices) with 16-bits indices.
 // Issues:
 //  [ ] 64-bit only for now! (Because sizeof(ImTextureId) == sizeof(void*)). See github.com/ocornut/imgui/pull/301
@@ -25,16 +25,27 @@
 //  2018-02-22: Merged into master with all Win32 code synchronized to other examples.
 
 #include "cimgui.h"
+// Unity build: expects threading.c, job_system.c, upload_ring.c and ui_batch.c to be included before this file.
 
 #include <d3d12.h>
 #pragma clang diagnostic ignored "-Weverything"
 
+// Bytecode generated by build_debug.ps1 from imgui_shaders.hlsl, the strings below are only compiled when it is missing.
+#if __has_include("generated/imgui_vs.h") && __has_include("generated/imgui_ps.h")
+#define IMGUI_DX12_PRECOMPILED_SHADERS 1
+#include "generated/imgui_vs.h"
+#include "generated/imgui_ps.h"
+#else
+#define IMGUI_DX12_PRECOMPILED_SHADERS 0
+#endif
+
 #define ImDrawCallback_ResetRenderState (ImDrawCallback)(-1)
 
 // DirectX data
 // Use if you want to reset your rendering device without losing ImGui state.
 static void     ImGui_ImplDX12_InvalidateDeviceObjects(void);
 static bool     ImGui_ImplDX12_CreateDeviceObjects(void);
+static bool     ImGui_ImplDX12_FontTextureReady(void);
 static ID3D12Device*                g_pd3dDevice ;
 static ID3D10Blob*                  g_pVertexShaderBlob ;
 static ID3D10Blob*                  g_pPixelShaderBlob ;
@@ -43,26 +54,70 @@ static ID3D12PipelineState*         g_pPipelineState ;
 static DXGI_FORMAT                  g_RTVFormat = DXGI_FORMAT_UNKNOWN;
 static ID3D12Resource*              g_pFontTextureResource ;
 static D3D12_CPU_DESCRIPTOR_HANDLE  g_hFontSrvCpuDescHandle;
-static D3D12_GPU_DESCRIPTOR_HANDLE  g_hFontSrvGpuDescHandle;
-
-typedef struct FrameResources
-
+static UINT                         g_fontSrvIndex;
+static D3D12_GPU_DESCRIPTOR_HANDLE  g_hHeapGpuStart;
+static UINT                         g_srvDescriptorSize;
+static UINT64                       g_CreateDeviceObjectsNs; // last ImGui_ImplDX12_CreateDeviceObjects(), font upload submitted but not waited on
+
+// Font atlas upload, recorded on a copy queue and never waited on. The texture starts in COMMON, the
+// copy queue promotes it to COPY_DEST and it decays back once the copy is done, then the direct queue
+// promotes it to PIXEL_SHADER_RESOURCE on first use. Nothing is drawn until the copy fence passed.
+static ID3D12CommandQueue*          g_pCopyQueue;
+static ID3D12CommandAllocator*      g_pCopyAllocator;
+static ID3D12GraphicsCommandList*   g_pCopyList;
+static ID3D12Fence*                 g_pCopyFence;
+static UINT64                       g_CopyFenceValue;
+static ID3D12Resource*              g_pFontUploadBuffer;  // released by the first RenderDrawData() that sees the copy done
+static UINT64                       g_FontUploadBeginNs;
+static UINT64                       g_FontUploadNs;       // submit to first draw with the atlas, 0 while streaming
+static const unsigned char*         g_pFontPixels;        // see ImGui_ImplDX12_SetFontPixels()
+static int                          g_FontWidth;
+static int                          g_FontHeight;
+
+// Root parameters of the shared bindless root signature: 0 = constants (16 mvp + texture index), 1 = heap table.
+#define IMGUI_ROOT_CONSTANTS 0
+#define IMGUI_ROOT_TABLE 1
+#define IMGUI_TEXTURE_INDEX_OFFSET 16
+
+// Old binding model for comparison, one descriptor table set per draw instead of one root constant.
+static bool                         g_PerDrawDescriptorTables = false;
+static UINT                         g_DrawCallCount;
+static UINT                         g_CommandCount;   // ImDrawCmd in, callbacks excluded
+static UINT                         g_CulledCount;
+static UINT                         g_SkippedStateSets; // scissor and texture sets that would not have changed anything
+static struct ui_batches            g_Batches;
+
+// Vertex/index space for one RenderDrawData() call, carved out of the application's upload ring.
+typedef struct RenderBuffers
+{
+	D3D12_GPU_VIRTUAL_ADDRESS   VertexBuffer;
+	D3D12_GPU_VIRTUAL_ADDRESS   IndexBuffer;
+	UINT                        VertexBufferSize;
+	UINT                        IndexBufferSize;
+} RenderBuffers;
+static struct upload_ring*  g_pUploadRing;
+
+// Copies go wide through the job system above this many vertices, below it the fork costs more than the copy.
+#define IMGUI_PARALLEL_COPY_MIN_VERTICES 16384
+static bool                 g_ParallelCopy = true;
+static int*                 g_pListOffsets; // first vertex per command list
+static int                  g_ListOffsetsCapacity;
+static UINT64               g_UploadBytes;  // last RenderDrawData() call
+static UINT64               g_UploadCopyNs;
+
+typedef struct CopyContext
 {
-	ID3D12Resource*     IndexBuffer;
-	ID3D12Resource*     VertexBuffer;
-	int                 IndexBufferSize;
-	int                 VertexBufferSize;
-} FrameResources;
-static FrameResources*  g_pFrameResources ;
-static UINT             g_numFramesInFlight ;
-static UINT             g_frameIndex;
+	ImDrawData*     DrawData;
+	ImDrawVert*     VtxDst;
+	ImDrawIdx*      IdxDst;
+} CopyContext;
 
 typedef struct VERTEX_CONSTANT_BUFFER
 {
-	float   mvp[4][4];
+	struct mat4 mvp;
 } VERTEX_CONSTANT_BUFFER;
 
-static void ImGui_ImplDX12_SetupRenderState(ImDrawData* draw_data, ID3D12GraphicsCommandList* ctx, FrameResources* fr)
+static void ImGui_ImplDX12_SetupRenderState(ImDrawData* draw_data, ID3D12GraphicsCommandList* ctx, RenderBuffers* fr)
 {
 	// Setup orthographic projection matrix into our constant buffer
 	// Our visible imgui space lies from draw_data->DisplayPos (top left) to draw_data->DisplayPos+data_data->DisplaySize (bottom right).
@@ -72,14 +127,8 @@ static void ImGui_ImplDX12_SetupRenderState(ImDrawData* draw_data, ID3D12Graphic
 		float R = draw_data->DisplayPos.x + draw_data->DisplaySize.x;
 		float T = draw_data->DisplayPos.y;
 		float B = draw_data->DisplayPos.y + draw_data->DisplaySize.y;
-		float mvp[4][4] =
-		{
-			{ 2.0f/(R-L),   0.0f,           0.0f,       0.0f },
-			{ 0.0f,         2.0f/(T-B),     0.0f,       0.0f },
-			{ 0.0f,         0.0f,           0.5f,       0.0f },
-			{ (R+L)/(L-R),  (T+B)/(B-T),    0.5f,       1.0f },
-		};
-		memcpy(&vertex_constant_buffer.mvp, mvp, sizeof(mvp));
+		// z in [-1, 1] lands on 0.5 for the vertices' z = 0
+		vertex_constant_buffer.mvp = mat4_ortho(L, R, B, T, -1.0f, 1.0f);
 	}
 
 	// Setup viewport
@@ -94,29 +143,44 @@ static void ImGui_ImplDX12_SetupRenderState(ImDrawData* draw_data, ID3D12Graphic
 
 	// Bind shader and vertex buffers
 	unsigned int stride = sizeof(ImDrawVert);
-	unsigned int offset = 0;
 	D3D12_VERTEX_BUFFER_VIEW vbv;
 	memset(&vbv, 0, sizeof(D3D12_VERTEX_BUFFER_VIEW));
-	vbv.BufferLocation = fr->VertexBuffer->lpVtbl->GetGPUVirtualAddress(fr->VertexBuffer) + offset;
-	vbv.SizeInBytes = (UINT)fr->VertexBufferSize * stride;
+	vbv.BufferLocation = fr->VertexBuffer;
+	vbv.SizeInBytes = fr->VertexBufferSize * stride;
 	vbv.StrideInBytes = stride;
 	ctx->lpVtbl->IASetVertexBuffers( ctx,0, 1, &vbv);
 	D3D12_INDEX_BUFFER_VIEW ibv;
 	memset(&ibv, 0, sizeof(D3D12_INDEX_BUFFER_VIEW));
-	ibv.BufferLocation = fr->IndexBuffer->lpVtbl->GetGPUVirtualAddress(fr->IndexBuffer);
-	ibv.SizeInBytes = (UINT)fr->IndexBufferSize * sizeof(ImDrawIdx);
+	ibv.BufferLocation = fr->IndexBuffer;
+	ibv.SizeInBytes = fr->IndexBufferSize * sizeof(ImDrawIdx);
 	ibv.Format = sizeof(ImDrawIdx) == 2 ? DXGI_FORMAT_R16_UINT : DXGI_FORMAT_R32_UINT;
 	ctx->lpVtbl-> IASetIndexBuffer(ctx,&ibv);
 	ctx->lpVtbl->IASetPrimitiveTopology(ctx,D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
 	ctx->lpVtbl->SetPipelineState(ctx,g_pPipelineState);
 	ctx->lpVtbl->SetGraphicsRootSignature(ctx,g_pRootSignature);
-	ctx->lpVtbl->SetGraphicsRoot32BitConstants(ctx,0, 16, &vertex_constant_buffer, 0);
+	ctx->lpVtbl->SetGraphicsRoot32BitConstants(ctx,IMGUI_ROOT_CONSTANTS, 16, &vertex_constant_buffer, 0);
+	if (!g_PerDrawDescriptorTables)
+		ctx->lpVtbl->SetGraphicsRootDescriptorTable(ctx,IMGUI_ROOT_TABLE, g_hHeapGpuStart);
 
 	// Setup blend factor
 	const float blend_factor[4] = { 0.f, 0.f, 0.f, 0.f };
 	ctx->lpVtbl->OMSetBlendFactor(ctx,blend_factor);
 }
 
+// Items [0, CmdListsCount) copy a list's vertices, the rest are g_Batches index copies. Runs on job threads for large UIs.
+static void ImGui_ImplDX12_CopyLists(void* data, uint32_t begin, uint32_t end)
+{
+	CopyContext* copy = (CopyContext*)data;
+	uint32_t list_count = (uint32_t)copy->DrawData->CmdListsCount;
+	for (uint32_t n = begin; n < end && n < list_count; n++)
+	{
+		const ImDrawList* cmd_list = copy->DrawData->CmdLists[n];
+		memcpy(copy->VtxDst + g_pListOffsets[n], cmd_list->VtxBuffer.Data, (size_t)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
+	}
+	if (end > list_count)
+		ui_batches_copy_indices(&g_Batches, copy->IdxDst, begin > list_count ? begin - list_count : 0, end - list_count);
+}
+
 // Render function
 // (this used to be set in io.RenderDrawListsFn and called by ImGui::Render(), but you can now call this directly from your main loop)
 static void ImGui_ImplDX12_RenderDrawData(ImDrawData* draw_data, ID3D12GraphicsCommandList* ctx)
@@ -125,132 +189,187 @@ static void ImGui_ImplDX12_RenderDrawData(ImDrawData* draw_data, ID3D12GraphicsC
 	if (draw_data->DisplaySize.x <= 0.0f || draw_data->DisplaySize.y <= 0.0f)
 		return;
 
-	// FIXME: I'm assuming that this only gets called once per frame!
-	// If not, we can't just re-allocate the IB or VB, we'll have to do a proper allocator.
-	g_frameIndex = g_frameIndex + 1;
-	FrameResources* fr = &g_pFrameResources[g_frameIndex % g_numFramesInFlight];
-
-	// Create and grow vertex/index buffers if needed
-	if (fr->VertexBuffer == NULL || fr->VertexBufferSize < draw_data->TotalVtxCount)
-	{
-		if(fr->VertexBuffer)
-		{
-			fr->VertexBuffer->lpVtbl-> Release(fr->VertexBuffer);
-			fr->VertexBuffer = NULL;
-		}
-		fr->VertexBufferSize = draw_data->TotalVtxCount + 5000;
-		D3D12_HEAP_PROPERTIES props;
-		memset(&props, 0, sizeof(D3D12_HEAP_PROPERTIES));
-		props.Type = D3D12_HEAP_TYPE_UPLOAD;
-		props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		D3D12_RESOURCE_DESC desc;
-		memset(&desc, 0, sizeof(D3D12_RESOURCE_DESC));
-		desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		desc.Width = (UINT64)fr->VertexBufferSize * sizeof(ImDrawVert);
-		desc.Height = 1;
-		desc.DepthOrArraySize = 1;
-		desc.MipLevels = 1;
-		desc.Format = DXGI_FORMAT_UNKNOWN;
-		desc.SampleDesc.Count = 1;
-		desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-		if (g_pd3dDevice->lpVtbl-> CreateCommittedResource(g_pd3dDevice,&props, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, &IID_ID3D12Resource,(void**)&fr->VertexBuffer) < 0)
-			return;
-	}
-	if (fr->IndexBuffer == NULL || fr->IndexBufferSize < draw_data->TotalIdxCount)
+	// Every widget samples the font atlas, nothing to draw until its copy is done
+	if (!ImGui_ImplDX12_FontTextureReady())
+		return;
+	if (g_pFontUploadBuffer)
 	{
-		if(fr->IndexBuffer)
-		{
-			fr->IndexBuffer->lpVtbl-> Release(fr->IndexBuffer);
-			fr->IndexBuffer = NULL;
-		}
-		fr->IndexBufferSize = draw_data->TotalIdxCount + 10000;
-		D3D12_HEAP_PROPERTIES props;
-		memset(&props, 0, sizeof(D3D12_HEAP_PROPERTIES));
-		props.Type = D3D12_HEAP_TYPE_UPLOAD;
-		props.CPUPageProperty = D3D12_CPU_PAGE_PROPERTY_UNKNOWN;
-		props.MemoryPoolPreference = D3D12_MEMORY_POOL_UNKNOWN;
-		D3D12_RESOURCE_DESC desc;
-		memset(&desc, 0, sizeof(D3D12_RESOURCE_DESC));
-		desc.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER;
-		desc.Width = (UINT64)fr->IndexBufferSize * sizeof(ImDrawIdx);
-		desc.Height = 1;
-		desc.DepthOrArraySize = 1;
-		desc.MipLevels = 1;
-		desc.Format = DXGI_FORMAT_UNKNOWN;
-		desc.SampleDesc.Count = 1;
-		desc.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR;
-		desc.Flags = D3D12_RESOURCE_FLAG_NONE;
-		if (g_pd3dDevice->lpVtbl-> CreateCommittedResource(g_pd3dDevice,&props, D3D12_HEAP_FLAG_NONE, &desc, D3D12_RESOURCE_STATE_GENERIC_READ, NULL, &IID_ID3D12Resource,(void**)&fr->IndexBuffer) < 0)
-			return;
+		g_pFontUploadBuffer->lpVtbl->Release(g_pFontUploadBuffer);
+		g_pFontUploadBuffer = NULL;
+		g_FontUploadNs = time_now_ns() - g_FontUploadBeginNs;
 	}
 
-	// Upload vertex/index data into a single contiguous GPU buffer
-	void* vtx_resource, *idx_resource;
-	D3D12_RANGE range;
-	memset(&range, 0, sizeof(D3D12_RANGE));
-	if (fr->VertexBuffer->lpVtbl->Map(fr->VertexBuffer,0, &range, &vtx_resource) != S_OK)
+	// Merge and cull the command streams first, the packed index buffer only holds what gets drawn
+	if (!ui_batches_build(&g_Batches, draw_data))
 		return;
-	if (fr->IndexBuffer->lpVtbl->Map(fr->IndexBuffer,0, &range, &idx_resource) != S_OK)
+
+	// Sub-allocate this call's vertex/index space, the ring recycles it once the frame's fence has passed.
+	// Safe to call several times per frame, every call gets its own space.
+	UINT64 vtx_bytes = (UINT64)draw_data->TotalVtxCount * sizeof(ImDrawVert);
+	UINT64 idx_bytes = (UINT64)g_Batches.index_count * sizeof(ImDrawIdx);
+	struct upload_allocation vtx_alloc = upload_ring_alloc(g_pUploadRing, vtx_bytes ? vtx_bytes : sizeof(ImDrawVert), 16);
+	struct upload_allocation idx_alloc = upload_ring_alloc(g_pUploadRing, idx_bytes ? idx_bytes : sizeof(ImDrawIdx), 16);
+	if (vtx_alloc.cpu == NULL || idx_alloc.cpu == NULL)
 		return;
-	ImDrawVert* vtx_dst = (ImDrawVert*)vtx_resource;
-	ImDrawIdx* idx_dst = (ImDrawIdx*)idx_resource;
+	RenderBuffers buffers = { vtx_alloc.gpu, idx_alloc.gpu, (UINT)draw_data->TotalVtxCount, g_Batches.index_count };
+	RenderBuffers* fr = &buffers;
+
+	// Upload vertex/index data into a single contiguous GPU buffer, straight into the mapped ring
+	UINT64 copy_begin = time_now_ns();
+	if (g_ListOffsetsCapacity < draw_data->CmdListsCount)
+	{
+		g_ListOffsetsCapacity = draw_data->CmdListsCount * 2;
+		g_pListOffsets = (int*)realloc(g_pListOffsets, sizeof(int) * (size_t)g_ListOffsetsCapacity);
+	}
+	int vtx_offset = 0;
 	for (int n = 0; n < draw_data->CmdListsCount; n++)
 	{
-		const ImDrawList* cmd_list = draw_data->CmdLists[n];
-		memcpy(vtx_dst, cmd_list->VtxBuffer.Data, (UINT64)cmd_list->VtxBuffer.Size * sizeof(ImDrawVert));
-		memcpy(idx_dst, cmd_list->IdxBuffer.Data, (UINT64)cmd_list->IdxBuffer.Size * sizeof(ImDrawIdx));
-		vtx_dst += cmd_list->VtxBuffer.Size;
-		idx_dst += cmd_list->IdxBuffer.Size;
+		g_pListOffsets[n] = vtx_offset;
+		vtx_offset += draw_data->CmdLists[n]->VtxBuffer.Size;
 	}
-	fr->VertexBuffer->lpVtbl->Unmap(fr->VertexBuffer,0, &range);
-	fr->IndexBuffer->lpVtbl->Unmap(fr->IndexBuffer,0, &range);
+	CopyContext copy = { draw_data, (ImDrawVert*)vtx_alloc.cpu, (ImDrawIdx*)idx_alloc.cpu };
+	uint32_t copy_items = (uint32_t)draw_data->CmdListsCount + g_Batches.copy_count;
+	if (g_ParallelCopy && draw_data->TotalVtxCount >= IMGUI_PARALLEL_COPY_MIN_VERTICES)
+		job_parallel_for(copy_items, 0, ImGui_ImplDX12_CopyLists, &copy);
+	else
+		ImGui_ImplDX12_CopyLists(&copy, 0, copy_items);
+	g_UploadCopyNs = time_now_ns() - copy_begin;
+	g_UploadBytes = vtx_bytes + idx_bytes;
 
 	// Setup desired DX state
 	ImGui_ImplDX12_SetupRenderState(draw_data, ctx, fr);
 
-	// Render command lists
-	// (Because we merged all buffers into a single one, we maintain our own offset into them)
-	int global_vtx_offset = 0;
-	int global_idx_offset = 0;
-	ImVec2 clip_off = draw_data->DisplayPos;
-	for (int n = 0; n < draw_data->CmdListsCount; n++)
+	// Render batches, offsets are already global
+	UINT bound_texture = UINT_MAX;
+	D3D12_RECT bound_scissor = { 0, 0, -1, -1 };
+	g_DrawCallCount = 0;
+	g_SkippedStateSets = 0;
+	g_CommandCount = g_Batches.command_count;
+	g_CulledCount = g_Batches.culled_count;
+	for (uint32_t i = 0; i < g_Batches.batch_count; i++)
 	{
-		const ImDrawList* cmd_list = draw_data->CmdLists[n];
-		for (int cmd_i = 0; cmd_i < cmd_list->CmdBuffer.Size; cmd_i++)
+		const struct ui_batch* batch = &g_Batches.batches[i];
+		if (batch->callback != NULL)
 		{
-			const ImDrawCmd* pcmd = &cmd_list->CmdBuffer.Data[cmd_i];
-			if (pcmd->UserCallback != NULL)
-			{
-				// User callback, registered via ImDrawList::AddCallback()
-				// (ImDrawCallback_ResetRenderState is a special callback value used by the user to request the renderer to reset render state.)
-				if (pcmd->UserCallback == ImDrawCallback_ResetRenderState)
-					ImGui_ImplDX12_SetupRenderState(draw_data, ctx, fr);
-				else
-					pcmd->UserCallback(cmd_list, pcmd);
-			}
+			// User callback, registered via ImDrawList::AddCallback()
+			// (ImDrawCallback_ResetRenderState is a special callback value used by the user to request the renderer to reset render state.)
+			if (batch->callback->UserCallback == ImDrawCallback_ResetRenderState)
+				ImGui_ImplDX12_SetupRenderState(draw_data, ctx, fr);
 			else
-			{
-				// Apply Scissor, Bind texture, Draw
-				const D3D12_RECT r = { (LONG)(pcmd->ClipRect.x - clip_off.x), (LONG)(pcmd->ClipRect.y - clip_off.y), (LONG)(pcmd->ClipRect.z - clip_off.x), (LONG)(pcmd->ClipRect.w - clip_off.y) };
-				ctx->lpVtbl-> SetGraphicsRootDescriptorTable(ctx,1, *(const D3D12_GPU_DESCRIPTOR_HANDLE*)&pcmd->TextureId);
-				ctx->lpVtbl->RSSetScissorRects(ctx,1, &r);
-				ctx->lpVtbl->DrawIndexedInstanced(ctx,pcmd->ElemCount, 1, pcmd->IdxOffset + (UINT)global_idx_offset,(INT)pcmd->VtxOffset + global_vtx_offset, 0);
-			}
+				batch->callback->UserCallback(batch->list, batch->callback);
+			// either may have changed anything
+			bound_texture = UINT_MAX;
+			bound_scissor.right = -1;
+			continue;
+		}
+
+		// Apply Scissor, Bind texture, Draw
+		const D3D12_RECT r = { batch->scissor[0], batch->scissor[1], batch->scissor[2], batch->scissor[3] };
+		if (g_PerDrawDescriptorTables)
+		{
+			D3D12_GPU_DESCRIPTOR_HANDLE table = { g_hHeapGpuStart.ptr + (UINT64)batch->texture * g_srvDescriptorSize };
+			ctx->lpVtbl->SetGraphicsRootDescriptorTable(ctx,IMGUI_ROOT_TABLE, table);
+			ctx->lpVtbl->SetGraphicsRoot32BitConstant(ctx,IMGUI_ROOT_CONSTANTS, 0, IMGUI_TEXTURE_INDEX_OFFSET);
+		}
+		else if (batch->texture != bound_texture)
+		{
+			ctx->lpVtbl->SetGraphicsRoot32BitConstant(ctx,IMGUI_ROOT_CONSTANTS, batch->texture, IMGUI_TEXTURE_INDEX_OFFSET);
+			bound_texture = batch->texture;
+		}
+		else
+			g_SkippedStateSets++;
+		if (memcmp(&r, &bound_scissor, sizeof(r)) != 0)
+		{
+			ctx->lpVtbl->RSSetScissorRects(ctx,1, &r);
+			bound_scissor = r;
 		}
-		global_idx_offset += cmd_list->IdxBuffer.Size;
-		global_vtx_offset += cmd_list->VtxBuffer.Size;
+		else
+			g_SkippedStateSets++;
+		ctx->lpVtbl->DrawIndexedInstanced(ctx,batch->index_count, 1, batch->index_offset, batch->vertex_offset, 0);
+		g_DrawCallCount++;
 	}
 }
 
+// Any thread, ID3D12Fence::GetCompletedValue() is free-threaded.
+static bool ImGui_ImplDX12_FontTextureReady(void)
+{
+	// called every frame, also before the device objects exist or when the copy queue failed
+	return g_pFontTextureResource != NULL && g_pCopyFence != NULL && g_pCopyFence->lpVtbl->GetCompletedValue(g_pCopyFence) >= g_CopyFenceValue;
+}
+
+// Only for teardown and re-creation, the copy reads the upload buffer and writes the texture.
+static void ImGui_ImplDX12_WaitForFontUpload(void)
+{
+	if (g_pCopyFence && g_pCopyFence->lpVtbl->GetCompletedValue(g_pCopyFence) < g_CopyFenceValue)
+		g_pCopyFence->lpVtbl->SetEventOnCompletion(g_pCopyFence, g_CopyFenceValue, NULL); // NULL event blocks until done
+	if (g_pFontUploadBuffer)
+	{
+		g_pFontUploadBuffer->lpVtbl->Release(g_pFontUploadBuffer);
+		g_pFontUploadBuffer = NULL;
+	}
+}
+
+static bool ImGui_ImplDX12_CreateCopyQueue(void)
+{
+	D3D12_COMMAND_QUEUE_DESC queueDesc;
+	queueDesc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
+	queueDesc.Type     = D3D12_COMMAND_LIST_TYPE_COPY;
+	queueDesc.Flags    = D3D12_COMMAND_QUEUE_FLAG_NONE;
+	queueDesc.NodeMask = 1;
+	if (g_pd3dDevice->lpVtbl->CreateCommandQueue(g_pd3dDevice,&queueDesc, &IID_ID3D12CommandQueue,(void**)&g_pCopyQueue) != S_OK)
+		return false;
+	g_pCopyQueue->lpVtbl->SetName(g_pCopyQueue, L"imgui_copy_queue");
+
+	if (g_pd3dDevice->lpVtbl->CreateCommandAllocator(g_pd3dDevice,D3D12_COMMAND_LIST_TYPE_COPY, &IID_ID3D12CommandAllocator,(void**)&g_pCopyAllocator) != S_OK)
+		return false;
+	g_pCopyAllocator->lpVtbl->SetName(g_pCopyAllocator, L"imgui_copy_alloc");
+
+	if (g_pd3dDevice->lpVtbl->CreateCommandList(g_pd3dDevice,0, D3D12_COMMAND_LIST_TYPE_COPY, g_pCopyAllocator, NULL,&IID_ID3D12CommandList, (void**)&g_pCopyList) != S_OK)
+		return false;
+	g_pCopyList->lpVtbl->SetName(g_pCopyList, L"imgui_copy_list");
+	g_pCopyList->lpVtbl->Close(g_pCopyList);
+
+	if (g_pd3dDevice->lpVtbl->CreateFence(g_pd3dDevice,0, D3D12_FENCE_FLAG_NONE, &IID_ID3D12Fence,(void**)&g_pCopyFence) != S_OK)
+		return false;
+	g_pCopyFence->lpVtbl->SetName(g_pCopyFence, L"imgui_copy_fence");
+	g_CopyFenceValue = 0;
+	return true;
+}
+
+static void ImGui_ImplDX12_DestroyCopyQueue(void)
+{
+	ImGui_ImplDX12_WaitForFontUpload();
+	if (g_pCopyList) { g_pCopyList->lpVtbl->Release(g_pCopyList); g_pCopyList = NULL; }
+	if (g_pCopyAllocator) { g_pCopyAllocator->lpVtbl->Release(g_pCopyAllocator); g_pCopyAllocator = NULL; }
+	if (g_pCopyQueue) { g_pCopyQueue->lpVtbl->Release(g_pCopyQueue); g_pCopyQueue = NULL; }
+	if (g_pCopyFence) { g_pCopyFence->lpVtbl->Release(g_pCopyFence); g_pCopyFence = NULL; }
+	g_CopyFenceValue = 0;
+}
+
+// RGBA32 atlas pixels to upload instead of ImFontAtlas_GetTexDataAsRGBA32(), for an atlas that was
+// restored without being built. Must stay valid until ImGui_ImplDX12_Shutdown(), NULL to go back.
+static void ImGui_ImplDX12_SetFontPixels(const unsigned char* pixels, int width, int height)
+{
+	g_pFontPixels = pixels;
+	g_FontWidth = width;
+	g_FontHeight = height;
+}
+
 static void ImGui_ImplDX12_CreateFontsTexture()
 {
 	// Build texture atlas
 	ImGuiIO* io = igGetIO();
-	unsigned char* pixels;
-	int width, height;
-	ImFontAtlas_GetTexDataAsRGBA32(io->Fonts,&pixels, &width, &height, NULL);
+	unsigned char* pixels = (unsigned char*)g_pFontPixels;
+	int width = g_FontWidth, height = g_FontHeight;
+	if (!pixels)
+		ImFontAtlas_GetTexDataAsRGBA32(io->Fonts,&pixels, &width, &height, NULL);
+
+	if (!g_pCopyQueue && !ImGui_ImplDX12_CreateCopyQueue())
+	{
+		ImGui_ImplDX12_DestroyCopyQueue();
+		return;
+	}
+	ImGui_ImplDX12_WaitForFontUpload();
 
 	// Upload texture to graphics system
 	{
@@ -274,9 +393,10 @@ static void ImGui_ImplDX12_CreateFontsTexture()
 		desc.Layout = D3D12_TEXTURE_LAYOUT_UNKNOWN;
 		desc.Flags = D3D12_RESOURCE_FLAG_NONE;
 
+		// COMMON so the copy queue and later the direct queue can promote it without barriers
 		ID3D12Resource* pTexture = NULL;
 		g_pd3dDevice->lpVtbl->CreateCommittedResource(g_pd3dDevice,&props, D3D12_HEAP_FLAG_NONE, &desc,
-				D3D12_RESOURCE_STATE_COPY_DEST, NULL, &IID_ID3D12Resource,(void**)&pTexture);
+				D3D12_RESOURCE_STATE_COMMON, NULL, &IID_ID3D12Resource,(void**)&pTexture);
 
 		pTexture->lpVtbl->SetName(pTexture, L"imgui_fonts_default_buffer");
 
@@ -325,55 +445,17 @@ static void ImGui_ImplDX12_CreateFontsTexture()
 		dstLocation.Type = D3D12_TEXTURE_COPY_TYPE_SUBRESOURCE_INDEX;
 		dstLocation.SubresourceIndex = 0;
 
-		D3D12_RESOURCE_BARRIER barrier ;
-		barrier.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION;
-		barrier.Flags = D3D12_RESOURCE_BARRIER_FLAG_NONE;
-		barrier.Transition.pResource   = pTexture;
-		barrier.Transition.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES;
-		barrier.Transition.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST;
-		barrier.Transition.StateAfter  = D3D12_RESOURCE_STATE_PIXEL_SHADER_RESOURCE;
-
-		ID3D12Fence* fence = NULL;
-		hr = g_pd3dDevice->lpVtbl->CreateFence(g_pd3dDevice,0, D3D12_FENCE_FLAG_NONE, &IID_ID3D12Fence,(void**)&fence);
-		fence->lpVtbl->SetName(fence, L"imgui_fence");
+		// No transition, copy queues cannot reach PIXEL_SHADER_RESOURCE and the decay to COMMON covers it
+		g_pCopyAllocator->lpVtbl->Reset(g_pCopyAllocator);
+		g_pCopyList->lpVtbl->Reset(g_pCopyList, g_pCopyAllocator, NULL);
+		g_pCopyList->lpVtbl->CopyTextureRegion(g_pCopyList,&dstLocation, 0, 0, 0, &srcLocation, NULL);
+		hr = g_pCopyList->lpVtbl->Close(g_pCopyList);
 
-		HANDLE event = CreateEvent(0, 0, 0, 0);
-
-		D3D12_COMMAND_QUEUE_DESC queueDesc ;
-		queueDesc.Priority = D3D12_COMMAND_QUEUE_PRIORITY_NORMAL;
-		queueDesc.Type     = D3D12_COMMAND_LIST_TYPE_DIRECT;
-		queueDesc.Flags    = D3D12_COMMAND_QUEUE_FLAG_NONE;
-		queueDesc.NodeMask = 1;
-
-		ID3D12CommandQueue* cmdQueue = NULL;
-		hr = g_pd3dDevice->lpVtbl->CreateCommandQueue(g_pd3dDevice,&queueDesc, &IID_ID3D12CommandQueue,(void**)&cmdQueue);
-		cmdQueue->lpVtbl->SetName(cmdQueue, L"imgui_cmd_queue");
-
-		ID3D12CommandAllocator* cmdAlloc = NULL;
-		hr = g_pd3dDevice->lpVtbl->CreateCommandAllocator(g_pd3dDevice,D3D12_COMMAND_LIST_TYPE_DIRECT, &IID_ID3D12CommandAllocator,(void**)&cmdAlloc);
-		cmdAlloc->lpVtbl->SetName(cmdAlloc, L"imgui_cmd_alloc");
-
-		ID3D12GraphicsCommandList* cmdList = NULL;
-		hr = g_pd3dDevice->lpVtbl->CreateCommandList(g_pd3dDevice,0, D3D12_COMMAND_LIST_TYPE_DIRECT, cmdAlloc, NULL,&IID_ID3D12CommandList, (void**)&cmdList);
-		cmdList->lpVtbl->SetName(cmdList, L"imgui_cmd_list");
-
-		cmdList->lpVtbl->CopyTextureRegion(cmdList,&dstLocation, 0, 0, 0, &srcLocation, NULL);
-		cmdList->lpVtbl->ResourceBarrier(cmdList,1, &barrier);
-
-		hr = cmdList->lpVtbl->Close(cmdList);
-
-		cmdQueue->lpVtbl->ExecuteCommandLists(cmdQueue,1, (ID3D12CommandList* const*) &cmdList);
-		hr = cmdQueue->lpVtbl->Signal(cmdQueue,fence, 1);
-
-		fence->lpVtbl->SetEventOnCompletion(fence,1, event);
-		WaitForSingleObject(event, INFINITE);
-
-		cmdList->lpVtbl->Release(cmdList);
-		cmdAlloc->lpVtbl->Release(cmdAlloc);
-		cmdQueue->lpVtbl->Release(cmdQueue);
-		CloseHandle(event);
-		fence->lpVtbl->Release(fence);
-		uploadBuffer->lpVtbl->Release(uploadBuffer);
+		g_pCopyQueue->lpVtbl->ExecuteCommandLists(g_pCopyQueue,1, (ID3D12CommandList* const*) &g_pCopyList);
+		hr = g_pCopyQueue->lpVtbl->Signal(g_pCopyQueue,g_pCopyFence, ++g_CopyFenceValue);
+		g_pFontUploadBuffer = uploadBuffer;
+		g_FontUploadBeginNs = time_now_ns();
+		g_FontUploadNs = 0;
 
 		// Create texture view
 		D3D12_SHADER_RESOURCE_VIEW_DESC srvDesc;
@@ -393,7 +475,7 @@ static void ImGui_ImplDX12_CreateFontsTexture()
 	}
 
 	// Store our identifier
-	io->Fonts->TexID = (ImTextureID)g_hFontSrvGpuDescHandle.ptr;
+	io->Fonts->TexID = (ImTextureID)(uintptr_t)g_fontSrvIndex;
 }
 
 bool    ImGui_ImplDX12_CreateDeviceObjects()
@@ -403,63 +485,11 @@ bool    ImGui_ImplDX12_CreateDeviceObjects()
 	if (g_pPipelineState)
 		ImGui_ImplDX12_InvalidateDeviceObjects();
 
-	// Create the root signature
-	{
-		D3D12_DESCRIPTOR_RANGE descRange ;
-		descRange.RangeType = D3D12_DESCRIPTOR_RANGE_TYPE_SRV;
-		descRange.NumDescriptors = 1;
-		descRange.BaseShaderRegister = 0;
-		descRange.RegisterSpace = 0;
-		descRange.OffsetInDescriptorsFromTableStart = 0;
-
-		D3D12_ROOT_PARAMETER param[2] ;
-
-		param[0].ParameterType = D3D12_ROOT_PARAMETER_TYPE_32BIT_CONSTANTS;
-		param[0].Constants.ShaderRegister = 0;
-		param[0].Constants.RegisterSpace = 0;
-		param[0].Constants.Num32BitValues = 16;
-		param[0].ShaderVisibility = D3D12_SHADER_VISIBILITY_VERTEX;
-
-		param[1].ParameterType = D3D12_ROOT_PARAMETER_TYPE_DESCRIPTOR_TABLE;
-		param[1].DescriptorTable.NumDescriptorRanges = 1;
-		param[1].DescriptorTable.pDescriptorRanges = &descRange;
-		param[1].ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
-
-		D3D12_STATIC_SAMPLER_DESC staticSampler ;
-		staticSampler.Filter = D3D12_FILTER_MIN_MAG_MIP_LINEAR;
-		staticSampler.AddressU = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-		staticSampler.AddressV = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-		staticSampler.AddressW = D3D12_TEXTURE_ADDRESS_MODE_WRAP;
-		staticSampler.MipLODBias = 0.f;
-		staticSampler.MaxAnisotropy = 0;
-		staticSampler.ComparisonFunc = D3D12_COMPARISON_FUNC_ALWAYS;
-		staticSampler.BorderColor = D3D12_STATIC_BORDER_COLOR_TRANSPARENT_BLACK;
-		staticSampler.MinLOD = 0.f;
-		staticSampler.MaxLOD = 0.f;
-		staticSampler.ShaderRegister = 0;
-		staticSampler.RegisterSpace = 0;
-		staticSampler.ShaderVisibility = D3D12_SHADER_VISIBILITY_PIXEL;
-
-		D3D12_ROOT_SIGNATURE_DESC desc ;
-		desc.NumParameters = _countof(param);
-		desc.pParameters = param;
-		desc.NumStaticSamplers = 1;
-		desc.pStaticSamplers = &staticSampler;
-		desc.Flags =
-			D3D12_ROOT_SIGNATURE_FLAG_ALLOW_INPUT_ASSEMBLER_INPUT_LAYOUT |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_HULL_SHADER_ROOT_ACCESS |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_DOMAIN_SHADER_ROOT_ACCESS |
-			D3D12_ROOT_SIGNATURE_FLAG_DENY_GEOMETRY_SHADER_ROOT_ACCESS;
-
-		ID3DBlob* blob = NULL;
-		if (D3D12SerializeRootSignature(&desc, D3D_ROOT_SIGNATURE_VERSION_1, &blob, NULL) != S_OK)
-			return false;
-
+	// The root signature is the application's bindless one, see ImGui_ImplDX12_Init()
+	if (!g_pRootSignature)
+		return false;
 
-		g_pd3dDevice->lpVtbl->CreateRootSignature(g_pd3dDevice,0, blob->lpVtbl->GetBufferPointer(blob), blob->lpVtbl->GetBufferSize(blob), &IID_ID3D12RootSignature,(void**)&g_pRootSignature);
-		g_pRootSignature->lpVtbl->SetName(g_pRootSignature, L"imgui_rootsig");
-		blob->lpVtbl->Release(blob);
-	}
+	UINT64 create_begin = time_now_ns();
 
 	// By using D3DCompile() from <d3dcompiler.h> / d3dcompiler.lib, we introduce a dependency to a given version of d3dcompiler_XX.dll (see D3DCOMPILER_DLL_A)
 	// If you would like to use this DX12 sample code but remove this dependency you can:
@@ -480,10 +510,15 @@ bool    ImGui_ImplDX12_CreateDeviceObjects()
 
 	// Create the vertex shader
 	{
+#if IMGUI_DX12_PRECOMPILED_SHADERS
+		psoDesc.VS.pShaderBytecode = imgui_vs_bytecode;
+		psoDesc.VS.BytecodeLength = sizeof(imgui_vs_bytecode);
+#else
 		static const char* vertexShader =
 			"cbuffer vertexBuffer : register(b0) \
 			{\
 				float4x4 ProjectionMatrix; \
+				uint texture_index; \
 			};\
 		struct VS_INPUT\
 		{\
@@ -508,7 +543,7 @@ bool    ImGui_ImplDX12_CreateDeviceObjects()
 					return output;\
 			}";
 
-		D3DCompile(vertexShader, strlen(vertexShader), NULL, NULL, NULL, "main", "vs_5_0", 0, 0, &g_pVertexShaderBlob, NULL);
+		D3DCompile(vertexShader, strlen(vertexShader), NULL, NULL, NULL, "main", "vs_5_1", 0, 0, &g_pVertexShaderBlob, NULL);
 		if (g_pVertexShaderBlob == NULL) // NB: Pass ID3D10Blob* pErrorBlob to D3DCompile() to get error showing in (const char*)pErrorBlob->GetBufferPointer(). Make sure to Release() the blob!
 			return false;
 		
@@ -516,6 +551,7 @@ bool    ImGui_ImplDX12_CreateDeviceObjects()
 		vs_bytecode.pShaderBytecode = g_pVertexShaderBlob->lpVtbl->GetBufferPointer(g_pVertexShaderBlob);
 		vs_bytecode.BytecodeLength = g_pVertexShaderBlob->lpVtbl->GetBufferSize(g_pVertexShaderBlob);
 		psoDesc.VS = vs_bytecode;
+#endif
 
 		// Create the input layout
 		static D3D12_INPUT_ELEMENT_DESC local_layout[] = {
@@ -531,6 +567,10 @@ bool    ImGui_ImplDX12_CreateDeviceObjects()
 
 	// Create the pixel shader
 	{
+#if IMGUI_DX12_PRECOMPILED_SHADERS
+		psoDesc.PS.pShaderBytecode = imgui_ps_bytecode;
+		psoDesc.PS.BytecodeLength = sizeof(imgui_ps_bytecode);
+#else
 		static const char* pixelShader =
 			"struct PS_INPUT\
 			{\
@@ -538,22 +578,28 @@ bool    ImGui_ImplDX12_CreateDeviceObjects()
 					float4 col : COLOR0;\
 					float2 uv  : TEXCOORD0;\
 			};\
+		cbuffer vertexBuffer : register(b0) \
+			{\
+				float4x4 ProjectionMatrix; \
+				uint texture_index; \
+			};\
 		SamplerState sampler0 : register(s0);\
-			Texture2D texture0 : register(t0);\
+			Texture2D textures[] : register(t0, space1);\
 			\
 			float4 main(PS_INPUT input) : SV_Target\
 			{\
-				float4 out_col = input.col * texture0.Sample(sampler0, input.uv); \
+				float4 out_col = input.col * textures[texture_index].Sample(sampler0, input.uv); \
 					return out_col; \
 			}";
 
-		D3DCompile(pixelShader, strlen(pixelShader), NULL, NULL, NULL, "main", "ps_5_0", 0, 0, &g_pPixelShaderBlob, NULL);
+		D3DCompile(pixelShader, strlen(pixelShader), NULL, NULL, NULL, "main", "ps_5_1", 0, 0, &g_pPixelShaderBlob, NULL);
 		if (g_pPixelShaderBlob == NULL)  // NB: Pass ID3D10Blob* pErrorBlob to D3DCompile() to get error showing in (const char*)pErrorBlob->GetBufferPointer(). Make sure to Release() the blob!
 			return false;
 		D3D12_SHADER_BYTECODE ps_bytecode;
 		ps_bytecode.pShaderBytecode = g_pPixelShaderBlob->lpVtbl->GetBufferPointer(g_pPixelShaderBlob);
 		ps_bytecode.BytecodeLength = g_pPixelShaderBlob->lpVtbl->GetBufferSize(g_pPixelShaderBlob);
 		psoDesc.PS = ps_bytecode;
+#endif
 	}
 
 	// Create the blending setup
@@ -604,6 +650,7 @@ bool    ImGui_ImplDX12_CreateDeviceObjects()
 
 	ImGui_ImplDX12_CreateFontsTexture();
 
+	g_CreateDeviceObjectsNs = time_now_ns() - create_begin;
 	return true;
 }
 
@@ -622,16 +669,12 @@ void    ImGui_ImplDX12_InvalidateDeviceObjects()
 		g_pPixelShaderBlob->lpVtbl->Release(g_pPixelShaderBlob);
 		g_pPixelShaderBlob = NULL;
 	}
-	if(g_pRootSignature)
-	{
-		g_pRootSignature->lpVtbl->Release(g_pRootSignature);
-		g_pRootSignature = NULL;
-	}
 	if(g_pPipelineState)
 	{
 		g_pPipelineState->lpVtbl->Release(g_pPipelineState);
 		g_pPipelineState = NULL;
 	}
+	ImGui_ImplDX12_WaitForFontUpload();
 	if(g_pFontTextureResource)
 	{
 		g_pFontTextureResource->lpVtbl->Release(g_pFontTextureResource);
@@ -640,25 +683,14 @@ void    ImGui_ImplDX12_InvalidateDeviceObjects()
 
 	ImGuiIO* io = igGetIO();
 	io->Fonts->TexID = NULL; // We copied g_pFontTextureView to io.Fonts->TexID so let's clear that as well.
-
-	for (UINT i = 0; i < g_numFramesInFlight; i++)
-	{
-		FrameResources* fr = &g_pFrameResources[i];
-		if(fr->IndexBuffer)
-		{
-			fr->IndexBuffer->lpVtbl->Release(fr->IndexBuffer);
-			fr->IndexBuffer = NULL;
-		}
-		if(fr->VertexBuffer)
-		{
-			fr->VertexBuffer->lpVtbl->Release(fr->VertexBuffer);
-			fr->VertexBuffer = NULL;
-		}
-	}
 }
 
-static bool ImGui_ImplDX12_Init(ID3D12Device* device, int num_frames_in_flight, DXGI_FORMAT rtv_format, ID3D12DescriptorHeap* cbv_srv_heap,
-		D3D12_CPU_DESCRIPTOR_HANDLE font_srv_cpu_desc_handle, D3D12_GPU_DESCRIPTOR_HANDLE font_srv_gpu_desc_handle)
+// root_signature and heap_gpu_start: the bindless root signature and the start of the heap bound to its table.
+// font_srv_cpu_desc_handle must be the heap slot at font_srv_index.
+// upload_ring: vertex/index data goes there, the application begins and ends its frames around the fence.
+static bool ImGui_ImplDX12_Init(ID3D12Device* device, struct upload_ring* upload_ring, DXGI_FORMAT rtv_format, ID3D12DescriptorHeap* cbv_srv_heap,
+		ID3D12RootSignature* root_signature, D3D12_GPU_DESCRIPTOR_HANDLE heap_gpu_start,
+		D3D12_CPU_DESCRIPTOR_HANDLE font_srv_cpu_desc_handle, UINT font_srv_index)
 {
 	// Setup back-end capabilities flags
 	ImGuiIO* io = igGetIO();
@@ -668,21 +700,12 @@ static bool ImGui_ImplDX12_Init(ID3D12Device* device, int num_frames_in_flight,
 	g_pd3dDevice = device;
 
 	g_RTVFormat = rtv_format;
+	g_pRootSignature = root_signature;
+	g_hHeapGpuStart = heap_gpu_start;
+	g_srvDescriptorSize = device->lpVtbl->GetDescriptorHandleIncrementSize(device, D3D12_DESCRIPTOR_HEAP_TYPE_CBV_SRV_UAV);
 	g_hFontSrvCpuDescHandle = font_srv_cpu_desc_handle;
-	g_hFontSrvGpuDescHandle = font_srv_gpu_desc_handle;
-	g_pFrameResources = (FrameResources*)malloc(sizeof(FrameResources ) * (UINT64)num_frames_in_flight);
-	g_numFramesInFlight = (UINT)num_frames_in_flight;
-	g_frameIndex = UINT_MAX;
-
-	// Create buffers with a default size (they will later be grown as needed)
-	for (int i = 0; i < num_frames_in_flight; i++)
-	{
-		FrameResources* fr = &g_pFrameResources[i];
-		fr->IndexBuffer = NULL;
-		fr->VertexBuffer = NULL;
-		fr->IndexBufferSize = 10000;
-		fr->VertexBufferSize = 5000;
-	}
+	g_fontSrvIndex = font_srv_index;
+	g_pUploadRing = upload_ring;
 
 	return true;
 }
@@ -690,13 +713,18 @@ static bool ImGui_ImplDX12_Init(ID3D12Device* device, int num_frames_in_flight,
 static void ImGui_ImplDX12_Shutdown()
 {
 	ImGui_ImplDX12_InvalidateDeviceObjects();
-	free(g_pFrameResources);
-	g_pFrameResources = NULL;
+	ImGui_ImplDX12_DestroyCopyQueue();
+	ImGui_ImplDX12_SetFontPixels(NULL, 0, 0);
+	free(g_pListOffsets);
+	g_pListOffsets = NULL;
+	ui_batches_free(&g_Batches);
+	g_ListOffsetsCapacity = 0;
+	g_pUploadRing = NULL;
 	g_pd3dDevice = NULL;
+	g_pRootSignature = NULL;
+	g_hHeapGpuStart.ptr = 0;
 	g_hFontSrvCpuDescHandle.ptr = 0;
-	g_hFontSrvGpuDescHandle.ptr = 0;
-	g_numFramesInFlight = 0;
-	g_frameIndex = UINT_MAX;
+	g_fontSrvIndex = 0;
 }
 
 static void ImGui_ImplDX12_NewFrame()
@@ -0,0 +1,31 @@
+// ImGui vertex and pixel shaders, compiled by build_debug.ps1 into bin\debug\generated\imgui_vs.h and imgui_ps.h.
+// imgui_impl_dx12.c falls back to compiling an identical copy at runtime when those headers are missing.
+#include "bindless.hlsli"
+
+struct vs_input
+{
+	float2 pos : POSITION;
+	float4 col : COLOR0;
+	float2 uv : TEXCOORD0;
+};
+
+struct ps_input
+{
+	float4 pos : SV_POSITION;
+	float4 col : COLOR0;
+	float2 uv : TEXCOORD0;
+};
+
+ps_input vs_main(vs_input input)
+{
+	ps_input output;
+	output.pos = mul(constants.transform, float4(input.pos.xy, 0.f, 1.f));
+	output.col = input.col;
+	output.uv = input.uv;
+	return output;
+}
+
+float4 ps_main(ps_input input) : SV_Target
+{
+	return input.col * textures[constants.texture_index].Sample(linear_wrap, input.uv);
+}
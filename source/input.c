@@ -0,0 +1,294 @@
+// Timestamped input and input-to-present latency.
+// Gamepads are polled on their own thread at ~1 kHz into an SPSC ring, so a button press is stamped
+// when it happens rather than when the next frame starts. Keyboard and mouse messages are stamped
+// by the window thread and arrive through wndproc. Each frame takes every sample since the previous
+// frame, the frame packet carries their timestamps to the render thread, and after Present each one
+// lands in a latency histogram. Percentiles are published once per window.
+// Requires threading.c, spsc_queue.c, arena.c.
+
+#if defined(_WIN32)
+#pragma comment(lib, "xinput")
+#pragma comment(lib, "winmm")
+#include <timeapi.h>
+#endif
+
+#define INPUT_GAMEPAD_COUNT 4
+#define INPUT_POLL_INTERVAL_MS 1
+#define INPUT_PROBE_INTERVAL_NS 1000000000ull // disconnected pads, XInputGetState on them is slow
+#define INPUT_RING_SIZE 4096
+#define INPUT_PENDING_MAX 1024
+#define INPUT_LATENCY_BUCKET_NS 100000ull // 0.1 ms
+#define INPUT_LATENCY_BUCKETS 2048        // last bucket collects everything above ~205 ms
+#define INPUT_LATENCY_WINDOW_NS 1000000000ull
+
+enum input_modifier
+{
+	INPUT_MODIFIER_CTRL = 1 << 0,
+	INPUT_MODIFIER_SHIFT = 1 << 1,
+	INPUT_MODIFIER_ALT = 1 << 2,
+};
+
+// same layout as XINPUT_GAMEPAD
+struct input_gamepad
+{
+	uint16_t buttons;
+	uint8_t left_trigger;
+	uint8_t right_trigger;
+	int16_t thumb_lx;
+	int16_t thumb_ly;
+	int16_t thumb_rx;
+	int16_t thumb_ry;
+};
+
+struct input_sample
+{
+	uint64_t timestamp_ns;
+	uint32_t port;
+	bool connected;
+	struct input_gamepad gamepad;
+};
+
+struct input_latency
+{
+	uint64_t p50_ns;
+	uint64_t p90_ns;
+	uint64_t p99_ns;
+	uint64_t max_ns;
+	uint32_t samples;
+	uint64_t dropped; // since startup, left out of the percentiles
+};
+
+static struct
+{
+	// poll thread -> frame
+	struct spsc_queue gamepad_samples;
+	thread_handle poll_thread;
+	_Atomic bool running;
+	_Atomic uint64_t poll_count;
+	_Atomic uint64_t dropped; // samples that never reached the histogram
+
+	// frame side
+	struct input_gamepad gamepads[INPUT_GAMEPAD_COUNT];
+	bool connected[INPUT_GAMEPAD_COUNT];
+	uint32_t modifiers;
+	uint64_t pending[INPUT_PENDING_MAX];
+	uint32_t pending_count;
+	uint32_t frame_samples;
+	uint64_t poll_rate_begin_ns;
+	uint64_t poll_rate_begin_count;
+	double poll_rate_hz;
+
+	// present side, owned by whichever thread renders
+	uint32_t histogram[INPUT_LATENCY_BUCKETS];
+	uint32_t histogram_count;
+	uint64_t histogram_max_ns;
+	uint64_t window_begin_ns;
+
+	// published once per window
+	_Atomic uint64_t p50_ns;
+	_Atomic uint64_t p90_ns;
+	_Atomic uint64_t p99_ns;
+	_Atomic uint64_t max_ns;
+	_Atomic uint32_t window_samples;
+} g_input;
+
+#if defined(_WIN32)
+static void input_poll_main(void* param)
+{
+	(void)param;
+	// Sleep(1) is only 1 ms with a 1 ms system timer period
+	timeBeginPeriod(1);
+
+	DWORD last_packet[INPUT_GAMEPAD_COUNT] = {0};
+	bool connected[INPUT_GAMEPAD_COUNT] = {0};
+	uint64_t next_probe[INPUT_GAMEPAD_COUNT] = {0};
+
+	while (atomic_load_explicit(&g_input.running, memory_order_acquire)) {
+		uint64_t now = time_now_ns();
+		for (uint32_t port = 0; port < INPUT_GAMEPAD_COUNT; ++port) {
+			if (!connected[port] && now < next_probe[port]) continue;
+
+			XINPUT_STATE state;
+			bool ok = XInputGetState(port, &state) == ERROR_SUCCESS;
+			if (!ok) {
+				next_probe[port] = now + INPUT_PROBE_INTERVAL_NS;
+				if (!connected[port]) continue;
+			} else if (connected[port] && state.dwPacketNumber == last_packet[port]) {
+				continue;
+			}
+
+			struct input_sample sample = {.timestamp_ns = now, .port = port, .connected = ok};
+			if (ok) {
+				memcpy(&sample.gamepad, &state.Gamepad, sizeof(sample.gamepad));
+				last_packet[port] = state.dwPacketNumber;
+			}
+			connected[port] = ok;
+			if (!spsc_queue_push(&g_input.gamepad_samples, &sample))
+				atomic_fetch_add_explicit(&g_input.dropped, 1, memory_order_relaxed);
+		}
+		atomic_fetch_add_explicit(&g_input.poll_count, 1, memory_order_relaxed);
+		thread_sleep_ms(INPUT_POLL_INTERVAL_MS);
+	}
+
+	timeEndPeriod(1);
+}
+#endif
+
+bool input_init(void)
+{
+	memset(&g_input, 0, sizeof(g_input));
+	if (!spsc_queue_init(&g_input.gamepad_samples, INPUT_RING_SIZE, sizeof(struct input_sample)))
+		return false;
+	g_input.poll_rate_begin_ns = g_input.window_begin_ns = time_now_ns();
+
+#if defined(_WIN32)
+	atomic_store(&g_input.running, true);
+	if (!thread_create(&g_input.poll_thread, input_poll_main, NULL)) {
+		atomic_store(&g_input.running, false);
+		return false;
+	}
+#endif
+	return true;
+}
+
+void input_shutdown(void)
+{
+	if (atomic_load(&g_input.running)) {
+		atomic_store(&g_input.running, false);
+		thread_join(g_input.poll_thread);
+	}
+	spsc_queue_destroy(&g_input.gamepad_samples);
+}
+
+static void input_add_pending(uint64_t timestamp_ns)
+{
+	if (g_input.pending_count < INPUT_PENDING_MAX)
+		g_input.pending[g_input.pending_count++] = timestamp_ns;
+	else
+		atomic_fetch_add_explicit(&g_input.dropped, 1, memory_order_relaxed);
+}
+
+// Frame thread, called from wndproc with the window thread's timestamp.
+void input_record_message(UINT msg, WPARAM wParam, uint64_t timestamp_ns)
+{
+	uint32_t modifier = 0;
+	switch (msg) {
+		case WM_KEYDOWN: case WM_SYSKEYDOWN:
+		case WM_KEYUP: case WM_SYSKEYUP:
+			if (wParam == VK_CONTROL) modifier = INPUT_MODIFIER_CTRL;
+			else if (wParam == VK_SHIFT) modifier = INPUT_MODIFIER_SHIFT;
+			else if (wParam == VK_MENU) modifier = INPUT_MODIFIER_ALT;
+			if (msg == WM_KEYDOWN || msg == WM_SYSKEYDOWN)
+				g_input.modifiers |= modifier;
+			else
+				g_input.modifiers &= ~modifier;
+			break;
+		case WM_KILLFOCUS:
+			// key ups go to whoever has focus now
+			g_input.modifiers = 0;
+			return;
+		default:
+			if ((msg < WM_KEYFIRST || msg > WM_KEYLAST) && (msg < WM_MOUSEFIRST || msg > WM_MOUSELAST))
+				return;
+			break;
+	}
+	input_add_pending(timestamp_ns);
+}
+
+// Frame thread, takes every gamepad sample since the last frame.
+void input_begin_frame(void)
+{
+	struct input_sample sample;
+	while (spsc_queue_pop(&g_input.gamepad_samples, &sample)) {
+		g_input.connected[sample.port] = sample.connected;
+		g_input.gamepads[sample.port] = sample.gamepad;
+		input_add_pending(sample.timestamp_ns);
+	}
+
+	uint64_t now = time_now_ns();
+	if (now - g_input.poll_rate_begin_ns >= INPUT_LATENCY_WINDOW_NS) {
+		uint64_t count = atomic_load_explicit(&g_input.poll_count, memory_order_relaxed);
+		g_input.poll_rate_hz = (double)(count - g_input.poll_rate_begin_count) * 1e9 / (double)(now - g_input.poll_rate_begin_ns);
+		g_input.poll_rate_begin_count = count;
+		g_input.poll_rate_begin_ns = now;
+	}
+}
+
+// Frame thread. Modifiers come from the stamped key events instead of GetKeyState at frame start.
+void input_apply_imgui(ImGuiIO* io)
+{
+	io->KeyCtrl = (g_input.modifiers & INPUT_MODIFIER_CTRL) != 0;
+	io->KeyShift = (g_input.modifiers & INPUT_MODIFIER_SHIFT) != 0;
+	io->KeyAlt = (g_input.modifiers & INPUT_MODIFIER_ALT) != 0;
+}
+
+// Frame thread. Moves the pending timestamps into the frame packet arena and starts a new frame.
+// The arena must have room for input_frame_bytes(), samples that do not fit count as dropped.
+uint32_t input_end_frame(struct arena* arena, uint64_t** timestamps)
+{
+	uint32_t count = g_input.pending_count;
+	*timestamps = count ? arena_push(arena, count * sizeof(uint64_t), 8) : NULL;
+	if (count && !*timestamps) {
+		atomic_fetch_add_explicit(&g_input.dropped, count, memory_order_relaxed);
+		count = 0;
+	}
+	if (count) memcpy(*timestamps, g_input.pending, count * sizeof(uint64_t));
+	g_input.frame_samples = count;
+	g_input.pending_count = 0;
+	return count;
+}
+
+// Frame thread. What input_end_frame() pushes into the packet arena, alignment included.
+size_t input_frame_bytes(void)
+{
+	return g_input.pending_count ? g_input.pending_count * sizeof(uint64_t) + 8 : 0;
+}
+
+static uint64_t input_histogram_percentile(uint32_t rank)
+{
+	uint32_t sum = 0;
+	for (uint32_t i = 0; i < INPUT_LATENCY_BUCKETS; ++i) {
+		sum += g_input.histogram[i];
+		if (sum >= rank) return (uint64_t)(i + 1) * INPUT_LATENCY_BUCKET_NS;
+	}
+	return g_input.histogram_max_ns;
+}
+
+// Render side, right after Present returned for the frame that consumed these samples.
+void input_record_present(const uint64_t* timestamps, uint32_t count, uint64_t present_ns)
+{
+	for (uint32_t i = 0; i < count; ++i) {
+		uint64_t latency = present_ns > timestamps[i] ? present_ns - timestamps[i] : 0;
+		uint64_t bucket = latency / INPUT_LATENCY_BUCKET_NS;
+		g_input.histogram[bucket < INPUT_LATENCY_BUCKETS ? bucket : INPUT_LATENCY_BUCKETS - 1]++;
+		g_input.histogram_count++;
+		if (latency > g_input.histogram_max_ns) g_input.histogram_max_ns = latency;
+	}
+
+	if (present_ns - g_input.window_begin_ns < INPUT_LATENCY_WINDOW_NS) return;
+	g_input.window_begin_ns = present_ns;
+
+	uint32_t n = g_input.histogram_count;
+	if (n) {
+		atomic_store_explicit(&g_input.p50_ns, input_histogram_percentile((n * 50 + 99) / 100), memory_order_relaxed);
+		atomic_store_explicit(&g_input.p90_ns, input_histogram_percentile((n * 90 + 99) / 100), memory_order_relaxed);
+		atomic_store_explicit(&g_input.p99_ns, input_histogram_percentile((n * 99 + 99) / 100), memory_order_relaxed);
+		atomic_store_explicit(&g_input.max_ns, g_input.histogram_max_ns, memory_order_relaxed);
+	}
+	atomic_store_explicit(&g_input.window_samples, n, memory_order_relaxed);
+	memset(g_input.histogram, 0, sizeof(g_input.histogram));
+	g_input.histogram_count = 0;
+	g_input.histogram_max_ns = 0;
+}
+
+struct input_latency input_latency_stats(void)
+{
+	return (struct input_latency){
+		.p50_ns = atomic_load_explicit(&g_input.p50_ns, memory_order_relaxed),
+		.p90_ns = atomic_load_explicit(&g_input.p90_ns, memory_order_relaxed),
+		.p99_ns = atomic_load_explicit(&g_input.p99_ns, memory_order_relaxed),
+		.max_ns = atomic_load_explicit(&g_input.max_ns, memory_order_relaxed),
+		.samples = atomic_load_explicit(&g_input.window_samples, memory_order_relaxed),
+		.dropped = atomic_load_explicit(&g_input.dropped, memory_order_relaxed),
+	};
+}
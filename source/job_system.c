@@ -0,0 +1,410 @@
+// Work-stealing job system.
+// One worker thread per core, pinned. The thread calling job_system_init() becomes worker 0,
+// other threads (render, input...) call job_register_thread() to get a deque of their own.
+// Each thread owns a Chase-Lev deque: the owner pushes/pops at the bottom, thieves steal at the top.
+// Jobs come from a lock-free pool and decrement a counter when they retire; waiting on a counter
+// runs other jobs instead of blocking, so the main thread helps rather than sleeps.
+// Requires threading.c.
+
+#include <assert.h>
+#include <string.h>
+
+#define JOB_MAX_THREADS 64
+#define JOB_POOL_SIZE 16384
+#define JOB_DEQUE_SIZE 4096 // per thread, power of two
+#define JOB_SPIN_ROUNDS 64  // failed steal rounds before a worker goes to sleep
+#define JOB_SLEEP_MS 2
+
+typedef void (*job_function)(void* data, uint32_t begin, uint32_t end);
+
+struct job_counter
+{
+	_Atomic int32_t value;
+	_Atomic(struct job*) continuation;
+};
+
+struct job
+{
+	job_function function;
+	void* data;
+	uint32_t begin;
+	uint32_t end;
+	struct job_counter* counter;
+	_Atomic uint32_t next_free;
+};
+
+struct job_decl
+{
+	job_function function;
+	void* data;
+	uint32_t begin;
+	uint32_t end;
+};
+
+struct job_deque
+{
+	_Alignas(64) _Atomic int64_t top;
+	_Alignas(64) _Atomic int64_t bottom;
+	_Alignas(64) _Atomic(struct job*) entries[JOB_DEQUE_SIZE];
+};
+
+struct job_worker_stats
+{
+	_Alignas(64) _Atomic uint64_t busy_ns;
+	_Atomic uint64_t idle_ns;
+	_Atomic uint64_t executed;
+	_Atomic uint64_t steals;
+	_Atomic uint64_t steal_attempts;
+};
+
+static struct
+{
+	uint32_t worker_count; // includes worker 0, the init thread
+	_Atomic uint32_t thread_count; // workers + registered threads
+	_Atomic bool running;
+	_Atomic uint32_t sleeping;
+	semaphore_handle wake;
+	thread_handle threads[JOB_MAX_THREADS];
+	struct job_deque deques[JOB_MAX_THREADS];
+	struct job_worker_stats stats[JOB_MAX_THREADS];
+	struct job pool[JOB_POOL_SIZE];
+	_Atomic uint64_t pool_head; // high 32 bits: ABA tag, low 32 bits: index + 1 (0 = empty)
+} g_jobs;
+
+static _Thread_local int32_t t_job_thread_index = -1;
+
+bool job_system_init(uint32_t worker_count);
+void job_system_shutdown(void);
+bool job_register_thread(void);
+void job_run(const struct job_decl* decls, uint32_t count, struct job_counter* counter);
+void job_wait(struct job_counter* counter);
+void job_counter_set_continuation(struct job_counter* counter, struct job_decl continuation, struct job_counter* continuation_counter);
+void job_parallel_for(uint32_t count, uint32_t grain, job_function function, void* data);
+uint32_t job_thread_count(void);
+
+// lock-free pool
+
+static struct job* job_alloc(void)
+{
+	uint64_t head = atomic_load_explicit(&g_jobs.pool_head, memory_order_acquire);
+	for (;;) {
+		uint32_t index = (uint32_t)head;
+		if (index == 0) return NULL;
+		struct job* job = &g_jobs.pool[index - 1];
+		uint32_t next = atomic_load_explicit(&job->next_free, memory_order_relaxed);
+		uint64_t new_head = ((head >> 32) + 1) << 32 | next;
+		if (atomic_compare_exchange_weak_explicit(&g_jobs.pool_head, &head, new_head, memory_order_acquire, memory_order_acquire))
+			return job;
+	}
+}
+
+static void job_free(struct job* job)
+{
+	uint32_t index = (uint32_t)(job - g_jobs.pool) + 1;
+	uint64_t head = atomic_load_explicit(&g_jobs.pool_head, memory_order_relaxed);
+	for (;;) {
+		atomic_store_explicit(&job->next_free, (uint32_t)head, memory_order_relaxed);
+		uint64_t new_head = ((head >> 32) + 1) << 32 | index;
+		if (atomic_compare_exchange_weak_explicit(&g_jobs.pool_head, &head, new_head, memory_order_release, memory_order_relaxed))
+			return;
+	}
+}
+
+// Chase-Lev deque, C11 formulation from Le et al. "Correct and Efficient Work-Stealing for Weak Memory Models"
+
+static bool job_deque_push(struct job_deque* deque, struct job* job)
+{
+	int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed);
+	int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	if (bottom - top >= JOB_DEQUE_SIZE) return false;
+	atomic_store_explicit(&deque->entries[bottom & (JOB_DEQUE_SIZE - 1)], job, memory_order_relaxed);
+	atomic_thread_fence(memory_order_release);
+	atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	return true;
+}
+
+static struct job* job_deque_pop(struct job_deque* deque)
+{
+	int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_relaxed) - 1;
+	atomic_store_explicit(&deque->bottom, bottom, memory_order_relaxed);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t top = atomic_load_explicit(&deque->top, memory_order_relaxed);
+
+	if (top > bottom) {
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+		return NULL;
+	}
+
+	struct job* job = atomic_load_explicit(&deque->entries[bottom & (JOB_DEQUE_SIZE - 1)], memory_order_relaxed);
+	if (top == bottom) {
+		// last entry, race against thieves
+		if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+			job = NULL;
+		atomic_store_explicit(&deque->bottom, bottom + 1, memory_order_relaxed);
+	}
+	return job;
+}
+
+static struct job* job_deque_steal(struct job_deque* deque)
+{
+	int64_t top = atomic_load_explicit(&deque->top, memory_order_acquire);
+	atomic_thread_fence(memory_order_seq_cst);
+	int64_t bottom = atomic_load_explicit(&deque->bottom, memory_order_acquire);
+	if (top >= bottom) return NULL;
+
+	struct job* job = atomic_load_explicit(&deque->entries[top & (JOB_DEQUE_SIZE - 1)], memory_order_relaxed);
+	if (!atomic_compare_exchange_strong_explicit(&deque->top, &top, top + 1, memory_order_seq_cst, memory_order_relaxed))
+		return NULL;
+	return job;
+}
+
+// scheduling
+
+static uint32_t job_random(uint32_t* state)
+{
+	// xorshift32, per thread state, only used to pick steal victims
+	uint32_t x = *state;
+	x ^= x << 13;
+	x ^= x >> 17;
+	x ^= x << 5;
+	*state = x;
+	return x;
+}
+
+static struct job* job_find(uint32_t thread_index, uint32_t* random_state)
+{
+	struct job* job = job_deque_pop(&g_jobs.deques[thread_index]);
+	if (job) return job;
+
+	uint32_t thread_count = atomic_load_explicit(&g_jobs.thread_count, memory_order_acquire);
+	if (thread_count < 2) return NULL;
+
+	struct job_worker_stats* stats = &g_jobs.stats[thread_index];
+	uint32_t start = job_random(random_state) % thread_count;
+	for (uint32_t i = 0; i < thread_count; ++i) {
+		uint32_t victim = (start + i) % thread_count;
+		if (victim == thread_index) continue;
+		atomic_fetch_add_explicit(&stats->steal_attempts, 1, memory_order_relaxed);
+		job = job_deque_steal(&g_jobs.deques[victim]);
+		if (job) {
+			atomic_fetch_add_explicit(&stats->steals, 1, memory_order_relaxed);
+			return job;
+		}
+	}
+	return NULL;
+}
+
+static void job_push(struct job* job);
+
+static void job_counter_retire(struct job_counter* counter)
+{
+	// The continuation is immutable while jobs are in flight, read it before we give up the counter.
+	struct job* continuation = atomic_load_explicit(&counter->continuation, memory_order_acquire);
+	if (atomic_fetch_sub_explicit(&counter->value, 1, memory_order_acq_rel) == 1 && continuation) {
+		atomic_store_explicit(&counter->continuation, NULL, memory_order_relaxed);
+		job_push(continuation);
+	}
+}
+
+static void job_execute(struct job* job, uint32_t thread_index)
+{
+	struct job_worker_stats* stats = &g_jobs.stats[thread_index];
+	uint64_t start = time_now_ns();
+	job->function(job->data, job->begin, job->end);
+	atomic_fetch_add_explicit(&stats->busy_ns, time_now_ns() - start, memory_order_relaxed);
+	atomic_fetch_add_explicit(&stats->executed, 1, memory_order_relaxed);
+
+	struct job_counter* counter = job->counter;
+	job_free(job);
+	if (counter) job_counter_retire(counter);
+}
+
+// Runs one pending job on the calling thread, returns false when nothing could be found.
+static bool job_help(void)
+{
+	static _Thread_local uint32_t random_state = 0;
+	if (random_state == 0) random_state = 0x9E3779B9u ^ (uint32_t)(t_job_thread_index + 1) * 0x85EBCA6Bu;
+
+	struct job* job = job_find((uint32_t)t_job_thread_index, &random_state);
+	if (!job) return false;
+	job_execute(job, (uint32_t)t_job_thread_index);
+	return true;
+}
+
+static void job_push(struct job* job)
+{
+	assert(t_job_thread_index >= 0 && "job submitted from a thread unknown to the job system");
+	while (!job_deque_push(&g_jobs.deques[t_job_thread_index], job)) {
+		// own deque is full, drain some of it ourselves
+		job_help();
+	}
+	if (atomic_load_explicit(&g_jobs.sleeping, memory_order_acquire) > 0)
+		semaphore_post(&g_jobs.wake, 1);
+}
+
+static struct job* job_make(job_function function, void* data, uint32_t begin, uint32_t end, struct job_counter* counter)
+{
+	struct job* job = job_alloc();
+	while (!job) {
+		// pool exhausted, retire work until a slot frees up
+		if (!job_help()) thread_pause();
+		job = job_alloc();
+	}
+	job->function = function;
+	job->data = data;
+	job->begin = begin;
+	job->end = end;
+	job->counter = counter;
+	return job;
+}
+
+static void job_worker_main(void* param)
+{
+	uint32_t thread_index = (uint32_t)(uintptr_t)param;
+	t_job_thread_index = (int32_t)thread_index;
+	struct job_worker_stats* stats = &g_jobs.stats[thread_index];
+	uint32_t failed_rounds = 0;
+
+	while (atomic_load_explicit(&g_jobs.running, memory_order_acquire)) {
+		if (job_help()) {
+			failed_rounds = 0;
+			continue;
+		}
+
+		uint64_t idle_start = time_now_ns();
+		if (++failed_rounds < JOB_SPIN_ROUNDS) {
+			thread_pause();
+		} else {
+			atomic_fetch_add_explicit(&g_jobs.sleeping, 1, memory_order_acq_rel);
+			semaphore_wait(&g_jobs.wake, JOB_SLEEP_MS);
+			atomic_fetch_sub_explicit(&g_jobs.sleeping, 1, memory_order_acq_rel);
+			failed_rounds = 0;
+		}
+		atomic_fetch_add_explicit(&stats->idle_ns, time_now_ns() - idle_start, memory_order_relaxed);
+	}
+}
+
+// public interface
+
+// worker_count = 0 picks one worker per core, the calling thread included
+bool job_system_init(uint32_t worker_count)
+{
+	if (worker_count == 0) worker_count = thread_core_count();
+	if (worker_count > JOB_MAX_THREADS / 2) worker_count = JOB_MAX_THREADS / 2;
+
+	memset(&g_jobs.stats, 0, sizeof(g_jobs.stats));
+	for (uint32_t i = 0; i < JOB_MAX_THREADS; ++i) {
+		atomic_store(&g_jobs.deques[i].top, 0);
+		atomic_store(&g_jobs.deques[i].bottom, 0);
+	}
+	for (uint32_t i = 0; i < JOB_POOL_SIZE; ++i)
+		atomic_store(&g_jobs.pool[i].next_free, i + 2 <= JOB_POOL_SIZE ? i + 2 : 0);
+	atomic_store(&g_jobs.pool_head, 1);
+
+	if (!semaphore_create(&g_jobs.wake, 0)) return false;
+
+	g_jobs.worker_count = worker_count;
+	atomic_store(&g_jobs.thread_count, worker_count);
+	atomic_store(&g_jobs.sleeping, 0);
+	atomic_store(&g_jobs.running, true);
+	t_job_thread_index = 0;
+
+	for (uint32_t i = 1; i < worker_count; ++i) {
+		if (!thread_create(&g_jobs.threads[i], job_worker_main, (void*)(uintptr_t)i)) {
+			g_jobs.worker_count = i;
+			atomic_store(&g_jobs.thread_count, i);
+			break;
+		}
+		thread_set_affinity(g_jobs.threads[i], i);
+	}
+	return true;
+}
+
+void job_system_shutdown(void)
+{
+	// finish whatever is still queued, then stop the workers
+	while (job_help()) {}
+	atomic_store(&g_jobs.running, false);
+	semaphore_post(&g_jobs.wake, g_jobs.worker_count);
+	for (uint32_t i = 1; i < g_jobs.worker_count; ++i)
+		thread_join(g_jobs.threads[i]);
+	semaphore_destroy(&g_jobs.wake);
+	g_jobs.worker_count = 0;
+	atomic_store(&g_jobs.thread_count, 0);
+	t_job_thread_index = -1;
+}
+
+// Gives a non-worker thread its own deque so it can submit and wait on jobs.
+bool job_register_thread(void)
+{
+	if (t_job_thread_index >= 0) return true;
+	uint32_t index = atomic_load(&g_jobs.thread_count);
+	do {
+		if (index >= JOB_MAX_THREADS) return false;
+	} while (!atomic_compare_exchange_weak(&g_jobs.thread_count, &index, index + 1));
+	t_job_thread_index = (int32_t)index;
+	return true;
+}
+
+uint32_t job_thread_count(void)
+{
+	return atomic_load_explicit(&g_jobs.thread_count, memory_order_relaxed);
+}
+
+void job_run(const struct job_decl* decls, uint32_t count, struct job_counter* counter)
+{
+	if (counter) atomic_fetch_add_explicit(&counter->value, (int32_t)count, memory_order_relaxed);
+	for (uint32_t i = 0; i < count; ++i)
+		job_push(job_make(decls[i].function, decls[i].data, decls[i].begin, decls[i].end, counter));
+}
+
+// Executes other jobs until the counter drops to zero, never blocks.
+void job_wait(struct job_counter* counter)
+{
+	uint32_t failed_rounds = 0;
+	while (atomic_load_explicit(&counter->value, memory_order_acquire) > 0) {
+		if (job_help()) {
+			failed_rounds = 0;
+		} else if (++failed_rounds < JOB_SPIN_ROUNDS) {
+			thread_pause();
+		} else {
+			thread_yield();
+		}
+	}
+}
+
+// The continuation is pushed by whichever thread retires the counter's last job.
+// Must be set before jobs are run on the counter; wait on continuation_counter, not on counter.
+void job_counter_set_continuation(struct job_counter* counter, struct job_decl continuation, struct job_counter* continuation_counter)
+{
+	if (continuation_counter) atomic_fetch_add_explicit(&continuation_counter->value, 1, memory_order_relaxed);
+	struct job* job = job_make(continuation.function, continuation.data, continuation.begin, continuation.end, continuation_counter);
+	atomic_store_explicit(&counter->continuation, job, memory_order_release);
+}
+
+// Splits [0, count) into ranges of `grain` items, grain = 0 aims for four ranges per thread.
+void job_parallel_for(uint32_t count, uint32_t grain, job_function function, void* data)
+{
+	if (count == 0) return;
+	uint32_t thread_count = job_thread_count();
+	if (grain == 0) {
+		uint32_t ranges = (thread_count > 0 ? thread_count : 1) * 4;
+		grain = (count + ranges - 1) / ranges;
+	}
+	if (count <= grain || thread_count < 2 || t_job_thread_index < 0) {
+		function(data, 0, count);
+		return;
+	}
+
+	struct job_counter counter = {0};
+	uint32_t range_count = (count + grain - 1) / grain;
+	atomic_fetch_add_explicit(&counter.value, (int32_t)range_count, memory_order_relaxed);
+	// push all but the first range, the caller runs that one right away
+	for (uint32_t begin = grain; begin < count; begin += grain) {
+		uint32_t end = begin + grain < count ? begin + grain : count;
+		job_push(job_make(function, data, begin, end, &counter));
+	}
+	function(data, 0, grain);
+	atomic_fetch_sub_explicit(&counter.value, 1, memory_order_acq_rel);
+	job_wait(&counter);
+}
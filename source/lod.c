@@ -0,0 +1,321 @@
+// Level of detail selection.
+// A mesh's levels are consecutive mesh ids, finest first, each with the distance of its surface
+// from the full one relative to the bounding radius, which tools/mesh_cooker.c measures. An error
+// e of an object with bounding sphere radius r, centered at clip space w (1 when orthographic),
+// covers e * r * pixels_per_unit / w pixels on screen, pixels_per_unit the projection's y scale
+// times half the viewport height. lod_select() picks per object the coarsest level that stays
+// within max_pixels: its level is the number of levels whose limit, max_pixels over their error,
+// its r * pixels_per_unit / w is under. The objects are culling's bounds, the radius their sphere's.
+// Like cull_run() it splits them into chunks on the job system and every chunk selects with the
+// widest kernel the CPU has (AVX2 8, SSE 4 objects per iteration), counting the triangles of the
+// picked levels and the projected errors for the stats.
+// Requires vecmath.c, job_system.c, cull.c.
+
+#define LOD_MAX_LEVELS 8
+#define LOD_CHUNK 16384     // objects per job at least
+#define LOD_MAX_CHUNKS 256  // larger inputs get larger chunks
+#define LOD_MIN_W 1e-6f     // centers nearer than this, or behind the eye, get the full mesh
+
+struct lod_chain
+{
+	uint32_t key; // of the full level, a level adds to it
+	uint32_t count;
+	float errors[LOD_MAX_LEVELS]; // over the bounding radius, ascending, the full level's 0
+	uint32_t triangles[LOD_MAX_LEVELS];
+};
+
+struct lod_view
+{
+	struct vec4 w_row; // clip space w of a world position
+	float pixels_per_unit;
+	float max_pixels;
+};
+
+struct lod_stats
+{
+	uint32_t objects;
+	uint32_t levels[LOD_MAX_LEVELS]; // objects per level
+	uint64_t triangles;              // of the picked levels
+	uint64_t full_triangles;         // had every object drawn the full level
+	float max_pixels;                // largest projected error of a picked level
+	double sum_pixels;
+};
+
+struct lod_view lod_view_from_matrix(const struct mat4* view_projection, float viewport_height, float max_pixels)
+{
+	const struct vec4* c = view_projection->columns;
+	struct vec3 y_row = vec3_make(c[0].y, c[1].y, c[2].y);
+	return (struct lod_view){
+		.w_row = {c[0].w, c[1].w, c[2].w, c[3].w},
+		.pixels_per_unit = vec3_length(y_row) * viewport_height * 0.5f,
+		.max_pixels = max_pixels,
+	};
+}
+
+struct lod_job
+{
+	const struct cull_bounds* bounds;
+	uint32_t first;
+	const uint32_t* objects;
+	const struct lod_view* view;
+	const struct lod_chain* chain;
+	float limits[LOD_MAX_LEVELS]; // r * pixels_per_unit / w at most, for a level to be picked
+	uint32_t* keys;
+	uint32_t chunk_size;
+	uint32_t count;
+	struct lod_stats stats[LOD_MAX_CHUNKS];
+};
+
+// The reference every kernel has to match.
+static void lod_range_scalar(const struct lod_job* job, uint32_t begin, uint32_t end, struct lod_stats* stats)
+{
+	const struct cull_bounds* bounds = job->bounds;
+	const struct lod_chain* chain = job->chain;
+	struct vec4 row = job->view->w_row;
+	float pixels_per_unit = job->view->pixels_per_unit;
+	uint32_t level_count = chain->count;
+	uint32_t levels[LOD_MAX_LEVELS] = {0};
+	float max_pixels = 0.0f;
+	double sum_pixels = 0.0;
+	for (uint32_t i = begin; i < end; ++i) {
+		uint32_t object = job->objects ? job->objects[i] : i;
+		uint32_t o = job->first + object;
+		float w = row.x * bounds->center[0][o] + row.y * bounds->center[1][o] + row.z * bounds->center[2][o] + row.w;
+		float scale = bounds->radius[o] * pixels_per_unit / fmaxf(w, LOD_MIN_W);
+		uint32_t level = 0;
+		for (uint32_t l = 1; l < level_count; ++l) level += scale <= job->limits[l];
+		job->keys[object] = chain->key + level;
+		float pixels = chain->errors[level] * scale;
+		levels[level]++;
+		max_pixels = fmaxf(max_pixels, pixels);
+		sum_pixels += pixels;
+	}
+	for (uint32_t l = 0; l < level_count; ++l) stats->levels[l] += levels[l];
+	stats->max_pixels = fmaxf(stats->max_pixels, max_pixels);
+	stats->sum_pixels += sum_pixels;
+}
+
+#if VECMATH_SSE
+static void lod_range_sse(const struct lod_job* job, uint32_t begin, uint32_t end, struct lod_stats* stats)
+{
+	const struct cull_bounds* bounds = job->bounds;
+	const struct lod_chain* chain = job->chain;
+	struct vec4 row = job->view->w_row;
+	__m128 rx = _mm_set1_ps(row.x), ry = _mm_set1_ps(row.y), rz = _mm_set1_ps(row.z), rw = _mm_set1_ps(row.w);
+	__m128 pixels_per_unit = _mm_set1_ps(job->view->pixels_per_unit);
+	__m128 min_w = _mm_set1_ps(LOD_MIN_W);
+	__m128 max_pixels = _mm_setzero_ps();
+	__m128 sum_pixels = _mm_setzero_ps();
+	uint32_t level_count = chain->count;
+	__m128 limits[LOD_MAX_LEVELS], errors[LOD_MAX_LEVELS];
+	__m128i at_least[LOD_MAX_LEVELS]; // objects at level l or coarser, per lane
+	for (uint32_t l = 0; l < level_count; ++l) {
+		limits[l] = _mm_set1_ps(job->limits[l]);
+		errors[l] = _mm_set1_ps(chain->errors[l]);
+		at_least[l] = _mm_setzero_si128();
+	}
+	uint32_t i = begin;
+	for (; i + 4 <= end; i += 4) {
+		__m128 cx, cy, cz, r;
+		if (job->objects) {
+			const uint32_t* objects = job->objects + i;
+			uint32_t o[4] = {job->first + objects[0], job->first + objects[1], job->first + objects[2], job->first + objects[3]};
+			cx = _mm_setr_ps(bounds->center[0][o[0]], bounds->center[0][o[1]], bounds->center[0][o[2]], bounds->center[0][o[3]]);
+			cy = _mm_setr_ps(bounds->center[1][o[0]], bounds->center[1][o[1]], bounds->center[1][o[2]], bounds->center[1][o[3]]);
+			cz = _mm_setr_ps(bounds->center[2][o[0]], bounds->center[2][o[1]], bounds->center[2][o[2]], bounds->center[2][o[3]]);
+			r = _mm_setr_ps(bounds->radius[o[0]], bounds->radius[o[1]], bounds->radius[o[2]], bounds->radius[o[3]]);
+		} else {
+			uint32_t o = job->first + i;
+			cx = _mm_loadu_ps(bounds->center[0] + o);
+			cy = _mm_loadu_ps(bounds->center[1] + o);
+			cz = _mm_loadu_ps(bounds->center[2] + o);
+			r = _mm_loadu_ps(bounds->radius + o);
+		}
+		__m128 w = _mm_add_ps(_mm_add_ps(_mm_mul_ps(rx, cx), _mm_mul_ps(ry, cy)), _mm_add_ps(_mm_mul_ps(rz, cz), rw));
+		__m128 scale = _mm_div_ps(_mm_mul_ps(r, pixels_per_unit), _mm_max_ps(w, min_w));
+		// the masks nest, level l's is within level l - 1's: the last one set is the object's level
+		__m128i level = _mm_setzero_si128();
+		__m128 error = _mm_setzero_ps();
+		for (uint32_t l = 1; l < level_count; ++l) {
+			__m128 picked = _mm_cmple_ps(scale, limits[l]);
+			level = _mm_sub_epi32(level, _mm_castps_si128(picked));
+			error = _mm_or_ps(_mm_and_ps(picked, errors[l]), _mm_andnot_ps(picked, error));
+			at_least[l] = _mm_sub_epi32(at_least[l], _mm_castps_si128(picked));
+		}
+		__m128 pixels = _mm_mul_ps(error, scale);
+		max_pixels = _mm_max_ps(max_pixels, pixels);
+		sum_pixels = _mm_add_ps(sum_pixels, pixels);
+		__m128i keys = _mm_add_epi32(level, _mm_set1_epi32((int)chain->key));
+		if (job->objects) {
+			uint32_t lanes[4];
+			_mm_storeu_si128((__m128i*)lanes, keys);
+			for (uint32_t k = 0; k < 4; ++k) job->keys[job->objects[i + k]] = lanes[k];
+		} else {
+			_mm_storeu_si128((__m128i*)(job->keys + i), keys);
+		}
+	}
+	float lanes[4];
+	_mm_storeu_ps(lanes, max_pixels);
+	for (uint32_t k = 0; k < 4; ++k) stats->max_pixels = fmaxf(stats->max_pixels, lanes[k]);
+	_mm_storeu_ps(lanes, sum_pixels);
+	for (uint32_t k = 0; k < 4; ++k) stats->sum_pixels += lanes[k];
+	uint32_t counts[LOD_MAX_LEVELS + 1] = {i - begin};
+	for (uint32_t l = 1; l < level_count; ++l) {
+		uint32_t lane_counts[4];
+		_mm_storeu_si128((__m128i*)lane_counts, at_least[l]);
+		counts[l] = lane_counts[0] + lane_counts[1] + lane_counts[2] + lane_counts[3];
+	}
+	for (uint32_t l = 0; l < level_count; ++l) stats->levels[l] += counts[l] - counts[l + 1];
+	lod_range_scalar(job, i, end, stats);
+}
+#endif
+
+#if VECMATH_AVX2
+VECMATH_TARGET_AVX2 static void lod_range_avx2(const struct lod_job* job, uint32_t begin, uint32_t end, struct lod_stats* stats)
+{
+	const struct cull_bounds* bounds = job->bounds;
+	const struct lod_chain* chain = job->chain;
+	struct vec4 row = job->view->w_row;
+	__m256 rx = _mm256_set1_ps(row.x), ry = _mm256_set1_ps(row.y), rz = _mm256_set1_ps(row.z), rw = _mm256_set1_ps(row.w);
+	__m256 pixels_per_unit = _mm256_set1_ps(job->view->pixels_per_unit);
+	__m256 min_w = _mm256_set1_ps(LOD_MIN_W);
+	__m256i first = _mm256_set1_epi32((int)job->first);
+	__m256 max_pixels = _mm256_setzero_ps();
+	__m256 sum_pixels = _mm256_setzero_ps();
+	uint32_t level_count = chain->count;
+	__m256 limits[LOD_MAX_LEVELS], errors[LOD_MAX_LEVELS];
+	__m256i at_least[LOD_MAX_LEVELS];
+	for (uint32_t l = 0; l < level_count; ++l) {
+		limits[l] = _mm256_set1_ps(job->limits[l]);
+		errors[l] = _mm256_set1_ps(chain->errors[l]);
+		at_least[l] = _mm256_setzero_si256();
+	}
+	uint32_t i = begin;
+	for (; i + 8 <= end; i += 8) {
+		__m256 cx, cy, cz, r;
+		if (job->objects) {
+			__m256i o = _mm256_add_epi32(_mm256_loadu_si256((const __m256i*)(job->objects + i)), first);
+			cx = _mm256_i32gather_ps(bounds->center[0], o, 4);
+			cy = _mm256_i32gather_ps(bounds->center[1], o, 4);
+			cz = _mm256_i32gather_ps(bounds->center[2], o, 4);
+			r = _mm256_i32gather_ps(bounds->radius, o, 4);
+		} else {
+			uint32_t o = job->first + i;
+			cx = _mm256_loadu_ps(bounds->center[0] + o);
+			cy = _mm256_loadu_ps(bounds->center[1] + o);
+			cz = _mm256_loadu_ps(bounds->center[2] + o);
+			r = _mm256_loadu_ps(bounds->radius + o);
+		}
+		__m256 w = _mm256_fmadd_ps(rx, cx, _mm256_fmadd_ps(ry, cy, _mm256_fmadd_ps(rz, cz, rw)));
+		__m256 scale = _mm256_div_ps(_mm256_mul_ps(r, pixels_per_unit), _mm256_max_ps(w, min_w));
+		__m256i level = _mm256_setzero_si256();
+		__m256 error = _mm256_setzero_ps();
+		for (uint32_t l = 1; l < level_count; ++l) {
+			__m256 picked = _mm256_cmp_ps(scale, limits[l], _CMP_LE_OQ);
+			level = _mm256_sub_epi32(level, _mm256_castps_si256(picked));
+			error = _mm256_blendv_ps(error, errors[l], picked);
+			at_least[l] = _mm256_sub_epi32(at_least[l], _mm256_castps_si256(picked));
+		}
+		__m256 pixels = _mm256_mul_ps(error, scale);
+		max_pixels = _mm256_max_ps(max_pixels, pixels);
+		sum_pixels = _mm256_add_ps(sum_pixels, pixels);
+		__m256i keys = _mm256_add_epi32(level, _mm256_set1_epi32((int)chain->key));
+		if (job->objects) {
+			uint32_t lanes[8];
+			_mm256_storeu_si256((__m256i*)lanes, keys);
+			for (uint32_t k = 0; k < 8; ++k) job->keys[job->objects[i + k]] = lanes[k];
+		} else {
+			_mm256_storeu_si256((__m256i*)(job->keys + i), keys);
+		}
+	}
+	float lanes[8];
+	_mm256_storeu_ps(lanes, max_pixels);
+	for (uint32_t k = 0; k < 8; ++k) stats->max_pixels = fmaxf(stats->max_pixels, lanes[k]);
+	_mm256_storeu_ps(lanes, sum_pixels);
+	for (uint32_t k = 0; k < 8; ++k) stats->sum_pixels += lanes[k];
+	uint32_t counts[LOD_MAX_LEVELS + 1] = {i - begin};
+	for (uint32_t l = 1; l < level_count; ++l) {
+		uint32_t lane_counts[8];
+		_mm256_storeu_si256((__m256i*)lane_counts, at_least[l]);
+		for (uint32_t k = 0; k < 8; ++k) counts[l] += lane_counts[k];
+	}
+	for (uint32_t l = 0; l < level_count; ++l) stats->levels[l] += counts[l] - counts[l + 1];
+	lod_range_scalar(job, i, end, stats);
+}
+#endif
+
+typedef void (*lod_range_function)(const struct lod_job* job, uint32_t begin, uint32_t end, struct lod_stats* stats);
+
+static struct
+{
+	bool initialized;
+	enum vecmath_path path;
+	lod_range_function range;
+} g_lod;
+
+// Picks the kernel like cull_init() does, call up front from one thread.
+void lod_init(enum vecmath_path max_path)
+{
+	g_lod.path = VECMATH_PATH_SCALAR;
+	g_lod.range = lod_range_scalar;
+#if VECMATH_SSE
+	if (max_path >= VECMATH_PATH_SSE) {
+		g_lod.path = VECMATH_PATH_SSE;
+		g_lod.range = lod_range_sse;
+	}
+#endif
+#if VECMATH_AVX2
+	if (max_path >= VECMATH_PATH_AVX2 && vecmath_cpu_has_avx2()) {
+		g_lod.path = VECMATH_PATH_AVX2;
+		g_lod.range = lod_range_avx2;
+	}
+#endif
+	(void)max_path;
+	g_lod.initialized = true;
+}
+
+static void lod_chunks(void* data, uint32_t begin, uint32_t end)
+{
+	struct lod_job* job = data;
+	for (uint32_t chunk = begin; chunk < end; ++chunk) {
+		uint32_t first = chunk * job->chunk_size;
+		uint32_t last = first + job->chunk_size < job->count ? first + job->chunk_size : job->count;
+		memset(&job->stats[chunk], 0, sizeof(job->stats[chunk]));
+		g_lod.range(job, first, last, &job->stats[chunk]);
+	}
+}
+
+// Picks the level of count objects, bounds index first + objects[i] (first + i without objects):
+// keys[objects[i]] (keys[i]) becomes the chain's key plus the level, the keys a draw list source
+// over the same objects reads. Call from a thread known to the job system.
+void lod_select(const struct cull_bounds* bounds, uint32_t first, const uint32_t* objects, uint32_t count, const struct lod_view* view,
+		const struct lod_chain* chain, uint32_t* keys, struct lod_stats* stats)
+{
+	if (!g_lod.initialized) lod_init(VECMATH_PATH_AVX2);
+	assert(chain->count >= 1 && chain->count <= LOD_MAX_LEVELS);
+	memset(stats, 0, sizeof(*stats));
+	if (count == 0) return;
+	struct lod_job job = {
+		.bounds = bounds,
+		.first = first,
+		.objects = objects,
+		.view = view,
+		.chain = chain,
+		.keys = keys,
+		.chunk_size = LOD_CHUNK,
+		.count = count,
+	};
+	for (uint32_t l = 0; l < chain->count; ++l) job.limits[l] = chain->errors[l] > 0.0f ? view->max_pixels / chain->errors[l] : INFINITY;
+	while ((uint64_t)job.chunk_size * LOD_MAX_CHUNKS < count) job.chunk_size *= 2;
+	uint32_t chunk_count = (count + job.chunk_size - 1) / job.chunk_size;
+	job_parallel_for(chunk_count, 1, lod_chunks, &job);
+
+	stats->objects = count;
+	for (uint32_t chunk = 0; chunk < chunk_count; ++chunk) {
+		for (uint32_t l = 0; l < chain->count; ++l) stats->levels[l] += job.stats[chunk].levels[l];
+		stats->max_pixels = fmaxf(stats->max_pixels, job.stats[chunk].max_pixels);
+		stats->sum_pixels += job.stats[chunk].sum_pixels;
+	}
+	for (uint32_t l = 0; l < chain->count; ++l) stats->triangles += (uint64_t)stats->levels[l] * chain->triangles[l];
+	stats->full_triangles = (uint64_t)count * chain->triangles[0];
+}
@@ -0,0 +1,171 @@
+// Block codec of the asset archive's compressed entries: byte oriented LZ77 in the manner of LZ4,
+// no entropy coding, so decoding is little more than copies and runs at memory speed. Every block
+// stands alone, a block's matches only reach back into its own output, which is what lets
+// asset_entry_read() decode an entry's blocks on any thread in any order.
+// A block is a run of sequences: a token byte, literals, then a match. The token's high nibble is
+// the literal count and its low one the match length less LZ_MIN_MATCH, 15 in either is continued
+// by bytes added on up to one that is not 255. The match is a 16-bit little endian distance back
+// into the output. The last sequence has no match, the block ends after its literals, at least
+// LZ_END_LITERALS of them so that no match ends the output: a match is copied 8 bytes at a time.
+// lz_decompress() checks every length and distance, a damaged block fails instead of writing
+// outside its output or reading outside its input.
+// Plain C, the packer includes it too.
+
+#define LZ_MIN_MATCH 4
+#define LZ_MAX_DISTANCE 65535
+#define LZ_END_LITERALS 8
+#define LZ_HASH_BITS 14
+
+static inline uint32_t lz_read32(const uint8_t* p)
+{
+	uint32_t word;
+	memcpy(&word, p, 4);
+	return word;
+}
+
+// Most bytes lz_compress() writes for size bytes, however they compress.
+size_t lz_compress_bound(size_t size)
+{
+	return size + size / 255 + 16;
+}
+
+static uint8_t* lz_write_length(uint8_t* out, size_t length)
+{
+	for (; length >= 255; length -= 255) *out++ = 255;
+	*out++ = (uint8_t)length;
+	return out;
+}
+
+// One sequence, without a match when match_length is 0. NULL when it does not fit before end.
+static uint8_t* lz_write_sequence(uint8_t* out, const uint8_t* end, const uint8_t* literals, size_t literal_count, size_t distance, size_t match_length)
+{
+	size_t needed = 1 + literal_count / 255 + 1 + literal_count + (match_length ? 2 + match_length / 255 + 1 : 0);
+	if (needed > (size_t)(end - out)) return NULL;
+	uint8_t* token = out++;
+	*token = (uint8_t)((literal_count < 15 ? literal_count : 15) << 4);
+	if (literal_count >= 15) out = lz_write_length(out, literal_count - 15);
+	memcpy(out, literals, literal_count);
+	out += literal_count;
+	if (match_length) {
+		size_t length = match_length - LZ_MIN_MATCH;
+		*token |= (uint8_t)(length < 15 ? length : 15);
+		out[0] = (uint8_t)distance;
+		out[1] = (uint8_t)(distance >> 8);
+		out += 2;
+		if (length >= 15) out = lz_write_length(out, length - 15);
+	}
+	return out;
+}
+
+// Compresses size bytes, at most 4 GiB, into capacity bytes at destination. Returns the compressed
+// size, 0 when it does not fit: a capacity under size asks for it only if it is smaller. Greedy, a
+// hash of the next 4 bytes finds the last place they were seen, and the search steps further the
+// longer it goes without a match, so data that does not compress is passed over quickly.
+size_t lz_compress(const void* source, size_t size, void* destination, size_t capacity)
+{
+	const uint8_t* in = source;
+	uint8_t* out = destination;
+	const uint8_t* out_end = out + capacity;
+	uint32_t table[1u << LZ_HASH_BITS];
+	memset(table, 0, sizeof(table));
+
+	size_t anchor = 0; // first byte not written yet
+	size_t position = 0;
+	size_t limit = size > LZ_END_LITERALS ? size - LZ_END_LITERALS : 0; // where matches end at the latest
+	uint32_t misses = 0;
+	while (position + LZ_MIN_MATCH <= limit) {
+		uint32_t word = lz_read32(in + position);
+		uint32_t hash = (word * 2654435761u) >> (32 - LZ_HASH_BITS);
+		size_t candidate = table[hash];
+		table[hash] = (uint32_t)position;
+		if (candidate >= position || position - candidate > LZ_MAX_DISTANCE || lz_read32(in + candidate) != word) {
+			position += 1 + (misses++ >> 5);
+			continue;
+		}
+		size_t length = LZ_MIN_MATCH;
+		for (uint64_t a, b; position + length + 8 <= limit; length += 8) {
+			memcpy(&a, in + candidate + length, 8);
+			memcpy(&b, in + position + length, 8);
+			if (a != b) break;
+		}
+		while (position + length < limit && in[candidate + length] == in[position + length]) ++length;
+		// the literals before may end the same way
+		while (position > anchor && candidate > 0 && in[position - 1] == in[candidate - 1]) {
+			--position;
+			--candidate;
+			++length;
+		}
+		out = lz_write_sequence(out, out_end, in + anchor, position - anchor, position - candidate, length);
+		if (!out) return 0;
+		position += length;
+		anchor = position;
+		misses = 0;
+		// the match's end is likely to repeat as well
+		if (position >= 2 && position + 2 <= limit) {
+			uint32_t tail = lz_read32(in + position - 2);
+			table[(tail * 2654435761u) >> (32 - LZ_HASH_BITS)] = (uint32_t)(position - 2);
+		}
+	}
+	out = lz_write_sequence(out, out_end, in + anchor, size - anchor, 0, 0);
+	return out ? (size_t)(out - (uint8_t*)destination) : 0;
+}
+
+static bool lz_read_length(const uint8_t** in, const uint8_t* end, size_t* length)
+{
+	uint8_t byte;
+	do {
+		if (*in == end) return false;
+		byte = *(*in)++;
+		*length += byte;
+	} while (byte == 255);
+	return true;
+}
+
+// Decompresses the block of size bytes at source into exactly destination_size bytes. Returns
+// false, the output partly written, when the block is damaged or decodes to another size. Matches
+// are read back from the output, so it should be memory that reads fast.
+bool lz_decompress(const void* source, size_t size, void* destination, size_t destination_size)
+{
+	const uint8_t* in = source;
+	const uint8_t* in_end = in + size;
+	uint8_t* out = destination;
+	uint8_t* out_end = out + destination_size;
+	for (;;) {
+		if (in == in_end) return false;
+		uint8_t token = *in++;
+		size_t literals = token >> 4;
+		if (literals == 15 && !lz_read_length(&in, in_end, &literals)) return false;
+		if (literals > (size_t)(in_end - in) || literals > (size_t)(out_end - out)) return false;
+		if (literals <= 16 && in_end - in >= 16 && out_end - out >= 16)
+			memcpy(out, in, 16); // most runs are short, a fixed copy beats a call
+		else
+			memcpy(out, in, literals);
+		in += literals;
+		out += literals;
+		if (in == in_end) return out == out_end;
+
+		if (in_end - in < 2) return false;
+		size_t distance = (size_t)in[0] | (size_t)in[1] << 8;
+		in += 2;
+		size_t length = token & 15;
+		if (length == 15 && !lz_read_length(&in, in_end, &length)) return false;
+		length += LZ_MIN_MATCH;
+		if (distance == 0 || distance > (size_t)(out - (uint8_t*)destination) || length > (size_t)(out_end - out)) return false;
+		const uint8_t* match = out - distance;
+		if (distance >= 8 && (size_t)(out_end - out) >= length + 8) {
+			// 8 bytes at a time, the last copy may run past the match into bytes written later
+			for (size_t i = 0; i < length; i += 8) memcpy(out + i, match + i, 8);
+		} else if ((size_t)(out_end - out) >= length + 8) {
+			// a shorter distance repeats a pattern, which repeats at any multiple of it too: bytes
+			// up to one of 8 or more, then 8 at a time from that far back
+			size_t period = distance;
+			while (period < 8) period += distance;
+			size_t head = period < length ? period : length;
+			for (size_t i = 0; i < head; ++i) out[i] = match[i];
+			for (size_t i = head; i < length; i += 8) memcpy(out + i, out + i - period, 8);
+		} else {
+			for (size_t i = 0; i < length; ++i) out[i] = match[i];
+		}
+		out += length;
+	}
+}
@@ -2,11 +2,19 @@
 #pragma comment(lib,"user32")
 #pragma comment(lib, "Pathcch.lib")
 
-typedef bool(*gamecode_initialize)(HWND* hwnd);
+#include "threading.c"
+#include "spsc_queue.c"
+#include "platform_events.c"
+
+// sent by the frame thread once the game code is torn down, DestroyWindow must run on the window's thread
+#define WM_APP_DESTROY_WINDOW (WM_APP + 1)
+
+typedef bool(*gamecode_initialize)(HWND* hwnd, void** persistent);
 typedef void(*gamecode_resize)(HWND hWnd, int width, int height);
 typedef bool(*gamecode_update_and_render)(void);
+typedef uint32_t(*gamecode_idle_wait_ms)(void);
 typedef void(*gamecode_cleanup)(void);
-typedef LRESULT(*gamecode_wndproc)(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam);
+typedef void(*gamecode_wndproc)(HWND hwnd, UINT msg, WPARAM wParam, LPARAM lParam, uint64_t timestamp_ns);
 
 struct game_code
 {
@@ -15,6 +23,7 @@ struct game_code
 	gamecode_wndproc wndproc ;
 	gamecode_initialize initialize ;
 	gamecode_update_and_render update_and_render ;
+	gamecode_idle_wait_ms idle_wait_ms ;
 	gamecode_cleanup cleanup ;
 	FILETIME last_dll_write ;
 	FILETIME source_dll_write ;
@@ -28,6 +37,7 @@ static wchar_t temp_gamecodedll_name[20] = L"\\temp_game_code.dll";
 static HMODULE win32code = NULL;
 static bool game_is_ready = false;
 static struct game_code gamecode;
+static void* game_persistent = NULL; // owned by the game code, handed back to it after every hot reload
 static LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam);
 
 static void get_dll_path(void);
@@ -37,55 +47,133 @@ bool hotreload(void);
 static wchar_t window_text[100] = L"";
 static HWND hwnd;
 
+// The window is created and pumped on its own thread: message storms and modal move/size loops
+// never stall the frame, and the frame never blocks DispatchMessage. Messages reach the game
+// code through the event ring, drained once per frame on the main thread.
+static struct platform_events events;
+static thread_handle message_thread;
+static DWORD message_thread_id;
+static semaphore_handle window_ready;
+static _Atomic bool quit_requested = false;
+static bool running = true;
+static void message_thread_main(void* param);
+static void dispatch_event(const struct platform_event* event, void* user);
+
 int main(){
 	get_dll_path();
 
 	if (!load_gamecode())
 		return 1;
 
-	WNDCLASSEX wc = { sizeof(WNDCLASSEX), CS_CLASSDC, WndProc, 0L, 0L,win32code , NULL, NULL, NULL, NULL, _T("Clang C99 DirectX12"), NULL };
-	RegisterClassEx(&wc);
-	hwnd = CreateWindow(wc.lpszClassName, _T("Clang C99 DirectX12"), WS_OVERLAPPEDWINDOW, 100, 100, 1280, 800, NULL, NULL, wc.hInstance, NULL);
+	if (!platform_events_init(&events) || !semaphore_create(&window_ready, 0))
+		return 1;
+	if (!thread_create(&message_thread, message_thread_main, NULL))
+		return 1;
+	semaphore_wait(&window_ready, INFINITE);
+	if (!hwnd)
+		return 1;
 
-	ShowWindow(hwnd, SW_SHOWDEFAULT);
-	UpdateWindow(hwnd);
-	GetWindowTextW(hwnd, window_text, 100);
+	// share input state with the window thread so GetKeyState, SetCapture and SetCursor behave as if
+	// the window was ours. AttachThreadInput needs a message queue on both sides, PeekMessage creates ours.
+	MSG msg;
+	PeekMessage(&msg, NULL, WM_USER, WM_USER, PM_NOREMOVE);
+	AttachThreadInput(GetCurrentThreadId(), message_thread_id, TRUE);
+
+	// drop whatever the window produced while being created, initialize reads the client size itself
+	platform_events_drain(&events, dispatch_event, NULL);
 
-	if (!gamecode.initialize(&hwnd))
+	if (!gamecode.initialize(&hwnd, &game_persistent))
 		return 1;
 
 	game_is_ready = true;
 
-	MSG msg;
-	ZeroMemory(&msg, sizeof(msg));
-	while (msg.message != WM_QUIT)
+	while (running)
 	{
-		if (PeekMessage(&msg, NULL, 0U, 0U, PM_REMOVE))
-		{
-			TranslateMessage(&msg);
-			DispatchMessage(&msg);
-			continue;
-		}
+		platform_events_drain(&events, dispatch_event, NULL);
+		if (!running)
+			break;
 
 		if (hotreload())
 		{
 			if (!load_gamecode())
 				return 1;
-			if (!gamecode.initialize(&hwnd))
+			if (!gamecode.initialize(&hwnd, &game_persistent))
 				return 1;
 			game_is_ready = true;
 		}
 
 		game_is_ready = gamecode.update_and_render();
+
+		// nothing to show, sleep until the next event or the game's next tick
+		uint32_t wait_ms = gamecode.idle_wait_ms();
+		if (wait_ms)
+			platform_events_wait(&events, wait_ms);
 	}
 	gamecode.cleanup();
 	if (gamecode.game_dll)
 		FreeLibrary(gamecode.game_dll);
-	DestroyWindow(hwnd);
-	UnregisterClass(wc.lpszClassName, wc.hInstance);
+
+	AttachThreadInput(GetCurrentThreadId(), message_thread_id, FALSE);
+	PostMessage(hwnd, WM_APP_DESTROY_WINDOW, 0, 0);
+	thread_join(message_thread);
+	semaphore_destroy(&window_ready);
+	platform_events_destroy(&events);
 	return 0;
 }
 
+static void message_thread_main(void* param)
+{
+	(void)param;
+	message_thread_id = GetCurrentThreadId();
+
+	WNDCLASSEX wc = { sizeof(WNDCLASSEX), CS_CLASSDC, WndProc, 0L, 0L,win32code , NULL, NULL, NULL, NULL, _T("Clang C99 DirectX12"), NULL };
+	RegisterClassEx(&wc);
+	hwnd = CreateWindow(wc.lpszClassName, _T("Clang C99 DirectX12"), WS_OVERLAPPEDWINDOW, 100, 100, 1280, 800, NULL, NULL, wc.hInstance, NULL);
+	if (!hwnd)
+	{
+		UnregisterClass(wc.lpszClassName, wc.hInstance);
+		semaphore_post(&window_ready, 1);
+		return;
+	}
+
+	ShowWindow(hwnd, SW_SHOWDEFAULT);
+	UpdateWindow(hwnd);
+	GetWindowTextW(hwnd, window_text, 100);
+	semaphore_post(&window_ready, 1);
+
+	// blocking pump, this thread sleeps whenever there is nothing to dispatch
+	MSG msg;
+	while (GetMessage(&msg, NULL, 0U, 0U) > 0)
+	{
+		TranslateMessage(&msg);
+		DispatchMessage(&msg);
+	}
+	UnregisterClass(wc.lpszClassName, wc.hInstance);
+}
+
+static void dispatch_event(const struct platform_event* event, void* user)
+{
+	(void)user;
+	switch (event->type)
+	{
+		case PLATFORM_EVENT_QUIT:
+			running = false;
+			break;
+		case PLATFORM_EVENT_RESIZE:
+			if (game_is_ready && !event->minimized)
+			{
+				gamecode.resize(hwnd, (int)event->width, (int)event->height);
+			}
+			break;
+		default:
+			if (game_is_ready)
+			{
+				gamecode.wndproc(hwnd, event->message, (WPARAM)event->wparam, (LPARAM)event->lparam, event->timestamp_ns);
+			}
+			break;
+	}
+}
+
 bool load_gamecode()
 {
 	CopyFileW(gamecodedll_path, tempgamecodedll_path, 0);
@@ -101,8 +189,9 @@ bool load_gamecode()
 	gamecode.initialize = (gamecode_initialize)GetProcAddress(gamecode.game_dll, "initialize");
 	gamecode.update_and_render = (gamecode_update_and_render)GetProcAddress(gamecode.game_dll, "update_and_render");
 	gamecode.cleanup = (gamecode_cleanup)GetProcAddress(gamecode.game_dll, "cleanup");
+	gamecode.idle_wait_ms = (gamecode_idle_wait_ms)GetProcAddress(gamecode.game_dll, "idle_wait_ms");
 
-	if (!gamecode.resize || !gamecode.wndproc || !gamecode.initialize || !gamecode.update_and_render || !gamecode.cleanup)
+	if (!gamecode.resize || !gamecode.wndproc || !gamecode.initialize || !gamecode.update_and_render || !gamecode.cleanup || !gamecode.idle_wait_ms)
 		return false;
 
 	return true;
@@ -134,6 +223,7 @@ bool hotreload()
 			gamecode.initialize = NULL;
 			gamecode.resize = NULL;
 			gamecode.update_and_render = NULL;
+			gamecode.idle_wait_ms = NULL;
 			gamecode.wndproc = NULL;
 		}
 
@@ -168,28 +258,68 @@ void get_dll_path()
 	SetCurrentDirectoryW(win32_exe_location);
 }
 
+// keyboard, mouse buttons and focus changes are never dropped, everything else may be when the ring is full
+static bool is_input_message(UINT msg)
+{
+	return (msg >= WM_KEYFIRST && msg <= WM_KEYLAST) ||
+	       (msg > WM_MOUSEMOVE && msg <= WM_MOUSELAST) ||
+	       msg == WM_SETFOCUS || msg == WM_KILLFOCUS;
+}
+
+// Runs on the window thread. Translates and forwards, never calls into the game code.
 LRESULT WINAPI WndProc(HWND hWnd, UINT msg, WPARAM wParam, LPARAM lParam)
 {
-	if (game_is_ready)
-	{
-		gamecode.wndproc(hWnd, msg, wParam, lParam);
-	}
+	struct platform_event event = {
+		.timestamp_ns = time_now_ns(),
+		.type = PLATFORM_EVENT_MESSAGE,
+		.message = msg,
+		.wparam = (uint64_t)wParam,
+		.lparam = (int64_t)lParam,
+	};
+	bool forward = !atomic_load_explicit(&quit_requested, memory_order_relaxed);
 
 	switch (msg)
 	{
 		case WM_SIZE:
-			if (game_is_ready && wParam != SIZE_MINIMIZED)
+			if (forward)
 			{
-				gamecode.resize(hWnd, LOWORD(lParam), HIWORD(lParam));
+				// the newest size replaces one not taken yet, the last of a drag always arrives
+				platform_events_push_resize(&events, event.timestamp_ns, LOWORD(lParam), HIWORD(lParam), wParam == SIZE_MINIMIZED);
 			}
 			return 0;
+		case WM_LBUTTONDOWN: case WM_LBUTTONDBLCLK:
+		case WM_RBUTTONDOWN: case WM_RBUTTONDBLCLK:
+		case WM_MBUTTONDOWN: case WM_MBUTTONDBLCLK:
+			// capture belongs to the window's thread, take it here rather than from the frame thread
+			if (GetCapture() == NULL)
+				SetCapture(hWnd);
+			break;
+		case WM_LBUTTONUP:
+		case WM_RBUTTONUP:
+		case WM_MBUTTONUP:
+			if ((wParam & (MK_LBUTTON | MK_RBUTTON | MK_MBUTTON)) == 0 && GetCapture() == hWnd)
+				ReleaseCapture();
+			break;
 		case WM_SYSCOMMAND:
 			if ((wParam & 0xfff0) == SC_KEYMENU) // Disable ALT application menu
 				return 0;
 			break;
+		case WM_CLOSE:
+			// the frame thread still renders into this window, it tears down first and asks for DestroyWindow;
+			// quit skips the ring, a full one must not leave a window that cannot be closed
+			if (!atomic_exchange(&quit_requested, true))
+				platform_events_push_quit(&events, event.timestamp_ns);
+			return 0;
+		case WM_APP_DESTROY_WINDOW:
+			DestroyWindow(hWnd);
+			return 0;
 		case WM_DESTROY:
 			PostQuitMessage(0);
 			return 0;
 	}
+
+	if (forward)
+		platform_events_push(&events, &event, !is_input_message(msg));
+
 	return DefWindowProc(hWnd, msg, wParam, lParam);
 }
@@ -0,0 +1,147 @@
+// Cooked mesh file, what tools/mesh_cooker.c writes and mesh_create_cooked() uploads.
+// The vertex buffer is stored exactly as the GPU reads it, vertex_format.c's header first, and the
+// 16-bit indices after it, so loading is two copies into the upload buffer. The cooker has already
+// welded the vertices and ordered the triangles and vertices for the caches, its metrics are kept
+// in the header for the stats. Levels of detail are ranges of the indices, coarser ones use a subset
+// of the same vertices. Every level is cut into meshlets, at most MESHLET_MAX_VERTICES vertices and
+// MESHLET_MAX_TRIANGLES triangles, whose triangles are consecutive in the indices: a run of them is
+// one indexed draw. For mesh shaders a meshlet also has its vertices, 16-bit indices into the vertex
+// buffer, and its triangles as three 8-bit indices into those, packed in a uint32 each. Its bounding
+// sphere and normal cone, both in model space, are what cluster culling tests.
+// Plain C without Windows, the cooker includes it as well.
+// Requires vertex_format.c.
+
+#define MESH_BLOB_MAGIC 0x3148534du // "MSH1"
+#define MESH_BLOB_VERSION 3
+#define MESH_BLOB_MAX_LODS 8
+#define MESHLET_MAX_VERTICES 64   // what one mesh shader group outputs
+#define MESHLET_MAX_TRIANGLES 124
+
+struct mesh_blob_lod
+{
+	uint32_t first_index;
+	uint32_t index_count;
+	float error; // model space distance between this level's surface and the full mesh's, measured
+	uint32_t first_meshlet;
+	uint32_t meshlet_count;
+	uint32_t pad;
+};
+
+struct mesh_blob_meshlet
+{
+	float center[3];       // bounding sphere
+	float radius;
+	int8_t cone_axis[3];   // average normal, snorm8
+	int8_t cone_cutoff;    // snorm8 sine of the normals' largest angle from the axis, rounded up; 127 never culls
+	uint32_t first_vertex; // into the meshlet vertices
+	uint32_t first_triangle; // into the packed triangles, and the index buffer's triangles: first index / 3
+	uint8_t vertex_count;
+	uint8_t triangle_count;
+	uint16_t pad;
+};
+
+_Static_assert(sizeof(struct mesh_blob_meshlet) == 32, "meshlets are packed to 32 bytes");
+
+struct mesh_blob_header
+{
+	uint32_t magic;
+	uint32_t version;
+	uint64_t file_size;
+	uint32_t format; // enum vertex_format
+	uint32_t vertex_count;
+	uint32_t index_count; // of all levels
+	uint32_t cache_size; // of the metrics below
+	uint64_t vertex_offset; // from the start of the file, 16 byte aligned
+	uint64_t vertex_bytes;
+	uint64_t index_offset;
+	float bounds_min[3];
+	float bounds_max[3];
+	float acmr;     // post-transform cache misses per triangle
+	float atvr;     // the same per vertex, 1 is the best possible
+	float overdraw; // shaded over covered pixels, averaged over six axis views
+	uint32_t lod_count;
+	struct mesh_blob_lod lods[MESH_BLOB_MAX_LODS]; // finest first, errors ascending; the metrics are of lods[0]
+	uint32_t meshlet_count;        // of all levels
+	uint32_t meshlet_vertex_count; // the same
+	uint64_t meshlet_offset;          // struct mesh_blob_meshlet, 16 byte aligned
+	uint64_t meshlet_vertex_offset;   // uint16_t
+	uint64_t meshlet_triangle_offset; // uint32_t, index_count / 3 of them
+};
+
+_Static_assert(sizeof(struct mesh_blob_header) % 16 == 0, "the vertices follow the header aligned");
+
+// The header of size bytes of a cooked mesh when everything in it is in range, indices included,
+// NULL otherwise.
+static const struct mesh_blob_header* mesh_blob_validate(const void* data, uint64_t size)
+{
+	if (size < sizeof(struct mesh_blob_header)) return NULL;
+	const struct mesh_blob_header* header = data;
+	if (header->magic != MESH_BLOB_MAGIC || header->version != MESH_BLOB_VERSION || header->file_size != size) return NULL;
+	if (header->format >= VERTEX_FORMAT_COUNT || header->vertex_count == 0 || header->vertex_count > 0x10000) return NULL;
+	if (header->index_count == 0 || header->index_count % 3) return NULL;
+	if (header->vertex_bytes != vertex_buffer_bytes((enum vertex_format)header->format, header->vertex_count)) return NULL;
+	if (header->vertex_offset % 16 || header->vertex_offset > size || header->vertex_bytes > size - header->vertex_offset) return NULL;
+	if (header->index_offset % 2 || header->index_offset > size || (uint64_t)header->index_count * 2 > size - header->index_offset) return NULL;
+	if (header->lod_count == 0 || header->lod_count > MESH_BLOB_MAX_LODS || header->lods[0].first_index != 0) return NULL;
+	uint32_t level_meshlets = 0;
+	for (uint32_t i = 0; i < header->lod_count; ++i) {
+		const struct mesh_blob_lod* lod = &header->lods[i];
+		if (lod->first_index % 3 || lod->index_count == 0 || lod->index_count % 3 || (uint64_t)lod->first_index + lod->index_count > header->index_count) return NULL;
+		if (!(lod->error >= (i ? header->lods[i - 1].error : 0.0f))) return NULL; // NaN too
+		if (lod->first_meshlet != level_meshlets || lod->meshlet_count == 0 || lod->meshlet_count > header->meshlet_count - level_meshlets) return NULL;
+		level_meshlets += lod->meshlet_count;
+	}
+	if (level_meshlets != header->meshlet_count) return NULL;
+	uint64_t meshlet_bytes = (uint64_t)header->meshlet_count * sizeof(struct mesh_blob_meshlet);
+	if (header->meshlet_offset % 16 || header->meshlet_offset > size || meshlet_bytes > size - header->meshlet_offset) return NULL;
+	if (header->meshlet_vertex_offset % 2 || header->meshlet_vertex_offset > size ||
+	    (uint64_t)header->meshlet_vertex_count * 2 > size - header->meshlet_vertex_offset)
+		return NULL;
+	if (header->meshlet_triangle_offset % 4 || header->meshlet_triangle_offset > size ||
+	    (uint64_t)header->index_count / 3 * 4 > size - header->meshlet_triangle_offset)
+		return NULL;
+
+	struct vertex_header vertices;
+	memcpy(&vertices, (const uint8_t*)data + header->vertex_offset, sizeof(vertices));
+	if (vertices.format != header->format || vertices.stride != vertex_formats[header->format].stride) return NULL;
+
+	const uint8_t* indices = (const uint8_t*)data + header->index_offset;
+	for (uint32_t i = 0; i < header->index_count; ++i) {
+		uint16_t index;
+		memcpy(&index, indices + i * 2, sizeof(index));
+		if (index >= header->vertex_count) return NULL;
+	}
+
+	// every meshlet in range and within the limits, a level's meshlets covering its triangles in order
+	const struct mesh_blob_meshlet* meshlets = (const void*)((const uint8_t*)data + header->meshlet_offset);
+	for (uint32_t i = 0; i < header->lod_count; ++i) {
+		const struct mesh_blob_lod* lod = &header->lods[i];
+		uint32_t triangle = lod->first_index / 3;
+		for (uint32_t m = lod->first_meshlet; m < lod->first_meshlet + lod->meshlet_count; ++m) {
+			const struct mesh_blob_meshlet* meshlet = &meshlets[m];
+			if (meshlet->first_triangle != triangle || meshlet->triangle_count == 0 || meshlet->triangle_count > MESHLET_MAX_TRIANGLES) return NULL;
+			if (meshlet->vertex_count == 0 || meshlet->vertex_count > MESHLET_MAX_VERTICES) return NULL;
+			if ((uint64_t)meshlet->first_vertex + meshlet->vertex_count > header->meshlet_vertex_count) return NULL;
+			if (!(meshlet->radius >= 0.0f)) return NULL;
+			triangle += meshlet->triangle_count;
+		}
+		if (triangle != (lod->first_index + lod->index_count) / 3) return NULL;
+	}
+	const uint8_t* meshlet_vertices = (const uint8_t*)data + header->meshlet_vertex_offset;
+	for (uint32_t i = 0; i < header->meshlet_vertex_count; ++i) {
+		uint16_t index;
+		memcpy(&index, meshlet_vertices + i * 2, sizeof(index));
+		if (index >= header->vertex_count) return NULL;
+	}
+	const uint8_t* triangles = (const uint8_t*)data + header->meshlet_triangle_offset;
+	for (uint32_t m = 0; m < header->meshlet_count; ++m) {
+		for (uint32_t t = meshlets[m].first_triangle; t < meshlets[m].first_triangle + meshlets[m].triangle_count; ++t) {
+			uint32_t packed;
+			memcpy(&packed, triangles + t * 4, sizeof(packed));
+			if ((packed & 0xff) >= meshlets[m].vertex_count || (packed >> 8 & 0xff) >= meshlets[m].vertex_count ||
+			    (packed >> 16 & 0xff) >= meshlets[m].vertex_count || packed >> 24)
+				return NULL;
+		}
+	}
+	return header;
+}
@@ -0,0 +1,109 @@
+// GPU culling for mesh_renderer.c, layouts must match it.
+// cull: one thread per instance, tests the mesh bounds against the clip volume and appends visible
+// instances to their batch's range of the output buffer.
+// compact: one thread per batch, writes an indirect command for every batch with visible instances,
+// packed per PSO, and counts them for ExecuteIndirect.
+
+struct mesh_cull_constants
+{
+	uint instance_buffer; // buffers[], 80 byte instances grouped by batch
+	uint batch_buffer;    // buffers[], 64 byte batch records sorted by key
+	uint output_buffer;   // rw_buffers[], visible instances
+	uint indirect_buffer; // rw_buffers[], commands, then counts per PSO, then visible per batch
+	uint output_srv;      // buffers[] index of output_buffer, for the draws
+	uint instance_count;
+	uint batch_count;
+	uint counts_offset;
+	uint visible_offset;
+};
+#define BINDLESS_CONSTANTS mesh_cull_constants
+#include "bindless.hlsli"
+
+#define INSTANCE_STRIDE 80
+#define BATCH_STRIDE 64
+#define COMMAND_STRIDE 48
+
+// batch record: first instance, instance count, index count, first command of the PSO, PSO,
+// vertex buffer index, index buffer view (address low, high, size, format), bounds min, bounds max
+uint find_batch(ByteAddressBuffer batches, uint instance)
+{
+	uint low = 0;
+	uint high = constants.batch_count;
+	while (high - low > 1) {
+		uint middle = (low + high) / 2;
+		if (batches.Load(middle * BATCH_STRIDE) <= instance) low = middle;
+		else high = middle;
+	}
+	return low;
+}
+
+[numthreads(64, 1, 1)]
+void cull(uint3 id : SV_DispatchThreadID)
+{
+	uint instance = id.x;
+	if (instance >= constants.instance_count) return;
+
+	ByteAddressBuffer instances = buffers[constants.instance_buffer];
+	ByteAddressBuffer batches = buffers[constants.batch_buffer];
+	uint batch = find_batch(batches, instance);
+	uint record = batch * BATCH_STRIDE;
+	float3 bounds_min = asfloat(batches.Load3(record + 40));
+	float3 bounds_max = asfloat(batches.Load3(record + 52));
+
+	uint offset = instance * INSTANCE_STRIDE;
+	float4 c0 = asfloat(instances.Load4(offset));
+	float4 c1 = asfloat(instances.Load4(offset + 16));
+	float4 c2 = asfloat(instances.Load4(offset + 32));
+	float4 c3 = asfloat(instances.Load4(offset + 48));
+
+	// outside when all eight corners are beyond the same clip plane
+	uint3 outside_low = 0;  // x < -w, y < -w, z < 0
+	uint3 outside_high = 0; // x > w, y > w, z > w
+	[unroll]
+	for (uint corner = 0; corner < 8; ++corner) {
+		float3 p = float3(corner & 1 ? bounds_max.x : bounds_min.x,
+				  corner & 2 ? bounds_max.y : bounds_min.y,
+				  corner & 4 ? bounds_max.z : bounds_min.z);
+		float4 clip = c0 * p.x + c1 * p.y + c2 * p.z + c3;
+		outside_low += uint3(clip.x < -clip.w, clip.y < -clip.w, clip.z < 0.0f);
+		outside_high += uint3(clip.x > clip.w, clip.y > clip.w, clip.z > clip.w);
+	}
+	if (any(outside_low == 8) || any(outside_high == 8)) return;
+
+	RWByteAddressBuffer indirect = rw_buffers[constants.indirect_buffer];
+	uint slot;
+	indirect.InterlockedAdd(constants.visible_offset + batch * 4, 1, slot);
+	RWByteAddressBuffer output = rw_buffers[constants.output_buffer];
+	uint destination = (batches.Load(record) + slot) * INSTANCE_STRIDE;
+	output.Store4(destination, asuint(c0));
+	output.Store4(destination + 16, asuint(c1));
+	output.Store4(destination + 32, asuint(c2));
+	output.Store4(destination + 48, asuint(c3));
+	output.Store4(destination + 64, instances.Load4(offset + 64));
+}
+
+// Command layout, the command signature in mesh_renderer.c:
+// index buffer view (16), buffer_index, instance_buffer_index, instance_base (12), draw indexed (20).
+[numthreads(256, 1, 1)]
+void compact(uint3 id : SV_DispatchThreadID)
+{
+	uint batch = id.x;
+	if (batch >= constants.batch_count) return;
+
+	RWByteAddressBuffer indirect = rw_buffers[constants.indirect_buffer];
+	uint visible = indirect.Load(constants.visible_offset + batch * 4);
+	if (visible == 0) return;
+
+	ByteAddressBuffer batches = buffers[constants.batch_buffer];
+	uint record = batch * BATCH_STRIDE;
+	uint4 batch_info = batches.Load4(record);         // first instance, count, index count, first command
+	uint4 mesh_info = batches.Load4(record + 16);     // PSO, vertex buffer, index buffer address
+	uint2 index_view = batches.Load2(record + 32);    // index buffer size, format
+
+	uint command;
+	indirect.InterlockedAdd(constants.counts_offset + mesh_info.x * 4, 1, command);
+	uint offset = (batch_info.w + command) * COMMAND_STRIDE;
+	indirect.Store4(offset, uint4(mesh_info.z, mesh_info.w, index_view.x, index_view.y));
+	indirect.Store4(offset + 16, uint4(mesh_info.y, constants.output_srv, batch_info.x, batch_info.z));
+	indirect.Store4(offset + 32, uint4(visible, 0, 0, 0));
+}
@@ -0,0 +1,881 @@
+// Instanced mesh rendering.
+// The simulation describes what to draw as objects, each a model to projection transform, a color
+// and a key naming its PSO and mesh. mesh_draw_list_build() groups the objects by key into a packet
+// arena: one batch per key, and the instances of a batch contiguous. The render thread copies all
+// instances into the upload ring in one go, points a per-frame raw view at them and queues one
+// DrawIndexedInstanced per batch in a draw_queue, keyed by PSO and mesh, which orders them so PSO
+// changes are minimal.
+// default_shader.hlsl fetches vertices and instances from buffers[], indexing the latter with
+// SV_InstanceID plus an instance_base root constant, SV_InstanceID does not include the start
+// instance of the draw. Every mesh has its own vertex format, the buffer's header says which.
+// With GPU culling (mesh_renderer_draw_indirect) the instances and a table of the batches are
+// uploaded the same way, then mesh_cull.hlsl culls the instances against each mesh's bounds, keeps
+// the visible ones per batch and writes one indirect command per batch that has any, packed per PSO
+// with a count. Recording is then one ExecuteIndirect per PSO, whatever the number of objects.
+// Meshes and PSOs are created on the render thread, their ids are handed out in creation order.
+// Meshes cooked by tools/mesh_cooker.c load with mesh_load_cooked(), one id per level of detail:
+// the levels share the first's buffers, each with its own range of the indices, and keep their
+// meshlets for cluster culling. A batch meshlet.c culled draws ranges of its mesh's indices per
+// instance instead of the whole mesh for all; GPU culling draws such batches whole.
+// Requires vecmath.c, arena.c, upload_ring.c, bindless.c, job_system.c, draw_queue.c, vertex_format.c,
+// mesh_blob.c.
+
+#define MESH_MAX_MESHES 64
+#define MESH_MAX_PSOS 16
+#define MESH_MAX_BATCHES 256
+#define MESH_MAX_FRAMES 16
+#define MESH_INVALID UINT32_MAX
+#define MESH_COPY_GRAIN 4096 // instances per job of the upload copy
+#define MESH_CULL_MAX_INSTANCES (1 << 17) // GPU culling output, larger lists draw unculled
+#define MESH_CULL_GROUP 64 // threads per group of the cull kernel, mesh_cull.hlsl
+#define MESH_KEY(pso, mesh) ((uint32_t)(pso) << 16 | (uint32_t)(mesh))
+#define MESH_KEY_MESH(key) ((key) & 0xffffu)
+
+// As default_shader.hlsl reads it.
+struct mesh_instance
+{
+	struct mat4 transform;
+	struct vec4 color;
+};
+
+_Static_assert(sizeof(struct mesh_instance) == 80, "default_shader.hlsl reads 80 byte instances");
+
+struct mesh
+{
+	ID3D12Resource* vertex_buffer; // raw view in buffers[], fetched by SV_VertexID
+	ID3D12Resource* index_buffer;
+	ID3D12Resource* upload;        // released at shutdown, like the rest
+	D3D12_INDEX_BUFFER_VIEW index_view;
+	uint32_t vertex_srv;
+	uint32_t vertex_count;
+	uint32_t vertex_stride;
+	uint32_t index_count;
+	struct vec3 bounds_min; // model space, for culling
+	struct vec3 bounds_max;
+	bool shared; // a level of detail of the mesh before it, whose buffers these are
+	struct mesh_blob_meshlet* meshlets; // cooked meshes', into the first level's copy
+	uint32_t meshlet_count;
+};
+
+// count objects, transforms in the arena the list is built into or anywhere that outlives the build
+struct mesh_objects
+{
+	const struct mat4* transforms;
+	const uint32_t* keys;
+	const struct vec4* colors;
+	const uint32_t* indices; // when set, the count objects drawn are these indices into the arrays
+	uint32_t count;
+	uint32_t mesh_offset; // added to the mesh of every key, picks one of several copies of the meshes
+};
+
+// Part of a batch's mesh drawn for one of its instances.
+struct mesh_range
+{
+	uint32_t instance; // from the batch's first
+	uint32_t first_index;
+	uint32_t index_count;
+};
+
+struct mesh_batch
+{
+	uint32_t key;
+	uint32_t first_instance;
+	uint32_t instance_count;
+	uint32_t first_range; // drawn instead of the whole mesh when clustered, none when all were culled
+	uint32_t range_count;
+	bool clustered;
+};
+
+struct mesh_draw_list
+{
+	struct mesh_instance* instances; // grouped by batch
+	uint32_t instance_count;
+	struct mesh_batch* batches; // sorted by key
+	uint32_t batch_count;
+	struct mesh_range* ranges;  // by batch
+	uint32_t range_count;
+};
+
+static struct
+{
+	ID3D12Device* device;
+	struct mesh meshes[MESH_MAX_MESHES];
+	uint32_t mesh_count;
+	ID3D12PipelineState* psos[MESH_MAX_PSOS];
+	uint32_t pso_count;
+	uint32_t instance_views[MESH_MAX_FRAMES]; // one per frame in flight, rewritten every frame
+	uint32_t frame_count;
+
+	// GPU culling, see mesh_cull.hlsl
+	bool culling_ready;
+	ID3D12PipelineState* cull_pso;
+	ID3D12PipelineState* compact_pso;
+	ID3D12CommandSignature* command_signature;
+	ID3D12Resource* cull_output;  // visible instances, UAV for culling then SRV for the draws
+	ID3D12Resource* indirect;     // struct mesh_cull_indirect
+	ID3D12Resource* readback;     // counts and visible per batch, per frame in flight
+	const uint32_t* readback_data;
+	uint32_t output_srv;
+	uint32_t output_uav;
+	uint32_t indirect_uav;
+	uint32_t batch_views[MESH_MAX_FRAMES];
+	uint32_t readback_batches[MESH_MAX_FRAMES];   // batches of the frame in the readback slot, 0 when empty
+	uint32_t readback_psos[MESH_MAX_FRAMES];
+	uint32_t readback_reference[MESH_MAX_FRAMES]; // CPU culled count of that frame, UINT32_MAX unverified
+
+	// last draw, written by the render thread
+	_Atomic uint32_t draw_count;
+	_Atomic uint32_t instance_count;
+	_Atomic uint64_t vertex_bytes; // read by the vertex shader, once per index: without cache reuse
+	_Atomic uint64_t triangle_count; // submitted, before GPU culling
+	_Atomic uint64_t copy_ns;
+	_Atomic uint64_t submit_ns; // copy and recording
+	// GPU culling results, from the readback a few frames late
+	_Atomic uint32_t gpu_draw_count;
+	_Atomic uint32_t gpu_visible_count;
+	_Atomic uint32_t reference_visible_count;
+	_Atomic uint32_t cull_mismatches; // frames the GPU and CPU visible counts differed
+} g_mesh_renderer;
+
+// As mesh_cull.hlsl reads it, in the root constants.
+struct mesh_cull_constants
+{
+	uint32_t instance_buffer;
+	uint32_t batch_buffer;
+	uint32_t output_buffer;
+	uint32_t indirect_buffer;
+	uint32_t output_srv;
+	uint32_t instance_count;
+	uint32_t batch_count;
+	uint32_t counts_offset;
+	uint32_t visible_offset;
+};
+
+// One per batch.
+struct mesh_cull_batch
+{
+	uint32_t first_instance;
+	uint32_t instance_count;
+	uint32_t index_count;
+	uint32_t first_command; // of the batch's PSO, its commands are packed from there
+	uint32_t pso;
+	uint32_t vertex_srv;
+	D3D12_INDEX_BUFFER_VIEW index_view;
+	struct vec3 bounds_min;
+	struct vec3 bounds_max;
+};
+
+// What the compact kernel writes, the command signature's layout.
+struct mesh_cull_command
+{
+	D3D12_INDEX_BUFFER_VIEW index_view;
+	uint32_t buffer_index;
+	uint32_t instance_buffer_index;
+	uint32_t instance_base;
+	D3D12_DRAW_INDEXED_ARGUMENTS draw;
+};
+
+struct mesh_cull_indirect
+{
+	struct mesh_cull_command commands[MESH_MAX_BATCHES];
+	uint32_t counts[MESH_MAX_PSOS];     // commands per PSO, ExecuteIndirect's count buffer
+	uint32_t visible[MESH_MAX_BATCHES]; // visible instances per batch
+};
+
+_Static_assert(sizeof(struct mesh_cull_batch) == 64, "mesh_cull.hlsl reads 64 byte batches");
+_Static_assert(sizeof(struct mesh_cull_command) == 48, "mesh_cull.hlsl writes 48 byte commands");
+_Static_assert(sizeof(struct mesh_cull_constants) <= sizeof(struct bindless_constants), "fits the root constants");
+
+#define MESH_CULL_COUNTS_OFFSET offsetof(struct mesh_cull_indirect, counts)
+#define MESH_CULL_RESET_BYTES (sizeof(struct mesh_cull_indirect) - MESH_CULL_COUNTS_OFFSET)
+
+bool mesh_renderer_init(ID3D12Device* device, uint32_t frame_count)
+{
+	memset(&g_mesh_renderer, 0, sizeof(g_mesh_renderer));
+	g_mesh_renderer.device = device;
+	g_mesh_renderer.frame_count = frame_count < MESH_MAX_FRAMES ? frame_count : MESH_MAX_FRAMES;
+	for (uint32_t i = 0; i < g_mesh_renderer.frame_count; ++i) {
+		g_mesh_renderer.instance_views[i] = bindless_alloc();
+		if (g_mesh_renderer.instance_views[i] == BINDLESS_INVALID_INDEX) return false;
+	}
+	return true;
+}
+
+// After the GPU finished with every draw.
+void mesh_renderer_shutdown(void)
+{
+	for (uint32_t i = 0; i < g_mesh_renderer.mesh_count; ++i) {
+		struct mesh* mesh = &g_mesh_renderer.meshes[i];
+		if (mesh->shared) continue;
+		free(mesh->meshlets);
+		bindless_free(mesh->vertex_srv);
+		if (mesh->vertex_buffer) mesh->vertex_buffer->lpVtbl->Release(mesh->vertex_buffer);
+		if (mesh->index_buffer) mesh->index_buffer->lpVtbl->Release(mesh->index_buffer);
+		if (mesh->upload) mesh->upload->lpVtbl->Release(mesh->upload);
+	}
+	for (uint32_t i = 0; i < g_mesh_renderer.frame_count; ++i) {
+		bindless_free(g_mesh_renderer.instance_views[i]);
+		bindless_free(g_mesh_renderer.batch_views[i]);
+	}
+	bindless_free(g_mesh_renderer.output_srv);
+	bindless_free(g_mesh_renderer.output_uav);
+	bindless_free(g_mesh_renderer.indirect_uav);
+	ID3D12Pageable* objects[] = {
+		(ID3D12Pageable*)g_mesh_renderer.cull_pso,
+		(ID3D12Pageable*)g_mesh_renderer.compact_pso,
+		(ID3D12Pageable*)g_mesh_renderer.command_signature,
+		(ID3D12Pageable*)g_mesh_renderer.cull_output,
+		(ID3D12Pageable*)g_mesh_renderer.indirect,
+		(ID3D12Pageable*)g_mesh_renderer.readback,
+	};
+	for (size_t i = 0; i < _countof(objects); ++i)
+		if (objects[i]) objects[i]->lpVtbl->Release(objects[i]);
+	memset(&g_mesh_renderer, 0, sizeof(g_mesh_renderer)); // PSOs in the table are owned by the caller
+}
+
+static ID3D12Resource* mesh_create_buffer(D3D12_HEAP_TYPE heap, UINT64 size, D3D12_RESOURCE_STATES state, D3D12_RESOURCE_FLAGS flags)
+{
+	ID3D12Resource* buffer = NULL;
+	HRESULT hr = g_mesh_renderer.device->lpVtbl->CreateCommittedResource(g_mesh_renderer.device,
+		&(D3D12_HEAP_PROPERTIES){.Type = heap, .CreationNodeMask = 1, .VisibleNodeMask = 1},
+		D3D12_HEAP_FLAG_NONE,
+		&(D3D12_RESOURCE_DESC){
+			.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+			.Width = size,
+			.Height = 1,
+			.DepthOrArraySize = 1,
+			.MipLevels = 1,
+			.SampleDesc = {.Count = 1},
+			.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+			.Flags = flags,
+		},
+		state, NULL, &IID_ID3D12Resource, (void**)&buffer);
+	return SUCCEEDED(hr) ? buffer : NULL;
+}
+
+// Of the indices in a mesh's upload buffer, after the vertices.
+static uint64_t mesh_index_offset(uint64_t vertex_bytes)
+{
+	return (vertex_bytes + 255) & ~(uint64_t)255;
+}
+
+// A new mesh's buffers and its upload buffer, mapped: vertex_bytes of vertices then the indices at
+// mesh_index_offset(). NULL on failure, nothing is left behind.
+static uint8_t* mesh_begin_upload(struct mesh* mesh, UINT64 vertex_bytes, UINT64 index_bytes, const wchar_t* name)
+{
+	memset(mesh, 0, sizeof(*mesh));
+	mesh->vertex_buffer = mesh_create_buffer(D3D12_HEAP_TYPE_DEFAULT, vertex_bytes, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_FLAG_NONE);
+	mesh->index_buffer = mesh_create_buffer(D3D12_HEAP_TYPE_DEFAULT, index_bytes, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_FLAG_NONE);
+	mesh->upload = mesh_create_buffer(D3D12_HEAP_TYPE_UPLOAD, mesh_index_offset(vertex_bytes) + index_bytes, D3D12_RESOURCE_STATE_GENERIC_READ, D3D12_RESOURCE_FLAG_NONE);
+	uint8_t* mapped = NULL;
+	if (!mesh->vertex_buffer || !mesh->index_buffer || !mesh->upload ||
+	    FAILED(mesh->upload->lpVtbl->Map(mesh->upload, 0, &(D3D12_RANGE){0, 0}, (void**)&mapped))) {
+		if (mesh->vertex_buffer) mesh->vertex_buffer->lpVtbl->Release(mesh->vertex_buffer);
+		if (mesh->index_buffer) mesh->index_buffer->lpVtbl->Release(mesh->index_buffer);
+		if (mesh->upload) mesh->upload->lpVtbl->Release(mesh->upload);
+		return NULL;
+	}
+	mesh->vertex_buffer->lpVtbl->SetName(mesh->vertex_buffer, name);
+	mesh->index_buffer->lpVtbl->SetName(mesh->index_buffer, name);
+	return mapped;
+}
+
+// Records the copies of the filled upload buffer into cmd_list and hands out the mesh's id.
+static uint32_t mesh_end_upload(ID3D12GraphicsCommandList* cmd_list, struct mesh* mesh, UINT64 vertex_bytes, UINT64 index_bytes)
+{
+	mesh->upload->lpVtbl->Unmap(mesh->upload, 0, NULL);
+
+	cmd_list->lpVtbl->CopyBufferRegion(cmd_list, mesh->vertex_buffer, 0, mesh->upload, 0, vertex_bytes);
+	cmd_list->lpVtbl->CopyBufferRegion(cmd_list, mesh->index_buffer, 0, mesh->upload, mesh_index_offset(vertex_bytes), index_bytes);
+	D3D12_RESOURCE_BARRIER barriers[2] = {
+		{
+			.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+			.Transition = {
+				.pResource = mesh->vertex_buffer,
+				.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+				.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST,
+				.StateAfter = D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+			},
+		},
+		{
+			.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+			.Transition = {
+				.pResource = mesh->index_buffer,
+				.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+				.StateBefore = D3D12_RESOURCE_STATE_COPY_DEST,
+				.StateAfter = D3D12_RESOURCE_STATE_INDEX_BUFFER,
+			},
+		},
+	};
+	cmd_list->lpVtbl->ResourceBarrier(cmd_list, 2, barriers);
+
+	mesh->vertex_srv = bindless_create_buffer_srv(mesh->vertex_buffer, vertex_bytes);
+	mesh->index_view = (D3D12_INDEX_BUFFER_VIEW){
+		.BufferLocation = mesh->index_buffer->lpVtbl->GetGPUVirtualAddress(mesh->index_buffer),
+		.SizeInBytes = (UINT)index_bytes,
+		.Format = DXGI_FORMAT_R16_UINT,
+	};
+	return g_mesh_renderer.mesh_count++;
+}
+
+// Records the upload of vertices, encoded in format, and 16-bit indices into cmd_list, the mesh is
+// usable by draws recorded after it. Returns MESH_INVALID on failure.
+uint32_t mesh_create(ID3D12GraphicsCommandList* cmd_list, enum vertex_format format, const struct vertex_input* vertices, uint32_t vertex_count,
+		     const uint16_t* indices, uint32_t index_count, const wchar_t* name)
+{
+	if (g_mesh_renderer.mesh_count == MESH_MAX_MESHES) return MESH_INVALID;
+	struct mesh* mesh = &g_mesh_renderer.meshes[g_mesh_renderer.mesh_count];
+	UINT64 vertex_bytes = vertex_buffer_bytes(format, vertex_count);
+	UINT64 index_bytes = (UINT64)index_count * sizeof(uint16_t);
+	uint8_t* mapped = mesh_begin_upload(mesh, vertex_bytes, index_bytes, name);
+	if (!mapped) return MESH_INVALID;
+	vertex_encode(format, vertices, vertex_count, mapped);
+	memcpy(mapped + mesh_index_offset(vertex_bytes), indices, index_bytes);
+
+	mesh->vertex_count = vertex_count;
+	mesh->vertex_stride = vertex_formats[format].stride;
+	mesh->index_count = index_count;
+	mesh->bounds_min = vec3_make(FLT_MAX, FLT_MAX, FLT_MAX);
+	mesh->bounds_max = vec3_make(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (uint32_t i = 0; i < vertex_count; ++i) {
+		struct vec3 position = vertices[i].position;
+		mesh->bounds_min = vec3_make(fminf(mesh->bounds_min.x, position.x), fminf(mesh->bounds_min.y, position.y), fminf(mesh->bounds_min.z, position.z));
+		mesh->bounds_max = vec3_make(fmaxf(mesh->bounds_max.x, position.x), fmaxf(mesh->bounds_max.y, position.y), fmaxf(mesh->bounds_max.z, position.z));
+	}
+	return mesh_end_upload(cmd_list, mesh, vertex_bytes, index_bytes);
+}
+
+// As mesh_create() from a mesh_blob.c file in memory, its vertices and indices are copied as they
+// are. Level of detail i is the returned id + i. Returns MESH_INVALID when the blob does not
+// validate or on failure.
+uint32_t mesh_create_cooked(ID3D12GraphicsCommandList* cmd_list, const void* blob, uint64_t size, const wchar_t* name)
+{
+	const struct mesh_blob_header* header = mesh_blob_validate(blob, size);
+	if (!header || MESH_MAX_MESHES - g_mesh_renderer.mesh_count < header->lod_count) return MESH_INVALID;
+	struct mesh* mesh = &g_mesh_renderer.meshes[g_mesh_renderer.mesh_count];
+	UINT64 index_bytes = (UINT64)header->index_count * sizeof(uint16_t);
+	size_t meshlet_bytes = (size_t)header->meshlet_count * sizeof(struct mesh_blob_meshlet);
+	struct mesh_blob_meshlet* meshlets = malloc(meshlet_bytes);
+	uint8_t* mapped = meshlets ? mesh_begin_upload(mesh, header->vertex_bytes, index_bytes, name) : NULL;
+	if (!mapped) {
+		free(meshlets);
+		return MESH_INVALID;
+	}
+	memcpy(meshlets, (const uint8_t*)blob + header->meshlet_offset, meshlet_bytes);
+	memcpy(mapped, (const uint8_t*)blob + header->vertex_offset, header->vertex_bytes);
+	memcpy(mapped + mesh_index_offset(header->vertex_bytes), (const uint8_t*)blob + header->index_offset, index_bytes);
+
+	mesh->vertex_count = header->vertex_count;
+	mesh->vertex_stride = vertex_formats[header->format].stride;
+	mesh->bounds_min = vec3_make(header->bounds_min[0], header->bounds_min[1], header->bounds_min[2]);
+	mesh->bounds_max = vec3_make(header->bounds_max[0], header->bounds_max[1], header->bounds_max[2]);
+	uint32_t id = mesh_end_upload(cmd_list, mesh, header->vertex_bytes, index_bytes);
+
+	// every level a view of its range, bounds and vertices as the full mesh's
+	for (uint32_t i = 0; i < header->lod_count; ++i) {
+		struct mesh* level = &g_mesh_renderer.meshes[id + i];
+		if (i) {
+			*level = *mesh;
+			level->shared = true;
+			g_mesh_renderer.mesh_count++;
+		}
+		level->meshlets = meshlets + header->lods[i].first_meshlet;
+		level->meshlet_count = header->lods[i].meshlet_count;
+		level->index_count = header->lods[i].index_count;
+		level->index_view.BufferLocation = mesh->index_view.BufferLocation + (UINT64)header->lods[i].first_index * sizeof(uint16_t);
+		level->index_view.SizeInBytes = header->lods[i].index_count * (UINT)sizeof(uint16_t);
+	}
+	return id;
+}
+
+// mesh_create_cooked() of a file, mapped for the copy. The header is copied to *info when given.
+uint32_t mesh_load_cooked(ID3D12GraphicsCommandList* cmd_list, const wchar_t* path, struct mesh_blob_header* info)
+{
+	HANDLE file = CreateFileW(path, GENERIC_READ, FILE_SHARE_READ, NULL, OPEN_EXISTING, FILE_ATTRIBUTE_NORMAL, NULL);
+	if (file == INVALID_HANDLE_VALUE) return MESH_INVALID;
+	uint32_t id = MESH_INVALID;
+	LARGE_INTEGER size;
+	HANDLE mapping = GetFileSizeEx(file, &size) && size.QuadPart > 0 ? CreateFileMappingW(file, NULL, PAGE_READONLY, 0, 0, NULL) : NULL;
+	const void* view = mapping ? MapViewOfFile(mapping, FILE_MAP_READ, 0, 0, 0) : NULL;
+	if (view) {
+		id = mesh_create_cooked(cmd_list, view, (uint64_t)size.QuadPart, path);
+		if (id != MESH_INVALID && info) memcpy(info, view, sizeof(*info));
+		UnmapViewOfFile(view);
+	}
+	if (mapping) CloseHandle(mapping);
+	CloseHandle(file);
+	return id;
+}
+
+// The PSO stays owned by the caller. Returns MESH_INVALID when the table is full.
+uint32_t mesh_renderer_add_pso(ID3D12PipelineState* pso)
+{
+	if (g_mesh_renderer.pso_count == MESH_MAX_PSOS) return MESH_INVALID;
+	g_mesh_renderer.psos[g_mesh_renderer.pso_count] = pso;
+	return g_mesh_renderer.pso_count++;
+}
+
+#define MESH_CULL_READ_STATE (D3D12_RESOURCE_STATE_INDIRECT_ARGUMENT | D3D12_RESOURCE_STATE_COPY_SOURCE)
+
+// Compute PSOs from mesh_cull.hlsl's cull and compact entry points, the command signature and the
+// buffers. Without it, or when it fails, mesh_renderer_draw_indirect() returns false.
+bool mesh_renderer_init_culling(const void* cull_cs, size_t cull_cs_size, const void* compact_cs, size_t compact_cs_size)
+{
+	ID3D12Device* device = g_mesh_renderer.device;
+	for (uint32_t i = 0; i < g_mesh_renderer.frame_count; ++i) {
+		g_mesh_renderer.batch_views[i] = bindless_alloc();
+		g_mesh_renderer.readback_reference[i] = UINT32_MAX;
+	}
+	HRESULT hr = device->lpVtbl->CreateComputePipelineState(device,
+		&(D3D12_COMPUTE_PIPELINE_STATE_DESC){
+			.pRootSignature = g_bindless.root_signature,
+			.CS = {.pShaderBytecode = cull_cs, .BytecodeLength = cull_cs_size},
+		},
+		&IID_ID3D12PipelineState, (void**)&g_mesh_renderer.cull_pso);
+	if (FAILED(hr)) return false;
+	hr = device->lpVtbl->CreateComputePipelineState(device,
+		&(D3D12_COMPUTE_PIPELINE_STATE_DESC){
+			.pRootSignature = g_bindless.root_signature,
+			.CS = {.pShaderBytecode = compact_cs, .BytecodeLength = compact_cs_size},
+		},
+		&IID_ID3D12PipelineState, (void**)&g_mesh_renderer.compact_pso);
+	if (FAILED(hr)) return false;
+
+	// the mesh's index buffer, buffer_index, instance_buffer_index and instance_base, then the draw
+	D3D12_INDIRECT_ARGUMENT_DESC arguments[3] = {
+		{.Type = D3D12_INDIRECT_ARGUMENT_TYPE_INDEX_BUFFER_VIEW},
+		{
+			.Type = D3D12_INDIRECT_ARGUMENT_TYPE_CONSTANT,
+			.Constant = {.RootParameterIndex = BINDLESS_ROOT_CONSTANTS, .DestOffsetIn32BitValues = BINDLESS_BUFFER_INDEX_OFFSET, .Num32BitValuesToSet = 3},
+		},
+		{.Type = D3D12_INDIRECT_ARGUMENT_TYPE_DRAW_INDEXED},
+	};
+	hr = device->lpVtbl->CreateCommandSignature(device,
+		&(D3D12_COMMAND_SIGNATURE_DESC){
+			.ByteStride = sizeof(struct mesh_cull_command),
+			.NumArgumentDescs = _countof(arguments),
+			.pArgumentDescs = arguments,
+		},
+		g_bindless.root_signature, &IID_ID3D12CommandSignature, (void**)&g_mesh_renderer.command_signature);
+	if (FAILED(hr)) return false;
+
+	UINT64 output_bytes = (UINT64)MESH_CULL_MAX_INSTANCES * sizeof(struct mesh_instance);
+	g_mesh_renderer.cull_output = mesh_create_buffer(D3D12_HEAP_TYPE_DEFAULT, output_bytes, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE,
+							 D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	g_mesh_renderer.indirect = mesh_create_buffer(D3D12_HEAP_TYPE_DEFAULT, sizeof(struct mesh_cull_indirect), MESH_CULL_READ_STATE,
+						      D3D12_RESOURCE_FLAG_ALLOW_UNORDERED_ACCESS);
+	g_mesh_renderer.readback = mesh_create_buffer(D3D12_HEAP_TYPE_READBACK, (UINT64)g_mesh_renderer.frame_count * MESH_CULL_RESET_BYTES,
+						      D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_FLAG_NONE);
+	if (!g_mesh_renderer.cull_output || !g_mesh_renderer.indirect || !g_mesh_renderer.readback) return false;
+	g_mesh_renderer.cull_output->lpVtbl->SetName(g_mesh_renderer.cull_output, L"mesh_cull_output");
+	g_mesh_renderer.indirect->lpVtbl->SetName(g_mesh_renderer.indirect, L"mesh_cull_indirect");
+	// readback memory stays mapped, every slot is read only after its frame's fence
+	if (FAILED(g_mesh_renderer.readback->lpVtbl->Map(g_mesh_renderer.readback, 0, NULL, (void**)&g_mesh_renderer.readback_data))) return false;
+
+	g_mesh_renderer.output_srv = bindless_create_buffer_srv(g_mesh_renderer.cull_output, output_bytes);
+	g_mesh_renderer.output_uav = bindless_create_buffer_uav(g_mesh_renderer.cull_output, output_bytes);
+	g_mesh_renderer.indirect_uav = bindless_create_buffer_uav(g_mesh_renderer.indirect, sizeof(struct mesh_cull_indirect));
+	g_mesh_renderer.culling_ready = g_mesh_renderer.output_srv != BINDLESS_INVALID_INDEX && g_mesh_renderer.output_uav != BINDLESS_INVALID_INDEX &&
+					g_mesh_renderer.indirect_uav != BINDLESS_INVALID_INDEX;
+	for (uint32_t i = 0; i < g_mesh_renderer.frame_count; ++i)
+		if (g_mesh_renderer.batch_views[i] == BINDLESS_INVALID_INDEX) g_mesh_renderer.culling_ready = false;
+	return g_mesh_renderer.culling_ready;
+}
+
+// Arena space mesh_draw_list_build() needs for object_count objects.
+size_t mesh_draw_list_bytes(uint32_t object_count)
+{
+	return (size_t)object_count * sizeof(struct mesh_instance) + MESH_MAX_BATCHES * sizeof(struct mesh_batch) + 32;
+}
+
+// Batch of a key in a small open addressing table, slots hold batch index + 1.
+static uint32_t mesh_batch_slot(uint16_t* table, const struct mesh_batch* batches, uint32_t key)
+{
+	uint32_t mask = MESH_MAX_BATCHES * 2 - 1;
+	uint32_t slot = (key * 0x9e3779b1u) >> 23 & mask;
+	while (table[slot] && batches[table[slot] - 1].key != key) slot = (slot + 1) & mask;
+	return slot;
+}
+
+// Groups the objects of every source by key into arena memory. Returns false, with an empty list,
+// when the arena is full or there are more than MESH_MAX_BATCHES distinct keys.
+bool mesh_draw_list_build(struct mesh_draw_list* list, struct arena* arena, const struct mesh_objects* sources, uint32_t source_count)
+{
+	memset(list, 0, sizeof(*list));
+	uint32_t total = 0;
+	for (uint32_t s = 0; s < source_count; ++s) total += sources[s].count;
+	if (total == 0) return true;
+
+	struct mesh_batch* batches = arena_push(arena, MESH_MAX_BATCHES * sizeof(struct mesh_batch), 16);
+	struct mesh_instance* instances = arena_push(arena, (size_t)total * sizeof(struct mesh_instance), 16);
+	if (!batches || !instances) return false;
+
+	// count per key, consecutive objects mostly share one
+	uint16_t table[MESH_MAX_BATCHES * 2] = {0};
+	uint32_t batch_count = 0;
+	for (uint32_t s = 0; s < source_count; ++s) {
+		uint32_t last_key = MESH_INVALID;
+		uint32_t last_batch = 0;
+		for (uint32_t i = 0; i < sources[s].count; ++i) {
+			uint32_t key = sources[s].keys[sources[s].indices ? sources[s].indices[i] : i] + sources[s].mesh_offset;
+			if (key != last_key) {
+				uint32_t slot = mesh_batch_slot(table, batches, key);
+				if (!table[slot]) {
+					if (batch_count == MESH_MAX_BATCHES) return false;
+					batches[batch_count] = (struct mesh_batch){.key = key};
+					table[slot] = (uint16_t)++batch_count;
+				}
+				last_key = key;
+				last_batch = table[slot] - 1u;
+			}
+			batches[last_batch].instance_count++;
+		}
+	}
+
+	// by key, then the instance ranges; the table is rebuilt for the new order
+	for (uint32_t i = 1; i < batch_count; ++i) {
+		struct mesh_batch batch = batches[i];
+		uint32_t j = i;
+		for (; j > 0 && batches[j - 1].key > batch.key; --j) batches[j] = batches[j - 1];
+		batches[j] = batch;
+	}
+	memset(table, 0, sizeof(table));
+	uint32_t first = 0;
+	for (uint32_t i = 0; i < batch_count; ++i) {
+		batches[i].first_instance = first;
+		first += batches[i].instance_count;
+		batches[i].instance_count = 0; // the fill position below
+		table[mesh_batch_slot(table, batches, batches[i].key)] = (uint16_t)(i + 1);
+	}
+
+	for (uint32_t s = 0; s < source_count; ++s) {
+		const struct mesh_objects* source = &sources[s];
+		uint32_t last_key = MESH_INVALID;
+		struct mesh_batch* batch = NULL;
+		for (uint32_t i = 0; i < source->count; ++i) {
+			uint32_t object = source->indices ? source->indices[i] : i;
+			if (source->keys[object] + source->mesh_offset != last_key) {
+				last_key = source->keys[object] + source->mesh_offset;
+				batch = &batches[table[mesh_batch_slot(table, batches, last_key)] - 1];
+			}
+			struct mesh_instance* instance = &instances[batch->first_instance + batch->instance_count++];
+			instance->transform = source->transforms[object];
+			instance->color = source->colors[object];
+		}
+	}
+
+	list->instances = instances;
+	list->instance_count = total;
+	list->batches = batches;
+	list->batch_count = batch_count;
+	return true;
+}
+
+struct mesh_copy_job
+{
+	const struct mesh_instance* src;
+	struct mesh_instance* dst;
+};
+
+static void mesh_copy_range(void* data, uint32_t begin, uint32_t end)
+{
+	struct mesh_copy_job* job = data;
+	memcpy(job->dst + begin, job->src + begin, (size_t)(end - begin) * sizeof(struct mesh_instance));
+}
+
+// Copies the instances into the ring and points view at them.
+static bool mesh_upload_instances(const struct mesh_draw_list* list, struct upload_ring* ring, uint32_t view)
+{
+	uint64_t begin = time_now_ns();
+	uint64_t bytes = (uint64_t)list->instance_count * sizeof(struct mesh_instance);
+	struct upload_allocation allocation = upload_ring_alloc(ring, bytes, 16);
+	if (!allocation.cpu) return false;
+	struct mesh_copy_job copy = {.src = list->instances, .dst = allocation.cpu};
+	job_parallel_for(list->instance_count, MESH_COPY_GRAIN, mesh_copy_range, &copy);
+	bindless_write_buffer_srv(view, ring->buffer, allocation.gpu - ring->gpu, bytes);
+	atomic_store_explicit(&g_mesh_renderer.copy_ns, time_now_ns() - begin, memory_order_relaxed);
+	return true;
+}
+
+_Static_assert(BINDLESS_INSTANCE_BUFFER_OFFSET == BINDLESS_BUFFER_INDEX_OFFSET + 1 && BINDLESS_INSTANCE_BASE_OFFSET == BINDLESS_BUFFER_INDEX_OFFSET + 2,
+	       "mesh draws set the three constants at once");
+
+// Uploads the instances and queues the draws under layer. The queue records them with the bindless
+// root signature; frame_slot cycles through the frames in flight, the GPU must be done with the
+// frame that last used it.
+void mesh_renderer_draw(struct draw_queue* queue, uint32_t layer, const struct mesh_draw_list* list, struct upload_ring* ring, uint32_t frame_slot)
+{
+	uint64_t begin = time_now_ns();
+	uint32_t draws = 0;
+	uint64_t vertex_bytes = 0;
+	uint64_t triangles = 0;
+	atomic_store_explicit(&g_mesh_renderer.gpu_draw_count, 0, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.gpu_visible_count, 0, memory_order_relaxed);
+	if (list->instance_count == 0) {
+		atomic_store_explicit(&g_mesh_renderer.draw_count, 0, memory_order_relaxed);
+		atomic_store_explicit(&g_mesh_renderer.instance_count, 0, memory_order_relaxed);
+		atomic_store_explicit(&g_mesh_renderer.vertex_bytes, 0, memory_order_relaxed);
+		atomic_store_explicit(&g_mesh_renderer.triangle_count, 0, memory_order_relaxed);
+		return;
+	}
+
+	uint32_t view = g_mesh_renderer.instance_views[frame_slot % g_mesh_renderer.frame_count];
+	if (!mesh_upload_instances(list, ring, view)) return;
+
+	for (uint32_t i = 0; i < list->batch_count; ++i) {
+		const struct mesh_batch* batch = &list->batches[i];
+		uint32_t pso = batch->key >> 16;
+		uint32_t mesh_index = batch->key & 0xffff;
+		if (pso >= g_mesh_renderer.pso_count || mesh_index >= g_mesh_renderer.mesh_count) continue;
+		const struct mesh* mesh = &g_mesh_renderer.meshes[mesh_index];
+
+		// the mesh is the material, instances of a batch have no single depth
+		struct draw_command command = {
+			.root_signature = g_bindless.root_signature,
+			.table = g_bindless.gpu_start,
+			.pso = g_mesh_renderer.psos[pso],
+			.index_buffer = mesh->index_view,
+			.constants = {mesh->vertex_srv, view, batch->first_instance},
+			.constant_offset = BINDLESS_BUFFER_INDEX_OFFSET,
+			.constant_count = 3,
+			.index_count = mesh->index_count,
+			.instance_count = batch->instance_count,
+		};
+		if (!batch->clustered) {
+			if (draw_queue_push(queue, DRAW_KEY(layer, DRAW_PASS_OPAQUE, pso, mesh_index, 0), draw_queue_command(queue, &command))) {
+				vertex_bytes += (uint64_t)batch->instance_count * mesh->index_count * mesh->vertex_stride;
+				triangles += (uint64_t)batch->instance_count * mesh->index_count / 3;
+				draws++;
+			}
+			continue;
+		}
+		// what cluster culling left, an instance at a time
+		for (uint32_t r = batch->first_range; r < batch->first_range + batch->range_count; ++r) {
+			const struct mesh_range* range = &list->ranges[r];
+			command.constants[2] = batch->first_instance + range->instance;
+			command.first_index = range->first_index;
+			command.index_count = range->index_count;
+			command.instance_count = 1;
+			if (draw_queue_push(queue, DRAW_KEY(layer, DRAW_PASS_OPAQUE, pso, mesh_index, 0), draw_queue_command(queue, &command))) {
+				vertex_bytes += (uint64_t)range->index_count * mesh->vertex_stride;
+				triangles += range->index_count / 3;
+				draws++;
+			}
+		}
+	}
+
+	atomic_store_explicit(&g_mesh_renderer.draw_count, draws, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.instance_count, list->instance_count, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.vertex_bytes, vertex_bytes, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.triangle_count, triangles, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.submit_ns, time_now_ns() - begin, memory_order_relaxed);
+}
+
+// The test of mesh_cull.hlsl: outside when the eight corners of the bounds are all beyond one clip
+// plane. Same order of operations, only fused multiply-adds on the GPU can round differently.
+static bool mesh_instance_visible(const struct mesh_instance* instance, const struct mesh* mesh)
+{
+	const struct vec4* c = instance->transform.columns;
+	uint32_t outside[6] = {0}; // corners beyond -x, -y, near, +x, +y, far
+	for (uint32_t corner = 0; corner < 8; ++corner) {
+		float x = corner & 1 ? mesh->bounds_max.x : mesh->bounds_min.x;
+		float y = corner & 2 ? mesh->bounds_max.y : mesh->bounds_min.y;
+		float z = corner & 4 ? mesh->bounds_max.z : mesh->bounds_min.z;
+		struct vec4 clip = {
+			c[0].x * x + c[1].x * y + c[2].x * z + c[3].x,
+			c[0].y * x + c[1].y * y + c[2].y * z + c[3].y,
+			c[0].z * x + c[1].z * y + c[2].z * z + c[3].z,
+			c[0].w * x + c[1].w * y + c[2].w * z + c[3].w,
+		};
+		outside[0] += clip.x < -clip.w;
+		outside[1] += clip.y < -clip.w;
+		outside[2] += clip.z < 0.0f;
+		outside[3] += clip.x > clip.w;
+		outside[4] += clip.y > clip.w;
+		outside[5] += clip.z > clip.w;
+	}
+	for (int i = 0; i < 6; ++i)
+		if (outside[i] == 8) return false;
+	return true;
+}
+
+struct mesh_reference_job
+{
+	const struct mesh_instance* instances;
+	const struct mesh* mesh;
+	_Atomic uint32_t visible;
+};
+
+static void mesh_reference_range(void* data, uint32_t begin, uint32_t end)
+{
+	struct mesh_reference_job* job = data;
+	uint32_t visible = 0;
+	for (uint32_t i = begin; i < end; ++i) visible += mesh_instance_visible(&job->instances[i], job->mesh);
+	atomic_fetch_add_explicit(&job->visible, visible, memory_order_relaxed);
+}
+
+// CPU culled count of a list, what the GPU should find.
+static uint32_t mesh_reference_visible(const struct mesh_draw_list* list)
+{
+	uint32_t visible = 0;
+	for (uint32_t i = 0; i < list->batch_count; ++i) {
+		const struct mesh_batch* batch = &list->batches[i];
+		struct mesh_reference_job job = {
+			.instances = list->instances + batch->first_instance,
+			.mesh = &g_mesh_renderer.meshes[batch->key & 0xffff],
+		};
+		job_parallel_for(batch->instance_count, MESH_COPY_GRAIN, mesh_reference_range, &job);
+		visible += atomic_load_explicit(&job.visible, memory_order_relaxed);
+	}
+	return visible;
+}
+
+// Takes the counts of the frame that last used the slot, its fence has passed.
+static void mesh_cull_collect(uint32_t slot)
+{
+	uint32_t batch_count = g_mesh_renderer.readback_batches[slot];
+	if (!batch_count) return;
+	const uint32_t* data = g_mesh_renderer.readback_data + (size_t)slot * (MESH_CULL_RESET_BYTES / sizeof(uint32_t));
+	uint32_t draws = 0;
+	uint32_t visible = 0;
+	for (uint32_t i = 0; i < g_mesh_renderer.readback_psos[slot]; ++i) draws += data[i];
+	for (uint32_t i = 0; i < batch_count; ++i) visible += data[MESH_MAX_PSOS + i];
+	atomic_store_explicit(&g_mesh_renderer.gpu_draw_count, draws, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.gpu_visible_count, visible, memory_order_relaxed);
+
+	uint32_t reference = g_mesh_renderer.readback_reference[slot];
+	if (reference != UINT32_MAX) {
+		atomic_store_explicit(&g_mesh_renderer.reference_visible_count, reference, memory_order_relaxed);
+		if (reference != visible) atomic_fetch_add_explicit(&g_mesh_renderer.cull_mismatches, 1, memory_order_relaxed);
+	}
+	g_mesh_renderer.readback_batches[slot] = 0;
+}
+
+static D3D12_RESOURCE_BARRIER mesh_transition(ID3D12Resource* resource, D3D12_RESOURCE_STATES before, D3D12_RESOURCE_STATES after)
+{
+	return (D3D12_RESOURCE_BARRIER){
+		.Type = D3D12_RESOURCE_BARRIER_TYPE_TRANSITION,
+		.Transition = {
+			.pResource = resource,
+			.Subresource = D3D12_RESOURCE_BARRIER_ALL_SUBRESOURCES,
+			.StateBefore = before,
+			.StateAfter = after,
+		},
+	};
+}
+
+// The GPU-driven version of mesh_renderer_draw(): uploads instances and batches, culls and compacts
+// on the GPU, then one ExecuteIndirect per PSO. verify also counts the visible instances on the CPU,
+// compared once the GPU counts are read back. Returns false when GPU culling is unavailable or the
+// list does not fit, nothing is recorded then.
+bool mesh_renderer_draw_indirect(ID3D12GraphicsCommandList* cmd_list, const struct mesh_draw_list* list, struct upload_ring* ring,
+				 uint32_t frame_slot, bool verify)
+{
+	if (!g_mesh_renderer.culling_ready || list->instance_count > MESH_CULL_MAX_INSTANCES) return false;
+	for (uint32_t i = 0; i < list->batch_count; ++i)
+		if ((list->batches[i].key >> 16) >= g_mesh_renderer.pso_count || (list->batches[i].key & 0xffff) >= g_mesh_renderer.mesh_count)
+			return false;
+
+	uint64_t begin = time_now_ns();
+	uint32_t slot = frame_slot % g_mesh_renderer.frame_count;
+	mesh_cull_collect(slot);
+	atomic_store_explicit(&g_mesh_renderer.instance_count, list->instance_count, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.draw_count, 0, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.vertex_bytes, 0, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.triangle_count, 0, memory_order_relaxed);
+	if (list->instance_count == 0) return true;
+
+	uint32_t instance_view = g_mesh_renderer.instance_views[slot];
+	uint64_t batch_bytes = (uint64_t)list->batch_count * sizeof(struct mesh_cull_batch);
+	struct upload_allocation batches = upload_ring_alloc(ring, batch_bytes, 16);
+	struct upload_allocation zeros = upload_ring_alloc(ring, MESH_CULL_RESET_BYTES, 16);
+	if (!batches.cpu || !zeros.cpu || !mesh_upload_instances(list, ring, instance_view)) return true;
+	memset(zeros.cpu, 0, MESH_CULL_RESET_BYTES);
+
+	// batch table, every PSO's commands start at its first batch
+	uint64_t vertex_bytes = 0;
+	uint64_t triangles = 0;
+	uint32_t pso_first[MESH_MAX_PSOS] = {0};
+	uint32_t pso_batches[MESH_MAX_PSOS] = {0};
+	struct mesh_cull_batch* table = batches.cpu;
+	for (uint32_t i = 0; i < list->batch_count; ++i) {
+		const struct mesh_batch* batch = &list->batches[i];
+		uint32_t pso = batch->key >> 16;
+		const struct mesh* mesh = &g_mesh_renderer.meshes[batch->key & 0xffff];
+		if (!pso_batches[pso]) pso_first[pso] = i;
+		pso_batches[pso]++;
+		vertex_bytes += (uint64_t)batch->instance_count * mesh->index_count * mesh->vertex_stride; // before culling
+		triangles += (uint64_t)batch->instance_count * mesh->index_count / 3;
+		table[i] = (struct mesh_cull_batch){
+			.first_instance = batch->first_instance,
+			.instance_count = batch->instance_count,
+			.index_count = mesh->index_count,
+			.first_command = pso_first[pso],
+			.pso = pso,
+			.vertex_srv = mesh->vertex_srv,
+			.index_view = mesh->index_view,
+			.bounds_min = mesh->bounds_min,
+			.bounds_max = mesh->bounds_max,
+		};
+	}
+	uint32_t batch_view = g_mesh_renderer.batch_views[slot];
+	bindless_write_buffer_srv(batch_view, ring->buffer, batches.gpu - ring->gpu, batch_bytes);
+
+	ID3D12Resource* indirect = g_mesh_renderer.indirect;
+	ID3D12Resource* output = g_mesh_renderer.cull_output;
+	D3D12_RESOURCE_BARRIER reset[2] = {
+		mesh_transition(indirect, MESH_CULL_READ_STATE, D3D12_RESOURCE_STATE_COPY_DEST),
+		mesh_transition(output, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE, D3D12_RESOURCE_STATE_UNORDERED_ACCESS),
+	};
+	cmd_list->lpVtbl->ResourceBarrier(cmd_list, 2, reset);
+	cmd_list->lpVtbl->CopyBufferRegion(cmd_list, indirect, MESH_CULL_COUNTS_OFFSET, ring->buffer, zeros.gpu - ring->gpu, MESH_CULL_RESET_BYTES);
+	D3D12_RESOURCE_BARRIER cull = mesh_transition(indirect, D3D12_RESOURCE_STATE_COPY_DEST, D3D12_RESOURCE_STATE_UNORDERED_ACCESS);
+	cmd_list->lpVtbl->ResourceBarrier(cmd_list, 1, &cull);
+
+	struct mesh_cull_constants constants = {
+		.instance_buffer = instance_view,
+		.batch_buffer = batch_view,
+		.output_buffer = g_mesh_renderer.output_uav,
+		.indirect_buffer = g_mesh_renderer.indirect_uav,
+		.output_srv = g_mesh_renderer.output_srv,
+		.instance_count = list->instance_count,
+		.batch_count = list->batch_count,
+		.counts_offset = MESH_CULL_COUNTS_OFFSET,
+		.visible_offset = offsetof(struct mesh_cull_indirect, visible),
+	};
+	bindless_bind_compute(cmd_list);
+	cmd_list->lpVtbl->SetComputeRoot32BitConstants(cmd_list, BINDLESS_ROOT_CONSTANTS, sizeof(constants) / sizeof(uint32_t), &constants, 0);
+	cmd_list->lpVtbl->SetPipelineState(cmd_list, g_mesh_renderer.cull_pso);
+	cmd_list->lpVtbl->Dispatch(cmd_list, (list->instance_count + MESH_CULL_GROUP - 1) / MESH_CULL_GROUP, 1, 1);
+	D3D12_RESOURCE_BARRIER compact = {.Type = D3D12_RESOURCE_BARRIER_TYPE_UAV, .UAV = {.pResource = indirect}};
+	cmd_list->lpVtbl->ResourceBarrier(cmd_list, 1, &compact);
+	cmd_list->lpVtbl->SetPipelineState(cmd_list, g_mesh_renderer.compact_pso);
+	cmd_list->lpVtbl->Dispatch(cmd_list, 1, 1, 1);
+	D3D12_RESOURCE_BARRIER draw[2] = {
+		mesh_transition(indirect, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, MESH_CULL_READ_STATE),
+		mesh_transition(output, D3D12_RESOURCE_STATE_UNORDERED_ACCESS, D3D12_RESOURCE_STATE_NON_PIXEL_SHADER_RESOURCE),
+	};
+	cmd_list->lpVtbl->ResourceBarrier(cmd_list, 2, draw);
+	cmd_list->lpVtbl->CopyBufferRegion(cmd_list, g_mesh_renderer.readback, (UINT64)slot * MESH_CULL_RESET_BYTES, indirect, MESH_CULL_COUNTS_OFFSET,
+					   MESH_CULL_RESET_BYTES);
+	g_mesh_renderer.readback_batches[slot] = list->batch_count;
+	g_mesh_renderer.readback_psos[slot] = g_mesh_renderer.pso_count;
+	g_mesh_renderer.readback_reference[slot] = verify ? mesh_reference_visible(list) : UINT32_MAX;
+
+	cmd_list->lpVtbl->IASetPrimitiveTopology(cmd_list, D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST);
+	uint32_t executes = 0;
+	for (uint32_t pso = 0; pso < g_mesh_renderer.pso_count; ++pso) {
+		if (!pso_batches[pso]) continue;
+		cmd_list->lpVtbl->SetPipelineState(cmd_list, g_mesh_renderer.psos[pso]);
+		cmd_list->lpVtbl->ExecuteIndirect(cmd_list, g_mesh_renderer.command_signature, pso_batches[pso],
+						  indirect, (UINT64)pso_first[pso] * sizeof(struct mesh_cull_command),
+						  indirect, MESH_CULL_COUNTS_OFFSET + pso * sizeof(uint32_t));
+		executes++;
+	}
+
+	atomic_store_explicit(&g_mesh_renderer.draw_count, executes, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.vertex_bytes, vertex_bytes, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.triangle_count, triangles, memory_order_relaxed);
+	atomic_store_explicit(&g_mesh_renderer.submit_ns, time_now_ns() - begin, memory_order_relaxed);
+	return true;
+}
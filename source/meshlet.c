@@ -0,0 +1,141 @@
+// Cluster culling on the CPU, the fallback for when meshlets are not culled by a mesh or compute
+// shader. A cooked mesh's meshlets (mesh_blob.c) each have a bounding sphere and a cone around
+// their triangles' normals, in model space. meshlet_cull() tests them for one instance through its
+// model to clip transform: the sphere against the frustum planes, which frustum_from_matrix() of
+// that transform puts in model space, and the cone against the eye, the point the transform sends
+// to infinity, a direction when it is orthographic. A meshlet whose triangles all face away from
+// the eye is dropped, as is one outside a plane. The meshlets' triangles are consecutive in the
+// index buffer, in meshlet order, so every run of visible meshlets becomes one range of indices.
+// mesh_draw_list_cull_clusters() does this for every instance of the batches of a few instances
+// whose mesh has meshlets, the renderer then draws their ranges instead.
+// Requires vecmath.c, mesh_blob.c, mesh_renderer.c, cull.c.
+
+#define MESHLET_MAX_INSTANCES 16 // batches with more are drawn whole, draws per instance would cost more
+
+struct meshlet_stats
+{
+	uint32_t instances;
+	uint32_t meshlets;
+	uint32_t frustum_culled;
+	uint32_t cone_culled;
+	uint64_t triangles; // of every meshlet tested
+	uint64_t drawn_triangles;
+	uint32_t ranges;
+	uint64_t cull_ns;
+};
+
+// Homogeneous model space position of the eye: where clip x, y and w are 0. Orthographic
+// transforms give w = 0 and the view direction.
+static struct vec4 meshlet_eye(const struct mat4* model_to_clip)
+{
+	const struct vec4* c = model_to_clip->columns;
+	struct vec4 a = {c[0].x, c[1].x, c[2].x, c[3].x};
+	struct vec4 b = {c[0].y, c[1].y, c[2].y, c[3].y};
+	struct vec4 d = {c[0].w, c[1].w, c[2].w, c[3].w};
+	// orthogonal to the rows of x, y and w: the cofactors of a 4x4 with those three rows
+	struct vec4 eye = {
+		vec3_dot(vec3_make(a.y, a.z, a.w), vec3_cross(vec3_make(b.y, b.z, b.w), vec3_make(d.y, d.z, d.w))),
+		-vec3_dot(vec3_make(a.x, a.z, a.w), vec3_cross(vec3_make(b.x, b.z, b.w), vec3_make(d.x, d.z, d.w))),
+		vec3_dot(vec3_make(a.x, a.y, a.w), vec3_cross(vec3_make(b.x, b.y, b.w), vec3_make(d.x, d.y, d.w))),
+		-vec3_dot(vec3_make(a.x, a.y, a.z), vec3_cross(vec3_make(b.x, b.y, b.z), vec3_make(d.x, d.y, d.z))),
+	};
+	// a direction points into the screen, clip z grows along it
+	struct vec4 z = {c[0].z, c[1].z, c[2].z, c[3].z};
+	return vec4_dot(z, eye) < 0.0f ? vec4_scale(eye, -1.0f) : eye;
+}
+
+// The visible meshlets of count, of an instance drawn with model_to_clip, as ranges of indices in
+// ranges, at most (count + 1) / 2 of them; returns how many, stats adds to its counts.
+uint32_t meshlet_cull(const struct mesh_blob_meshlet* meshlets, uint32_t count, const struct mat4* model_to_clip, uint32_t instance,
+		      struct mesh_range* ranges, struct meshlet_stats* stats)
+{
+	struct frustum frustum = frustum_from_matrix(model_to_clip);
+	struct vec4 eye = meshlet_eye(model_to_clip);
+	bool orthographic = fabsf(eye.w) <= 1e-6f * vec3_length(vec4_xyz(eye));
+	struct vec3 view = orthographic ? vec3_normalize(vec4_xyz(eye)) : vec3_scale(vec4_xyz(eye), 1.0f / eye.w);
+
+	uint32_t range_count = 0;
+	bool open = false; // the last range ends at the meshlet before
+	for (uint32_t m = 0; m < count; ++m) {
+		const struct mesh_blob_meshlet* meshlet = &meshlets[m];
+		struct vec3 center = vec3_make(meshlet->center[0], meshlet->center[1], meshlet->center[2]);
+		stats->triangles += meshlet->triangle_count;
+		bool visible = true;
+		for (int p = 0; p < 6 && visible; ++p) {
+			struct vec4 plane = frustum.planes[p];
+			visible = vec3_dot(vec4_xyz(plane), center) + plane.w >= -meshlet->radius;
+		}
+		if (!visible) {
+			stats->frustum_culled++;
+			open = false;
+			continue;
+		}
+		// all normals within asin(cutoff) of 90 degrees from the axis face away when the axis is that
+		// much closer to the view than perpendicular, the sphere widening the view's spread
+		if (meshlet->cone_cutoff < 127) {
+			struct vec3 axis = vec3_normalize(vec3_make(meshlet->cone_axis[0] / 127.0f, meshlet->cone_axis[1] / 127.0f, meshlet->cone_axis[2] / 127.0f));
+			float cutoff = meshlet->cone_cutoff / 127.0f;
+			bool away;
+			if (orthographic) {
+				away = vec3_dot(axis, view) > cutoff;
+			} else {
+				struct vec3 to_center = vec3_sub(center, view);
+				away = vec3_dot(axis, to_center) > cutoff * vec3_length(to_center) + meshlet->radius;
+			}
+			if (away) {
+				stats->cone_culled++;
+				open = false;
+				continue;
+			}
+		}
+		stats->drawn_triangles += meshlet->triangle_count;
+		if (open) {
+			ranges[range_count - 1].index_count += meshlet->triangle_count * 3u;
+		} else {
+			ranges[range_count++] = (struct mesh_range){instance, meshlet->first_triangle * 3, meshlet->triangle_count * 3u};
+			open = true;
+		}
+	}
+	stats->meshlets += count;
+	stats->instances++;
+	stats->ranges += range_count;
+	return range_count;
+}
+
+// Cluster culls the instances of list's batches of at most MESHLET_MAX_INSTANCES whose meshes,
+// first_mesh to first_mesh + mesh_count, have meshlets, into ranges in arena. Only meshes this
+// thread knows are loaded are read. Returns false, the list drawn whole, when the arena is full.
+bool mesh_draw_list_cull_clusters(struct mesh_draw_list* list, struct arena* arena, uint32_t first_mesh, uint32_t mesh_count, struct meshlet_stats* stats)
+{
+	uint64_t begin = time_now_ns();
+	memset(stats, 0, sizeof(*stats));
+	size_t most = 0;
+	for (uint32_t i = 0; i < list->batch_count; ++i) {
+		uint32_t mesh = MESH_KEY_MESH(list->batches[i].key);
+		if (mesh - first_mesh < mesh_count && list->batches[i].instance_count <= MESHLET_MAX_INSTANCES)
+			most += (size_t)list->batches[i].instance_count * (g_mesh_renderer.meshes[mesh].meshlet_count + 1) / 2;
+	}
+	if (most == 0) return true;
+	struct mesh_range* ranges = arena_push(arena, most * sizeof(struct mesh_range), 16);
+	if (!ranges) return false;
+
+	uint32_t range_count = 0;
+	for (uint32_t i = 0; i < list->batch_count; ++i) {
+		struct mesh_batch* batch = &list->batches[i];
+		uint32_t mesh = MESH_KEY_MESH(batch->key);
+		if (mesh - first_mesh >= mesh_count || batch->instance_count > MESHLET_MAX_INSTANCES) continue;
+		const struct mesh* source = &g_mesh_renderer.meshes[mesh];
+		if (!source->meshlet_count) continue;
+		batch->first_range = range_count;
+		for (uint32_t instance = 0; instance < batch->instance_count; ++instance) {
+			const struct mat4* transform = &list->instances[batch->first_instance + instance].transform;
+			range_count += meshlet_cull(source->meshlets, source->meshlet_count, transform, instance, ranges + range_count, stats);
+		}
+		batch->range_count = range_count - batch->first_range;
+		batch->clustered = true;
+	}
+	list->ranges = ranges;
+	list->range_count = range_count;
+	stats->cull_ns = time_now_ns() - begin;
+	return true;
+}
@@ -0,0 +1,178 @@
+// Message thread -> frame thread event ring.
+// The window thread translates OS messages into timestamped events and pushes them without ever
+// waiting on the frame; the frame thread drains the ring once per frame. Resizes skip the ring:
+// the newest size waits in one slot, so dragging a window border costs one swap chain resize per
+// frame, not one per message, and the final size is never dropped however full the ring is. Quit
+// has a slot of its own for the same reason: a window must close even when the ring stays full.
+// No OS types in here, message/wparam/lparam travel as plain integers.
+// Requires threading.c, spsc_queue.c.
+
+#define PLATFORM_EVENT_CAPACITY 4096
+#define PLATFORM_EVENT_PUSH_RETRY_MS 100
+#define PLATFORM_RESIZE_PENDING (1ull << 63)
+#define PLATFORM_RESIZE_MINIMIZED (1ull << 62)
+
+enum platform_event_type
+{
+	PLATFORM_EVENT_MESSAGE,
+	PLATFORM_EVENT_RESIZE,
+	PLATFORM_EVENT_QUIT,
+};
+
+struct platform_event
+{
+	uint64_t timestamp_ns;
+	uint32_t type;
+	uint32_t message;
+	uint64_t wparam;
+	int64_t lparam;
+	uint32_t width;     // PLATFORM_EVENT_RESIZE
+	uint32_t height;
+	bool minimized;
+};
+
+struct platform_events
+{
+	struct spsc_queue queue;
+	semaphore_handle wake;
+	_Atomic bool consumer_waiting;
+	_Atomic uint64_t dropped;
+	_Atomic uint64_t resize; // PLATFORM_RESIZE_PENDING | minimized | width << 31 | height, 0 when taken
+	_Atomic uint64_t resize_ns;
+	_Atomic uint32_t replaced_resizes; // since the last drain
+	_Atomic bool quit;                 // requested and not taken yet
+	_Atomic uint64_t quit_ns;
+
+	// consumer side, last drain
+	uint32_t drained;
+	uint32_t coalesced_resizes;
+};
+
+typedef void (*platform_event_handler)(const struct platform_event* event, void* user);
+
+bool platform_events_init(struct platform_events* events)
+{
+	atomic_store(&events->consumer_waiting, false);
+	atomic_store(&events->dropped, 0);
+	atomic_store(&events->resize, 0);
+	atomic_store(&events->resize_ns, 0);
+	atomic_store(&events->replaced_resizes, 0);
+	atomic_store(&events->quit, false);
+	atomic_store(&events->quit_ns, 0);
+	events->drained = 0;
+	events->coalesced_resizes = 0;
+	if (!spsc_queue_init(&events->queue, PLATFORM_EVENT_CAPACITY, sizeof(struct platform_event)))
+		return false;
+	if (!semaphore_create(&events->wake, 0)) {
+		spsc_queue_destroy(&events->queue);
+		return false;
+	}
+	return true;
+}
+
+void platform_events_destroy(struct platform_events* events)
+{
+	spsc_queue_destroy(&events->queue);
+	semaphore_destroy(&events->wake);
+}
+
+static void platform_events_wake(struct platform_events* events)
+{
+	if (atomic_exchange_explicit(&events->consumer_waiting, false, memory_order_acq_rel))
+		semaphore_post(&events->wake, 1);
+}
+
+// Producer side. Droppable events (mouse moves) are discarded when the ring is full, others retry
+// for a bounded time so a stalled frame thread can never hang the window thread. Resizes go
+// through platform_events_push_resize(), quit through platform_events_push_quit().
+bool platform_events_push(struct platform_events* events, const struct platform_event* event, bool droppable)
+{
+	bool pushed = spsc_queue_push(&events->queue, event);
+	if (!pushed && !droppable) {
+		uint64_t deadline = time_now_ns() + PLATFORM_EVENT_PUSH_RETRY_MS * 1000000ull;
+		while (!(pushed = spsc_queue_push(&events->queue, event)) && time_now_ns() < deadline)
+			thread_yield();
+	}
+
+	if (!pushed) {
+		atomic_fetch_add_explicit(&events->dropped, 1, memory_order_relaxed);
+		return false;
+	}
+	platform_events_wake(events);
+	return true;
+}
+
+// Producer side. Replaces the size the frame thread has not taken yet, never fails nor waits.
+void platform_events_push_resize(struct platform_events* events, uint64_t timestamp_ns, uint32_t width, uint32_t height, bool minimized)
+{
+	uint64_t resize = PLATFORM_RESIZE_PENDING | (minimized ? PLATFORM_RESIZE_MINIMIZED : 0) | (uint64_t)(width & 0x7fffffffu) << 31 | (height & 0x7fffffffu);
+	atomic_store_explicit(&events->resize_ns, timestamp_ns, memory_order_relaxed);
+	if (atomic_exchange_explicit(&events->resize, resize, memory_order_acq_rel) & PLATFORM_RESIZE_PENDING)
+		atomic_fetch_add_explicit(&events->replaced_resizes, 1, memory_order_relaxed);
+	platform_events_wake(events);
+}
+
+// Producer side. Like a resize, never fails nor waits; asking twice before a drain quits once.
+void platform_events_push_quit(struct platform_events* events, uint64_t timestamp_ns)
+{
+	atomic_store_explicit(&events->quit_ns, timestamp_ns, memory_order_relaxed);
+	atomic_store_explicit(&events->quit, true, memory_order_release);
+	platform_events_wake(events);
+}
+
+// Consumer side. Dispatches everything queued at the time of the call in order, then the newest
+// resize, then quit. Returns the number of events popped.
+uint32_t platform_events_drain(struct platform_events* events, platform_event_handler handler, void* user)
+{
+	struct platform_event event;
+
+	// bound the drain to what is already there, a message storm must not starve the frame
+	uint32_t available = spsc_queue_count(&events->queue);
+	uint32_t drained = 0;
+	while (drained < available && spsc_queue_pop(&events->queue, &event)) {
+		drained++;
+		handler(&event, user);
+	}
+
+	uint32_t replaced = atomic_exchange_explicit(&events->replaced_resizes, 0, memory_order_relaxed);
+	uint64_t resize = atomic_exchange_explicit(&events->resize, 0, memory_order_acq_rel);
+	if (resize & PLATFORM_RESIZE_PENDING) {
+		event = (struct platform_event){
+			.timestamp_ns = atomic_load_explicit(&events->resize_ns, memory_order_relaxed),
+			.type = PLATFORM_EVENT_RESIZE,
+			.width = (uint32_t)(resize >> 31) & 0x7fffffffu,
+			.height = (uint32_t)resize & 0x7fffffffu,
+			.minimized = (resize & PLATFORM_RESIZE_MINIMIZED) != 0,
+		};
+		handler(&event, user);
+	}
+	if (atomic_exchange_explicit(&events->quit, false, memory_order_acq_rel)) {
+		event = (struct platform_event){
+			.timestamp_ns = atomic_load_explicit(&events->quit_ns, memory_order_relaxed),
+			.type = PLATFORM_EVENT_QUIT,
+		};
+		handler(&event, user);
+	}
+
+	events->drained = drained;
+	events->coalesced_resizes = replaced;
+	return drained;
+}
+
+static bool platform_events_pending(struct platform_events* events)
+{
+	return spsc_queue_count(&events->queue) > 0 || (atomic_load_explicit(&events->resize, memory_order_acquire) & PLATFORM_RESIZE_PENDING) ||
+	       atomic_load_explicit(&events->quit, memory_order_acquire);
+}
+
+// Consumer side. Sleeps until an event arrives or the timeout expires, returns true if events are pending.
+bool platform_events_wait(struct platform_events* events, uint32_t timeout_ms)
+{
+	if (platform_events_pending(events)) return true;
+	atomic_store_explicit(&events->consumer_waiting, true, memory_order_seq_cst);
+	// re-check after publishing the flag, a push in between would otherwise be missed
+	if (!platform_events_pending(events))
+		semaphore_wait(&events->wake, timeout_ms);
+	atomic_store_explicit(&events->consumer_waiting, false, memory_order_relaxed);
+	return platform_events_pending(events);
+}
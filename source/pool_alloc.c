@@ -0,0 +1,240 @@
+// Size-class pool allocator with per-frame statistics.
+// Power-of-two blocks from 32 bytes to 1 MB are carved out of 64 KB (or single block) chunks taken
+// straight from the OS, and freed blocks go onto a per-class free list that is never returned, so
+// once a workload has reached its high water mark every allocation is a free list pop. Anything
+// bigger goes to the OS directly. A 16 byte header in front of each block holds its class, which is
+// how pool_free() finds it without being told the size, as ImGui's free callback requires.
+// The allocator itself lives in OS memory too, nothing in it points into the module that created
+// it, so a hot reloaded game code can take it over with the pools still warm. Every chunk and huge
+// block is recorded, pool_allocator_destroy() gives them all back at once whatever is still live.
+// Not thread-safe, one allocator per thread that uses it.
+
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <string.h>
+
+#if !defined(_WIN32)
+#include <sys/mman.h>
+#endif
+
+#define POOL_MIN_SHIFT 5  // 32 byte blocks, 16 bytes usable
+#define POOL_MAX_SHIFT 20 // 1 MB blocks
+#define POOL_CLASS_COUNT (POOL_MAX_SHIFT - POOL_MIN_SHIFT + 1)
+#define POOL_HUGE_CLASS 0xffffffffu
+#define POOL_CHUNK_SIZE (64 * 1024)
+#define POOL_HEADER_SIZE 16
+
+struct pool_header
+{
+	uint32_t size_class;
+	uint32_t os_block; // huge blocks, their entry in os_blocks
+	uint64_t size;     // requested, for the statistics
+};
+
+// A chunk or a huge block, as taken from the OS.
+struct pool_os_block
+{
+	void* base;
+	uint64_t bytes;
+	uint32_t huge; // freed on its own, its header knows where the entry is
+	uint32_t pad;
+};
+
+struct pool_stats
+{
+	uint64_t allocs;
+	uint64_t frees;
+	uint64_t alloc_bytes;
+	uint64_t os_allocs; // chunks and huge blocks, what would have been malloc calls
+	uint64_t os_bytes;
+};
+
+struct pool_allocator
+{
+	// these four first and never moved: a reload with a different layout destroys the old allocator
+	// through them and starts a new one
+	uint32_t size;
+	uint32_t os_block_count;
+	uint32_t os_block_capacity;
+	struct pool_os_block* os_blocks; // OS memory as well, doubles when full
+	void* free_lists[POOL_CLASS_COUNT];
+
+	uint64_t live_bytes;  // requested sizes of blocks handed out
+	uint64_t peak_bytes;
+	uint64_t os_reserved; // chunks and huge blocks held from the OS
+
+	struct pool_stats frame;      // since the last pool_allocator_frame()
+	struct pool_stats last_frame;
+	struct pool_stats total;
+	uint64_t frame_count;
+	uint64_t quiet_frames; // consecutive frames without an OS allocation
+};
+
+static void* pool_os_alloc(size_t size)
+{
+#if defined(_WIN32)
+	return VirtualAlloc(NULL, size, MEM_RESERVE | MEM_COMMIT, PAGE_READWRITE);
+#else
+	void* p = mmap(NULL, size, PROT_READ | PROT_WRITE, MAP_PRIVATE | MAP_ANONYMOUS, -1, 0);
+	return p == MAP_FAILED ? NULL : p;
+#endif
+}
+
+static void pool_os_free(void* p, size_t size)
+{
+#if defined(_WIN32)
+	(void)size;
+	VirtualFree(p, 0, MEM_RELEASE);
+#else
+	munmap(p, size);
+#endif
+}
+
+static void pool_count_os(struct pool_allocator* pool, uint64_t bytes)
+{
+	pool->frame.os_allocs++;
+	pool->frame.os_bytes += bytes;
+	pool->total.os_allocs++;
+	pool->total.os_bytes += bytes;
+	pool->os_reserved += bytes;
+}
+
+// Records an OS block, its index or UINT32_MAX when the array could not grow.
+static uint32_t pool_track(struct pool_allocator* pool, void* base, uint64_t bytes, bool huge)
+{
+	if (pool->os_block_count == pool->os_block_capacity) {
+		uint32_t capacity = pool->os_block_capacity ? pool->os_block_capacity * 2 : 256;
+		struct pool_os_block* blocks = pool_os_alloc(capacity * sizeof(*blocks));
+		if (!blocks) return UINT32_MAX;
+		if (pool->os_blocks) {
+			memcpy(blocks, pool->os_blocks, pool->os_block_count * sizeof(*blocks));
+			pool_os_free(pool->os_blocks, pool->os_block_capacity * sizeof(*blocks));
+		}
+		pool->os_reserved += (capacity - pool->os_block_capacity) * sizeof(*blocks);
+		pool->os_blocks = blocks;
+		pool->os_block_capacity = capacity;
+	}
+	pool->os_blocks[pool->os_block_count] = (struct pool_os_block){.base = base, .bytes = bytes, .huge = huge};
+	return pool->os_block_count++;
+}
+
+struct pool_allocator* pool_allocator_create(void)
+{
+	struct pool_allocator* pool = pool_os_alloc(sizeof(struct pool_allocator));
+	if (!pool) return NULL;
+	memset(pool, 0, sizeof(*pool));
+	pool->size = sizeof(*pool);
+	pool->os_reserved = sizeof(*pool);
+	return pool;
+}
+
+// Gives every chunk and huge block back to the OS, then the allocator itself. Blocks still handed
+// out go with them. Reads nothing past the first four fields, so it also takes down an allocator
+// left behind by a game code built with another layout.
+void pool_allocator_destroy(struct pool_allocator* pool)
+{
+	if (!pool) return;
+	for (uint32_t i = 0; i < pool->os_block_count; ++i) pool_os_free(pool->os_blocks[i].base, pool->os_blocks[i].bytes);
+	if (pool->os_blocks) pool_os_free(pool->os_blocks, pool->os_block_capacity * sizeof(struct pool_os_block));
+	uint32_t size = pool->size;
+	pool_os_free(pool, size);
+}
+
+// Smallest class whose block holds size plus the header.
+static uint32_t pool_size_class(size_t size)
+{
+	size_t block = (size_t)1 << POOL_MIN_SHIFT;
+	uint32_t size_class = 0;
+	while (block - POOL_HEADER_SIZE < size) {
+		block <<= 1;
+		size_class++;
+	}
+	return size_class;
+}
+
+// Refills an empty class with a chunk, every block of it goes onto the free list.
+static bool pool_refill(struct pool_allocator* pool, uint32_t size_class)
+{
+	size_t block = (size_t)1 << (POOL_MIN_SHIFT + size_class);
+	size_t chunk = block > POOL_CHUNK_SIZE ? block : POOL_CHUNK_SIZE;
+	uint8_t* base = pool_os_alloc(chunk);
+	if (!base) return false;
+	if (pool_track(pool, base, chunk, false) == UINT32_MAX) {
+		pool_os_free(base, chunk);
+		return false;
+	}
+	pool_count_os(pool, chunk);
+
+	for (size_t offset = chunk; offset >= block; offset -= block) {
+		void** node = (void**)(base + offset - block);
+		*node = pool->free_lists[size_class];
+		pool->free_lists[size_class] = node;
+	}
+	return true;
+}
+
+void* pool_alloc(struct pool_allocator* pool, size_t size)
+{
+	struct pool_header* header;
+	if (size > ((size_t)1 << POOL_MAX_SHIFT) - POOL_HEADER_SIZE) {
+		header = pool_os_alloc(size + POOL_HEADER_SIZE);
+		if (!header) return NULL;
+		header->os_block = pool_track(pool, header, size + POOL_HEADER_SIZE, true);
+		if (header->os_block == UINT32_MAX) {
+			pool_os_free(header, size + POOL_HEADER_SIZE);
+			return NULL;
+		}
+		pool_count_os(pool, size + POOL_HEADER_SIZE);
+		header->size_class = POOL_HUGE_CLASS;
+	} else {
+		uint32_t size_class = pool_size_class(size);
+		if (!pool->free_lists[size_class] && !pool_refill(pool, size_class)) return NULL;
+		void** node = pool->free_lists[size_class];
+		pool->free_lists[size_class] = *node;
+		header = (struct pool_header*)node;
+		header->size_class = size_class;
+	}
+	header->size = size;
+
+	pool->frame.allocs++;
+	pool->frame.alloc_bytes += size;
+	pool->total.allocs++;
+	pool->total.alloc_bytes += size;
+	pool->live_bytes += size;
+	if (pool->live_bytes > pool->peak_bytes) pool->peak_bytes = pool->live_bytes;
+	return (uint8_t*)header + POOL_HEADER_SIZE;
+}
+
+void pool_free(struct pool_allocator* pool, void* p)
+{
+	if (!p) return;
+	struct pool_header* header = (struct pool_header*)((uint8_t*)p - POOL_HEADER_SIZE);
+	pool->frame.frees++;
+	pool->total.frees++;
+	pool->live_bytes -= header->size;
+
+	if (header->size_class == POOL_HUGE_CLASS) {
+		// the last entry moves into its place
+		struct pool_os_block last = pool->os_blocks[--pool->os_block_count];
+		pool->os_blocks[header->os_block] = last;
+		if (last.huge) ((struct pool_header*)last.base)->os_block = header->os_block;
+		pool->os_reserved -= header->size + POOL_HEADER_SIZE;
+		pool_os_free(header, header->size + POOL_HEADER_SIZE);
+		return;
+	}
+	// the link overwrites the header
+	uint32_t size_class = header->size_class;
+	void** node = (void**)header;
+	*node = pool->free_lists[size_class];
+	pool->free_lists[size_class] = node;
+}
+
+// Closes the frame's statistics, call once per frame from the allocating thread.
+void pool_allocator_frame(struct pool_allocator* pool)
+{
+	pool->last_frame = pool->frame;
+	memset(&pool->frame, 0, sizeof(pool->frame));
+	pool->frame_count++;
+	pool->quiet_frames = pool->last_frame.os_allocs ? 0 : pool->quiet_frames + 1;
+}
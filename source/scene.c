@@ -0,0 +1,257 @@
+// Transform hierarchy.
+// Nodes are indices into structure of arrays storage: local position, rotation and scale, a parent
+// index and a depth. Nodes are kept sorted by depth, so every parent comes before its children and
+// each depth is one contiguous range, a level. scene_update() walks the levels in order and splits
+// each one across the job system; nothing in a level depends on another node of the same level,
+// only on the previous one, which is complete by then.
+// Setting a local transform marks the node dirty. An update recomputes the dirty nodes and every
+// node under them, the others keep last update's world matrix. It can also write
+// projection * world for every node to a caller's buffer in the same pass, a mapped per-frame
+// constant or instance buffer for instance: the writes are sequential and never read back.
+// Structure changes (scene_add, scene_sort) are single-threaded and not concurrent with an update.
+// Requires vecmath.c, job_system.c.
+
+#include <assert.h>
+#include <stdatomic.h>
+#include <stdlib.h>
+#include <string.h>
+
+#define SCENE_NO_PARENT UINT32_MAX
+#define SCENE_MAX_LEVELS 64
+#define SCENE_UPDATE_GRAIN 4096 // nodes per job
+
+struct scene
+{
+	uint32_t count;
+	uint32_t capacity;
+
+	// local transform
+	float* position[3]; // x, y, z
+	float* rotation[4]; // quaternion x, y, z, w
+	float* scale[3];
+
+	uint32_t* parent; // SCENE_NO_PARENT for roots, always a lower index
+	uint8_t* depth;
+	uint8_t* dirty;   // local transform set since the last update
+	uint8_t* changed; // world matrix recomputed by the last update
+	struct mat4* world;
+
+	bool sorted; // false after adding a node shallower than the last one
+	uint32_t level_count;
+	uint32_t level_begin[SCENE_MAX_LEVELS + 1];
+
+	uint64_t revision; // bumped by every change, for frame hashing
+	_Atomic uint32_t updated; // nodes recomputed by the last update
+};
+
+static bool scene_grow(struct scene* scene, uint32_t capacity)
+{
+	void** arrays[] = {
+		(void**)&scene->position[0], (void**)&scene->position[1], (void**)&scene->position[2],
+		(void**)&scene->rotation[0], (void**)&scene->rotation[1], (void**)&scene->rotation[2], (void**)&scene->rotation[3],
+		(void**)&scene->scale[0], (void**)&scene->scale[1], (void**)&scene->scale[2],
+		(void**)&scene->parent, (void**)&scene->depth, (void**)&scene->dirty, (void**)&scene->changed,
+		(void**)&scene->world,
+	};
+	size_t sizes[] = {
+		sizeof(float), sizeof(float), sizeof(float),
+		sizeof(float), sizeof(float), sizeof(float), sizeof(float),
+		sizeof(float), sizeof(float), sizeof(float),
+		sizeof(uint32_t), sizeof(uint8_t), sizeof(uint8_t), sizeof(uint8_t),
+		sizeof(struct mat4),
+	};
+	for (size_t i = 0; i < sizeof(arrays) / sizeof(arrays[0]); ++i) {
+		// 64-bit malloc aligns to 16 bytes, what the world matrices' SSE loads need
+		void* p = realloc(*arrays[i], (size_t)capacity * sizes[i]);
+		if (!p) return false;
+		*arrays[i] = p;
+	}
+	scene->capacity = capacity;
+	return true;
+}
+
+bool scene_init(struct scene* scene, uint32_t capacity)
+{
+	memset(scene, 0, sizeof(*scene));
+	scene->sorted = true;
+	return scene_grow(scene, capacity ? capacity : 64);
+}
+
+void scene_free(struct scene* scene)
+{
+	for (int i = 0; i < 3; ++i) free(scene->position[i]);
+	for (int i = 0; i < 4; ++i) free(scene->rotation[i]);
+	for (int i = 0; i < 3; ++i) free(scene->scale[i]);
+	free(scene->parent);
+	free(scene->depth);
+	free(scene->dirty);
+	free(scene->changed);
+	free(scene->world);
+	memset(scene, 0, sizeof(*scene));
+}
+
+// Appends a node, the parent must already exist. Returns SCENE_NO_PARENT when out of memory or
+// deeper than SCENE_MAX_LEVELS. Adding a node shallower than the last one unsorts the scene, call
+// scene_sort() before the next update; adding level by level keeps it sorted.
+uint32_t scene_add(struct scene* scene, uint32_t parent, struct vec3 position, struct quat rotation, struct vec3 scale)
+{
+	assert(parent == SCENE_NO_PARENT || parent < scene->count);
+	uint32_t depth = parent == SCENE_NO_PARENT ? 0 : scene->depth[parent] + 1u;
+	if (depth >= SCENE_MAX_LEVELS) return SCENE_NO_PARENT;
+	if (scene->count == scene->capacity && !scene_grow(scene, scene->capacity * 2)) return SCENE_NO_PARENT;
+
+	uint32_t node = scene->count++;
+	scene->position[0][node] = position.x;
+	scene->position[1][node] = position.y;
+	scene->position[2][node] = position.z;
+	scene->rotation[0][node] = rotation.x;
+	scene->rotation[1][node] = rotation.y;
+	scene->rotation[2][node] = rotation.z;
+	scene->rotation[3][node] = rotation.w;
+	scene->scale[0][node] = scale.x;
+	scene->scale[1][node] = scale.y;
+	scene->scale[2][node] = scale.z;
+	scene->parent[node] = parent;
+	scene->depth[node] = (uint8_t)depth;
+	scene->dirty[node] = 1;
+	scene->changed[node] = 0;
+
+	if (node > 0 && depth < scene->depth[node - 1]) scene->sorted = false;
+	if (scene->sorted) {
+		// levels up to this depth end here
+		while (scene->level_count <= depth) scene->level_begin[scene->level_count++] = node;
+		scene->level_begin[scene->level_count] = node + 1;
+	}
+	scene->revision++;
+	return node;
+}
+
+static void scene_permute(void* array, const uint32_t* order, void* scratch, size_t element, uint32_t count)
+{
+	uint8_t* src = array;
+	uint8_t* dst = scratch;
+	for (uint32_t i = 0; i < count; ++i) memcpy(dst + (size_t)i * element, src + (size_t)order[i] * element, element);
+	memcpy(array, scratch, (size_t)count * element);
+}
+
+// Stable counting sort of the nodes by depth. remap, when given, receives every node's new index
+// (count entries). Returns false when out of memory, the scene is left as it was.
+bool scene_sort(struct scene* scene, uint32_t* remap)
+{
+	uint32_t count = scene->count;
+	uint32_t* order = malloc((size_t)count * sizeof(uint32_t));
+	uint32_t* new_index = remap ? remap : malloc((size_t)count * sizeof(uint32_t));
+	void* scratch = malloc((size_t)count * sizeof(struct mat4));
+	bool ok = order && new_index && scratch;
+	if (ok) {
+		uint32_t begin[SCENE_MAX_LEVELS + 1] = {0};
+		for (uint32_t i = 0; i < count; ++i) begin[scene->depth[i] + 1]++;
+		for (uint32_t d = 0; d < SCENE_MAX_LEVELS; ++d) begin[d + 1] += begin[d];
+		scene->level_count = 0;
+		for (uint32_t d = 0; d <= SCENE_MAX_LEVELS; ++d) {
+			scene->level_begin[d] = begin[d];
+			if (d < SCENE_MAX_LEVELS && begin[d + 1] > begin[d]) scene->level_count = d + 1;
+		}
+		for (uint32_t i = 0; i < count; ++i) {
+			uint32_t slot = begin[scene->depth[i]]++;
+			order[slot] = i;
+			new_index[i] = slot;
+		}
+
+		for (int i = 0; i < 3; ++i) scene_permute(scene->position[i], order, scratch, sizeof(float), count);
+		for (int i = 0; i < 4; ++i) scene_permute(scene->rotation[i], order, scratch, sizeof(float), count);
+		for (int i = 0; i < 3; ++i) scene_permute(scene->scale[i], order, scratch, sizeof(float), count);
+		scene_permute(scene->parent, order, scratch, sizeof(uint32_t), count);
+		scene_permute(scene->depth, order, scratch, sizeof(uint8_t), count);
+		scene_permute(scene->dirty, order, scratch, sizeof(uint8_t), count);
+		scene_permute(scene->changed, order, scratch, sizeof(uint8_t), count);
+		scene_permute(scene->world, order, scratch, sizeof(struct mat4), count);
+		for (uint32_t i = 0; i < count; ++i)
+			if (scene->parent[i] != SCENE_NO_PARENT) scene->parent[i] = new_index[scene->parent[i]];
+		scene->sorted = true;
+		scene->revision++;
+	}
+	free(scratch);
+	if (!remap) free(new_index);
+	free(order);
+	return ok;
+}
+
+void scene_set_position(struct scene* scene, uint32_t node, struct vec3 position)
+{
+	scene->position[0][node] = position.x;
+	scene->position[1][node] = position.y;
+	scene->position[2][node] = position.z;
+	scene->dirty[node] = 1;
+	scene->revision++;
+}
+
+void scene_set_rotation(struct scene* scene, uint32_t node, struct quat rotation)
+{
+	scene->rotation[0][node] = rotation.x;
+	scene->rotation[1][node] = rotation.y;
+	scene->rotation[2][node] = rotation.z;
+	scene->rotation[3][node] = rotation.w;
+	scene->dirty[node] = 1;
+	scene->revision++;
+}
+
+void scene_set_scale(struct scene* scene, uint32_t node, struct vec3 scale)
+{
+	scene->scale[0][node] = scale.x;
+	scene->scale[1][node] = scale.y;
+	scene->scale[2][node] = scale.z;
+	scene->dirty[node] = 1;
+	scene->revision++;
+}
+
+struct scene_update_job
+{
+	struct scene* scene;
+	uint32_t level_begin;
+	const struct mat4* view_projection;
+	struct mat4* out;
+};
+
+static void scene_update_range(void* data, uint32_t begin, uint32_t end)
+{
+	struct scene_update_job* job = data;
+	struct scene* scene = job->scene;
+	uint32_t updated = 0;
+	for (uint32_t node = job->level_begin + begin; node < job->level_begin + end; ++node) {
+		uint32_t parent = scene->parent[node];
+		bool parent_changed = parent != SCENE_NO_PARENT && scene->changed[parent];
+		if (scene->dirty[node] || parent_changed) {
+			struct vec3 position = {scene->position[0][node], scene->position[1][node], scene->position[2][node]};
+			struct quat rotation = {scene->rotation[0][node], scene->rotation[1][node], scene->rotation[2][node], scene->rotation[3][node]};
+			struct vec3 scale = {scene->scale[0][node], scene->scale[1][node], scene->scale[2][node]};
+			struct mat4 local = mat4_trs(position, rotation, scale);
+			scene->world[node] = parent == SCENE_NO_PARENT ? local : mat4_mul(&scene->world[parent], &local);
+			scene->dirty[node] = 0;
+			scene->changed[node] = 1;
+			updated++;
+		} else {
+			scene->changed[node] = 0;
+		}
+		if (job->out) job->out[node] = mat4_mul(job->view_projection, &scene->world[node]);
+	}
+	if (updated) atomic_fetch_add_explicit(&scene->updated, updated, memory_order_relaxed);
+}
+
+// Recomputes the world matrices of dirty nodes and their descendants, level by level on the job
+// system. With out, out[i] = view_projection * world[i] is written for every node, out must hold
+// scene->count matrices. Call from a thread known to the job system.
+void scene_update(struct scene* scene, const struct mat4* view_projection, struct mat4* out)
+{
+	assert(scene->sorted && "scene_sort() after adding nodes out of depth order");
+	atomic_store_explicit(&scene->updated, 0, memory_order_relaxed);
+	for (uint32_t level = 0; level < scene->level_count; ++level) {
+		struct scene_update_job job = {
+			.scene = scene,
+			.level_begin = scene->level_begin[level],
+			.view_projection = view_projection,
+			.out = out,
+		};
+		job_parallel_for(scene->level_begin[level + 1] - scene->level_begin[level], SCENE_UPDATE_GRAIN, scene_update_range, &job);
+	}
+}
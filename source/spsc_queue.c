@@ -0,0 +1,76 @@
+// Bounded lock-free single-producer/single-consumer queue of fixed-size elements.
+// Head and tail live on their own cache lines and each side keeps a cached copy of the other's
+// index, so the common case touches no shared line.
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+
+struct spsc_queue
+{
+	_Alignas(64) _Atomic uint32_t head; // written by the producer
+	uint32_t tail_cache;
+	_Alignas(64) _Atomic uint32_t tail; // written by the consumer
+	uint32_t head_cache;
+	_Alignas(64) uint32_t mask;
+	uint32_t element_size;
+	uint8_t* elements;
+};
+
+// capacity is rounded up to a power of two
+bool spsc_queue_init(struct spsc_queue* queue, uint32_t capacity, uint32_t element_size)
+{
+	uint32_t size = 1;
+	while (size < capacity)
+		size <<= 1;
+
+	queue->elements = malloc((size_t)size * element_size);
+	if (!queue->elements) return false;
+	queue->mask = size - 1;
+	queue->element_size = element_size;
+	atomic_store(&queue->head, 0);
+	atomic_store(&queue->tail, 0);
+	queue->head_cache = 0;
+	queue->tail_cache = 0;
+	return true;
+}
+
+void spsc_queue_destroy(struct spsc_queue* queue)
+{
+	free(queue->elements);
+	queue->elements = NULL;
+}
+
+// producer side, returns false when full
+bool spsc_queue_push(struct spsc_queue* queue, const void* element)
+{
+	uint32_t head = atomic_load_explicit(&queue->head, memory_order_relaxed);
+	if (head - queue->tail_cache > queue->mask) {
+		queue->tail_cache = atomic_load_explicit(&queue->tail, memory_order_acquire);
+		if (head - queue->tail_cache > queue->mask) return false;
+	}
+	memcpy(queue->elements + (size_t)(head & queue->mask) * queue->element_size, element, queue->element_size);
+	atomic_store_explicit(&queue->head, head + 1, memory_order_release);
+	return true;
+}
+
+// consumer side, returns false when empty
+bool spsc_queue_pop(struct spsc_queue* queue, void* element)
+{
+	uint32_t tail = atomic_load_explicit(&queue->tail, memory_order_relaxed);
+	if (tail == queue->head_cache) {
+		queue->head_cache = atomic_load_explicit(&queue->head, memory_order_acquire);
+		if (tail == queue->head_cache) return false;
+	}
+	memcpy(element, queue->elements + (size_t)(tail & queue->mask) * queue->element_size, queue->element_size);
+	atomic_store_explicit(&queue->tail, tail + 1, memory_order_release);
+	return true;
+}
+
+// approximate when called concurrently with push/pop
+uint32_t spsc_queue_count(struct spsc_queue* queue)
+{
+	return atomic_load_explicit(&queue->head, memory_order_acquire) - atomic_load_explicit(&queue->tail, memory_order_acquire);
+}
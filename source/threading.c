@@ -0,0 +1,221 @@
+// Thin platform layer over Win32 and pthreads: threads, semaphores and a nanosecond clock.
+// Only what the job system and the frame threads need, nothing more.
+
+#if !defined(_WIN32) && !defined(_GNU_SOURCE)
+#define _GNU_SOURCE
+#endif
+
+#include <stdatomic.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#if defined(_WIN32)
+#include <intrin.h>
+typedef HANDLE thread_handle;
+typedef HANDLE semaphore_handle;
+#else
+#include <errno.h>
+#include <pthread.h>
+#include <sched.h>
+#include <semaphore.h>
+#include <time.h>
+#include <unistd.h>
+#if defined(__x86_64__) || defined(__i386__)
+#include <immintrin.h>
+#endif
+typedef pthread_t thread_handle;
+typedef sem_t semaphore_handle;
+#endif
+
+typedef void (*thread_function)(void* param);
+
+struct thread_start
+{
+	thread_function function;
+	void* param;
+};
+
+#if defined(_WIN32)
+static DWORD WINAPI thread_trampoline(LPVOID param)
+#else
+static void* thread_trampoline(void* param)
+#endif
+{
+	struct thread_start start = *(struct thread_start*)param;
+	free(param);
+	start.function(start.param);
+	return 0;
+}
+
+bool thread_create(thread_handle* thread, thread_function function, void* param)
+{
+	struct thread_start* start = malloc(sizeof(struct thread_start));
+	if (!start) return false;
+	start->function = function;
+	start->param = param;
+#if defined(_WIN32)
+	*thread = CreateThread(NULL, 0, thread_trampoline, start, 0, NULL);
+	if (*thread == NULL) {
+		free(start);
+		return false;
+	}
+#else
+	if (pthread_create(thread, NULL, thread_trampoline, start) != 0) {
+		free(start);
+		return false;
+	}
+#endif
+	return true;
+}
+
+void thread_join(thread_handle thread)
+{
+#if defined(_WIN32)
+	WaitForSingleObject(thread, INFINITE);
+	CloseHandle(thread);
+#else
+	pthread_join(thread, NULL);
+#endif
+}
+
+void thread_set_affinity(thread_handle thread, uint32_t core)
+{
+#if defined(_WIN32)
+	SetThreadAffinityMask(thread, (DWORD_PTR)1 << (core % (sizeof(DWORD_PTR) * 8)));
+#elif defined(__linux__)
+	cpu_set_t set;
+	CPU_ZERO(&set);
+	CPU_SET(core % CPU_SETSIZE, &set);
+	pthread_setaffinity_np(thread, sizeof(set), &set);
+#else
+	(void)thread;
+	(void)core;
+#endif
+}
+
+uint32_t thread_core_count(void)
+{
+#if defined(_WIN32)
+	SYSTEM_INFO info;
+	GetSystemInfo(&info);
+	return info.dwNumberOfProcessors > 0 ? (uint32_t)info.dwNumberOfProcessors : 1;
+#else
+	long count = sysconf(_SC_NPROCESSORS_ONLN);
+	return count > 0 ? (uint32_t)count : 1;
+#endif
+}
+
+void thread_yield(void)
+{
+#if defined(_WIN32)
+	SwitchToThread();
+#else
+	sched_yield();
+#endif
+}
+
+void thread_sleep_ms(uint32_t ms)
+{
+#if defined(_WIN32)
+	Sleep(ms);
+#else
+	struct timespec ts = {.tv_sec = ms / 1000, .tv_nsec = (long)(ms % 1000) * 1000000L};
+	nanosleep(&ts, NULL);
+#endif
+}
+
+// spin-wait hint, keeps the hyperthread sibling fed while polling an atomic
+static inline void thread_pause(void)
+{
+#if defined(_WIN32) || defined(__x86_64__) || defined(__i386__)
+	_mm_pause();
+#endif
+}
+
+bool semaphore_create(semaphore_handle* semaphore, uint32_t initial_count)
+{
+#if defined(_WIN32)
+	*semaphore = CreateSemaphoreW(NULL, (LONG)initial_count, LONG_MAX, NULL);
+	return *semaphore != NULL;
+#else
+	return sem_init(semaphore, 0, initial_count) == 0;
+#endif
+}
+
+void semaphore_destroy(semaphore_handle* semaphore)
+{
+#if defined(_WIN32)
+	CloseHandle(*semaphore);
+	*semaphore = NULL;
+#else
+	sem_destroy(semaphore);
+#endif
+}
+
+void semaphore_post(semaphore_handle* semaphore, uint32_t count)
+{
+#if defined(_WIN32)
+	ReleaseSemaphore(*semaphore, (LONG)count, NULL);
+#else
+	for (uint32_t i = 0; i < count; ++i)
+		sem_post(semaphore);
+#endif
+}
+
+// returns false on timeout
+bool semaphore_wait(semaphore_handle* semaphore, uint32_t timeout_ms)
+{
+#if defined(_WIN32)
+	return WaitForSingleObject(*semaphore, timeout_ms) == WAIT_OBJECT_0;
+#else
+	struct timespec deadline;
+	clock_gettime(CLOCK_REALTIME, &deadline);
+	deadline.tv_sec += timeout_ms / 1000;
+	deadline.tv_nsec += (long)(timeout_ms % 1000) * 1000000L;
+	if (deadline.tv_nsec >= 1000000000L) {
+		deadline.tv_sec += 1;
+		deadline.tv_nsec -= 1000000000L;
+	}
+	while (sem_timedwait(semaphore, &deadline) != 0) {
+		if (errno != EINTR) return false;
+	}
+	return true;
+#endif
+}
+
+uint64_t time_now_ns(void)
+{
+#if defined(_WIN32)
+	static LONGLONG frequency = 0;
+	if (frequency == 0) {
+		LARGE_INTEGER tmp;
+		QueryPerformanceFrequency(&tmp);
+		frequency = tmp.QuadPart;
+	}
+	LARGE_INTEGER counter;
+	QueryPerformanceCounter(&counter);
+	return (uint64_t)(counter.QuadPart / frequency) * 1000000000ull +
+	       (uint64_t)(counter.QuadPart % frequency) * 1000000000ull / (uint64_t)frequency;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_MONOTONIC, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
+
+// CPU time used by every thread of the process, user and kernel.
+uint64_t process_cpu_time_ns(void)
+{
+#if defined(_WIN32)
+	FILETIME creation, exit, kernel, user;
+	if (!GetProcessTimes(GetCurrentProcess(), &creation, &exit, &kernel, &user)) return 0;
+	uint64_t kernel_100ns = ((uint64_t)kernel.dwHighDateTime << 32) | kernel.dwLowDateTime;
+	uint64_t user_100ns = ((uint64_t)user.dwHighDateTime << 32) | user.dwLowDateTime;
+	return (kernel_100ns + user_100ns) * 100;
+#else
+	struct timespec ts;
+	clock_gettime(CLOCK_PROCESS_CPUTIME_ID, &ts);
+	return (uint64_t)ts.tv_sec * 1000000000ull + (uint64_t)ts.tv_nsec;
+#endif
+}
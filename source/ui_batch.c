@@ -0,0 +1,166 @@
+// ImGui draw command coalescing.
+// A CPU-only pass over ImDrawData that turns the per-list command streams into one list of draws
+// over a packed index buffer. Commands with an empty or off-screen clip rectangle are dropped,
+// and adjacent commands with the same texture and scissor merge into one draw, across ImDrawList
+// boundaries too. Lists sit back to back in the vertex buffer, so a run of lists shares one base
+// vertex and their indices are rebased while being copied; a new run starts wherever the rebased
+// indices would no longer fit ImDrawIdx. User callbacks pass through in order and never merge.
+// No graphics API in here.
+
+#define UI_BATCH_INDEX_RANGE (sizeof(ImDrawIdx) == 2 ? 0x10000u : 0xffffffffu)
+
+struct ui_batch
+{
+	const ImDrawList* list;   // callbacks only
+	const ImDrawCmd* callback; // set: run the callback instead of drawing
+	uint32_t texture;
+	int32_t scissor[4];       // left, top, right, bottom, relative to DisplayPos
+	uint32_t index_offset;    // into the packed index buffer
+	uint32_t index_count;
+	int32_t vertex_offset;    // base vertex of the run
+};
+
+// One kept command's indices, copied to `offset` in the packed buffer with `bias` added.
+struct ui_index_copy
+{
+	const ImDrawIdx* source;
+	uint32_t count;
+	uint32_t offset;
+	uint32_t bias;
+};
+
+struct ui_batches
+{
+	struct ui_batch* batches;
+	uint32_t batch_count;
+	uint32_t batch_capacity;
+	struct ui_index_copy* copies;
+	uint32_t copy_count;
+	uint32_t copy_capacity;
+	uint32_t index_count; // packed
+
+	uint32_t command_count; // draw commands in, callbacks excluded
+	uint32_t culled_count;
+};
+
+static bool ui_batches_reserve(void** data, uint32_t* capacity, uint32_t count, size_t elem_size)
+{
+	if (count <= *capacity) return true;
+	uint32_t new_capacity = *capacity ? *capacity * 2 : 256;
+	while (new_capacity < count) new_capacity *= 2;
+	void* grown = realloc(*data, new_capacity * elem_size);
+	if (!grown) return false;
+	*data = grown;
+	*capacity = new_capacity;
+	return true;
+}
+
+static struct ui_batch* ui_batches_push(struct ui_batches* out)
+{
+	if (!ui_batches_reserve((void**)&out->batches, &out->batch_capacity, out->batch_count + 1, sizeof(struct ui_batch)))
+		return NULL;
+	struct ui_batch* batch = &out->batches[out->batch_count++];
+	memset(batch, 0, sizeof(*batch));
+	return batch;
+}
+
+// Scissor in integer pixels clamped to the display, false if nothing of it is visible.
+static bool ui_batch_scissor(const ImDrawData* draw_data, const ImDrawCmd* cmd, int32_t scissor[4])
+{
+	float left = cmd->ClipRect.x - draw_data->DisplayPos.x;
+	float top = cmd->ClipRect.y - draw_data->DisplayPos.y;
+	float right = cmd->ClipRect.z - draw_data->DisplayPos.x;
+	float bottom = cmd->ClipRect.w - draw_data->DisplayPos.y;
+	scissor[0] = left > 0.0f ? (int32_t)left : 0;
+	scissor[1] = top > 0.0f ? (int32_t)top : 0;
+	scissor[2] = right < draw_data->DisplaySize.x ? (int32_t)right : (int32_t)draw_data->DisplaySize.x;
+	scissor[3] = bottom < draw_data->DisplaySize.y ? (int32_t)bottom : (int32_t)draw_data->DisplaySize.y;
+	return scissor[2] > scissor[0] && scissor[3] > scissor[1];
+}
+
+bool ui_batches_build(struct ui_batches* out, const ImDrawData* draw_data)
+{
+	out->batch_count = 0;
+	out->copy_count = 0;
+	out->index_count = 0;
+	out->command_count = 0;
+	out->culled_count = 0;
+
+	uint32_t list_vertex_base = 0; // where the list starts in the merged vertex buffer
+	uint32_t run_base = 0;
+	for (int n = 0; n < draw_data->CmdListsCount; n++) {
+		const ImDrawList* list = draw_data->CmdLists[n];
+		for (int i = 0; i < list->CmdBuffer.Size; i++) {
+			const ImDrawCmd* cmd = &list->CmdBuffer.Data[i];
+			if (cmd->UserCallback) {
+				struct ui_batch* batch = ui_batches_push(out);
+				if (!batch) return false;
+				batch->list = list;
+				batch->callback = cmd;
+				continue;
+			}
+
+			out->command_count++;
+			int32_t scissor[4];
+			if (cmd->ElemCount == 0 || !ui_batch_scissor(draw_data, cmd, scissor)) {
+				out->culled_count++;
+				continue;
+			}
+
+			// highest index the command can use, so the rebased indices are known to fit
+			uint32_t first_vertex = list_vertex_base + cmd->VtxOffset;
+			uint32_t span = (uint32_t)list->VtxBuffer.Size - cmd->VtxOffset;
+			if (span > UI_BATCH_INDEX_RANGE) span = UI_BATCH_INDEX_RANGE;
+			if (first_vertex - run_base > UI_BATCH_INDEX_RANGE - span) run_base = first_vertex;
+
+			if (!ui_batches_reserve((void**)&out->copies, &out->copy_capacity, out->copy_count + 1, sizeof(struct ui_index_copy)))
+				return false;
+			out->copies[out->copy_count++] = (struct ui_index_copy){
+				.source = list->IdxBuffer.Data + cmd->IdxOffset,
+				.count = cmd->ElemCount,
+				.offset = out->index_count,
+				.bias = first_vertex - run_base,
+			};
+
+			uint32_t texture = (uint32_t)(uintptr_t)cmd->TextureId;
+			struct ui_batch* last = out->batch_count ? &out->batches[out->batch_count - 1] : NULL;
+			if (last && !last->callback && last->texture == texture && last->vertex_offset == (int32_t)run_base &&
+			    memcmp(last->scissor, scissor, sizeof(scissor)) == 0) {
+				last->index_count += cmd->ElemCount;
+			} else {
+				struct ui_batch* batch = ui_batches_push(out);
+				if (!batch) return false;
+				batch->texture = texture;
+				memcpy(batch->scissor, scissor, sizeof(scissor));
+				batch->index_offset = out->index_count;
+				batch->index_count = cmd->ElemCount;
+				batch->vertex_offset = (int32_t)run_base;
+			}
+			out->index_count += cmd->ElemCount;
+		}
+		list_vertex_base += (uint32_t)list->VtxBuffer.Size;
+	}
+	return true;
+}
+
+// Copies ui_index_copy entries [begin, end) into the packed buffer, split across threads freely.
+void ui_batches_copy_indices(const struct ui_batches* batches, ImDrawIdx* dst, uint32_t begin, uint32_t end)
+{
+	for (uint32_t i = begin; i < end; i++) {
+		const struct ui_index_copy* copy = &batches->copies[i];
+		ImDrawIdx* out = dst + copy->offset;
+		if (copy->bias == 0) {
+			memcpy(out, copy->source, copy->count * sizeof(ImDrawIdx));
+		} else {
+			for (uint32_t k = 0; k < copy->count; k++)
+				out[k] = (ImDrawIdx)(copy->source[k] + copy->bias);
+		}
+	}
+}
+
+void ui_batches_free(struct ui_batches* batches)
+{
+	free(batches->batches);
+	free(batches->copies);
+	memset(batches, 0, sizeof(*batches));
+}
@@ -0,0 +1,187 @@
+// Persistently mapped upload ring.
+// One upload heap buffer, mapped once at creation and never unmapped. Allocations carve the buffer
+// front to back and wrap; each frame records how far the head got, and the space behind it is
+// reclaimed once the frame fence that covered it has completed, so the ring is keyed to the real
+// GPU progress rather than to a fixed frames-in-flight count. When a request does not fit, a buffer
+// twice the size replaces it and the old one is released after the current frame's fence, no stall.
+// Any number of allocations per frame, from one thread.
+
+#define UPLOAD_RING_MAX_FRAMES 16 // frames in flight the ring can track
+#define UPLOAD_RING_MAX_RETIRED 8 // grown-out-of buffers still referenced by the GPU
+
+struct upload_allocation
+{
+	void* cpu;
+	D3D12_GPU_VIRTUAL_ADDRESS gpu;
+};
+
+struct upload_ring
+{
+	ID3D12Device* device;
+	ID3D12Resource* buffer;
+	uint8_t* cpu;
+	D3D12_GPU_VIRTUAL_ADDRESS gpu;
+	uint64_t size;
+
+	// monotonic byte positions, offset in the buffer is position % size
+	uint64_t head;
+	uint64_t tail;
+
+	uint64_t frame_fence; // value the frame being recorded will signal
+	uint32_t frame_first;
+	uint32_t frame_count;
+	struct
+	{
+		uint64_t fence;
+		uint64_t head;
+	} frames[UPLOAD_RING_MAX_FRAMES];
+
+	uint32_t retired_count;
+	struct
+	{
+		ID3D12Resource* buffer;
+		uint64_t fence;
+	} retired[UPLOAD_RING_MAX_RETIRED];
+
+	// stats
+	uint64_t frame_bytes;
+	uint32_t grow_count;
+};
+
+static bool upload_ring_create_buffer(struct upload_ring* ring, uint64_t size)
+{
+	D3D12_HEAP_PROPERTIES props = {.Type = D3D12_HEAP_TYPE_UPLOAD};
+	D3D12_RESOURCE_DESC desc = {
+		.Dimension = D3D12_RESOURCE_DIMENSION_BUFFER,
+		.Width = size,
+		.Height = 1,
+		.DepthOrArraySize = 1,
+		.MipLevels = 1,
+		.Format = DXGI_FORMAT_UNKNOWN,
+		.SampleDesc = {.Count = 1},
+		.Layout = D3D12_TEXTURE_LAYOUT_ROW_MAJOR,
+	};
+
+	ID3D12Resource* buffer = NULL;
+	if (FAILED(ring->device->lpVtbl->CreateCommittedResource(ring->device, &props, D3D12_HEAP_FLAG_NONE, &desc,
+								 D3D12_RESOURCE_STATE_GENERIC_READ, NULL,
+								 &IID_ID3D12Resource, (void**)&buffer)))
+		return false;
+
+	// the CPU never reads it back, empty read range
+	void* mapped = NULL;
+	if (FAILED(buffer->lpVtbl->Map(buffer, 0, &(D3D12_RANGE){0, 0}, &mapped))) {
+		buffer->lpVtbl->Release(buffer);
+		return false;
+	}
+	buffer->lpVtbl->SetName(buffer, L"upload_ring");
+
+	ring->buffer = buffer;
+	ring->cpu = mapped;
+	ring->gpu = buffer->lpVtbl->GetGPUVirtualAddress(buffer);
+	ring->size = size;
+	ring->head = ring->tail = 0;
+	ring->frame_first = ring->frame_count = 0;
+	return true;
+}
+
+bool upload_ring_init(struct upload_ring* ring, ID3D12Device* device, uint64_t size)
+{
+	memset(ring, 0, sizeof(*ring));
+	ring->device = device;
+	return upload_ring_create_buffer(ring, size);
+}
+
+// The GPU must be idle.
+void upload_ring_destroy(struct upload_ring* ring)
+{
+	for (uint32_t i = 0; i < ring->retired_count; ++i)
+		ring->retired[i].buffer->lpVtbl->Release(ring->retired[i].buffer);
+	ring->retired_count = 0;
+	if (ring->buffer) {
+		ring->buffer->lpVtbl->Unmap(ring->buffer, 0, NULL);
+		ring->buffer->lpVtbl->Release(ring->buffer);
+		ring->buffer = NULL;
+	}
+	ring->cpu = NULL;
+}
+
+// Before recording a frame. frame_fence is the value the queue will signal after this frame's
+// command lists, completed_fence the fence's current completed value.
+void upload_ring_begin_frame(struct upload_ring* ring, uint64_t frame_fence, uint64_t completed_fence)
+{
+	while (ring->frame_count && ring->frames[ring->frame_first].fence <= completed_fence) {
+		ring->tail = ring->frames[ring->frame_first].head;
+		ring->frame_first = (ring->frame_first + 1) % UPLOAD_RING_MAX_FRAMES;
+		ring->frame_count--;
+	}
+
+	uint32_t kept = 0;
+	for (uint32_t i = 0; i < ring->retired_count; ++i) {
+		if (ring->retired[i].fence <= completed_fence)
+			ring->retired[i].buffer->lpVtbl->Release(ring->retired[i].buffer);
+		else
+			ring->retired[kept++] = ring->retired[i];
+	}
+	ring->retired_count = kept;
+
+	ring->frame_fence = frame_fence;
+	ring->frame_bytes = 0;
+}
+
+// After the frame's fence value was signalled.
+void upload_ring_end_frame(struct upload_ring* ring)
+{
+	if (ring->frame_count == UPLOAD_RING_MAX_FRAMES) {
+		// more frames in flight than tracked, fold the oldest into the next one
+		ring->frame_first = (ring->frame_first + 1) % UPLOAD_RING_MAX_FRAMES;
+		ring->frame_count--;
+	}
+	uint32_t last = (ring->frame_first + ring->frame_count) % UPLOAD_RING_MAX_FRAMES;
+	ring->frames[last].fence = ring->frame_fence;
+	ring->frames[last].head = ring->head;
+	ring->frame_count++;
+}
+
+static bool upload_ring_grow(struct upload_ring* ring, uint64_t min_size)
+{
+	if (ring->retired_count == UPLOAD_RING_MAX_RETIRED) return false;
+
+	uint64_t size = ring->size * 2;
+	while (size < min_size) size *= 2;
+
+	ID3D12Resource* old = ring->buffer;
+	if (!upload_ring_create_buffer(ring, size)) {
+		ring->buffer = old;
+		return false;
+	}
+	// allocations already made this frame stay valid in the old buffer until the frame retires
+	ring->retired[ring->retired_count].buffer = old;
+	ring->retired[ring->retired_count].fence = ring->frame_fence;
+	ring->retired_count++;
+	ring->grow_count++;
+	return true;
+}
+
+// align must be a power of two. Returns a NULL cpu pointer if the ring can neither fit nor grow.
+struct upload_allocation upload_ring_alloc(struct upload_ring* ring, uint64_t size, uint64_t align)
+{
+	for (;;) {
+		uint64_t offset = (ring->head % ring->size + align - 1) & ~(align - 1);
+		uint64_t position = ring->head - ring->head % ring->size + offset;
+		if (offset + size > ring->size) {
+			// does not fit before the end, skip to the start of the buffer
+			position = ring->head - ring->head % ring->size + ring->size;
+			offset = 0;
+		}
+
+		if (size <= ring->size && position + size - ring->tail <= ring->size) {
+			ring->head = position + size;
+			ring->frame_bytes += size;
+			return (struct upload_allocation){.cpu = ring->cpu + offset, .gpu = ring->gpu + offset};
+		}
+
+		// the new buffer's first allocation is at offset 0, no alignment slack needed
+		if (!upload_ring_grow(ring, size * 2)) return (struct upload_allocation){0};
+	}
+}
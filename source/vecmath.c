@@ -0,0 +1,586 @@
+// Vector, matrix and quaternion math.
+// Types follow the HLSL constant buffer rules so they can be copied into root constants and cbuffers
+// as they are: vec4, quat and mat4 are 16 byte aligned, vec3 is 12 bytes and packs with a following
+// float like a float3 does, and a mat4 is four columns, what HLSL's default column_major packing of a
+// float4x4 expects, so mul(m, v) in a shader is mat4_transform(m, v) here. Projections are left-handed
+// with depth in [0, 1].
+// Single values go through SSE when the target has it (x86-64 always does) or plain C otherwise.
+// The batch kernels pick AVX2 + FMA at runtime when the CPU and OS support it, without building the
+// whole game for AVX2. The _scalar variants are always compiled, as a reference for the others.
+
+#include <math.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+
+#if !defined(VECMATH_FORCE_SCALAR) && (defined(__SSE2__) || defined(_M_X64))
+#define VECMATH_SSE 1
+#include <immintrin.h>
+#else
+#define VECMATH_SSE 0
+#endif
+
+#if VECMATH_SSE && (defined(__x86_64__) || defined(__i386__)) && (defined(__clang__) || defined(__GNUC__))
+#define VECMATH_AVX2 1
+#include <cpuid.h>
+#define VECMATH_TARGET_AVX2 __attribute__((target("avx2,fma")))
+#else
+#define VECMATH_AVX2 0
+#endif
+
+#define VECMATH_PI 3.14159265358979323846f
+
+struct vec3
+{
+	float x, y, z;
+};
+
+struct vec4
+{
+	_Alignas(16) float x;
+	float y, z, w;
+};
+
+struct quat
+{
+	_Alignas(16) float x;
+	float y, z, w;
+};
+
+struct mat4
+{
+	struct vec4 columns[4];
+};
+
+// Structure of arrays view of count vec4s, for the batch kernels.
+struct vec4_soa
+{
+	float* x;
+	float* y;
+	float* z;
+	float* w;
+};
+
+_Static_assert(sizeof(struct vec3) == 12, "vec3 must match an HLSL float3");
+_Static_assert(sizeof(struct vec4) == 16, "vec4 must match an HLSL float4");
+_Static_assert(sizeof(struct mat4) == 64, "mat4 must match an HLSL float4x4");
+
+// vec3
+
+static inline struct vec3 vec3_make(float x, float y, float z) { return (struct vec3){x, y, z}; }
+static inline struct vec3 vec3_add(struct vec3 a, struct vec3 b) { return (struct vec3){a.x + b.x, a.y + b.y, a.z + b.z}; }
+static inline struct vec3 vec3_sub(struct vec3 a, struct vec3 b) { return (struct vec3){a.x - b.x, a.y - b.y, a.z - b.z}; }
+static inline struct vec3 vec3_mul(struct vec3 a, struct vec3 b) { return (struct vec3){a.x * b.x, a.y * b.y, a.z * b.z}; }
+static inline struct vec3 vec3_scale(struct vec3 a, float s) { return (struct vec3){a.x * s, a.y * s, a.z * s}; }
+static inline float vec3_dot(struct vec3 a, struct vec3 b) { return a.x * b.x + a.y * b.y + a.z * b.z; }
+static inline float vec3_length(struct vec3 a) { return sqrtf(vec3_dot(a, a)); }
+
+static inline struct vec3 vec3_cross(struct vec3 a, struct vec3 b)
+{
+	return (struct vec3){a.y * b.z - a.z * b.y, a.z * b.x - a.x * b.z, a.x * b.y - a.y * b.x};
+}
+
+// Zero stays zero.
+static inline struct vec3 vec3_normalize(struct vec3 a)
+{
+	float length = vec3_length(a);
+	return length > 0.0f ? vec3_scale(a, 1.0f / length) : a;
+}
+
+static inline struct vec3 vec3_lerp(struct vec3 a, struct vec3 b, float t)
+{
+	return vec3_add(a, vec3_scale(vec3_sub(b, a), t));
+}
+
+// vec4
+
+#if VECMATH_SSE
+static inline __m128 vec4_load(struct vec4 a) { return _mm_load_ps(&a.x); }
+static inline struct vec4 vec4_store(__m128 v)
+{
+	struct vec4 result;
+	_mm_store_ps(&result.x, v);
+	return result;
+}
+#endif
+
+static inline struct vec4 vec4_make(float x, float y, float z, float w) { return (struct vec4){x, y, z, w}; }
+static inline struct vec4 vec4_from_vec3(struct vec3 a, float w) { return (struct vec4){a.x, a.y, a.z, w}; }
+static inline struct vec3 vec4_xyz(struct vec4 a) { return (struct vec3){a.x, a.y, a.z}; }
+
+static inline struct vec4 vec4_add(struct vec4 a, struct vec4 b)
+{
+#if VECMATH_SSE
+	return vec4_store(_mm_add_ps(vec4_load(a), vec4_load(b)));
+#else
+	return (struct vec4){a.x + b.x, a.y + b.y, a.z + b.z, a.w + b.w};
+#endif
+}
+
+static inline struct vec4 vec4_sub(struct vec4 a, struct vec4 b)
+{
+#if VECMATH_SSE
+	return vec4_store(_mm_sub_ps(vec4_load(a), vec4_load(b)));
+#else
+	return (struct vec4){a.x - b.x, a.y - b.y, a.z - b.z, a.w - b.w};
+#endif
+}
+
+static inline struct vec4 vec4_mul(struct vec4 a, struct vec4 b)
+{
+#if VECMATH_SSE
+	return vec4_store(_mm_mul_ps(vec4_load(a), vec4_load(b)));
+#else
+	return (struct vec4){a.x * b.x, a.y * b.y, a.z * b.z, a.w * b.w};
+#endif
+}
+
+static inline struct vec4 vec4_scale(struct vec4 a, float s)
+{
+#if VECMATH_SSE
+	return vec4_store(_mm_mul_ps(vec4_load(a), _mm_set1_ps(s)));
+#else
+	return (struct vec4){a.x * s, a.y * s, a.z * s, a.w * s};
+#endif
+}
+
+static inline float vec4_dot(struct vec4 a, struct vec4 b)
+{
+#if VECMATH_SSE && defined(__SSE4_1__)
+	return _mm_cvtss_f32(_mm_dp_ps(vec4_load(a), vec4_load(b), 0xf1));
+#else
+	return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w;
+#endif
+}
+
+static inline float vec4_length(struct vec4 a) { return sqrtf(vec4_dot(a, a)); }
+
+static inline struct vec4 vec4_normalize(struct vec4 a)
+{
+	float length = vec4_length(a);
+	return length > 0.0f ? vec4_scale(a, 1.0f / length) : a;
+}
+
+static inline struct vec4 vec4_lerp(struct vec4 a, struct vec4 b, float t)
+{
+	return vec4_add(a, vec4_scale(vec4_sub(b, a), t));
+}
+
+// mat4
+
+static inline struct mat4 mat4_identity(void)
+{
+	return (struct mat4){{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {0, 0, 0, 1}}};
+}
+
+static inline struct vec4 mat4_transform(const struct mat4* m, struct vec4 v)
+{
+#if VECMATH_SSE
+	__m128 x = _mm_mul_ps(_mm_load_ps(&m->columns[0].x), _mm_set1_ps(v.x));
+	__m128 y = _mm_mul_ps(_mm_load_ps(&m->columns[1].x), _mm_set1_ps(v.y));
+	__m128 z = _mm_mul_ps(_mm_load_ps(&m->columns[2].x), _mm_set1_ps(v.z));
+	__m128 w = _mm_mul_ps(_mm_load_ps(&m->columns[3].x), _mm_set1_ps(v.w));
+	return vec4_store(_mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w)));
+#else
+	const struct vec4* c = m->columns;
+	return (struct vec4){
+		c[0].x * v.x + c[1].x * v.y + c[2].x * v.z + c[3].x * v.w,
+		c[0].y * v.x + c[1].y * v.y + c[2].y * v.z + c[3].y * v.w,
+		c[0].z * v.x + c[1].z * v.y + c[2].z * v.z + c[3].z * v.w,
+		c[0].w * v.x + c[1].w * v.y + c[2].w * v.z + c[3].w * v.w,
+	};
+#endif
+}
+
+static inline struct vec3 mat4_transform_point(const struct mat4* m, struct vec3 p)
+{
+	return vec4_xyz(mat4_transform(m, vec4_from_vec3(p, 1.0f)));
+}
+
+static inline struct vec3 mat4_transform_direction(const struct mat4* m, struct vec3 d)
+{
+	return vec4_xyz(mat4_transform(m, vec4_from_vec3(d, 0.0f)));
+}
+
+// a * b, b applied first. Each column of the result is a transforming a column of b.
+static inline struct mat4 mat4_mul(const struct mat4* a, const struct mat4* b)
+{
+	struct mat4 result;
+	for (int i = 0; i < 4; ++i) result.columns[i] = mat4_transform(a, b->columns[i]);
+	return result;
+}
+
+static inline struct mat4 mat4_transpose(const struct mat4* m)
+{
+#if VECMATH_SSE
+	__m128 c0 = _mm_load_ps(&m->columns[0].x);
+	__m128 c1 = _mm_load_ps(&m->columns[1].x);
+	__m128 c2 = _mm_load_ps(&m->columns[2].x);
+	__m128 c3 = _mm_load_ps(&m->columns[3].x);
+	_MM_TRANSPOSE4_PS(c0, c1, c2, c3);
+	return (struct mat4){{vec4_store(c0), vec4_store(c1), vec4_store(c2), vec4_store(c3)}};
+#else
+	const struct vec4* c = m->columns;
+	return (struct mat4){{{c[0].x, c[1].x, c[2].x, c[3].x},
+			      {c[0].y, c[1].y, c[2].y, c[3].y},
+			      {c[0].z, c[1].z, c[2].z, c[3].z},
+			      {c[0].w, c[1].w, c[2].w, c[3].w}}};
+#endif
+}
+
+static inline struct mat4 mat4_translation(struct vec3 t)
+{
+	return (struct mat4){{{1, 0, 0, 0}, {0, 1, 0, 0}, {0, 0, 1, 0}, {t.x, t.y, t.z, 1}}};
+}
+
+static inline struct mat4 mat4_scaling(struct vec3 s)
+{
+	return (struct mat4){{{s.x, 0, 0, 0}, {0, s.y, 0, 0}, {0, 0, s.z, 0}, {0, 0, 0, 1}}};
+}
+
+// Maps [left, right] x [bottom, top] x [near_z, far_z] to clip space, depth to [0, 1].
+static inline struct mat4 mat4_ortho(float left, float right, float bottom, float top, float near_z, float far_z)
+{
+	return (struct mat4){{{2.0f / (right - left), 0, 0, 0},
+			      {0, 2.0f / (top - bottom), 0, 0},
+			      {0, 0, 1.0f / (far_z - near_z), 0},
+			      {(left + right) / (left - right), (top + bottom) / (bottom - top), near_z / (near_z - far_z), 1}}};
+}
+
+// Vertical field of view in radians.
+static inline struct mat4 mat4_perspective(float fov_y, float aspect, float near_z, float far_z)
+{
+	float y = 1.0f / tanf(fov_y * 0.5f);
+	float range = far_z / (far_z - near_z);
+	return (struct mat4){{{y / aspect, 0, 0, 0},
+			      {0, y, 0, 0},
+			      {0, 0, range, 1},
+			      {0, 0, -near_z * range, 0}}};
+}
+
+static inline struct mat4 mat4_look_at(struct vec3 eye, struct vec3 target, struct vec3 up)
+{
+	struct vec3 z = vec3_normalize(vec3_sub(target, eye));
+	struct vec3 x = vec3_normalize(vec3_cross(up, z));
+	struct vec3 y = vec3_cross(z, x);
+	return (struct mat4){{{x.x, y.x, z.x, 0},
+			      {x.y, y.y, z.y, 0},
+			      {x.z, y.z, z.z, 0},
+			      {-vec3_dot(x, eye), -vec3_dot(y, eye), -vec3_dot(z, eye), 1}}};
+}
+
+// Inverse of rotation, uniform or non-uniform scale and translation, no projection.
+static inline struct mat4 mat4_inverse_affine(const struct mat4* m)
+{
+	struct vec3 x = vec4_xyz(m->columns[0]);
+	struct vec3 y = vec4_xyz(m->columns[1]);
+	struct vec3 z = vec4_xyz(m->columns[2]);
+	struct vec3 t = vec4_xyz(m->columns[3]);
+	// rows of the inverse 3x3 are the cross products over the determinant
+	struct vec3 r0 = vec3_cross(y, z);
+	struct vec3 r1 = vec3_cross(z, x);
+	struct vec3 r2 = vec3_cross(x, y);
+	float inv_det = 1.0f / vec3_dot(x, r0);
+	r0 = vec3_scale(r0, inv_det);
+	r1 = vec3_scale(r1, inv_det);
+	r2 = vec3_scale(r2, inv_det);
+	return (struct mat4){{{r0.x, r1.x, r2.x, 0},
+			      {r0.y, r1.y, r2.y, 0},
+			      {r0.z, r1.z, r2.z, 0},
+			      {-vec3_dot(r0, t), -vec3_dot(r1, t), -vec3_dot(r2, t), 1}}};
+}
+
+// quat, unit quaternions as rotations, w is the scalar part
+
+static inline struct quat quat_identity(void) { return (struct quat){0, 0, 0, 1}; }
+
+static inline struct quat quat_axis_angle(struct vec3 axis, float radians)
+{
+	struct vec3 a = vec3_scale(vec3_normalize(axis), sinf(radians * 0.5f));
+	return (struct quat){a.x, a.y, a.z, cosf(radians * 0.5f)};
+}
+
+// a * b, b applied first.
+static inline struct quat quat_mul(struct quat a, struct quat b)
+{
+	return (struct quat){
+		a.w * b.x + a.x * b.w + a.y * b.z - a.z * b.y,
+		a.w * b.y - a.x * b.z + a.y * b.w + a.z * b.x,
+		a.w * b.z + a.x * b.y - a.y * b.x + a.z * b.w,
+		a.w * b.w - a.x * b.x - a.y * b.y - a.z * b.z,
+	};
+}
+
+static inline float quat_dot(struct quat a, struct quat b) { return a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w; }
+static inline struct quat quat_conjugate(struct quat q) { return (struct quat){-q.x, -q.y, -q.z, q.w}; }
+
+static inline struct quat quat_normalize(struct quat q)
+{
+	float length = sqrtf(quat_dot(q, q));
+	if (length <= 0.0f) return quat_identity();
+	float s = 1.0f / length;
+	return (struct quat){q.x * s, q.y * s, q.z * s, q.w * s};
+}
+
+static inline struct vec3 quat_rotate(struct quat q, struct vec3 v)
+{
+	// v + 2w(u x v) + 2u x (u x v)
+	struct vec3 u = {q.x, q.y, q.z};
+	struct vec3 t = vec3_scale(vec3_cross(u, v), 2.0f);
+	return vec3_add(vec3_add(v, vec3_scale(t, q.w)), vec3_cross(u, t));
+}
+
+// Normalized lerp along the shorter arc, enough for small steps and animation blending.
+static inline struct quat quat_nlerp(struct quat a, struct quat b, float t)
+{
+	float s = quat_dot(a, b) < 0.0f ? -t : t;
+	return quat_normalize((struct quat){a.x + (b.x * s - a.x * t), a.y + (b.y * s - a.y * t),
+					    a.z + (b.z * s - a.z * t), a.w + (b.w * s - a.w * t)});
+}
+
+static inline struct quat quat_slerp(struct quat a, struct quat b, float t)
+{
+	float cos_theta = quat_dot(a, b);
+	if (cos_theta < 0.0f) {
+		b = (struct quat){-b.x, -b.y, -b.z, -b.w};
+		cos_theta = -cos_theta;
+	}
+	if (cos_theta > 0.9995f) return quat_nlerp(a, b, t); // nearly parallel, sin(theta) would be 0
+	float theta = acosf(cos_theta);
+	float inv_sin = 1.0f / sinf(theta);
+	float wa = sinf((1.0f - t) * theta) * inv_sin;
+	float wb = sinf(t * theta) * inv_sin;
+	return (struct quat){a.x * wa + b.x * wb, a.y * wa + b.y * wb, a.z * wa + b.z * wb, a.w * wa + b.w * wb};
+}
+
+static inline struct mat4 mat4_from_quat(struct quat q)
+{
+	float xx = q.x * q.x, yy = q.y * q.y, zz = q.z * q.z;
+	float xy = q.x * q.y, xz = q.x * q.z, yz = q.y * q.z;
+	float wx = q.w * q.x, wy = q.w * q.y, wz = q.w * q.z;
+	return (struct mat4){{{1 - 2 * (yy + zz), 2 * (xy + wz), 2 * (xz - wy), 0},
+			      {2 * (xy - wz), 1 - 2 * (xx + zz), 2 * (yz + wx), 0},
+			      {2 * (xz + wy), 2 * (yz - wx), 1 - 2 * (xx + yy), 0},
+			      {0, 0, 0, 1}}};
+}
+
+// Translation * rotation * scale, the usual local transform.
+static inline struct mat4 mat4_trs(struct vec3 translation, struct quat rotation, struct vec3 scale)
+{
+	struct mat4 m = mat4_from_quat(rotation);
+	m.columns[0] = vec4_scale(m.columns[0], scale.x);
+	m.columns[1] = vec4_scale(m.columns[1], scale.y);
+	m.columns[2] = vec4_scale(m.columns[2], scale.z);
+	m.columns[3] = vec4_from_vec3(translation, 1.0f);
+	return m;
+}
+
+// Batch kernels
+
+// out[i] = m * in[i] over count SoA vectors. out may be in.
+void mat4_transform_soa_scalar(const struct mat4* m, struct vec4_soa in, struct vec4_soa out, size_t count)
+{
+	const struct vec4* c = m->columns;
+	for (size_t i = 0; i < count; ++i) {
+		float x = in.x[i], y = in.y[i], z = in.z[i], w = in.w[i];
+		out.x[i] = c[0].x * x + c[1].x * y + c[2].x * z + c[3].x * w;
+		out.y[i] = c[0].y * x + c[1].y * y + c[2].y * z + c[3].y * w;
+		out.z[i] = c[0].z * x + c[1].z * y + c[2].z * z + c[3].z * w;
+		out.w[i] = c[0].w * x + c[1].w * y + c[2].w * z + c[3].w * w;
+	}
+}
+
+// out[i] = a * b[i], a view projection times model matrices for example. out may be b.
+void mat4_mul_batch_scalar(const struct mat4* a, const struct mat4* b, struct mat4* out, size_t count)
+{
+	const struct vec4* c = a->columns;
+	for (size_t i = 0; i < count; ++i) {
+		struct mat4 result;
+		for (int j = 0; j < 4; ++j) {
+			struct vec4 v = b[i].columns[j];
+			result.columns[j] = (struct vec4){
+				c[0].x * v.x + c[1].x * v.y + c[2].x * v.z + c[3].x * v.w,
+				c[0].y * v.x + c[1].y * v.y + c[2].y * v.z + c[3].y * v.w,
+				c[0].z * v.x + c[1].z * v.y + c[2].z * v.z + c[3].z * v.w,
+				c[0].w * v.x + c[1].w * v.y + c[2].w * v.z + c[3].w * v.w,
+			};
+		}
+		out[i] = result;
+	}
+}
+
+#if VECMATH_SSE
+static void mat4_transform_soa_sse(const struct mat4* m, struct vec4_soa in, struct vec4_soa out, size_t count)
+{
+	// the 16 coefficients stay in registers, 4 vectors per iteration
+	__m128 k[4][4];
+	for (int c = 0; c < 4; ++c) {
+		const float* column = &m->columns[c].x;
+		for (int r = 0; r < 4; ++r) k[c][r] = _mm_set1_ps(column[r]);
+	}
+	size_t i = 0;
+	for (; i + 4 <= count; i += 4) {
+		__m128 x = _mm_loadu_ps(in.x + i);
+		__m128 y = _mm_loadu_ps(in.y + i);
+		__m128 z = _mm_loadu_ps(in.z + i);
+		__m128 w = _mm_loadu_ps(in.w + i);
+		float* outs[4] = {out.x, out.y, out.z, out.w};
+		for (int r = 0; r < 4; ++r) {
+			__m128 v = _mm_add_ps(_mm_add_ps(_mm_mul_ps(k[0][r], x), _mm_mul_ps(k[1][r], y)),
+					      _mm_add_ps(_mm_mul_ps(k[2][r], z), _mm_mul_ps(k[3][r], w)));
+			_mm_storeu_ps(outs[r] + i, v);
+		}
+	}
+	mat4_transform_soa_scalar(m, (struct vec4_soa){in.x + i, in.y + i, in.z + i, in.w + i},
+				  (struct vec4_soa){out.x + i, out.y + i, out.z + i, out.w + i}, count - i);
+}
+
+static void mat4_mul_batch_sse(const struct mat4* a, const struct mat4* b, struct mat4* out, size_t count)
+{
+	__m128 c0 = _mm_load_ps(&a->columns[0].x);
+	__m128 c1 = _mm_load_ps(&a->columns[1].x);
+	__m128 c2 = _mm_load_ps(&a->columns[2].x);
+	__m128 c3 = _mm_load_ps(&a->columns[3].x);
+	for (size_t i = 0; i < count; ++i) {
+		__m128 result[4];
+		for (int j = 0; j < 4; ++j) {
+			__m128 v = _mm_load_ps(&b[i].columns[j].x);
+			__m128 x = _mm_mul_ps(c0, _mm_shuffle_ps(v, v, _MM_SHUFFLE(0, 0, 0, 0)));
+			__m128 y = _mm_mul_ps(c1, _mm_shuffle_ps(v, v, _MM_SHUFFLE(1, 1, 1, 1)));
+			__m128 z = _mm_mul_ps(c2, _mm_shuffle_ps(v, v, _MM_SHUFFLE(2, 2, 2, 2)));
+			__m128 w = _mm_mul_ps(c3, _mm_shuffle_ps(v, v, _MM_SHUFFLE(3, 3, 3, 3)));
+			result[j] = _mm_add_ps(_mm_add_ps(x, y), _mm_add_ps(z, w));
+		}
+		for (int j = 0; j < 4; ++j) _mm_store_ps(&out[i].columns[j].x, result[j]);
+	}
+}
+#endif
+
+#if VECMATH_AVX2
+VECMATH_TARGET_AVX2 static void mat4_transform_soa_avx2(const struct mat4* m, struct vec4_soa in, struct vec4_soa out, size_t count)
+{
+	__m256 k[4][4];
+	for (int c = 0; c < 4; ++c) {
+		const float* column = &m->columns[c].x;
+		for (int r = 0; r < 4; ++r) k[c][r] = _mm256_set1_ps(column[r]);
+	}
+	size_t i = 0;
+	for (; i + 8 <= count; i += 8) {
+		__m256 x = _mm256_loadu_ps(in.x + i);
+		__m256 y = _mm256_loadu_ps(in.y + i);
+		__m256 z = _mm256_loadu_ps(in.z + i);
+		__m256 w = _mm256_loadu_ps(in.w + i);
+		float* outs[4] = {out.x, out.y, out.z, out.w};
+		for (int r = 0; r < 4; ++r) {
+			__m256 v = _mm256_mul_ps(k[3][r], w);
+			v = _mm256_fmadd_ps(k[2][r], z, v);
+			v = _mm256_fmadd_ps(k[1][r], y, v);
+			v = _mm256_fmadd_ps(k[0][r], x, v);
+			_mm256_storeu_ps(outs[r] + i, v);
+		}
+	}
+	mat4_transform_soa_scalar(m, (struct vec4_soa){in.x + i, in.y + i, in.z + i, in.w + i},
+				  (struct vec4_soa){out.x + i, out.y + i, out.z + i, out.w + i}, count - i);
+}
+
+// Two columns of b per 256-bit register, a's columns repeated in both halves. A mat4 array is
+// only 16 byte aligned, hence the unaligned loads.
+VECMATH_TARGET_AVX2 static void mat4_mul_batch_avx2(const struct mat4* a, const struct mat4* b, struct mat4* out, size_t count)
+{
+	__m128 a0 = _mm_load_ps(&a->columns[0].x);
+	__m128 a1 = _mm_load_ps(&a->columns[1].x);
+	__m128 a2 = _mm_load_ps(&a->columns[2].x);
+	__m128 a3 = _mm_load_ps(&a->columns[3].x);
+	__m256 c0 = _mm256_set_m128(a0, a0), c1 = _mm256_set_m128(a1, a1);
+	__m256 c2 = _mm256_set_m128(a2, a2), c3 = _mm256_set_m128(a3, a3);
+	for (size_t i = 0; i < count; ++i) {
+		__m256 v01 = _mm256_loadu_ps(&b[i].columns[0].x);
+		__m256 v23 = _mm256_loadu_ps(&b[i].columns[2].x);
+		__m256 r01 = _mm256_mul_ps(c3, _mm256_permute_ps(v01, _MM_SHUFFLE(3, 3, 3, 3)));
+		__m256 r23 = _mm256_mul_ps(c3, _mm256_permute_ps(v23, _MM_SHUFFLE(3, 3, 3, 3)));
+		r01 = _mm256_fmadd_ps(c2, _mm256_permute_ps(v01, _MM_SHUFFLE(2, 2, 2, 2)), r01);
+		r23 = _mm256_fmadd_ps(c2, _mm256_permute_ps(v23, _MM_SHUFFLE(2, 2, 2, 2)), r23);
+		r01 = _mm256_fmadd_ps(c1, _mm256_permute_ps(v01, _MM_SHUFFLE(1, 1, 1, 1)), r01);
+		r23 = _mm256_fmadd_ps(c1, _mm256_permute_ps(v23, _MM_SHUFFLE(1, 1, 1, 1)), r23);
+		r01 = _mm256_fmadd_ps(c0, _mm256_permute_ps(v01, _MM_SHUFFLE(0, 0, 0, 0)), r01);
+		r23 = _mm256_fmadd_ps(c0, _mm256_permute_ps(v23, _MM_SHUFFLE(0, 0, 0, 0)), r23);
+		_mm256_storeu_ps(&out[i].columns[0].x, r01);
+		_mm256_storeu_ps(&out[i].columns[2].x, r23);
+	}
+}
+
+static bool vecmath_cpu_has_avx2(void)
+{
+	unsigned int eax, ebx, ecx, edx;
+	if (!__get_cpuid(1, &eax, &ebx, &ecx, &edx)) return false;
+	bool fma = ecx & (1u << 12);
+	bool osxsave = ecx & (1u << 27);
+	if (!fma || !osxsave) return false;
+	// the OS must save the ymm registers on context switches
+	uint32_t xcr0_lo, xcr0_hi;
+	__asm__ volatile("xgetbv" : "=a"(xcr0_lo), "=d"(xcr0_hi) : "c"(0));
+	(void)xcr0_hi;
+	if ((xcr0_lo & 6) != 6) return false;
+	if (!__get_cpuid_count(7, 0, &eax, &ebx, &ecx, &edx)) return false;
+	return ebx & (1u << 5);
+}
+#endif
+
+enum vecmath_path
+{
+	VECMATH_PATH_SCALAR,
+	VECMATH_PATH_SSE,
+	VECMATH_PATH_AVX2,
+};
+
+// For the stats panel.
+const char* vecmath_path_name(enum vecmath_path path)
+{
+	static const char* names[] = {"scalar", "sse", "avx2"};
+	return names[path];
+}
+
+static struct
+{
+	bool initialized;
+	enum vecmath_path path;
+	void (*transform_soa)(const struct mat4* m, struct vec4_soa in, struct vec4_soa out, size_t count);
+	void (*mul_batch)(const struct mat4* a, const struct mat4* b, struct mat4* out, size_t count);
+} g_vecmath;
+
+// Picks the batch kernels, the fastest the CPU runs unless limited to max_path. Called lazily by
+// the kernels, call it up front from one thread before using them from several.
+void vecmath_init(enum vecmath_path max_path)
+{
+	g_vecmath.path = VECMATH_PATH_SCALAR;
+	g_vecmath.transform_soa = mat4_transform_soa_scalar;
+	g_vecmath.mul_batch = mat4_mul_batch_scalar;
+#if VECMATH_SSE
+	if (max_path >= VECMATH_PATH_SSE) {
+		g_vecmath.path = VECMATH_PATH_SSE;
+		g_vecmath.transform_soa = mat4_transform_soa_sse;
+		g_vecmath.mul_batch = mat4_mul_batch_sse;
+	}
+#endif
+#if VECMATH_AVX2
+	if (max_path >= VECMATH_PATH_AVX2 && vecmath_cpu_has_avx2()) {
+		g_vecmath.path = VECMATH_PATH_AVX2;
+		g_vecmath.transform_soa = mat4_transform_soa_avx2;
+		g_vecmath.mul_batch = mat4_mul_batch_avx2;
+	}
+#endif
+	(void)max_path;
+	g_vecmath.initialized = true;
+}
+
+void mat4_transform_soa(const struct mat4* m, struct vec4_soa in, struct vec4_soa out, size_t count)
+{
+	if (!g_vecmath.initialized) vecmath_init(VECMATH_PATH_AVX2);
+	g_vecmath.transform_soa(m, in, out, count);
+}
+
+void mat4_mul_batch(const struct mat4* a, const struct mat4* b, struct mat4* out, size_t count)
+{
+	if (!g_vecmath.initialized) vecmath_init(VECMATH_PATH_AVX2);
+	g_vecmath.mul_batch(a, b, out, count);
+}
@@ -0,0 +1,346 @@
+// Vertex encoding for the formats vertex_format.hlsli declares; shaders decode them with its
+// vertex_load(), input assembler PSOs can use vertex_input_layout(). Meshes come in as float
+// positions, normals and colors and are stored in one format behind a header holding the format
+// and the position dequantization: the 16-bit formats store positions relative to the center of
+// the bounds and scaled by their half size, so the whole range is used.
+// Defining VERTEX_FORMAT_NO_INPUT_LAYOUT leaves out the D3D12 parts, for the tools.
+// Requires vecmath.c.
+
+#include <math.h>
+#include <string.h>
+
+#define VERTEX_FORMAT_C 1
+#include "vertex_format.hlsli"
+
+enum vertex_format
+{
+#define VERTEX_FORMAT_ENUM(name, id, stride, ATTRIBUTES) VERTEX_FORMAT_##name = id,
+	VERTEX_FORMAT_LIST(VERTEX_FORMAT_ENUM)
+	VERTEX_FORMAT_COUNT
+};
+
+enum vertex_semantic
+{
+	VERTEX_SEMANTIC_POSITION,
+	VERTEX_SEMANTIC_NORMAL,
+	VERTEX_SEMANTIC_COLOR,
+};
+
+enum vertex_encoding
+{
+	VERTEX_ENCODING_FLOAT4,
+	VERTEX_ENCODING_FLOAT3,
+	VERTEX_ENCODING_SNORM16X4,
+	VERTEX_ENCODING_HALF4,
+	VERTEX_ENCODING_UNORM8X4,
+	VERTEX_ENCODING_OCT16,
+};
+
+#define VERTEX_SIZE_FLOAT4 16
+#define VERTEX_SIZE_FLOAT3 12
+#define VERTEX_SIZE_SNORM16X4 8
+#define VERTEX_SIZE_HALF4 8
+#define VERTEX_SIZE_UNORM8X4 4
+#define VERTEX_SIZE_OCT16 4
+
+struct vertex_attribute
+{
+	enum vertex_semantic semantic;
+	enum vertex_encoding encoding;
+	uint32_t offset;
+};
+
+struct vertex_format_info
+{
+	uint32_t stride;
+	uint32_t attribute_count;
+	struct vertex_attribute attributes[VERTEX_MAX_ATTRIBUTES];
+};
+
+#define VERTEX_ATTRIBUTE_COUNT(semantic, encoding, offset) +1
+#define VERTEX_ATTRIBUTE_BYTES(semantic, encoding, offset) +VERTEX_SIZE_##encoding
+#define VERTEX_ATTRIBUTE_INFO(semantic, encoding, offset) {VERTEX_SEMANTIC_##semantic, VERTEX_ENCODING_##encoding, offset},
+#define VERTEX_FORMAT_INFO(name, id, stride, ATTRIBUTES) \
+	[id] = {stride, 0 ATTRIBUTES(VERTEX_ATTRIBUTE_COUNT), {ATTRIBUTES(VERTEX_ATTRIBUTE_INFO)}},
+
+#define VERTEX_FORMAT_NAME(name, id, stride, ATTRIBUTES) [id] = #name,
+
+static const struct vertex_format_info vertex_formats[VERTEX_FORMAT_COUNT] = {VERTEX_FORMAT_LIST(VERTEX_FORMAT_INFO)};
+static const char* const vertex_format_names[VERTEX_FORMAT_COUNT] = {VERTEX_FORMAT_LIST(VERTEX_FORMAT_NAME)};
+
+#define VERTEX_FORMAT_CHECK(name, id, stride, ATTRIBUTES) \
+	_Static_assert((0 ATTRIBUTES(VERTEX_ATTRIBUTE_BYTES)) <= stride && stride % 4 == 0, #name " does not fit its stride"); \
+	_Static_assert((0 ATTRIBUTES(VERTEX_ATTRIBUTE_COUNT)) <= VERTEX_MAX_ATTRIBUTES, #name " has too many attributes");
+VERTEX_FORMAT_LIST(VERTEX_FORMAT_CHECK)
+
+// As vertex_format.hlsli reads it, at the start of every vertex buffer.
+struct vertex_header
+{
+	float offset[3]; // position = offset + scale * stored
+	uint32_t format;
+	float scale[3];
+	uint32_t stride;
+};
+
+_Static_assert(sizeof(struct vertex_header) == VERTEX_HEADER_BYTES, "vertex_format.hlsli reads a 32 byte header");
+
+struct vertex_input
+{
+	struct vec3 position;
+	struct vec3 normal;
+	struct vec4 color;
+};
+
+#ifndef VERTEX_FORMAT_NO_INPUT_LAYOUT
+// OCT16 still needs decoding in the shader, the input assembler only unpacks the two values
+#define VERTEX_DXGI_FLOAT4 DXGI_FORMAT_R32G32B32A32_FLOAT
+#define VERTEX_DXGI_FLOAT3 DXGI_FORMAT_R32G32B32_FLOAT
+#define VERTEX_DXGI_SNORM16X4 DXGI_FORMAT_R16G16B16A16_SNORM
+#define VERTEX_DXGI_HALF4 DXGI_FORMAT_R16G16B16A16_FLOAT
+#define VERTEX_DXGI_UNORM8X4 DXGI_FORMAT_R8G8B8A8_UNORM
+#define VERTEX_DXGI_OCT16 DXGI_FORMAT_R16G16_SNORM
+
+#define VERTEX_INPUT_ELEMENT(semantic, encoding, offset) \
+	{#semantic, 0, VERTEX_DXGI_##encoding, 0, offset, D3D12_INPUT_CLASSIFICATION_PER_VERTEX_DATA, 0},
+#define VERTEX_FORMAT_ELEMENTS(name, id, stride, ATTRIBUTES) [id] = {ATTRIBUTES(VERTEX_INPUT_ELEMENT)},
+
+static const D3D12_INPUT_ELEMENT_DESC vertex_format_elements[VERTEX_FORMAT_COUNT][VERTEX_MAX_ATTRIBUTES] = {VERTEX_FORMAT_LIST(VERTEX_FORMAT_ELEMENTS)};
+
+D3D12_INPUT_LAYOUT_DESC vertex_input_layout(enum vertex_format format)
+{
+	return (D3D12_INPUT_LAYOUT_DESC){.pInputElementDescs = vertex_format_elements[format], .NumElements = vertex_formats[format].attribute_count};
+}
+#endif
+
+size_t vertex_buffer_bytes(enum vertex_format format, uint32_t count)
+{
+	return VERTEX_HEADER_BYTES + (size_t)count * vertex_formats[format].stride;
+}
+
+static uint16_t vertex_snorm16(float value)
+{
+	value = value < -1.0f ? -1.0f : value > 1.0f ? 1.0f : value;
+	return (uint16_t)(int16_t)lrintf(value * 32767.0f);
+}
+
+static uint8_t vertex_unorm8(float value)
+{
+	value = value < 0.0f ? 0.0f : value > 1.0f ? 1.0f : value;
+	return (uint8_t)lrintf(value * 255.0f);
+}
+
+// Round to nearest even, as the hardware converts.
+static uint16_t vertex_half(float value)
+{
+	uint32_t bits;
+	memcpy(&bits, &value, sizeof(bits));
+	uint32_t sign = bits >> 16 & 0x8000;
+	uint32_t mantissa = bits & 0x7fffff;
+	int32_t exponent = (int32_t)(bits >> 23 & 0xff) - 127 + 15;
+	if (exponent == 128 + 15) return (uint16_t)(sign | 0x7c00 | (mantissa ? 0x200 : 0)); // inf, nan
+	if (exponent >= 31) return (uint16_t)(sign | 0x7c00);
+	uint32_t shift = 13;
+	uint32_t half = (uint32_t)exponent << 10;
+	if (exponent <= 0) {
+		// denormal, the implicit one becomes part of the mantissa
+		if (exponent < -10) return (uint16_t)sign;
+		mantissa |= 0x800000;
+		shift = (uint32_t)(14 - exponent);
+		half = 0;
+	}
+	half |= mantissa >> shift;
+	uint32_t rest = mantissa & ((1u << shift) - 1);
+	uint32_t middle = 1u << (shift - 1);
+	if (rest > middle || (rest == middle && (half & 1))) half++; // may carry into the exponent, correctly
+	return (uint16_t)(sign | half);
+}
+
+static float vertex_half_to_float(uint16_t half)
+{
+	uint32_t sign = (uint32_t)(half & 0x8000) << 16;
+	uint32_t exponent = half >> 10 & 0x1f;
+	uint32_t mantissa = half & 0x3ff;
+	float value;
+	if (exponent == 0) {
+		value = ldexpf((float)mantissa, -24);
+	} else if (exponent == 31) {
+		value = mantissa ? NAN : INFINITY;
+	} else {
+		uint32_t bits = (exponent + 127 - 15) << 23 | mantissa << 13;
+		memcpy(&value, &bits, sizeof(value));
+	}
+	return sign ? -value : value;
+}
+
+// The unit vector on the octahedron |x| + |y| + |z| = 1, the lower half folded over the upper.
+static uint32_t vertex_octahedral(struct vec3 normal)
+{
+	float length = fabsf(normal.x) + fabsf(normal.y) + fabsf(normal.z);
+	if (length == 0.0f) return (uint32_t)vertex_snorm16(1.0f) << 16; // (0, 0, 1)
+	float x = normal.x / length;
+	float y = normal.y / length;
+	if (normal.z < 0.0f) {
+		float folded_x = (1.0f - fabsf(y)) * (x >= 0.0f ? 1.0f : -1.0f);
+		float folded_y = (1.0f - fabsf(x)) * (y >= 0.0f ? 1.0f : -1.0f);
+		x = folded_x;
+		y = folded_y;
+	}
+	return (uint32_t)vertex_snorm16(x) | (uint32_t)vertex_snorm16(y) << 16;
+}
+
+static float vertex_snorm16_to_float(uint16_t value)
+{
+	float result = (float)(int16_t)value / 32767.0f;
+	return result < -1.0f ? -1.0f : result;
+}
+
+static struct vec3 vertex_octahedral_to_vec3(uint32_t packed)
+{
+	float x = vertex_snorm16_to_float((uint16_t)packed);
+	float y = vertex_snorm16_to_float((uint16_t)(packed >> 16));
+	float z = 1.0f - fabsf(x) - fabsf(y);
+	float t = z < 0.0f ? -z : 0.0f;
+	x += x >= 0.0f ? -t : t;
+	y += y >= 0.0f ? -t : t;
+	float length = sqrtf(x * x + y * y + z * z);
+	return vec3_make(x / length, y / length, z / length);
+}
+
+static void vertex_store(enum vertex_encoding encoding, const float* value, uint8_t* out)
+{
+	switch (encoding) {
+	case VERTEX_ENCODING_FLOAT4: memcpy(out, value, 16); break;
+	case VERTEX_ENCODING_FLOAT3: memcpy(out, value, 12); break;
+	case VERTEX_ENCODING_SNORM16X4:
+		for (int i = 0; i < 4; ++i) {
+			uint16_t stored = vertex_snorm16(value[i]);
+			memcpy(out + i * 2, &stored, sizeof(stored));
+		}
+		break;
+	case VERTEX_ENCODING_HALF4:
+		for (int i = 0; i < 4; ++i) {
+			uint16_t stored = vertex_half(value[i]);
+			memcpy(out + i * 2, &stored, sizeof(stored));
+		}
+		break;
+	case VERTEX_ENCODING_UNORM8X4:
+		for (int i = 0; i < 4; ++i) out[i] = vertex_unorm8(value[i]);
+		break;
+	case VERTEX_ENCODING_OCT16: {
+		uint32_t stored = vertex_octahedral(vec3_make(value[0], value[1], value[2]));
+		memcpy(out, &stored, sizeof(stored));
+		break;
+	}
+	}
+}
+
+static void vertex_fetch(enum vertex_encoding encoding, const uint8_t* in, float* value)
+{
+	value[3] = 1.0f;
+	switch (encoding) {
+	case VERTEX_ENCODING_FLOAT4: memcpy(value, in, 16); break;
+	case VERTEX_ENCODING_FLOAT3: memcpy(value, in, 12); break;
+	case VERTEX_ENCODING_SNORM16X4:
+		for (int i = 0; i < 4; ++i) {
+			uint16_t stored;
+			memcpy(&stored, in + i * 2, sizeof(stored));
+			value[i] = vertex_snorm16_to_float(stored);
+		}
+		break;
+	case VERTEX_ENCODING_HALF4:
+		for (int i = 0; i < 4; ++i) {
+			uint16_t stored;
+			memcpy(&stored, in + i * 2, sizeof(stored));
+			value[i] = vertex_half_to_float(stored);
+		}
+		break;
+	case VERTEX_ENCODING_UNORM8X4:
+		for (int i = 0; i < 4; ++i) value[i] = (float)in[i] / 255.0f;
+		break;
+	case VERTEX_ENCODING_OCT16: {
+		uint32_t stored;
+		memcpy(&stored, in, sizeof(stored));
+		struct vec3 normal = vertex_octahedral_to_vec3(stored);
+		value[0] = normal.x;
+		value[1] = normal.y;
+		value[2] = normal.z;
+		value[3] = 0.0f;
+		break;
+	}
+	}
+}
+
+// Writes the header and count vertices to out, vertex_buffer_bytes() of them.
+void vertex_encode(enum vertex_format format, const struct vertex_input* vertices, uint32_t count, void* out)
+{
+	const struct vertex_format_info* info = &vertex_formats[format];
+	struct vertex_header header = {.format = (uint32_t)format, .stride = info->stride, .scale = {1.0f, 1.0f, 1.0f}};
+	if (info->attributes[0].encoding != VERTEX_ENCODING_FLOAT4 && info->attributes[0].encoding != VERTEX_ENCODING_FLOAT3 && count) {
+		float low[3] = {vertices[0].position.x, vertices[0].position.y, vertices[0].position.z};
+		float high[3] = {low[0], low[1], low[2]};
+		for (uint32_t i = 1; i < count; ++i) {
+			float position[3] = {vertices[i].position.x, vertices[i].position.y, vertices[i].position.z};
+			for (int axis = 0; axis < 3; ++axis) {
+				low[axis] = position[axis] < low[axis] ? position[axis] : low[axis];
+				high[axis] = position[axis] > high[axis] ? position[axis] : high[axis];
+			}
+		}
+		for (int axis = 0; axis < 3; ++axis) {
+			header.offset[axis] = (low[axis] + high[axis]) * 0.5f;
+			float extent = (high[axis] - low[axis]) * 0.5f;
+			header.scale[axis] = extent > 0.0f ? extent : 1.0f; // flat axes store 0
+		}
+	}
+	memcpy(out, &header, sizeof(header));
+
+	uint8_t* vertex = (uint8_t*)out + VERTEX_HEADER_BYTES;
+	for (uint32_t i = 0; i < count; ++i, vertex += info->stride) {
+		memset(vertex, 0, info->stride);
+		for (uint32_t a = 0; a < info->attribute_count; ++a) {
+			const struct vertex_attribute* attribute = &info->attributes[a];
+			const struct vertex_input* input = &vertices[i];
+			float value[4];
+			switch (attribute->semantic) {
+			case VERTEX_SEMANTIC_POSITION:
+				value[0] = (input->position.x - header.offset[0]) / header.scale[0];
+				value[1] = (input->position.y - header.offset[1]) / header.scale[1];
+				value[2] = (input->position.z - header.offset[2]) / header.scale[2];
+				value[3] = 1.0f;
+				break;
+			case VERTEX_SEMANTIC_NORMAL:
+				value[0] = input->normal.x;
+				value[1] = input->normal.y;
+				value[2] = input->normal.z;
+				value[3] = 0.0f;
+				break;
+			case VERTEX_SEMANTIC_COLOR: memcpy(value, &input->color, sizeof(value)); break;
+			}
+			vertex_store(attribute->encoding, value, vertex + attribute->offset);
+		}
+	}
+}
+
+// What vertex_load() in vertex_format.hlsli reads from a buffer vertex_encode() wrote, for tools
+// and checks.
+struct vertex_input vertex_decode(const void* buffer, uint32_t index)
+{
+	struct vertex_header header;
+	memcpy(&header, buffer, sizeof(header));
+	const struct vertex_format_info* info = &vertex_formats[header.format];
+	const uint8_t* vertex = (const uint8_t*)buffer + VERTEX_HEADER_BYTES + (size_t)index * info->stride;
+	struct vertex_input result = {.normal = {0.0f, 0.0f, 1.0f}, .color = {1.0f, 1.0f, 1.0f, 1.0f}};
+	for (uint32_t a = 0; a < info->attribute_count; ++a) {
+		const struct vertex_attribute* attribute = &info->attributes[a];
+		float value[4];
+		vertex_fetch(attribute->encoding, vertex + attribute->offset, value);
+		switch (attribute->semantic) {
+		case VERTEX_SEMANTIC_POSITION:
+			result.position = vec3_make(header.offset[0] + header.scale[0] * value[0], header.offset[1] + header.scale[1] * value[1],
+						    header.offset[2] + header.scale[2] * value[2]);
+			break;
+		case VERTEX_SEMANTIC_NORMAL: result.normal = vec3_make(value[0], value[1], value[2]); break;
+		case VERTEX_SEMANTIC_COLOR: result.color = vec4_make(value[0], value[1], value[2], value[3]); break;
+		}
+	}
+	return result;
+}
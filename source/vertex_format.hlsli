@@ -0,0 +1,120 @@
+// Vertex formats, the one declaration vertex_format.c and default_shader.hlsl both expand.
+// VERTEX_FORMAT_LIST(FORMAT) calls FORMAT(name, id, stride, ATTRIBUTES) per format, ATTRIBUTES(ATTRIBUTE)
+// calls ATTRIBUTE(semantic, encoding, offset) per attribute. Offsets are multiples of 4, buffers[] loads
+// are. Every vertex buffer starts with a 32 byte header, positions decode to offset + scale * stored.
+// Encodings:
+//   FLOAT4     16 bytes, float4
+//   FLOAT3     12 bytes, float3, w = 1
+//   SNORM16X4   8 bytes, 16-bit signed normalized, w unused
+//   HALF4       8 bytes, half floats, w unused
+//   UNORM8X4    4 bytes, 8-bit unsigned normalized
+//   OCT16       4 bytes, a unit vector octahedral encoded into two 16-bit signed normalized values
+// Semantics: POSITION, NORMAL (0, 0, 1 when missing), COLOR (1 when missing).
+
+#define VERTEX_HEADER_BYTES 32
+#define VERTEX_MAX_ATTRIBUTES 3
+
+#define VERTEX_FORMAT_LIST(FORMAT) \
+	FORMAT(FLOAT4, 0, 32, VERTEX_FLOAT4_ATTRIBUTES) \
+	FORMAT(FLOAT3, 1, 20, VERTEX_FLOAT3_ATTRIBUTES) \
+	FORMAT(SNORM16, 2, 16, VERTEX_SNORM16_ATTRIBUTES) \
+	FORMAT(HALF, 3, 16, VERTEX_HALF_ATTRIBUTES)
+
+// the layout before there were formats
+#define VERTEX_FLOAT4_ATTRIBUTES(ATTRIBUTE) \
+	ATTRIBUTE(POSITION, FLOAT4, 0) \
+	ATTRIBUTE(COLOR, FLOAT4, 16)
+
+#define VERTEX_FLOAT3_ATTRIBUTES(ATTRIBUTE) \
+	ATTRIBUTE(POSITION, FLOAT3, 0) \
+	ATTRIBUTE(NORMAL, OCT16, 12) \
+	ATTRIBUTE(COLOR, UNORM8X4, 16)
+
+#define VERTEX_SNORM16_ATTRIBUTES(ATTRIBUTE) \
+	ATTRIBUTE(POSITION, SNORM16X4, 0) \
+	ATTRIBUTE(NORMAL, OCT16, 8) \
+	ATTRIBUTE(COLOR, UNORM8X4, 12)
+
+#define VERTEX_HALF_ATTRIBUTES(ATTRIBUTE) \
+	ATTRIBUTE(POSITION, HALF4, 0) \
+	ATTRIBUTE(NORMAL, OCT16, 8) \
+	ATTRIBUTE(COLOR, UNORM8X4, 12)
+
+// the decoder, C includes only the declaration
+#ifndef VERTEX_FORMAT_C
+
+struct mesh_vertex
+{
+	float4 position;
+	float3 normal;
+	float4 color;
+};
+
+float4 vertex_decode_FLOAT4(ByteAddressBuffer vertices, uint offset)
+{
+	return asfloat(vertices.Load4(offset));
+}
+
+float4 vertex_decode_FLOAT3(ByteAddressBuffer vertices, uint offset)
+{
+	return float4(asfloat(vertices.Load3(offset)), 1.0f);
+}
+
+float4 vertex_decode_SNORM16X4(ByteAddressBuffer vertices, uint offset)
+{
+	uint2 packed = vertices.Load2(offset);
+	int4 values = asint(uint4(packed.x << 16, packed.x, packed.y << 16, packed.y)) >> 16; // sign extends
+	return max(float4(values) / 32767.0f, -1.0f);
+}
+
+float4 vertex_decode_HALF4(ByteAddressBuffer vertices, uint offset)
+{
+	uint2 packed = vertices.Load2(offset);
+	return f16tof32(uint4(packed.x, packed.x >> 16, packed.y, packed.y >> 16));
+}
+
+float4 vertex_decode_UNORM8X4(ByteAddressBuffer vertices, uint offset)
+{
+	uint packed = vertices.Load(offset);
+	return float4(packed & 0xff, packed >> 8 & 0xff, packed >> 16 & 0xff, packed >> 24) / 255.0f;
+}
+
+float4 vertex_decode_OCT16(ByteAddressBuffer vertices, uint offset)
+{
+	uint packed = vertices.Load(offset);
+	float2 e = max(float2(asint(uint2(packed << 16, packed)) >> 16) / 32767.0f, -1.0f);
+	float3 n = float3(e, 1.0f - abs(e.x) - abs(e.y));
+	float t = saturate(-n.z);
+	n.xy += n.xy >= 0.0f ? -t : t;
+	return float4(normalize(n), 0.0f);
+}
+
+#define VERTEX_ASSIGN_POSITION(value) v.position = float4(position_offset + position_scale * (value).xyz, 1.0f);
+#define VERTEX_ASSIGN_NORMAL(value) v.normal = (value).xyz;
+#define VERTEX_ASSIGN_COLOR(value) v.color = (value);
+#define VERTEX_LOAD_ATTRIBUTE(semantic, encoding, offset) VERTEX_ASSIGN_##semantic(vertex_decode_##encoding(vertices, base + offset))
+#define VERTEX_LOAD_FORMAT(name, id, stride, ATTRIBUTES) \
+	if (format == id) { \
+		uint base = VERTEX_HEADER_BYTES + index * stride; \
+		ATTRIBUTES(VERTEX_LOAD_ATTRIBUTE) \
+	}
+
+// Vertex index of a buffer written by vertex_encode(), whatever its format.
+mesh_vertex vertex_load(ByteAddressBuffer vertices, uint index)
+{
+	// header: position offset, format, position scale, stride
+	uint4 header0 = vertices.Load4(0);
+	uint4 header1 = vertices.Load4(16);
+	float3 position_offset = asfloat(header0.xyz);
+	float3 position_scale = asfloat(header1.xyz);
+	uint format = header0.w;
+
+	mesh_vertex v;
+	v.position = float4(0.0f, 0.0f, 0.0f, 1.0f);
+	v.normal = float3(0.0f, 0.0f, 1.0f);
+	v.color = float4(1.0f, 1.0f, 1.0f, 1.0f);
+	VERTEX_FORMAT_LIST(VERTEX_LOAD_FORMAT)
+	return v;
+}
+
+#endif
@@ -0,0 +1,199 @@
+// alloc_track.c over a fake frame loop: frames that allocate a known number of blocks in known
+// zones, from the frame thread and from workers, have to come out of alloc_track_frame() with
+// exactly those numbers, the busiest call site found and allocation free frames counted as clean.
+// Then a worker allocating non-stop while the frame thread closes frames, every allocation landing
+// in exactly one frame. Builds without NDEBUG, so call sites are counted too.
+
+#include "test_util.c"
+#include "../source/alloc_track.c" // from here on malloc and free are tracked
+
+#define WORKERS 3
+
+struct worker
+{
+	uint32_t allocs;
+	size_t size;
+	semaphore_handle start;
+	semaphore_handle done;
+	_Atomic bool quit;
+};
+
+static void wait_for(semaphore_handle* semaphore)
+{
+	while (!semaphore_wait(semaphore, 1000)) {}
+}
+
+static void worker_main(void* param)
+{
+	struct worker* worker = param;
+	alloc_track_name_thread("worker");
+	for (;;) {
+		wait_for(&worker->start);
+		if (atomic_load(&worker->quit)) return;
+		uint32_t zone = alloc_zone_enter(ALLOC_ZONE_RENDER);
+		for (uint32_t i = 0; i < worker->allocs; ++i) free(malloc(worker->size));
+		alloc_zone_enter(zone);
+		semaphore_post(&worker->done, 1);
+	}
+}
+
+// One frame of the simulation: allocs blocks of size bytes, half of them grown by realloc.
+static void simulate(uint32_t allocs, size_t size)
+{
+	uint32_t zone = alloc_zone_enter(ALLOC_ZONE_SIMULATION);
+	for (uint32_t i = 0; i < allocs; ++i) {
+		void* p = malloc(size);
+		if (i & 1) p = realloc(p, size * 2);
+		free(p);
+	}
+	alloc_zone_enter(zone);
+}
+
+static void test_frames(void)
+{
+	struct worker workers[WORKERS];
+	thread_handle threads[WORKERS];
+	for (int i = 0; i < WORKERS; ++i) {
+		workers[i] = (struct worker){.allocs = 0};
+		semaphore_create(&workers[i].start, 0);
+		semaphore_create(&workers[i].done, 0);
+		if (!thread_create(&threads[i], worker_main, &workers[i])) {
+			fputs("no worker thread\n", stderr);
+			exit(1);
+		}
+	}
+	alloc_track_name_thread("frame");
+	alloc_track_frame(); // whatever happened before the loop
+
+	uint32_t clean = 0;
+	for (uint32_t frame = 0; frame < 400; ++frame) {
+		// every fourth frame allocates nothing at all, as a warm game should
+		bool quiet = frame % 4 == 3;
+		uint32_t sim_allocs = quiet ? 0 : 1 + test_random() % 50;
+		size_t sim_size = 16 + test_random() % 1000;
+		uint64_t render_allocs = 0, render_bytes = 0;
+		for (int i = 0; i < WORKERS; ++i) {
+			workers[i].allocs = quiet ? 0 : test_random() % 200;
+			workers[i].size = 8 + test_random() % 100;
+			render_allocs += workers[i].allocs;
+			render_bytes += workers[i].allocs * workers[i].size;
+			semaphore_post(&workers[i].start, 1);
+		}
+		simulate(sim_allocs, sim_size);
+		for (int i = 0; i < WORKERS; ++i) wait_for(&workers[i].done);
+		alloc_track_frame();
+
+		// realloc counts as another allocation of its new size
+		uint64_t sim_reallocs = sim_allocs / 2;
+		const struct alloc_counts* sim = &g_alloc_track.frame_zones[ALLOC_ZONE_SIMULATION];
+		const struct alloc_counts* render = &g_alloc_track.frame_zones[ALLOC_ZONE_RENDER];
+		bool passed = CHECK(sim->allocs == sim_allocs + sim_reallocs && sim->frees == sim_allocs &&
+		                        sim->bytes == sim_allocs * sim_size + sim_reallocs * sim_size * 2,
+		                    "frame %u: %s %llu allocs %llu frees %llu bytes, expected %u, %u, %llu", frame, alloc_zone_names[ALLOC_ZONE_SIMULATION], (unsigned long long)sim->allocs,
+		                    (unsigned long long)sim->frees, (unsigned long long)sim->bytes, sim_allocs + (uint32_t)sim_reallocs, sim_allocs,
+		                    (unsigned long long)(sim_allocs * sim_size + sim_reallocs * sim_size * 2));
+		passed &= CHECK(render->allocs == render_allocs && render->frees == render_allocs && render->bytes == render_bytes,
+		                "frame %u: %s %llu allocs %llu bytes, expected %llu, %llu", frame, alloc_zone_names[ALLOC_ZONE_RENDER], (unsigned long long)render->allocs,
+		                (unsigned long long)render->bytes, (unsigned long long)render_allocs, (unsigned long long)render_bytes);
+		passed &= CHECK(g_alloc_track.frame_total.allocs == sim->allocs + render->allocs, "frame %u: totals are not the zones added up", frame);
+		passed &= CHECK(g_alloc_track.frame_zones[ALLOC_ZONE_OTHER].allocs == 0, "frame %u: allocations outside any zone", frame);
+
+		clean = quiet ? clean + 1 : 0;
+		passed &= CHECK(g_alloc_track.clean_frames == clean, "frame %u: %llu clean frames, expected %u", frame, (unsigned long long)g_alloc_track.clean_frames,
+		                clean);
+		if (quiet) {
+			passed &= CHECK(g_alloc_track.frame_top_site == NULL, "frame %u: a top site in a frame without allocations", frame);
+		} else {
+			// the busiest of three lines: the workers' malloc, the simulation's malloc and its realloc
+			const struct alloc_site* top = g_alloc_track.frame_top_site;
+			uint64_t most = render_allocs > sim_allocs ? render_allocs : sim_allocs;
+			passed &= CHECK(top && top->frame_allocs == most, "frame %u: top site %llu allocations, expected %llu", frame,
+			                          top ? (unsigned long long)top->frame_allocs : 0ull, (unsigned long long)most);
+		}
+		if (!passed) break;
+	}
+	CHECK(atomic_load(&g_alloc_track.thread_count) == WORKERS + 1, "%u threads counted, expected %d", atomic_load(&g_alloc_track.thread_count), WORKERS + 1);
+	CHECK(atomic_load(&g_alloc_track.dropped_sites) == 0, "call sites dropped");
+
+	for (int i = 0; i < WORKERS; ++i) {
+		atomic_store(&workers[i].quit, true);
+		semaphore_post(&workers[i].start, 1);
+		thread_join(threads[i]);
+		semaphore_destroy(&workers[i].start);
+		semaphore_destroy(&workers[i].done);
+	}
+}
+
+// A worker that never stops allocating, frames closed underneath it.
+static _Atomic bool g_flood_quit;
+static _Atomic uint64_t g_flood_allocs;
+
+static void flood_main(void* param)
+{
+	(void)param;
+	uint32_t zone = alloc_zone_enter(ALLOC_ZONE_RESIZE);
+	uint64_t allocs = 0;
+	while (!atomic_load_explicit(&g_flood_quit, memory_order_relaxed)) {
+		free(malloc(32));
+		allocs++;
+	}
+	alloc_zone_enter(zone);
+	atomic_store(&g_flood_allocs, allocs);
+}
+
+static void test_concurrent_frames(void)
+{
+	alloc_track_frame();
+	thread_handle thread;
+	if (!CHECK(thread_create(&thread, flood_main, NULL), "no flood thread")) return;
+	uint64_t counted = 0;
+	for (int frame = 0; frame < 2000; ++frame) {
+		alloc_track_frame();
+		counted += g_alloc_track.frame_zones[ALLOC_ZONE_RESIZE].allocs;
+		thread_yield();
+	}
+	atomic_store(&g_flood_quit, true);
+	thread_join(thread);
+	alloc_track_frame();
+	counted += g_alloc_track.frame_zones[ALLOC_ZONE_RESIZE].allocs;
+	uint64_t made = atomic_load(&g_flood_allocs);
+	CHECK(counted == made, "concurrent frames: %llu allocations counted, %llu made", (unsigned long long)counted, (unsigned long long)made);
+	printf("concurrent frames: %llu allocations over 2000 frames\n", (unsigned long long)made);
+}
+
+// benchmark: what tracking adds to a malloc and free pair
+
+#define BENCH_PAIRS 1000000
+
+static void bench_tracked(void* data)
+{
+	(void)data;
+	for (uint32_t i = 0; i < BENCH_PAIRS; ++i) {
+		void* p = malloc(16 + (i & 255));
+		*(volatile uint8_t*)p = (uint8_t)i;
+		free(p);
+	}
+}
+
+#undef malloc
+#undef free
+
+static void bench_untracked(void* data)
+{
+	(void)data;
+	for (uint32_t i = 0; i < BENCH_PAIRS; ++i) {
+		void* p = malloc(16 + (i & 255));
+		*(volatile uint8_t*)p = (uint8_t)i; // or the compiler drops malloc and free altogether
+		free(p);
+	}
+}
+
+int main(void)
+{
+	test_frames();
+	test_concurrent_frames();
+	double tracked = test_time_ms(9, bench_tracked, NULL);
+	double untracked = test_time_ms(9, bench_untracked, NULL);
+	printf("%u malloc and free pairs: tracked %.3f ms, untracked %.3f ms\n", BENCH_PAIRS, tracked, untracked);
+	return test_finish("alloc_track_test");
+}
@@ -0,0 +1,286 @@
+// asset_archive.c with archives laid out here as tools/asset_packer.c does, in memory: payloads
+// stored as they are and in compressed blocks, a short last block and blocks that would not shrink
+// among them, must validate, be found by id and come back through asset_entry_read() on the
+// workers. Then one damage at a time to a compressed entry's block table, its block size and its
+// sizes, a count of blocks past 32 bits among them, must fail validation, and a damaged block's
+// bytes must fail the read or the hash.
+
+#include "test_util.c"
+#include "../source/job_system.c"
+#include "../source/lz_block.c"
+#include "../source/asset_archive.c"
+
+#define TEST_WORKERS 4
+#define BLOCK_SIZE (64u * 1024u)
+
+struct payload
+{
+	const char* name;
+	uint8_t* data;
+	uint64_t size;
+	bool compress;
+	// as packed
+	uint8_t* stored;
+	uint64_t stored_size;
+	struct asset_block* blocks;
+	uint32_t block_count;
+};
+
+static uint64_t align_up(uint64_t value, uint64_t alignment)
+{
+	return (value + alignment - 1) / alignment * alignment;
+}
+
+// Blocks that do not shrink stored as they are, like the packer's compress_input().
+static void compress_payload(struct payload* payload)
+{
+	payload->stored = payload->data;
+	payload->stored_size = payload->size;
+	if (!payload->compress) return;
+	payload->block_count = (uint32_t)((payload->size + BLOCK_SIZE - 1) / BLOCK_SIZE);
+	payload->blocks = test_allocate(payload->block_count * sizeof(struct asset_block));
+	payload->stored = test_allocate(payload->size);
+	uint64_t offset = 0;
+	for (uint32_t b = 0; b < payload->block_count; ++b) {
+		uint64_t at = (uint64_t)b * BLOCK_SIZE;
+		size_t size = (size_t)(payload->size - at < BLOCK_SIZE ? payload->size - at : BLOCK_SIZE);
+		size_t compressed = lz_compress(payload->data + at, size, payload->stored + offset, size - 1);
+		if (!compressed) {
+			memcpy(payload->stored + offset, payload->data + at, size);
+			compressed = size;
+		}
+		payload->blocks[b] = (struct asset_block){(uint32_t)offset, (uint32_t)compressed};
+		offset += compressed;
+	}
+	payload->stored_size = offset;
+}
+
+// Header, table sorted by id, names, block tables, payloads a page apart. *size gets the file's.
+static uint8_t* build_archive(struct payload* payloads, uint32_t count, uint64_t* size)
+{
+	struct payload* sorted[8];
+	for (uint32_t i = 0; i < count; ++i) {
+		sorted[i] = &payloads[i];
+		for (uint32_t k = i; k > 0 && asset_id(sorted[k]->name) < asset_id(sorted[k - 1]->name); --k) {
+			struct payload* swap = sorted[k];
+			sorted[k] = sorted[k - 1];
+			sorted[k - 1] = swap;
+		}
+	}
+	uint64_t entries_offset = sizeof(struct asset_archive_header);
+	uint64_t offset = entries_offset + count * sizeof(struct asset_entry);
+	uint64_t name_offsets[8], block_offsets[8], data_offsets[8];
+	for (uint32_t i = 0; i < count; ++i) {
+		name_offsets[i] = offset;
+		offset += strlen(sorted[i]->name) + 1;
+	}
+	offset = align_up(offset, _Alignof(struct asset_block));
+	for (uint32_t i = 0; i < count; ++i) {
+		block_offsets[i] = offset;
+		offset += sorted[i]->block_count * sizeof(struct asset_block);
+	}
+	uint64_t payload_bytes = 0, stored_bytes = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		data_offsets[i] = offset = align_up(offset, ASSET_ARCHIVE_ALIGNMENT);
+		offset += sorted[i]->stored_size;
+		payload_bytes += sorted[i]->size;
+		stored_bytes += sorted[i]->stored_size;
+	}
+	*size = offset;
+
+	uint8_t* archive = aligned_alloc(ASSET_ARCHIVE_ALIGNMENT, align_up(offset, ASSET_ARCHIVE_ALIGNMENT));
+	if (!archive) exit(1);
+	memset(archive, 0, offset);
+	*(struct asset_archive_header*)archive = (struct asset_archive_header){
+		.magic = ASSET_ARCHIVE_MAGIC,
+		.version = ASSET_ARCHIVE_VERSION,
+		.file_size = offset,
+		.entry_count = count,
+		.entries = {(int64_t)(entries_offset - offsetof(struct asset_archive_header, entries))},
+		.payload_bytes = payload_bytes,
+		.stored_bytes = stored_bytes,
+	};
+	for (uint32_t i = 0; i < count; ++i) {
+		const struct payload* payload = sorted[i];
+		uint64_t at = entries_offset + i * sizeof(struct asset_entry);
+		*(struct asset_entry*)(archive + at) = (struct asset_entry){
+			.id = asset_id(payload->name),
+			.hash = asset_hash(payload->data, payload->size),
+			.data = {(int64_t)data_offsets[i] - (int64_t)(at + offsetof(struct asset_entry, data))},
+			.size = payload->size,
+			.stored_size = payload->stored_size,
+			.blocks = {payload->blocks ? (int64_t)block_offsets[i] - (int64_t)(at + offsetof(struct asset_entry, blocks)) : 0},
+			.name = {(int64_t)name_offsets[i] - (int64_t)(at + offsetof(struct asset_entry, name))},
+			.name_length = (uint32_t)strlen(payload->name),
+			.block_size = payload->blocks ? BLOCK_SIZE : 0,
+		};
+		memcpy(archive + name_offsets[i], payload->name, strlen(payload->name) + 1);
+		if (payload->blocks) memcpy(archive + block_offsets[i], payload->blocks, payload->block_count * sizeof(struct asset_block));
+		memcpy(archive + data_offsets[i], payload->stored, payload->stored_size);
+	}
+	return archive;
+}
+
+static void fill_text(uint8_t* data, uint64_t size)
+{
+	static const char* words[] = {"float4 ", "position", " = mul(", "transform, ", "input.", "normal", ");\n", "return "};
+	for (uint64_t i = 0; i < size;) {
+		const char* word = words[test_random() % 8];
+		for (size_t k = 0; word[k] && i < size; ++k) data[i++] = (uint8_t)word[k];
+	}
+}
+
+static struct asset_archive open_in_memory(const uint8_t* data, uint64_t size)
+{
+	struct asset_archive archive = {.view = data, .size = size, .header = asset_archive_validate(data, size)};
+	if (archive.header) archive.entries = archive.header->entry_count ? asset_ref_get(&archive.header->entries) : NULL;
+	return archive;
+}
+
+static struct asset_entry* find_entry(uint8_t* data, uint64_t size, const char* name)
+{
+	struct asset_archive archive = open_in_memory(data, size);
+	return (struct asset_entry*)asset_archive_find(&archive, asset_id(name));
+}
+
+int main(void)
+{
+	if (!job_system_init(TEST_WORKERS)) {
+		fputs("cannot start the workers\n", stderr);
+		return 1;
+	}
+	struct payload payloads[] = {
+		{.name = "data/cooked.mesh", .size = 5 * BLOCK_SIZE + 1234, .compress = true}, // a short last block
+		{.name = "source/default_shader.hlsl", .size = 3 * BLOCK_SIZE, .compress = true},
+		{.name = "data/noise.bin", .size = 2 * BLOCK_SIZE + 7, .compress = true},     // blocks that do not shrink
+		{.name = "Source/Bindless.hlsli", .size = 12345, .compress = false},
+		{.name = "data/half.bin", .size = 2 * BLOCK_SIZE + 100, .compress = true},     // one block of each
+	};
+	enum { COUNT = sizeof(payloads) / sizeof(payloads[0]) };
+	for (uint32_t i = 0; i < COUNT; ++i) {
+		payloads[i].data = test_allocate(payloads[i].size);
+		if (i == 2) {
+			for (uint64_t k = 0; k < payloads[i].size; ++k) payloads[i].data[k] = (uint8_t)test_random();
+		} else {
+			fill_text(payloads[i].data, payloads[i].size);
+		}
+		if (i == 4)
+			for (uint64_t k = BLOCK_SIZE; k < 2 * BLOCK_SIZE; ++k) payloads[i].data[k] = (uint8_t)test_random();
+		compress_payload(&payloads[i]);
+	}
+	uint64_t size;
+	uint8_t* archive = build_archive(payloads, COUNT, &size);
+
+	// every entry found, by either spelling of its name, and read back
+	struct asset_archive opened = open_in_memory(archive, size);
+	if (!CHECK(opened.header != NULL, "the archive does not validate")) return test_finish("asset_archive_test");
+	uint32_t wrong = 0;
+	for (uint32_t i = 0; i < COUNT; ++i) {
+		const struct asset_entry* entry = asset_archive_find(&opened, asset_id(payloads[i].name));
+		if (!CHECK(entry && entry->size == payloads[i].size, "%s not found", payloads[i].name)) continue;
+		CHECK(asset_entry_compressed(entry) == payloads[i].compress && strcmp(asset_entry_name(entry), payloads[i].name) == 0, "%s stored wrong", payloads[i].name);
+		uint8_t* read = test_allocate(entry->size);
+		wrong += !asset_entry_read(entry, read) || memcmp(read, payloads[i].data, entry->size) != 0 || !asset_entry_verify(entry);
+		free(read);
+	}
+	CHECK(wrong == 0, "%u entries did not read back", wrong);
+	CHECK(asset_archive_find(&opened, asset_id("source/bindless.hlsli")) != NULL, "the case folded name not found");
+	CHECK(asset_archive_find(&opened, asset_id("missing")) == NULL, "a missing name found");
+	const struct asset_block* noise = asset_ref_get(&asset_archive_find(&opened, asset_id("data/noise.bin"))->blocks);
+	CHECK(noise[0].size == BLOCK_SIZE, "a block that does not shrink was not stored as it is");
+	printf("%u entries, %llu bytes of payloads stored in %llu, %llu byte archive\n", COUNT, (unsigned long long)opened.header->payload_bytes,
+	       (unsigned long long)opened.header->stored_bytes, (unsigned long long)size);
+
+	// one damage to the block index at a time, in a fresh copy
+	enum damage
+	{
+		DAMAGE_OFFSET,       // a block not where the one before ends
+		DAMAGE_EMPTY,        // a block of 0 bytes
+		DAMAGE_LARGER,       // a block larger than what it decodes to
+		DAMAGE_STORED_SIZE,  // the blocks not covering the stored bytes
+		DAMAGE_BLOCK_SMALL,  // block sizes out of range
+		DAMAGE_BLOCK_LARGE,
+		DAMAGE_TABLE_OUTSIDE, // the table past the file's end
+		DAMAGE_TABLE_ALIGN,
+		DAMAGE_NO_TABLE,
+		DAMAGE_COUNT_WRAPS,  // 2^32 + 6 blocks, which a 32-bit count would take for 6
+		DAMAGE_SIZE_HUGE,    // a size whose block count overflows 64 bits on the way
+		DAMAGE_KIND_COUNT,
+	};
+	static const char* damage_names[DAMAGE_KIND_COUNT] = {"block offset", "empty block", "block larger than decoded", "stored size", "block size too small",
+							      "block size too large", "table outside", "table misaligned", "no table", "block count past 32 bits",
+							      "size near 2^64"};
+	uint8_t* copy = aligned_alloc(ASSET_ARCHIVE_ALIGNMENT, align_up(size, ASSET_ARCHIVE_ALIGNMENT));
+	if (!copy) return 1;
+	for (int damage = 0; damage < DAMAGE_KIND_COUNT; ++damage) {
+		memcpy(copy, archive, size);
+		struct asset_entry* entry = find_entry(copy, size, "data/cooked.mesh");
+		struct asset_block* blocks = (struct asset_block*)asset_ref_get(&entry->blocks);
+		struct asset_archive_header* header = (struct asset_archive_header*)copy;
+		switch (damage) {
+			case DAMAGE_OFFSET: blocks[2].offset += 1; break;
+			case DAMAGE_EMPTY:
+				// the last block emptied, the sizes following it so only the block itself is wrong
+				entry->stored_size -= blocks[5].size;
+				header->stored_bytes -= blocks[5].size;
+				blocks[5].size = 0;
+				break;
+			case DAMAGE_LARGER: {
+				// the last block grown past the 1234 bytes it decodes to, taking the stored bytes with it
+				uint32_t grown = 1235 - blocks[5].size;
+				blocks[5].size += grown;
+				entry->stored_size += grown;
+				header->stored_bytes += grown;
+				break;
+			}
+			case DAMAGE_STORED_SIZE: entry->stored_size -= 1, header->stored_bytes -= 1; break;
+			case DAMAGE_BLOCK_SMALL: entry->block_size = ASSET_BLOCK_MIN - 1; break;
+			case DAMAGE_BLOCK_LARGE: entry->block_size = ASSET_BLOCK_MAX + 1; break;
+			case DAMAGE_TABLE_OUTSIDE: entry->blocks.offset += (int64_t)size; break;
+			case DAMAGE_TABLE_ALIGN: entry->blocks.offset += 1; break;
+			case DAMAGE_NO_TABLE: entry->blocks.offset = 0; break;
+			case DAMAGE_COUNT_WRAPS:
+				// the 6 real blocks and 2^32 more, the last one taking the difference: truncated, the count is 6 again
+				header->payload_bytes += (uint64_t)BLOCK_SIZE << 32;
+				entry->size += (uint64_t)BLOCK_SIZE << 32;
+				break;
+			default:
+				header->payload_bytes += UINT64_MAX - entry->size;
+				entry->size = UINT64_MAX;
+				break;
+		}
+		CHECK(asset_archive_validate(copy, size) == NULL, "damage to the %s validated", damage_names[damage]);
+	}
+	// the undamaged copy still validates, so the failures above are the damage's
+	memcpy(copy, archive, size);
+	CHECK(asset_archive_validate(copy, size) != NULL, "a copy of the archive does not validate");
+
+	// damaged compressed bytes: the read fails or the hash does, unless they decode to the same bytes,
+	// a distance changed to another copy of the same word
+	struct payload* shader = &payloads[1];
+	uint8_t* read = test_allocate(shader->size);
+	uint32_t undetected = 0, harmless = 0;
+	for (int round = 0; round < 200; ++round) {
+		memcpy(copy, archive, size);
+		struct asset_entry* entry = find_entry(copy, size, shader->name);
+		uint8_t* stored = (uint8_t*)asset_entry_data(entry);
+		stored[test_random() % entry->stored_size] ^= (uint8_t)(1 + test_random() % 255);
+		if (asset_entry_read(entry, read) && memcmp(read, shader->data, shader->size) == 0)
+			harmless++;
+		else
+			undetected += asset_entry_verify(entry);
+	}
+	CHECK(undetected == 0, "%u damaged payloads passed verification", undetected);
+	printf("200 damaged payloads: %u decoded to the same bytes, the rest failed\n", harmless);
+	free(read);
+
+	free(copy);
+	free(archive);
+	for (uint32_t i = 0; i < COUNT; ++i) {
+		if (payloads[i].stored != payloads[i].data) free(payloads[i].stored);
+		free(payloads[i].blocks);
+		free(payloads[i].data);
+	}
+	job_system_shutdown();
+	return test_finish("asset_archive_test");
+}
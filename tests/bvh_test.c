@@ -0,0 +1,258 @@
+// bvh.c against brute force: trees over random boxes of several sizes, with stacks of identical
+// boxes too, checked for every object in exactly one leaf and every box inside its parent's, after
+// the build and after a refit, which must also leave every box tight. Frustum queries must find
+// exactly what a test of every object finds, ray picks the same nearest entry distance. Then the
+// build, refit and queries timed on a million objects.
+
+#include "test_util.c"
+#include "../source/vecmath.c"
+#include "../source/job_system.c"
+#include "../source/cull.c"
+#include "../source/bvh.c"
+
+#define TEST_WORKERS 4
+
+static void random_bounds(struct cull_bounds* bounds, uint32_t count, float spread)
+{
+	cull_bounds_resize(bounds, count);
+	for (uint32_t i = 0; i < count; ++i) {
+		struct vec3 extent = {test_random_float(0.01f, 0.2f), test_random_float(0.01f, 0.2f), test_random_float(0.01f, 0.2f)};
+		struct vec3 center = {test_random_float(-spread, spread), test_random_float(-spread, spread), test_random_float(-spread, spread)};
+		// a stack of objects in one place, which no split can tell apart
+		if (count >= 100 && i < 50) center = vec3_make(0.5f, 0.5f, 0.5f);
+		cull_bounds_set(bounds, i, center, vec3_length(extent), extent);
+	}
+}
+
+struct validation
+{
+	uint8_t* seen;
+	uint32_t objects;
+	uint32_t errors;
+	bool tight; // boxes must be exactly the union of what is below
+};
+
+static void validate_node(const struct bvh* bvh, const struct cull_bounds* bounds, uint32_t node_index, uint32_t depth, struct validation* v)
+{
+	const struct bvh_node* node = &bvh->nodes[node_index];
+	struct bvh_box box = bvh_box_empty;
+	if (node->count) {
+		for (uint32_t i = node->first; i < node->first + node->count; ++i) {
+			uint32_t object = bvh->indices[i];
+			if (object >= bounds->count || v->seen[object]++) {
+				v->errors++;
+				continue;
+			}
+			v->objects++;
+			struct bvh_box object_box = bvh_object_box(bounds, object);
+			bvh_box_grow(&box, &object_box);
+		}
+	} else {
+		if (node->first % 2 || node->first + 1 >= bvh->node_count || depth >= BVH_MAX_DEPTH) {
+			v->errors++;
+			return;
+		}
+		for (uint32_t c = 0; c < 2; ++c) {
+			const struct bvh_node* child = &bvh->nodes[node->first + c];
+			validate_node(bvh, bounds, node->first + c, depth + 1, v);
+			bvh_box_grow_corners(&box, child->min, child->max);
+		}
+	}
+	for (int axis = 0; axis < 3; ++axis) {
+		if (box.min[axis] < node->min[axis] || box.max[axis] > node->max[axis]) v->errors++;
+		if (v->tight && (box.min[axis] != node->min[axis] || box.max[axis] != node->max[axis])) v->errors++;
+	}
+}
+
+static void validate(const struct bvh* bvh, const struct cull_bounds* bounds, bool tight, const char* when)
+{
+	struct validation v = {.seen = test_allocate(bounds->count), .tight = tight};
+	if (bvh->node_count) validate_node(bvh, bounds, 0, 0, &v);
+	CHECK(v.errors == 0 && v.objects == bounds->count, "%u objects %s: %u errors, %u objects in leaves", bounds->count, when, v.errors, v.objects);
+	CHECK(((uintptr_t)bvh->nodes & 63) == 0, "nodes not cache line aligned");
+	free(v.seen);
+}
+
+static int compare_indices(const void* a, const void* b)
+{
+	uint32_t x = *(const uint32_t*)a, y = *(const uint32_t*)b;
+	return x < y ? -1 : x > y;
+}
+
+static struct frustum random_frustum(float spread)
+{
+	struct mat4 projection = mat4_perspective(test_random_float(0.3f, 1.5f), 1.5f, 0.1f, spread * 1.5f);
+	struct vec3 eye = {test_random_float(-spread, spread), test_random_float(-spread, spread), -spread * 1.2f};
+	struct vec3 target = {test_random_float(-spread, spread) * 0.5f, test_random_float(-spread, spread) * 0.5f, 0.0f};
+	struct mat4 view = mat4_look_at(eye, target, vec3_make(0, 1, 0));
+	struct mat4 view_projection = mat4_mul(&projection, &view);
+	return frustum_from_matrix(&view_projection);
+}
+
+static void check_frustum_queries(const struct bvh* bvh, const struct cull_bounds* bounds, float spread, const char* when)
+{
+	uint32_t count = bounds->count;
+	uint32_t* found = test_allocate((count + 1) * sizeof(uint32_t));
+	uint32_t* expected = test_allocate((count + 1) * sizeof(uint32_t));
+	uint32_t wrong = 0;
+	for (int query = 0; query < 8; ++query) {
+		struct frustum frustum = random_frustum(spread);
+		uint32_t found_count = bvh_query_frustum(bvh, bounds, &frustum, found);
+		uint32_t expected_count = 0;
+		for (uint32_t i = 0; i < count; ++i)
+			if (cull_test_scalar(bounds, &frustum, i)) expected[expected_count++] = i;
+		qsort(found, found_count, sizeof(uint32_t), compare_indices);
+		wrong += found_count != expected_count || memcmp(found, expected, found_count * sizeof(uint32_t)) != 0;
+	}
+	CHECK(wrong == 0, "%u objects %s: %u of 8 frustum queries differ from testing every object", count, when, wrong);
+	free(found);
+	free(expected);
+}
+
+// The same slab test the tree runs, on every object.
+static struct bvh_hit brute_force_ray(const struct cull_bounds* bounds, struct vec3 origin, struct vec3 direction, float max_t)
+{
+	struct bvh_hit hit = {UINT32_MAX, max_t};
+	float o[3] = {origin.x, origin.y, origin.z};
+	float inverse[3] = {1.0f / direction.x, 1.0f / direction.y, 1.0f / direction.z};
+	for (uint32_t i = 0; i < bounds->count; ++i) {
+		float entry = 0.0f, exit = hit.t;
+		for (int axis = 0; axis < 3; ++axis) {
+			float t0 = (bounds->center[axis][i] - bounds->extent[axis][i] - o[axis]) * inverse[axis];
+			float t1 = (bounds->center[axis][i] + bounds->extent[axis][i] - o[axis]) * inverse[axis];
+			entry = bvh_max(entry, bvh_min(t0, t1));
+			exit = bvh_min(exit, bvh_max(t0, t1));
+		}
+		if (entry <= exit && entry < hit.t) hit = (struct bvh_hit){i, entry};
+	}
+	return hit;
+}
+
+static void check_rays(const struct bvh* bvh, const struct cull_bounds* bounds, float spread, uint32_t rays, const char* when)
+{
+	uint32_t wrong = 0;
+	for (uint32_t ray = 0; ray < rays; ++ray) {
+		struct vec3 origin = {test_random_float(-spread, spread), test_random_float(-spread, spread), -spread * 1.5f};
+		struct vec3 target = {test_random_float(-spread, spread), test_random_float(-spread, spread), test_random_float(-spread, spread)};
+		struct vec3 direction = vec3_normalize(vec3_sub(target, origin));
+		if (ray % 8 == 0) direction = vec3_make(0.0f, 0.0f, 1.0f); // parallel to two slabs
+		float max_t = ray % 4 == 1 ? spread : 1e30f;
+		struct bvh_hit hit, expected = brute_force_ray(bounds, origin, direction, max_t);
+		bool found = bvh_query_ray(bvh, bounds, origin, direction, max_t, &hit);
+		// objects entered at the same distance may be picked in either order
+		wrong += found != (expected.index != UINT32_MAX) || (found && hit.t != expected.t);
+	}
+	CHECK(wrong == 0, "%u objects %s: %u of %u rays differ from testing every object", bounds->count, when, wrong, rays);
+}
+
+static void test_sizes(void)
+{
+	uint32_t sizes[] = {0, 1, 2, 3, 5, 17, 100, 1000, 100000};
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		uint32_t count = sizes[s];
+		float spread = 1.0f + cbrtf((float)count) * 0.3f;
+		struct cull_bounds bounds = {0};
+		random_bounds(&bounds, count, spread);
+		struct bvh bvh = {0};
+		if (!CHECK(bvh_build(&bvh, &bounds), "build of %u objects failed", count)) continue;
+		validate(&bvh, &bounds, false, "built");
+		check_frustum_queries(&bvh, &bounds, spread, "built");
+		check_rays(&bvh, &bounds, spread, count > 10000 ? 200 : 1000, "built");
+
+		// objects move, the refit keeps the topology and makes every box tight again
+		for (uint32_t i = 0; i < count; ++i)
+			for (int axis = 0; axis < 3; ++axis) bounds.center[axis][i] += test_random_float(-0.3f, 0.3f);
+		bvh_refit(&bvh, &bounds);
+		validate(&bvh, &bounds, true, "refit");
+		check_frustum_queries(&bvh, &bounds, spread, "refit");
+		check_rays(&bvh, &bounds, spread, count > 10000 ? 200 : 1000, "refit");
+
+		// a rebuild into the same memory
+		if (CHECK(bvh_build(&bvh, &bounds), "rebuild of %u objects failed", count)) validate(&bvh, &bounds, false, "rebuilt");
+		bvh_free(&bvh);
+		cull_bounds_free(&bounds);
+	}
+}
+
+// benchmark
+
+#define BENCH_COUNT 1000000
+
+static struct
+{
+	struct cull_bounds bounds;
+	struct bvh bvh;
+	struct frustum frustum;
+	uint32_t* visible;
+	uint32_t count;
+} g_bench;
+
+static void bench_build(void* data)
+{
+	(void)data;
+	bvh_build(&g_bench.bvh, &g_bench.bounds);
+}
+
+static void bench_refit(void* data)
+{
+	(void)data;
+	bvh_refit(&g_bench.bvh, &g_bench.bounds);
+}
+
+static void bench_query(void* data)
+{
+	(void)data;
+	g_bench.count = bvh_query_frustum(&g_bench.bvh, &g_bench.bounds, &g_bench.frustum, g_bench.visible);
+}
+
+static void bench_cull(void* data)
+{
+	(void)data;
+	g_bench.count = cull_run(&g_bench.bounds, &g_bench.frustum, g_bench.visible, false);
+}
+
+static void bench_rays(void* data)
+{
+	(void)data;
+	struct bvh_hit hit;
+	uint32_t hits = 0;
+	for (uint32_t ray = 0; ray < 10000; ++ray) {
+		struct vec3 origin = {(float)(ray % 100) - 50.0f, (float)(ray / 100) - 50.0f, -100.0f};
+		hits += bvh_query_ray(&g_bench.bvh, &g_bench.bounds, origin, vec3_normalize(vec3_make(0.1f, 0.05f, 1.0f)), 1e30f, &hit);
+	}
+	g_bench.count = hits;
+}
+
+int main(void)
+{
+	if (!job_system_init(TEST_WORKERS)) {
+		fputs("cannot start the workers\n", stderr);
+		return 1;
+	}
+	test_sizes();
+
+	random_bounds(&g_bench.bounds, BENCH_COUNT, 50.0f);
+	g_bench.visible = test_allocate(BENCH_COUNT * sizeof(uint32_t));
+	g_bench.frustum = random_frustum(50.0f);
+	double build = test_time_ms(5, bench_build, NULL);
+	for (uint32_t i = 0; i < BENCH_COUNT; ++i) g_bench.bounds.center[1][i] += 0.1f;
+	double refit = test_time_ms(9, bench_refit, NULL);
+	double query = test_time_ms(9, bench_query, NULL);
+	uint32_t query_count = g_bench.count;
+	double cull = test_time_ms(9, bench_cull, NULL);
+	double rays = test_time_ms(5, bench_rays, NULL);
+	printf("%u objects, %u threads: build %.2f ms (%u nodes), refit %.2f ms\n", BENCH_COUNT, job_thread_count(), build, g_bench.bvh.node_count, refit);
+	printf("frustum query %.3f ms (%u visible), cull_run %.3f ms; 10000 rays %.3f ms (%u hits)\n", query, query_count, cull, rays, g_bench.count);
+	job_system_shutdown();
+
+	// without workers the build runs on the calling thread alone
+	if (job_system_init(1)) {
+		double serial = test_time_ms(3, bench_build, NULL);
+		printf("%u objects on the calling thread alone: build %.2f ms\n", BENCH_COUNT, serial);
+		job_system_shutdown();
+	}
+	bvh_free(&g_bench.bvh);
+	cull_bounds_free(&g_bench.bounds);
+	free(g_bench.visible);
+	return test_finish("bvh_test");
+}
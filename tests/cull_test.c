@@ -0,0 +1,238 @@
+// cull.c: every kernel the CPU runs, AVX2, SSE and the scalar one, against a frustum test in double
+// precision here, over random objects around a perspective frustum and over odd ranges so the
+// scalar tails are covered, then through cull_run() flat and hierarchical. Kernels may only
+// disagree with it on objects within float rounding of a plane. Boxes and spheres exactly touching
+// a plane of an axis aligned frustum, where every path computes exactly, must be kept, and one
+// float step further out culled. Then each path timed on a million objects.
+
+#include "test_util.c"
+#include "../source/vecmath.c"
+#include "../source/job_system.c"
+#include "../source/cull.c"
+
+#define TEST_WORKERS 4
+#define OBJECT_COUNT 100003 // not a multiple of any vector width
+
+// How far inside the frustum the object reaches, negative when culled, and how large the terms
+// summed were, which bounds the float rounding of the kernels.
+static double reference_margin(const struct cull_bounds* bounds, const struct frustum* frustum, uint32_t i, double* magnitude)
+{
+	double margin = INFINITY;
+	*magnitude = 0.0;
+	for (int p = 0; p < 6; ++p) {
+		const float* plane = &frustum->planes[p].x;
+		double distance = plane[3], box = 0.0, terms = fabs(plane[3]);
+		for (int k = 0; k < 3; ++k) {
+			distance += (double)plane[k] * bounds->center[k][i];
+			box += fabs((double)plane[k]) * bounds->extent[k][i];
+			terms += fabs((double)plane[k] * bounds->center[k][i]);
+		}
+		double reach = fmin(bounds->radius[i], box);
+		margin = fmin(margin, distance + reach);
+		*magnitude = fmax(*magnitude, terms + reach);
+	}
+	return margin;
+}
+
+struct reference
+{
+	uint8_t* visible;
+	uint8_t* uncertain; // within rounding of a plane, either answer is right
+	uint32_t visible_count;
+	uint32_t uncertain_count;
+};
+
+static void reference_cull(const struct cull_bounds* bounds, const struct frustum* frustum, struct reference* reference)
+{
+	reference->visible_count = reference->uncertain_count = 0;
+	for (uint32_t i = 0; i < bounds->count; ++i) {
+		double magnitude;
+		double margin = reference_margin(bounds, frustum, i, &magnitude);
+		reference->visible[i] = margin >= 0.0;
+		reference->uncertain[i] = fabs(margin) <= 1e-5 * magnitude;
+		reference->visible_count += reference->visible[i];
+		reference->uncertain_count += reference->uncertain[i];
+	}
+}
+
+// Indices in [begin, end) ascending, each visible by the reference unless uncertain, none missing.
+static uint32_t count_wrong(const struct reference* reference, uint32_t begin, uint32_t end, const uint32_t* indices, uint32_t count)
+{
+	uint32_t wrong = 0, next = begin;
+	for (uint32_t k = 0; k < count; ++k) {
+		uint32_t i = indices[k];
+		if (i < next || i >= end) return wrong + 1 + count - k; // out of order or out of range
+		for (; next < i; ++next) wrong += reference->visible[next] && !reference->uncertain[next];
+		wrong += !reference->visible[i] && !reference->uncertain[i];
+		next = i + 1;
+	}
+	for (; next < end; ++next) wrong += reference->visible[next] && !reference->uncertain[next];
+	return wrong;
+}
+
+static void random_bounds(struct cull_bounds* bounds, uint32_t count)
+{
+	cull_bounds_resize(bounds, count);
+	for (uint32_t i = 0; i < count; ++i) {
+		// spread around the frustum below, boxes from flat to cubes, spheres from tight to loose
+		struct vec3 center = {test_random_float(-120, 120), test_random_float(-80, 80), test_random_float(-20, 220)};
+		struct vec3 extent = {test_random_float(0.01f, 6), test_random_float(0.01f, 6), test_random_float(0.01f, 6)};
+		float radius = vec3_length(extent) * test_random_float(0.3f, 1.5f);
+		cull_bounds_set(bounds, i, center, radius, extent);
+	}
+}
+
+static struct frustum perspective_frustum(float yaw)
+{
+	struct mat4 projection = mat4_perspective(1.0f, 16.0f / 9.0f, 0.5f, 200.0f);
+	struct vec3 eye = {3.0f, 2.0f, -5.0f};
+	struct mat4 view = mat4_look_at(eye, vec3_add(eye, vec3_make(sinf(yaw), 0.1f, cosf(yaw))), vec3_make(0, 1, 0));
+	struct mat4 view_projection = mat4_mul(&projection, &view);
+	return frustum_from_matrix(&view_projection);
+}
+
+static void test_random_objects(void)
+{
+	struct cull_bounds bounds = {0};
+	random_bounds(&bounds, OBJECT_COUNT);
+	cull_build_groups(&bounds);
+	struct reference reference = {.visible = test_allocate(OBJECT_COUNT), .uncertain = test_allocate(OBJECT_COUNT)};
+	uint32_t* visible = test_allocate(OBJECT_COUNT * sizeof(uint32_t));
+
+	for (int view = 0; view < 4; ++view) {
+		struct frustum frustum = perspective_frustum(-0.6f + 0.4f * (float)view);
+		reference_cull(&bounds, &frustum, &reference);
+		for (int path = VECMATH_PATH_SCALAR; path <= VECMATH_PATH_AVX2; ++path) {
+			cull_init((enum vecmath_path)path);
+			if (g_cull.path != (enum vecmath_path)path) continue;
+			const char* name = vecmath_path_name(g_cull.path);
+
+			// the kernel itself over ranges that start and end anywhere
+			uint32_t wrong = 0;
+			for (int round = 0; round < 200; ++round) {
+				uint32_t begin = test_random() % OBJECT_COUNT;
+				uint32_t end = begin + test_random() % (OBJECT_COUNT - begin + 1);
+				if (round < 20) end = begin + (uint32_t)round < OBJECT_COUNT ? begin + (uint32_t)round : OBJECT_COUNT;
+				uint32_t count = g_cull.range(&bounds, &frustum, begin, end, visible);
+				wrong += count_wrong(&reference, begin, end, visible, count);
+			}
+			CHECK(wrong == 0, "view %d, %s kernel: %u objects off the reference", view, name, wrong);
+
+			for (int hierarchical = 0; hierarchical < 2; ++hierarchical) {
+				uint32_t count = cull_run(&bounds, &frustum, visible, hierarchical);
+				wrong = count_wrong(&reference, 0, OBJECT_COUNT, visible, count);
+				CHECK(wrong == 0, "view %d, %s cull_run %s: %u objects off the reference", view, name, hierarchical ? "hierarchical" : "flat", wrong);
+			}
+		}
+		if (view == 0)
+			printf("random objects: %u of %u visible, %u within rounding of a plane\n", reference.visible_count, OBJECT_COUNT, reference.uncertain_count);
+	}
+	free(reference.visible);
+	free(reference.uncertain);
+	free(visible);
+	cull_bounds_free(&bounds);
+}
+
+// A box shaped frustum with axis aligned planes, where products are by 0 or 1 and every sum below
+// is exact in float whatever the kernel's order or FMA.
+static const struct frustum g_box_frustum = {
+	.planes = {{1, 0, 0, 8}, {-1, 0, 0, 8}, {0, 1, 0, 8}, {0, -1, 0, 8}, {0, 0, 1, 0}, {0, 0, -1, 64}},
+};
+
+static void test_on_plane(void)
+{
+	// per plane: a box touching it from outside, a sphere smaller than the box touching it, and
+	// each of them one float step further out
+	enum { PER_PLANE = 4, COUNT = 6 * PER_PLANE * 7 };
+	struct cull_bounds bounds = {0};
+	cull_bounds_resize(&bounds, COUNT);
+	uint8_t expected[COUNT];
+	for (uint32_t i = 0; i < COUNT; ++i) {
+		uint32_t plane = (i / PER_PLANE) % 6, kind = i % PER_PLANE;
+		const float* normal = &g_box_frustum.planes[plane].x;
+		float extent = 0.25f * (float)(1 + i % 9);
+		bool sphere = kind >= 2;
+		float radius = sphere ? extent * 0.5f : extent * 4.0f; // the smaller of the two reaches decides
+		// the plane's point nearest the frustum's middle, moved out by exactly the reach
+		float center[3] = {0.0f, 0.0f, 32.0f};
+		for (int k = 0; k < 3; ++k) {
+			if (normal[k] == 0.0f) continue;
+			float touching = -normal[k] * (normal[3] + (sphere ? radius : extent));
+			center[k] = kind & 1 ? nextafterf(touching, normal[k] > 0 ? -INFINITY : INFINITY) : touching;
+		}
+		cull_bounds_set(&bounds, i, vec3_make(center[0], center[1], center[2]), radius, vec3_make(extent, extent, extent));
+		expected[i] = (kind & 1) == 0;
+	}
+	cull_build_groups(&bounds);
+	uint32_t visible[COUNT];
+	for (int path = VECMATH_PATH_SCALAR; path <= VECMATH_PATH_AVX2; ++path) {
+		cull_init((enum vecmath_path)path);
+		if (g_cull.path != (enum vecmath_path)path) continue;
+		for (int hierarchical = 0; hierarchical < 2; ++hierarchical) {
+			uint32_t count = cull_run(&bounds, &g_box_frustum, visible, hierarchical);
+			uint8_t got[COUNT] = {0};
+			for (uint32_t k = 0; k < count; ++k) got[visible[k]] = 1;
+			uint32_t kept_outside = 0, culled_touching = 0;
+			for (uint32_t i = 0; i < COUNT; ++i) {
+				kept_outside += got[i] && !expected[i];
+				culled_touching += !got[i] && expected[i];
+			}
+			CHECK(culled_touching == 0 && kept_outside == 0, "%s %s: %u objects touching a plane culled, %u one step outside kept",
+			      vecmath_path_name(g_cull.path), hierarchical ? "hierarchical" : "flat", culled_touching, kept_outside);
+		}
+	}
+	cull_bounds_free(&bounds);
+}
+
+// benchmark
+
+#define BENCH_COUNT (1u << 20)
+
+static struct
+{
+	struct cull_bounds bounds;
+	struct frustum frustum;
+	uint32_t* visible;
+	bool hierarchical;
+	uint32_t count;
+} g_bench;
+
+static void bench_cull(void* data)
+{
+	(void)data;
+	g_bench.count = cull_run(&g_bench.bounds, &g_bench.frustum, g_bench.visible, g_bench.hierarchical);
+}
+
+int main(void)
+{
+	if (!job_system_init(TEST_WORKERS)) {
+		fputs("cannot start the workers\n", stderr);
+		return 1;
+	}
+	test_random_objects();
+	test_on_plane();
+
+	// a grid, consecutive objects close together as the hierarchical mode wants
+	cull_bounds_resize(&g_bench.bounds, BENCH_COUNT);
+	for (uint32_t i = 0; i < BENCH_COUNT; ++i) {
+		struct vec3 center = {(float)(i % 1024) * 0.5f - 256.0f, 0.0f, (float)(i / 1024) * 0.5f - 50.0f};
+		cull_bounds_set(&g_bench.bounds, i, center, 0.35f, vec3_make(0.2f, 0.2f, 0.2f));
+	}
+	cull_build_groups(&g_bench.bounds);
+	g_bench.frustum = perspective_frustum(0.3f);
+	g_bench.visible = test_allocate(BENCH_COUNT * sizeof(uint32_t));
+	for (int path = VECMATH_PATH_SCALAR; path <= VECMATH_PATH_AVX2; ++path) {
+		cull_init((enum vecmath_path)path);
+		if (g_cull.path != (enum vecmath_path)path) continue;
+		g_bench.hierarchical = false;
+		double flat = test_time_ms(15, bench_cull, NULL);
+		g_bench.hierarchical = true;
+		double hierarchical = test_time_ms(15, bench_cull, NULL);
+		printf("%-6s %u objects, %u visible: flat %.3f ms, hierarchical %.3f ms on %u threads\n", vecmath_path_name(g_cull.path), BENCH_COUNT, g_bench.count,
+		       flat, hierarchical, job_thread_count());
+	}
+	free(g_bench.visible);
+	cull_bounds_free(&g_bench.bounds);
+	job_system_shutdown();
+	return test_finish("cull_test");
+}
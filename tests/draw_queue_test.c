@@ -0,0 +1,330 @@
+// draw_queue.c on Linux, with just enough of the D3D12 types for it to build: draw_queue_sort()
+// against qsort on random 64-bit keys, on keys with many ties, on keys that differ in a few bytes
+// only and on the game's DRAW_KEY layout, at sizes around the insertion sort and chunk limits. Ties
+// must keep their push order, which the command index records, and passes whose digit all keys
+// share must be skipped. Then draw_queue_record() into a fake command list that counts its calls.
+// Then the sort timed on a frame of a million draws.
+
+#include "test_util.c"
+#include "../source/job_system.c"
+
+// the D3D12 stand-ins, only what draw_queue.c touches
+typedef struct { uint64_t ptr; } D3D12_GPU_DESCRIPTOR_HANDLE;
+typedef struct { uint64_t BufferLocation; uint32_t SizeInBytes; uint32_t StrideInBytes; } D3D12_VERTEX_BUFFER_VIEW;
+typedef enum { DXGI_FORMAT_R16_UINT = 57 } DXGI_FORMAT;
+typedef struct { uint64_t BufferLocation; uint32_t SizeInBytes; DXGI_FORMAT Format; } D3D12_INDEX_BUFFER_VIEW;
+typedef enum { D3D_PRIMITIVE_TOPOLOGY_TRIANGLELIST = 4 } D3D_PRIMITIVE_TOPOLOGY;
+typedef struct ID3D12RootSignature ID3D12RootSignature;
+typedef struct ID3D12PipelineState ID3D12PipelineState;
+typedef struct ID3D12GraphicsCommandList ID3D12GraphicsCommandList;
+
+struct ID3D12GraphicsCommandListVtbl
+{
+	void (*SetGraphicsRootSignature)(ID3D12GraphicsCommandList* list, ID3D12RootSignature* root_signature);
+	void (*SetGraphicsRootDescriptorTable)(ID3D12GraphicsCommandList* list, unsigned index, D3D12_GPU_DESCRIPTOR_HANDLE table);
+	void (*SetPipelineState)(ID3D12GraphicsCommandList* list, ID3D12PipelineState* pso);
+	void (*IASetVertexBuffers)(ID3D12GraphicsCommandList* list, unsigned slot, unsigned count, const D3D12_VERTEX_BUFFER_VIEW* views);
+	void (*IASetIndexBuffer)(ID3D12GraphicsCommandList* list, const D3D12_INDEX_BUFFER_VIEW* view);
+	void (*IASetPrimitiveTopology)(ID3D12GraphicsCommandList* list, D3D_PRIMITIVE_TOPOLOGY topology);
+	void (*SetGraphicsRoot32BitConstants)(ID3D12GraphicsCommandList* list, unsigned index, unsigned count, const void* data, unsigned offset);
+	void (*DrawIndexedInstanced)(ID3D12GraphicsCommandList* list, unsigned indices, unsigned instances, unsigned first_index, int base_vertex,
+				     unsigned first_instance);
+};
+
+// Counts what was recorded.
+struct ID3D12GraphicsCommandList
+{
+	const struct ID3D12GraphicsCommandListVtbl* lpVtbl;
+	uint32_t root_signatures;
+	uint32_t psos;
+	uint32_t vertex_buffers;
+	uint32_t index_buffers;
+	uint32_t draws;
+	uint32_t records;
+	ID3D12PipelineState* pso;
+	bool pso_wrong; // a draw with another PSO than its command's
+};
+
+#include "../source/draw_queue.c"
+
+#define TEST_WORKERS 4
+
+static void fake_root_signature(ID3D12GraphicsCommandList* list, ID3D12RootSignature* root_signature)
+{
+	(void)root_signature;
+	list->root_signatures++;
+}
+
+static void fake_table(ID3D12GraphicsCommandList* list, unsigned index, D3D12_GPU_DESCRIPTOR_HANDLE table)
+{
+	(void)list, (void)index, (void)table;
+}
+
+static void fake_pso(ID3D12GraphicsCommandList* list, ID3D12PipelineState* pso)
+{
+	list->psos++;
+	list->pso = pso;
+}
+
+static void fake_vertex_buffers(ID3D12GraphicsCommandList* list, unsigned slot, unsigned count, const D3D12_VERTEX_BUFFER_VIEW* views)
+{
+	(void)slot, (void)count, (void)views;
+	list->vertex_buffers++;
+}
+
+static void fake_index_buffer(ID3D12GraphicsCommandList* list, const D3D12_INDEX_BUFFER_VIEW* view)
+{
+	(void)view;
+	list->index_buffers++;
+}
+
+static void fake_topology(ID3D12GraphicsCommandList* list, D3D_PRIMITIVE_TOPOLOGY topology)
+{
+	(void)list, (void)topology;
+}
+
+static void fake_constants(ID3D12GraphicsCommandList* list, unsigned index, unsigned count, const void* data, unsigned offset)
+{
+	(void)list, (void)index, (void)count, (void)data, (void)offset;
+}
+
+// The first index carries the command's PSO, so every draw can be checked against what is bound.
+static void fake_draw(ID3D12GraphicsCommandList* list, unsigned indices, unsigned instances, unsigned first_index, int base_vertex, unsigned first_instance)
+{
+	(void)indices, (void)instances, (void)base_vertex, (void)first_instance;
+	list->draws++;
+	if ((uintptr_t)list->pso != first_index) list->pso_wrong = true;
+}
+
+static const struct ID3D12GraphicsCommandListVtbl g_fake_vtbl = {
+	.SetGraphicsRootSignature = fake_root_signature,
+	.SetGraphicsRootDescriptorTable = fake_table,
+	.SetPipelineState = fake_pso,
+	.IASetVertexBuffers = fake_vertex_buffers,
+	.IASetIndexBuffer = fake_index_buffer,
+	.IASetPrimitiveTopology = fake_topology,
+	.SetGraphicsRoot32BitConstants = fake_constants,
+	.DrawIndexedInstanced = fake_draw,
+};
+
+static void fake_record(ID3D12GraphicsCommandList* list, void* data)
+{
+	(void)data;
+	list->records++;
+}
+
+static int compare_items(const void* a, const void* b)
+{
+	const struct draw_item* x = a;
+	const struct draw_item* y = b;
+	if (x->key != y->key) return x->key < y->key ? -1 : 1;
+	return x->command < y->command ? -1 : x->command > y->command; // push order
+}
+
+enum key_kind
+{
+	KEYS_RANDOM,
+	KEYS_TIES,      // 16 distinct keys
+	KEYS_FEW_BYTES, // bytes 1 and 5 only, every other pass skipped
+	KEYS_LAYOUT,    // DRAW_KEY fields as the game fills them
+	KEYS_SAME,
+	KEY_KIND_COUNT,
+};
+
+static const char* key_kind_names[KEY_KIND_COUNT] = {"random", "ties", "few bytes", "layout", "same"};
+
+static uint64_t make_key(enum key_kind kind)
+{
+	switch (kind) {
+		case KEYS_RANDOM: return test_random64();
+		case KEYS_TIES: return test_random64() % 16 * 0x0123456789abcdefull;
+		case KEYS_FEW_BYTES: return 0x7700000000000000ull | (uint64_t)(test_random() & 0xff) << 8 | (uint64_t)(test_random() & 0xff) << 40;
+		case KEYS_LAYOUT: {
+			uint32_t pso = test_random() % 12;
+			float depth = test_random_float(0.0f, 100.0f);
+			return pso >= 8 ? DRAW_KEY(DRAW_LAYER_SCENE, DRAW_PASS_TRANSPARENT, pso, test_random() % 64, draw_key_depth_back_to_front(depth))
+					: DRAW_KEY(DRAW_LAYER_SCENE, DRAW_PASS_OPAQUE, pso, test_random() % 64, draw_key_depth(depth));
+		}
+		default: return 0x1234;
+	}
+}
+
+// Passes whose digit is not the same for every key.
+static uint32_t expected_passes(const struct draw_item* items, uint32_t count)
+{
+	uint64_t differing = 0;
+	for (uint32_t i = 1; i < count; ++i) differing |= items[i].key ^ items[0].key;
+	uint32_t passes = 0;
+	for (uint32_t pass = 0; pass < DRAW_SORT_PASSES; ++pass) passes += (differing >> (pass * 8) & 0xff) != 0;
+	return passes;
+}
+
+static void test_sort(void)
+{
+	// around the insertion sort, one chunk, many chunks and past DRAW_SORT_MAX_CHUNKS full chunks
+	uint32_t sizes[] = {0, 1, 2, DRAW_SORT_INSERTION, DRAW_SORT_INSERTION + 1, 1000, DRAW_SORT_CHUNK, DRAW_SORT_CHUNK + 1, 100003,
+			    DRAW_SORT_CHUNK * DRAW_SORT_MAX_CHUNKS + 777};
+	struct draw_queue queue = {0};
+	struct draw_item* expected = test_allocate(sizes[9] * sizeof(struct draw_item));
+	for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+		uint32_t count = sizes[s];
+		for (int kind = 0; kind < KEY_KIND_COUNT; ++kind) {
+			if (!draw_queue_reserve(&queue, count, 1)) {
+				fputs("out of memory\n", stderr);
+				exit(1);
+			}
+			draw_queue_reset(&queue);
+			for (uint32_t i = 0; i < count; ++i) {
+				expected[i] = (struct draw_item){.key = make_key((enum key_kind)kind), .command = i};
+				draw_queue_push(&queue, expected[i].key, i);
+			}
+			uint32_t passes = expected_passes(expected, count);
+			qsort(expected, count, sizeof(struct draw_item), compare_items);
+			draw_queue_sort(&queue);
+			uint32_t wrong = 0;
+			for (uint32_t i = 0; i < count; ++i) wrong += queue.items[i].key != expected[i].key || queue.items[i].command != expected[i].command;
+			CHECK(wrong == 0, "%u %s keys: %u items off qsort", count, key_kind_names[kind], wrong);
+			if (count > DRAW_SORT_INSERTION)
+				CHECK(queue.stats.sort_passes == passes, "%u %s keys: %u radix passes, %u digits differ", count, key_kind_names[kind], queue.stats.sort_passes,
+				      passes);
+		}
+	}
+	free(expected);
+	draw_queue_free(&queue);
+}
+
+static void test_record(void)
+{
+	// commands: 8 PSOs x 4 vertex buffers, one index buffer, and a recorded function now and then
+	enum { PSOS = 8, BUFFERS = 4, ITEMS = 20000 };
+	struct draw_queue queue = {0};
+	if (!draw_queue_reserve(&queue, ITEMS, PSOS * BUFFERS + 1)) exit(1);
+	for (uint32_t c = 0; c < PSOS * BUFFERS; ++c) {
+		uintptr_t pso = 1 + c / BUFFERS;
+		struct draw_command command = {
+			.root_signature = (ID3D12RootSignature*)(uintptr_t)(pso < 5 ? 1 : 2),
+			.pso = (ID3D12PipelineState*)pso,
+			.vertex_buffer = {.BufferLocation = 0x1000 * (1 + c % BUFFERS), .SizeInBytes = 256, .StrideInBytes = 16},
+			.index_buffer = {.BufferLocation = 0x100000, .SizeInBytes = 1024, .Format = DXGI_FORMAT_R16_UINT},
+			.index_count = 3,
+			.instance_count = 1,
+			.first_index = (uint32_t)pso,
+		};
+		draw_queue_command(&queue, &command);
+	}
+	uint32_t record_command = draw_queue_command(&queue, &(struct draw_command){.record = fake_record});
+	uint32_t records = 0;
+	for (uint32_t i = 0; i < ITEMS; ++i) {
+		uint32_t command = test_random() % (PSOS * BUFFERS);
+		uint64_t key = DRAW_KEY(DRAW_LAYER_SCENE, DRAW_PASS_OPAQUE, command / BUFFERS, command % BUFFERS, test_random());
+		if (i % 1000 == 0) {
+			command = record_command;
+			key = DRAW_KEY(DRAW_LAYER_SCENE, test_random() % 2 ? DRAW_PASS_TRANSPARENT : DRAW_PASS_END, 0, 0, 0);
+			records++;
+		}
+		draw_queue_push(&queue, key, command);
+	}
+	draw_queue_sort(&queue);
+
+	// sorted, a PSO is set once per PSO in every run between recorded functions, a vertex buffer
+	// once per PSO and buffer
+	uint32_t expected_psos = 0, expected_buffers = 0;
+	const struct draw_command* previous = NULL;
+	for (uint32_t i = 0; i < ITEMS; ++i) {
+		const struct draw_command* command = &queue.commands[queue.items[i].command];
+		if (command->record) {
+			previous = NULL;
+			continue;
+		}
+		expected_psos += !previous || previous->pso != command->pso;
+		expected_buffers += !previous || previous->vertex_buffer.BufferLocation != command->vertex_buffer.BufferLocation;
+		previous = command;
+	}
+	ID3D12GraphicsCommandList list = {.lpVtbl = &g_fake_vtbl};
+	draw_queue_record(&queue, &list);
+	const struct draw_stats* stats = &queue.stats;
+	CHECK(list.draws == ITEMS - records && list.records == records, "%u draws and %u recorded functions, expected %u and %u", list.draws, list.records,
+	      ITEMS - records, records);
+	CHECK(!list.pso_wrong, "a draw recorded with another command's PSO bound");
+	CHECK(list.psos == expected_psos && stats->sets[DRAW_STATE_PSO] == expected_psos, "%u PSOs set, %u counted, expected %u", list.psos,
+	      stats->sets[DRAW_STATE_PSO], expected_psos);
+	CHECK(list.vertex_buffers == expected_buffers && stats->sets[DRAW_STATE_VERTEX_BUFFER] == expected_buffers, "%u vertex buffers set, expected %u",
+	      list.vertex_buffers, expected_buffers);
+	CHECK(list.root_signatures == stats->sets[DRAW_STATE_ROOT_SIGNATURE] && list.index_buffers == stats->sets[DRAW_STATE_INDEX_BUFFER],
+	      "recorded calls and counted sets differ");
+	uint32_t walked = 0;
+	for (int state = 0; state < DRAW_STATE_COUNT; ++state)
+		if (state != DRAW_STATE_VERTEX_BUFFER) walked += stats->sets[state] + stats->skips[state] != ITEMS - records;
+	CHECK(walked == 0, "sets and skips do not add up to the draws");
+
+	// without a command list the walk counts the same
+	struct draw_stats recorded = *stats;
+	draw_queue_record(&queue, NULL);
+	CHECK(memcmp(recorded.sets, stats->sets, sizeof(stats->sets)) == 0 && memcmp(recorded.skips, stats->skips, sizeof(stats->skips)) == 0,
+	      "counting without a command list differs from recording");
+	printf("record: %u draws", list.draws);
+	for (int state = 0; state < DRAW_STATE_COUNT; ++state) printf(", %s %u set %u skipped", draw_state_names[state], stats->sets[state], stats->skips[state]);
+	printf("\n");
+	draw_queue_free(&queue);
+}
+
+// benchmark
+
+#define BENCH_ITEMS (1u << 20)
+
+static struct
+{
+	struct draw_queue queue;
+	struct draw_item* items; // the frame as pushed
+	double sort_ms[64];
+	uint32_t runs;
+} g_bench;
+
+static void bench_sort(void* data)
+{
+	(void)data;
+	memcpy(g_bench.queue.items, g_bench.items, BENCH_ITEMS * sizeof(struct draw_item));
+	draw_queue_sort(&g_bench.queue);
+	g_bench.sort_ms[g_bench.runs++] = (double)g_bench.queue.stats.sort_ns / 1e6; // without the copy
+}
+
+static double bench_median(void)
+{
+	qsort(g_bench.sort_ms, g_bench.runs, sizeof(double), test_double_compare);
+	double median = g_bench.sort_ms[g_bench.runs / 2];
+	g_bench.runs = 0;
+	return median;
+}
+
+int main(void)
+{
+	if (!job_system_init(TEST_WORKERS)) {
+		fputs("cannot start the workers\n", stderr);
+		return 1;
+	}
+	test_sort();
+	test_record();
+
+	if (!draw_queue_reserve(&g_bench.queue, BENCH_ITEMS, 1)) return 1;
+	g_bench.items = test_allocate(BENCH_ITEMS * sizeof(struct draw_item));
+	atomic_store(&g_bench.queue.count, BENCH_ITEMS);
+	for (int kind = KEYS_RANDOM; kind <= KEYS_LAYOUT; ++kind) {
+		for (uint32_t i = 0; i < BENCH_ITEMS; ++i) g_bench.items[i] = (struct draw_item){.key = make_key((enum key_kind)kind), .command = i};
+		test_time_ms(15, bench_sort, NULL);
+		double sorted = bench_median();
+		printf("sort of %u %s keys, %u threads: %.3f ms, %u passes, %.0f M items/s\n", BENCH_ITEMS, key_kind_names[kind], job_thread_count(), sorted,
+		       g_bench.queue.stats.sort_passes, BENCH_ITEMS / sorted / 1000.0);
+	}
+	job_system_shutdown();
+
+	// without workers the passes run on the calling thread
+	if (job_system_init(1)) {
+		test_time_ms(9, bench_sort, NULL);
+		double serial = bench_median();
+		printf("sort of %u layout keys on the calling thread alone: %.3f ms\n", BENCH_ITEMS, serial);
+		job_system_shutdown();
+	}
+	draw_queue_free(&g_bench.queue);
+	free(g_bench.items);
+	return test_finish("draw_queue_test");
+}
@@ -0,0 +1,205 @@
+// job_system.c under load: parallel_for covering every index once, nested parallel_for,
+// continuation chains, many small jobs stolen back and forth, then parallel_for against a serial
+// loop. Four workers whatever the core count, so the deques are contended even on one core.
+
+#include "test_util.c"
+#include "../source/job_system.c"
+
+#define TEST_WORKERS 4
+
+static _Atomic uint64_t g_sum;
+
+static void sum_range(void* data, uint32_t begin, uint32_t end)
+{
+	_Atomic uint8_t* visits = data;
+	uint64_t sum = 0;
+	for (uint32_t i = begin; i < end; ++i) {
+		sum += i;
+		if (visits) atomic_fetch_add_explicit(&visits[i], 1, memory_order_relaxed);
+	}
+	atomic_fetch_add_explicit(&g_sum, sum, memory_order_relaxed);
+}
+
+static void test_parallel_for(void)
+{
+	uint32_t counts[] = {1, 2, 7, 64, 1000, 4097, 100000};
+	uint32_t grains[] = {0, 1, 3, 64, 100000};
+	_Atomic uint8_t* visits = test_allocate(100000);
+	for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+		for (size_t g = 0; g < sizeof(grains) / sizeof(grains[0]); ++g) {
+			uint32_t count = counts[c];
+			memset((void*)visits, 0, count);
+			atomic_store(&g_sum, 0);
+			job_parallel_for(count, grains[g], sum_range, (void*)visits);
+			uint32_t wrong = 0;
+			for (uint32_t i = 0; i < count; ++i) wrong += atomic_load(&visits[i]) != 1;
+			CHECK(wrong == 0, "parallel_for(%u, grain %u): %u indices not visited exactly once", count, grains[g], wrong);
+			CHECK(atomic_load(&g_sum) == (uint64_t)count * (count - 1) / 2, "parallel_for(%u, grain %u): wrong sum", count, grains[g]);
+		}
+	}
+	// repeated, a race shows up as a wrong sum sooner or later
+	uint32_t bad = 0;
+	for (int run = 0; run < 200; ++run) {
+		atomic_store(&g_sum, 0);
+		job_parallel_for(1000000, 0, sum_range, NULL);
+		bad += atomic_load(&g_sum) != 499999500000ull;
+	}
+	CHECK(bad == 0, "parallel_for(1000000): %u of 200 sums wrong", bad);
+	free((void*)visits);
+}
+
+static void nested_outer(void* data, uint32_t begin, uint32_t end)
+{
+	(void)data;
+	for (uint32_t i = begin; i < end; ++i) job_parallel_for(1000, 16, sum_range, NULL);
+}
+
+static void test_nested(void)
+{
+	for (int run = 0; run < 20; ++run) {
+		atomic_store(&g_sum, 0);
+		job_parallel_for(64, 1, nested_outer, NULL);
+		CHECK(atomic_load(&g_sum) == 64ull * 499500, "nested parallel_for: sum %llu", (unsigned long long)atomic_load(&g_sum));
+	}
+}
+
+// A chain of stages: each stage's jobs run on its counter, whose continuation checks that all of
+// them finished and starts the next stage.
+#define CHAIN_STAGES 16
+#define CHAIN_JOBS 8
+
+static struct
+{
+	struct job_counter stages[CHAIN_STAGES];
+	struct job_counter continuations[CHAIN_STAGES];
+	_Atomic uint32_t done[CHAIN_STAGES];
+	_Atomic uint32_t out_of_order;
+	_Atomic uint32_t finished;
+} g_chain;
+
+static void chain_job(void* data, uint32_t begin, uint32_t end)
+{
+	(void)data;
+	(void)end;
+	// a previous stage still running would be a continuation that fired early
+	if (begin > 0 && atomic_load(&g_chain.done[begin - 1]) != CHAIN_JOBS) atomic_fetch_add(&g_chain.out_of_order, 1);
+	atomic_fetch_add(&g_chain.done[begin], 1);
+}
+
+static void chain_continue(void* data, uint32_t begin, uint32_t end)
+{
+	(void)data;
+	(void)end;
+	if (atomic_load(&g_chain.done[begin]) != CHAIN_JOBS) atomic_fetch_add(&g_chain.out_of_order, 1);
+	if (begin + 1 == CHAIN_STAGES) {
+		atomic_fetch_add(&g_chain.finished, 1);
+		return;
+	}
+	struct job_decl jobs[CHAIN_JOBS];
+	for (int i = 0; i < CHAIN_JOBS; ++i) jobs[i] = (struct job_decl){chain_job, NULL, begin + 1, begin + 2};
+	job_run(jobs, CHAIN_JOBS, &g_chain.stages[begin + 1]);
+}
+
+static void test_continuations(void)
+{
+	for (int run = 0; run < 500; ++run) {
+		memset(&g_chain, 0, sizeof(g_chain));
+		for (uint32_t s = 0; s < CHAIN_STAGES; ++s)
+			job_counter_set_continuation(&g_chain.stages[s], (struct job_decl){chain_continue, NULL, s, s + 1}, &g_chain.continuations[s]);
+		struct job_decl jobs[CHAIN_JOBS];
+		for (int i = 0; i < CHAIN_JOBS; ++i) jobs[i] = (struct job_decl){chain_job, NULL, 0, 1};
+		job_run(jobs, CHAIN_JOBS, &g_chain.stages[0]);
+		for (uint32_t s = 0; s < CHAIN_STAGES; ++s) job_wait(&g_chain.continuations[s]);
+		if (!CHECK(atomic_load(&g_chain.finished) == 1 && atomic_load(&g_chain.out_of_order) == 0, "continuation chain run %d: finished %u, %u out of order",
+			   run, atomic_load(&g_chain.finished), atomic_load(&g_chain.out_of_order)))
+			break;
+	}
+}
+
+// Tiny jobs, far more than a deque holds, so the owner drains while the others steal.
+#define STEAL_JOBS 20000
+
+static _Atomic uint8_t g_steal_runs[STEAL_JOBS];
+
+static void steal_job(void* data, uint32_t begin, uint32_t end)
+{
+	(void)data;
+	for (uint32_t i = begin; i < end; ++i) atomic_fetch_add_explicit(&g_steal_runs[i], 1, memory_order_relaxed);
+}
+
+static void test_steal_contention(void)
+{
+	static struct job_decl jobs[STEAL_JOBS];
+	for (uint32_t i = 0; i < STEAL_JOBS; ++i) jobs[i] = (struct job_decl){steal_job, NULL, i, i + 1};
+	uint64_t steals_before = 0;
+	for (uint32_t t = 0; t < JOB_MAX_THREADS; ++t) steals_before += atomic_load(&g_jobs.stats[t].steals);
+	for (int run = 0; run < 50; ++run) {
+		memset((void*)g_steal_runs, 0, sizeof(g_steal_runs));
+		struct job_counter counter = {0};
+		job_run(jobs, STEAL_JOBS, &counter);
+		job_wait(&counter);
+		uint32_t wrong = 0;
+		for (uint32_t i = 0; i < STEAL_JOBS; ++i) wrong += atomic_load(&g_steal_runs[i]) != 1;
+		if (!CHECK(wrong == 0, "steal run %d: %u jobs not run exactly once", run, wrong)) break;
+	}
+	uint64_t steals = 0;
+	for (uint32_t t = 0; t < JOB_MAX_THREADS; ++t) steals += atomic_load(&g_jobs.stats[t].steals);
+	CHECK(steals > steals_before, "no job was ever stolen");
+	printf("steal contention: %llu steals over 50 runs of %u jobs\n", (unsigned long long)(steals - steals_before), STEAL_JOBS);
+}
+
+// benchmark: a few flops per element, enough that the split is not all overhead
+
+#define BENCH_COUNT (4u << 20)
+
+static float* g_bench_values;
+static _Atomic uint64_t g_bench_result;
+
+static uint64_t bench_kernel(uint32_t begin, uint32_t end)
+{
+	float sum = 0.0f;
+	for (uint32_t i = begin; i < end; ++i) sum += sqrtf(g_bench_values[i] * 3.0f + 1.0f);
+	return (uint64_t)sum;
+}
+
+static void bench_range(void* data, uint32_t begin, uint32_t end)
+{
+	(void)data;
+	atomic_fetch_add_explicit(&g_bench_result, bench_kernel(begin, end), memory_order_relaxed);
+}
+
+static void bench_serial(void* data)
+{
+	(void)data;
+	atomic_store(&g_bench_result, bench_kernel(0, BENCH_COUNT));
+}
+
+static void bench_parallel(void* data)
+{
+	(void)data;
+	atomic_store(&g_bench_result, 0);
+	job_parallel_for(BENCH_COUNT, 0, bench_range, NULL);
+}
+
+int main(void)
+{
+	if (!job_system_init(TEST_WORKERS)) {
+		fputs("cannot start the workers\n", stderr);
+		return 1;
+	}
+	test_parallel_for();
+	test_nested();
+	test_continuations();
+	test_steal_contention();
+
+	g_bench_values = test_allocate(BENCH_COUNT * sizeof(float));
+	for (uint32_t i = 0; i < BENCH_COUNT; ++i) g_bench_values[i] = test_random_float(0.0f, 1.0f);
+	double serial = test_time_ms(9, bench_serial, NULL);
+	double parallel = test_time_ms(9, bench_parallel, NULL);
+	printf("parallel_for over %u floats: serial %.3f ms, %u workers %.3f ms (%.2fx), %ld cores\n", BENCH_COUNT, serial, job_thread_count(), parallel,
+	       serial / parallel, sysconf(_SC_NPROCESSORS_ONLN));
+	free(g_bench_values);
+
+	job_system_shutdown();
+	return test_finish("job_system_test");
+}
@@ -0,0 +1,242 @@
+// lod.c: every kernel the CPU runs, AVX2, SSE and the scalar one, against a level picked here in
+// double precision, over random objects in front of and behind a perspective eye and under an
+// orthographic one, chains of 1 to LOD_MAX_LEVELS levels, odd ranges so the scalar tails are
+// covered, and through lod_select() over all objects and over an index list. Kernels may only
+// disagree with it on objects within float rounding of a level's limit. The stats must count the
+// levels the keys hold and sum the errors they project to. Then each path timed on a million objects.
+
+#include "test_util.c"
+#include "../source/vecmath.c"
+#include "../source/job_system.c"
+#include "../source/cull.c"
+#include "../source/lod.c"
+
+#define TEST_WORKERS 4
+#define OBJECT_COUNT 100003 // not a multiple of any vector width
+#define FIRST 5             // bounds before the objects selected
+
+struct reference
+{
+	uint8_t* levels;
+	uint8_t* uncertain; // within rounding of a limit, the level next to it is right too
+	double* scale;      // r * pixels_per_unit / w
+};
+
+static void reference_select(const struct cull_bounds* bounds, const struct lod_view* view, const struct lod_chain* chain, const float* limits,
+			     struct reference* reference)
+{
+	for (uint32_t i = 0; i < OBJECT_COUNT; ++i) {
+		uint32_t o = FIRST + i;
+		const float* row = &view->w_row.x;
+		double w = row[3], terms = fabs(row[3]);
+		for (int k = 0; k < 3; ++k) {
+			w += (double)row[k] * bounds->center[k][o];
+			terms += fabs((double)row[k] * bounds->center[k][o]);
+		}
+		double scale = bounds->radius[o] * (double)view->pixels_per_unit / fmax(w, LOD_MIN_W);
+		double tolerance = 1e-5 * scale * (1.0 + terms / fmax(fabs(w), LOD_MIN_W));
+		uint32_t level = 0;
+		bool uncertain = fabs(w - LOD_MIN_W) <= 1e-5 * terms;
+		for (uint32_t l = 1; l < chain->count; ++l) {
+			level += scale <= limits[l];
+			uncertain |= fabs(scale - limits[l]) <= tolerance;
+		}
+		reference->levels[i] = (uint8_t)level;
+		reference->uncertain[i] = uncertain;
+		reference->scale[i] = scale;
+	}
+}
+
+static void random_bounds(struct cull_bounds* bounds)
+{
+	cull_bounds_resize(bounds, FIRST + OBJECT_COUNT);
+	for (uint32_t i = 0; i < FIRST + OBJECT_COUNT; ++i) {
+		// mostly in front of the eye at -5 z, some behind it and some just around it
+		struct vec3 center = {test_random_float(-100, 100), test_random_float(-40, 40), test_random_float(-30, 300)};
+		if (i % 97 == 0) center.z = -5.0f + test_random_float(-1e-3f, 1e-3f);
+		float radius = test_random_float(0.05f, 8.0f);
+		cull_bounds_set(bounds, i, center, radius, vec3_make(radius, radius, radius));
+	}
+}
+
+static struct lod_chain random_chain(uint32_t count)
+{
+	struct lod_chain chain = {.key = 1000 + test_random() % 1000, .count = count, .triangles = {100000}};
+	for (uint32_t l = 1; l < count; ++l) {
+		chain.errors[l] = chain.errors[l - 1] + test_random_float(0.001f, 0.05f);
+		chain.triangles[l] = chain.triangles[l - 1] / 2;
+	}
+	return chain;
+}
+
+static struct lod_view random_view(bool orthographic)
+{
+	struct mat4 projection = orthographic ? mat4_ortho(-100.0f, 100.0f, -60.0f, 60.0f, 0.1f, 400.0f) : mat4_perspective(test_random_float(0.5f, 1.4f), 16.0f / 9.0f, 0.1f, 400.0f);
+	struct vec3 eye = {0.0f, 5.0f, -5.0f};
+	struct mat4 view = mat4_look_at(eye, vec3_add(eye, vec3_make(test_random_float(-0.3f, 0.3f), -0.1f, 1.0f)), vec3_make(0, 1, 0));
+	struct mat4 view_projection = mat4_mul(&projection, &view);
+	return lod_view_from_matrix(&view_projection, 1080.0f, test_random_float(0.5f, 4.0f));
+}
+
+// Within float rounding, summed in whatever order.
+static bool close_to(double value, double expected)
+{
+	return fabs(value - expected) <= 1e-4 * fmax(fabs(expected), 1e-3);
+}
+
+// Keys of objects [begin, end) against the reference, the stats against what the keys hold.
+static uint32_t count_wrong(const struct reference* reference, const struct lod_chain* chain, const uint32_t* keys, uint32_t begin, uint32_t end,
+			    const struct lod_stats* stats)
+{
+	uint32_t wrong = 0, levels[LOD_MAX_LEVELS] = {0};
+	double max_pixels = 0.0, sum_pixels = 0.0;
+	for (uint32_t i = begin; i < end; ++i) {
+		uint32_t level = keys[i] - chain->key;
+		if (level >= chain->count) return wrong + end - i;
+		int difference = (int)level - (int)reference->levels[i];
+		wrong += difference != 0 && !(reference->uncertain[i] && abs(difference) == 1);
+		levels[level]++;
+		double pixels = chain->errors[level] * reference->scale[i];
+		max_pixels = fmax(max_pixels, pixels);
+		sum_pixels += pixels;
+	}
+	for (uint32_t l = 0; l < LOD_MAX_LEVELS; ++l) wrong += stats->levels[l] != levels[l];
+	wrong += !close_to(stats->max_pixels, max_pixels) || !close_to(stats->sum_pixels, sum_pixels);
+	return wrong;
+}
+
+static void test_random_objects(void)
+{
+	struct cull_bounds bounds = {0};
+	random_bounds(&bounds);
+	struct reference reference = {
+		.levels = test_allocate(OBJECT_COUNT),
+		.uncertain = test_allocate(OBJECT_COUNT),
+		.scale = test_allocate(OBJECT_COUNT * sizeof(double)),
+	};
+	uint32_t* keys = test_allocate(OBJECT_COUNT * sizeof(uint32_t));
+	uint32_t* objects = test_allocate(OBJECT_COUNT * sizeof(uint32_t));
+
+	for (int round = 0; round < 2 * LOD_MAX_LEVELS; ++round) {
+		bool orthographic = round % 4 == 3;
+		struct lod_chain chain = random_chain(1 + (uint32_t)round % LOD_MAX_LEVELS);
+		struct lod_view view = random_view(orthographic);
+		float limits[LOD_MAX_LEVELS];
+		for (uint32_t l = 0; l < chain.count; ++l) limits[l] = chain.errors[l] > 0.0f ? view.max_pixels / chain.errors[l] : INFINITY;
+		reference_select(&bounds, &view, &chain, limits, &reference);
+		uint32_t uncertain = 0, levels[LOD_MAX_LEVELS] = {0};
+		for (uint32_t i = 0; i < OBJECT_COUNT; ++i) uncertain += reference.uncertain[i], levels[reference.levels[i]]++;
+
+		for (int path = VECMATH_PATH_SCALAR; path <= VECMATH_PATH_AVX2; ++path) {
+			lod_init((enum vecmath_path)path);
+			if (g_lod.path != (enum vecmath_path)path) continue;
+			const char* name = vecmath_path_name(g_lod.path);
+
+			// the kernel itself over ranges that start and end anywhere
+			struct lod_job job = {.bounds = &bounds, .first = FIRST, .view = &view, .chain = &chain, .keys = keys};
+			memcpy(job.limits, limits, sizeof(limits));
+			uint32_t wrong = 0;
+			for (int range = 0; range < 100; ++range) {
+				uint32_t begin = test_random() % OBJECT_COUNT;
+				uint32_t end = begin + test_random() % (OBJECT_COUNT - begin + 1);
+				if (range < 20) end = begin + (uint32_t)range < OBJECT_COUNT ? begin + (uint32_t)range : OBJECT_COUNT;
+				struct lod_stats stats = {0};
+				g_lod.range(&job, begin, end, &stats);
+				wrong += count_wrong(&reference, &chain, keys, begin, end, &stats);
+			}
+			CHECK(wrong == 0, "round %d, %s kernel, %u levels: %u objects off the reference", round, name, chain.count, wrong);
+
+			// every object, its keys in place
+			struct lod_stats stats;
+			lod_select(&bounds, FIRST, NULL, OBJECT_COUNT, &view, &chain, keys, &stats);
+			wrong = count_wrong(&reference, &chain, keys, 0, OBJECT_COUNT, &stats);
+			wrong += stats.objects != OBJECT_COUNT || stats.full_triangles != (uint64_t)OBJECT_COUNT * chain.triangles[0];
+			uint64_t triangles = 0;
+			for (uint32_t l = 0; l < chain.count; ++l) triangles += (uint64_t)stats.levels[l] * chain.triangles[l];
+			wrong += stats.triangles != triangles;
+			CHECK(wrong == 0, "round %d, %s lod_select, %u levels: %u objects off the reference", round, name, chain.count, wrong);
+
+			// every other object through an index list, in a shuffled order, keys at the indices
+			uint32_t count = 0;
+			for (uint32_t i = 0; i < OBJECT_COUNT; i += 1 + test_random() % 2) objects[count++] = i;
+			for (uint32_t i = count - 1; i > 0; --i) {
+				uint32_t k = test_random() % (i + 1), swap = objects[i];
+				objects[i] = objects[k];
+				objects[k] = swap;
+			}
+			for (uint32_t i = 0; i < OBJECT_COUNT; ++i) keys[i] = chain.key;
+			lod_select(&bounds, FIRST, objects, count, &view, &chain, keys, &stats);
+			wrong = 0;
+			uint32_t listed_levels[LOD_MAX_LEVELS] = {0};
+			for (uint32_t i = 0; i < count; ++i) {
+				uint32_t object = objects[i];
+				int difference = (int)(keys[object] - chain.key) - (int)reference.levels[object];
+				wrong += difference != 0 && !(reference.uncertain[object] && abs(difference) == 1);
+				if (keys[object] - chain.key < chain.count) listed_levels[keys[object] - chain.key]++;
+			}
+			for (uint32_t l = 0; l < LOD_MAX_LEVELS; ++l) wrong += stats.levels[l] != listed_levels[l];
+			wrong += stats.objects != count;
+			CHECK(wrong == 0, "round %d, %s lod_select of %u listed objects: %u off the reference", round, name, count, wrong);
+		}
+		if (round < 4) {
+			printf("%s, %u levels:", orthographic ? "orthographic" : "perspective", chain.count);
+			for (uint32_t l = 0; l < chain.count; ++l) printf(" %u", levels[l]);
+			printf(" objects per level, %u within rounding of a limit\n", uncertain);
+		}
+	}
+	free(reference.levels);
+	free(reference.uncertain);
+	free(reference.scale);
+	free(keys);
+	free(objects);
+	cull_bounds_free(&bounds);
+}
+
+// benchmark
+
+#define BENCH_COUNT (1u << 20)
+
+static struct
+{
+	struct cull_bounds bounds;
+	struct lod_view view;
+	struct lod_chain chain;
+	uint32_t* keys;
+	struct lod_stats stats;
+} g_bench;
+
+static void bench_select(void* data)
+{
+	(void)data;
+	lod_select(&g_bench.bounds, 0, NULL, BENCH_COUNT, &g_bench.view, &g_bench.chain, g_bench.keys, &g_bench.stats);
+}
+
+int main(void)
+{
+	if (!job_system_init(TEST_WORKERS)) {
+		fputs("cannot start the workers\n", stderr);
+		return 1;
+	}
+	test_random_objects();
+
+	// a field of objects running away from the eye, every level picked somewhere
+	cull_bounds_resize(&g_bench.bounds, BENCH_COUNT);
+	for (uint32_t i = 0; i < BENCH_COUNT; ++i) {
+		struct vec3 center = {(float)(i % 1024) * 0.5f - 256.0f, 0.0f, (float)(i / 1024) * 0.5f};
+		cull_bounds_set(&g_bench.bounds, i, center, 0.35f, vec3_make(0.2f, 0.2f, 0.2f));
+	}
+	g_bench.chain = random_chain(LOD_MAX_LEVELS);
+	g_bench.view = random_view(false);
+	g_bench.keys = test_allocate(BENCH_COUNT * sizeof(uint32_t));
+	for (int path = VECMATH_PATH_SCALAR; path <= VECMATH_PATH_AVX2; ++path) {
+		lod_init((enum vecmath_path)path);
+		if (g_lod.path != (enum vecmath_path)path) continue;
+		double select = test_time_ms(15, bench_select, NULL);
+		printf("%-6s %u objects: lod_select %.3f ms on %u threads, %.1f%% of the full triangles\n", vecmath_path_name(g_lod.path), BENCH_COUNT, select,
+		       job_thread_count(), 100.0 * (double)g_bench.stats.triangles / (double)g_bench.stats.full_triangles);
+	}
+	free(g_bench.keys);
+	cull_bounds_free(&g_bench.bounds);
+	job_system_shutdown();
+	return test_finish("lod_test");
+}
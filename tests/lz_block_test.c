@@ -0,0 +1,181 @@
+// lz_block.c: blocks of every kind of data, text like, random, runs, short repeating patterns that
+// make matches overlap their own output, at sizes around LZ_END_LITERALS and the length
+// continuations, must come back exactly, no larger than lz_compress_bound(), and not at all when the
+// capacity is too small. Damaged blocks, truncated, with bytes flipped or decoded to the wrong size,
+// must fail or at worst decode to other bytes, never write outside the output. Then compression and
+// decompression timed on an archive sized block.
+
+#include "test_util.c"
+#include "../source/lz_block.c"
+
+#define MAX_SIZE (256u * 1024u)
+#define GUARD 64 // bytes around the output that must stay untouched
+
+enum data_kind
+{
+	DATA_TEXT,    // words from a small vocabulary, what shaders and meshes look like to the codec
+	DATA_RANDOM,  // does not compress
+	DATA_RUNS,    // long runs of one byte
+	DATA_PATTERN, // a pattern of 1 to 9 bytes repeated, matches overlapping their own output
+	DATA_MIXED,   // random stretches between text
+	DATA_KIND_COUNT,
+};
+
+static const char* data_kind_names[DATA_KIND_COUNT] = {"text", "random", "runs", "pattern", "mixed"};
+
+static void fill(uint8_t* data, size_t size, enum data_kind kind)
+{
+	static const char* words[] = {"float4 ", "position", " = mul(", "transform, ", "input.", "normal", ");\n", "return ", "struct ", "vertex"};
+	uint32_t period = 1 + test_random() % 9;
+	uint8_t pattern[9];
+	for (uint32_t i = 0; i < 9; ++i) pattern[i] = (uint8_t)test_random();
+	for (size_t i = 0; i < size;) {
+		bool random = kind == DATA_RANDOM || (kind == DATA_MIXED && test_random() % 4 == 0);
+		if (random) {
+			size_t run = kind == DATA_RANDOM ? size : 1 + test_random() % 300;
+			for (size_t k = 0; k < run && i < size; ++k) data[i++] = (uint8_t)test_random();
+		} else if (kind == DATA_RUNS) {
+			uint8_t byte = (uint8_t)test_random();
+			size_t run = 1 + test_random() % 2000;
+			for (size_t k = 0; k < run && i < size; ++k) data[i++] = byte;
+		} else if (kind == DATA_PATTERN) {
+			data[i] = pattern[i % period];
+			i++;
+		} else {
+			const char* word = words[test_random() % (sizeof(words) / sizeof(words[0]))];
+			for (size_t k = 0; word[k] && i < size; ++k) data[i++] = (uint8_t)word[k];
+		}
+	}
+}
+
+static uint8_t g_source[MAX_SIZE];
+static uint8_t g_compressed[MAX_SIZE + MAX_SIZE / 255 + 16];
+static uint8_t g_output[GUARD + MAX_SIZE + GUARD];
+
+static bool guards_intact(size_t size)
+{
+	for (size_t i = 0; i < GUARD; ++i)
+		if (g_output[i] != 0xcd || g_output[GUARD + size + i] != 0xcd) return false;
+	return true;
+}
+
+// Decodes into the output between its guards.
+static bool decode(const uint8_t* block, size_t block_size, size_t size)
+{
+	memset(g_output, 0xcd, sizeof(g_output));
+	return lz_decompress(block, block_size, g_output + GUARD, size);
+}
+
+static void test_round_trip(void)
+{
+	size_t sizes[] = {0, 1, 3, 4, 7, 8, 9, 12, 13, 15, 16, 17, 31, 100, 269, 270, 271, 1000, 4096, 65535, 65536, 65537, 100000, MAX_SIZE};
+	uint32_t wrong = 0, too_large = 0, overrun = 0, rounds = 0;
+	double saved[DATA_KIND_COUNT] = {0};
+	for (int kind = 0; kind < DATA_KIND_COUNT; ++kind) {
+		for (size_t s = 0; s < sizeof(sizes) / sizeof(sizes[0]); ++s) {
+			size_t size = sizes[s];
+			fill(g_source, size, (enum data_kind)kind);
+			size_t compressed = lz_compress(g_source, size, g_compressed, sizeof(g_compressed));
+			rounds++;
+			too_large += compressed == 0 || compressed > lz_compress_bound(size);
+			wrong += !decode(g_compressed, compressed, size) || memcmp(g_output + GUARD, g_source, size) != 0 || !guards_intact(size);
+			if (size == MAX_SIZE) saved[kind] = 100.0 * (1.0 - (double)compressed / (double)size);
+
+			// less room than it needs: nothing, and nothing written past the capacity
+			if (compressed > 1) {
+				size_t capacity = test_random() % 2 ? compressed - 1 : compressed / 2;
+				memset(g_compressed + capacity, 0xcd, GUARD);
+				size_t result = lz_compress(g_source, size, g_compressed, capacity);
+				overrun += result != 0;
+				for (size_t i = 0; i < GUARD; ++i) overrun += g_compressed[capacity + i] != 0xcd;
+			}
+		}
+	}
+	CHECK(wrong == 0, "%u of %u blocks did not come back", wrong, rounds);
+	CHECK(too_large == 0, "%u blocks empty or past lz_compress_bound()", too_large);
+	CHECK(overrun == 0, "%u blocks written past their capacity", overrun);
+	printf("saved of %u bytes:", MAX_SIZE);
+	for (int kind = 0; kind < DATA_KIND_COUNT; ++kind) printf(" %s %.1f%%", data_kind_names[kind], saved[kind]);
+	printf("\n");
+}
+
+static void test_damaged(void)
+{
+	enum { SIZE = 20000 };
+	uint32_t truncated_passed = 0, resized_passed = 0, flips = 0, flips_passed = 0, outside = 0;
+	for (int kind = 0; kind < DATA_KIND_COUNT; ++kind) {
+		if (kind == DATA_RANDOM) continue; // stored as literals, any flip decodes
+		fill(g_source, SIZE, (enum data_kind)kind);
+		size_t compressed = lz_compress(g_source, SIZE, g_compressed, sizeof(g_compressed));
+
+		// every prefix is a damaged block
+		for (size_t length = 0; length < compressed; ++length) {
+			truncated_passed += decode(g_compressed, length, SIZE);
+			outside += !guards_intact(SIZE);
+		}
+		// the right block decoded to another size
+		resized_passed += decode(g_compressed, compressed, SIZE - 1) + decode(g_compressed, compressed, SIZE + 1);
+		outside += !guards_intact(SIZE + 1);
+
+		// random bytes changed: a wrong length or distance fails, a changed literal decodes to other bytes
+		static uint8_t damaged[SIZE + SIZE / 255 + 16];
+		for (int round = 0; round < 2000; ++round) {
+			memcpy(damaged, g_compressed, compressed);
+			for (int k = 0; k <= round % 3; ++k) damaged[test_random() % compressed] ^= (uint8_t)(1 + test_random() % 255);
+			bool passed = decode(damaged, compressed, SIZE);
+			flips++;
+			flips_passed += passed && memcmp(g_output + GUARD, g_source, SIZE) != 0;
+			outside += !guards_intact(SIZE);
+		}
+	}
+	CHECK(truncated_passed == 0, "%u truncated blocks decoded", truncated_passed);
+	CHECK(resized_passed == 0, "%u blocks decoded to another size", resized_passed);
+	CHECK(outside == 0, "%u damaged blocks wrote outside the output", outside);
+	printf("damaged blocks: %u of %u with bytes flipped decoded to other bytes, the rest failed\n", flips_passed, flips);
+
+	// distances reaching before the output and past the input's end
+	static const uint8_t before_start[] = {0x10, 'a', 0x02, 0x00, 0x80, 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i'};
+	static const uint8_t zero_distance[] = {0x10, 'a', 0x00, 0x00, 0x80, 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i'};
+	static const uint8_t endless_length[] = {0xf0, 255, 255, 255};
+	CHECK(!decode(before_start, sizeof(before_start), 13) && guards_intact(13), "a match before the output's start decoded");
+	CHECK(!decode(zero_distance, sizeof(zero_distance), 13) && guards_intact(13), "a match at distance 0 decoded");
+	CHECK(!decode(endless_length, sizeof(endless_length), 1000) && guards_intact(1000), "a length running past the input decoded");
+	static const uint8_t valid[] = {0x11, 'a', 0x01, 0x00, 0x80, 'b', 'c', 'd', 'e', 'f', 'g', 'h', 'i'}; // "a", then 5 more, then 8 literals
+	CHECK(decode(valid, sizeof(valid), 14) && memcmp(g_output + GUARD, "aaaaaabcdefghi", 14) == 0, "a hand made block did not decode");
+}
+
+// benchmark
+
+static struct
+{
+	size_t size;
+	size_t compressed;
+} g_bench;
+
+static void bench_compress(void* data)
+{
+	(void)data;
+	g_bench.compressed = lz_compress(g_source, g_bench.size, g_compressed, sizeof(g_compressed));
+}
+
+static void bench_decompress(void* data)
+{
+	(void)data;
+	if (!lz_decompress(g_compressed, g_bench.compressed, g_output, g_bench.size)) exit(1);
+}
+
+int main(void)
+{
+	test_round_trip();
+	test_damaged();
+
+	g_bench.size = 128u * 1024u; // the packer's default block
+	for (int kind = 0; kind < DATA_KIND_COUNT; ++kind) {
+		fill(g_source, g_bench.size, (enum data_kind)kind);
+		double compress = test_time_ms(21, bench_compress, NULL);
+		double decompress = test_time_ms(21, bench_decompress, NULL);
+		printf("%-8s %zu bytes to %zu: compress %.0f MB/s, decompress %.0f MB/s\n", data_kind_names[kind], g_bench.size, g_bench.compressed,
+		       (double)g_bench.size / compress / 1e3, (double)g_bench.size / decompress / 1e3);
+	}
+	return test_finish("lz_block_test");
+}
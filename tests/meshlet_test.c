@@ -0,0 +1,360 @@
+// meshlet.c over meshes cooked by tools/mesh_cooker.c, a torus and a sphere with every level of
+// detail: meshlet_cull() under random model transforms, orthographic and perspective, against a
+// per triangle reference, a triangle is kept unless it is wholly outside one clip plane or faces
+// away from the eye. No triangle the reference keeps may be culled; triangles within rounding of
+// a plane or edge on are left out of the comparison. The ranges must be ascending, merged and add
+// up to the drawn triangles. Then mesh_draw_list_cull_clusters() against meshlet_cull() per
+// instance, and meshlet_cull() timed.
+
+#include "test_util.c"
+
+// the cooker, its main and its own struct mesh renamed out of the way
+#define main mesh_cooker_main
+#define mesh cooked_mesh
+#include "../tools/mesh_cooker.c"
+#undef main
+#undef mesh
+
+#include "../source/job_system.c"
+#include "../source/cull.c"
+#include "../source/arena.c"
+
+// the mesh_renderer.c stand-ins, only what meshlet.c touches
+#define MESH_KEY(pso, mesh) ((uint32_t)(pso) << 16 | (uint32_t)(mesh))
+#define MESH_KEY_MESH(key) ((key) & 0xffffu)
+
+struct mesh_instance
+{
+	struct mat4 transform;
+	struct vec4 color;
+};
+
+struct mesh
+{
+	struct mesh_blob_meshlet* meshlets;
+	uint32_t meshlet_count;
+};
+
+struct mesh_range
+{
+	uint32_t instance;
+	uint32_t first_index;
+	uint32_t index_count;
+};
+
+struct mesh_batch
+{
+	uint32_t key;
+	uint32_t first_instance;
+	uint32_t instance_count;
+	uint32_t first_range;
+	uint32_t range_count;
+	bool clustered;
+};
+
+struct mesh_draw_list
+{
+	struct mesh_instance* instances;
+	uint32_t instance_count;
+	struct mesh_batch* batches;
+	uint32_t batch_count;
+	struct mesh_range* ranges;
+	uint32_t range_count;
+};
+
+static struct
+{
+	struct mesh meshes[8];
+} g_mesh_renderer;
+
+#include "../source/meshlet.c"
+
+#define TRANSFORMS 300
+
+struct cooked
+{
+	const char* name;
+	uint8_t* file;
+	const struct mesh_blob_header* header;
+	struct mesh_blob_meshlet* meshlets;
+	const uint16_t* indices;
+	struct vec3* positions; // decoded, what the cooker measured the spheres and cones on
+	struct vec3 center;
+	float size;
+};
+
+typedef struct vec3 (*surface_function)(float u, float v);
+
+static struct vec3 torus_point(float u, float v)
+{
+	return vec3_make((1.0f + 0.3f * cosf(v)) * cosf(u), (1.0f + 0.3f * cosf(v)) * sinf(u), 0.3f * sinf(v));
+}
+
+static struct vec3 sphere_point(float u, float v)
+{
+	float theta = v * 0.5f; // pole to pole
+	return vec3_make(sinf(theta) * cosf(u), sinf(theta) * sinf(u), cosf(theta));
+}
+
+// A closed grid of quads over the surface, written as OBJ and cooked with the cooker's defaults.
+static void cook(struct cooked* cooked, const char* name, surface_function surface, uint32_t columns, uint32_t rows)
+{
+	char obj_path[256], blob_path[256];
+	snprintf(obj_path, sizeof(obj_path), "/tmp/meshlet_test_%s.obj", name);
+	snprintf(blob_path, sizeof(blob_path), "/tmp/meshlet_test_%s.mesh", name);
+	FILE* file = fopen(obj_path, "w");
+	if (!file) {
+		fprintf(stderr, "cannot write %s\n", obj_path);
+		exit(1);
+	}
+	const float tau = 6.28318530718f;
+	for (uint32_t i = 0; i < columns; ++i)
+		for (uint32_t j = 0; j <= rows; ++j) {
+			struct vec3 p = surface(tau * (float)i / (float)columns, tau * (float)j / (float)rows);
+			fprintf(file, "v %.7f %.7f %.7f\n", p.x, p.y, p.z);
+		}
+	for (uint32_t i = 0; i < columns; ++i)
+		for (uint32_t j = 0; j < rows; ++j) {
+			uint32_t a = i * (rows + 1) + j + 1, b = (i + 1) % columns * (rows + 1) + j + 1;
+			fprintf(file, "f %u %u %u %u\n", a, b, b + 1, a + 1);
+		}
+	fclose(file);
+
+	char* argv[] = {"mesh_cooker", obj_path, blob_path, NULL};
+	if (mesh_cooker_main(3, argv) != 0) exit(1);
+	file = fopen(blob_path, "rb");
+	if (!file) exit(1);
+	fseek(file, 0, SEEK_END);
+	long size = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	cooked->file = test_allocate((size_t)size);
+	if (fread(cooked->file, 1, (size_t)size, file) != (size_t)size) exit(1);
+	fclose(file);
+	remove(obj_path);
+	remove(blob_path);
+
+	cooked->name = name;
+	cooked->header = mesh_blob_validate(cooked->file, (uint64_t)size);
+	if (!cooked->header) {
+		fprintf(stderr, "%s: the cooked file does not validate\n", name);
+		exit(1);
+	}
+	const struct mesh_blob_header* header = cooked->header;
+	cooked->meshlets = (struct mesh_blob_meshlet*)(cooked->file + header->meshlet_offset);
+	cooked->indices = (const uint16_t*)(cooked->file + header->index_offset);
+	cooked->positions = test_allocate(header->vertex_count * sizeof(struct vec3));
+	for (uint32_t v = 0; v < header->vertex_count; ++v) cooked->positions[v] = vertex_decode(cooked->file + header->vertex_offset, v).position;
+	cooked->center = vec3_scale(vec3_add(vec3_make(header->bounds_min[0], header->bounds_min[1], header->bounds_min[2]),
+					     vec3_make(header->bounds_max[0], header->bounds_max[1], header->bounds_max[2])),
+				    0.5f);
+	cooked->size = 0.0f;
+	for (int k = 0; k < 3; ++k) cooked->size = fmaxf(cooked->size, header->bounds_max[k] - header->bounds_min[k]);
+}
+
+static struct quat random_rotation(void)
+{
+	struct quat q = {test_random_float(-1, 1), test_random_float(-1, 1), test_random_float(-1, 1), test_random_float(-1, 1)};
+	return quat_normalize(q);
+}
+
+// Model to clip of a random view of the mesh, about its size, scaled unevenly and partly off
+// screen; the model to world part in *model. The eye is at the world origin looking along +z.
+static struct mat4 random_transform(const struct cooked* cooked, bool orthographic, struct mat4* model)
+{
+	float s = test_random_float(0.2f, 1.2f) / cooked->size;
+	struct vec3 position = orthographic ? vec3_make(test_random_float(-1.5f, 1.5f), test_random_float(-1.2f, 1.2f), 0.5f)
+					    : vec3_make(test_random_float(-1.0f, 1.0f), test_random_float(-1.0f, 1.0f), test_random_float(0.3f, 2.3f));
+	struct mat4 trs = mat4_trs(position, random_rotation(), vec3_make(s, s * test_random_float(0.5f, 1.5f), s));
+	struct mat4 centered = mat4_translation(vec3_scale(cooked->center, -1.0f));
+	*model = mat4_mul(&trs, &centered);
+	struct mat4 projection = orthographic ? mat4_ortho(-1.7f, 1.7f, -1.0f, 1.0f, 0.0f, 1.0f) : mat4_perspective(1.0f, 1.7f, 0.1f, 10.0f);
+	return mat4_mul(&projection, model);
+}
+
+enum reference_result
+{
+	REFERENCE_KEPT,
+	REFERENCE_CULLED,
+	REFERENCE_UNSURE, // within rounding of a plane, or edge on
+};
+
+static enum reference_result reference_triangle(const struct cooked* cooked, uint32_t triangle, const struct mat4* model_to_clip, const struct mat4* model,
+					       bool orthographic)
+{
+	struct vec3 p[3];
+	struct vec4 c[3];
+	for (int k = 0; k < 3; ++k) {
+		p[k] = mat4_transform_point(model, cooked->positions[cooked->indices[triangle * 3 + k]]);
+		c[k] = mat4_transform(model_to_clip, vec4_from_vec3(cooked->positions[cooked->indices[triangle * 3 + k]], 1.0f));
+	}
+	// clip space: -w <= x, y <= w, 0 <= z <= w; unsure when rounding could put all three outside
+	bool unsure = false;
+	for (int plane = 0; plane < 6; ++plane) {
+		int outside = 0, near = 0;
+		for (int k = 0; k < 3; ++k) {
+			float value, magnitude;
+			switch (plane) {
+				case 0: value = c[k].w + c[k].x, magnitude = fabsf(c[k].w) + fabsf(c[k].x); break;
+				case 1: value = c[k].w - c[k].x, magnitude = fabsf(c[k].w) + fabsf(c[k].x); break;
+				case 2: value = c[k].w + c[k].y, magnitude = fabsf(c[k].w) + fabsf(c[k].y); break;
+				case 3: value = c[k].w - c[k].y, magnitude = fabsf(c[k].w) + fabsf(c[k].y); break;
+				case 4: value = c[k].z, magnitude = fabsf(c[k].z) + fabsf(c[k].w); break;
+				default: value = c[k].w - c[k].z, magnitude = fabsf(c[k].z) + fabsf(c[k].w); break;
+			}
+			outside += value < 0.0f;
+			near += value >= 0.0f && value <= 1e-4f * magnitude;
+		}
+		if (outside == 3) return REFERENCE_CULLED;
+		unsure |= outside + near == 3;
+	}
+	// in world space, the cooker's winding: front facing normals point at the eye
+	struct vec3 normal = vec3_cross(vec3_sub(p[1], p[0]), vec3_sub(p[2], p[0]));
+	struct vec3 view = orthographic ? vec3_make(0.0f, 0.0f, 1.0f) : p[0];
+	float facing = vec3_dot(normal, view);
+	if (fabsf(facing) <= 1e-4f * vec3_length(normal) * vec3_length(view)) return REFERENCE_UNSURE;
+	if (facing >= 0.0f) return REFERENCE_CULLED;
+	return unsure ? REFERENCE_UNSURE : REFERENCE_KEPT;
+}
+
+static void test_cull(const struct cooked* cooked)
+{
+	const struct mesh_blob_header* header = cooked->header;
+	uint8_t* drawn = test_allocate(header->index_count / 3);
+	struct mesh_range* ranges = test_allocate((header->meshlet_count + 1) / 2 * sizeof(struct mesh_range));
+	for (int orthographic = 0; orthographic < 2; ++orthographic) {
+		const char* projection = orthographic ? "orthographic" : "perspective";
+		uint32_t bad_ranges = 0, lost = 0;
+		uint64_t culled = 0, culled_drawn = 0;
+		struct meshlet_stats stats = {0};
+		for (uint32_t level = 0; level < header->lod_count; ++level) {
+			const struct mesh_blob_lod* lod = &header->lods[level];
+			uint32_t first_triangle = lod->first_index / 3, triangle_count = lod->index_count / 3;
+			for (uint32_t round = 0; round < TRANSFORMS; ++round) {
+				struct mat4 model;
+				struct mat4 model_to_clip = random_transform(cooked, orthographic, &model);
+				uint64_t drawn_before = stats.drawn_triangles;
+				uint32_t range_count = meshlet_cull(cooked->meshlets + lod->first_meshlet, lod->meshlet_count, &model_to_clip, 7, ranges, &stats);
+
+				// ascending, apart and inside the level, as many triangles as the stats say were drawn
+				memset(drawn + first_triangle, 0, triangle_count);
+				uint64_t sum = 0;
+				bad_ranges += range_count > (lod->meshlet_count + 1) / 2;
+				for (uint32_t r = 0; r < range_count; ++r) {
+					const struct mesh_range* range = &ranges[r];
+					bad_ranges += range->instance != 7 || range->first_index % 3 || range->index_count % 3 || range->index_count == 0;
+					bad_ranges += range->first_index < lod->first_index || range->first_index + range->index_count > lod->first_index + lod->index_count;
+					bad_ranges += r > 0 && range->first_index <= ranges[r - 1].first_index + ranges[r - 1].index_count;
+					if (range->first_index < lod->first_index || range->first_index + range->index_count > lod->first_index + lod->index_count) continue;
+					memset(drawn + range->first_index / 3, 1, range->index_count / 3);
+					sum += range->index_count / 3;
+				}
+				bad_ranges += sum != stats.drawn_triangles - drawn_before;
+
+				for (uint32_t t = first_triangle; t < first_triangle + triangle_count; ++t) {
+					enum reference_result result = reference_triangle(cooked, t, &model_to_clip, &model, orthographic);
+					lost += result == REFERENCE_KEPT && !drawn[t];
+					culled += result == REFERENCE_CULLED;
+					culled_drawn += result == REFERENCE_CULLED && drawn[t];
+				}
+			}
+		}
+		CHECK(bad_ranges == 0, "%s %s: %u ranges malformed", cooked->name, projection, bad_ranges);
+		CHECK(lost == 0, "%s %s: %u triangles the reference keeps were culled", cooked->name, projection, lost);
+		CHECK(stats.frustum_culled + stats.cone_culled > 0, "%s %s: nothing culled at all", cooked->name, projection);
+		printf("%s %s, %u levels: %u meshlets, %.1f%% off the frustum, %.1f%% by their cones; %.1f%% of the triangles the reference culls are culled, "
+		       "%.2f ranges per instance\n",
+		       cooked->name, projection, header->lod_count, stats.meshlets, 100.0 * stats.frustum_culled / stats.meshlets, 100.0 * stats.cone_culled / stats.meshlets,
+		       culled ? 100.0 * (double)(culled - culled_drawn) / (double)culled : 0.0, (double)stats.ranges / stats.instances);
+	}
+	free(drawn);
+	free(ranges);
+}
+
+// The list's clustered batches have exactly the ranges meshlet_cull() gives each instance.
+static void test_draw_list(const struct cooked* cooked)
+{
+	enum { INSTANCES = 4 + MESHLET_MAX_INSTANCES + 1 + 3 };
+	const struct mesh_blob_lod* lod = &cooked->header->lods[0];
+	g_mesh_renderer.meshes[2] = (struct mesh){cooked->meshlets + lod->first_meshlet, lod->meshlet_count};
+	g_mesh_renderer.meshes[3] = (struct mesh){cooked->meshlets + lod->first_meshlet, lod->meshlet_count};
+	g_mesh_renderer.meshes[4] = (struct mesh){NULL, 0}; // not cooked, no meshlets
+	struct mesh_instance instances[INSTANCES];
+	for (uint32_t i = 0; i < INSTANCES; ++i) {
+		struct mat4 model;
+		instances[i] = (struct mesh_instance){.transform = random_transform(cooked, false, &model)};
+	}
+	// one within the limit, one past it, one without meshlets
+	struct mesh_batch batches[3] = {
+		{.key = MESH_KEY(1, 2), .first_instance = 0, .instance_count = 4},
+		{.key = MESH_KEY(1, 3), .first_instance = 4, .instance_count = MESHLET_MAX_INSTANCES + 1},
+		{.key = MESH_KEY(2, 4), .first_instance = 4 + MESHLET_MAX_INSTANCES + 1, .instance_count = 3},
+	};
+	struct mesh_draw_list list = {instances, INSTANCES, batches, 3, NULL, 0};
+	struct arena arena;
+	if (!arena_init(&arena, 1 << 20)) exit(1);
+	struct meshlet_stats stats;
+	CHECK(mesh_draw_list_cull_clusters(&list, &arena, 2, 3, &stats), "cluster culling failed");
+	CHECK(batches[0].clustered && !batches[1].clustered && !batches[2].clustered, "clustered %d %d %d, expected only the first batch", batches[0].clustered,
+	      batches[1].clustered, batches[2].clustered);
+	CHECK(stats.instances == 4, "%u instances culled, expected 4", stats.instances);
+
+	struct mesh_range expected[64];
+	struct meshlet_stats expected_stats = {0};
+	uint32_t expected_count = 0;
+	for (uint32_t instance = 0; instance < 4; ++instance)
+		expected_count += meshlet_cull(g_mesh_renderer.meshes[2].meshlets, lod->meshlet_count, &instances[instance].transform, instance, expected + expected_count,
+					       &expected_stats);
+	CHECK(batches[0].first_range == 0 && batches[0].range_count == expected_count && list.range_count == expected_count &&
+		      memcmp(list.ranges, expected, expected_count * sizeof(struct mesh_range)) == 0,
+	      "the list's ranges differ from meshlet_cull() per instance");
+	arena_free(&arena);
+}
+
+// benchmark
+
+#define BENCH_INSTANCES 4096
+
+static struct
+{
+	const struct cooked* cooked;
+	struct mat4 transforms[BENCH_INSTANCES];
+	struct mesh_range* ranges;
+	struct meshlet_stats stats;
+} g_bench;
+
+static void bench_cull(void* data)
+{
+	(void)data;
+	const struct mesh_blob_lod* lod = &g_bench.cooked->header->lods[0];
+	memset(&g_bench.stats, 0, sizeof(g_bench.stats));
+	for (uint32_t i = 0; i < BENCH_INSTANCES; ++i)
+		meshlet_cull(g_bench.cooked->meshlets + lod->first_meshlet, lod->meshlet_count, &g_bench.transforms[i], i, g_bench.ranges, &g_bench.stats);
+}
+
+int main(void)
+{
+	struct cooked cooked[2];
+	cook(&cooked[0], "torus", torus_point, 96, 48);
+	cook(&cooked[1], "sphere", sphere_point, 64, 32);
+	for (int i = 0; i < 2; ++i) test_cull(&cooked[i]);
+	test_draw_list(&cooked[0]);
+
+	for (int i = 0; i < 2; ++i) {
+		g_bench.cooked = &cooked[i];
+		g_bench.ranges = test_allocate((cooked[i].header->lods[0].meshlet_count + 1) / 2 * sizeof(struct mesh_range));
+		for (uint32_t t = 0; t < BENCH_INSTANCES; ++t) {
+			struct mat4 model;
+			g_bench.transforms[t] = random_transform(&cooked[i], false, &model);
+		}
+		double ms = test_time_ms(9, bench_cull, NULL);
+		printf("%s: %u instances of %u meshlets culled in %.3f ms, %.1f ns per meshlet, %.1f%% of the triangles drawn\n", cooked[i].name, BENCH_INSTANCES,
+		       cooked[i].header->lods[0].meshlet_count, ms, ms * 1e6 / ((double)BENCH_INSTANCES * cooked[i].header->lods[0].meshlet_count),
+		       100.0 * (double)g_bench.stats.drawn_triangles / (double)g_bench.stats.triangles);
+		free(g_bench.ranges);
+	}
+	for (int i = 0; i < 2; ++i) {
+		free(cooked[i].file);
+		free(cooked[i].positions);
+	}
+	return test_finish("meshlet_test");
+}
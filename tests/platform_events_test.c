@@ -0,0 +1,216 @@
+// platform_events.c, the window thread to frame thread ring: indices wrapping around, a full ring
+// dropping droppable events and holding others back until there is room, the resize slot keeping
+// the newest size and the quit slot closing the window however full the ring is, then a producer
+// and a consumer thread checking that nothing arrives out of order and nothing that may not be
+// dropped is.
+
+#include "test_util.c"
+#include "../source/spsc_queue.c"
+#include "../source/platform_events.c"
+
+#define MESSAGE_ORDERED 1 // never dropped, message numbers in wparam
+#define MESSAGE_MOVE 2    // droppable
+
+struct received
+{
+	uint64_t ordered;      // count
+	uint64_t next_ordered; // wparam expected next
+	uint64_t moves;
+	uint64_t last_move;
+	uint64_t resizes;
+	uint32_t width, height;
+	bool minimized;
+	bool quit;
+	uint32_t quits;
+	uint64_t ordered_at_quit; // what had arrived before it
+	uint64_t resizes_at_quit;
+	uint32_t out_of_order;
+	uint64_t last_resize_width;
+};
+
+static void receive(const struct platform_event* event, void* user)
+{
+	struct received* received = user;
+	switch (event->type) {
+		case PLATFORM_EVENT_QUIT:
+			received->quit = true;
+			received->quits++;
+			received->ordered_at_quit = received->ordered;
+			received->resizes_at_quit = received->resizes;
+			break;
+		case PLATFORM_EVENT_RESIZE:
+			if (event->width < received->last_resize_width) received->out_of_order++;
+			received->last_resize_width = event->width;
+			received->resizes++;
+			received->width = event->width;
+			received->height = event->height;
+			received->minimized = event->minimized;
+			break;
+		default:
+			if (event->message == MESSAGE_ORDERED) {
+				if (event->wparam != received->next_ordered) received->out_of_order++;
+				received->next_ordered = event->wparam + 1;
+				received->ordered++;
+			} else {
+				if (received->moves && event->wparam <= received->last_move) received->out_of_order++;
+				received->last_move = event->wparam;
+				received->moves++;
+			}
+			break;
+	}
+}
+
+static bool push_message(struct platform_events* events, uint32_t message, uint64_t number, bool droppable)
+{
+	struct platform_event event = {.timestamp_ns = time_now_ns(), .type = PLATFORM_EVENT_MESSAGE, .message = message, .wparam = number};
+	return platform_events_push(events, &event, droppable);
+}
+
+static void test_wraparound(void)
+{
+	struct platform_events events;
+	if (!CHECK(platform_events_init(&events), "init failed")) return;
+	// start just short of where the 32-bit indices wrap
+	atomic_store(&events.queue.head, 0xfffff000u);
+	atomic_store(&events.queue.tail, 0xfffff000u);
+	events.queue.head_cache = events.queue.tail_cache = 0xfffff000u;
+	struct received received = {0};
+	uint64_t number = 0;
+	for (int round = 0; round < 8; ++round) {
+		uint32_t count = 1000 + test_random() % (PLATFORM_EVENT_CAPACITY - 1000);
+		for (uint32_t i = 0; i < count; ++i) push_message(&events, MESSAGE_ORDERED, number++, false);
+		uint32_t drained = platform_events_drain(&events, receive, &received);
+		CHECK(drained == count, "round %d: drained %u of %u", round, drained, count);
+	}
+	CHECK(atomic_load(&events.queue.head) < 0xfffff000u, "the indices did not wrap");
+	CHECK(received.ordered == number && received.out_of_order == 0, "wraparound: %llu of %llu received, %u out of order", (unsigned long long)received.ordered,
+	      (unsigned long long)number, received.out_of_order);
+	platform_events_destroy(&events);
+}
+
+struct late_consumer
+{
+	struct platform_events* events;
+	struct received* received;
+	uint32_t delay_ms;
+};
+
+static void late_consumer_main(void* param)
+{
+	struct late_consumer* consumer = param;
+	thread_sleep_ms(consumer->delay_ms);
+	platform_events_drain(consumer->events, receive, consumer->received);
+}
+
+static void test_full_ring(void)
+{
+	struct platform_events events;
+	if (!CHECK(platform_events_init(&events), "init failed")) return;
+	struct received received = {0};
+	uint32_t pushed = 0;
+	for (uint32_t i = 0; i < PLATFORM_EVENT_CAPACITY; ++i) pushed += push_message(&events, MESSAGE_ORDERED, i, true);
+	CHECK(pushed == PLATFORM_EVENT_CAPACITY, "only %u of %u fit an empty ring", pushed, PLATFORM_EVENT_CAPACITY);
+
+	// full: a droppable event is dropped at once, another after waiting its bounded time
+	uint64_t begin = time_now_ns();
+	CHECK(!push_message(&events, MESSAGE_MOVE, 0, true), "a droppable push into a full ring succeeded");
+	CHECK(time_now_ns() - begin < PLATFORM_EVENT_PUSH_RETRY_MS * 1000000ull / 2, "a droppable push waited");
+	begin = time_now_ns();
+	CHECK(!push_message(&events, MESSAGE_ORDERED, PLATFORM_EVENT_CAPACITY, false), "a push into a full ring nobody drains succeeded");
+	CHECK(time_now_ns() - begin >= PLATFORM_EVENT_PUSH_RETRY_MS * 1000000ull, "the push gave up before its retry time");
+	CHECK(atomic_load(&events.dropped) == 2, "dropped %llu, expected 2", (unsigned long long)atomic_load(&events.dropped));
+
+	// quit is not in the ring either: asked for twice into the full ring, it neither waits nor is
+	// dropped, and arrives once after the queued events and the resize
+	begin = time_now_ns();
+	platform_events_push_quit(&events, time_now_ns());
+	platform_events_push_quit(&events, time_now_ns());
+	CHECK(time_now_ns() - begin < PLATFORM_EVENT_PUSH_RETRY_MS * 1000000ull / 2, "a quit into a full ring waited");
+	CHECK(platform_events_wait(&events, 0), "a quit is not pending");
+
+	// resizes are not in the ring, the newest of them arrives after the queued events
+	platform_events_push_resize(&events, time_now_ns(), 640, 480, false);
+	platform_events_push_resize(&events, time_now_ns(), 800, 600, false);
+	platform_events_push_resize(&events, time_now_ns(), 1024, 768, true);
+	platform_events_drain(&events, receive, &received);
+	CHECK(received.quits == 1 && received.ordered_at_quit == PLATFORM_EVENT_CAPACITY && received.resizes_at_quit == 1,
+	      "full ring: %u quits, after %llu events and %llu resizes", received.quits, (unsigned long long)received.ordered_at_quit,
+	      (unsigned long long)received.resizes_at_quit);
+	CHECK(received.ordered == PLATFORM_EVENT_CAPACITY && received.out_of_order == 0, "full ring: %llu events back", (unsigned long long)received.ordered);
+	CHECK(received.resizes == 1 && received.width == 1024 && received.height == 768 && received.minimized, "resize %ux%u (%llu of them), expected the last",
+	      received.width, received.height, (unsigned long long)received.resizes);
+	CHECK(events.coalesced_resizes == 2, "%u resizes coalesced, expected 2", events.coalesced_resizes);
+	platform_events_drain(&events, receive, &received);
+	CHECK(received.resizes == 1 && received.quits == 1, "a resize or the quit was delivered twice");
+	CHECK(!platform_events_wait(&events, 0), "events pending after everything was drained");
+
+	// full again, an event that may not be dropped waits until the frame thread makes room
+	uint64_t next = received.next_ordered; // the consumer thread owns received from here
+	for (uint32_t i = 0; i < PLATFORM_EVENT_CAPACITY; ++i) push_message(&events, MESSAGE_ORDERED, next + i, false);
+	struct late_consumer consumer = {&events, &received, 20};
+	thread_handle thread;
+	if (CHECK(thread_create(&thread, late_consumer_main, &consumer), "no consumer thread")) {
+		CHECK(push_message(&events, MESSAGE_ORDERED, next + PLATFORM_EVENT_CAPACITY, false), "the push was dropped although the ring was drained");
+		thread_join(thread);
+		platform_events_drain(&events, receive, &received);
+		CHECK(received.ordered == 2 * PLATFORM_EVENT_CAPACITY + 1 && received.out_of_order == 0, "after the wait: %llu events back, %u out of order",
+		      (unsigned long long)received.ordered, received.out_of_order);
+	}
+	platform_events_destroy(&events);
+}
+
+#define PRODUCER_EVENTS 1000000u
+
+static void producer_main(void* param)
+{
+	struct platform_events* events = param;
+	uint64_t ordered = 0, moves = 0;
+	for (uint32_t i = 0; i < PRODUCER_EVENTS; ++i) {
+		uint32_t kind = i % 16;
+		if (kind == 0)
+			platform_events_push_resize(events, time_now_ns(), 100 + i / 16, 200, false);
+		else if (kind < 8)
+			push_message(events, MESSAGE_MOVE, moves++, true);
+		else
+			push_message(events, MESSAGE_ORDERED, ordered++, false);
+	}
+	platform_events_push_quit(events, time_now_ns());
+}
+
+static void test_threads(void)
+{
+	struct platform_events events;
+	if (!CHECK(platform_events_init(&events), "init failed")) return;
+	struct received received = {0};
+	thread_handle thread;
+	if (!CHECK(thread_create(&thread, producer_main, &events), "no producer thread")) return;
+	uint64_t begin = time_now_ns();
+	uint32_t drains = 0;
+	while (!received.quit) {
+		platform_events_wait(&events, 5);
+		platform_events_drain(&events, receive, &received);
+		drains++;
+	}
+	double ms = (double)(time_now_ns() - begin) / 1e6;
+	thread_join(thread);
+	uint64_t expected_ordered = PRODUCER_EVENTS / 2;
+	uint64_t last_width = 100 + (PRODUCER_EVENTS - 16) / 16;
+	CHECK(received.out_of_order == 0, "two threads: %u events out of order", received.out_of_order);
+	CHECK(received.ordered_at_quit == expected_ordered, "two threads: quit arrived after %llu of %llu events", (unsigned long long)received.ordered_at_quit,
+	      (unsigned long long)expected_ordered);
+	CHECK(received.ordered == expected_ordered, "two threads: %llu of %llu events that may not be dropped arrived", (unsigned long long)received.ordered,
+	      (unsigned long long)expected_ordered);
+	CHECK(received.width == last_width && received.height == 200, "two threads: last resize %u wide, expected %llu", received.width,
+	      (unsigned long long)last_width);
+	printf("two threads: %u events in %.1f ms over %u drains, %llu moves dropped, %llu resizes delivered\n", PRODUCER_EVENTS, ms, drains,
+	       (unsigned long long)atomic_load(&events.dropped), (unsigned long long)received.resizes);
+	platform_events_destroy(&events);
+}
+
+int main(void)
+{
+	test_wraparound();
+	test_full_ring();
+	test_threads();
+	return test_finish("platform_events_test");
+}
@@ -0,0 +1,241 @@
+// pool_alloc.c on its own: size class boundaries, alignment, a freed block handed out again by its
+// class, blocks that never overlap under random alloc and free, huge blocks going back to the OS,
+// and a frame loop allocating the way ImGui does (vectors growing by doubling, transient buffers)
+// that must stop touching the OS once warm, and destroying an allocator with blocks still live,
+// which a hot reload does to one it cannot take over. Then alloc and free pairs timed against malloc.
+// ImGui itself only ships as a Windows library here, so its frame is imitated, not run.
+
+#include "test_util.c"
+#include "../source/pool_alloc.c"
+
+static void test_size_classes(struct pool_allocator* pool)
+{
+	CHECK(pool_size_class(0) == 0 && pool_size_class(16) == 0, "up to 16 bytes should be the first class");
+	CHECK(pool_size_class(17) == 1 && pool_size_class(48) == 1 && pool_size_class(49) == 2, "wrong class around 64 byte blocks");
+	CHECK(pool_size_class(((size_t)1 << POOL_MAX_SHIFT) - POOL_HEADER_SIZE) == POOL_CLASS_COUNT - 1, "the largest pooled size is not in the last class");
+
+	// every size up to a few KB lands in a block that holds it, aligned for SSE
+	uint32_t misaligned = 0, wrong_class = 0;
+	for (size_t size = 0; size < 5000; ++size) {
+		uint8_t* p = pool_alloc(pool, size);
+		struct pool_header* header = (struct pool_header*)(p - POOL_HEADER_SIZE);
+		misaligned += ((uintptr_t)p & 15) != 0;
+		size_t block = (size_t)1 << (POOL_MIN_SHIFT + header->size_class);
+		wrong_class += block - POOL_HEADER_SIZE < size || (header->size_class > 0 && block / 2 - POOL_HEADER_SIZE >= size);
+		pool_free(pool, p);
+	}
+	CHECK(misaligned == 0, "%u blocks not 16 byte aligned", misaligned);
+	CHECK(wrong_class == 0, "%u sizes in a class too small or larger than needed", wrong_class);
+
+	// the block just freed is the next one of its class
+	void* a = pool_alloc(pool, 100);
+	pool_free(pool, a);
+	void* b = pool_alloc(pool, 90);
+	CHECK(a == b, "a freed block was not reused by its class");
+	void* c = pool_alloc(pool, 1000);
+	CHECK(c != b, "another class handed out the same block");
+	pool_free(pool, b);
+	pool_free(pool, c);
+}
+
+static void test_huge(struct pool_allocator* pool)
+{
+	uint64_t reserved = pool->os_reserved, os_allocs = pool->total.os_allocs;
+	size_t size = (size_t)3 << 20;
+	uint8_t* p = pool_alloc(pool, size);
+	if (!CHECK(p != NULL, "no huge block")) return;
+	memset(p, 0x5a, size);
+	CHECK(pool->total.os_allocs == os_allocs + 1 && pool->os_reserved == reserved + size + POOL_HEADER_SIZE, "a huge block did not come from the OS");
+	pool_free(pool, p);
+	CHECK(pool->os_reserved == reserved, "a freed huge block is still reserved");
+}
+
+// Random blocks, each filled with its own byte: a block handed out twice or overlapping another
+// shows up as a byte that changed.
+#define LIVE_SLOTS 2048
+
+static void test_no_overlap(struct pool_allocator* pool)
+{
+	static uint8_t* blocks[LIVE_SLOTS];
+	static size_t sizes[LIVE_SLOTS];
+	uint32_t damaged = 0;
+	for (uint32_t step = 0; step < 200000; ++step) {
+		uint32_t slot = test_random() % LIVE_SLOTS;
+		if (blocks[slot]) {
+			for (size_t i = 0; i < sizes[slot]; ++i) damaged += blocks[slot][i] != (uint8_t)slot;
+			pool_free(pool, blocks[slot]);
+			blocks[slot] = NULL;
+		} else {
+			// mostly small, as UI allocations are, now and then up to the largest class
+			sizes[slot] = test_random() % 16 ? test_random() % 512 : test_random() % (1u << POOL_MAX_SHIFT);
+			blocks[slot] = pool_alloc(pool, sizes[slot]);
+			memset(blocks[slot], (uint8_t)slot, sizes[slot]);
+		}
+	}
+	for (uint32_t slot = 0; slot < LIVE_SLOTS; ++slot) {
+		if (!blocks[slot]) continue;
+		for (size_t i = 0; i < sizes[slot]; ++i) damaged += blocks[slot][i] != (uint8_t)slot;
+		pool_free(pool, blocks[slot]);
+	}
+	CHECK(damaged == 0, "%u bytes overwritten by another block", damaged);
+	CHECK(pool->live_bytes == 0, "%llu bytes still live after everything was freed", (unsigned long long)pool->live_bytes);
+	CHECK(pool->total.allocs == pool->total.frees, "%llu allocations, %llu frees", (unsigned long long)pool->total.allocs, (unsigned long long)pool->total.frees);
+}
+
+// An ImVector: grows by doubling through alloc, copy and free.
+struct vector
+{
+	uint8_t* data;
+	size_t size;
+	size_t capacity;
+};
+
+static void vector_push(struct pool_allocator* pool, struct vector* vector, size_t count)
+{
+	if (vector->size + count > vector->capacity) {
+		size_t capacity = vector->capacity ? vector->capacity * 2 : 8;
+		while (capacity < vector->size + count) capacity *= 2;
+		uint8_t* data = pool_alloc(pool, capacity);
+		if (vector->data) memcpy(data, vector->data, vector->size);
+		pool_free(pool, vector->data);
+		vector->data = data;
+		vector->capacity = capacity;
+	}
+	memset(vector->data + vector->size, 0xab, count);
+	vector->size += count;
+}
+
+#define FRAME_VECTORS 96
+#define WARM_FRAMES 16
+
+static void test_frame_loop(void)
+{
+	struct pool_allocator* pool = pool_allocator_create();
+	if (!CHECK(pool != NULL, "no allocator")) return;
+	struct vector vectors[FRAME_VECTORS] = {0};
+	uint32_t late_os_frames = 0;
+	for (uint32_t frame = 0; frame < 300; ++frame) {
+		pool_allocator_frame(pool);
+		if (frame > WARM_FRAMES && pool->last_frame.os_allocs) late_os_frames++;
+		// draw lists rebuilt every frame, sizes wobbling within what they reached before
+		for (uint32_t i = 0; i < FRAME_VECTORS; ++i) {
+			vectors[i].size = 0;
+			vector_push(pool, &vectors[i], 64 + i * 700 + (frame % 5) * 31);
+		}
+		// text and temporary buffers freed within the frame
+		void* transient[48];
+		for (uint32_t i = 0; i < 48; ++i) transient[i] = pool_alloc(pool, 1 + (i * 97 + frame * 13) % 4000);
+		for (uint32_t i = 0; i < 48; ++i) pool_free(pool, transient[i]);
+	}
+	CHECK(late_os_frames == 0, "%u frames after warm-up still allocated from the OS", late_os_frames);
+	CHECK(pool->quiet_frames >= 300 - WARM_FRAMES - 1, "only %llu quiet frames", (unsigned long long)pool->quiet_frames);
+	printf("frame loop: %llu allocations, %llu from the OS, %llu KB reserved, peak %llu KB live\n", (unsigned long long)pool->total.allocs,
+	       (unsigned long long)pool->total.os_allocs, (unsigned long long)(pool->os_reserved / 1024), (unsigned long long)(pool->peak_bytes / 1024));
+	for (uint32_t i = 0; i < FRAME_VECTORS; ++i) pool_free(pool, vectors[i].data);
+	CHECK(pool->live_bytes == 0, "frame loop: %llu bytes still live", (unsigned long long)pool->live_bytes);
+}
+
+static uint64_t tracked_bytes(const struct pool_allocator* pool)
+{
+	uint64_t bytes = 0;
+	for (uint32_t i = 0; i < pool->os_block_count; ++i) bytes += pool->os_blocks[i].bytes;
+	return bytes;
+}
+
+#if defined(__linux__)
+#include <unistd.h>
+
+static uint64_t mapped_pages(void)
+{
+	unsigned long long pages = 0;
+	FILE* file = fopen("/proc/self/statm", "r");
+	if (file) {
+		if (fscanf(file, "%llu", &pages) != 1) pages = 0;
+		fclose(file);
+	}
+	return pages;
+}
+#endif
+
+static void test_destroy(void)
+{
+	struct pool_allocator* pool = pool_allocator_create();
+	if (!CHECK(pool != NULL, "no allocator")) return;
+	uint64_t bookkeeping = sizeof(*pool);
+
+	// huge blocks freed out of order, each free moves the last entry into the hole
+	uint8_t* huge[6];
+	for (uint32_t i = 0; i < 6; ++i) huge[i] = pool_alloc(pool, ((size_t)2 << 20) + i * 4096);
+	bookkeeping += pool->os_block_capacity * sizeof(struct pool_os_block);
+	uint32_t order[6] = {0, 5, 2, 4, 1, 3};
+	for (uint32_t i = 0; i < 3; ++i) pool_free(pool, huge[order[i]]);
+	CHECK(pool->os_block_count == 3 && tracked_bytes(pool) == pool->os_reserved - bookkeeping, "%u blocks, %llu bytes tracked of %llu reserved",
+	      pool->os_block_count, (unsigned long long)tracked_bytes(pool), (unsigned long long)(pool->os_reserved - bookkeeping));
+	for (uint32_t i = 3; i < 6; ++i) pool_free(pool, huge[order[i]]);
+	CHECK(pool->os_block_count == 0 && pool->os_reserved == bookkeeping, "huge blocks still tracked after they were freed");
+
+	// left live: chunks of every class, enough to grow the array, and huge blocks
+	for (uint32_t i = 0; i < 20000; ++i) pool_alloc(pool, test_random() % 64 ? test_random() % 4096 : test_random() % (1u << POOL_MAX_SHIFT));
+	for (uint32_t i = 0; i < 4; ++i) pool_alloc(pool, (size_t)3 << 20);
+	bookkeeping = sizeof(*pool) + pool->os_block_capacity * sizeof(struct pool_os_block);
+	CHECK(pool->os_block_capacity > 256, "the block array never grew");
+	CHECK(tracked_bytes(pool) == pool->os_reserved - bookkeeping, "%llu bytes tracked of %llu reserved", (unsigned long long)tracked_bytes(pool),
+	      (unsigned long long)(pool->os_reserved - bookkeeping));
+
+#if defined(__linux__)
+	uint64_t reserved_pages = pool->os_reserved / (uint64_t)sysconf(_SC_PAGESIZE);
+	uint64_t before = mapped_pages();
+	pool_allocator_destroy(pool);
+	uint64_t after = mapped_pages();
+	CHECK(before - after >= reserved_pages, "destroy unmapped %llu of %llu pages", (unsigned long long)(before - after), (unsigned long long)reserved_pages);
+#else
+	pool_allocator_destroy(pool);
+#endif
+	pool_allocator_destroy(NULL);
+}
+
+// benchmark: alloc and free pairs in UI sizes, warm pools against the C library
+
+#define BENCH_PAIRS 1000000
+
+static struct pool_allocator* g_bench_pool;
+
+static void bench_pool(void* data)
+{
+	(void)data;
+	for (uint32_t i = 0; i < BENCH_PAIRS; ++i) {
+		void* p = pool_alloc(g_bench_pool, 16 + (i * 37) % 2000);
+		*(volatile uint8_t*)p = (uint8_t)i;
+		pool_free(g_bench_pool, p);
+	}
+}
+
+static void bench_malloc(void* data)
+{
+	(void)data;
+	for (uint32_t i = 0; i < BENCH_PAIRS; ++i) {
+		void* p = malloc(16 + (i * 37) % 2000);
+		*(volatile uint8_t*)p = (uint8_t)i; // or the compiler drops malloc and free altogether
+		free(p);
+	}
+}
+
+int main(void)
+{
+	struct pool_allocator* pool = pool_allocator_create();
+	if (!pool) {
+		fputs("no allocator\n", stderr);
+		return 1;
+	}
+	test_size_classes(pool);
+	test_huge(pool);
+	test_no_overlap(pool);
+	test_frame_loop();
+	test_destroy();
+
+	g_bench_pool = pool;
+	double pooled = test_time_ms(9, bench_pool, NULL);
+	double system = test_time_ms(9, bench_malloc, NULL);
+	printf("%u alloc and free pairs: pool %.3f ms, malloc %.3f ms\n", BENCH_PAIRS, pooled, system);
+	return test_finish("pool_alloc_test");
+}
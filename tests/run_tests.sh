@@ -0,0 +1,28 @@
+#!/bin/sh
+# Builds every tests/*_test.c on Linux and runs it, stops at the first that fails. Each test prints
+# its benchmarks as it goes. Run from anywhere, builds into _test_build next to this directory:
+#   tests/run_tests.sh            all of them
+#   tests/run_tests.sh job_system only those whose names contain one of the words
+set -e
+root=$(cd "$(dirname "$0")/.." && pwd)
+out="$root/_test_build"
+mkdir -p "$out"
+cc=${CC:-cc}
+failed=0
+for source in "$root"/tests/*_test.c; do
+	name=$(basename "$source" .c)
+	if [ $# -gt 0 ]; then
+		wanted=0
+		for word in "$@"; do
+			case "$name" in *"$word"*) wanted=1 ;; esac
+		done
+		[ $wanted -eq 1 ] || continue
+	fi
+	echo "== $name"
+	$cc -std=c11 -O2 -g -Wall -Wextra -o "$out/$name" "$source" -lm -lpthread
+	if ! "$out/$name"; then
+		failed=1
+		break
+	fi
+done
+exit $failed
@@ -0,0 +1,213 @@
+// scene.c with a large random hierarchy: added out of depth order and sorted, every world matrix
+// checked against one computed recursively from the node's ancestors, then partial updates that
+// must recompute exactly the dirty subtrees and leave the rest untouched, and the projected output.
+// Then full and partial updates timed, on the workers and on the calling thread alone.
+
+#include "test_util.c"
+#include "../source/vecmath.c"
+#include "../source/job_system.c"
+#include "../source/scene.c"
+
+#define TEST_WORKERS 4
+#define NODE_COUNT 200000
+
+static struct mat4 local_matrix(const struct scene* scene, uint32_t node)
+{
+	struct vec3 position = {scene->position[0][node], scene->position[1][node], scene->position[2][node]};
+	struct quat rotation = {scene->rotation[0][node], scene->rotation[1][node], scene->rotation[2][node], scene->rotation[3][node]};
+	struct vec3 scale = {scene->scale[0][node], scene->scale[1][node], scene->scale[2][node]};
+	return mat4_trs(position, rotation, scale);
+}
+
+static struct mat4 reference_world(const struct scene* scene, uint32_t node)
+{
+	struct mat4 local = local_matrix(scene, node);
+	if (scene->parent[node] == SCENE_NO_PARENT) return local;
+	struct mat4 parent = reference_world(scene, scene->parent[node]);
+	return mat4_mul(&parent, &local);
+}
+
+static bool matrices_near(const struct mat4* a, const struct mat4* b)
+{
+	const float* x = &a->columns[0].x;
+	const float* y = &b->columns[0].x;
+	for (int i = 0; i < 16; ++i)
+		if (fabsf(x[i] - y[i]) > 1e-4f * (1.0f + fabsf(y[i]))) return false;
+	return true;
+}
+
+static uint32_t count_wrong_worlds(const struct scene* scene)
+{
+	uint32_t wrong = 0;
+	for (uint32_t node = 0; node < scene->count; ++node) {
+		struct mat4 expected = reference_world(scene, node);
+		wrong += !matrices_near(&scene->world[node], &expected);
+	}
+	return wrong;
+}
+
+static struct quat random_rotation(void)
+{
+	struct vec3 axis = {test_random_float(-1, 1), test_random_float(-1, 1), test_random_float(-1, 1) + 2.0f};
+	return quat_axis_angle(vec3_normalize(axis), test_random_float(-3.0f, 3.0f));
+}
+
+// Every node under a random earlier one, so depths come in any order and the tree is about
+// log(count) deep, with a root now and then.
+static void build_random(struct scene* scene, uint32_t count)
+{
+	scene_init(scene, 64);
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t parent = i == 0 || test_random() % 1000 == 0 ? SCENE_NO_PARENT : test_random() % i;
+		struct vec3 position = {test_random_float(-2, 2), test_random_float(-2, 2), test_random_float(-2, 2)};
+		float s = test_random_float(0.8f, 1.2f);
+		if (scene_add(scene, parent, position, random_rotation(), vec3_make(s, s, s)) == SCENE_NO_PARENT) {
+			fputs("scene_add failed\n", stderr);
+			exit(1);
+		}
+	}
+}
+
+static void test_sort(struct scene* scene)
+{
+	uint32_t count = scene->count;
+	float* x = test_allocate(count * sizeof(float));
+	memcpy(x, scene->position[0], count * sizeof(float));
+	uint32_t* parents = test_allocate(count * sizeof(uint32_t));
+	memcpy(parents, scene->parent, count * sizeof(uint32_t));
+	uint32_t* remap = test_allocate(count * sizeof(uint32_t));
+
+	CHECK(!scene->sorted, "a random hierarchy came out sorted");
+	if (!CHECK(scene_sort(scene, remap), "scene_sort failed")) exit(1);
+	uint32_t misplaced = 0, bad_parents = 0, bad_levels = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		uint32_t node = remap[i];
+		misplaced += scene->position[0][node] != x[i];
+		uint32_t parent = parents[i] == SCENE_NO_PARENT ? SCENE_NO_PARENT : remap[parents[i]];
+		bad_parents += scene->parent[node] != parent || (parent != SCENE_NO_PARENT && parent >= node);
+	}
+	for (uint32_t level = 0; level < scene->level_count; ++level)
+		for (uint32_t node = scene->level_begin[level]; node < scene->level_begin[level + 1]; ++node) bad_levels += scene->depth[node] != level;
+	CHECK(misplaced == 0, "sort: %u nodes lost their transform", misplaced);
+	CHECK(bad_parents == 0, "sort: %u parents wrong or after their children", bad_parents);
+	CHECK(bad_levels == 0 && scene->level_begin[scene->level_count] == count, "sort: %u nodes outside their level", bad_levels);
+	printf("sort: %u nodes in %u levels\n", count, scene->level_count);
+	free(x);
+	free(parents);
+	free(remap);
+}
+
+static void test_updates(struct scene* scene)
+{
+	uint32_t count = scene->count;
+	scene_update(scene, NULL, NULL);
+	CHECK(atomic_load(&scene->updated) == count, "first update recomputed %u of %u nodes", atomic_load(&scene->updated), count);
+	CHECK(count_wrong_worlds(scene) == 0, "first update: world matrices off the recursive reference");
+
+	// nothing dirty, nothing recomputed
+	scene_update(scene, NULL, NULL);
+	CHECK(atomic_load(&scene->updated) == 0, "a clean update recomputed %u nodes", atomic_load(&scene->updated));
+
+	struct mat4* before = test_allocate(count * sizeof(struct mat4));
+	uint8_t* in_subtree = test_allocate(count);
+	for (int round = 0; round < 5; ++round) {
+		memcpy(before, scene->world, count * sizeof(struct mat4));
+		memset(in_subtree, 0, count);
+		for (int i = 0; i < 50; ++i) {
+			uint32_t node = test_random() % count;
+			switch (i % 3) {
+				case 0: scene_set_position(scene, node, vec3_make(test_random_float(-2, 2), 0.5f, test_random_float(-2, 2))); break;
+				case 1: scene_set_rotation(scene, node, random_rotation()); break;
+				default: scene_set_scale(scene, node, vec3_make(1.1f, 0.9f, 1.0f)); break;
+			}
+			in_subtree[node] = 1;
+		}
+		// parents come first, so one pass marks every descendant
+		uint32_t expected_updated = 0;
+		for (uint32_t node = 0; node < count; ++node) {
+			if (scene->parent[node] != SCENE_NO_PARENT && in_subtree[scene->parent[node]]) in_subtree[node] = 1;
+			expected_updated += in_subtree[node];
+		}
+		scene_update(scene, NULL, NULL);
+		CHECK(atomic_load(&scene->updated) == expected_updated, "partial update %d recomputed %u nodes, the dirty subtrees hold %u", round,
+		      atomic_load(&scene->updated), expected_updated);
+		uint32_t touched = 0;
+		for (uint32_t node = 0; node < count; ++node)
+			touched += !in_subtree[node] && memcmp(&before[node], &scene->world[node], sizeof(struct mat4)) != 0;
+		CHECK(touched == 0, "partial update %d changed %u matrices outside the dirty subtrees", round, touched);
+		CHECK(count_wrong_worlds(scene) == 0, "partial update %d: world matrices off the recursive reference", round);
+	}
+
+	// projected output, written for every node whether it changed or not
+	struct mat4 projection = mat4_perspective(1.0f, 1.5f, 0.1f, 100.0f);
+	struct mat4 view = mat4_look_at(vec3_make(0, 5, -20), vec3_make(0, 0, 0), vec3_make(0, 1, 0));
+	struct mat4 view_projection = mat4_mul(&projection, &view);
+	struct mat4* out = before;
+	scene_set_position(scene, 0, vec3_make(1, 2, 3));
+	scene_update(scene, &view_projection, out);
+	uint32_t wrong = 0;
+	for (uint32_t node = 0; node < count; ++node) {
+		struct mat4 expected = mat4_mul(&view_projection, &scene->world[node]);
+		wrong += !matrices_near(&out[node], &expected);
+	}
+	CHECK(wrong == 0, "%u projected matrices wrong", wrong);
+	free(before);
+	free(in_subtree);
+}
+
+// benchmark
+
+static struct
+{
+	struct scene* scene;
+	struct mat4* out;
+	struct mat4 view_projection;
+	bool partial;
+} g_bench;
+
+static void bench_update(void* data)
+{
+	(void)data;
+	struct scene* scene = g_bench.scene;
+	if (g_bench.partial) {
+		// a few hundred animated nodes, the usual frame, from the deeper half where subtrees are small
+		for (uint32_t i = 0; i < 300; ++i)
+			scene_set_rotation(scene, scene->count - 1 - (i * 7919u) % (scene->count / 2), quat_axis_angle(vec3_make(0, 1, 0), (float)i));
+	} else {
+		for (uint32_t node = 0; node < scene->count; ++node) scene->dirty[node] = 1;
+	}
+	scene_update(scene, &g_bench.view_projection, g_bench.out);
+}
+
+int main(void)
+{
+	if (!job_system_init(TEST_WORKERS)) {
+		fputs("cannot start the workers\n", stderr);
+		return 1;
+	}
+	struct scene scene;
+	build_random(&scene, NODE_COUNT);
+	test_sort(&scene);
+	test_updates(&scene);
+
+	g_bench.scene = &scene;
+	g_bench.out = test_allocate(scene.count * sizeof(struct mat4));
+	g_bench.view_projection = mat4_perspective(1.0f, 1.5f, 0.1f, 100.0f);
+	double full = test_time_ms(9, bench_update, NULL);
+	g_bench.partial = true;
+	double partial = test_time_ms(9, bench_update, NULL);
+	printf("scene_update of %u nodes with projection, %u workers: all dirty %.3f ms, 300 animated %.3f ms (%u recomputed)\n", scene.count,
+	       job_thread_count(), full, partial, atomic_load(&scene.updated));
+	job_system_shutdown();
+
+	// without workers job_parallel_for runs everything on the calling thread
+	if (job_system_init(1)) {
+		g_bench.partial = false;
+		double serial = test_time_ms(9, bench_update, NULL);
+		printf("scene_update of %u nodes on the calling thread alone: all dirty %.3f ms\n", scene.count, serial);
+		job_system_shutdown();
+	}
+	free(g_bench.out);
+	scene_free(&scene);
+	return test_finish("scene_test");
+}
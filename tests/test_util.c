@@ -0,0 +1,96 @@
+// Shared by the Linux tests in this directory. Each test is one C11 program that includes the
+// sources it checks, as the game does, prints its benchmarks and exits non-zero when a check
+// failed. tests/run_tests.sh builds and runs them all; one on its own:
+//   cc -std=c11 -O2 -Wall -Wextra -o job_system_test tests/job_system_test.c -lm -lpthread
+// Requires nothing, includes threading.c for time_now_ns().
+
+#include "../source/threading.c"
+
+#include <math.h>
+#include <stdarg.h>
+#include <stdio.h>
+#include <string.h>
+
+static uint32_t g_test_checks;
+static uint32_t g_test_failures;
+
+// Counts the check, prints the message when it failed. Returns whether it passed.
+static inline bool test_check(bool passed, const char* file, int line, const char* format, ...)
+{
+	g_test_checks++;
+	if (passed) return true;
+	if (++g_test_failures <= 20) {
+		va_list args;
+		va_start(args, format);
+		fprintf(stderr, "%s:%d: ", file, line);
+		vfprintf(stderr, format, args);
+		fputc('\n', stderr);
+		va_end(args);
+	}
+	return false;
+}
+
+#define CHECK(condition, ...) test_check((condition), __FILE__, __LINE__, __VA_ARGS__)
+
+// The exit code of main: 0 when every check passed.
+static inline int test_finish(const char* name)
+{
+	if (g_test_failures) {
+		fprintf(stderr, "%s: %u of %u checks failed\n", name, g_test_failures, g_test_checks);
+		return 1;
+	}
+	printf("%s: %u checks passed\n", name, g_test_checks);
+	return 0;
+}
+
+// xorshift64*, seeded the same every run so a failure reproduces
+static uint64_t g_test_random = 0x9e3779b97f4a7c15ull;
+
+static inline uint32_t test_random(void)
+{
+	g_test_random ^= g_test_random >> 12;
+	g_test_random ^= g_test_random << 25;
+	g_test_random ^= g_test_random >> 27;
+	return (uint32_t)((g_test_random * 0x2545f4914f6cdd1dull) >> 32);
+}
+
+static inline uint64_t test_random64(void)
+{
+	return (uint64_t)test_random() << 32 | test_random();
+}
+
+// In [low, high).
+static inline float test_random_float(float low, float high)
+{
+	return low + (high - low) * (float)(test_random() >> 8) / 16777216.0f;
+}
+
+static inline void* test_allocate(size_t size)
+{
+	void* memory = calloc(size ? size : 1, 1);
+	if (!memory) {
+		fputs("out of memory\n", stderr);
+		exit(1);
+	}
+	return memory;
+}
+
+static inline int test_double_compare(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+// Median of runs timings of function(data), in milliseconds.
+static inline double test_time_ms(uint32_t runs, void (*function)(void* data), void* data)
+{
+	double times[64];
+	if (runs > 64) runs = 64;
+	for (uint32_t run = 0; run < runs; ++run) {
+		uint64_t begin = time_now_ns();
+		function(data);
+		times[run] = (double)(time_now_ns() - begin) / 1e6;
+	}
+	qsort(times, runs, sizeof(double), test_double_compare);
+	return times[runs / 2];
+}
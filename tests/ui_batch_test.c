@@ -0,0 +1,302 @@
+// ui_batch.c against the draw data it batches: random frames of lists and commands, with
+// callbacks, empty and off-screen clip rectangles and lists past 64K vertices, are resolved into
+// triangles, vertices through indices with texture and scissor, once straight from the commands
+// and once from the batches and packed indices. The two streams must be the same, and no two
+// neighbouring batches could have been one. Then the build and copy timed on a UI sized frame.
+
+#include "test_util.c"
+
+#define CIMGUI_DEFINE_ENUMS_AND_STRUCTS
+#pragma GCC diagnostic push
+#pragma GCC diagnostic ignored "-Wunknown-pragmas"
+#include "../source/cimgui.h"
+#pragma GCC diagnostic pop
+
+#include "../source/ui_batch.c"
+
+// A triangle as drawn, or a callback in between when callback is set.
+struct triangle
+{
+	const ImDrawCmd* callback;
+	uint32_t texture;
+	int32_t scissor[4];
+	uint32_t vertices[3]; // into the merged vertex buffer
+};
+
+struct triangles
+{
+	struct triangle* data;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+static void triangles_add(struct triangles* triangles, struct triangle triangle)
+{
+	if (triangles->count == triangles->capacity) {
+		triangles->capacity = triangles->capacity ? triangles->capacity * 2 : 4096;
+		triangles->data = realloc(triangles->data, triangles->capacity * sizeof(struct triangle));
+		if (!triangles->data) exit(1);
+	}
+	triangles->data[triangles->count++] = triangle;
+}
+
+static void test_callback(const ImDrawList* list, const ImDrawCmd* cmd)
+{
+	(void)list;
+	(void)cmd;
+}
+
+struct frame_shape
+{
+	uint32_t lists;
+	uint32_t commands;  // per list at most
+	uint32_t triangles; // per command at most
+	bool large;         // some lists past what 16-bit indices reach
+};
+
+static ImDrawData random_frame(struct frame_shape shape)
+{
+	ImDrawData data = {.Valid = true, .DisplaySize = {1280.0f, 720.0f}, .FramebufferScale = {1.0f, 1.0f}};
+	data.DisplayPos = (ImVec2){(float)(test_random() % 64), (float)(test_random() % 64)};
+	data.CmdListsCount = 1 + test_random() % shape.lists;
+	data.CmdLists = test_allocate(data.CmdListsCount * sizeof(ImDrawList*));
+	float x = data.DisplayPos.x, y = data.DisplayPos.y;
+	for (int n = 0; n < data.CmdListsCount; ++n) {
+		ImDrawList* list = test_allocate(sizeof(ImDrawList));
+		data.CmdLists[n] = list;
+		bool large = shape.large && test_random() % 3 == 0;
+		uint32_t vertex_count = large ? 70000 + test_random() % 100000 : 3 + test_random() % 3000;
+		list->VtxBuffer.Size = (int)vertex_count;
+		list->VtxBuffer.Data = test_allocate(vertex_count * sizeof(ImDrawVert));
+
+		uint32_t command_count = 1 + test_random() % shape.commands;
+		list->CmdBuffer.Size = (int)command_count;
+		list->CmdBuffer.Data = test_allocate(command_count * sizeof(ImDrawCmd));
+		uint32_t* triangle_counts = test_allocate(command_count * sizeof(uint32_t));
+		uint32_t index_count = 0;
+		for (uint32_t c = 0; c < command_count; ++c) {
+			triangle_counts[c] = test_random() % 8 == 0 ? 0 : 1 + test_random() % shape.triangles;
+			index_count += 3 * triangle_counts[c];
+		}
+		list->IdxBuffer.Size = (int)index_count;
+		list->IdxBuffer.Data = test_allocate(index_count * sizeof(ImDrawIdx));
+
+		uint32_t index_offset = 0, vertex_offset = 0;
+		uint32_t texture = 1 + test_random() % 3;
+		for (uint32_t c = 0; c < command_count; ++c) {
+			ImDrawCmd* cmd = &list->CmdBuffer.Data[c];
+			if (test_random() % 24 == 0) {
+				cmd->UserCallback = test_callback;
+				continue;
+			}
+			// a large list moves its VtxOffset along, as ImGui does past 64K vertices
+			if (large && c > 0 && test_random() % 3 == 0) vertex_offset += test_random() % (vertex_count - vertex_offset - 3);
+			// runs of one texture and one clip rectangle, as windows draw, so batches merge
+			if (test_random() % 4 == 0) texture = 1 + test_random() % 3;
+			cmd->TextureId = (ImTextureID)(uintptr_t)texture;
+			switch (test_random() % 6) {
+				case 0: cmd->ClipRect = (ImVec4){x - 100.0f, y - 50.0f, x + 1400.0f, y + 800.0f}; break; // past the display
+				case 1: cmd->ClipRect = (ImVec4){x + 1300.0f, y, x + 1500.0f, y + 720.0f}; break;      // off the display
+				case 2: cmd->ClipRect = (ImVec4){x + 200.0f, y + 100.0f, x + 200.0f, y + 400.0f}; break; // empty
+				case 3: {
+					float left = x + (float)(test_random() % 600), top = y + (float)(test_random() % 300);
+					cmd->ClipRect = (ImVec4){left, top, left + 1.0f + (float)(test_random() % 600), top + 1.0f + (float)(test_random() % 400)};
+					break;
+				}
+				default: cmd->ClipRect = (ImVec4){x, y, x + 1280.0f, y + 720.0f}; break;
+			}
+			cmd->VtxOffset = vertex_offset;
+			cmd->IdxOffset = index_offset;
+			cmd->ElemCount = 3 * triangle_counts[c];
+			uint32_t reach = vertex_count - vertex_offset;
+			if (reach > 0x10000) reach = 0x10000;
+			for (uint32_t k = 0; k < cmd->ElemCount; ++k) list->IdxBuffer.Data[index_offset + k] = (ImDrawIdx)(test_random() % reach);
+			index_offset += cmd->ElemCount;
+		}
+		free(triangle_counts);
+		data.TotalVtxCount += (int)vertex_count;
+		data.TotalIdxCount += (int)index_count;
+	}
+	return data;
+}
+
+static void free_frame(ImDrawData* data)
+{
+	for (int n = 0; n < data->CmdListsCount; ++n) {
+		free(data->CmdLists[n]->VtxBuffer.Data);
+		free(data->CmdLists[n]->IdxBuffer.Data);
+		free(data->CmdLists[n]->CmdBuffer.Data);
+		free(data->CmdLists[n]);
+	}
+	free(data->CmdLists);
+}
+
+// What the unbatched backend draws: every visible command on its own, at its list's base vertex.
+static void resolve_commands(const ImDrawData* data, struct triangles* out)
+{
+	out->count = 0;
+	uint32_t list_vertex_base = 0;
+	for (int n = 0; n < data->CmdListsCount; ++n) {
+		const ImDrawList* list = data->CmdLists[n];
+		for (int i = 0; i < list->CmdBuffer.Size; ++i) {
+			const ImDrawCmd* cmd = &list->CmdBuffer.Data[i];
+			if (cmd->UserCallback) {
+				triangles_add(out, (struct triangle){.callback = cmd});
+				continue;
+			}
+			int32_t scissor[4];
+			if (!ui_batch_scissor(data, cmd, scissor)) continue;
+			for (uint32_t k = 0; k < cmd->ElemCount; k += 3) {
+				struct triangle triangle = {.texture = (uint32_t)(uintptr_t)cmd->TextureId};
+				memcpy(triangle.scissor, scissor, sizeof(scissor));
+				for (int j = 0; j < 3; ++j) triangle.vertices[j] = list_vertex_base + cmd->VtxOffset + list->IdxBuffer.Data[cmd->IdxOffset + k + j];
+				triangles_add(out, triangle);
+			}
+		}
+		list_vertex_base += (uint32_t)list->VtxBuffer.Size;
+	}
+}
+
+// What the batched backend draws: the batches over the packed indices.
+static void resolve_batches(const struct ui_batches* batches, const ImDrawIdx* packed, struct triangles* out)
+{
+	out->count = 0;
+	for (uint32_t i = 0; i < batches->batch_count; ++i) {
+		const struct ui_batch* batch = &batches->batches[i];
+		if (batch->callback) {
+			triangles_add(out, (struct triangle){.callback = batch->callback});
+			continue;
+		}
+		for (uint32_t k = 0; k < batch->index_count; k += 3) {
+			struct triangle triangle = {.texture = batch->texture};
+			memcpy(triangle.scissor, batch->scissor, sizeof(batch->scissor));
+			for (int j = 0; j < 3; ++j) triangle.vertices[j] = (uint32_t)batch->vertex_offset + packed[batch->index_offset + k + j];
+			triangles_add(out, triangle);
+		}
+	}
+}
+
+static bool triangles_equal(const struct triangle* a, const struct triangle* b)
+{
+	if (a->callback || b->callback) return a->callback == b->callback;
+	return a->texture == b->texture && memcmp(a->scissor, b->scissor, sizeof(a->scissor)) == 0 &&
+	       memcmp(a->vertices, b->vertices, sizeof(a->vertices)) == 0;
+}
+
+static void test_random_frames(struct frame_shape shape, uint32_t frames, const char* name)
+{
+	struct triangles expected = {0}, batched = {0};
+	uint64_t commands = 0, batch_count = 0, rebased_frames = 0;
+	for (uint32_t frame = 0; frame < frames; ++frame) {
+		ImDrawData data = random_frame(shape);
+		resolve_commands(&data, &expected);
+
+		struct ui_batches batches = {0};
+		if (!CHECK(ui_batches_build(&batches, &data), "%s frame %u: build failed", name, frame)) break;
+		ImDrawIdx* packed = test_allocate((batches.index_count + 1) * sizeof(ImDrawIdx));
+		// in two pieces, as the copy is split across threads
+		ui_batches_copy_indices(&batches, packed, 0, batches.copy_count / 2);
+		ui_batches_copy_indices(&batches, packed, batches.copy_count / 2, batches.copy_count);
+		resolve_batches(&batches, packed, &batched);
+
+		uint32_t mismatch = expected.count;
+		if (batched.count == expected.count)
+			for (uint32_t i = 0; i < expected.count && mismatch == expected.count; ++i)
+				if (!triangles_equal(&expected.data[i], &batched.data[i])) mismatch = i;
+		bool same = CHECK(batched.count == expected.count && mismatch == expected.count, "%s frame %u: %u triangles batched, %u expected, first difference at %u",
+		                  name, frame, batched.count, expected.count, mismatch);
+
+		uint32_t unmerged = 0, vertex_bases = 0;
+		for (uint32_t i = 0; i < batches.batch_count; ++i) {
+			const struct ui_batch* batch = &batches.batches[i];
+			if (batch->callback) continue;
+			vertex_bases += i == 0 || batch->vertex_offset != batches.batches[i - 1].vertex_offset;
+			if (i == 0) continue;
+			const struct ui_batch* previous = &batches.batches[i - 1];
+			unmerged += !previous->callback && previous->texture == batch->texture && previous->vertex_offset == batch->vertex_offset &&
+			            memcmp(previous->scissor, batch->scissor, sizeof(batch->scissor)) == 0;
+		}
+		CHECK(unmerged == 0, "%s frame %u: %u batches could have merged with the one before", name, frame, unmerged);
+		rebased_frames += vertex_bases > 1;
+		commands += batches.command_count;
+		batch_count += batches.batch_count;
+		ui_batches_free(&batches);
+		free(packed);
+		free_frame(&data);
+		if (!same) break;
+	}
+	if (shape.large) CHECK(rebased_frames > frames / 4, "%s: only %llu of %u frames started a new vertex run", name, (unsigned long long)rebased_frames, frames);
+	printf("%s: %u frames, %llu commands into %llu batches, %llu frames with more than one vertex run\n", name, frames, (unsigned long long)commands,
+	       (unsigned long long)batch_count, (unsigned long long)rebased_frames);
+	free(expected.data);
+	free(batched.data);
+}
+
+// Lists sized so that the second starts a run exactly where the rebased indices stop fitting, and
+// one vertex later.
+static void test_run_edge(void)
+{
+	for (uint32_t extra = 0; extra < 2; ++extra) {
+		ImDrawList lists[2] = {0};
+		ImDrawCmd commands[2];
+		ImDrawIdx indices[2][3] = {{0, 1, 2}, {0, 1, 2}};
+		ImDrawVert* vertices = test_allocate(0x10000 * sizeof(ImDrawVert));
+		// first list ends where the second's full 16-bit span still fits the run, or one past that
+		uint32_t first_count = 0x10000 - 3 + extra;
+		for (int n = 0; n < 2; ++n) {
+			commands[n] = (ImDrawCmd){.ElemCount = 3, .ClipRect = {0.0f, 0.0f, 100.0f, 100.0f}, .TextureId = (ImTextureID)(uintptr_t)1};
+			lists[n].CmdBuffer = (ImVector_ImDrawCmd){1, 1, &commands[n]};
+			lists[n].IdxBuffer = (ImVector_ImDrawIdx){3, 3, indices[n]};
+			lists[n].VtxBuffer = (ImVector_ImDrawVert){n == 0 ? (int)first_count : 3, 0, vertices};
+		}
+		ImDrawList* list_pointers[2] = {&lists[0], &lists[1]};
+		ImDrawData data = {.Valid = true, .CmdLists = list_pointers, .CmdListsCount = 2, .DisplaySize = {100.0f, 100.0f}};
+		struct ui_batches batches = {0};
+		ImDrawIdx packed[6];
+		if (CHECK(ui_batches_build(&batches, &data), "run edge: build failed")) {
+			ui_batches_copy_indices(&batches, packed, 0, batches.copy_count);
+			uint32_t expected_batches = extra ? 2 : 1;
+			if (CHECK(batches.batch_count == expected_batches, "run edge +%u: %u batches, expected %u", extra, batches.batch_count, expected_batches)) {
+				const struct ui_batch* last = &batches.batches[batches.batch_count - 1];
+				uint32_t vertex = (uint32_t)last->vertex_offset + packed[last->index_offset + last->index_count - 1];
+				CHECK(vertex == first_count + 2, "run edge +%u: last vertex %u, expected %u", extra, vertex, first_count + 2);
+			}
+		}
+		ui_batches_free(&batches);
+		free(vertices);
+	}
+}
+
+// benchmark: about what a busy UI frame submits
+
+struct batch_bench
+{
+	ImDrawData data;
+	struct ui_batches batches;
+	ImDrawIdx* packed;
+};
+
+static void bench_build(void* param)
+{
+	struct batch_bench* bench = param;
+	ui_batches_build(&bench->batches, &bench->data);
+	ui_batches_copy_indices(&bench->batches, bench->packed, 0, bench->batches.copy_count);
+}
+
+int main(void)
+{
+	test_run_edge();
+	test_random_frames((struct frame_shape){.lists = 8, .commands = 12, .triangles = 40}, 3000, "small lists");
+	test_random_frames((struct frame_shape){.lists = 6, .commands = 12, .triangles = 40, .large = true}, 600, "lists past 64K vertices");
+	test_random_frames((struct frame_shape){.lists = 200, .commands = 30, .triangles = 200}, 20, "many lists");
+
+	struct batch_bench bench = {.data = random_frame((struct frame_shape){.lists = 300, .commands = 40, .triangles = 60})};
+	bench.packed = test_allocate((size_t)bench.data.TotalIdxCount * sizeof(ImDrawIdx));
+	double ms = test_time_ms(31, bench_build, &bench);
+	printf("build and copy: %d lists, %u commands into %u batches, %d indices in %.3f ms\n", bench.data.CmdListsCount, bench.batches.command_count,
+	       bench.batches.batch_count, bench.data.TotalIdxCount, ms);
+	ui_batches_free(&bench.batches);
+	free(bench.packed);
+	free_frame(&bench.data);
+	return test_finish("ui_batch_test");
+}
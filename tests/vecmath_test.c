@@ -0,0 +1,214 @@
+// vecmath.c: every batch kernel path the CPU runs against the _scalar reference on random inputs,
+// counts around the vector widths so the scalar tails are covered, in place as well, then the
+// single value SSE functions against plain C and a few identities. Results may differ from the
+// reference by float rounding only, FMA rounds once where the reference rounds twice. Then each
+// path timed on a scene sized batch.
+
+#include "test_util.c"
+#include "../source/vecmath.c"
+
+// Relative to the magnitude of the terms summed, not of the result, which may cancel to near 0.
+static bool near(float value, float expected, float magnitude)
+{
+	return fabsf(value - expected) <= 1e-5f * (1.0f + magnitude);
+}
+
+static struct mat4 random_matrix(void)
+{
+	struct mat4 m;
+	float* f = &m.columns[0].x;
+	for (int i = 0; i < 16; ++i) f[i] = test_random_float(-4.0f, 4.0f);
+	return m;
+}
+
+// Sum of |a_ij * b_j| for row r, bounding the rounding of the dot product.
+static float row_magnitude(const struct mat4* m, int row, struct vec4 v)
+{
+	float terms[4] = {v.x, v.y, v.z, v.w};
+	float sum = 0.0f;
+	for (int c = 0; c < 4; ++c) sum += fabsf((&m->columns[c].x)[row] * terms[c]);
+	return sum;
+}
+
+#define MAX_COUNT 1031
+
+static float* soa_allocate(struct vec4_soa* soa)
+{
+	float* block = test_allocate(4 * MAX_COUNT * sizeof(float));
+	*soa = (struct vec4_soa){block, block + MAX_COUNT, block + 2 * MAX_COUNT, block + 3 * MAX_COUNT};
+	return block;
+}
+
+static void test_transform_soa(enum vecmath_path path)
+{
+	struct vec4_soa in, expected, out;
+	float* blocks[3] = {soa_allocate(&in), soa_allocate(&expected), soa_allocate(&out)};
+	float* in_lanes[4] = {in.x, in.y, in.z, in.w};
+	float* expected_lanes[4] = {expected.x, expected.y, expected.z, expected.w};
+	float* out_lanes[4] = {out.x, out.y, out.z, out.w};
+	uint32_t wrong = 0;
+	size_t counts[] = {0, 1, 3, 4, 5, 7, 8, 9, 15, 16, 17, 31, 33, 100, MAX_COUNT};
+	for (int round = 0; round < 20; ++round) {
+		struct mat4 m = random_matrix();
+		for (size_t i = 0; i < MAX_COUNT; ++i)
+			for (int k = 0; k < 4; ++k) in_lanes[k][i] = test_random_float(-100.0f, 100.0f);
+		for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+			size_t count = counts[c];
+			// the element past count must be left alone
+			for (int k = 0; k < 4; ++k) out_lanes[k][count < MAX_COUNT ? count : 0] = 12345.0f;
+			mat4_transform_soa_scalar(&m, in, expected, count);
+			mat4_transform_soa(&m, in, out, count);
+			for (size_t i = 0; i < count; ++i) {
+				struct vec4 v = {in.x[i], in.y[i], in.z[i], in.w[i]};
+				for (int k = 0; k < 4; ++k) wrong += !near(out_lanes[k][i], expected_lanes[k][i], row_magnitude(&m, k, v));
+			}
+			if (count < MAX_COUNT)
+				for (int k = 0; k < 4; ++k) wrong += out_lanes[k][count] != 12345.0f;
+		}
+		// in place
+		memcpy(blocks[2], blocks[0], 4 * MAX_COUNT * sizeof(float));
+		mat4_transform_soa_scalar(&m, in, expected, MAX_COUNT);
+		mat4_transform_soa(&m, out, out, MAX_COUNT);
+		for (size_t i = 0; i < MAX_COUNT; ++i) {
+			struct vec4 v = {in.x[i], in.y[i], in.z[i], in.w[i]};
+			for (int k = 0; k < 4; ++k) wrong += !near(out_lanes[k][i], expected_lanes[k][i], row_magnitude(&m, k, v));
+		}
+	}
+	CHECK(wrong == 0, "mat4_transform_soa %s: %u values off the scalar reference", vecmath_path_name(path), wrong);
+	for (int i = 0; i < 3; ++i) free(blocks[i]);
+}
+
+static void test_mul_batch(enum vecmath_path path)
+{
+	struct mat4* b = test_allocate(MAX_COUNT * sizeof(struct mat4));
+	struct mat4* expected = test_allocate(MAX_COUNT * sizeof(struct mat4));
+	struct mat4* out = test_allocate(MAX_COUNT * sizeof(struct mat4));
+	uint32_t wrong = 0;
+	size_t counts[] = {0, 1, 2, 3, 7, 64, MAX_COUNT};
+	for (int round = 0; round < 20; ++round) {
+		struct mat4 a = random_matrix();
+		for (size_t i = 0; i < MAX_COUNT; ++i) b[i] = random_matrix();
+		for (size_t c = 0; c < sizeof(counts) / sizeof(counts[0]); ++c) {
+			size_t count = counts[c];
+			mat4_mul_batch_scalar(&a, b, expected, count);
+			mat4_mul_batch(&a, b, out, count);
+			for (size_t i = 0; i < count; ++i)
+				for (int j = 0; j < 4; ++j)
+					for (int r = 0; r < 4; ++r)
+						wrong += !near((&out[i].columns[j].x)[r], (&expected[i].columns[j].x)[r], row_magnitude(&a, r, b[i].columns[j]));
+		}
+		// in place
+		mat4_mul_batch_scalar(&a, b, expected, MAX_COUNT);
+		memcpy(out, b, MAX_COUNT * sizeof(struct mat4));
+		mat4_mul_batch(&a, out, out, MAX_COUNT);
+		for (size_t i = 0; i < MAX_COUNT; ++i)
+			for (int j = 0; j < 4; ++j)
+				for (int r = 0; r < 4; ++r)
+					wrong += !near((&out[i].columns[j].x)[r], (&expected[i].columns[j].x)[r], row_magnitude(&a, r, b[i].columns[j]));
+	}
+	CHECK(wrong == 0, "mat4_mul_batch %s: %u values off the scalar reference", vecmath_path_name(path), wrong);
+	free(b);
+	free(expected);
+	free(out);
+}
+
+// The single value functions, SSE whenever the build has it, against the same sums in plain C.
+static void test_single_values(void)
+{
+	uint32_t wrong = 0;
+	for (int round = 0; round < 10000; ++round) {
+		struct vec4 a = {test_random_float(-10, 10), test_random_float(-10, 10), test_random_float(-10, 10), test_random_float(-10, 10)};
+		struct vec4 b = {test_random_float(-10, 10), test_random_float(-10, 10), test_random_float(-10, 10), test_random_float(-10, 10)};
+		struct vec4 sum = vec4_add(a, b), difference = vec4_sub(a, b), product = vec4_mul(a, b), scaled = vec4_scale(a, 0.5f);
+		wrong += sum.x != a.x + b.x || sum.w != a.w + b.w || difference.y != a.y - b.y || product.z != a.z * b.z || scaled.w != a.w * 0.5f;
+		wrong += !near(vec4_dot(a, b), a.x * b.x + a.y * b.y + a.z * b.z + a.w * b.w, 400.0f);
+
+		struct mat4 m = random_matrix();
+		struct vec4 t = mat4_transform(&m, a);
+		float v[4] = {a.x, a.y, a.z, a.w}, tf[4] = {t.x, t.y, t.z, t.w};
+		for (int r = 0; r < 4; ++r) {
+			float expected = 0.0f;
+			for (int c = 0; c < 4; ++c) expected += (&m.columns[c].x)[r] * v[c];
+			wrong += !near(tf[r], expected, row_magnitude(&m, r, a));
+		}
+		struct mat4 transposed = mat4_transpose(&m);
+		for (int c = 0; c < 4; ++c)
+			for (int r = 0; r < 4; ++r) wrong += (&transposed.columns[c].x)[r] != (&m.columns[r].x)[c];
+	}
+	CHECK(wrong == 0, "%u single value results off plain C", wrong);
+
+	// an affine inverse undoes its matrix, a quaternion rotates as its matrix does
+	struct quat q = quat_normalize(quat_axis_angle(vec3_make(1, 2, 3), 0.7f));
+	struct mat4 trs = mat4_trs(vec3_make(1, 2, 3), q, vec3_make(2, 3, 4));
+	struct mat4 inverse = mat4_inverse_affine(&trs);
+	struct mat4 identity = mat4_mul(&inverse, &trs);
+	struct mat4 expected = mat4_identity();
+	uint32_t off = 0;
+	for (int i = 0; i < 16; ++i) off += !near((&identity.columns[0].x)[i], (&expected.columns[0].x)[i], 10.0f);
+	CHECK(off == 0, "inverse times matrix is %u values off identity", off);
+	struct mat4 rotation = mat4_from_quat(q);
+	struct vec3 p = vec3_make(0.3f, -2.0f, 5.0f);
+	struct vec3 by_quat = quat_rotate(q, p), by_matrix = mat4_transform_direction(&rotation, p);
+	CHECK(near(by_quat.x, by_matrix.x, 5) && near(by_quat.y, by_matrix.y, 5) && near(by_quat.z, by_matrix.z, 5), "quaternion and matrix rotations differ");
+}
+
+// benchmark: a scene's worth of points and matrices per path
+
+#define BENCH_COUNT 65536
+
+static struct
+{
+	struct mat4 m;
+	struct vec4_soa in, out;
+	struct mat4* matrices;
+	struct mat4* products;
+} g_bench;
+
+static void bench_transform(void* data)
+{
+	(void)data;
+	mat4_transform_soa(&g_bench.m, g_bench.in, g_bench.out, BENCH_COUNT);
+}
+
+static void bench_mul(void* data)
+{
+	(void)data;
+	mat4_mul_batch(&g_bench.m, g_bench.matrices, g_bench.products, BENCH_COUNT);
+}
+
+int main(void)
+{
+	for (int path = VECMATH_PATH_SCALAR; path <= VECMATH_PATH_AVX2; ++path) {
+		vecmath_init((enum vecmath_path)path);
+		if (g_vecmath.path != (enum vecmath_path)path) {
+			printf("%s: not supported here, skipped\n", vecmath_path_name((enum vecmath_path)path));
+			continue;
+		}
+		test_transform_soa(g_vecmath.path);
+		test_mul_batch(g_vecmath.path);
+	}
+	test_single_values();
+
+	float* in_block = test_allocate(4 * BENCH_COUNT * sizeof(float));
+	float* out_block = test_allocate(4 * BENCH_COUNT * sizeof(float));
+	g_bench.in = (struct vec4_soa){in_block, in_block + BENCH_COUNT, in_block + 2 * BENCH_COUNT, in_block + 3 * BENCH_COUNT};
+	g_bench.out = (struct vec4_soa){out_block, out_block + BENCH_COUNT, out_block + 2 * BENCH_COUNT, out_block + 3 * BENCH_COUNT};
+	for (size_t i = 0; i < 4 * BENCH_COUNT; ++i) in_block[i] = test_random_float(-100.0f, 100.0f);
+	g_bench.matrices = test_allocate(BENCH_COUNT * sizeof(struct mat4));
+	g_bench.products = test_allocate(BENCH_COUNT * sizeof(struct mat4));
+	for (size_t i = 0; i < BENCH_COUNT; ++i) g_bench.matrices[i] = random_matrix();
+	g_bench.m = random_matrix();
+	for (int path = VECMATH_PATH_SCALAR; path <= VECMATH_PATH_AVX2; ++path) {
+		vecmath_init((enum vecmath_path)path);
+		if (g_vecmath.path != (enum vecmath_path)path) continue;
+		double transform = test_time_ms(21, bench_transform, NULL);
+		double mul = test_time_ms(21, bench_mul, NULL);
+		printf("%-6s %u points transformed in %.3f ms, %u matrices multiplied in %.3f ms\n", vecmath_path_name(g_vecmath.path), BENCH_COUNT, transform,
+		       BENCH_COUNT, mul);
+	}
+	free(in_block);
+	free(out_block);
+	free(g_bench.matrices);
+	free(g_bench.products);
+	return test_finish("vecmath_test");
+}
@@ -0,0 +1,478 @@
+// Asset packer: writes the asset_archive.c file the game maps at startup instead of reading loose
+// files, lists one, and measures loading from one against loading the same files loose. C11 for
+// Linux, the archive is mapped with mmap and the benchmark drops and counts pages with posix_fadvise
+// and mincore:
+//   cc -std=c11 -O2 -o asset_packer tools/asset_packer.c -lm -lpthread
+//   asset_packer [--root DIR] [--compress [--block-size KiB]] output.pak file...
+//                                                      pack, names relative to DIR (.)
+//   asset_packer --list archive.pak                    every entry, its payload checked against its hash
+//   asset_packer --bench [--runs N] [--warm] [--root DIR] archive.pak...
+// The game's archive is packed from the repository root:
+//   asset_packer --compress data/assets.pak data/cooked.mesh source/default_shader.hlsl
+//                source/mesh_cull.hlsl source/bindless.hlsli source/vertex_format.hlsli
+// --compress stores the payloads of a block or more, 64 to 256 KiB (128), in compressed blocks
+// when that saves at least a sixteenth, the blocks compressed on every core.
+// The benchmark loads every entry into a buffer allocated up front, what an upload buffer mapped
+// for good is in the game: the loose file from DIR opened and read into it, and from each archive,
+// mapped once, every payload prefetched and then read into it by asset_entry_read() on every core.
+// It times that from disk to the buffer, then checks every payload's hash, and a cooked mesh's
+// validity, against the first. Cold by default, every file dropped from the page cache before each
+// run. Give the same files packed raw and compressed to compare them.
+// It also opens the first archive and looks up every id without reading a payload, then counts how
+// many of its pages that brought in.
+
+#define _GNU_SOURCE
+#include "../source/threading.c"
+#include "../source/job_system.c"
+
+#include <errno.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stddef.h>
+#include <stdio.h>
+#include <string.h>
+
+#define VERTEX_FORMAT_NO_INPUT_LAYOUT 1
+#include "../source/vecmath.c"
+#include "../source/vertex_format.c"
+#include "../source/mesh_blob.c"
+#include "../source/lz_block.c"
+#include "../source/asset_archive.c"
+
+#define PACK_MIN_SAVING 16 // a payload is stored compressed when that saves a sixteenth of it
+
+_Noreturn static void fail(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fputs("asset_packer: ", stderr);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+	exit(1);
+}
+
+static void* allocate(size_t count, size_t size)
+{
+	void* memory = calloc(count ? count : 1, size);
+	if (!memory) fail("out of memory");
+	return memory;
+}
+
+static uint8_t* read_file(const char* path, uint64_t* size)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file) fail("cannot open %s: %s", path, strerror(errno));
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (length < 0) fail("cannot read %s", path);
+	uint8_t* data = allocate((size_t)length, 1);
+	if (fread(data, 1, (size_t)length, file) != (size_t)length) fail("cannot read %s", path);
+	fclose(file);
+	*size = (uint64_t)length;
+	return data;
+}
+
+static bool ends_with(const char* string, const char* suffix)
+{
+	size_t length = strlen(string), suffix_length = strlen(suffix);
+	return length >= suffix_length && !strcmp(string + length - suffix_length, suffix);
+}
+
+struct input
+{
+	char name[ASSET_ARCHIVE_MAX_NAME];
+	uint64_t id;
+	uint8_t* data;
+	uint64_t size;
+	uint8_t* stored; // data unless compressed
+	uint64_t stored_size;
+	struct asset_block* blocks; // NULL unless compressed
+	uint32_t block_count;
+};
+
+static int input_compare(const void* a, const void* b)
+{
+	uint64_t x = ((const struct input*)a)->id, y = ((const struct input*)b)->id;
+	return x < y ? -1 : x > y;
+}
+
+static uint64_t align_up(uint64_t value, uint64_t alignment) { return (value + alignment - 1) / alignment * alignment; }
+
+struct compression
+{
+	const struct input* input;
+	uint32_t block_size;
+	uint8_t** blocks; // each block's compressed bytes, NULL when it would not shrink
+	uint32_t* sizes;
+};
+
+static void compress_blocks(void* data, uint32_t begin, uint32_t end)
+{
+	struct compression* compression = data;
+	for (uint32_t b = begin; b < end; ++b) {
+		uint64_t at = (uint64_t)b * compression->block_size;
+		size_t size = (size_t)(compression->input->size - at < compression->block_size ? compression->input->size - at : compression->block_size);
+		compression->blocks[b] = allocate(size, 1);
+		compression->sizes[b] = (uint32_t)lz_compress(compression->input->data + at, size, compression->blocks[b], size - 1);
+		if (!compression->sizes[b]) {
+			free(compression->blocks[b]);
+			compression->blocks[b] = NULL;
+			compression->sizes[b] = (uint32_t)size;
+		}
+	}
+}
+
+// Stores the input in compressed blocks of block_size when it has a block or more and that saves
+// enough, as it is otherwise.
+static void compress_input(struct input* input, uint32_t block_size)
+{
+	input->stored = input->data;
+	input->stored_size = input->size;
+	if (!block_size || input->size < block_size) return;
+	uint32_t count = (uint32_t)((input->size + block_size - 1) / block_size);
+	struct compression compression = {
+		.input = input,
+		.block_size = block_size,
+		.blocks = allocate(count, sizeof(uint8_t*)),
+		.sizes = allocate(count, sizeof(uint32_t)),
+	};
+	job_parallel_for(count, 1, compress_blocks, &compression);
+	uint64_t stored_size = 0;
+	for (uint32_t b = 0; b < count; ++b) stored_size += compression.sizes[b];
+	if (stored_size <= input->size - input->size / PACK_MIN_SAVING) {
+		input->stored = allocate(stored_size, 1);
+		input->blocks = allocate(count, sizeof(struct asset_block));
+		input->block_count = count;
+		uint64_t offset = 0;
+		for (uint32_t b = 0; b < count; ++b) {
+			input->blocks[b] = (struct asset_block){(uint32_t)offset, compression.sizes[b]};
+			memcpy(input->stored + offset, compression.blocks[b] ? compression.blocks[b] : input->data + (uint64_t)b * block_size, compression.sizes[b]);
+			offset += compression.sizes[b];
+		}
+		input->stored_size = stored_size;
+	}
+	for (uint32_t b = 0; b < count; ++b) free(compression.blocks[b]);
+	free(compression.blocks);
+	free(compression.sizes);
+}
+
+static void pack(const char* output, const char* root, char** files, uint32_t count, uint32_t block_size)
+{
+	struct input* inputs = allocate(count, sizeof(struct input));
+	for (uint32_t i = 0; i < count; ++i) {
+		struct input* input = &inputs[i];
+		size_t length = strlen(files[i]);
+		if (length >= ASSET_ARCHIVE_MAX_NAME) fail("%s: names are shorter than %u bytes", files[i], ASSET_ARCHIVE_MAX_NAME);
+		for (size_t c = 0; c <= length; ++c) input->name[c] = files[i][c] == '\\' ? '/' : files[i][c];
+		input->id = asset_id(input->name);
+		char path[4096];
+		if (snprintf(path, sizeof(path), "%s/%s", root, input->name) >= (int)sizeof(path)) fail("%s: path too long", input->name);
+		input->data = read_file(path, &input->size);
+		compress_input(input, block_size);
+	}
+	qsort(inputs, count, sizeof(struct input), input_compare);
+	for (uint32_t i = 1; i < count; ++i)
+		if (inputs[i].id == inputs[i - 1].id) fail("%s and %s have the same id, rename one", inputs[i - 1].name, inputs[i].name);
+
+	// header, table, names, block tables, then the payloads a page apart
+	uint64_t entries_offset = sizeof(struct asset_archive_header);
+	uint64_t names_offset = entries_offset + (uint64_t)count * sizeof(struct asset_entry);
+	uint64_t offset = names_offset;
+	for (uint32_t i = 0; i < count; ++i) offset += strlen(inputs[i].name) + 1;
+	uint64_t* block_offsets = allocate(count, sizeof(uint64_t));
+	offset = align_up(offset, _Alignof(struct asset_block));
+	for (uint32_t i = 0; i < count; ++i) {
+		block_offsets[i] = offset;
+		offset += (uint64_t)inputs[i].block_count * sizeof(struct asset_block);
+	}
+	uint64_t* data_offsets = allocate(count, sizeof(uint64_t));
+	uint64_t payload_bytes = 0, stored_bytes = 0;
+	uint32_t compressed = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		data_offsets[i] = offset = align_up(offset, ASSET_ARCHIVE_ALIGNMENT);
+		offset += inputs[i].stored_size;
+		payload_bytes += inputs[i].size;
+		stored_bytes += inputs[i].stored_size;
+		compressed += inputs[i].blocks != NULL;
+	}
+	uint64_t file_size = offset;
+
+	uint8_t* archive = allocate(file_size, 1);
+	struct asset_archive_header* header = (struct asset_archive_header*)archive;
+	*header = (struct asset_archive_header){
+		.magic = ASSET_ARCHIVE_MAGIC,
+		.version = ASSET_ARCHIVE_VERSION,
+		.file_size = file_size,
+		.entry_count = count,
+		.entries = {count ? (int64_t)(entries_offset - offsetof(struct asset_archive_header, entries)) : 0},
+		.payload_bytes = payload_bytes,
+		.stored_bytes = stored_bytes,
+	};
+	struct asset_entry* entries = (struct asset_entry*)(archive + entries_offset);
+	uint64_t name_offset = names_offset;
+	for (uint32_t i = 0; i < count; ++i) {
+		uint64_t at = entries_offset + i * sizeof(struct asset_entry);
+		uint32_t name_length = (uint32_t)strlen(inputs[i].name);
+		entries[i] = (struct asset_entry){
+			.id = inputs[i].id,
+			.hash = asset_hash(inputs[i].data, inputs[i].size),
+			.data = {(int64_t)data_offsets[i] - (int64_t)(at + offsetof(struct asset_entry, data))},
+			.size = inputs[i].size,
+			.stored_size = inputs[i].stored_size,
+			.blocks = {inputs[i].blocks ? (int64_t)block_offsets[i] - (int64_t)(at + offsetof(struct asset_entry, blocks)) : 0},
+			.name = {(int64_t)name_offset - (int64_t)(at + offsetof(struct asset_entry, name))},
+			.name_length = name_length,
+			.block_size = inputs[i].blocks ? block_size : 0,
+		};
+		memcpy(archive + name_offset, inputs[i].name, name_length + 1);
+		name_offset += name_length + 1;
+		if (inputs[i].blocks) memcpy(archive + block_offsets[i], inputs[i].blocks, inputs[i].block_count * sizeof(struct asset_block));
+		memcpy(archive + data_offsets[i], inputs[i].stored, inputs[i].stored_size);
+		if (ends_with(inputs[i].name, ".mesh") && !mesh_blob_validate(inputs[i].data, inputs[i].size))
+			fprintf(stderr, "asset_packer: warning: %s is not a valid cooked mesh of version %u\n", inputs[i].name, MESH_BLOB_VERSION);
+		if (inputs[i].stored != inputs[i].data) free(inputs[i].stored);
+		free(inputs[i].blocks);
+		free(inputs[i].data);
+	}
+	if (!asset_archive_validate(archive, file_size)) fail("the archive does not validate");
+
+	// through a temporary file, a running game never maps half an archive
+	char temp[4096];
+	if (snprintf(temp, sizeof(temp), "%s.tmp", output) >= (int)sizeof(temp)) fail("%s: path too long", output);
+	FILE* file = fopen(temp, "wb");
+	if (!file || fwrite(archive, 1, file_size, file) != file_size || fclose(file)) fail("cannot write %s", temp);
+	if (rename(temp, output)) fail("cannot replace %s: %s", output, strerror(errno));
+	printf("wrote %s: %u assets, %u compressed, %.1f KB of payloads stored in %.1f KB, %.1f KB in all\n", output, count, compressed,
+	       (double)payload_bytes / 1024.0, (double)stored_bytes / 1024.0, (double)file_size / 1024.0);
+	free(archive);
+	free(block_offsets);
+	free(data_offsets);
+	free(inputs);
+}
+
+static void list(const char* path)
+{
+	struct asset_archive archive;
+	if (!asset_archive_open(&archive, path)) fail("%s is not a valid archive", path);
+	printf("%-16s %-16s %12s %12s %10s  %s\n", "id", "hash", "bytes", "stored", "offset", "name");
+	uint32_t damaged = 0;
+	for (uint32_t i = 0; i < archive.header->entry_count; ++i) {
+		const struct asset_entry* entry = &archive.entries[i];
+		bool intact = asset_entry_verify(entry);
+		damaged += !intact;
+		printf("%016llx %016llx %12llu %12llu %10llu  %s%s\n", (unsigned long long)entry->id, (unsigned long long)entry->hash, (unsigned long long)entry->size,
+		       (unsigned long long)entry->stored_size, (unsigned long long)((const uint8_t*)asset_entry_data(entry) - archive.view), asset_entry_name(entry),
+		       intact ? "" : "  DAMAGED");
+	}
+	printf("%u assets, %.1f KB of payloads stored in %.1f KB, %.1f KB in all, opened in %.3f ms\n", archive.header->entry_count,
+	       (double)archive.header->payload_bytes / 1024.0, (double)archive.header->stored_bytes / 1024.0, (double)archive.size / 1024.0,
+	       (double)archive.open_ns / 1e6);
+	asset_archive_close(&archive);
+	if (damaged) fail("%u damaged assets", damaged);
+}
+
+// Written back and dropped from the page cache, the next read comes from the disk.
+static void drop_cached(const char* path)
+{
+	int file = open(path, O_RDONLY);
+	if (file < 0) fail("cannot open %s: %s", path, strerror(errno));
+	fdatasync(file);
+	posix_fadvise(file, 0, 0, POSIX_FADV_DONTNEED);
+	close(file);
+}
+
+// What the game does with an asset once it has its bytes.
+static uint64_t use_asset(const char* name, const void* data, uint64_t size)
+{
+	uint64_t hash = asset_hash(data, size);
+	if (ends_with(name, ".mesh") && !mesh_blob_validate(data, size)) fail("%s is not a valid cooked mesh", name);
+	return hash;
+}
+
+static int double_compare(const void* a, const void* b)
+{
+	double x = *(const double*)a, y = *(const double*)b;
+	return x < y ? -1 : x > y;
+}
+
+struct archive_load
+{
+	const struct asset_entry** found;
+	uint8_t* buffer;
+	const uint64_t* offsets;
+};
+
+static void load_entries(void* data, uint32_t begin, uint32_t end)
+{
+	struct archive_load* load = data;
+	for (uint32_t i = begin; i < end; ++i)
+		if (!asset_entry_read(load->found[i], load->buffer + load->offsets[i])) fail("%s is damaged", asset_entry_name(load->found[i]));
+}
+
+static void bench(char** paths, uint32_t path_count, const char* root, uint32_t runs, bool cold)
+{
+	struct asset_archive archive;
+	if (!asset_archive_open(&archive, paths[0])) fail("%s is not a valid archive", paths[0]);
+	uint32_t count = archive.header->entry_count;
+	char (*loose)[4096] = allocate(count, sizeof(*loose));
+	char (*names)[ASSET_ARCHIVE_MAX_NAME] = allocate(count, sizeof(*names)); // the archive is reopened per run
+	uint64_t* sizes = allocate(count, sizeof(uint64_t));
+	uint64_t* offsets = allocate(count, sizeof(uint64_t)); // in the buffer
+	uint64_t buffer_size = 0;
+	for (uint32_t i = 0; i < count; ++i) {
+		memcpy(names[i], asset_entry_name(&archive.entries[i]), archive.entries[i].name_length + 1);
+		if (snprintf(loose[i], sizeof(loose[i]), "%s/%s", root, names[i]) >= (int)sizeof(loose[i])) fail("%s: path too long", names[i]);
+		sizes[i] = archive.entries[i].size;
+		offsets[i] = buffer_size;
+		buffer_size = align_up(buffer_size + sizes[i], 256);
+	}
+	uint64_t payload_bytes = archive.header->payload_bytes;
+	uint64_t file_size = archive.size;
+	asset_archive_close(&archive);
+	// written the way a mapped upload buffer is, its pages already there
+	uint8_t* buffer = allocate(buffer_size, 1);
+	memset(buffer, 1, buffer_size);
+
+	printf("%u assets, %.1f KB, %s, %u threads, %u runs, median ms\n", count, (double)payload_bytes / 1024.0, cold ? "cold page cache" : "warm page cache",
+	       job_thread_count(), runs);
+	uint32_t method_count = path_count + 2; // loose, the archives, startup
+	double* times = allocate((size_t)method_count * runs, sizeof(double));
+	uint64_t* read_bytes = allocate(method_count, sizeof(uint64_t));
+	read_bytes[0] = payload_bytes;
+	const struct asset_entry** found = allocate(count, sizeof(*found));
+	size_t page = (size_t)sysconf(_SC_PAGESIZE);
+	size_t pages = (file_size + page - 1) / page;
+	unsigned char* resident = allocate(pages, 1);
+	size_t startup_pages = 0;
+	for (uint32_t run = 0; run < runs; ++run) {
+		// loose: open, size, read and close each file
+		if (cold)
+			for (uint32_t i = 0; i < count; ++i) drop_cached(loose[i]);
+		memset(buffer, 0, buffer_size);
+		uint64_t begin = time_now_ns();
+		for (uint32_t i = 0; i < count; ++i) {
+			int file = open(loose[i], O_RDONLY);
+			struct stat status;
+			if (file < 0 || fstat(file, &status)) fail("cannot open %s: %s", loose[i], strerror(errno));
+			if ((uint64_t)status.st_size != sizes[i]) fail("%s differs from the archive", loose[i]);
+			for (ssize_t done = 0; done < status.st_size;) {
+				ssize_t got = read(file, buffer + offsets[i] + done, (size_t)(status.st_size - done));
+				if (got <= 0) fail("cannot read %s", loose[i]);
+				done += got;
+			}
+			close(file);
+		}
+		times[run] = (double)(time_now_ns() - begin) / 1e6;
+		uint64_t expected = 0;
+		for (uint32_t i = 0; i < count; ++i) expected ^= use_asset(names[i], buffer + offsets[i], sizes[i]);
+
+		// archives: one open, every asset found by id, asked for, then read into the buffer
+		for (uint32_t a = 0; a < path_count; ++a) {
+			if (cold) drop_cached(paths[a]);
+			memset(buffer, 0, buffer_size);
+			begin = time_now_ns();
+			if (!asset_archive_open(&archive, paths[a])) fail("%s is not a valid archive", paths[a]);
+			for (uint32_t i = 0; i < count; ++i) {
+				found[i] = asset_archive_find(&archive, asset_id(names[i]));
+				if (!found[i] || found[i]->size != sizes[i]) fail("%s is missing from %s", names[i], paths[a]);
+				asset_archive_prefetch(found[i]);
+			}
+			job_parallel_for(count, 1, load_entries, &(struct archive_load){found, buffer, offsets});
+			read_bytes[a + 1] = archive.header->stored_bytes;
+			asset_archive_close(&archive);
+			times[(a + 1) * runs + run] = (double)(time_now_ns() - begin) / 1e6;
+			uint64_t check = 0;
+			for (uint32_t i = 0; i < count; ++i) check ^= use_asset(names[i], buffer + offsets[i], sizes[i]);
+			if (check != expected) fail("the payloads of %s differ from the loose files", paths[a]);
+		}
+	}
+	// startup alone, always cold: open and look everything up, then see which pages that read
+	double* startup = times + (size_t)(path_count + 1) * runs;
+	for (uint32_t run = 0; run < runs; ++run) {
+		drop_cached(paths[0]);
+		uint64_t begin = time_now_ns();
+		if (!asset_archive_open(&archive, paths[0])) fail("%s is not a valid archive", paths[0]);
+		uint32_t hits = 0;
+		for (uint32_t i = 0; i < count; ++i) hits += asset_archive_find(&archive, asset_id(names[i])) != NULL;
+		startup[run] = (double)(time_now_ns() - begin) / 1e6;
+		if (hits != count || mincore((void*)archive.view, (size_t)archive.size, resident)) fail("lookup failed");
+		startup_pages = 0;
+		for (size_t p = 0; p < pages; ++p) startup_pages += resident[p] & 1;
+		asset_archive_close(&archive);
+	}
+	printf("%-34s %9s  %12s  %s\n", "disk to buffer", "ms", "payload MB/s", "MB read");
+	for (uint32_t m = 0; m < method_count; ++m) {
+		qsort(times + (size_t)m * runs, runs, sizeof(double), double_compare);
+		double median = times[(size_t)m * runs + runs / 2];
+		char label[64];
+		if (m == 0)
+			snprintf(label, sizeof(label), "loose files");
+		else if (m <= path_count)
+			snprintf(label, sizeof(label), "%.26s, %.0f%% stored", strrchr(paths[m - 1], '/') ? strrchr(paths[m - 1], '/') + 1 : paths[m - 1],
+				 100.0 * (double)read_bytes[m] / (double)payload_bytes);
+		if (m <= path_count)
+			printf("%-34s %9.3f  %12.1f  %.1f\n", label, median, median > 0.0 ? (double)payload_bytes / (1024.0 * 1024.0) / (median / 1e3) : 0.0,
+			       (double)read_bytes[m] / (1024.0 * 1024.0));
+		else
+			printf("%-34s %9.3f  %zu of %zu pages resident (cold)\n", "archive open and lookups", median, startup_pages, pages);
+	}
+	free(resident);
+	free(found);
+	free(read_bytes);
+	free(times);
+	free(buffer);
+	free(offsets);
+	free(sizes);
+	free(names);
+	free(loose);
+}
+
+int main(int argc, char** argv)
+{
+	const char* root = ".";
+	bool listing = false, benchmark = false, cold = true, compress = false;
+	uint32_t runs = 5;
+	uint32_t block_kib = 128;
+	int first = 1;
+	for (; first < argc && argv[first][0] == '-'; ++first) {
+		if (!strcmp(argv[first], "--root") && first + 1 < argc) {
+			root = argv[++first];
+		} else if (!strcmp(argv[first], "--list")) {
+			listing = true;
+		} else if (!strcmp(argv[first], "--bench")) {
+			benchmark = true;
+		} else if (!strcmp(argv[first], "--warm")) {
+			cold = false;
+		} else if (!strcmp(argv[first], "--compress")) {
+			compress = true;
+		} else if (!strcmp(argv[first], "--block-size") && first + 1 < argc) {
+			block_kib = (uint32_t)strtoul(argv[++first], NULL, 10);
+			if (block_kib * 1024u < ASSET_BLOCK_MIN || block_kib * 1024u > ASSET_BLOCK_MAX)
+				fail("blocks are %u to %u KiB", ASSET_BLOCK_MIN / 1024u, ASSET_BLOCK_MAX / 1024u);
+		} else if (!strcmp(argv[first], "--runs") && first + 1 < argc) {
+			runs = (uint32_t)strtoul(argv[++first], NULL, 10);
+			if (runs == 0) fail("at least one run");
+		} else {
+			first = argc;
+			break;
+		}
+	}
+	int remaining = argc - first;
+	if (!job_system_init(0)) fail("cannot start the workers");
+	if (listing && remaining == 1 && !benchmark) {
+		list(argv[first]);
+	} else if (benchmark && remaining >= 1 && !listing) {
+		bench(argv + first, (uint32_t)remaining, root, runs, cold);
+	} else if (!listing && !benchmark && remaining >= 2) {
+		pack(argv[first], root, argv + first + 1, (uint32_t)(remaining - 1), compress ? block_kib * 1024u : 0);
+	} else {
+		fprintf(stderr, "usage: asset_packer [--root DIR] [--compress [--block-size KiB]] output.pak file...\n"
+				"       asset_packer --list archive.pak\n"
+				"       asset_packer --bench [--runs N] [--warm] [--root DIR] archive.pak...\n");
+		return 1;
+	}
+	job_system_shutdown();
+	return 0;
+}
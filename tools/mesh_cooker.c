@@ -0,0 +1,2160 @@
+// Offline mesh cooker: reads an OBJ or glTF 2.0 (.gltf, .glb) mesh and writes the mesh_blob.c file
+// mesh_load_cooked() uploads as it is. Plain C11 without Windows, it builds and runs on Linux:
+//   cc -std=c11 -O2 -o mesh_cooker tools/mesh_cooker.c -lm
+//   mesh_cooker [--format FLOAT4|FLOAT3|SNORM16|HALF] [--cache N] [--no-overdraw] [--threshold T]
+//               [--lods N] [--lod-ratio R] [--lod-error E] [--attribute-weight W] in out
+// The steps, each reported with the ACMR and ATVR (post-transform cache misses per triangle and per
+// vertex, a FIFO cache of --cache entries), the vertex fetch overfetch and the overdraw:
+//   weld      identical vertices become one, degenerate triangles are dropped
+//   lods      up to --lods levels of detail (8), each --lod-ratio (0.5) of the triangles of the one
+//             before, by quadric error edge collapses; the chain stops where a collapse's error, or
+//             the level's measured distance from the full surface, relative to the bounding radius,
+//             would pass --lod-error (0.05). Normals and colors count --attribute-weight (0.05) as
+//             much as the position. Every level's measured distance goes into the file for the
+//             runtime's selection
+//   tipsify   triangle order for the post-transform cache, Sander, Nehab and Barczak 2007
+//   overdraw  that order cut into clusters, sorted to draw outward facing ones first, giving up at
+//             most --threshold times each cluster's ACMR for the cuts
+//   meshlets  that order regrouped into meshlets of 64 vertices and 124 triangles, grown greedily
+//             from the last one's border by shared vertices, normal spread and distance; sorted
+//             outward facing first again. Their spheres and normal cones are measured on the
+//             quantized positions, and the cones checked against front facing triangles
+//   fetch    vertices renumbered in order of first use, so fetches walk the buffer forward
+// Tipsify and overdraw run per level, the table shows the full one and a summary of the levels.
+// OBJ: v (with optional r g b), vn and f, any polygon fanned, negative indices. glTF: the triangle
+// primitives of the default scene's nodes with their transforms, of every mesh without scenes;
+// POSITION, NORMAL and COLOR_0 from the .glb, data URIs or files next to the .gltf. Missing normals
+// are smoothed over the faces around each OBJ position, flat for glTF as its specification asks.
+
+#include <errno.h>
+#include <float.h>
+#include <math.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+#include <time.h>
+
+#define VERTEX_FORMAT_NO_INPUT_LAYOUT 1
+#include "../source/vecmath.c"
+#include "../source/vertex_format.c"
+#include "../source/mesh_blob.c"
+
+#define NONE UINT32_MAX
+#define FETCH_LINE_BYTES 64
+#define FETCH_CACHE_LINES 64 // 4 KB, a vertex fetch cache's share
+#define OVERDRAW_GRID 256
+#define MESHLET_CONE_WEIGHT 0.5f     // of a candidate triangle's normal spread from the meshlet's, against one more vertex
+#define MESHLET_DISTANCE_WEIGHT 0.25f // of its distance from the center, over the meshlet's radius
+#define MESHLET_LIVE_WEIGHT 0.05f     // of the triangles left around its vertices
+
+_Noreturn static void fail(const char* format, ...)
+{
+	va_list args;
+	va_start(args, format);
+	fputs("mesh_cooker: ", stderr);
+	vfprintf(stderr, format, args);
+	fputc('\n', stderr);
+	va_end(args);
+	exit(1);
+}
+
+static void* allocate(size_t count, size_t size)
+{
+	void* memory = calloc(count ? count : 1, size);
+	if (!memory) fail("out of memory");
+	return memory;
+}
+
+// Doubles *capacity until count more fit.
+static void* grow(void* array, uint32_t* capacity, uint32_t used, uint32_t count, size_t size)
+{
+	if (used + count <= *capacity) return array;
+	uint32_t wanted = *capacity ? *capacity : 1024;
+	while (wanted < used + count) wanted *= 2;
+	array = realloc(array, (size_t)wanted * size);
+	if (!array) fail("out of memory");
+	*capacity = wanted;
+	return array;
+}
+
+static double seconds(void)
+{
+	struct timespec now;
+	timespec_get(&now, TIME_UTC);
+	return (double)now.tv_sec + (double)now.tv_nsec / 1e9;
+}
+
+static uint8_t* read_file(const char* path, uint64_t* size)
+{
+	FILE* file = fopen(path, "rb");
+	if (!file) fail("cannot open %s: %s", path, strerror(errno));
+	fseek(file, 0, SEEK_END);
+	long length = ftell(file);
+	fseek(file, 0, SEEK_SET);
+	if (length < 0) fail("cannot read %s", path);
+	uint8_t* data = allocate((size_t)length + 1, 1); // terminated, for the text parsers
+	if (fread(data, 1, (size_t)length, file) != (size_t)length) fail("cannot read %s", path);
+	fclose(file);
+	*size = (uint64_t)length;
+	return data;
+}
+
+// Triangles as three corners each, before welding.
+struct corners
+{
+	struct vertex_input* vertices;
+	uint32_t count;
+	uint32_t capacity;
+};
+
+static void add_corner(struct corners* corners, struct vec3 position, struct vec3 normal, struct vec4 color)
+{
+	corners->vertices = grow(corners->vertices, &corners->capacity, corners->count, 1, sizeof(struct vertex_input));
+	struct vertex_input* v = &corners->vertices[corners->count++];
+	memset(v, 0, sizeof(*v));
+	v->position = position;
+	v->normal = normal; // zero when missing
+	v->color = color;
+}
+
+// Fills the normals left zero: the area weighted face normals summed per position id, or the
+// triangle's own without ids.
+static void generate_normals(struct corners* corners, const uint32_t* position_ids, uint32_t position_count)
+{
+	struct vec3* sums = position_ids ? allocate(position_count, sizeof(struct vec3)) : NULL;
+	for (int pass = position_ids ? 0 : 1; pass < 2; ++pass) {
+		for (uint32_t t = 0; t + 2 < corners->count; t += 3) {
+			struct vertex_input* v = &corners->vertices[t];
+			struct vec3 face = vec3_cross(vec3_sub(v[1].position, v[0].position), vec3_sub(v[2].position, v[0].position));
+			for (uint32_t k = 0; k < 3; ++k) {
+				if (pass == 0) sums[position_ids[t + k]] = vec3_add(sums[position_ids[t + k]], face);
+				else if (vec3_dot(v[k].normal, v[k].normal) == 0.0f) v[k].normal = vec3_normalize(position_ids ? sums[position_ids[t + k]] : face);
+			}
+		}
+	}
+	free(sums);
+}
+
+// OBJ
+
+static const char* skip_spaces(const char* p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r') ++p;
+	return p;
+}
+
+// A 1-based or negative OBJ index into count elements, NONE when absent.
+static uint32_t obj_index(const char** p, uint32_t count, uint32_t line)
+{
+	char* end;
+	long index = strtol(*p, &end, 10);
+	if (end == *p) return NONE;
+	*p = end;
+	long resolved = index < 0 ? (long)count + index : index - 1;
+	if (resolved < 0 || resolved >= (long)count) fail("line %u: index %ld out of range", line, index);
+	return (uint32_t)resolved;
+}
+
+static void load_obj(const char* text, struct corners* corners)
+{
+	struct vec3* positions = NULL;
+	struct vec4* colors = NULL;
+	struct vec3* normals = NULL;
+	uint32_t* position_ids = NULL;
+	uint32_t position_count = 0, position_capacity = 0, color_capacity = 0;
+	uint32_t normal_count = 0, normal_capacity = 0, id_capacity = 0;
+	bool missing_normals = false;
+
+	uint32_t line = 1;
+	for (const char* p = text; *p; ++line) {
+		p = skip_spaces(p);
+		if (p[0] == 'v' && (p[1] == ' ' || p[1] == '\t')) {
+			float values[6] = {0.0f, 0.0f, 0.0f, 1.0f, 1.0f, 1.0f};
+			char* end = (char*)p + 1;
+			int read = 0;
+			for (; read < 6; ++read) {
+				const char* start = skip_spaces(end);
+				float value = strtof(start, &end);
+				if (end == start) break;
+				values[read] = value;
+			}
+			if (read < 3) fail("line %u: a vertex needs three coordinates", line);
+			positions = grow(positions, &position_capacity, position_count, 1, sizeof(struct vec3));
+			colors = grow(colors, &color_capacity, position_count, 1, sizeof(struct vec4));
+			positions[position_count] = vec3_make(values[0], values[1], values[2]);
+			colors[position_count++] = vec4_make(values[3], values[4], values[5], 1.0f);
+		} else if (p[0] == 'v' && p[1] == 'n') {
+			char* end = (char*)p + 2;
+			float values[3];
+			for (int i = 0; i < 3; ++i) values[i] = strtof(end, &end);
+			normals = grow(normals, &normal_capacity, normal_count, 1, sizeof(struct vec3));
+			normals[normal_count++] = vec3_normalize(vec3_make(values[0], values[1], values[2]));
+		} else if (p[0] == 'f' && (p[1] == ' ' || p[1] == '\t')) {
+			// fanned from the first corner
+			uint32_t face_positions[3], face_normals[3];
+			uint32_t corner = 0;
+			p += 1;
+			for (;;) {
+				p = skip_spaces(p);
+				uint32_t position = obj_index(&p, position_count, line);
+				if (position == NONE) break;
+				uint32_t normal = NONE;
+				if (*p == '/') {
+					++p;
+					if (*p != '/') strtol(p, (char**)&p, 10); // texture coordinates, not used
+					if (*p == '/') {
+						++p;
+						normal = obj_index(&p, normal_count, line);
+					}
+				}
+				while (*p && *p != ' ' && *p != '\t' && *p != '\r' && *p != '\n') ++p;
+				if (corner >= 3) {
+					face_positions[1] = face_positions[2];
+					face_normals[1] = face_normals[2];
+				}
+				uint32_t slot = corner < 2 ? corner : 2;
+				face_positions[slot] = position;
+				face_normals[slot] = normal;
+				if (++corner < 3) continue;
+				position_ids = grow(position_ids, &id_capacity, corners->count, 3, sizeof(uint32_t));
+				for (uint32_t k = 0; k < 3; ++k) {
+					position_ids[corners->count] = face_positions[k];
+					missing_normals |= face_normals[k] == NONE;
+					add_corner(corners, positions[face_positions[k]], face_normals[k] == NONE ? vec3_make(0.0f, 0.0f, 0.0f) : normals[face_normals[k]],
+						   colors[face_positions[k]]);
+				}
+			}
+		}
+		while (*p && *p != '\n') ++p;
+		if (*p) ++p;
+	}
+	if (missing_normals) generate_normals(corners, position_ids, position_count);
+	free(positions);
+	free(colors);
+	free(normals);
+	free(position_ids);
+}
+
+// JSON, as much as glTF needs: a tree of values in one array, strings left unescaped in the text.
+
+enum json_type
+{
+	JSON_NULL,
+	JSON_BOOL,
+	JSON_NUMBER,
+	JSON_STRING,
+	JSON_ARRAY,
+	JSON_OBJECT,
+};
+
+struct json_value
+{
+	enum json_type type;
+	uint32_t first; // first element or member
+	uint32_t next;  // next sibling
+	uint32_t count;
+	const char* key; // as a member of an object
+	uint32_t key_length;
+	uint32_t length;
+	const char* string;
+	double number;
+};
+
+struct json
+{
+	struct json_value* values;
+	uint32_t count;
+	uint32_t capacity;
+	const char* p;
+};
+
+static const char* json_skip(const char* p)
+{
+	while (*p == ' ' || *p == '\t' || *p == '\r' || *p == '\n') ++p;
+	return p;
+}
+
+static const char* json_string_end(const char* p)
+{
+	for (; *p != '"'; ++p) {
+		if (!*p) fail("unterminated JSON string");
+		if (*p == '\\' && p[1]) ++p;
+	}
+	return p;
+}
+
+static uint32_t json_parse(struct json* json, uint32_t depth)
+{
+	if (depth > 64) fail("JSON nested too deeply");
+	json->values = grow(json->values, &json->capacity, json->count, 1, sizeof(struct json_value));
+	uint32_t index = json->count++;
+	memset(&json->values[index], 0, sizeof(json->values[index]));
+	json->values[index].first = NONE;
+	json->values[index].next = NONE;
+
+	const char* p = json_skip(json->p);
+	if (*p == '{' || *p == '[') {
+		bool object = *p == '{';
+		char close = object ? '}' : ']';
+		json->values[index].type = object ? JSON_OBJECT : JSON_ARRAY;
+		p = json_skip(p + 1);
+		uint32_t last = NONE;
+		while (*p != close) {
+			const char* key = NULL;
+			uint32_t key_length = 0;
+			if (object) {
+				if (*p != '"') fail("JSON object key expected");
+				key = p + 1;
+				p = json_string_end(key);
+				key_length = (uint32_t)(p - key);
+				p = json_skip(p + 1);
+				if (*p != ':') fail("JSON ':' expected");
+				++p;
+			}
+			json->p = p;
+			uint32_t child = json_parse(json, depth + 1);
+			json->values[child].key = key;
+			json->values[child].key_length = key_length;
+			if (last == NONE) json->values[index].first = child;
+			else json->values[last].next = child;
+			last = child;
+			json->values[index].count++;
+			p = json_skip(json->p);
+			if (*p == ',') p = json_skip(p + 1);
+			else if (*p != close) fail("JSON ',' or '%c' expected", close);
+		}
+		json->p = p + 1;
+	} else if (*p == '"') {
+		json->values[index].type = JSON_STRING;
+		json->values[index].string = p + 1;
+		const char* end = json_string_end(p + 1);
+		json->values[index].length = (uint32_t)(end - (p + 1));
+		json->p = end + 1;
+	} else if (!strncmp(p, "true", 4) || !strncmp(p, "false", 5)) {
+		json->values[index].type = JSON_BOOL;
+		json->values[index].number = *p == 't';
+		json->p = p + (*p == 't' ? 4 : 5);
+	} else if (!strncmp(p, "null", 4)) {
+		json->p = p + 4;
+	} else {
+		char* end;
+		json->values[index].type = JSON_NUMBER;
+		json->values[index].number = strtod(p, &end);
+		if (end == p) fail("JSON value expected");
+		json->p = end;
+	}
+	return index;
+}
+
+static uint32_t json_member(const struct json* json, uint32_t object, const char* key)
+{
+	if (object == NONE || json->values[object].type != JSON_OBJECT) return NONE;
+	size_t length = strlen(key);
+	for (uint32_t i = json->values[object].first; i != NONE; i = json->values[i].next)
+		if (json->values[i].key_length == length && !memcmp(json->values[i].key, key, length)) return i;
+	return NONE;
+}
+
+static uint32_t json_element(const struct json* json, uint32_t array, uint32_t n)
+{
+	if (array == NONE || json->values[array].type != JSON_ARRAY) return NONE;
+	uint32_t i = json->values[array].first;
+	while (i != NONE && n--) i = json->values[i].next;
+	return i;
+}
+
+static double json_number(const struct json* json, uint32_t value, double fallback)
+{
+	return value != NONE && (json->values[value].type == JSON_NUMBER || json->values[value].type == JSON_BOOL) ? json->values[value].number : fallback;
+}
+
+static bool json_is(const struct json* json, uint32_t value, const char* string)
+{
+	return value != NONE && json->values[value].type == JSON_STRING && json->values[value].length == strlen(string) &&
+	       !memcmp(json->values[value].string, string, json->values[value].length);
+}
+
+// glTF
+
+struct gltf
+{
+	struct json json;
+	uint32_t root;
+	uint8_t** buffers;
+	uint64_t* buffer_sizes;
+	uint32_t buffer_count;
+};
+
+static uint8_t* base64_decode(const char* text, uint32_t length, uint64_t* size)
+{
+	uint8_t* data = allocate(length / 4 * 3 + 3, 1);
+	uint32_t bits = 0, bit_count = 0;
+	*size = 0;
+	for (uint32_t i = 0; i < length && text[i] != '='; ++i) {
+		char c = text[i];
+		int value = c >= 'A' && c <= 'Z' ? c - 'A' : c >= 'a' && c <= 'z' ? c - 'a' + 26 : c >= '0' && c <= '9' ? c - '0' + 52 : c == '+' ? 62 : c == '/' ? 63 : -1;
+		if (value < 0) fail("bad base64 in a data URI");
+		bits = bits << 6 | (uint32_t)value;
+		bit_count += 6;
+		if (bit_count >= 8) {
+			bit_count -= 8;
+			data[(*size)++] = (uint8_t)(bits >> bit_count);
+		}
+	}
+	return data;
+}
+
+static void gltf_load_buffers(struct gltf* gltf, const char* path, uint8_t* glb_chunk, uint64_t glb_size)
+{
+	const struct json* json = &gltf->json;
+	uint32_t buffers = json_member(json, gltf->root, "buffers");
+	gltf->buffer_count = buffers == NONE ? 0 : json->values[buffers].count;
+	gltf->buffers = allocate(gltf->buffer_count, sizeof(uint8_t*));
+	gltf->buffer_sizes = allocate(gltf->buffer_count, sizeof(uint64_t));
+	for (uint32_t i = 0; i < gltf->buffer_count; ++i) {
+		uint32_t buffer = json_element(json, buffers, i);
+		uint32_t uri = json_member(json, buffer, "uri");
+		if (uri == NONE) {
+			if (i != 0 || !glb_chunk) fail("buffer %u has no data", i);
+			gltf->buffers[i] = glb_chunk;
+			gltf->buffer_sizes[i] = glb_size;
+			continue;
+		}
+		const char* text = json->values[uri].string;
+		uint32_t length = json->values[uri].length;
+		if (length > 5 && !memcmp(text, "data:", 5)) {
+			const char* comma = memchr(text, ',', length);
+			if (!comma || comma - text < 7 || memcmp(comma - 7, ";base64", 7)) fail("buffer %u: only base64 data URIs", i);
+			gltf->buffers[i] = base64_decode(comma + 1, length - (uint32_t)(comma + 1 - text), &gltf->buffer_sizes[i]);
+		} else {
+			// next to the .gltf
+			const char* slash = strrchr(path, '/');
+			const char* backslash = strrchr(path, '\\');
+			if (backslash > slash) slash = backslash;
+			size_t directory = slash ? (size_t)(slash - path + 1) : 0;
+			char* file = allocate(directory + length + 1, 1);
+			memcpy(file, path, directory);
+			memcpy(file + directory, text, length);
+			gltf->buffers[i] = read_file(file, &gltf->buffer_sizes[i]);
+			free(file);
+		}
+		if (gltf->buffer_sizes[i] < (uint64_t)json_number(json, json_member(json, buffer, "byteLength"), 0)) fail("buffer %u is short", i);
+	}
+}
+
+// Reads an accessor as floats, components per element (padding with 0 and w with 1), normalized
+// integers as their spec says. Returns the element count.
+static uint32_t gltf_read(const struct gltf* gltf, uint32_t index, uint32_t components, float** out)
+{
+	const struct json* json = &gltf->json;
+	uint32_t accessor = json_element(json, json_member(json, gltf->root, "accessors"), index);
+	if (accessor == NONE) fail("accessor %u does not exist", index);
+	if (json_member(json, accessor, "sparse") != NONE) fail("accessor %u: sparse accessors are not supported", index);
+	uint32_t count = (uint32_t)json_number(json, json_member(json, accessor, "count"), 0);
+	uint32_t type = json_member(json, accessor, "type");
+	uint32_t element_components = json_is(json, type, "SCALAR") ? 1 : json_is(json, type, "VEC2") ? 2 : json_is(json, type, "VEC3") ? 3 : json_is(json, type, "VEC4") ? 4 : 0;
+	if (!element_components) fail("accessor %u: unsupported type", index);
+	uint32_t component_type = (uint32_t)json_number(json, json_member(json, accessor, "componentType"), 0);
+	uint32_t component_bytes = component_type == 5126 || component_type == 5125 ? 4 : component_type == 5123 || component_type == 5122 ? 2 : 1;
+	bool normalized = json_number(json, json_member(json, accessor, "normalized"), 0) != 0;
+
+	float* values = allocate((size_t)count * components, sizeof(float));
+	for (uint32_t i = 0; i < count; ++i)
+		for (uint32_t c = 0; c < components; ++c) values[i * components + c] = c == 3 ? 1.0f : 0.0f;
+	*out = values;
+	uint32_t view = json_element(json, json_member(json, gltf->root, "bufferViews"), (uint32_t)json_number(json, json_member(json, accessor, "bufferView"), NONE));
+	if (view == NONE) return count; // all zeros
+
+	uint32_t buffer = (uint32_t)json_number(json, json_member(json, view, "buffer"), 0);
+	if (buffer >= gltf->buffer_count) fail("accessor %u: bad buffer", index);
+	uint64_t offset = (uint64_t)json_number(json, json_member(json, view, "byteOffset"), 0) + (uint64_t)json_number(json, json_member(json, accessor, "byteOffset"), 0);
+	uint64_t element_bytes = (uint64_t)component_bytes * element_components;
+	uint64_t stride = (uint64_t)json_number(json, json_member(json, view, "byteStride"), 0);
+	if (!stride) stride = element_bytes;
+	if (count && offset + stride * (count - 1) + element_bytes > gltf->buffer_sizes[buffer]) fail("accessor %u is out of its buffer", index);
+
+	const uint8_t* data = gltf->buffers[buffer] + offset;
+	for (uint32_t i = 0; i < count; ++i) {
+		for (uint32_t c = 0; c < element_components && c < components; ++c) {
+			const uint8_t* p = data + i * stride + c * component_bytes;
+			float value;
+			switch (component_type) {
+			case 5126: memcpy(&value, p, 4); break;
+			case 5125: { uint32_t v; memcpy(&v, p, 4); value = (float)v; } break;
+			case 5123: { uint16_t v; memcpy(&v, p, 2); value = normalized ? (float)v / 65535.0f : (float)v; } break;
+			case 5122: { int16_t v; memcpy(&v, p, 2); value = normalized ? fmaxf((float)v / 32767.0f, -1.0f) : (float)v; } break;
+			case 5121: value = normalized ? (float)p[0] / 255.0f : (float)p[0]; break;
+			case 5120: value = normalized ? fmaxf((float)(int8_t)p[0] / 127.0f, -1.0f) : (float)(int8_t)p[0]; break;
+			default: fail("accessor %u: unsupported component type %u", index, component_type);
+			}
+			values[i * components + c] = value;
+		}
+	}
+	return count;
+}
+
+static void gltf_add_mesh(const struct gltf* gltf, uint32_t mesh_index, const struct mat4* world, struct corners* corners)
+{
+	const struct json* json = &gltf->json;
+	uint32_t mesh = json_element(json, json_member(json, gltf->root, "meshes"), mesh_index);
+	if (mesh == NONE) fail("mesh %u does not exist", mesh_index);
+	// normals by the inverse transpose, right under non-uniform scale
+	struct mat4 inverse = mat4_inverse_affine(world);
+	struct mat4 normal_matrix = mat4_transpose(&inverse);
+	bool mirrored = vec3_dot(vec3_cross(vec4_xyz(world->columns[0]), vec4_xyz(world->columns[1])), vec4_xyz(world->columns[2])) < 0.0f;
+
+	uint32_t primitives = json_member(json, mesh, "primitives");
+	for (uint32_t p = json_element(json, primitives, 0); p != NONE; p = json->values[p].next) {
+		if (json_number(json, json_member(json, p, "mode"), 4) != 4) {
+			fprintf(stderr, "mesh_cooker: mesh %u: skipping a primitive that is not triangles\n", mesh_index);
+			continue;
+		}
+		uint32_t attributes = json_member(json, p, "attributes");
+		uint32_t position_accessor = json_member(json, attributes, "POSITION");
+		if (position_accessor == NONE) fail("mesh %u: a primitive without positions", mesh_index);
+		float* positions;
+		float* normals = NULL;
+		float* colors = NULL;
+		uint32_t count = gltf_read(gltf, (uint32_t)json_number(json, position_accessor, 0), 3, &positions);
+		uint32_t normal_accessor = json_member(json, attributes, "NORMAL");
+		uint32_t color_accessor = json_member(json, attributes, "COLOR_0");
+		if (normal_accessor != NONE && gltf_read(gltf, (uint32_t)json_number(json, normal_accessor, 0), 3, &normals) != count) fail("mesh %u: normal count", mesh_index);
+		if (color_accessor != NONE && gltf_read(gltf, (uint32_t)json_number(json, color_accessor, 0), 4, &colors) != count) fail("mesh %u: color count", mesh_index);
+
+		float* indices = NULL;
+		uint32_t index_accessor = json_member(json, p, "indices");
+		uint32_t index_count = index_accessor != NONE ? gltf_read(gltf, (uint32_t)json_number(json, index_accessor, 0), 1, &indices) : count;
+		for (uint32_t i = 0; i + 2 < index_count; i += 3) {
+			for (uint32_t k = 0; k < 3; ++k) {
+				// mirroring transforms flip the winding back
+				uint32_t corner = i + (mirrored && k ? 3 - k : k);
+				uint32_t v = indices ? (uint32_t)indices[corner] : corner;
+				if (v >= count) fail("mesh %u: index %u out of range", mesh_index, v);
+				struct vec3 position = mat4_transform_point(world, vec3_make(positions[v * 3], positions[v * 3 + 1], positions[v * 3 + 2]));
+				struct vec3 normal = normals ? vec3_normalize(mat4_transform_direction(&normal_matrix, vec3_make(normals[v * 3], normals[v * 3 + 1], normals[v * 3 + 2])))
+							    : vec3_make(0.0f, 0.0f, 0.0f);
+				struct vec4 color = colors ? vec4_make(colors[v * 4], colors[v * 4 + 1], colors[v * 4 + 2], colors[v * 4 + 3]) : vec4_make(1.0f, 1.0f, 1.0f, 1.0f);
+				add_corner(corners, position, normal, color);
+			}
+		}
+		free(positions);
+		free(normals);
+		free(colors);
+		free(indices);
+	}
+}
+
+static void gltf_add_node(const struct gltf* gltf, uint32_t node_index, const struct mat4* parent, uint32_t depth, struct corners* corners)
+{
+	const struct json* json = &gltf->json;
+	uint32_t node = json_element(json, json_member(json, gltf->root, "nodes"), node_index);
+	if (node == NONE || depth > 64) fail("node %u does not exist or the hierarchy has a cycle", node_index);
+	struct mat4 local;
+	uint32_t matrix = json_member(json, node, "matrix");
+	if (matrix != NONE) {
+		// column-major, as mat4 is
+		float* m = &local.columns[0].x;
+		for (uint32_t i = 0; i < 16; ++i) m[i] = (float)json_number(json, json_element(json, matrix, i), i % 5 == 0);
+	} else {
+		uint32_t t = json_member(json, node, "translation");
+		uint32_t r = json_member(json, node, "rotation");
+		uint32_t s = json_member(json, node, "scale");
+		local = mat4_trs(vec3_make((float)json_number(json, json_element(json, t, 0), 0), (float)json_number(json, json_element(json, t, 1), 0), (float)json_number(json, json_element(json, t, 2), 0)),
+				 (struct quat){(float)json_number(json, json_element(json, r, 0), 0), (float)json_number(json, json_element(json, r, 1), 0),
+					       (float)json_number(json, json_element(json, r, 2), 0), (float)json_number(json, json_element(json, r, 3), 1)},
+				 vec3_make((float)json_number(json, json_element(json, s, 0), 1), (float)json_number(json, json_element(json, s, 1), 1), (float)json_number(json, json_element(json, s, 2), 1)));
+	}
+	struct mat4 world = mat4_mul(parent, &local);
+	uint32_t mesh = json_member(json, node, "mesh");
+	if (mesh != NONE) gltf_add_mesh(gltf, (uint32_t)json_number(json, mesh, 0), &world, corners);
+	uint32_t children = json_member(json, node, "children");
+	for (uint32_t c = json_element(json, children, 0); c != NONE; c = json->values[c].next)
+		gltf_add_node(gltf, (uint32_t)json_number(json, c, 0), &world, depth + 1, corners);
+}
+
+static void load_gltf(const char* path, uint8_t* file, uint64_t size, struct corners* corners)
+{
+	struct gltf gltf = {0};
+	const char* text = (const char*)file;
+	uint8_t* bin = NULL;
+	uint64_t bin_size = 0;
+	uint32_t header[3];
+	if (size >= 12) memcpy(header, file, sizeof(header));
+	if (size >= 12 && header[0] == 0x46546c67u) { // "glTF": the binary container, JSON chunk then BIN chunk
+		if (header[1] != 2) fail("%s: glTF version %u, only 2 is supported", path, header[1]);
+		uint64_t offset = 12;
+		while (offset + 8 <= size) {
+			uint32_t chunk[2];
+			memcpy(chunk, file + offset, sizeof(chunk));
+			if (offset + 8 + chunk[0] > size) fail("%s: truncated chunk", path);
+			if (chunk[1] == 0x4e4f534au) { // JSON, parsed up to the end of its value
+				text = (const char*)file + offset + 8;
+			} else if (chunk[1] == 0x004e4942u) { // BIN
+				bin = file + offset + 8;
+				bin_size = chunk[0];
+			}
+			offset += 8 + ((chunk[0] + 3) & ~3u);
+		}
+	}
+	gltf.json.p = text;
+	gltf.root = json_parse(&gltf.json, 0);
+	gltf_load_buffers(&gltf, path, bin, bin_size);
+
+	struct mat4 identity = mat4_identity();
+	uint32_t scenes = json_member(&gltf.json, gltf.root, "scenes");
+	uint32_t scene = json_element(&gltf.json, scenes, (uint32_t)json_number(&gltf.json, json_member(&gltf.json, gltf.root, "scene"), 0));
+	if (scene != NONE) {
+		uint32_t nodes = json_member(&gltf.json, scene, "nodes");
+		for (uint32_t n = json_element(&gltf.json, nodes, 0); n != NONE; n = gltf.json.values[n].next)
+			gltf_add_node(&gltf, (uint32_t)json_number(&gltf.json, n, 0), &identity, 0, corners);
+	} else {
+		uint32_t meshes = json_member(&gltf.json, gltf.root, "meshes");
+		for (uint32_t m = 0; meshes != NONE && m < gltf.json.values[meshes].count; ++m) gltf_add_mesh(&gltf, m, &identity, corners);
+	}
+	generate_normals(corners, NULL, 0);
+
+	for (uint32_t i = 0; i < gltf.buffer_count; ++i)
+		if (gltf.buffers[i] != bin) free(gltf.buffers[i]);
+	free(gltf.buffers);
+	free(gltf.buffer_sizes);
+	free(gltf.json.values);
+}
+
+// Indexed mesh, the steps below work on it in place.
+struct mesh
+{
+	struct vertex_input* vertices;
+	uint32_t vertex_count;
+	uint32_t* indices;
+	uint32_t index_count;
+};
+
+// The ten floats of a vertex, -0 as 0 so both weld.
+static void vertex_key(const struct vertex_input* v, uint32_t key[10])
+{
+	float values[10] = {v->position.x, v->position.y, v->position.z, v->normal.x, v->normal.y, v->normal.z, v->color.x, v->color.y, v->color.z, v->color.w};
+	for (int i = 0; i < 10; ++i) values[i] += 0.0f;
+	memcpy(key, values, sizeof(values));
+}
+
+static uint32_t weld(const struct corners* corners, struct mesh* mesh)
+{
+	uint32_t table_size = 1;
+	while (table_size < corners->count * 2) table_size *= 2;
+	uint32_t* table = allocate(table_size, sizeof(uint32_t));
+	memset(table, 0xff, (size_t)table_size * sizeof(uint32_t));
+	mesh->vertices = allocate(corners->count, sizeof(struct vertex_input));
+	mesh->indices = allocate(corners->count, sizeof(uint32_t));
+	mesh->vertex_count = 0;
+	mesh->index_count = 0;
+	uint32_t degenerate = 0;
+	for (uint32_t t = 0; t + 2 < corners->count; t += 3) {
+		uint32_t triangle[3];
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t key[10];
+			vertex_key(&corners->vertices[t + k], key);
+			uint32_t hash = 2166136261u;
+			for (int i = 0; i < 10; ++i) hash = (hash ^ key[i]) * 16777619u;
+			uint32_t slot = hash & (table_size - 1);
+			for (;; slot = (slot + 1) & (table_size - 1)) {
+				if (table[slot] == NONE) {
+					table[slot] = mesh->vertex_count;
+					mesh->vertices[mesh->vertex_count++] = corners->vertices[t + k];
+					break;
+				}
+				uint32_t other[10];
+				vertex_key(&mesh->vertices[table[slot]], other);
+				if (!memcmp(key, other, sizeof(key))) break;
+			}
+			triangle[k] = table[slot];
+		}
+		if (triangle[0] == triangle[1] || triangle[1] == triangle[2] || triangle[0] == triangle[2]) {
+			degenerate++;
+			continue;
+		}
+		memcpy(mesh->indices + mesh->index_count, triangle, sizeof(triangle));
+		mesh->index_count += 3;
+	}
+	free(table);
+	return degenerate;
+}
+
+static float coordinate(struct vec3 v, uint32_t axis)
+{
+	return axis == 0 ? v.x : axis == 1 ? v.y : v.z;
+}
+
+// Simplification, Garland and Heckbert's quadric error metrics over positions and attributes
+// (Garland and Heckbert 1998): every triangle is a plane in a ten dimensional space of position,
+// normal and color, every vertex the area weighted sum of the squared distances to its triangles'
+// planes. An edge collapses into one of its ends, so every level uses a subset of the vertices.
+// Borders add planes across them and only collapse along themselves, vertices on seams (several
+// vertices at one position) and on edges of more than two triangles do not move.
+
+#define QUADRIC_SIZE 10 // position over the mesh's radius, normal and color times the attribute weight
+#define QUADRIC_TERMS (QUADRIC_SIZE * (QUADRIC_SIZE + 1) / 2)
+#define BORDER_WEIGHT 10.0
+
+struct quadric
+{
+	double a[QUADRIC_TERMS]; // upper triangle, row by row
+	double b[QUADRIC_SIZE];
+	double c;
+	double weight; // area summed, the error is the quadric over it
+};
+
+struct edge_slot
+{
+	uint64_t key; // UINT64_MAX when free
+	uint32_t triangles;
+};
+
+struct simplifier
+{
+	uint32_t vertex_count;
+	uint32_t* indices; // the current level
+	uint32_t index_count;
+	double* points; // QUADRIC_SIZE per vertex
+	struct quadric* quadrics;
+	bool* locked;
+	bool* border;
+	float max_error; // of a collapse so far, relative to the radius
+
+	// rebuilt every pass
+	uint32_t* offsets;   // triangles per vertex
+	uint32_t* adjacency;
+	struct edge_slot* edges;
+	uint32_t edge_mask;
+	uint32_t* marks;     // per vertex, stamps of the link test
+	uint32_t stamp;
+};
+
+static uint64_t edge_key(uint32_t a, uint32_t b)
+{
+	return a < b ? (uint64_t)a << 32 | b : (uint64_t)b << 32 | a;
+}
+
+static struct edge_slot* edge_find(struct simplifier* s, uint32_t a, uint32_t b)
+{
+	uint64_t key = edge_key(a, b);
+	uint32_t slot = (uint32_t)((key * 0x9e3779b97f4a7c15ull) >> 32) & s->edge_mask;
+	while (s->edges[slot].key != UINT64_MAX && s->edges[slot].key != key) slot = (slot + 1) & s->edge_mask;
+	return &s->edges[slot];
+}
+
+// Triangles per vertex and per edge of the current indices.
+static void simplifier_connect(struct simplifier* s)
+{
+	memset(s->offsets, 0, (size_t)(s->vertex_count + 1) * sizeof(uint32_t));
+	for (uint32_t i = 0; i < s->index_count; ++i) s->offsets[s->indices[i] + 1]++;
+	for (uint32_t v = 0; v < s->vertex_count; ++v) s->offsets[v + 1] += s->offsets[v];
+	uint32_t* fill = allocate(s->vertex_count, sizeof(uint32_t));
+	for (uint32_t i = 0; i < s->index_count; ++i) s->adjacency[s->offsets[s->indices[i]] + fill[s->indices[i]]++] = i / 3;
+	free(fill);
+
+	for (uint32_t i = 0; i <= s->edge_mask; ++i) s->edges[i] = (struct edge_slot){.key = UINT64_MAX};
+	for (uint32_t i = 0; i < s->index_count; ++i) {
+		uint32_t a = s->indices[i], b = s->indices[i % 3 == 2 ? i - 2 : i + 1];
+		struct edge_slot* edge = edge_find(s, a, b);
+		edge->key = edge_key(a, b);
+		edge->triangles++;
+	}
+	memset(s->border, 0, s->vertex_count * sizeof(bool));
+	for (uint32_t i = 0; i <= s->edge_mask; ++i) {
+		if (s->edges[i].key == UINT64_MAX || s->edges[i].triangles == 2) continue;
+		uint32_t a = (uint32_t)(s->edges[i].key >> 32), b = (uint32_t)s->edges[i].key;
+		if (s->edges[i].triangles == 1) {
+			s->border[a] = s->border[b] = true;
+		} else {
+			s->locked[a] = s->locked[b] = true;
+		}
+	}
+}
+
+// Adds the squared distance to the affine plane through p, q and r, times weight.
+static void quadric_add_plane(struct quadric* quadric, const double* p, const double* q, const double* r, double weight)
+{
+	double e1[QUADRIC_SIZE], e2[QUADRIC_SIZE];
+	double length1 = 0.0, dot = 0.0, length2 = 0.0;
+	for (int i = 0; i < QUADRIC_SIZE; ++i) {
+		e1[i] = q[i] - p[i];
+		length1 += e1[i] * e1[i];
+	}
+	if (length1 == 0.0) return;
+	for (int i = 0; i < QUADRIC_SIZE; ++i) {
+		e1[i] /= sqrt(length1);
+		dot += e1[i] * (r[i] - p[i]);
+	}
+	for (int i = 0; i < QUADRIC_SIZE; ++i) {
+		e2[i] = r[i] - p[i] - dot * e1[i];
+		length2 += e2[i] * e2[i];
+	}
+	if (length2 == 0.0) return;
+	double pe1 = 0.0, pe2 = 0.0, pp = 0.0;
+	for (int i = 0; i < QUADRIC_SIZE; ++i) {
+		e2[i] /= sqrt(length2);
+		pe1 += p[i] * e1[i];
+		pe2 += p[i] * e2[i];
+		pp += p[i] * p[i];
+	}
+	// A = I - e1 e1' - e2 e2', b = (p.e1) e1 + (p.e2) e2 - p, c = p.p - (p.e1)^2 - (p.e2)^2
+	uint32_t term = 0;
+	for (int i = 0; i < QUADRIC_SIZE; ++i) {
+		for (int j = i; j < QUADRIC_SIZE; ++j) quadric->a[term++] += weight * ((i == j) - e1[i] * e1[j] - e2[i] * e2[j]);
+		quadric->b[i] += weight * (pe1 * e1[i] + pe2 * e2[i] - p[i]);
+	}
+	quadric->c += weight * (pp - pe1 * pe1 - pe2 * pe2);
+	quadric->weight += weight;
+}
+
+// The squared distance to the plane with unit normal n through p, positions only.
+static void quadric_add_position_plane(struct quadric* quadric, const double* n, const double* p, double weight)
+{
+	double d = -(n[0] * p[0] + n[1] * p[1] + n[2] * p[2]);
+	uint32_t term = 0;
+	for (int i = 0; i < 3; ++i) {
+		for (int j = i; j < QUADRIC_SIZE; ++j) quadric->a[term++] += j < 3 ? weight * n[i] * n[j] : 0.0;
+		quadric->b[i] += weight * d * n[i];
+	}
+	quadric->c += weight * d * d;
+}
+
+static void quadric_sum(struct quadric* sum, const struct quadric* a, const struct quadric* b)
+{
+	for (int i = 0; i < QUADRIC_TERMS; ++i) sum->a[i] = a->a[i] + b->a[i];
+	for (int i = 0; i < QUADRIC_SIZE; ++i) sum->b[i] = a->b[i] + b->b[i];
+	sum->c = a->c + b->c;
+	sum->weight = a->weight + b->weight;
+}
+
+// The weighted mean squared distance of x to the quadric's planes.
+static double quadric_error(const struct quadric* quadric, const double* x)
+{
+	double sum = quadric->c;
+	uint32_t term = 0;
+	for (int i = 0; i < QUADRIC_SIZE; ++i) {
+		double row = quadric->a[term++] * x[i];
+		for (int j = i + 1; j < QUADRIC_SIZE; ++j) row += 2.0 * quadric->a[term++] * x[j];
+		sum += x[i] * (row + 2.0 * quadric->b[i]);
+	}
+	return quadric->weight > 0.0 ? fmax(sum, 0.0) / quadric->weight : 0.0;
+}
+
+static void simplifier_init(struct simplifier* s, const struct mesh* mesh, float attribute_weight)
+{
+	memset(s, 0, sizeof(*s));
+	s->vertex_count = mesh->vertex_count;
+	s->index_count = mesh->index_count;
+	s->indices = allocate(mesh->index_count, sizeof(uint32_t));
+	memcpy(s->indices, mesh->indices, (size_t)mesh->index_count * sizeof(uint32_t));
+	s->points = allocate((size_t)mesh->vertex_count * QUADRIC_SIZE, sizeof(double));
+	s->quadrics = allocate(mesh->vertex_count, sizeof(struct quadric));
+	s->locked = allocate(mesh->vertex_count, sizeof(bool));
+	s->border = allocate(mesh->vertex_count, sizeof(bool));
+	s->offsets = allocate(mesh->vertex_count + 1, sizeof(uint32_t));
+	s->adjacency = allocate(mesh->index_count, sizeof(uint32_t));
+	s->marks = allocate(mesh->vertex_count, sizeof(uint32_t));
+	uint32_t edge_slots = 1;
+	while (edge_slots < mesh->index_count * 2) edge_slots *= 2;
+	s->edges = allocate(edge_slots, sizeof(struct edge_slot));
+	s->edge_mask = edge_slots - 1;
+
+	// positions over the radius, so errors are relative to the mesh's size
+	struct vec3 min = vec3_make(FLT_MAX, FLT_MAX, FLT_MAX), max = vec3_make(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (uint32_t i = 0; i < mesh->vertex_count; ++i) {
+		struct vec3 p = mesh->vertices[i].position;
+		min = vec3_make(fminf(min.x, p.x), fminf(min.y, p.y), fminf(min.z, p.z));
+		max = vec3_make(fmaxf(max.x, p.x), fmaxf(max.y, p.y), fmaxf(max.z, p.z));
+	}
+	float radius = vec3_length(vec3_scale(vec3_sub(max, min), 0.5f));
+	double scale = radius > 0.0f ? 1.0 / radius : 1.0;
+	for (uint32_t i = 0; i < mesh->vertex_count; ++i) {
+		const struct vertex_input* v = &mesh->vertices[i];
+		double values[QUADRIC_SIZE] = {
+			v->position.x * scale, v->position.y * scale, v->position.z * scale,
+			v->normal.x * attribute_weight, v->normal.y * attribute_weight, v->normal.z * attribute_weight,
+			v->color.x * attribute_weight, v->color.y * attribute_weight, v->color.z * attribute_weight, v->color.w * attribute_weight,
+		};
+		memcpy(&s->points[(size_t)i * QUADRIC_SIZE], values, sizeof(values));
+	}
+
+	// seams, found by position
+	uint32_t table_size = 1;
+	while (table_size < mesh->vertex_count * 2) table_size *= 2;
+	uint32_t* table = allocate(table_size, sizeof(uint32_t));
+	memset(table, 0xff, (size_t)table_size * sizeof(uint32_t));
+	for (uint32_t i = 0; i < mesh->vertex_count; ++i) {
+		struct vec3 p = vec3_add(mesh->vertices[i].position, vec3_make(0.0f, 0.0f, 0.0f)); // -0 as 0
+		uint32_t hash = 2166136261u;
+		uint32_t key[3];
+		memcpy(key, &p, sizeof(key));
+		for (int k = 0; k < 3; ++k) hash = (hash ^ key[k]) * 16777619u;
+		uint32_t slot = hash & (table_size - 1);
+		for (;; slot = (slot + 1) & (table_size - 1)) {
+			if (table[slot] == NONE) {
+				table[slot] = i;
+				break;
+			}
+			struct vec3 other = mesh->vertices[table[slot]].position;
+			if (other.x == p.x && other.y == p.y && other.z == p.z) {
+				s->locked[i] = s->locked[table[slot]] = true;
+				break;
+			}
+		}
+	}
+	free(table);
+
+	simplifier_connect(s);
+	for (uint32_t t = 0; t < s->index_count; t += 3) {
+		const double* p[3];
+		for (int k = 0; k < 3; ++k) p[k] = &s->points[(size_t)s->indices[t + k] * QUADRIC_SIZE];
+		double u[3], w[3], n[3];
+		for (int k = 0; k < 3; ++k) {
+			u[k] = p[1][k] - p[0][k];
+			w[k] = p[2][k] - p[0][k];
+		}
+		n[0] = u[1] * w[2] - u[2] * w[1];
+		n[1] = u[2] * w[0] - u[0] * w[2];
+		n[2] = u[0] * w[1] - u[1] * w[0];
+		double length = sqrt(n[0] * n[0] + n[1] * n[1] + n[2] * n[2]);
+		if (length == 0.0) continue;
+		for (int k = 0; k < 3; ++k) quadric_add_plane(&s->quadrics[s->indices[t + k]], p[0], p[1], p[2], length * 0.5);
+		// a plane through every border edge, perpendicular to the triangle, keeps the border in place
+		for (int k = 0; k < 3; ++k) {
+			uint32_t a = s->indices[t + k], b = s->indices[t + (k + 1) % 3];
+			if (edge_find(s, a, b)->triangles != 1) continue;
+			const double* pa = &s->points[(size_t)a * QUADRIC_SIZE];
+			const double* pb = &s->points[(size_t)b * QUADRIC_SIZE];
+			double e[3] = {pb[0] - pa[0], pb[1] - pa[1], pb[2] - pa[2]};
+			double m[3] = {e[1] * n[2] - e[2] * n[1], e[2] * n[0] - e[0] * n[2], e[0] * n[1] - e[1] * n[0]};
+			double m_length = sqrt(m[0] * m[0] + m[1] * m[1] + m[2] * m[2]);
+			if (m_length == 0.0) continue;
+			for (int i = 0; i < 3; ++i) m[i] /= m_length;
+			double weight = BORDER_WEIGHT * (e[0] * e[0] + e[1] * e[1] + e[2] * e[2]);
+			quadric_add_position_plane(&s->quadrics[a], m, pa, weight);
+			quadric_add_position_plane(&s->quadrics[b], m, pa, weight);
+		}
+	}
+}
+
+static void simplifier_free(struct simplifier* s)
+{
+	free(s->indices);
+	free(s->points);
+	free(s->quadrics);
+	free(s->locked);
+	free(s->border);
+	free(s->offsets);
+	free(s->adjacency);
+	free(s->edges);
+	free(s->marks);
+}
+
+// Whether from can move onto to: the triangles keep their orientation and the surface stays a
+// manifold, the vertices both ends share are only those of the triangles on the edge.
+static bool collapse_valid(struct simplifier* s, const struct mesh* mesh, uint32_t from, uint32_t to, uint32_t edge_triangles)
+{
+	s->stamp++;
+	for (uint32_t a = s->offsets[to]; a < s->offsets[to + 1]; ++a)
+		for (uint32_t k = 0; k < 3; ++k) s->marks[s->indices[s->adjacency[a] * 3 + k]] = s->stamp;
+	uint32_t shared = 0;
+	s->stamp++; // counts every shared vertex once
+	for (uint32_t a = s->offsets[from]; a < s->offsets[from + 1]; ++a) {
+		for (uint32_t k = 0; k < 3; ++k) {
+			uint32_t v = s->indices[s->adjacency[a] * 3 + k];
+			if (v == from || v == to || s->marks[v] != s->stamp - 1) continue;
+			s->marks[v] = s->stamp;
+			shared++;
+		}
+	}
+	if (shared != edge_triangles) return false;
+
+	struct vec3 target = mesh->vertices[to].position;
+	for (uint32_t a = s->offsets[from]; a < s->offsets[from + 1]; ++a) {
+		const uint32_t* triangle = &s->indices[s->adjacency[a] * 3];
+		if (triangle[0] == to || triangle[1] == to || triangle[2] == to) continue; // removed
+		struct vec3 p[3], q[3];
+		for (uint32_t k = 0; k < 3; ++k) {
+			p[k] = mesh->vertices[triangle[k]].position;
+			q[k] = triangle[k] == from ? target : p[k];
+		}
+		struct vec3 before = vec3_cross(vec3_sub(p[1], p[0]), vec3_sub(p[2], p[0]));
+		struct vec3 after = vec3_cross(vec3_sub(q[1], q[0]), vec3_sub(q[2], q[0]));
+		if (vec3_dot(before, after) <= 0.0f) return false;
+	}
+	return true;
+}
+
+struct collapse
+{
+	uint32_t from;
+	uint32_t to;
+	float error;
+	uint32_t edge_triangles;
+};
+
+static int collapse_compare(const void* a, const void* b)
+{
+	const struct collapse* x = a;
+	const struct collapse* y = b;
+	return x->error < y->error ? -1 : x->error > y->error;
+}
+
+// Collapses edges, the cheapest first, until at most target_triangles are left or the next one
+// would cost more than max_error, relative to the mesh's radius. In passes: the cheapest
+// collapses that do not touch each other's triangles, then the triangles are rebuilt.
+static void simplify(struct simplifier* s, const struct mesh* mesh, uint32_t target_triangles, float max_error)
+{
+	struct collapse* collapses = allocate(s->index_count, sizeof(struct collapse));
+	uint32_t* remap = allocate(s->vertex_count, sizeof(uint32_t));
+	uint32_t* moved = allocate(s->vertex_count, sizeof(uint32_t)); // stamp of the pass that touched a vertex
+	for (uint32_t pass = 1; s->index_count / 3 > target_triangles; ++pass) {
+		simplifier_connect(s);
+		uint32_t collapse_count = 0;
+		for (uint32_t i = 0; i < s->index_count; ++i) {
+			uint32_t a = s->indices[i], b = s->indices[i % 3 == 2 ? i - 2 : i + 1];
+			uint32_t edge_triangles = edge_find(s, a, b)->triangles;
+			if (a > b && edge_triangles != 1) continue; // the other triangle has it the other way
+			struct quadric sum;
+			quadric_sum(&sum, &s->quadrics[a], &s->quadrics[b]);
+			struct collapse best = {.error = FLT_MAX, .edge_triangles = edge_triangles};
+			for (int direction = 0; direction < 2; ++direction) {
+				uint32_t from = direction ? b : a, to = direction ? a : b;
+				if (s->locked[from] || (s->border[from] && edge_triangles != 1)) continue;
+				float error = (float)sqrt(quadric_error(&sum, &s->points[(size_t)to * QUADRIC_SIZE]));
+				if (error < best.error) {
+					best.from = from;
+					best.to = to;
+					best.error = error;
+				}
+			}
+			if (best.error <= max_error) collapses[collapse_count++] = best;
+		}
+		qsort(collapses, collapse_count, sizeof(struct collapse), collapse_compare);
+
+		for (uint32_t v = 0; v < s->vertex_count; ++v) remap[v] = v;
+		uint32_t removed = 0, done = 0;
+		uint32_t wanted = s->index_count / 3 - target_triangles;
+		for (uint32_t c = 0; c < collapse_count && removed < wanted; ++c) {
+			struct collapse* collapse = &collapses[c];
+			if (moved[collapse->from] == pass || moved[collapse->to] == pass) continue;
+			if (!collapse_valid(s, mesh, collapse->from, collapse->to, collapse->edge_triangles)) continue;
+			remap[collapse->from] = collapse->to;
+			quadric_sum(&s->quadrics[collapse->to], &s->quadrics[collapse->to], &s->quadrics[collapse->from]);
+			// nothing around from changes again this pass, the tests above see the triangles as they are
+			for (uint32_t a = s->offsets[collapse->from]; a < s->offsets[collapse->from + 1]; ++a)
+				for (uint32_t k = 0; k < 3; ++k) moved[s->indices[s->adjacency[a] * 3 + k]] = pass;
+			s->max_error = fmaxf(s->max_error, collapse->error);
+			removed += collapse->edge_triangles;
+			done++;
+		}
+		if (!done) break;
+
+		uint32_t count = 0;
+		for (uint32_t t = 0; t < s->index_count; t += 3) {
+			uint32_t a = remap[s->indices[t]], b = remap[s->indices[t + 1]], c = remap[s->indices[t + 2]];
+			if (a == b || b == c || a == c) continue;
+			s->indices[count++] = a;
+			s->indices[count++] = b;
+			s->indices[count++] = c;
+		}
+		s->index_count = count;
+	}
+	free(collapses);
+	free(remap);
+	free(moved);
+}
+
+// Uniform grid over a mesh's triangles, for the distance of a point to its surface.
+struct triangle_grid
+{
+	const struct vertex_input* vertices;
+	const uint32_t* indices;
+	struct vec3 min;
+	float cell;
+	uint32_t size[3];
+	uint32_t* offsets; // into triangles, per cell
+	uint32_t* triangles;
+	uint32_t* stamps; // per triangle, the query that last tested it
+	uint32_t query;
+};
+
+static void grid_cell_range(const struct triangle_grid* grid, struct vec3 min, struct vec3 max, uint32_t first[3], uint32_t last[3])
+{
+	for (uint32_t k = 0; k < 3; ++k) {
+		float low = (coordinate(min, k) - coordinate(grid->min, k)) / grid->cell;
+		float high = (coordinate(max, k) - coordinate(grid->min, k)) / grid->cell;
+		first[k] = (uint32_t)fminf(fmaxf(low, 0.0f), (float)(grid->size[k] - 1));
+		last[k] = (uint32_t)fminf(fmaxf(high, 0.0f), (float)(grid->size[k] - 1));
+	}
+}
+
+// Over the bounds min to max, which the queried points are in as well.
+static void grid_build(struct triangle_grid* grid, const struct vertex_input* vertices, const uint32_t* indices, uint32_t index_count, struct vec3 min,
+		       struct vec3 max)
+{
+	memset(grid, 0, sizeof(*grid));
+	grid->vertices = vertices;
+	grid->indices = indices;
+	grid->min = min;
+	struct vec3 extent = vec3_sub(max, min);
+	float resolution = fminf(ceilf(cbrtf((float)(index_count / 3))), 128.0f);
+	grid->cell = fmaxf(fmaxf(extent.x, fmaxf(extent.y, extent.z)) / resolution, 1e-20f);
+	for (uint32_t k = 0; k < 3; ++k) grid->size[k] = (uint32_t)fminf(fmaxf(ceilf(coordinate(extent, k) / grid->cell), 1.0f), resolution);
+	uint32_t cells = grid->size[0] * grid->size[1] * grid->size[2];
+	grid->offsets = allocate(cells + 1, sizeof(uint32_t));
+	grid->stamps = allocate(index_count / 3, sizeof(uint32_t));
+	uint32_t* fill = allocate(cells, sizeof(uint32_t));
+	for (int pass = 0; pass < 2; ++pass) {
+		for (uint32_t t = 0; t < index_count; t += 3) {
+			struct vec3 a = vertices[indices[t]].position, b = vertices[indices[t + 1]].position, c = vertices[indices[t + 2]].position;
+			uint32_t first[3], last[3];
+			grid_cell_range(grid, vec3_make(fminf(a.x, fminf(b.x, c.x)), fminf(a.y, fminf(b.y, c.y)), fminf(a.z, fminf(b.z, c.z))),
+					vec3_make(fmaxf(a.x, fmaxf(b.x, c.x)), fmaxf(a.y, fmaxf(b.y, c.y)), fmaxf(a.z, fmaxf(b.z, c.z))), first, last);
+			for (uint32_t z = first[2]; z <= last[2]; ++z)
+				for (uint32_t y = first[1]; y <= last[1]; ++y)
+					for (uint32_t x = first[0]; x <= last[0]; ++x) {
+						uint32_t cell = (z * grid->size[1] + y) * grid->size[0] + x;
+						if (pass == 0) grid->offsets[cell + 1]++;
+						else grid->triangles[grid->offsets[cell] + fill[cell]++] = t / 3;
+					}
+		}
+		if (pass == 0) {
+			for (uint32_t i = 0; i < cells; ++i) grid->offsets[i + 1] += grid->offsets[i];
+			grid->triangles = allocate(grid->offsets[cells], sizeof(uint32_t));
+		}
+	}
+	free(fill);
+}
+
+static void grid_free(struct triangle_grid* grid)
+{
+	free(grid->offsets);
+	free(grid->triangles);
+	free(grid->stamps);
+}
+
+// Squared distance from p to the closest point of triangle abc, Ericson's Real-Time Collision Detection 5.1.5.
+static float point_triangle_distance2(struct vec3 p, struct vec3 a, struct vec3 b, struct vec3 c)
+{
+	struct vec3 ab = vec3_sub(b, a), ac = vec3_sub(c, a), ap = vec3_sub(p, a);
+	float d1 = vec3_dot(ab, ap), d2 = vec3_dot(ac, ap);
+	struct vec3 closest;
+	if (d1 <= 0.0f && d2 <= 0.0f) {
+		closest = a;
+	} else {
+		struct vec3 bp = vec3_sub(p, b);
+		float d3 = vec3_dot(ab, bp), d4 = vec3_dot(ac, bp);
+		struct vec3 cp = vec3_sub(p, c);
+		float d5 = vec3_dot(ab, cp), d6 = vec3_dot(ac, cp);
+		float vc = d1 * d4 - d3 * d2, vb = d5 * d2 - d1 * d6, va = d3 * d6 - d5 * d4;
+		if (d3 >= 0.0f && d4 <= d3) closest = b;
+		else if (d6 >= 0.0f && d5 <= d6) closest = c;
+		else if (vc <= 0.0f && d1 >= 0.0f && d3 <= 0.0f) closest = vec3_add(a, vec3_scale(ab, d1 / (d1 - d3)));
+		else if (vb <= 0.0f && d2 >= 0.0f && d6 <= 0.0f) closest = vec3_add(a, vec3_scale(ac, d2 / (d2 - d6)));
+		else if (va <= 0.0f && d4 - d3 >= 0.0f && d5 - d6 >= 0.0f) closest = vec3_add(b, vec3_scale(vec3_sub(c, b), (d4 - d3) / ((d4 - d3) + (d5 - d6))));
+		else {
+			float denominator = 1.0f / (va + vb + vc);
+			closest = vec3_add(a, vec3_add(vec3_scale(ab, vb * denominator), vec3_scale(ac, vc * denominator)));
+		}
+	}
+	struct vec3 d = vec3_sub(p, closest);
+	return vec3_dot(d, d);
+}
+
+// Cells in shells of growing distance around p's, until no farther cell can hold anything closer.
+static float grid_distance(struct triangle_grid* grid, struct vec3 p)
+{
+	grid->query++;
+	uint32_t center[3];
+	grid_cell_range(grid, p, p, center, center);
+	uint32_t max_shell = grid->size[0] > grid->size[1] ? grid->size[0] : grid->size[1];
+	max_shell = max_shell > grid->size[2] ? max_shell : grid->size[2];
+	float best = FLT_MAX;
+	for (uint32_t shell = 0; shell <= max_shell; ++shell) {
+		int64_t low[3], high[3];
+		for (uint32_t k = 0; k < 3; ++k) {
+			low[k] = (int64_t)center[k] - shell > 0 ? (int64_t)center[k] - shell : 0;
+			high[k] = (int64_t)center[k] + shell < grid->size[k] - 1 ? (int64_t)center[k] + shell : grid->size[k] - 1;
+		}
+		for (int64_t z = low[2]; z <= high[2]; ++z)
+			for (int64_t y = low[1]; y <= high[1]; ++y)
+				for (int64_t x = low[0]; x <= high[0]; ++x) {
+					int64_t dx = llabs(x - center[0]), dy = llabs(y - center[1]), dz = llabs(z - center[2]);
+					if (dx < shell && dy < shell && dz < shell) continue; // an inner shell's
+					uint32_t cell = ((uint32_t)z * grid->size[1] + (uint32_t)y) * grid->size[0] + (uint32_t)x;
+					for (uint32_t i = grid->offsets[cell]; i < grid->offsets[cell + 1]; ++i) {
+						uint32_t t = grid->triangles[i];
+						if (grid->stamps[t] == grid->query) continue;
+						grid->stamps[t] = grid->query;
+						const uint32_t* triangle = &grid->indices[t * 3];
+						best = fminf(best, point_triangle_distance2(p, grid->vertices[triangle[0]].position, grid->vertices[triangle[1]].position,
+											    grid->vertices[triangle[2]].position));
+					}
+				}
+		float reach = (float)shell * grid->cell; // at least this far to any cell outside the shell
+		if (best <= reach * reach) break;
+	}
+	return sqrtf(best);
+}
+
+// The distance between two surfaces over the same vertices, at the points that matter: the full
+// mesh's vertices from the level's surface, and the level's triangle centers and edge midpoints
+// from the full mesh's (its own vertices lie on it).
+static float lod_distance(struct triangle_grid* full, const struct mesh* mesh, const uint32_t* indices, uint32_t index_count, struct vec3 min, struct vec3 max)
+{
+	struct triangle_grid grid;
+	grid_build(&grid, mesh->vertices, indices, index_count, min, max);
+	float distance = 0.0f;
+	bool* used = allocate(mesh->vertex_count, sizeof(bool));
+	for (uint32_t i = 0; i < mesh->index_count; ++i) {
+		uint32_t v = mesh->indices[i];
+		if (used[v]) continue;
+		used[v] = true;
+		distance = fmaxf(distance, grid_distance(&grid, mesh->vertices[v].position));
+	}
+	for (uint32_t t = 0; t < index_count; t += 3) {
+		struct vec3 a = mesh->vertices[indices[t]].position, b = mesh->vertices[indices[t + 1]].position, c = mesh->vertices[indices[t + 2]].position;
+		struct vec3 points[4] = {
+			vec3_scale(vec3_add(vec3_add(a, b), c), 1.0f / 3.0f),
+			vec3_scale(vec3_add(a, b), 0.5f),
+			vec3_scale(vec3_add(b, c), 0.5f),
+			vec3_scale(vec3_add(c, a), 0.5f),
+		};
+		for (uint32_t k = 0; k < 4; ++k) distance = fmaxf(distance, grid_distance(full, points[k]));
+	}
+	free(used);
+	grid_free(&grid);
+	return distance;
+}
+
+// FIFO post-transform cache: a vertex is in it while fewer than cache_size misses came after its own.
+// Returns 1 on a miss.
+static uint32_t cache_access(uint32_t* timestamps, uint32_t* time, uint32_t vertex, uint32_t cache_size)
+{
+	if (*time - timestamps[vertex] <= cache_size) return 0;
+	timestamps[vertex] = (*time)++;
+	return 1;
+}
+
+static uint32_t cache_misses(const struct mesh* mesh, uint32_t cache_size)
+{
+	uint32_t* timestamps = allocate(mesh->vertex_count, sizeof(uint32_t));
+	uint32_t time = cache_size + 1;
+	uint32_t misses = 0;
+	for (uint32_t i = 0; i < mesh->index_count; ++i) misses += cache_access(timestamps, &time, mesh->indices[i], cache_size);
+	free(timestamps);
+	return misses;
+}
+
+// Bytes read from the vertex buffer on post-transform cache misses, 64 byte lines through a small
+// FIFO, over the bytes the vertices take. 1 is every byte read once.
+static double vertex_overfetch(const struct mesh* mesh, uint32_t stride, uint32_t cache_size)
+{
+	uint32_t* timestamps = allocate(mesh->vertex_count, sizeof(uint32_t));
+	uint64_t lines[FETCH_CACHE_LINES];
+	memset(lines, 0xff, sizeof(lines));
+	uint32_t next_line = 0;
+	uint32_t time = cache_size + 1;
+	uint64_t fetched = 0;
+	for (uint32_t i = 0; i < mesh->index_count; ++i) {
+		uint32_t v = mesh->indices[i];
+		if (!cache_access(timestamps, &time, v, cache_size)) continue;
+		uint64_t begin = VERTEX_HEADER_BYTES + (uint64_t)v * stride;
+		for (uint64_t line = begin / FETCH_LINE_BYTES; line <= (begin + stride - 1) / FETCH_LINE_BYTES; ++line) {
+			bool hit = false;
+			for (uint32_t l = 0; l < FETCH_CACHE_LINES && !hit; ++l) hit = lines[l] == line;
+			if (hit) continue;
+			lines[next_line] = line;
+			next_line = (next_line + 1) % FETCH_CACHE_LINES;
+			fetched += FETCH_LINE_BYTES;
+		}
+	}
+	free(timestamps);
+	return mesh->vertex_count ? (double)fetched / ((double)mesh->vertex_count * stride) : 0.0;
+}
+
+// Pixels shaded over pixels covered, front faces rasterized in order with a less depth test from
+// the six axis directions, orthographic over the bounds.
+static double measure_overdraw(const struct mesh* mesh)
+{
+	struct vec3 min = vec3_make(FLT_MAX, FLT_MAX, FLT_MAX), max = vec3_make(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+	for (uint32_t i = 0; i < mesh->vertex_count; ++i) {
+		struct vec3 p = mesh->vertices[i].position;
+		min = vec3_make(fminf(min.x, p.x), fminf(min.y, p.y), fminf(min.z, p.z));
+		max = vec3_make(fmaxf(max.x, p.x), fmaxf(max.y, p.y), fmaxf(max.z, p.z));
+	}
+	float* depth = allocate(OVERDRAW_GRID * OVERDRAW_GRID, sizeof(float));
+	uint64_t shaded = 0, covered = 0;
+	for (uint32_t view = 0; view < 6; ++view) {
+		uint32_t axis = view / 2, u = (axis + 1) % 3, w = (axis + 2) % 3;
+		float sign = view % 2 ? -1.0f : 1.0f; // looking along +axis or -axis
+		float extent = fmaxf(coordinate(vec3_sub(max, min), u), coordinate(vec3_sub(max, min), w));
+		float scale = extent > 0.0f ? (OVERDRAW_GRID - 1) / extent : 0.0f;
+		for (uint32_t i = 0; i < OVERDRAW_GRID * OVERDRAW_GRID; ++i) depth[i] = FLT_MAX;
+		for (uint32_t t = 0; t < mesh->index_count; t += 3) {
+			struct vec3 p[3];
+			for (uint32_t k = 0; k < 3; ++k) p[k] = mesh->vertices[mesh->indices[t + k]].position;
+			// counterclockwise is front, so the face normal points against the view direction
+			struct vec3 normal = vec3_cross(vec3_sub(p[1], p[0]), vec3_sub(p[2], p[0]));
+			if (sign * coordinate(normal, axis) >= 0.0f) continue;
+			float x[3], y[3], z[3];
+			for (uint32_t k = 0; k < 3; ++k) {
+				x[k] = (coordinate(p[k], u) - coordinate(min, u)) * scale;
+				y[k] = (coordinate(p[k], w) - coordinate(min, w)) * scale;
+				z[k] = sign * coordinate(p[k], axis);
+			}
+			float area = (x[1] - x[0]) * (y[2] - y[0]) - (x[2] - x[0]) * (y[1] - y[0]);
+			if (area == 0.0f) continue;
+			if (area < 0.0f) {
+				float swap = x[1]; x[1] = x[2]; x[2] = swap;
+				swap = y[1]; y[1] = y[2]; y[2] = swap;
+				swap = z[1]; z[1] = z[2]; z[2] = swap;
+				area = -area;
+			}
+			int x0 = (int)fmaxf(floorf(fminf(x[0], fminf(x[1], x[2]))), 0.0f), x1 = (int)fminf(ceilf(fmaxf(x[0], fmaxf(x[1], x[2]))), OVERDRAW_GRID - 1);
+			int y0 = (int)fmaxf(floorf(fminf(y[0], fminf(y[1], y[2]))), 0.0f), y1 = (int)fminf(ceilf(fmaxf(y[0], fmaxf(y[1], y[2]))), OVERDRAW_GRID - 1);
+			for (int py = y0; py <= y1; ++py) {
+				for (int px = x0; px <= x1; ++px) {
+					float cx = (float)px + 0.5f, cy = (float)py + 0.5f;
+					float b0 = (x[2] - x[1]) * (cy - y[1]) - (y[2] - y[1]) * (cx - x[1]);
+					float b1 = (x[0] - x[2]) * (cy - y[2]) - (y[0] - y[2]) * (cx - x[2]);
+					float b2 = (x[1] - x[0]) * (cy - y[0]) - (y[1] - y[0]) * (cx - x[0]);
+					if (b0 < 0.0f || b1 < 0.0f || b2 < 0.0f) continue;
+					float d = (b0 * z[0] + b1 * z[1] + b2 * z[2]) / area;
+					float* pixel = &depth[py * OVERDRAW_GRID + px];
+					if (d < *pixel) {
+						*pixel = d;
+						shaded++;
+					}
+				}
+			}
+		}
+		for (uint32_t i = 0; i < OVERDRAW_GRID * OVERDRAW_GRID; ++i) covered += depth[i] != FLT_MAX;
+	}
+	free(depth);
+	return covered ? (double)shaded / (double)covered : 0.0;
+}
+
+// Tipsify: fan around a vertex, then continue from a neighbor that will still be in the cache after
+// its own fan, else from the most recent vertex with triangles left, else the next one in order.
+static void tipsify(struct mesh* mesh, uint32_t cache_size)
+{
+	uint32_t triangle_count = mesh->index_count / 3;
+	uint32_t* offsets = allocate(mesh->vertex_count + 1, sizeof(uint32_t));
+	uint32_t* live = allocate(mesh->vertex_count, sizeof(uint32_t));
+	for (uint32_t i = 0; i < mesh->index_count; ++i) live[mesh->indices[i]]++;
+	uint32_t max_valence = 0;
+	for (uint32_t v = 0; v < mesh->vertex_count; ++v) {
+		offsets[v + 1] = offsets[v] + live[v];
+		if (live[v] > max_valence) max_valence = live[v];
+	}
+	uint32_t* fill = allocate(mesh->vertex_count, sizeof(uint32_t));
+	uint32_t* adjacency = allocate(mesh->index_count, sizeof(uint32_t));
+	for (uint32_t i = 0; i < mesh->index_count; ++i) adjacency[offsets[mesh->indices[i]] + fill[mesh->indices[i]]++] = i / 3;
+
+	uint32_t* cache_time = allocate(mesh->vertex_count, sizeof(uint32_t));
+	bool* emitted = allocate(triangle_count, sizeof(bool));
+	uint32_t* dead_end = allocate(mesh->index_count, sizeof(uint32_t));
+	uint32_t* candidates = allocate((size_t)max_valence * 3, sizeof(uint32_t));
+	uint32_t* output = allocate(mesh->index_count, sizeof(uint32_t));
+	uint32_t dead_end_count = 0, output_count = 0, cursor = 0;
+	uint32_t time = cache_size + 1;
+
+	uint32_t fan = 0;
+	while (fan < mesh->vertex_count && !live[fan]) fan++;
+	while (fan < mesh->vertex_count) {
+		uint32_t candidate_count = 0;
+		for (uint32_t a = offsets[fan]; a < offsets[fan + 1]; ++a) {
+			uint32_t t = adjacency[a];
+			if (emitted[t]) continue;
+			emitted[t] = true;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t v = mesh->indices[t * 3 + k];
+				output[output_count++] = v;
+				dead_end[dead_end_count++] = v;
+				candidates[candidate_count++] = v;
+				live[v]--;
+				cache_access(cache_time, &time, v, cache_size);
+			}
+		}
+
+		// the oldest candidate still in the cache once its remaining triangles are fanned
+		uint32_t next = NONE;
+		int64_t best = -1;
+		for (uint32_t c = 0; c < candidate_count; ++c) {
+			uint32_t v = candidates[c];
+			if (!live[v]) continue;
+			int64_t priority = 0;
+			if (time - cache_time[v] + 2 * live[v] <= cache_size) priority = time - cache_time[v];
+			if (priority > best) {
+				best = priority;
+				next = v;
+			}
+		}
+		while (next == NONE && dead_end_count) {
+			uint32_t v = dead_end[--dead_end_count];
+			if (live[v]) next = v;
+		}
+		while (next == NONE && cursor < mesh->vertex_count) {
+			if (live[cursor]) next = cursor;
+			cursor++;
+		}
+		fan = next == NONE ? mesh->vertex_count : next;
+	}
+	memcpy(mesh->indices, output, (size_t)output_count * sizeof(uint32_t));
+
+	free(offsets);
+	free(live);
+	free(fill);
+	free(adjacency);
+	free(cache_time);
+	free(emitted);
+	free(dead_end);
+	free(candidates);
+	free(output);
+}
+
+struct cluster
+{
+	uint32_t first; // triangle
+	uint32_t count;
+	float sort_key;
+};
+
+static int cluster_compare(const void* a, const void* b)
+{
+	const struct cluster* x = a;
+	const struct cluster* y = b;
+	if (x->sort_key != y->sort_key) return x->sort_key > y->sort_key ? -1 : 1;
+	return x->first < y->first ? -1 : x->first > y->first;
+}
+
+// Sander et al.'s overdraw pass over a cache optimized order: it is cut where the cache starts over
+// (all three vertices of a triangle miss), those pieces again wherever the running ACMR has come
+// down to threshold times their own, then the pieces facing away from the mesh's center are drawn
+// first, they are the ones likely to hide the rest. Returns the number of clusters, *restarts the
+// cache restarts.
+static uint32_t optimize_overdraw(struct mesh* mesh, uint32_t cache_size, float threshold, uint32_t* restarts)
+{
+	uint32_t triangle_count = mesh->index_count / 3;
+	uint32_t* timestamps = allocate(mesh->vertex_count, sizeof(uint32_t));
+	uint32_t* hard = allocate(triangle_count + 1, sizeof(uint32_t));
+	uint32_t hard_count = 0;
+	uint32_t time = cache_size + 1;
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		uint32_t misses = 0;
+		for (uint32_t k = 0; k < 3; ++k) misses += cache_access(timestamps, &time, mesh->indices[t * 3 + k], cache_size);
+		if (t == 0 || misses == 3) hard[hard_count++] = t;
+	}
+	hard[hard_count] = triangle_count;
+
+	struct cluster* clusters = allocate(triangle_count, sizeof(struct cluster));
+	uint32_t cluster_count = 0;
+	for (uint32_t h = 0; h < hard_count; ++h) {
+		uint32_t begin = hard[h], end = hard[h + 1];
+		// its ACMR on its own, from a flushed cache, then cut where the running one gets under the target
+		time += cache_size + 1;
+		uint32_t misses = 0;
+		for (uint32_t i = begin * 3; i < end * 3; ++i) misses += cache_access(timestamps, &time, mesh->indices[i], cache_size);
+		float target = threshold * (float)misses / (float)(end - begin);
+
+		uint32_t first_cluster = cluster_count;
+		clusters[cluster_count++] = (struct cluster){.first = begin};
+		time += cache_size + 1;
+		uint32_t running_misses = 0, running_triangles = 0;
+		for (uint32_t t = begin; t < end; ++t) {
+			for (uint32_t k = 0; k < 3; ++k) running_misses += cache_access(timestamps, &time, mesh->indices[t * 3 + k], cache_size);
+			running_triangles++;
+			if (t + 1 < end && (float)running_misses / (float)running_triangles <= target) {
+				clusters[cluster_count++] = (struct cluster){.first = t + 1};
+				time += cache_size + 1;
+				running_misses = 0;
+				running_triangles = 0;
+			}
+		}
+		// a tail that never came down goes back into the piece before it
+		if (cluster_count - first_cluster > 1 && (float)running_misses / (float)running_triangles > target) cluster_count--;
+	}
+	for (uint32_t c = 0; c < cluster_count; ++c)
+		clusters[c].count = (c + 1 < cluster_count ? clusters[c + 1].first : triangle_count) - clusters[c].first;
+
+	// area weighted centroids and normals
+	struct vec3 mesh_centroid = vec3_make(0.0f, 0.0f, 0.0f);
+	float mesh_area = 0.0f;
+	struct vec3* centroids = allocate(cluster_count, sizeof(struct vec3));
+	struct vec3* normals = allocate(cluster_count, sizeof(struct vec3));
+	for (uint32_t c = 0; c < cluster_count; ++c) {
+		float area = 0.0f;
+		for (uint32_t t = clusters[c].first; t < clusters[c].first + clusters[c].count; ++t) {
+			struct vec3 a = mesh->vertices[mesh->indices[t * 3]].position;
+			struct vec3 b = mesh->vertices[mesh->indices[t * 3 + 1]].position;
+			struct vec3 d = mesh->vertices[mesh->indices[t * 3 + 2]].position;
+			struct vec3 normal = vec3_cross(vec3_sub(b, a), vec3_sub(d, a));
+			float triangle_area = vec3_length(normal);
+			struct vec3 center = vec3_scale(vec3_add(vec3_add(a, b), d), 1.0f / 3.0f);
+			centroids[c] = vec3_add(centroids[c], vec3_scale(center, triangle_area));
+			normals[c] = vec3_add(normals[c], normal);
+			area += triangle_area;
+		}
+		mesh_centroid = vec3_add(mesh_centroid, centroids[c]);
+		mesh_area += area;
+		centroids[c] = area > 0.0f ? vec3_scale(centroids[c], 1.0f / area) : centroids[c];
+	}
+	if (mesh_area > 0.0f) mesh_centroid = vec3_scale(mesh_centroid, 1.0f / mesh_area);
+	for (uint32_t c = 0; c < cluster_count; ++c)
+		clusters[c].sort_key = vec3_dot(vec3_sub(centroids[c], mesh_centroid), vec3_normalize(normals[c]));
+	qsort(clusters, cluster_count, sizeof(struct cluster), cluster_compare);
+
+	uint32_t* output = allocate(mesh->index_count, sizeof(uint32_t));
+	uint32_t output_count = 0;
+	for (uint32_t c = 0; c < cluster_count; ++c) {
+		memcpy(output + output_count, mesh->indices + clusters[c].first * 3, (size_t)clusters[c].count * 3 * sizeof(uint32_t));
+		output_count += clusters[c].count * 3;
+	}
+	memcpy(mesh->indices, output, (size_t)output_count * sizeof(uint32_t));
+	*restarts = hard_count;
+
+	free(timestamps);
+	free(hard);
+	free(clusters);
+	free(centroids);
+	free(normals);
+	free(output);
+	return cluster_count;
+}
+
+// Greedy meshlets over a level's triangles: one grows by the triangle next to it that adds the
+// fewest vertices, of those the one whose normal is nearest the meshlet's, nearest its center and
+// with the fewest triangles left around it, until it is full or nothing next to it fits. The next
+// starts next to the one before, where the fewest triangles are left, so none are stranded; the
+// first, and any after a part of the mesh ran out, at the first triangle left in the current order.
+// The level's triangles are reordered meshlet by meshlet, each keeping its triangles in their order
+// so the caches see little change, and with outward_first the meshlets sorted like the overdraw
+// pass sorts its clusters. Appends the meshlets' triangle counts to *counts, returns how many.
+static uint32_t build_meshlets(struct mesh* level, bool outward_first, uint8_t** counts, uint32_t* count_capacity, uint32_t count_used)
+{
+	uint32_t triangle_count = level->index_count / 3;
+	uint32_t* first = allocate(level->vertex_count + 1, sizeof(uint32_t));
+	for (uint32_t i = 0; i < level->index_count; ++i) first[level->indices[i] + 1]++;
+	for (uint32_t v = 0; v < level->vertex_count; ++v) first[v + 1] += first[v];
+	uint32_t* around = allocate(level->index_count, sizeof(uint32_t));
+	uint32_t* live = allocate(level->vertex_count, sizeof(uint32_t)); // triangles not taken around each vertex
+	for (uint32_t i = 0; i < level->index_count; ++i) around[first[level->indices[i]] + live[level->indices[i]]++] = i / 3;
+	struct vec3* normals = allocate(triangle_count, sizeof(struct vec3));
+	struct vec3* centers = allocate(triangle_count, sizeof(struct vec3));
+	for (uint32_t t = 0; t < triangle_count; ++t) {
+		struct vec3 a = level->vertices[level->indices[t * 3]].position;
+		struct vec3 b = level->vertices[level->indices[t * 3 + 1]].position;
+		struct vec3 c = level->vertices[level->indices[t * 3 + 2]].position;
+		normals[t] = vec3_normalize(vec3_cross(vec3_sub(b, a), vec3_sub(c, a)));
+		centers[t] = vec3_scale(vec3_add(vec3_add(a, b), c), 1.0f / 3.0f);
+	}
+
+	uint32_t* slot = allocate(level->vertex_count, sizeof(uint32_t)); // in the current meshlet, NONE when not
+	memset(slot, 0xff, (size_t)level->vertex_count * sizeof(uint32_t));
+	bool* taken = allocate(triangle_count, sizeof(bool));
+	uint32_t* listed = allocate(triangle_count, sizeof(uint32_t)); // meshlet + 1 that has it as a candidate
+	uint32_t* candidates = allocate(triangle_count, sizeof(uint32_t));
+	uint32_t* order = allocate(triangle_count, sizeof(uint32_t));
+	uint32_t ordered = 0;
+	struct cluster* meshlets = allocate(triangle_count, sizeof(struct cluster));
+	uint32_t meshlet_count = 0;
+	uint32_t scan = 0;
+	uint32_t seed = NONE;
+	while (ordered < triangle_count) {
+		if (seed == NONE) {
+			while (taken[scan]) scan++;
+			seed = scan;
+		}
+		uint32_t vertices[MESHLET_MAX_VERTICES];
+		uint32_t* triangles = order + ordered;
+		uint32_t vertex_count = 0, count = 0, candidate_count = 0;
+		struct vec3 normal_sum = vec3_make(0.0f, 0.0f, 0.0f), center_sum = normal_sum;
+		for (uint32_t next = seed; next != NONE; ) {
+			taken[next] = true;
+			triangles[count++] = next;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t v = level->indices[next * 3 + k];
+				live[v]--;
+				if (slot[v] != NONE) continue;
+				slot[v] = vertex_count;
+				vertices[vertex_count++] = v;
+				for (uint32_t a = first[v]; a < first[v + 1]; ++a) {
+					if (taken[around[a]] || listed[around[a]] == meshlet_count + 1) continue;
+					listed[around[a]] = meshlet_count + 1;
+					candidates[candidate_count++] = around[a];
+				}
+			}
+			normal_sum = vec3_add(normal_sum, normals[next]);
+			center_sum = vec3_add(center_sum, centers[next]);
+			if (count == MESHLET_MAX_TRIANGLES) break;
+
+			struct vec3 axis = vec3_normalize(normal_sum);
+			struct vec3 center = vec3_scale(center_sum, 1.0f / (float)count);
+			float radius = 0.0f;
+			for (uint32_t i = 0; i < vertex_count; ++i) radius = fmaxf(radius, vec3_length(vec3_sub(level->vertices[vertices[i]].position, center)));
+			float best = FLT_MAX;
+			next = NONE;
+			for (uint32_t i = 0; i < candidate_count; ++i) {
+				uint32_t t = candidates[i];
+				if (taken[t]) {
+					candidates[i--] = candidates[--candidate_count];
+					continue;
+				}
+				uint32_t added = 0, left = 0;
+				for (uint32_t k = 0; k < 3; ++k) {
+					added += slot[level->indices[t * 3 + k]] == NONE;
+					left += live[level->indices[t * 3 + k]];
+				}
+				if (vertex_count + added > MESHLET_MAX_VERTICES) continue;
+				float spread = 1.0f - vec3_dot(normals[t], axis);
+				float distance = radius > 0.0f ? vec3_length(vec3_sub(centers[t], center)) / radius : 0.0f;
+				float score = (float)added + MESHLET_CONE_WEIGHT * spread + MESHLET_DISTANCE_WEIGHT * distance + MESHLET_LIVE_WEIGHT * (float)left;
+				if (score < best) {
+					best = score;
+					next = t;
+				}
+			}
+		}
+
+		// the next seed on this one's border, where the least is left
+		seed = NONE;
+		uint32_t fewest = UINT32_MAX;
+		for (uint32_t i = 0; i < vertex_count; ++i) {
+			uint32_t v = vertices[i];
+			slot[v] = NONE;
+			for (uint32_t a = first[v]; a < first[v + 1]; ++a) {
+				uint32_t t = around[a];
+				if (taken[t]) continue;
+				uint32_t left = live[level->indices[t * 3]] + live[level->indices[t * 3 + 1]] + live[level->indices[t * 3 + 2]];
+				if (left < fewest) {
+					fewest = left;
+					seed = t;
+				}
+			}
+		}
+		for (uint32_t i = 1; i < count; ++i) {
+			uint32_t t = triangles[i], j = i;
+			for (; j > 0 && triangles[j - 1] > t; --j) triangles[j] = triangles[j - 1];
+			triangles[j] = t;
+		}
+		meshlets[meshlet_count++] = (struct cluster){.first = ordered, .count = count};
+		ordered += count;
+	}
+
+	// outward facing first: centroid from the mesh's along the normal, both area weighted
+	if (outward_first) {
+		struct vec3 mesh_centroid = vec3_make(0.0f, 0.0f, 0.0f);
+		float mesh_area = 0.0f;
+		struct vec3* centroids = allocate(meshlet_count, sizeof(struct vec3));
+		struct vec3* sums = allocate(meshlet_count, sizeof(struct vec3));
+		for (uint32_t m = 0; m < meshlet_count; ++m) {
+			struct vec3 centroid = vec3_make(0.0f, 0.0f, 0.0f);
+			float area = 0.0f;
+			for (uint32_t i = meshlets[m].first; i < meshlets[m].first + meshlets[m].count; ++i) {
+				const uint32_t* t = level->indices + order[i] * 3;
+				struct vec3 a = level->vertices[t[0]].position, b = level->vertices[t[1]].position, c = level->vertices[t[2]].position;
+				struct vec3 normal = vec3_cross(vec3_sub(b, a), vec3_sub(c, a));
+				float triangle_area = vec3_length(normal);
+				centroid = vec3_add(centroid, vec3_scale(centers[order[i]], triangle_area));
+				sums[m] = vec3_add(sums[m], normal);
+				area += triangle_area;
+			}
+			mesh_centroid = vec3_add(mesh_centroid, centroid);
+			mesh_area += area;
+			centroids[m] = area > 0.0f ? vec3_scale(centroid, 1.0f / area) : centroid;
+		}
+		if (mesh_area > 0.0f) mesh_centroid = vec3_scale(mesh_centroid, 1.0f / mesh_area);
+		for (uint32_t m = 0; m < meshlet_count; ++m) meshlets[m].sort_key = vec3_dot(vec3_sub(centroids[m], mesh_centroid), vec3_normalize(sums[m]));
+		qsort(meshlets, meshlet_count, sizeof(struct cluster), cluster_compare);
+		free(centroids);
+		free(sums);
+	}
+
+	uint32_t* indices = allocate(level->index_count, sizeof(uint32_t));
+	uint32_t written = 0;
+	*counts = grow(*counts, count_capacity, count_used, meshlet_count, sizeof(uint8_t));
+	for (uint32_t m = 0; m < meshlet_count; ++m) {
+		for (uint32_t i = meshlets[m].first; i < meshlets[m].first + meshlets[m].count; ++i)
+			memcpy(indices + written++ * 3, level->indices + order[i] * 3, 3 * sizeof(uint32_t));
+		(*counts)[count_used + m] = (uint8_t)meshlets[m].count;
+	}
+	memcpy(level->indices, indices, (size_t)level->index_count * sizeof(uint32_t));
+	free(indices);
+	free(meshlets);
+	free(first);
+	free(around);
+	free(live);
+	free(normals);
+	free(centers);
+	free(slot);
+	free(taken);
+	free(listed);
+	free(candidates);
+	free(order);
+	return meshlet_count;
+}
+
+struct meshlets
+{
+	struct mesh_blob_meshlet* meshlets;
+	uint32_t count;
+	uint16_t* vertices;
+	uint32_t vertex_count;
+	uint32_t* triangles;    // one per triangle of the indices
+	struct vec3* axes;      // the cones' axes as the runtime decodes them, for the report
+	struct vec3* positions; // of the vertices as the format stores them, the same
+};
+
+// The cone axis the runtime reads.
+static struct vec3 meshlet_axis(const struct mesh_blob_meshlet* meshlet)
+{
+	return vec3_normalize(vec3_make(meshlet->cone_axis[0] / 127.0f, meshlet->cone_axis[1] / 127.0f, meshlet->cone_axis[2] / 127.0f));
+}
+
+// The meshlets' vertices, packed triangles, bounding spheres and normal cones, with the positions as
+// format stores them so culling agrees with what the GPU draws. The meshlets cover the indices in
+// order, triangle_counts long each.
+static void meshlet_data(const struct mesh* mesh, enum vertex_format format, const uint8_t* triangle_counts, uint32_t meshlet_count, struct meshlets* out)
+{
+	uint8_t* encoded = allocate(vertex_buffer_bytes(format, mesh->vertex_count), 1);
+	vertex_encode(format, mesh->vertices, mesh->vertex_count, encoded);
+	struct vec3* positions = allocate(mesh->vertex_count, sizeof(struct vec3));
+	for (uint32_t i = 0; i < mesh->vertex_count; ++i) positions[i] = vertex_decode(encoded, i).position;
+	free(encoded);
+
+	uint32_t* slot = allocate(mesh->vertex_count, sizeof(uint32_t));
+	memset(slot, 0xff, (size_t)mesh->vertex_count * sizeof(uint32_t));
+	*out = (struct meshlets){
+		.meshlets = allocate(meshlet_count, sizeof(struct mesh_blob_meshlet)),
+		.count = meshlet_count,
+		.vertices = allocate((size_t)meshlet_count * MESHLET_MAX_VERTICES, sizeof(uint16_t)),
+		.triangles = allocate(mesh->index_count / 3, sizeof(uint32_t)),
+		.axes = allocate(meshlet_count, sizeof(struct vec3)),
+		.positions = positions,
+	};
+	uint32_t first_triangle = 0;
+	for (uint32_t m = 0; m < meshlet_count; ++m) {
+		struct mesh_blob_meshlet* meshlet = &out->meshlets[m];
+		uint16_t* vertices = out->vertices + out->vertex_count;
+		uint32_t vertex_count = 0;
+		struct vec3 min = vec3_make(FLT_MAX, FLT_MAX, FLT_MAX), max = vec3_make(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		struct vec3 normal_sum = vec3_make(0.0f, 0.0f, 0.0f);
+		for (uint32_t t = first_triangle; t < first_triangle + triangle_counts[m]; ++t) {
+			uint32_t packed = 0;
+			for (uint32_t k = 0; k < 3; ++k) {
+				uint32_t v = mesh->indices[t * 3 + k];
+				if (slot[v] == NONE) {
+					slot[v] = vertex_count;
+					vertices[vertex_count++] = (uint16_t)v;
+					min = vec3_make(fminf(min.x, positions[v].x), fminf(min.y, positions[v].y), fminf(min.z, positions[v].z));
+					max = vec3_make(fmaxf(max.x, positions[v].x), fmaxf(max.y, positions[v].y), fmaxf(max.z, positions[v].z));
+				}
+				packed |= slot[v] << (k * 8);
+			}
+			out->triangles[t] = packed;
+			struct vec3 a = positions[mesh->indices[t * 3]], b = positions[mesh->indices[t * 3 + 1]], c = positions[mesh->indices[t * 3 + 2]];
+			normal_sum = vec3_add(normal_sum, vec3_normalize(vec3_cross(vec3_sub(b, a), vec3_sub(c, a))));
+		}
+		struct vec3 center = vec3_scale(vec3_add(min, max), 0.5f);
+		float radius = 0.0f;
+		for (uint32_t i = 0; i < vertex_count; ++i) {
+			radius = fmaxf(radius, vec3_length(vec3_sub(positions[vertices[i]], center)));
+			slot[vertices[i]] = NONE;
+		}
+
+		// the axis quantized first, the spread measured from what the runtime reads and rounded up
+		struct vec3 axis = vec3_normalize(normal_sum);
+		*meshlet = (struct mesh_blob_meshlet){
+			.center = {center.x, center.y, center.z},
+			.radius = radius,
+			.cone_axis = {(int8_t)lrintf(axis.x * 127.0f), (int8_t)lrintf(axis.y * 127.0f), (int8_t)lrintf(axis.z * 127.0f)},
+			.cone_cutoff = 127,
+			.first_vertex = out->vertex_count,
+			.first_triangle = first_triangle,
+			.vertex_count = (uint8_t)vertex_count,
+			.triangle_count = triangle_counts[m],
+		};
+		out->axes[m] = meshlet_axis(meshlet);
+		float min_dot = vec3_length(normal_sum) > 0.0f ? 1.0f : -1.0f;
+		for (uint32_t t = first_triangle; t < first_triangle + triangle_counts[m]; ++t) {
+			struct vec3 a = positions[mesh->indices[t * 3]], b = positions[mesh->indices[t * 3 + 1]], c = positions[mesh->indices[t * 3 + 2]];
+			struct vec3 normal = vec3_cross(vec3_sub(b, a), vec3_sub(c, a));
+			if (vec3_length(normal) > 0.0f) min_dot = fminf(min_dot, vec3_dot(vec3_normalize(normal), out->axes[m]));
+		}
+		if (min_dot > 0.0f) meshlet->cone_cutoff = (int8_t)fminf(ceilf(sqrtf(1.0f - min_dot * min_dot) * 127.0f), 127.0f);
+
+		out->vertex_count += vertex_count;
+		first_triangle += triangle_counts[m];
+	}
+	free(slot);
+}
+
+// Of the meshlets first to first + count, orthographic from the 26 directions to a cube's faces,
+// edges and corners: the share of meshlets and triangles the cones reject, and of triangles facing
+// away, all a per triangle test would. Fails when a cone rejects a triangle facing the view.
+static void report_meshlets(const struct mesh* mesh, const struct meshlets* meshlets, uint32_t first, uint32_t count)
+{
+	uint64_t tested = 0, culled = 0, triangles = 0, culled_triangles = 0, facing_away = 0;
+	uint32_t vertices = 0, level_triangles = 0;
+	for (uint32_t m = first; m < first + count; ++m) {
+		vertices += meshlets->meshlets[m].vertex_count;
+		level_triangles += meshlets->meshlets[m].triangle_count;
+	}
+	for (int x = -1; x <= 1; ++x) {
+		for (int y = -1; y <= 1; ++y) {
+			for (int z = -1; z <= 1; ++z) {
+				if (!x && !y && !z) continue;
+				struct vec3 view = vec3_normalize(vec3_make((float)x, (float)y, (float)z));
+				for (uint32_t m = first; m < first + count; ++m) {
+					const struct mesh_blob_meshlet* meshlet = &meshlets->meshlets[m];
+					bool rejected = meshlet->cone_cutoff < 127 && vec3_dot(meshlets->axes[m], view) > meshlet->cone_cutoff / 127.0f;
+					tested++;
+					culled += rejected;
+					triangles += meshlet->triangle_count;
+					culled_triangles += rejected ? meshlet->triangle_count : 0;
+					for (uint32_t t = meshlet->first_triangle; t < meshlet->first_triangle + meshlet->triangle_count; ++t) {
+						struct vec3 a = meshlets->positions[mesh->indices[t * 3]];
+						struct vec3 b = meshlets->positions[mesh->indices[t * 3 + 1]];
+						struct vec3 c = meshlets->positions[mesh->indices[t * 3 + 2]];
+						float facing = vec3_dot(vec3_cross(vec3_sub(b, a), vec3_sub(c, a)), view);
+						facing_away += facing >= 0.0f;
+						if (rejected && facing < -1e-6f * vec3_length(vec3_sub(b, a)) * vec3_length(vec3_sub(c, a)))
+							fail("meshlet %u's cone rejects a triangle facing the view", m);
+					}
+				}
+			}
+		}
+	}
+	printf("%-10s %u meshlets of %.1f vertices and %.1f triangles on average, cones reject %.1f%% of them, %.1f%% of the triangles, of %.1f%% facing away\n",
+	       "", count, (double)vertices / count, (double)level_triangles / count, 100.0 * (double)culled / (double)tested,
+	       100.0 * (double)culled_triangles / (double)triangles, 100.0 * (double)facing_away / (double)triangles);
+}
+
+// Vertices in the order the indices first use them, unused ones dropped.
+static void optimize_fetch(struct mesh* mesh)
+{
+	uint32_t* remap = allocate(mesh->vertex_count, sizeof(uint32_t));
+	memset(remap, 0xff, (size_t)mesh->vertex_count * sizeof(uint32_t));
+	struct vertex_input* vertices = allocate(mesh->vertex_count, sizeof(struct vertex_input));
+	uint32_t count = 0;
+	for (uint32_t i = 0; i < mesh->index_count; ++i) {
+		uint32_t v = mesh->indices[i];
+		if (remap[v] == NONE) {
+			remap[v] = count;
+			vertices[count++] = mesh->vertices[v];
+		}
+		mesh->indices[i] = remap[v];
+	}
+	free(mesh->vertices);
+	free(remap);
+	mesh->vertices = vertices;
+	mesh->vertex_count = count;
+}
+
+struct metrics
+{
+	float acmr;
+	float atvr;
+	float overfetch;
+	float overdraw;
+};
+
+static struct metrics report(const char* step, const struct mesh* mesh, uint32_t stride, uint32_t cache_size)
+{
+	uint32_t misses = cache_misses(mesh, cache_size);
+	struct metrics metrics = {
+		.acmr = mesh->index_count ? (float)misses / (float)(mesh->index_count / 3) : 0.0f,
+		.atvr = mesh->vertex_count ? (float)misses / (float)mesh->vertex_count : 0.0f,
+		.overfetch = (float)vertex_overfetch(mesh, stride, cache_size),
+		.overdraw = (float)measure_overdraw(mesh),
+	};
+	printf("%-10s %8u %9u %7.3f %7.3f %10.3f %9.3f\n", step, mesh->vertex_count, mesh->index_count / 3, metrics.acmr, metrics.atvr, metrics.overfetch,
+	       metrics.overdraw);
+	return metrics;
+}
+
+// mesh's indices are those of the levels one after the other, the meshlets cover them in order.
+static void write_blob(const char* path, const struct mesh* mesh, const struct mesh_blob_lod* lods, uint32_t lod_count, const struct meshlets* meshlets,
+		       enum vertex_format format, uint32_t cache_size, struct metrics metrics)
+{
+	struct mesh_blob_header header = {
+		.magic = MESH_BLOB_MAGIC,
+		.version = MESH_BLOB_VERSION,
+		.format = format,
+		.vertex_count = mesh->vertex_count,
+		.index_count = mesh->index_count,
+		.cache_size = cache_size,
+		.vertex_offset = sizeof(struct mesh_blob_header),
+		.vertex_bytes = vertex_buffer_bytes(format, mesh->vertex_count),
+		.bounds_min = {FLT_MAX, FLT_MAX, FLT_MAX},
+		.bounds_max = {-FLT_MAX, -FLT_MAX, -FLT_MAX},
+		.acmr = metrics.acmr,
+		.atvr = metrics.atvr,
+		.overdraw = metrics.overdraw,
+		.lod_count = lod_count,
+		.meshlet_count = meshlets->count,
+		.meshlet_vertex_count = meshlets->vertex_count,
+	};
+	memcpy(header.lods, lods, lod_count * sizeof(struct mesh_blob_lod));
+	header.index_offset = (header.vertex_offset + header.vertex_bytes + 3) & ~(uint64_t)3;
+	header.meshlet_offset = (header.index_offset + (uint64_t)mesh->index_count * sizeof(uint16_t) + 15) & ~(uint64_t)15;
+	header.meshlet_vertex_offset = header.meshlet_offset + (uint64_t)meshlets->count * sizeof(struct mesh_blob_meshlet);
+	header.meshlet_triangle_offset = (header.meshlet_vertex_offset + (uint64_t)meshlets->vertex_count * sizeof(uint16_t) + 3) & ~(uint64_t)3;
+	header.file_size = header.meshlet_triangle_offset + (uint64_t)mesh->index_count / 3 * sizeof(uint32_t);
+	for (uint32_t i = 0; i < mesh->vertex_count; ++i) {
+		struct vec3 p = mesh->vertices[i].position;
+		float values[3] = {p.x, p.y, p.z};
+		for (int k = 0; k < 3; ++k) {
+			header.bounds_min[k] = fminf(header.bounds_min[k], values[k]);
+			header.bounds_max[k] = fmaxf(header.bounds_max[k], values[k]);
+		}
+	}
+
+	uint8_t* blob = allocate(header.file_size, 1);
+	memcpy(blob, &header, sizeof(header));
+	vertex_encode(format, mesh->vertices, mesh->vertex_count, blob + header.vertex_offset);
+	for (uint32_t i = 0; i < mesh->index_count; ++i) {
+		uint16_t index = (uint16_t)mesh->indices[i];
+		memcpy(blob + header.index_offset + i * sizeof(index), &index, sizeof(index));
+	}
+	memcpy(blob + header.meshlet_offset, meshlets->meshlets, (size_t)meshlets->count * sizeof(struct mesh_blob_meshlet));
+	memcpy(blob + header.meshlet_vertex_offset, meshlets->vertices, (size_t)meshlets->vertex_count * sizeof(uint16_t));
+	memcpy(blob + header.meshlet_triangle_offset, meshlets->triangles, (size_t)mesh->index_count / 3 * sizeof(uint32_t));
+	if (!mesh_blob_validate(blob, header.file_size)) fail("the cooked mesh does not validate");
+
+	FILE* file = fopen(path, "wb");
+	if (!file || fwrite(blob, 1, header.file_size, file) != header.file_size || fclose(file)) fail("cannot write %s", path);
+	printf("wrote %s: %s vertices, %u bytes each, %.1f KB\n", path, vertex_format_names[format], vertex_formats[format].stride,
+	       (double)header.file_size / 1024.0);
+	free(blob);
+}
+
+static bool ends_with(const char* string, const char* suffix)
+{
+	size_t length = strlen(string), suffix_length = strlen(suffix);
+	if (length < suffix_length) return false;
+	for (size_t i = 0; i < suffix_length; ++i) {
+		char c = string[length - suffix_length + i];
+		if ((c >= 'A' && c <= 'Z' ? c - 'A' + 'a' : c) != suffix[i]) return false;
+	}
+	return true;
+}
+
+// A level's vertices and ACMR.
+static uint32_t lod_vertices(const struct mesh* mesh, const struct mesh_blob_lod* lod, uint32_t cache_size, float* acmr)
+{
+	bool* used = allocate(mesh->vertex_count, sizeof(bool));
+	uint32_t count = 0;
+	for (uint32_t i = lod->first_index; i < lod->first_index + lod->index_count; ++i) {
+		count += !used[mesh->indices[i]];
+		used[mesh->indices[i]] = true;
+	}
+	free(used);
+	struct mesh view = {.vertices = mesh->vertices, .vertex_count = mesh->vertex_count, .indices = mesh->indices + lod->first_index, .index_count = lod->index_count};
+	*acmr = (float)cache_misses(&view, cache_size) / (float)(lod->index_count / 3);
+	return count;
+}
+
+int main(int argc, char** argv)
+{
+	enum vertex_format format = VERTEX_FORMAT_SNORM16;
+	uint32_t cache_size = 16;
+	bool overdraw = true;
+	float threshold = 1.05f;
+	uint32_t max_lods = MESH_BLOB_MAX_LODS;
+	float lod_ratio = 0.5f;
+	float lod_error = 0.05f;
+	float attribute_weight = 0.05f;
+	const char* paths[2] = {NULL, NULL};
+	uint32_t path_count = 0;
+	for (int i = 1; i < argc; ++i) {
+		if (!strcmp(argv[i], "--format") && i + 1 < argc) {
+			const char* name = argv[++i];
+			uint32_t f = 0;
+			while (f < VERTEX_FORMAT_COUNT && strcmp(vertex_format_names[f], name)) f++;
+			if (f == VERTEX_FORMAT_COUNT) fail("unknown vertex format %s", name);
+			format = (enum vertex_format)f;
+		} else if (!strcmp(argv[i], "--cache") && i + 1 < argc) {
+			cache_size = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (cache_size < 3) fail("the cache needs at least three entries");
+		} else if (!strcmp(argv[i], "--threshold") && i + 1 < argc) {
+			threshold = strtof(argv[++i], NULL);
+		} else if (!strcmp(argv[i], "--no-overdraw")) {
+			overdraw = false;
+		} else if (!strcmp(argv[i], "--lods") && i + 1 < argc) {
+			max_lods = (uint32_t)strtoul(argv[++i], NULL, 10);
+			if (max_lods < 1 || max_lods > MESH_BLOB_MAX_LODS) fail("between 1 and %u levels of detail", MESH_BLOB_MAX_LODS);
+		} else if (!strcmp(argv[i], "--lod-ratio") && i + 1 < argc) {
+			lod_ratio = strtof(argv[++i], NULL);
+			if (!(lod_ratio > 0.0f && lod_ratio < 1.0f)) fail("the level of detail ratio is between 0 and 1");
+		} else if (!strcmp(argv[i], "--lod-error") && i + 1 < argc) {
+			lod_error = strtof(argv[++i], NULL);
+		} else if (!strcmp(argv[i], "--attribute-weight") && i + 1 < argc) {
+			attribute_weight = strtof(argv[++i], NULL);
+		} else if (argv[i][0] != '-' && path_count < 2) {
+			paths[path_count++] = argv[i];
+		} else {
+			path_count = 0;
+			break;
+		}
+	}
+	if (path_count != 2) {
+		fprintf(stderr, "usage: mesh_cooker [--format FLOAT4|FLOAT3|SNORM16|HALF] [--cache N] [--no-overdraw] [--threshold T]\n"
+				"                   [--lods N] [--lod-ratio R] [--lod-error E] [--attribute-weight W] input.obj|.gltf|.glb output\n");
+		return 1;
+	}
+
+	uint64_t size;
+	uint8_t* file = read_file(paths[0], &size);
+	struct corners corners = {0};
+	if (ends_with(paths[0], ".obj")) load_obj((const char*)file, &corners);
+	else if (ends_with(paths[0], ".gltf") || ends_with(paths[0], ".glb")) load_gltf(paths[0], file, size, &corners);
+	else fail("%s: only .obj, .gltf and .glb", paths[0]);
+	free(file);
+	if (!corners.count) fail("%s has no triangles", paths[0]);
+
+	uint32_t stride = vertex_formats[format].stride;
+	printf("%s: %u triangles, FIFO cache of %u\n", paths[0], corners.count / 3, cache_size);
+	printf("%-10s %8s %9s %7s %7s %10s %9s\n", "step", "vertices", "triangles", "ACMR", "ATVR", "overfetch", "overdraw");
+	struct mesh unwelded = {.vertices = corners.vertices, .vertex_count = corners.count, .index_count = corners.count};
+	unwelded.indices = allocate(corners.count, sizeof(uint32_t));
+	for (uint32_t i = 0; i < corners.count; ++i) unwelded.indices[i] = i;
+	report("input", &unwelded, stride, cache_size);
+	free(unwelded.indices);
+
+	struct mesh mesh;
+	uint32_t degenerate = weld(&corners, &mesh);
+	free(corners.vertices);
+	if (degenerate) printf("%-10s %u degenerate triangles dropped\n", "", degenerate);
+	if (!mesh.index_count) fail("%s has only degenerate triangles", paths[0]);
+	report("weld", &mesh, stride, cache_size);
+
+	// every level lod_ratio of the one before, until a level would cost or measure more than lod_error
+	struct mesh_blob_lod lods[MESH_BLOB_MAX_LODS] = {{.index_count = mesh.index_count}};
+	uint32_t lod_count = 1;
+	if (max_lods > 1) {
+		struct vec3 min = vec3_make(FLT_MAX, FLT_MAX, FLT_MAX), max = vec3_make(-FLT_MAX, -FLT_MAX, -FLT_MAX);
+		for (uint32_t i = 0; i < mesh.vertex_count; ++i) {
+			struct vec3 p = mesh.vertices[i].position;
+			min = vec3_make(fminf(min.x, p.x), fminf(min.y, p.y), fminf(min.z, p.z));
+			max = vec3_make(fmaxf(max.x, p.x), fmaxf(max.y, p.y), fmaxf(max.z, p.z));
+		}
+		float radius = vec3_length(vec3_scale(vec3_sub(max, min), 0.5f)); // as simplifier_init() scales errors
+		struct triangle_grid full;
+		grid_build(&full, mesh.vertices, mesh.indices, mesh.index_count, min, max);
+		struct simplifier simplifier;
+		simplifier_init(&simplifier, &mesh, attribute_weight);
+		uint32_t* indices = NULL;
+		uint32_t index_capacity = 0;
+		uint32_t total = mesh.index_count;
+		while (lod_count < max_lods) {
+			uint32_t previous = lods[lod_count - 1].index_count / 3;
+			simplify(&simplifier, &mesh, (uint32_t)((float)previous * lod_ratio), lod_error);
+			// too little left to gain, the error limit stopped it early
+			if (simplifier.index_count == 0 || (float)simplifier.index_count / 3.0f > (float)previous * (1.0f + lod_ratio) * 0.5f) break;
+			// the quadrics underestimate what many collapses add up to, the measured distance decides
+			float error = fmaxf(lod_distance(&full, &mesh, simplifier.indices, simplifier.index_count, min, max), lods[lod_count - 1].error);
+			if (error > lod_error * radius) {
+				printf("%-10s level %u dropped, %.3f%% of the radius measured\n", "", lod_count, radius > 0.0f ? 100.0 * error / radius : 0.0);
+				break;
+			}
+			indices = grow(indices, &index_capacity, total - mesh.index_count, simplifier.index_count, sizeof(uint32_t));
+			memcpy(indices + total - mesh.index_count, simplifier.indices, (size_t)simplifier.index_count * sizeof(uint32_t));
+			lods[lod_count] = (struct mesh_blob_lod){
+				.first_index = total,
+				.index_count = simplifier.index_count,
+				.error = error,
+			};
+			total += simplifier.index_count;
+			lod_count++;
+		}
+		simplifier_free(&simplifier);
+		grid_free(&full);
+		mesh.indices = realloc(mesh.indices, (size_t)total * sizeof(uint32_t));
+		if (!mesh.indices) fail("out of memory");
+		memcpy(mesh.indices + mesh.index_count, indices, (size_t)(total - mesh.index_count) * sizeof(uint32_t));
+		mesh.index_count = total;
+		free(indices);
+	}
+
+	// the steps per level, the table follows the full one
+	struct mesh full = {.vertices = mesh.vertices, .vertex_count = mesh.vertex_count, .indices = mesh.indices, .index_count = lods[0].index_count};
+	for (uint32_t i = 0; i < lod_count; ++i) {
+		struct mesh level = {.vertices = mesh.vertices, .vertex_count = mesh.vertex_count, .indices = mesh.indices + lods[i].first_index, .index_count = lods[i].index_count};
+		tipsify(&level, cache_size);
+	}
+	struct metrics metrics = report("tipsify", &full, stride, cache_size);
+	if (overdraw) {
+		uint32_t clusters = 0, restarts = 0;
+		for (uint32_t i = 0; i < lod_count; ++i) {
+			struct mesh level = {.vertices = mesh.vertices, .vertex_count = mesh.vertex_count, .indices = mesh.indices + lods[i].first_index, .index_count = lods[i].index_count};
+			uint32_t level_restarts;
+			uint32_t level_clusters = optimize_overdraw(&level, cache_size, threshold, &level_restarts);
+			if (i == 0) {
+				clusters = level_clusters;
+				restarts = level_restarts;
+			}
+		}
+		metrics = report("overdraw", &full, stride, cache_size);
+		printf("%-10s %u clusters from %u cache restarts\n", "", clusters, restarts);
+	}
+	// every level's triangles made consecutive per meshlet, their data once the vertices are final
+	double meshlet_begin = seconds();
+	uint8_t* meshlet_triangles = NULL;
+	uint32_t meshlet_capacity = 0, meshlet_count = 0;
+	for (uint32_t i = 0; i < lod_count; ++i) {
+		struct mesh level = {.vertices = mesh.vertices, .vertex_count = mesh.vertex_count, .indices = mesh.indices + lods[i].first_index, .index_count = lods[i].index_count};
+		lods[i].first_meshlet = meshlet_count;
+		lods[i].meshlet_count = build_meshlets(&level, overdraw, &meshlet_triangles, &meshlet_capacity, meshlet_count);
+		meshlet_count += lods[i].meshlet_count;
+	}
+	double meshlet_seconds = seconds() - meshlet_begin;
+	metrics = report("meshlets", &full, stride, cache_size);
+	// the full level uses every vertex, the others a subset: its order decides
+	optimize_fetch(&mesh);
+	full.vertices = mesh.vertices;
+	full.vertex_count = mesh.vertex_count;
+	full.indices = mesh.indices;
+	metrics = report("fetch", &full, stride, cache_size);
+	if (mesh.vertex_count > 0x10000) fail("%u vertices, the runtime's 16-bit indices address 65536: split the mesh", mesh.vertex_count);
+	meshlet_begin = seconds();
+	struct meshlets meshlets;
+	meshlet_data(&mesh, format, meshlet_triangles, meshlet_count, &meshlets);
+	meshlet_seconds += seconds() - meshlet_begin;
+	printf("%-10s %u meshlets in all levels, built in %.1f ms (%.1f M triangles/s)\n", "", meshlet_count, meshlet_seconds * 1e3,
+	       meshlet_seconds > 0.0 ? (double)mesh.index_count / 3.0 / meshlet_seconds / 1e6 : 0.0);
+	report_meshlets(&mesh, &meshlets, 0, lods[0].meshlet_count);
+
+	if (lod_count > 1) {
+		struct vec3 min = mesh.vertices[0].position, max = min;
+		for (uint32_t i = 0; i < mesh.vertex_count; ++i) {
+			struct vec3 p = mesh.vertices[i].position;
+			min = vec3_make(fminf(min.x, p.x), fminf(min.y, p.y), fminf(min.z, p.z));
+			max = vec3_make(fmaxf(max.x, p.x), fmaxf(max.y, p.y), fmaxf(max.z, p.z));
+		}
+		float radius = vec3_length(vec3_scale(vec3_sub(max, min), 0.5f)); // what the runtime divides by
+		printf("%-10s %8s %9s %7s %12s %9s %8s\n", "lod", "vertices", "triangles", "ACMR", "error", "of radius", "meshlets");
+		for (uint32_t i = 0; i < lod_count; ++i) {
+			float acmr;
+			uint32_t vertices = lod_vertices(&mesh, &lods[i], cache_size, &acmr);
+			printf("%-10u %8u %9u %7.3f %12.4g %8.3f%% %8u\n", i, vertices, lods[i].index_count / 3, acmr, (double)lods[i].error,
+			       radius > 0.0f ? 100.0 * lods[i].error / radius : 0.0, lods[i].meshlet_count);
+		}
+	}
+
+	write_blob(paths[1], &mesh, lods, lod_count, &meshlets, format, cache_size, metrics);
+	free(mesh.vertices);
+	free(mesh.indices);
+	free(meshlet_triangles);
+	free(meshlets.meshlets);
+	free(meshlets.vertices);
+	free(meshlets.triangles);
+	free(meshlets.axes);
+	free(meshlets.positions);
+	return 0;
+}